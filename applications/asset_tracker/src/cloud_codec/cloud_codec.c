@@ -16,10 +16,14 @@
 #include <modem/modem_info.h>
 #endif /* CONFIG_BSD_LIBRARY */
 #include <date_time.h>
+#include <json_writer.h>
 
 #include "cJSON.h"
 #include "cJSON_os.h"
 #include "cloud_codec.h"
+#if defined(CONFIG_CLOUD_CODEC_CBOR)
+#include "cloud_codec_cbor.h"
+#endif
 
 #include "service_info.h"
 #include "env_sensors.h"
@@ -283,64 +287,136 @@ static int json_add_obj(cJSON *parent, const char *str, cJSON *item)
 	return 0;
 }
 
-static int json_add_str(cJSON *parent, const char *str, const char *item)
+static cJSON *json_object_decode(cJSON *obj, const char *str)
 {
-	cJSON *json_str;
+	return obj ? cJSON_GetObjectItem(obj, str) : NULL;
+}
 
-	json_str = cJSON_CreateString(item);
-	if (json_str == NULL) {
-		return -ENOMEM;
+static bool json_value_string_compare(cJSON *obj, const char *const str)
+{
+	char *json_str = cJSON_GetStringValue(obj);
+
+	if ((json_str == NULL) || (str == NULL)) {
+		return false;
 	}
 
-	return json_add_obj(parent, str, json_str);
+	return (strcmp(json_str, str) == 0);
 }
 
-static int json_add_number(cJSON *parent, const char *str, double item)
+/* Encode in two passes, the first one sizes the output buffer */
+static int json_encode(int (*write)(struct json_writer *w, const void *ctx),
+		       const void *ctx, struct cloud_msg *output)
 {
-	cJSON *json_num;
+	int len;
+	char *buffer;
+	struct json_writer w;
 
-	json_num = cJSON_CreateNumber(item);
-	if (json_num == NULL) {
+	json_writer_init(&w, NULL, 0);
+	(void)write(&w, ctx);
+	len = json_writer_finish(&w);
+	if (len < 0) {
+		return len;
+	}
+
+	buffer = k_malloc(len + 1);
+	if (buffer == NULL) {
 		return -ENOMEM;
 	}
 
-	return json_add_obj(parent, str, json_num);
+	json_writer_init(&w, buffer, len + 1);
+	(void)write(&w, ctx);
+	len = json_writer_finish(&w);
+	if (len < 0) {
+		k_free(buffer);
+		return len;
+	}
+
+	output->buf = buffer;
+	output->len = len;
+
+	return 0;
 }
 
-static int json_add_bool(cJSON *parent, const char *str, const bool value)
+#if defined(CONFIG_CLOUD_CODEC_CBOR)
+/* Same two passes as for JSON, the CBOR encoders also measure */
+static int cbor_encode(int (*encode)(const void *msg, uint8_t *buf,
+				     size_t size),
+		       const void *msg, struct cloud_msg *output)
 {
-	cJSON *json_bool;
+	int len;
+	uint8_t *buffer;
+
+	len = encode(msg, NULL, 0);
+	if (len < 0) {
+		return len;
+	}
 
-	json_bool = cJSON_CreateBool(value);
-	if (json_bool == NULL) {
+	buffer = k_malloc(len);
+	if (buffer == NULL) {
 		return -ENOMEM;
 	}
 
-	return json_add_obj(parent, str, json_bool);
+	len = encode(msg, buffer, len);
+	if (len < 0) {
+		k_free(buffer);
+		return len;
+	}
+
+	output->buf = (char *)buffer;
+	output->len = len;
+
+	return 0;
 }
 
-static cJSON *json_object_decode(cJSON *obj, const char *str)
+static int cbor_data_encode(const void *msg, uint8_t *buf, size_t size)
 {
-	return obj ? cJSON_GetObjectItem(obj, str) : NULL;
+	return cloud_cbor_encode_data(msg, buf, size);
 }
 
-static bool json_value_string_compare(cJSON *obj, const char *const str)
+static int cbor_config_encode(const void *msg, uint8_t *buf, size_t size)
 {
-	char *json_str = cJSON_GetStringValue(obj);
+	return cloud_cbor_encode_config(msg, 1, buf, size);
+}
+#endif /* CONFIG_CLOUD_CODEC_CBOR */
 
-	if ((json_str == NULL) || (str == NULL)) {
-		return false;
-	}
+struct channel_data {
+	const struct cloud_channel_data *channel;
+	enum cloud_cmd_group group;
+	int64_t ts;
+};
 
-	return (strcmp(json_str, str) == 0);
+static int channel_data_write(struct json_writer *w, const void *ctx)
+{
+	const struct channel_data *data = ctx;
+
+	json_writer_obj_start(w, NULL);
+	json_writer_str(w, CMD_CHAN_KEY_STR,
+			channel_type_str[data->channel->type]);
+	json_writer_str(w, CMD_DATA_TYPE_KEY_STR, data->channel->data.buf);
+	json_writer_str(w, CMD_GROUP_KEY_STR, cmd_group_str[data->group]);
+	json_writer_int(w, DATA_TS, data->ts);
+
+	return json_writer_obj_end(w);
 }
 
 int cloud_encode_data(const struct cloud_channel_data *channel,
 		      const enum cloud_cmd_group group,
 		      struct cloud_msg *output)
+{
+	return cloud_encode_data_format(channel, group,
+					CLOUD_CODEC_FORMAT_DEFAULT, output);
+}
+
+int cloud_encode_data_format(const struct cloud_channel_data *channel,
+			     const enum cloud_cmd_group group,
+			     enum cloud_codec_format format,
+			     struct cloud_msg *output)
 {
 	int ret;
-	int64_t data_ts = channel->ts;
+	struct channel_data data = {
+		.channel = channel,
+		.group = group,
+	};
 
 	if (channel == NULL || channel->data.buf == NULL ||
 	    channel->data.len == 0 || output == NULL ||
@@ -348,41 +424,33 @@ int cloud_encode_data(const struct cloud_channel_data *channel,
 		return -EINVAL;
 	}
 
-	cJSON *root_obj = cJSON_CreateObject();
-	if (root_obj == NULL) {
-		cJSON_Delete(root_obj);
-		return -ENOMEM;
-	}
-
 	/** Convert sample uptime to unix time ms. If this function fails the
 	 *  uptime is cleared and an empty timestamp value is encoded.
 	 */
-	ret = date_time_uptime_to_unix_time_ms(&data_ts);
+	data.ts = channel->ts;
+	ret = date_time_uptime_to_unix_time_ms(&data.ts);
 	if (ret) {
 		LOG_WRN("date_time_uptime_to_unix_time_ms, error: %d", ret);
 		LOG_WRN("Clearing timestamp");
-		date_time_timestamp_clear(&data_ts);
+		date_time_timestamp_clear(&data.ts);
 	}
 
-	ret = json_add_str(root_obj, CMD_CHAN_KEY_STR,
-			   channel_type_str[channel->type]);
-	ret += json_add_str(root_obj, CMD_DATA_TYPE_KEY_STR, channel->data.buf);
-	ret += json_add_str(root_obj, CMD_GROUP_KEY_STR, cmd_group_str[group]);
-	ret += json_add_number(root_obj, DATA_TS, data_ts);
-	if (ret != 0) {
-		cJSON_Delete(root_obj);
-		return -ENOMEM;
+	if (format == CLOUD_CODEC_FORMAT_CBOR) {
+#if defined(CONFIG_CLOUD_CODEC_CBOR)
+		struct cloud_cbor_data msg = {
+			.channel = channel->type,
+			.group = group,
+			.data = channel->data.buf,
+			.ts = data.ts,
+		};
+
+		return cbor_encode(cbor_data_encode, &msg, output);
+#else
+		return -ENOTSUP;
+#endif
 	}
 
-	char *buffer;
-
-	buffer = cJSON_PrintUnformatted(root_obj);
-	cJSON_Delete(root_obj);
-
-	output->buf = buffer;
-	output->len = strlen(buffer);
-
-	return 0;
+	return json_encode(channel_data_write, &data, output);
 }
 
 int cloud_encode_env_sensors_data(const env_sensor_data_t *sensor_data,
@@ -503,24 +571,35 @@ int cloud_encode_light_sensor_data(const struct light_sensor_data *sensor_data,
 }
 #endif /* CONFIG_LIGHT_SENSOR */
 
-int cloud_encode_config_data(struct cloud_msg *output)
+static int config_data_write(struct json_writer *w, const void *ctx)
 {
-	__ASSERT_NO_MSG(output != NULL);
+	enum cloud_cmd_state gps_state = *(const enum cloud_cmd_state *)ctx;
+
+	json_writer_obj_start(w, NULL);
+	json_writer_obj_start(w, "state");
+	json_writer_obj_start(w, "reported");
+	json_writer_obj_start(w, "config");
+	json_writer_obj_start(w, channel_type_str[CLOUD_CHANNEL_GPS]);
+	json_writer_bool(w, cmd_type_str[CLOUD_CMD_ENABLE],
+			 gps_state == CLOUD_CMD_STATE_TRUE);
+	json_writer_obj_end(w);
+	json_writer_obj_end(w);
+	json_writer_obj_end(w);
+	json_writer_obj_end(w);
+
+	return json_writer_obj_end(w);
+}
 
-	cJSON *chan_obj = cJSON_CreateObject();
-	cJSON *state_obj = cJSON_CreateObject();
-	cJSON *reported_obj = cJSON_CreateObject();
-	cJSON *config_obj = cJSON_CreateObject();
-	cJSON *root_obj = cJSON_CreateObject();
-	int ret = 0;
-	char *buffer;
+int cloud_encode_config_data(struct cloud_msg *output)
+{
+	return cloud_encode_config_data_format(CLOUD_CODEC_FORMAT_DEFAULT,
+					       output);
+}
 
-	if (chan_obj == NULL || state_obj == NULL ||
-	    reported_obj == NULL || config_obj == NULL ||
-		root_obj == NULL) {
-		ret = -ENOMEM;
-		goto cleanup;
-	}
+int cloud_encode_config_data_format(enum cloud_codec_format format,
+				    struct cloud_msg *output)
+{
+	__ASSERT_NO_MSG(output != NULL);
 
 	/* Currently, the only value that can be changed from
 	 * the device is GPS enable, so it is the only
@@ -529,45 +608,28 @@ int cloud_encode_config_data(struct cloud_msg *output)
 	enum cloud_cmd_state gps_state =
 		cloud_get_channel_enable_state(CLOUD_CHANNEL_GPS);
 
-	if (gps_state != CLOUD_CMD_STATE_UNDEFINED) {
-		ret = json_add_bool(chan_obj, cmd_type_str[CLOUD_CMD_ENABLE],
-				gps_state == CLOUD_CMD_STATE_TRUE);
-		if (ret != 0) {
-			ret = -ENOMEM;
-			goto cleanup;
-		}
-	}
+	output->buf = NULL;
+	output->len = 0;
 
-	/* No items in chan_obj is not an error, there
-	 * is just nothing to report
-	 */
-	if (cJSON_GetArraySize(chan_obj) == 0) {
-		goto cleanup;
+	/* Nothing to report is not an error */
+	if (gps_state == CLOUD_CMD_STATE_UNDEFINED) {
+		return 0;
 	}
 
-	cJSON_AddItemToObject(config_obj, channel_type_str[CLOUD_CHANNEL_GPS],
-			      chan_obj);
-	cJSON_AddItemToObject(reported_obj, "config", config_obj);
-	cJSON_AddItemToObject(state_obj, "reported", reported_obj);
-	cJSON_AddItemToObject(root_obj, "state", state_obj);
-
-	buffer = cJSON_PrintUnformatted(root_obj);
-	cJSON_Delete(root_obj);
-	output->buf = buffer;
-	output->len = strlen(buffer);
-
-	return 0;
+	if (format == CLOUD_CODEC_FORMAT_CBOR) {
+#if defined(CONFIG_CLOUD_CODEC_CBOR)
+		struct cloud_cbor_config cfg = {
+			.channel = CLOUD_CHANNEL_GPS,
+			.enable = (gps_state == CLOUD_CMD_STATE_TRUE),
+		};
 
-cleanup:
-	output->buf = NULL;
-	output->len = 0;
-	cJSON_Delete(chan_obj);
-	cJSON_Delete(state_obj);
-	cJSON_Delete(reported_obj);
-	cJSON_Delete(config_obj);
-	cJSON_Delete(root_obj);
+		return cbor_encode(cbor_config_encode, &cfg, output);
+#else
+		return -ENOTSUP;
+#endif
+	}
 
-	return ret;
+	return json_encode(config_data_write, &gps_state, output);
 }
 
 int cloud_encode_device_status_data(
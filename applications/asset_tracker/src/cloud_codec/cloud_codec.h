@@ -193,8 +193,22 @@ struct cloud_command {
 
 typedef void (*cloud_cmd_cb_t)(struct cloud_command *cmd);
 
+/** @brief Encoding of the messages sent to the cloud. */
+enum cloud_codec_format {
+	/** JSON, with the channel and command names as strings. */
+	CLOUD_CODEC_FORMAT_JSON,
+	/** CBOR, with the integer keys defined in cloud_codec_cbor.h. */
+	CLOUD_CODEC_FORMAT_CBOR,
+};
+
+#if defined(CONFIG_CLOUD_CODEC_CBOR_DEFAULT)
+#define CLOUD_CODEC_FORMAT_DEFAULT CLOUD_CODEC_FORMAT_CBOR
+#else
+#define CLOUD_CODEC_FORMAT_DEFAULT CLOUD_CODEC_FORMAT_JSON
+#endif
+
 /**
- * @brief Encode cloud data.
+ * @brief Encode cloud data in the default format.
  *
  * @param channel The cloud channel type.
  * @param group The channel data's group.
@@ -205,6 +219,22 @@ typedef void (*cloud_cmd_cb_t)(struct cloud_command *cmd);
 int cloud_encode_data(const struct cloud_channel_data *channel,
 	const enum cloud_cmd_group group, struct cloud_msg *output);
 
+/**
+ * @brief Encode cloud data in the given format.
+ *
+ * @param channel The cloud channel type.
+ * @param group The channel data's group.
+ * @param format The encoding of the message.
+ * @param output Pointer to the cloud data output.
+ *
+ * @return 0 if the operation was successful, -ENOTSUP if the format is not
+ *         enabled, otherwise a (negative) error code.
+ */
+int cloud_encode_data_format(const struct cloud_channel_data *channel,
+			     const enum cloud_cmd_group group,
+			     enum cloud_codec_format format,
+			     struct cloud_msg *output);
+
 /**
  * @brief Decode cloud data.
  *
@@ -248,7 +278,7 @@ int cloud_encode_device_status_data(
 
 /**
  * @brief Encode device config data to be transmitted to the
- *        shadow/digital twin.
+ *        shadow/digital twin, in the default format.
  *
  * @param output Pointer to encoded data structure.
  *
@@ -257,6 +287,19 @@ int cloud_encode_device_status_data(
  */
 int cloud_encode_config_data(struct cloud_msg *output);
 
+/**
+ * @brief Encode device config data to be transmitted to the
+ *        shadow/digital twin, in the given format.
+ *
+ * @param format The encoding of the message.
+ * @param output Pointer to encoded data structure.
+ *
+ * @return 0 if the operation was successful, -ENOTSUP if the format is
+ *         not enabled, otherwise a (negative) error code.
+ */
+int cloud_encode_config_data_format(enum cloud_codec_format format,
+				    struct cloud_msg *output);
+
 /**
  * @brief Releases memory used by cloud data structure.
  *
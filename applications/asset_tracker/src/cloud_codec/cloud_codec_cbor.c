@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <tinycbor/cbor.h>
+#include <tinycbor/cbor_buf_reader.h>
+#include <tinycbor/cbor_buf_writer.h>
+
+#include "cloud_codec_cbor.h"
+
+/* Writer that only counts the bytes, used to size the output buffer */
+static int count_write(struct cbor_encoder_writer *writer,
+		       const char *data, int len)
+{
+	ARG_UNUSED(data);
+
+	writer->bytes_written += len;
+
+	return CborNoError;
+}
+
+typedef CborError (*cbor_encode_fn)(CborEncoder *enc, const void *ctx);
+
+static int cbor_encode(cbor_encode_fn encode, const void *ctx,
+		       uint8_t *buf, size_t size)
+{
+	CborError err;
+	CborEncoder enc;
+	struct cbor_buf_writer buf_writer;
+	struct cbor_encoder_writer count_writer = {
+		.write = count_write,
+	};
+	struct cbor_encoder_writer *writer = &count_writer;
+
+	if (buf != NULL) {
+		cbor_buf_writer_init(&buf_writer, buf, size);
+		writer = &buf_writer.enc;
+	}
+
+	cbor_encoder_init(&enc, writer, 0);
+	err = encode(&enc, ctx);
+
+	if (err == CborErrorOutOfMemory) {
+		return -ENOMEM;
+	} else if (err != CborNoError) {
+		return -EINVAL;
+	}
+
+	return writer->bytes_written;
+}
+
+static CborError data_encode(CborEncoder *enc, const void *ctx)
+{
+	const struct cloud_cbor_data *msg = ctx;
+	CborEncoder map;
+	CborError err;
+
+	err = cbor_encoder_create_map(enc, &map, 4);
+	err |= cbor_encode_uint(&map, CLOUD_CBOR_KEY_CHANNEL);
+	err |= cbor_encode_uint(&map, msg->channel);
+	err |= cbor_encode_uint(&map, CLOUD_CBOR_KEY_DATA);
+	err |= cbor_encode_text_stringz(&map, msg->data);
+	err |= cbor_encode_uint(&map, CLOUD_CBOR_KEY_GROUP);
+	err |= cbor_encode_uint(&map, msg->group);
+	err |= cbor_encode_uint(&map, CLOUD_CBOR_KEY_TS);
+	err |= cbor_encode_int(&map, msg->ts);
+	err |= cbor_encoder_close_container(enc, &map);
+
+	/* Out of memory is the only error that can be combined */
+	return (err & ~CborErrorOutOfMemory) ? CborErrorInternalError : err;
+}
+
+int cloud_cbor_encode_data(const struct cloud_cbor_data *msg,
+			   uint8_t *buf, size_t size)
+{
+	if (msg == NULL || msg->data == NULL) {
+		return -EINVAL;
+	}
+
+	return cbor_encode(data_encode, msg, buf, size);
+}
+
+struct config_list {
+	const struct cloud_cbor_config *cfg;
+	size_t count;
+};
+
+static CborError config_encode(CborEncoder *enc, const void *ctx)
+{
+	const struct config_list *list = ctx;
+	CborEncoder root;
+	CborEncoder state;
+	CborEncoder reported;
+	CborEncoder config;
+	CborError err;
+
+	err = cbor_encoder_create_map(enc, &root, 1);
+	err |= cbor_encode_uint(&root, CLOUD_CBOR_KEY_STATE);
+	err |= cbor_encoder_create_map(&root, &state, 1);
+	err |= cbor_encode_uint(&state, CLOUD_CBOR_KEY_REPORTED);
+	err |= cbor_encoder_create_map(&state, &reported, 1);
+	err |= cbor_encode_uint(&reported, CLOUD_CBOR_KEY_CONFIG);
+	err |= cbor_encoder_create_map(&reported, &config, list->count);
+
+	for (size_t i = 0; i < list->count; i++) {
+		CborEncoder channel;
+
+		err |= cbor_encode_uint(&config, list->cfg[i].channel);
+		err |= cbor_encoder_create_map(&config, &channel, 1);
+		err |= cbor_encode_uint(&channel, CLOUD_CBOR_KEY_ENABLE);
+		err |= cbor_encode_boolean(&channel, list->cfg[i].enable);
+		err |= cbor_encoder_close_container(&config, &channel);
+	}
+
+	err |= cbor_encoder_close_container(&reported, &config);
+	err |= cbor_encoder_close_container(&state, &reported);
+	err |= cbor_encoder_close_container(&root, &state);
+	err |= cbor_encoder_close_container(enc, &root);
+
+	return (err & ~CborErrorOutOfMemory) ? CborErrorInternalError : err;
+}
+
+int cloud_cbor_encode_config(const struct cloud_cbor_config *cfg,
+			     size_t count, uint8_t *buf, size_t size)
+{
+	struct config_list list = {
+		.cfg = cfg,
+		.count = count,
+	};
+
+	if (cfg == NULL && count > 0) {
+		return -EINVAL;
+	}
+
+	return cbor_encode(config_encode, &list, buf, size);
+}
+
+static int uint32_get(CborValue *it, uint32_t *result)
+{
+	uint64_t value;
+
+	if (!cbor_value_is_unsigned_integer(it) ||
+	    cbor_value_get_uint64(it, &value) != CborNoError ||
+	    value > UINT32_MAX ||
+	    cbor_value_advance_fixed(it) != CborNoError) {
+		return -EBADMSG;
+	}
+
+	*result = value;
+
+	return 0;
+}
+
+int cloud_cbor_decode_data(const uint8_t *buf, size_t len,
+			   struct cloud_cbor_data *msg,
+			   char *data, size_t data_size)
+{
+	struct cbor_buf_reader reader;
+	CborParser parser;
+	CborValue value;
+	CborValue map;
+	uint32_t found = 0;
+	uint32_t key;
+	int err;
+
+	if (buf == NULL || msg == NULL || data == NULL) {
+		return -EINVAL;
+	}
+
+	cbor_buf_reader_init(&reader, buf, len);
+
+	if (cbor_parser_init(&reader.r, 0, &parser, &value) != CborNoError ||
+	    !cbor_value_is_map(&value) ||
+	    cbor_value_enter_container(&value, &map) != CborNoError) {
+		return -EBADMSG;
+	}
+
+	while (!cbor_value_at_end(&map)) {
+		if (uint32_get(&map, &key)) {
+			return -EBADMSG;
+		}
+
+		switch (key) {
+		case CLOUD_CBOR_KEY_CHANNEL:
+			err = uint32_get(&map, &msg->channel);
+			break;
+		case CLOUD_CBOR_KEY_GROUP:
+			err = uint32_get(&map, &msg->group);
+			break;
+		case CLOUD_CBOR_KEY_TS:
+			err = (!cbor_value_is_integer(&map) ||
+			       cbor_value_get_int64(&map, &msg->ts) ||
+			       cbor_value_advance_fixed(&map)) ? -EBADMSG : 0;
+			break;
+		case CLOUD_CBOR_KEY_DATA: {
+			size_t size = data_size;
+
+			if (!cbor_value_is_text_string(&map)) {
+				return -EBADMSG;
+			}
+
+			switch (cbor_value_copy_text_string(&map, data, &size,
+							    &map)) {
+			case CborNoError:
+				/* Not terminated if it exactly fits */
+				err = (size < data_size) ? 0 : -ENOMEM;
+				break;
+			case CborErrorOutOfMemory:
+				err = -ENOMEM;
+				break;
+			default:
+				err = -EBADMSG;
+				break;
+			}
+			break;
+		}
+		default:
+			/* Added in a later version of the schema */
+			err = (cbor_value_advance(&map) == CborNoError) ?
+			      0 : -EBADMSG;
+			key = UINT32_MAX;
+			break;
+		}
+
+		if (err) {
+			return err;
+		}
+
+		if (key < 32) {
+			found |= BIT(key);
+		}
+	}
+
+	if (found != (BIT(CLOUD_CBOR_KEY_CHANNEL) | BIT(CLOUD_CBOR_KEY_DATA) |
+		      BIT(CLOUD_CBOR_KEY_GROUP) | BIT(CLOUD_CBOR_KEY_TS))) {
+		return -EBADMSG;
+	}
+
+	msg->data = data;
+
+	return 0;
+}
+
+/* Enter the map stored under key in the map at it, skipping other keys */
+static int map_enter(CborValue *it, uint32_t key, CborValue *inner)
+{
+	uint32_t k;
+
+	while (!cbor_value_at_end(it)) {
+		if (uint32_get(it, &k)) {
+			return -EBADMSG;
+		}
+
+		if (k == key) {
+			if (!cbor_value_is_map(it) ||
+			    cbor_value_enter_container(it, inner)) {
+				return -EBADMSG;
+			}
+			return 0;
+		}
+
+		if (cbor_value_advance(it)) {
+			return -EBADMSG;
+		}
+	}
+
+	return -EBADMSG;
+}
+
+int cloud_cbor_decode_config(const uint8_t *buf, size_t len,
+			     struct cloud_cbor_config *cfg, size_t max)
+{
+	struct cbor_buf_reader reader;
+	CborParser parser;
+	CborValue value;
+	CborValue root;
+	CborValue state;
+	CborValue reported;
+	CborValue config;
+	size_t count = 0;
+
+	if (buf == NULL || (cfg == NULL && max > 0)) {
+		return -EINVAL;
+	}
+
+	cbor_buf_reader_init(&reader, buf, len);
+
+	if (cbor_parser_init(&reader.r, 0, &parser, &value) != CborNoError ||
+	    !cbor_value_is_map(&value) ||
+	    cbor_value_enter_container(&value, &root) != CborNoError ||
+	    map_enter(&root, CLOUD_CBOR_KEY_STATE, &state) ||
+	    map_enter(&state, CLOUD_CBOR_KEY_REPORTED, &reported) ||
+	    map_enter(&reported, CLOUD_CBOR_KEY_CONFIG, &config)) {
+		return -EBADMSG;
+	}
+
+	while (!cbor_value_at_end(&config)) {
+		CborValue channel;
+		uint32_t channel_key;
+		bool has_enable = false;
+
+		if (count >= max) {
+			return -ENOMEM;
+		}
+
+		if (uint32_get(&config, &cfg[count].channel) ||
+		    !cbor_value_is_map(&config) ||
+		    cbor_value_enter_container(&config, &channel)) {
+			return -EBADMSG;
+		}
+
+		while (!cbor_value_at_end(&channel)) {
+			if (uint32_get(&channel, &channel_key)) {
+				return -EBADMSG;
+			}
+
+			if (channel_key == CLOUD_CBOR_KEY_ENABLE) {
+				if (!cbor_value_is_boolean(&channel) ||
+				    cbor_value_get_boolean(&channel,
+							   &cfg[count].enable) ||
+				    cbor_value_advance_fixed(&channel)) {
+					return -EBADMSG;
+				}
+				has_enable = true;
+			} else if (cbor_value_advance(&channel)) {
+				return -EBADMSG;
+			}
+		}
+
+		/* An entry without the enable key is not valid */
+		if (!has_enable ||
+		    cbor_value_leave_container(&config, &channel)) {
+			return -EBADMSG;
+		}
+
+		count++;
+	}
+
+	return count;
+}
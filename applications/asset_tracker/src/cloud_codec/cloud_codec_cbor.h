@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+/**@file
+ *
+ * @defgroup cloud_codec_cbor Cloud codec CBOR schema
+ * @brief  CBOR encoding of the messages sent by the cloud codec.
+ *
+ * Messages are CBOR maps with the integer keys of @ref cloud_cbor_key
+ * instead of the member names used in JSON. Channels and command groups
+ * are encoded as the values of @ref cloud_channel and @ref cloud_cmd_group.
+ * The same definitions are used by the encoder and the decoder, and all of
+ * them are part of the wire format.
+ *
+ * Data message:
+ *
+ * @code
+ * { CHANNEL: uint, DATA: tstr, GROUP: uint, TS: int }
+ * @endcode
+ *
+ * Configuration report, with one entry per channel:
+ *
+ * @code
+ * { STATE: { REPORTED: { CONFIG: { channel: { ENABLE: bool } } } } }
+ * @endcode
+ * @{
+ */
+
+#ifndef CLOUD_CODEC_CBOR_H__
+#define CLOUD_CODEC_CBOR_H__
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Map keys. The values must never be changed or reused. */
+enum cloud_cbor_key {
+	CLOUD_CBOR_KEY_CHANNEL = 0,
+	CLOUD_CBOR_KEY_DATA = 1,
+	CLOUD_CBOR_KEY_GROUP = 2,
+	CLOUD_CBOR_KEY_TS = 3,
+	CLOUD_CBOR_KEY_STATE = 4,
+	CLOUD_CBOR_KEY_REPORTED = 5,
+	CLOUD_CBOR_KEY_CONFIG = 6,
+	CLOUD_CBOR_KEY_ENABLE = 7,
+};
+
+/** @brief Data message. */
+struct cloud_cbor_data {
+	/** Channel, see @ref cloud_channel. */
+	uint32_t channel;
+	/** Command group, see @ref cloud_cmd_group. */
+	uint32_t group;
+	/** Null-terminated channel data. */
+	const char *data;
+	/** Unix time in milliseconds, 0 if unknown. */
+	int64_t ts;
+};
+
+/** @brief Configuration of a channel. */
+struct cloud_cbor_config {
+	/** Channel, see @ref cloud_channel. */
+	uint32_t channel;
+	/** Whether the channel is enabled. */
+	bool enable;
+};
+
+/**
+ * @brief Encode a data message.
+ *
+ * @param msg Message.
+ * @param buf Output buffer, or NULL to only measure the message.
+ * @param size Size of the output buffer.
+ *
+ * @return Length of the message if the operation was successful, -ENOMEM
+ *         if it does not fit the buffer, otherwise a (negative) error code.
+ */
+int cloud_cbor_encode_data(const struct cloud_cbor_data *msg,
+			   uint8_t *buf, size_t size);
+
+/**
+ * @brief Decode a data message.
+ *
+ * Unknown keys are skipped.
+ *
+ * @param buf Encoded message.
+ * @param len Length of the encoded message.
+ * @param msg Decoded message. Its data points to @p data.
+ * @param data Buffer for the channel data.
+ * @param data_size Size of @p data.
+ *
+ * @return 0 if the operation was successful, -EBADMSG if the message does
+ *         not match the schema, -ENOMEM if the channel data does not fit.
+ */
+int cloud_cbor_decode_data(const uint8_t *buf, size_t len,
+			   struct cloud_cbor_data *msg,
+			   char *data, size_t data_size);
+
+/**
+ * @brief Encode a configuration report.
+ *
+ * @param cfg Channel configurations.
+ * @param count Number of channel configurations.
+ * @param buf Output buffer, or NULL to only measure the message.
+ * @param size Size of the output buffer.
+ *
+ * @return Length of the message if the operation was successful, -ENOMEM
+ *         if it does not fit the buffer, otherwise a (negative) error code.
+ */
+int cloud_cbor_encode_config(const struct cloud_cbor_config *cfg,
+			     size_t count, uint8_t *buf, size_t size);
+
+/**
+ * @brief Decode a configuration report.
+ *
+ * @param buf Encoded message.
+ * @param len Length of the encoded message.
+ * @param cfg Decoded channel configurations.
+ * @param max Number of entries in @p cfg.
+ *
+ * @return Number of channel configurations if the operation was successful,
+ *         -EBADMSG if the message does not match the schema, -ENOMEM if
+ *         it has more than @p max channels.
+ */
+int cloud_cbor_decode_config(const uint8_t *buf, size_t len,
+			     struct cloud_cbor_config *cfg, size_t max);
+
+/**
+ * @}
+ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLOUD_CODEC_CBOR_H__ */
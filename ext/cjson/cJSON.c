@@ -208,6 +208,12 @@ CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
     }
 }
 
+CJSON_PUBLIC(void) cJSON_GetHooks(cJSON_Hooks* hooks)
+{
+    hooks->malloc_fn = global_hooks.allocate;
+    hooks->free_fn = global_hooks.deallocate;
+}
+
 /* Internal constructor. */
 static cJSON *cJSON_New_Item(const internal_hooks * const hooks)
 {
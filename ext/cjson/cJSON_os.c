@@ -7,15 +7,133 @@
 #include "cJSON_os.h"
 #include "cJSON.h"
 #include <stdint.h>
+#include <string.h>
 #include <zephyr.h>
 
+/* Enough for any member of a cJSON item */
+#define ARENA_ALIGN 8
+/* Heap allocations of an arena are chained through a header */
+#define OVERFLOW_HDR ROUND_UP(sizeof(void *), ARENA_ALIGN)
+
 static cJSON_Hooks _cjson_hooks;
+static bool hooks_installed;
+
+/* Hooks of the application, kept while arenas are active. Allocations
+ * outside of arenas are passed on to them.
+ */
+static cJSON_Hooks app_hooks;
+static bool app_hooks_saved;
+
+/* Active arenas of all threads, the last one started first */
+static struct cJSON_arena *arenas;
+static struct k_spinlock arenas_lock;
+
+static struct cJSON_arena *arena_find(const void *ptr)
+{
+	struct cJSON_arena *arena;
+	k_tid_t tid = k_current_get();
+	k_spinlock_key_t key = k_spin_lock(&arenas_lock);
+
+	for (arena = arenas; arena != NULL; arena = arena->next) {
+		if (arena->owner != tid) {
+			continue;
+		}
+		if (ptr == NULL) {
+			break;
+		}
+		if ((const uint8_t *)ptr >= arena->buf &&
+		    (const uint8_t *)ptr < arena->buf + arena->size) {
+			break;
+		}
+		for (void **node = &arena->overflow; *node != NULL;
+		     node = (void **)*node) {
+			if ((uint8_t *)*node + OVERFLOW_HDR == ptr) {
+				goto out;
+			}
+		}
+	}
+
+out:
+	k_spin_unlock(&arenas_lock, key);
+
+	return arena;
+}
+
+static void *arena_alloc(struct cJSON_arena *arena, size_t sz)
+{
+	void **node;
+
+	sz = ROUND_UP(sz, ARENA_ALIGN);
+
+	if (sz <= arena->size - arena->used) {
+		arena->last = arena->used;
+		arena->used += sz;
+		arena->peak = MAX(arena->peak, arena->used);
+		return arena->buf + arena->last;
+	}
+
+	node = k_malloc(OVERFLOW_HDR + sz);
+	if (node == NULL) {
+		return NULL;
+	}
+
+	*node = arena->overflow;
+	arena->overflow = node;
+	arena->overflow_count++;
+
+	return (uint8_t *)node + OVERFLOW_HDR;
+}
+
+static void arena_free(struct cJSON_arena *arena, void *ptr)
+{
+	void **node;
+
+	if ((uint8_t *)ptr >= arena->buf &&
+	    (uint8_t *)ptr < arena->buf + arena->size) {
+		/* Temporary buffers are often freed right away */
+		if ((uint8_t *)ptr == arena->buf + arena->last) {
+			arena->used = arena->last;
+		}
+		return;
+	}
+
+	for (node = &arena->overflow; *node != NULL; node = (void **)*node) {
+		if ((uint8_t *)*node + OVERFLOW_HDR == ptr) {
+			void *block = *node;
+
+			*node = *(void **)block;
+			k_free(block);
+			return;
+		}
+	}
+}
 
 /**@brief malloc() function definition. */
-static void *malloc_fn_hook(size_t sz) { return k_malloc(sz); }
+static void *malloc_fn_hook(size_t sz)
+{
+	struct cJSON_arena *arena = arenas ? arena_find(NULL) : NULL;
+
+	if (arena) {
+		return arena_alloc(arena, sz);
+	}
+
+	return app_hooks_saved ? app_hooks.malloc_fn(sz) : k_malloc(sz);
+}
 
 /**@brief free() function definition. */
-static void free_fn_hook(void *p_ptr) { k_free(p_ptr); }
+static void free_fn_hook(void *p_ptr)
+{
+	struct cJSON_arena *arena =
+		(arenas && p_ptr) ? arena_find(p_ptr) : NULL;
+
+	if (arena) {
+		arena_free(arena, p_ptr);
+	} else if (app_hooks_saved) {
+		app_hooks.free_fn(p_ptr);
+	} else {
+		k_free(p_ptr);
+	}
+}
 
 /**@brief Initialize cJSON by assigning function hooks. */
 void cJSON_Init(void)
@@ -23,10 +141,89 @@ void cJSON_Init(void)
 	_cjson_hooks.malloc_fn = malloc_fn_hook;
 	_cjson_hooks.free_fn = free_fn_hook;
 
+	/* The application chose these hooks, they are kept after arenas */
+	app_hooks_saved = false;
+
 	cJSON_InitHooks(&_cjson_hooks);
+	hooks_installed = true;
 }
 
 void cJSON_FreeString(char *ptr)
 {
-	free_fn_hook(ptr);
+	cJSON_free(ptr);
+}
+
+void cJSON_ArenaBegin(struct cJSON_arena *arena, void *buf, size_t size)
+{
+	k_spinlock_key_t key;
+
+	memset(arena, 0, sizeof(*arena));
+
+	if (buf == NULL && size > 0) {
+		/* Without memory, all allocations go to the heap as usual */
+		buf = k_malloc(size);
+		arena->mem = buf;
+	}
+
+	if (buf != NULL) {
+		/* Align the start, so that all allocations are aligned */
+		uintptr_t start = ROUND_UP((uintptr_t)buf, ARENA_ALIGN);
+		size_t skip = start - (uintptr_t)buf;
+
+		arena->buf = (uint8_t *)start;
+		arena->size = size > skip ? size - skip : 0;
+	}
+
+	arena->owner = k_current_get();
+
+	key = k_spin_lock(&arenas_lock);
+
+	/* Hooks installed by the application are swapped for the OS hooks
+	 * until the last arena ends.
+	 */
+	if (arenas == NULL && !hooks_installed) {
+		cJSON_GetHooks(&app_hooks);
+		app_hooks_saved = true;
+
+		_cjson_hooks.malloc_fn = malloc_fn_hook;
+		_cjson_hooks.free_fn = free_fn_hook;
+		cJSON_InitHooks(&_cjson_hooks);
+	}
+
+	arena->next = arenas;
+	arenas = arena;
+	k_spin_unlock(&arenas_lock, key);
+}
+
+void cJSON_ArenaEnd(struct cJSON_arena *arena)
+{
+	k_spinlock_key_t key;
+	void *node;
+
+	key = k_spin_lock(&arenas_lock);
+	for (struct cJSON_arena **a = &arenas; *a != NULL; a = &(*a)->next) {
+		if (*a == arena) {
+			*a = arena->next;
+			break;
+		}
+	}
+
+	if (arenas == NULL && app_hooks_saved) {
+		cJSON_InitHooks(&app_hooks);
+		app_hooks_saved = false;
+	}
+	k_spin_unlock(&arenas_lock, key);
+
+	while (arena->overflow != NULL) {
+		node = arena->overflow;
+		arena->overflow = *(void **)node;
+		k_free(node);
+	}
+
+	k_free(arena->mem);
+
+	arena->mem = NULL;
+	arena->buf = NULL;
+	arena->size = 0;
+	arena->used = 0;
 }
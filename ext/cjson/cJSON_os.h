@@ -8,6 +8,43 @@
 #define cJSON_OS_H__
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <zephyr.h>
+
+/**
+ * @brief Scoped arena for cJSON allocations.
+ *
+ * Between cJSON_ArenaBegin() and cJSON_ArenaEnd(), the allocations cJSON
+ * makes in the calling thread are carved from one block of memory, which
+ * is released at once when the arena ends. Allocations that do not fit
+ * are served by the heap, and are also released when the arena ends.
+ *
+ * The members are internal, but the statistics can be read to size the
+ * arena.
+ */
+struct cJSON_arena {
+	/** Memory of the arena. */
+	uint8_t *buf;
+	/** Size of the memory. */
+	size_t size;
+	/** Bytes handed out. */
+	size_t used;
+	/** Offset of the last allocation, which can be taken back. */
+	size_t last;
+	/** Most bytes handed out at once. */
+	size_t peak;
+	/** Memory allocated by cJSON_ArenaBegin(), if any. */
+	void *mem;
+	/** Allocations that did not fit, from the heap. */
+	void *overflow;
+	/** Number of allocations that did not fit. */
+	uint32_t overflow_count;
+	/** Thread using the arena. */
+	k_tid_t owner;
+	/** Next active arena, of any thread. */
+	struct cJSON_arena *next;
+};
 
 /**
  * @brief Initialize cJSON with OS hooks.
@@ -21,4 +58,31 @@ void cJSON_Init(void);
  */
 void cJSON_FreeString(char *ptr);
 
+/**
+ * @brief Start allocating from an arena in the calling thread.
+ *
+ * If the application installed its own hooks instead of calling
+ * cJSON_Init(), the OS hooks replace them until the last active arena
+ * ends. Meanwhile, allocations outside of arenas are passed on to the
+ * hooks of the application, which must not be changed. Arenas can be
+ * nested, the last one started is used.
+ *
+ * @param arena IN -- arena to start
+ * @param buf IN -- memory of the arena, or NULL to allocate
+ *                  @p size bytes from the heap
+ * @param size IN -- size of the memory
+ */
+void cJSON_ArenaBegin(struct cJSON_arena *arena, void *buf, size_t size);
+
+/**
+ * @brief Stop allocating from an arena and release all of its memory.
+ *
+ * Items and strings allocated from the arena must not be used after
+ * this, and need not be deleted before. Arenas must be ended in the
+ * reverse order of starting them.
+ *
+ * @param arena IN -- arena to end
+ */
+void cJSON_ArenaEnd(struct cJSON_arena *arena);
+
 #endif /* cJSON_OS_H__ */
@@ -22,6 +22,8 @@ extern "C" {
 
 #define DFU_TARGET_IMAGE_TYPE_MCUBOOT 1
 #define DFU_TARGET_IMAGE_TYPE_MODEM_DELTA 2
+#define DFU_TARGET_IMAGE_TYPE_COMPRESSED 3
+#define DFU_TARGET_IMAGE_TYPE_DELTA 4
 
 enum dfu_target_evt_id {
 	DFU_TARGET_EVT_TIMEOUT,
@@ -37,6 +39,8 @@ struct dfu_target {
 	int (*offset_get)(size_t *offset);
 	int (*write)(const void *const buf, size_t len);
 	int (*done)(bool successful);
+	int (*schedule_update)(void);
+	int (*cancel_update)(void);
 };
 
 /**
@@ -68,8 +72,9 @@ int dfu_target_img_type(const void *const buf, size_t len);
  * @param[in] cb Callback function in case the DFU operation requires additional
  *		 proceedures to be called.
  *
- * @return 0 for a supported image type or a negative error
- *	   code identicating reason of failure.
+ * @return 0 for a supported image type, -EEXIST if the image would
+ *	   overwrite an image staged with @ref dfu_target_stage, or a negative
+ *	   error code identicating reason of failure.
  *
  **/
 int dfu_target_init(int img_type, size_t file_size, dfu_target_callback_t cb);
@@ -77,15 +82,35 @@ int dfu_target_init(int img_type, size_t file_size, dfu_target_callback_t cb);
 /**
  * @brief Get offset of the firmware upgrade
  *
+ *	  If @option{CONFIG_DFU_TARGET_ASYNC} is enabled, the offset includes
+ *	  data which is buffered, but not yet written to the DFU target. Call
+ *	  @ref dfu_target_flush first to get the offset of the stored data.
+ *
  * @param[out] offset Returns the offset of the firmware upgrade.
  *
  * @return 0 if success, otherwise negative value if unable to get the offset
  */
 int dfu_target_offset_get(size_t *offset);
 
+/**
+ * @brief Write all buffered data to the DFU target, and wait until it is
+ *	  written.
+ *
+ *	  Does nothing unless @option{CONFIG_DFU_TARGET_ASYNC} is enabled.
+ *
+ * @return 0 if success, otherwise negative value if the data could not be
+ *	   written.
+ */
+int dfu_target_flush(void);
+
 /**
  * @brief Write the given buffer to the initialized DFU target.
  *
+ *	  If @option{CONFIG_DFU_TARGET_ASYNC} is enabled, the data is copied
+ *	  and written to the DFU target in a separate thread. The function
+ *	  blocks while both write buffers are in use. An error from the DFU
+ *	  target is returned by a later call.
+ *
  * @param[in] buf A buffer of bytes which contains part of an binary firmware
  *		  image.
  * @param[in] len The length of the provided buffer.
@@ -99,23 +124,79 @@ int dfu_target_write(const void *const buf, size_t len);
  * @brief Deinitialize the resources that were needed for the current DFU
  *	  target.
  *
+ *	  If @option{CONFIG_DFU_TARGET_STREAM_HASH} is enabled and the
+ *	  process completed successfully, the SHA-256 digest of the image is
+ *	  compared with the expected digest before the image is marked as
+ *	  ready to be booted. If the digests differ, the process is aborted.
+ *
  * @param[in] successful Indicate whether the process completed successfully or
  *			 was aborted.
  *
- * @return 0 for an successful deinitialization or a negative error
+ * @return 0 for an successful deinitialization, -EBADMSG if the digest of
+ *	   the image does not match, or another negative error
  *	   code identicating reason of failure.
  **/
 int dfu_target_done(bool successful);
 
+/**
+ * @brief Finish the image of the current DFU target without scheduling
+ *	  the upgrade.
+ *
+ *	  The image is completed and verified as by @ref dfu_target_done, but
+ *	  it is only marked as ready to be booted by
+ *	  @ref dfu_target_schedule_update. Use this to download several images
+ *	  and upgrade all of them, or none. One modem image and one image
+ *	  for MCUboot can be staged at a time.
+ *
+ * @return 0 if the image was staged, or a negative error code
+ *	   identicating reason of failure.
+ **/
+int dfu_target_stage(void);
+
+/**
+ * @brief Schedule the upgrade of all images staged with
+ *	  @ref dfu_target_stage.
+ *
+ *	  The upgrade of the modem can not be cancelled once it has been
+ *	  scheduled, so the modem image is scheduled last. If an upgrade can
+ *	  not be scheduled, the upgrades scheduled before it are cancelled.
+ *
+ * @return 0 if all upgrades were scheduled, or a negative error code
+ *	   identicating reason of failure.
+ **/
+int dfu_target_schedule_update(void);
+
 /**
  * @brief Deinitialize the resources that were needed for the current DFU
  *	  target if any and resets the current dfu target.
  *
+ *	  Images staged with @ref dfu_target_stage are not scheduled.
+ *
  * @return 0 for an successful deinitialization and reset or a negative error
  *	   code identicating reason of failure.
  **/
 int dfu_target_reset(void);
 
+/**
+ * @brief Set the expected SHA-256 digest of the next image, for example
+ *	  from a job document.
+ *
+ *	  The digest is compared with the hash of the whole image file by
+ *	  @ref dfu_target_done, in addition to the digest in the TLVs of
+ *	  MCUboot images. If the image could not be hashed, for example
+ *	  because its download was resumed after a reset, it is rejected.
+ *	  The digest applies to one image only. It is cleared when the
+ *	  image is aborted with @ref dfu_target_done or
+ *	  @ref dfu_target_reset.
+ *	  Requires @option{CONFIG_DFU_TARGET_STREAM_HASH}.
+ *
+ * @param[in] digest SHA-256 digest of the image file, or NULL to clear it.
+ * @param[in] len Length of the digest, in bytes.
+ *
+ * @return 0 on success, -EINVAL if the digest is not a SHA-256 digest.
+ **/
+int dfu_target_digest_set(const uint8_t *digest, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
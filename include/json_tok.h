@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef JSON_TOK_H__
+#define JSON_TOK_H__
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @defgroup json_tok JSON tokenizer
+ * @{
+ * @brief Library that splits a JSON document into tokens in place, without
+ *        copying it, and looks up values by their path.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Longest document that can be tokenized. */
+#define JSON_TOK_MAX_LEN (UINT16_MAX - 1)
+
+/** Deepest nesting of a document whose tokens are counted. */
+#define JSON_TOK_COUNT_MAX_DEPTH 32
+
+/** @brief Token types. */
+enum json_tok_type {
+	JSON_TOK_OBJ,
+	JSON_TOK_ARR,
+	JSON_TOK_STR,
+	/** Number, true, false or null. */
+	JSON_TOK_PRIM,
+};
+
+/** @brief Token, referring to a value or member name in the document. */
+struct json_tok {
+	/** Offset of the value in the document, after the opening quote
+	 *  for strings.
+	 */
+	uint16_t start;
+	/** Length of the value, without the quotes for strings. */
+	uint16_t len;
+	/** Index of the first token after the value and its children. */
+	uint16_t next;
+	/** Token type, see @ref json_tok_type. */
+	uint8_t type;
+};
+
+/** @brief Tokenize a JSON document.
+ *
+ *  The document is validated and not modified. Tokens refer to it, so it
+ *  must be kept as long as they are used. The first token is the document
+ *  itself. Each member of an object takes a string token for its name,
+ *  followed by the tokens of its value.
+ *
+ *  @param[in]  json  Document. It does not need to be null-terminated, but
+ *                    tokenizing stops at the first null character.
+ *  @param[in]  len   Length of the document.
+ *  @param[out] toks  Tokens, or NULL to only count them.
+ *  @param[in]  count Number of tokens in @p toks.
+ *
+ *  @return Number of tokens if the operation was successful.
+ *  @return -EINVAL If the document is not valid JSON.
+ *  @return -ENOMEM If the document has more than @p count tokens, or if
+ *                  they are counted and it is nested deeper than
+ *                  @ref JSON_TOK_COUNT_MAX_DEPTH.
+ *  @return -EFBIG  If the document is longer than @ref JSON_TOK_MAX_LEN.
+ */
+int json_tok_parse(const char *json, size_t len,
+		   struct json_tok *toks, size_t count);
+
+/** @brief Tokenize a JSON document, allocating the tokens if needed.
+ *
+ *  The document is tokenized into @p buf, usually on the stack of the
+ *  caller. If it has more tokens, they are counted and allocated from the
+ *  heap with k_malloc(), when CONFIG_JSON_TOK_HEAP is enabled.
+ *
+ *  @param[in]  json  Document.
+ *  @param[in]  len   Length of the document.
+ *  @param[in]  buf   Tokens of the caller.
+ *  @param[in]  count Number of tokens in @p buf.
+ *  @param[out] toks  Set to @p buf or to the allocated tokens, which are
+ *                    released with @ref json_tok_free.
+ *
+ *  @return Same as @ref json_tok_parse, and -ENOMEM if the tokens could
+ *          not be allocated.
+ */
+int json_tok_parse_alloc(const char *json, size_t len,
+			 struct json_tok *buf, size_t count,
+			 struct json_tok **toks);
+
+/** @brief Release the tokens of @ref json_tok_parse_alloc.
+ *
+ *  @param[in] toks Tokens.
+ *  @param[in] buf  Tokens of the caller, which are not released.
+ */
+void json_tok_free(struct json_tok *toks, const struct json_tok *buf);
+
+/** @brief Find a value by its path.
+ *
+ *  The path is a list of member names and array indices, separated by
+ *  dots, for example "state.desired.config.gpst" or "topics.0". Member
+ *  names are compared with the document as is, without unescaping it.
+ *
+ *  @param[in] json Document.
+ *  @param[in] toks Tokens of the document.
+ *  @param[in] from Index of the token to start from, 0 for the document.
+ *  @param[in] path Path, relative to @p from.
+ *
+ *  @return Index of the token if the operation was successful.
+ *  @return -ENOENT If the value does not exist.
+ */
+int json_tok_find(const char *json, const struct json_tok *toks,
+		  int from, const char *path);
+
+/** @brief Compare a string token with a string.
+ *
+ *  @param[in] json Document.
+ *  @param[in] tok  Token.
+ *  @param[in] str  Null-terminated string.
+ *
+ *  @return true if @p tok is a string equal to @p str, false otherwise.
+ */
+bool json_tok_eq(const char *json, const struct json_tok *tok,
+		 const char *str);
+
+/** @brief Copy and unescape a string token.
+ *
+ *  Like snprintf(), the output is always null-terminated and truncated to
+ *  fit @p size.
+ *
+ *  @param[in]  json Document.
+ *  @param[in]  tok  Token.
+ *  @param[out] buf  Output buffer, or NULL to only measure the string.
+ *  @param[in]  size Size of @p buf.
+ *
+ *  @return Length of the unescaped string, without the terminating null
+ *          character, if the operation was successful.
+ *  @return -EINVAL If @p tok is not a string.
+ */
+int json_tok_str(const char *json, const struct json_tok *tok,
+		 char *buf, size_t size);
+
+/** @brief Read an integer token.
+ *
+ *  @param[in]  json  Document.
+ *  @param[in]  tok   Token.
+ *  @param[out] value Value.
+ *
+ *  @return 0       If the operation was successful.
+ *  @return -EINVAL If @p tok is not an integer.
+ *  @return -ERANGE If the value does not fit @p value.
+ */
+int json_tok_int(const char *json, const struct json_tok *tok,
+		 int32_t *value);
+
+/** @brief Read a boolean token.
+ *
+ *  @param[in]  json  Document.
+ *  @param[in]  tok   Token.
+ *  @param[out] value Value.
+ *
+ *  @return 0       If the operation was successful.
+ *  @return -EINVAL If @p tok is not true or false.
+ */
+int json_tok_bool(const char *json, const struct json_tok *tok, bool *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* JSON_TOK_H__ */
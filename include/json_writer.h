@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef JSON_WRITER_H__
+#define JSON_WRITER_H__
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @defgroup json_writer JSON writer
+ * @{
+ * @brief Library that serializes JSON directly into a buffer, without
+ *        building a tree of objects first.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief JSON writer state.
+ *
+ *  The members are internal to the library and must not be accessed
+ *  directly.
+ */
+struct json_writer {
+	/** Output buffer, or NULL to only measure the output. */
+	char *buf;
+	/** Size of the output buffer. */
+	size_t size;
+	/** Length of the output so far, also when it did not fit. */
+	size_t len;
+	/** First error, returned by all later calls. */
+	int err;
+	/** Number of open objects and arrays. */
+	uint8_t depth;
+	/** Bit n is set if the container at depth n is an array. */
+	uint32_t array;
+	/** Bit n is set if the container at depth n has a member. */
+	uint32_t members;
+};
+
+/** @brief Initialize a JSON writer.
+ *
+ *  If @p buf is NULL, nothing is written and @ref json_writer_finish
+ *  returns the length of the output. This can be used to size a buffer
+ *  before writing the same document again.
+ *
+ *  @param[out] w    Writer.
+ *  @param[in]  buf  Output buffer, or NULL.
+ *  @param[in]  size Size of the output buffer, including the terminating
+ *                   null character.
+ */
+void json_writer_init(struct json_writer *w, char *buf, size_t size);
+
+/** @brief Start an object.
+ *
+ *  @param[in] w   Writer.
+ *  @param[in] key Member name inside an object, NULL otherwise.
+ *
+ *  @return 0          If the operation was successful.
+ *  @return -EINVAL    If @p key does not match the enclosing container.
+ *  @return -EOVERFLOW If CONFIG_JSON_WRITER_MAX_DEPTH containers are open.
+ *  @return -ENOMEM    If the output buffer is full.
+ */
+int json_writer_obj_start(struct json_writer *w, const char *key);
+
+/** @brief End the object started last.
+ *
+ *  @param[in] w Writer.
+ *
+ *  @return 0       If the operation was successful.
+ *  @return -EINVAL If the innermost open container is not an object.
+ *  @return -ENOMEM If the output buffer is full.
+ */
+int json_writer_obj_end(struct json_writer *w);
+
+/** @brief Start an array.
+ *
+ *  @param[in] w   Writer.
+ *  @param[in] key Member name inside an object, NULL otherwise.
+ *
+ *  @return 0 or a negative error code, see @ref json_writer_obj_start.
+ */
+int json_writer_arr_start(struct json_writer *w, const char *key);
+
+/** @brief End the array started last.
+ *
+ *  @param[in] w Writer.
+ *
+ *  @return 0       If the operation was successful.
+ *  @return -EINVAL If the innermost open container is not an array.
+ *  @return -ENOMEM If the output buffer is full.
+ */
+int json_writer_arr_end(struct json_writer *w);
+
+/** @brief Write a string, escaping it as needed.
+ *
+ *  @param[in] w   Writer.
+ *  @param[in] key Member name inside an object, NULL otherwise.
+ *  @param[in] str Null-terminated string.
+ *
+ *  @return 0 or a negative error code, see @ref json_writer_obj_start.
+ *  @return -EINVAL If @p str is NULL. Use @ref json_writer_null to write
+ *		    a null value.
+ */
+int json_writer_str(struct json_writer *w, const char *key, const char *str);
+
+/** @brief Write an integer.
+ *
+ *  @param[in] w     Writer.
+ *  @param[in] key   Member name inside an object, NULL otherwise.
+ *  @param[in] value Value.
+ *
+ *  @return 0 or a negative error code, see @ref json_writer_obj_start.
+ */
+int json_writer_int(struct json_writer *w, const char *key, int64_t value);
+
+/** @brief Write a floating-point number.
+ *
+ *  Values that are not finite are written as null.
+ *
+ *  @note This requires floating-point support in the printf family of
+ *        the C library.
+ *
+ *  @param[in] w     Writer.
+ *  @param[in] key   Member name inside an object, NULL otherwise.
+ *  @param[in] value Value.
+ *
+ *  @return 0 or a negative error code, see @ref json_writer_obj_start.
+ */
+int json_writer_num(struct json_writer *w, const char *key, double value);
+
+/** @brief Write a boolean.
+ *
+ *  @param[in] w     Writer.
+ *  @param[in] key   Member name inside an object, NULL otherwise.
+ *  @param[in] value Value.
+ *
+ *  @return 0 or a negative error code, see @ref json_writer_obj_start.
+ */
+int json_writer_bool(struct json_writer *w, const char *key, bool value);
+
+/** @brief Write null.
+ *
+ *  @param[in] w   Writer.
+ *  @param[in] key Member name inside an object, NULL otherwise.
+ *
+ *  @return 0 or a negative error code, see @ref json_writer_obj_start.
+ */
+int json_writer_null(struct json_writer *w, const char *key);
+
+/** @brief Write a value that is already serialized.
+ *
+ *  @p json is copied as is, and must be a single valid JSON value.
+ *
+ *  @param[in] w    Writer.
+ *  @param[in] key  Member name inside an object, NULL otherwise.
+ *  @param[in] json Serialized value.
+ *  @param[in] len  Length of @p json.
+ *
+ *  @return 0 or a negative error code, see @ref json_writer_obj_start.
+ */
+int json_writer_raw(struct json_writer *w, const char *key,
+		    const char *json, size_t len);
+
+/** @brief Finish the document and null-terminate the output.
+ *
+ *  @param[in] w Writer.
+ *
+ *  @return Length of the output, without the terminating null character,
+ *          if the operation was successful. Otherwise, the first error
+ *          returned by the writer, or -EINVAL if the document is not
+ *          complete.
+ */
+int json_writer_finish(struct json_writer *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* JSON_WRITER_H__ */
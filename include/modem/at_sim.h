@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef AT_SIM_H_
+#define AT_SIM_H_
+
+/**
+ * @file at_sim.h
+ *
+ * @defgroup at_sim Simulated modem AT socket
+ *
+ * @{
+ *
+ * @brief Public APIs for the simulated modem AT socket.
+ *
+ * The simulated AT socket replaces the bsdlib AT socket on host builds,
+ * so that the AT command stack can be exercised without a modem. Commands
+ * written to the socket are answered from a script of recorded responses,
+ * and notifications can be injected with configurable timing.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+/** @brief Scripted response to an AT command. */
+struct at_sim_entry {
+	/** Command prefix to match, for example "AT+CEREG?". */
+	const char *cmd;
+	/** Complete response, including the final result code. */
+	const char *resp;
+	/** Time from the command is written until the response can be read,
+	 *  in milliseconds.
+	 */
+	uint32_t latency_ms;
+	/** Notification sent after the response, or NULL. */
+	const char *notif;
+	/** Number of times the notification is sent. */
+	uint16_t notif_count;
+	/** Interval between repeated notifications, in milliseconds. */
+	uint32_t notif_interval_ms;
+};
+
+/** @brief Statistics of the simulated AT socket. */
+struct at_sim_stats {
+	/** Number of commands written to the socket. */
+	uint32_t cmds;
+	/** Number of commands that did not match any script entry. */
+	uint32_t unmatched;
+	/** Number of notifications read from the socket. */
+	uint32_t notifs;
+	/** Number of messages dropped because a receive queue was full. */
+	uint32_t dropped;
+};
+
+/**
+ * @brief Set the script used to answer AT commands.
+ *
+ * Entries are matched in the order they are given, so that a recorded
+ * session is replayed in sequence. If the next entry does not match,
+ * the rest of the script is searched. Commands not matching any entry are
+ * answered with "OK", or "ERROR" if @option{CONFIG_AT_SIM_UNMATCHED_ERROR}
+ * is set.
+ *
+ * @note The script is not copied and must remain valid while it is in use.
+ *
+ * @param script Array of script entries, or NULL to clear the script.
+ * @param count  Number of entries in the array.
+ *
+ * @retval 0       If the operation was successful.
+ * @retval -EINVAL If the script is invalid.
+ */
+int at_sim_script_set(const struct at_sim_entry *script, size_t count);
+
+/**
+ * @brief Send a notification to all open AT sockets.
+ *
+ * @note The string is not copied and must remain valid until it has been
+ *       read from all sockets.
+ *
+ * @param notif    Null-terminated notification.
+ * @param delay_ms Time until the notification can be read, in milliseconds.
+ *
+ * @retval 0        If the operation was successful.
+ * @retval -EINVAL  If the notification is a NULL pointer.
+ * @retval -ENOBUFS If a receive queue was full.
+ */
+int at_sim_notify(const char *notif, uint32_t delay_ms);
+
+/**
+ * @brief Send a burst of notifications to all open AT sockets.
+ *
+ * @param notif       Null-terminated notification.
+ * @param count       Number of times the notification is sent.
+ * @param interval_ms Interval between the notifications, in milliseconds.
+ *
+ * @retval 0        If the operation was successful.
+ * @retval -EINVAL  If the notification is a NULL pointer.
+ * @retval -ENOBUFS If a receive queue was full.
+ */
+int at_sim_notify_burst(const char *notif, size_t count, uint32_t interval_ms);
+
+/**
+ * @brief Get statistics of the simulated AT socket.
+ *
+ * @param stats Pointer to where the statistics are stored.
+ */
+void at_sim_stats_get(struct at_sim_stats *stats);
+
+/**
+ * @brief Reset the script position, statistics and pending messages.
+ */
+void at_sim_reset(void);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AT_SIM_H_ */
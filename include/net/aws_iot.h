@@ -25,13 +25,21 @@ extern "C" {
 #endif
 
 /** @brief AWS IoT shadow topics, used in messages to specify which shadow
- *         topic that will be published to.
+ *         topic that will be published to, and in received messages which
+ *         shadow topic the message was received on.
  */
 enum aws_iot_topic_type {
 	AWS_IOT_SHADOW_TOPIC_UNKNOWN = 0x0,
 	AWS_IOT_SHADOW_TOPIC_GET,
 	AWS_IOT_SHADOW_TOPIC_UPDATE,
-	AWS_IOT_SHADOW_TOPIC_DELETE
+	AWS_IOT_SHADOW_TOPIC_DELETE,
+	AWS_IOT_SHADOW_TOPIC_GET_ACCEPTED,
+	AWS_IOT_SHADOW_TOPIC_GET_REJECTED,
+	AWS_IOT_SHADOW_TOPIC_UPDATE_ACCEPTED,
+	AWS_IOT_SHADOW_TOPIC_UPDATE_REJECTED,
+	AWS_IOT_SHADOW_TOPIC_UPDATE_DELTA,
+	AWS_IOT_SHADOW_TOPIC_DELETE_ACCEPTED,
+	AWS_IOT_SHADOW_TOPIC_DELETE_REJECTED
 };
 
 /**@ AWS broker disconnect results. */
@@ -85,6 +93,8 @@ enum aws_iot_evt_type {
 	AWS_IOT_EVT_FOTA_ERASE_DONE,
 	/** FOTA progress notification. */
 	AWS_IOT_EVT_FOTA_DL_PROGRESS,
+	/** Acknowledgment for data sent to AWS IoT. */
+	AWS_IOT_EVT_PUBACK,
 	/** AWS IoT library error. */
 	AWS_IOT_EVT_ERROR
 };
@@ -119,6 +129,11 @@ struct aws_iot_data {
 	size_t len;
 	/** Quality of Service of the message. */
 	enum mqtt_qos qos;
+	/** Message ID, used to match acknowledgments. 0 to let the library
+	 *  choose it. IDs from AWS_JOBS_EXEC_MESSAGE_ID_FIRST up are taken
+	 *  by AWS FOTA if it is enabled.
+	 */
+	uint16_t message_id;
 };
 
 /** @brief Struct with data received from AWS IoT broker. */
@@ -131,9 +146,34 @@ struct aws_iot_evt {
 		/** FOTA progress in percentage. */
 		int fota_progress;
 		bool persistent_session;
+		/** ID of the acknowledged message. */
+		uint16_t message_id;
 	} data;
 };
 
+/** @brief Timing of the last connection to the AWS IoT broker, used to
+ *         measure the time saved when a persistent session is resumed.
+ *         All times are in milliseconds from the start of the connection.
+ */
+struct aws_iot_connect_stats {
+	/** Time until the MQTT CONNECT was sent, which includes the DNS
+	 *  lookup and the TCP and TLS handshakes.
+	 */
+	uint32_t handshake_ms;
+	/** Time until the CONNACK was received, 0 if not received. */
+	uint32_t connack_ms;
+	/** Time until @ref AWS_IOT_EVT_READY, 0 if not ready. */
+	uint32_t ready_ms;
+	/** Number of topics subscribed to. */
+	uint16_t subscribed;
+	/** Number of topics that were not subscribed to again, because the
+	 *  broker confirmed them in the resumed session.
+	 */
+	uint16_t skipped;
+	/** The broker resumed a persistent session. */
+	bool persistent_session;
+};
+
 /** @brief AWS IoT library asynchronous event handler.
  *
  *  @param[in] evt The event and any associated parameters.
@@ -195,6 +235,9 @@ int aws_iot_disconnect(void);
  *                     the AWS IoT broker.
  *
  *  @return 0 If successful.
+ *            -EBUSY if the message ID is used by a message that has not
+ *            been acknowledged yet.
+ *            -EINVAL if the message ID is reserved for AWS FOTA.
  *            Otherwise, a (negative) error code is returned.
  */
 int aws_iot_send(const struct aws_iot_data *const tx_data);
@@ -214,9 +257,21 @@ int aws_iot_input(void);
  */
 int aws_iot_ping(void);
 
+/** @brief Get the timing of the last connection to the AWS IoT broker.
+ *
+ *  @param[out] stats Pointer to where the timing is stored.
+ *
+ *  @return 0 If successful.
+ *            -ENODATA if no connection has been started.
+ */
+int aws_iot_connect_stats_get(struct aws_iot_connect_stats *const stats);
+
 /** @brief Add a list of application specific topics that will be subscribed to
  *         upon connection to AWS IoT broker.
  *
+ *  When a persistent session is resumed, only the topics that the broker has
+ *  not confirmed in the session are subscribed to.
+ *
  *  @param[in] topic_list Pointer to list of topics.
  *  @param[in] list_count Number of entries in the list.
  *
@@ -48,6 +48,16 @@ enum execution_status {
 #define SUBSCRIBE_EXPECTED (SUBSCRIBE_ID_BASE + 10)
 /** @}*/
 
+/** @name MQTT message IDs used by the job execution engine
+ *  Its subscription, requests and updates are sent with these IDs, and it
+ *  consumes their acknowledgments. Other users of the same MQTT client
+ *  must take their message IDs below this range.
+ * @{
+ */
+#define AWS_JOBS_EXEC_MESSAGE_ID_FIRST (0xFF00)
+#define AWS_JOBS_EXEC_MESSAGE_ID_LAST (0xFFFF)
+/** @}*/
+
 
 /** @brief The max JOB_ID_LEN according to AWS docs
  * https://docs.aws.amazon.com/general/latest/gr/aws_service_limits.html
@@ -272,6 +282,29 @@ int aws_jobs_update_job_execution(struct mqtt_client *const client,
 int aws_jobs_get_job_execution(struct mqtt_client *const client,
 			       const char *job_id, uint8_t *topic_buf);
 
+/**
+ * @brief Get the name of a job execution status, as used by AWS IoT Jobs.
+ *
+ * @param[in] status Job execution status.
+ *
+ * @return Null-terminated name, for example "IN_PROGRESS", or NULL if
+ *         @p status is not valid.
+ */
+const char *aws_jobs_status_str(enum execution_status status);
+
+/**
+ * @brief Parse the name of a job execution status.
+ *
+ * @param[in]  str    Name. It does not need to be null-terminated.
+ * @param[in]  len    Length of the name.
+ * @param[out] status Job execution status.
+ *
+ * @retval 0       If successful.
+ * @retval -EINVAL If the name is not a job execution status.
+ */
+int aws_jobs_status_parse(const char *str, size_t len,
+			  enum execution_status *status);
+
 /**
  * @brief Compare topics
  *
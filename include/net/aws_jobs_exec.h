@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/** @file
+ */
+
+#ifndef AWS_JOBS_EXEC_H__
+#define AWS_JOBS_EXEC_H__
+
+/**
+ * @defgroup aws_jobs_exec AWS Jobs execution engine
+ * @{
+ * @brief Engine that receives AWS IoT jobs, keeps their documents, and
+ *        reports the status of their executions.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr.h>
+#include <zephyr/types.h>
+#include <net/mqtt.h>
+#include <net/aws_jobs.h>
+
+/** @brief Job received by the engine. */
+struct aws_jobs_exec_job {
+	/** Job ID, null-terminated. */
+	char id[AWS_JOBS_JOB_ID_MAX_LEN];
+	/** Job document, a null-terminated JSON object. It is copied once,
+	 *  when the job is received, and kept until the job is done.
+	 */
+	char doc[CONFIG_AWS_JOBS_EXEC_DOC_MAX_LEN];
+	/** Length of the job document. */
+	size_t doc_len;
+	/** Status last accepted by AWS IoT. */
+	enum execution_status status;
+	/** Version of the job execution in AWS IoT. */
+	int version;
+};
+
+/** @brief Event types. */
+enum aws_jobs_exec_evt_type {
+	/** A job is next in the queue and can be run. */
+	AWS_JOBS_EXEC_EVT_JOB,
+	/** An update of the job execution was accepted. */
+	AWS_JOBS_EXEC_EVT_ACCEPTED,
+	/** An update of the job execution was rejected. The job is removed
+	 *  from the queue.
+	 */
+	AWS_JOBS_EXEC_EVT_REJECTED,
+};
+
+/** @brief Event. */
+struct aws_jobs_exec_evt {
+	/** Event type. */
+	enum aws_jobs_exec_evt_type type;
+	/** Job the event is for. Only valid during the callback. */
+	const struct aws_jobs_exec_job *job;
+	/** Status of the accepted or rejected update. */
+	enum execution_status status;
+};
+
+/** @brief Event handler.
+ *
+ *  The handler is called from aws_jobs_exec_mqtt_evt_handler(), and may
+ *  call the other functions of the engine.
+ */
+typedef void (*aws_jobs_exec_evt_handler_t)(
+	const struct aws_jobs_exec_evt *evt);
+
+/**
+ * @brief Initialize the engine.
+ *
+ * @param[in] client      MQTT client instance used for AWS IoT.
+ * @param[in] evt_handler Event handler.
+ *
+ * @retval 0       If successful.
+ * @retval -EINVAL If any of the input values are invalid.
+ */
+int aws_jobs_exec_init(struct mqtt_client *const client,
+		       aws_jobs_exec_evt_handler_t evt_handler);
+
+/**
+ * @brief MQTT event handler of the engine.
+ *
+ * On a new MQTT session, the engine subscribes to the job topics in one
+ * request, and fetches the next job and the list of pending jobs. Queued
+ * jobs are fetched up to @option{CONFIG_AWS_JOBS_EXEC_JOBS_MAX}, and run one
+ * at a time, in order.
+ *
+ * @param[in] client MQTT client instance.
+ * @param[in] evt    MQTT event.
+ *
+ * @retval 0 If the event was handled by the engine.
+ * @retval 1 If the event should be handled by the application.
+ * @return   A negative value on error.
+ */
+int aws_jobs_exec_mqtt_evt_handler(struct mqtt_client *const client,
+				   const struct mqtt_evt *evt);
+
+/**
+ * @brief Update the status of a job execution.
+ *
+ * The update is queued and the function returns at once. Updates are sent
+ * with the expected version of the job execution, and up to
+ * @option{CONFIG_AWS_JOBS_EXEC_PIPELINE_DEPTH} updates of a job can be
+ * waiting for a response. If an update is rejected because the version did
+ * not match, the version is read from AWS IoT and the update is sent again.
+ *
+ * Updates queued before the previous ones were sent are merged, and only
+ * the last one is sent. Updates that only change the status details are
+ * sent at most once every
+ * @option{CONFIG_AWS_JOBS_EXEC_PROGRESS_INTERVAL_MS} milliseconds.
+ *
+ * @param[in] job_id         Job ID.
+ * @param[in] status         New status of the job execution.
+ * @param[in] status_details JSON object with string values, or NULL to keep
+ *                           the status details.
+ *
+ * @retval 0       If the update was queued.
+ * @retval -ENOENT If the job is not in the queue.
+ * @retval -EINVAL If the status is not valid, or a final status has already
+ *                 been queued for the job.
+ * @retval -ENOMEM If the status details are longer than
+ *                 @option{CONFIG_AWS_JOBS_EXEC_DETAILS_MAX_LEN}.
+ */
+int aws_jobs_exec_update(const char *job_id, enum execution_status status,
+			 const char *status_details);
+
+/**
+ * @brief Report the progress of a job execution.
+ *
+ * Queues an IN_PROGRESS update with the status details
+ * {"progress":"<progress>"}. See aws_jobs_exec_update().
+ *
+ * @param[in] job_id   Job ID.
+ * @param[in] progress Progress, in percent.
+ *
+ * @return The return value of aws_jobs_exec_update().
+ */
+int aws_jobs_exec_progress(const char *job_id, int progress);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* AWS_JOBS_EXEC_H__ */
@@ -29,7 +29,9 @@ enum cloud_event_type {
 	CLOUD_EVT_READY,
 	/** An error has occurred in the cloud backend. */
 	CLOUD_EVT_ERROR,
-	/** Data has been sent to the cloud. */
+	/** Data has been sent to the cloud. If the backend reports
+	 *  acknowledgments, data.msg.message_id identifies the message.
+	 */
 	CLOUD_EVT_DATA_SENT,
 	/** Data has been received from the cloud. */
 	CLOUD_EVT_DATA_RECEIVED,
@@ -134,6 +136,10 @@ struct cloud_msg {
 	size_t len;
 	enum cloud_qos qos;
 	struct cloud_endpoint endpoint;
+	/** Message ID to match the acknowledgment, 0 to let the backend
+	 *  choose it.
+	 */
+	uint16_t message_id;
 };
 
 /**@brief Cloud event type. */
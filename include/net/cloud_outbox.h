@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef ZEPHYR_INCLUDE_CLOUD_OUTBOX_H_
+#define ZEPHYR_INCLUDE_CLOUD_OUTBOX_H_
+
+/**
+ * @brief Cloud outbox
+ * @defgroup cloud_outbox Cloud outbox
+ * @{
+ */
+
+#include <zephyr.h>
+#include <net/cloud.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief The message may be combined with other messages to the same
+ *         endpoint. Its payload must be a JSON value.
+ */
+#define CLOUD_OUTBOX_BATCH BIT(0)
+
+/** @name Message IDs used by the cloud outbox
+ *  Messages are handed to the backend with these IDs, and the outbox
+ *  matches acknowledgments against them. Backends that allocate message
+ *  IDs of their own must keep them out of this range.
+ * @{
+ */
+#define CLOUD_OUTBOX_MESSAGE_ID_FIRST (0xF000)
+#define CLOUD_OUTBOX_MESSAGE_ID_LAST (0xFEFF)
+/** @}*/
+
+/**@brief Cloud outbox event types. */
+enum cloud_outbox_evt_type {
+	/** A message has been acknowledged by the cloud, or handed over to
+	 *  the backend if it was sent with CLOUD_QOS_AT_MOST_ONCE.
+	 */
+	CLOUD_OUTBOX_EVT_SENT,
+	/** A message could not be sent and has been removed. */
+	CLOUD_OUTBOX_EVT_DROPPED,
+};
+
+/**@brief Cloud outbox event. */
+struct cloud_outbox_evt {
+	enum cloud_outbox_evt_type type;
+	/** ID returned by @ref cloud_outbox_send for the message. */
+	uint16_t id;
+};
+
+/**
+ * @brief Cloud outbox event handler function type.
+ *
+ * @param evt Pointer to the event.
+ */
+typedef void (*cloud_outbox_evt_handler_t)(const struct cloud_outbox_evt *evt);
+
+/**@brief Initialize the cloud outbox.
+ *
+ * If the outbox is stored in flash, the messages left from before a reset
+ * are queued again.
+ *
+ * @param backend Cloud backend the messages are sent to.
+ * @param handler Event handler, can be NULL.
+ *
+ * @return 0 or a negative error code indicating reason of failure.
+ */
+int cloud_outbox_init(const struct cloud_backend *backend,
+		      cloud_outbox_evt_handler_t handler);
+
+/**@brief Queue a message.
+ *
+ * The message is copied, and sent in order with the other queued messages
+ * when the backend is connected. Messages with the @ref CLOUD_OUTBOX_BATCH
+ * flag are held for up to CONFIG_CLOUD_OUTBOX_LATENCY_MS, and consecutive
+ * ones to the same endpoint with the same QoS are published together as a
+ * JSON array. Other messages are sent right away.
+ *
+ * @param msg Message. The message ID must be 0, as the outbox assigns it.
+ * @param flags Message flags, see @ref CLOUD_OUTBOX_BATCH.
+ *
+ * @return ID of the message, used in the events, if the operation was
+ *         successful. -ENOMEM if the outbox is full, otherwise a (negative)
+ *         error code.
+ */
+int cloud_outbox_send(const struct cloud_msg *msg, uint32_t flags);
+
+/**@brief Pass a cloud event to the outbox.
+ *
+ * Must be called from the cloud event handler of the application for
+ * every event. The outbox starts sending on CLOUD_EVT_READY, stops on
+ * CLOUD_EVT_DISCONNECTED, and tracks acknowledgments with
+ * CLOUD_EVT_DATA_SENT.
+ *
+ * @param evt Cloud event.
+ */
+void cloud_outbox_event_handle(const struct cloud_event *evt);
+
+/**@brief Send all queued messages without waiting for the latency budget.
+ *
+ * @return 0 or a negative error code indicating reason of failure.
+ */
+int cloud_outbox_flush(void);
+
+/**@brief Get the number of messages that have not been sent or
+ *        acknowledged yet.
+ *
+ * @return Number of messages.
+ */
+size_t cloud_outbox_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* ZEPHYR_INCLUDE_CLOUD_OUTBOX_H_ */
@@ -35,6 +35,11 @@ enum download_client_evt_id {
 	/**
 	 * Event contains a fragment.
 	 * The application may return any non-zero value to stop the download.
+	 *
+	 * If the fragment was received into a buffer lent by the application
+	 * (@ref download_client_buf_provider), the buffer belongs to the
+	 * application again. Otherwise, the fragment must be consumed before
+	 * returning from the callback.
 	 */
 	DOWNLOAD_CLIENT_EVT_FRAGMENT,
 	/**
@@ -46,6 +51,8 @@ enum download_client_evt_id {
 	 * - EHOSTDOWN: host went down during download
 	 * - EBADMSG: HTTP response header not as expected
 	 * - E2BIG: HTTP response header could not fit in buffer
+	 * - ECANCELED: file changed on the server since the download
+	 *   was started, the download must be restarted from the beginning
 	 *
 	 * In case of errors on the socket during send() or recv() (ECONNRESET),
 	 * returning zero from the callback will let the library attempt
@@ -58,13 +65,25 @@ enum download_client_evt_id {
 	 * network socket as necessary before re-attempting the download.
 	 */
 	DOWNLOAD_CLIENT_EVT_ERROR,
-	/** Download complete. */
+	/** Download complete.
+	 *
+	 * The application may start downloading another file from the
+	 * same host by calling @ref download_client_start from the
+	 * callback. The file is then requested on the same connection.
+	 */
 	DOWNLOAD_CLIENT_EVT_DONE,
 };
 
+/**
+ * @brief Download client fragment.
+ */
 struct download_fragment {
+	/** Fragment data. */
 	const void *buf;
+	/** Length of the fragment, in bytes. */
 	size_t len;
+	/** Offset of the fragment in the file. */
+	size_t offset;
 };
 
 /**
@@ -82,6 +101,37 @@ struct download_client_evt {
 	};
 };
 
+/**
+ * @brief Provider of buffers to receive fragments into.
+ *
+ * The application may lend buffers to the download client, so that
+ * fragments are received directly into memory chosen by the application,
+ * for example buffers aligned to the flash page size. A lent buffer is
+ * handed back to the application in the @ref DOWNLOAD_CLIENT_EVT_FRAGMENT
+ * event, and the fragment starts at the beginning of the buffer for HTTP
+ * and HTTPS downloads.
+ */
+struct download_client_buf_provider {
+	/**
+	 * @brief Lend a buffer to the download client.
+	 *
+	 * The buffer must be at least
+	 * @option{CONFIG_DOWNLOAD_CLIENT_BUF_SIZE} bytes large. If NULL
+	 * is returned, the next fragment is received into the internal
+	 * buffer of the download client.
+	 *
+	 * @return Pointer to the buffer, or NULL if none is available.
+	 */
+	void *(*get)(void);
+	/**
+	 * @brief Give back a lent buffer which has not been handed back
+	 *        in a fragment event, because the download has stopped.
+	 *
+	 * @param buf Pointer to the buffer.
+	 */
+	void (*put)(void *buf);
+};
+
 /**
  * @brief Download client configuration options.
  */
@@ -99,8 +149,39 @@ struct download_client_cfg {
 	 *  values shall be used.
 	 */
 	size_t frag_size_override;
+	/** Provider of buffers to receive fragments into.
+	 *  Pass NULL to receive fragments into the internal buffer.
+	 */
+	const struct download_client_buf_provider *buf_provider;
+	/** Settings key under which the resume record is stored,
+	 *  null-terminated. Pass NULL if the download is not resumed
+	 *  across reboots.
+	 */
+	const char *resume_key;
 };
 
+#if defined(CONFIG_DOWNLOAD_CLIENT_RESUME)
+/**
+ * @brief Resume record of a download.
+ *
+ * The record identifies the file being downloaded, and how much of it
+ * the application has stored, so that the download can be resumed after
+ * a reboot without downloading the stored part again.
+ */
+struct download_client_resume {
+	/** Hash of the host and file name. */
+	uint32_t url_hash;
+	/** Size of the file, in bytes. */
+	uint32_t file_size;
+	/** Offset up to which the application has stored the file. */
+	uint32_t offset;
+	/** Value stored by the application together with the record. */
+	uint32_t user;
+	/** ETag or Last-Modified value of the file, null-terminated. */
+	char validator[CONFIG_DOWNLOAD_CLIENT_RESUME_VALIDATOR_SIZE];
+};
+#endif
+
 /**
  * @brief Download client asynchronous event handler.
  *
@@ -125,13 +206,28 @@ struct download_client {
 	int fd;
 	/** Response buffer. */
 	char buf[CONFIG_DOWNLOAD_CLIENT_BUF_SIZE];
+	/** Buffer being received into, either the response buffer
+	 *  or a buffer lent by the application.
+	 */
+	char *rx_buf;
 	/** Buffer offset. */
 	size_t offset;
+	/** Offset of the fragment in the buffer being received into. */
+	size_t frag_off;
 
 	/** Size of the file being downloaded, in bytes. */
 	size_t file_size;
 	/** Download progress, number of bytes downloaded. */
 	size_t progress;
+	/** Offset past the last byte to download,
+	 *  or zero to download until the end of the file.
+	 */
+	size_t range_end;
+	/** Called when the range being downloaded is complete, to continue
+	 *  with another range on the same connection. Returns zero if
+	 *  progress and range_end have been set to the next range.
+	 */
+	int (*range_next)(struct download_client *client);
 
 	/** Server hosting the file, null-terminated. */
 	const char *host;
@@ -150,6 +246,41 @@ struct download_client {
 		bool has_header;
 		/** The server has closed the connection. */
 		bool connection_close;
+		/** Payload bytes of the current response not yet received. */
+		size_t body_left;
+		/** Bytes of the next pipelined response
+		 *  received together with the current fragment.
+		 */
+		size_t leftover;
+		/** Offset of the first byte of the next range to request. */
+		size_t next_range;
+		/** Number of requests sent and not yet fully answered. */
+		size_t inflight;
+		/** Pipelining is disabled for the current download. */
+		bool serial;
+		/** Response header parser, internal. */
+		struct {
+			/** Parser state. */
+			uint8_t state;
+			/** Header field whose value is being parsed. */
+			uint8_t field;
+			/** Header fields still matching the name being parsed. */
+			uint8_t match;
+			/** Position in the token being parsed. */
+			uint8_t pos;
+			/** HTTP status code. */
+			uint16_t status;
+			/** Whether the response has a Content-Length field. */
+			bool has_content_length;
+			/** Whether the response has a file size
+			 *  in the Content-Range field.
+			 */
+			bool has_file_size;
+			/** Value of the Content-Length field. */
+			size_t content_length;
+			/** File size from the Content-Range field. */
+			size_t file_size;
+		} parser;
 	} http;
 
 	struct {
@@ -157,6 +288,25 @@ struct download_client {
 		struct coap_block_context block_ctx;
 	} coap;
 
+#if defined(CONFIG_DOWNLOAD_CLIENT_RESUME)
+	/** Resume record, internal. */
+	struct {
+		/** Record of the current download. */
+		struct download_client_resume record;
+		/** The validator is taken from the next response. */
+		bool capture;
+		/** A validator value is being parsed. */
+		bool in_value;
+		/** The validator is an ETag. */
+		bool etag;
+		/** Length of the validator being parsed. */
+		uint8_t len;
+	} resume;
+#endif
+
+	/** The next download was started from the callback, internal. */
+	bool chained;
+
 	/** Internal thread ID. */
 	k_tid_t tid;
 	/** Internal download thread. */
@@ -213,6 +363,24 @@ int download_client_connect(struct download_client *client, const char *host,
 int download_client_start(struct download_client *client, const char *file,
 			  size_t from);
 
+/**
+ * @brief Download a range of a file.
+ *
+ * Like @ref download_client_start, but the download completes once
+ * the byte before @p to has been downloaded. HTTP range requests are
+ * used to download the range, also when using HTTP.
+ *
+ * @param[in] client	Client instance.
+ * @param[in] file	File to download, null-terminated.
+ * @param[in] from	Offset of the first byte to download.
+ * @param[in] to	Offset past the last byte to download,
+ *			or zero to download until the end of the file.
+ *
+ * @retval int Zero on success, a negative error code otherwise.
+ */
+int download_client_range_start(struct download_client *client,
+				const char *file, size_t from, size_t to);
+
 /**
  * @brief Pause the download.
  *
@@ -248,6 +416,117 @@ int download_client_file_size_get(struct download_client *client, size_t *size);
  */
 int download_client_disconnect(struct download_client *client);
 
+#if defined(CONFIG_DOWNLOAD_CLIENT_RESUME)
+/**
+ * @brief Load the resume record of a file.
+ *
+ * The record is loaded from the settings key given in the configuration
+ * options of the client, and is only returned if it was stored for the
+ * same host and file. When the download is then started from a non-zero
+ * offset, the range requests are made conditional on the file not having
+ * changed on the server, and the file size is known before the first
+ * fragment is received. If the file has changed, the download stops with
+ * a @ref DOWNLOAD_CLIENT_EVT_ERROR event with error ECANCELED.
+ *
+ * The client must be connected.
+ *
+ * @param[in]  client	Client instance.
+ * @param[in]  file	File to download, null-terminated.
+ * @param[out] record	Resume record.
+ *
+ * @retval int Zero on success, -ENOENT if there is no record for the
+ *	       file, another negative error code otherwise.
+ */
+int download_client_resume_load(struct download_client *client,
+				const char *file,
+				struct download_client_resume *record);
+
+/**
+ * @brief Store the resume record of the current download.
+ *
+ * The application calls this function once it has stored the file up to
+ * @p offset, typically less often than for every fragment.
+ *
+ * @param[in] client	Client instance.
+ * @param[in] offset	Offset up to which the file has been stored.
+ * @param[in] user	Value to store with the record.
+ *
+ * @retval int Zero on success, -EAGAIN if the response header has not
+ *	       been received yet, another negative error code otherwise.
+ */
+int download_client_resume_save(struct download_client *client,
+				size_t offset, uint32_t user);
+
+/**
+ * @brief Delete the stored resume record.
+ *
+ * @param[in] client	Client instance.
+ *
+ * @retval int Zero on success, a negative error code otherwise.
+ */
+int download_client_resume_clear(struct download_client *client);
+#endif /* CONFIG_DOWNLOAD_CLIENT_RESUME */
+
+/**
+ * @brief Initialize the segmented download.
+ *
+ * A segmented download fetches a file over
+ * @option{CONFIG_DOWNLOAD_CLIENT_SEGMENTED_CONNECTIONS} connections to
+ * the same server. Each connection downloads segments of
+ * @option{CONFIG_DOWNLOAD_CLIENT_SEGMENT_SIZE} bytes, using HTTP range
+ * requests. Only one segmented download can be active at a time.
+ *
+ * The fragments are delivered to @p callback one at a time. If
+ * @p in_order is true, the fragments are delivered in file order,
+ * and fragments received ahead of the download position are held in a
+ * reorder window of @option{CONFIG_DOWNLOAD_CLIENT_REORDER_WINDOW_SIZE}
+ * bytes. Otherwise, fragments are delivered as they are received, and
+ * the application uses the offset of each fragment to store it.
+ *
+ * The function can be called again when no download is in progress,
+ * to change the callback or the delivery order.
+ *
+ * @param[in] callback	Callback function.
+ * @param[in] in_order	Whether to deliver the fragments in file order.
+ *
+ * @retval int Zero on success, otherwise a negative error code.
+ */
+int download_client_segmented_init(download_client_callback_t callback,
+				   bool in_order);
+
+/**
+ * @brief Establish the connections of the segmented download.
+ *
+ * @param[in] host	Name of the host to connect to, null-terminated.
+ * @param[in] config	Configuration options.
+ *
+ * @retval int Zero on success, a negative error code otherwise.
+ */
+int download_client_segmented_connect(const char *host,
+				      const struct download_client_cfg *config);
+
+/**
+ * @brief Start the segmented download of a file.
+ *
+ * The first segment is downloaded on the first connection, to learn the
+ * size of the file. The download of the other segments starts once the
+ * file size is known.
+ *
+ * @param[in] file	File to download, null-terminated.
+ * @param[in] from	Offset from where to resume the download,
+ *			or zero to download from the beginning.
+ *
+ * @retval int Zero on success, a negative error code otherwise.
+ */
+int download_client_segmented_start(const char *file, size_t from);
+
+/**
+ * @brief Disconnect the connections of the segmented download.
+ *
+ * @return Zero on success, a negative error code otherwise.
+ */
+int download_client_segmented_disconnect(void);
+
 #ifdef __cplusplus
 }
 #endif
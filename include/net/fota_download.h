@@ -68,6 +68,26 @@ struct fota_download_evt {
 	};
 };
 
+/** Maximum number of images in a multi-image download,
+ *  one modem firmware image and one image for MCUboot.
+ */
+#define FOTA_DOWNLOAD_IMAGES_MAX 2
+
+/** Size of the SHA-256 digest of an image. */
+#define FOTA_DOWNLOAD_SHA256_SIZE 32
+
+/**
+ * @brief Image of a multi-image download.
+ */
+struct fota_download_image {
+	/** Path of the image file on the host. */
+	const char *file;
+	/** Expected SHA-256 digest of the image, or NULL.
+	 *  Requires @option{CONFIG_DFU_TARGET_STREAM_HASH}.
+	 */
+	const uint8_t *sha256;
+};
+
 /**
  * @brief FOTA download asynchronous callback function.
  *
@@ -105,6 +125,37 @@ int fota_download_init(fota_download_callback_t client_callback);
 int fota_download_start(const char *host, const char *file, int sec_tag,
 			const char *apn, size_t fragment_size);
 
+/**@brief Download several images from the given host, and upgrade
+ * all of them or none.
+ *
+ * The images are downloaded in order on one connection. Each image is
+ * verified and staged in its DFU target when it has been downloaded.
+ * The upgrades are scheduled once all images have been verified, and the
+ * completion is reported through an event. If any image fails, the
+ * images staged so far are discarded. If an upgrade can not be scheduled,
+ * the upgrades scheduled before it are cancelled.
+ *
+ * Interrupted multi-image downloads restart from the first image.
+ *
+ * @param host Name of host to start downloading from. Can include scheme
+ *             and port number, e.g. https://google.com:443
+ * @param manifest Images to download. The file paths and digests must stay
+ *                 valid until the download has completed.
+ * @param count Number of images, up to @ref FOTA_DOWNLOAD_IMAGES_MAX.
+ * @param sec_tag Security tag you want to use with HTTPS set to -1 to Disable.
+ * @param apn Access Point Name to use or NULL to use the default APN.
+ * @param fragment_size Fragment size to be used for the download.
+ *			If 0, @option{CONFIG_DOWNLOAD_CLIENT_HTTP_FRAG_SIZE} is used.
+ *
+ * @retval 0	     If download has started successfully.
+ * @retval -EINVAL   If the manifest is empty or has too many images.
+ *                   Otherwise, a negative value is returned.
+ */
+int fota_download_manifest_start(const char *host,
+				 const struct fota_download_image *manifest,
+				 size_t count, int sec_tag, const char *apn,
+				 size_t fragment_size);
+
 #ifdef __cplusplus
 }
 #endif
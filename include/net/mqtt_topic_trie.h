@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef MQTT_TOPIC_TRIE_H__
+#define MQTT_TOPIC_TRIE_H__
+
+#include <zephyr/types.h>
+#include <stddef.h>
+
+/**
+ * @defgroup mqtt_topic_trie MQTT topic trie
+ * @{
+ * @brief Library that matches received MQTT topics against a set of topic
+ *        filters, and captures the topic levels matched by wildcards.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Node of a topic trie, one topic level of a filter. */
+struct mqtt_topic_trie_node {
+	/** Topic level, pointing into the filter string. */
+	const char *level;
+	/** Length of the topic level. */
+	uint16_t level_len;
+	/** Index of the parent node. */
+	uint16_t parent;
+	/** Index of the '+' child, 0 if none. */
+	uint16_t plus;
+	/** Index of the '#' child, 0 if none. */
+	uint16_t hash;
+	/** Hash of the topic level. */
+	uint32_t level_hash;
+	/** ID of the filter that ends at this node, -1 if none. */
+	int id;
+};
+
+/** @brief Topic trie. Define it with @ref MQTT_TOPIC_TRIE_DEFINE. */
+struct mqtt_topic_trie {
+	/** Nodes, the first one is the root. */
+	struct mqtt_topic_trie_node *nodes;
+	/** Hash table of the literal children, by parent and topic level.
+	 *  Holds node indices, 0 for an empty slot.
+	 */
+	uint16_t *slots;
+	/** Number of nodes in use. */
+	uint16_t node_count;
+	/** Number of nodes. */
+	uint16_t node_max;
+	/** Number of slots in the hash table. */
+	uint16_t slot_count;
+};
+
+/** @brief Topic level captured by a wildcard. */
+struct mqtt_topic_trie_capture {
+	/** Start of the captured level, pointing into the topic. */
+	const char *ptr;
+	/** Length of the captured level. For '#', the length of the
+	 *  remaining topic levels, which can be 0.
+	 */
+	size_t len;
+};
+
+/** @brief Result of a match. */
+struct mqtt_topic_trie_match {
+	/** Levels captured by the wildcards of the filter, in order. */
+	struct mqtt_topic_trie_capture
+		capture[CONFIG_MQTT_TOPIC_TRIE_CAPTURE_MAX];
+	/** Number of captured levels. */
+	size_t capture_count;
+};
+
+/** @brief Define a topic trie.
+ *
+ *  @param _name Name of the trie.
+ *  @param _node_max Number of nodes. Each topic level of a filter takes a
+ *                   node, unless it is shared with a filter added before,
+ *                   and the root takes one.
+ */
+#define MQTT_TOPIC_TRIE_DEFINE(_name, _node_max)			       \
+	static struct mqtt_topic_trie_node _name##_nodes[_node_max];	       \
+	static uint16_t _name##_slots[2 * (_node_max)];			       \
+	static struct mqtt_topic_trie _name = {				       \
+		.nodes = _name##_nodes,					       \
+		.slots = _name##_slots,					       \
+		.node_max = (_node_max),				       \
+		.slot_count = 2 * (_node_max),				       \
+	}
+
+/** @brief Remove all filters from a trie.
+ *
+ *  @param[in] trie Trie.
+ */
+void mqtt_topic_trie_clear(struct mqtt_topic_trie *trie);
+
+/** @brief Add a topic filter.
+ *
+ *  The filter may contain the '+' and '#' wildcards, following the MQTT
+ *  rules. The filter string is not copied, and must be kept as long as the
+ *  trie is used.
+ *
+ *  @param[in] trie   Trie.
+ *  @param[in] filter Topic filter. It does not need to be null-terminated.
+ *  @param[in] len    Length of the filter.
+ *  @param[in] id     ID returned when a topic matches the filter, 0 or
+ *                    greater.
+ *
+ *  @retval 0 If successful.
+ *  @retval -EINVAL If the filter or the ID is not valid, or the filter has
+ *                  more levels than CONFIG_MQTT_TOPIC_TRIE_LEVEL_MAX or more
+ *                  wildcards than CONFIG_MQTT_TOPIC_TRIE_CAPTURE_MAX.
+ *  @retval -EALREADY If the filter has already been added.
+ *  @retval -ENOMEM If there are not enough nodes left in the trie.
+ */
+int mqtt_topic_trie_add(struct mqtt_topic_trie *trie, const char *filter,
+			size_t len, int id);
+
+/** @brief Match a topic against the filters of a trie.
+ *
+ *  Each topic level is hashed once and looked up in one step, so the cost
+ *  grows with the length of the topic, and not with the number of filters.
+ *  A literal topic level is preferred over '+', and '+' over '#'. If a
+ *  preferred branch fails at a later level, the next one is tried, which
+ *  visits each node at most once.
+ *
+ *  As required by MQTT, a topic that starts with '$' does not match a
+ *  filter that starts with a wildcard.
+ *
+ *  @param[in]  trie  Trie.
+ *  @param[in]  topic Topic. It does not need to be null-terminated.
+ *  @param[in]  len   Length of the topic.
+ *  @param[out] match Levels captured by the wildcards, can be NULL.
+ *
+ *  @return ID of the matching filter, or -ENOENT if no filter matches.
+ *          -E2BIG if the topic has more levels than
+ *          CONFIG_MQTT_TOPIC_TRIE_LEVEL_MAX.
+ */
+int mqtt_topic_trie_match(const struct mqtt_topic_trie *trie,
+			  const char *topic, size_t len,
+			  struct mqtt_topic_trie_match *match);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* MQTT_TOPIC_TRIE_H__ */
@@ -35,7 +35,9 @@ enum nrf_cloud_evt_type {
 	NRF_CLOUD_EVT_SENSOR_ATTACHED,
 	/** The device received data from the cloud. */
 	NRF_CLOUD_EVT_RX_DATA,
-	/** The data sent to the cloud was acknowledged. */
+	/** The data sent to the cloud was acknowledged. The tag of the data
+	 *  is given in the event.
+	 */
 	NRF_CLOUD_EVT_SENSOR_DATA_ACK,
 	/** The transport was disconnected. */
 	NRF_CLOUD_EVT_TRANSPORT_DISCONNECTED,
@@ -125,6 +127,10 @@ struct nrf_cloud_evt {
 	struct nrf_cloud_data data;
 	/** Topic on which data was received. */
 	struct nrf_cloud_topic topic;
+	/** Tag of the acknowledged data, or the message ID that the library
+	 *  allocated if it was sent without a tag.
+	 */
+	uint32_t tag;
 };
 
 /**
@@ -135,6 +141,30 @@ struct nrf_cloud_evt {
  */
 typedef void (*nrf_cloud_event_handler_t)(const struct nrf_cloud_evt *evt);
 
+/**@brief Timing of the last connection to the cloud, used to measure the
+ * time saved when a persistent session is resumed. All times are in
+ * milliseconds from the start of the connection.
+ */
+struct nrf_cloud_connect_stats {
+	/** Time until the MQTT CONNECT was sent, which includes the DNS
+	 *  lookup and the TCP and TLS handshakes.
+	 */
+	uint32_t handshake_ms;
+	/** Time until @ref NRF_CLOUD_EVT_TRANSPORT_CONNECTED, 0 if not
+	 *  connected.
+	 */
+	uint32_t connack_ms;
+	/** Time until @ref NRF_CLOUD_EVT_READY, 0 if not ready. */
+	uint32_t ready_ms;
+	/** The broker resumed a persistent session. */
+	bool persistent_session;
+	/** The shadow was requested. It is not requested when a persistent
+	 *  session is resumed after a disconnect, since changes to the
+	 *  shadow are then received on the delta topic.
+	 */
+	bool shadow_requested;
+};
+
 /**@brief Initialization parameters for the module. */
 struct nrf_cloud_init_param {
 	/** Event handler that is registered with the module. */
@@ -241,6 +271,17 @@ int nrf_cloud_disconnect(void);
  */
 void nrf_cloud_process(void);
 
+/**
+ * @brief Get the timing of the last connection to the cloud.
+ *
+ * @param[out] stats Pointer to where the timing is stored.
+ *
+ * @retval 0 If successful.
+ * @retval -EINVAL If stats is NULL.
+ * @retval -ENODATA If no connection has been started.
+ */
+int nrf_cloud_connect_stats_get(struct nrf_cloud_connect_stats *stats);
+
 /** @} */
 
 #ifdef __cplusplus
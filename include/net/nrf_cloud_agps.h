@@ -48,6 +48,44 @@ int nrf_cloud_agps_request_all(void);
  */
 int nrf_cloud_agps_process(const char *buf, size_t buf_len, const int *socket);
 
+/**@brief Prepares for incremental processing of binary A-GPS data.
+ *
+ * Must be called before the first fragment of an A-GPS response is passed
+ * to @ref nrf_cloud_agps_stream_process. Any partially processed response
+ * is discarded.
+ *
+ * @param socket Pointer to GNSS socket to which A-GPS data will be injected.
+ *		 If NULL, the nRF9160 GPS driver is used to inject the data.
+ *
+ * @return 0 if successful, otherwise a (negative) error code.
+ */
+int nrf_cloud_agps_stream_init(const int *socket);
+
+/**@brief Processes a fragment of binary A-GPS data received from nRF Cloud.
+ *
+ * The fragment can be of any size and is not required to be aligned with
+ * element boundaries. Each A-GPS element is injected to the modem as soon
+ * as it has been completely received, so only one element is buffered
+ * internally.
+ *
+ * @param buf Pointer to fragment of data received from nRF Cloud.
+ * @param buf_len Size of the fragment.
+ *
+ * @return 0 if successful, otherwise a (negative) error code.
+ */
+int nrf_cloud_agps_stream_process(const char *buf, size_t buf_len);
+
+/**@brief Completes incremental processing of binary A-GPS data.
+ *
+ * Injects the GPS system time and time-of-week data, which is only complete
+ * once the whole response has been processed.
+ *
+ * @retval 0 if successful.
+ * @retval -ENODATA if the data ended in the middle of an element.
+ * @return Otherwise a (negative) error code.
+ */
+int nrf_cloud_agps_stream_finish(void);
+
 /** @} */
 
 #ifdef __cplusplus
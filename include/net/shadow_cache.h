@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef SHADOW_CACHE_H__
+#define SHADOW_CACHE_H__
+
+#include <zephyr/types.h>
+#include <stddef.h>
+
+/**
+ * @defgroup shadow_cache Shadow cache
+ * @{
+ * @brief Library that remembers the reported state acknowledged by a device
+ *        shadow, and reduces the next report to the values that changed.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Value of the reported document, identified by its path. */
+struct shadow_cache_field {
+	/** Hash of the path of the value. */
+	uint32_t path;
+	/** Hash of the acknowledged value, 0 if none. */
+	uint32_t acked;
+	/** Hash of the value sent and not yet acknowledged, 0 if none. */
+	uint32_t sent;
+};
+
+/** @brief Shadow cache. Define it with @ref SHADOW_CACHE_DEFINE. */
+struct shadow_cache {
+	/** Fields of the reported document. */
+	struct shadow_cache_field *fields;
+	/** Number of fields in use. */
+	uint16_t count;
+	/** Number of fields. */
+	uint16_t size;
+	/** Last known version of the shadow, 0 if unknown. */
+	uint32_t version;
+};
+
+/** @brief Define a shadow cache.
+ *
+ *  @param _name Name of the cache.
+ *  @param _size Number of fields. Each value of the reported document that
+ *               is not an object takes a field.
+ */
+#define SHADOW_CACHE_DEFINE(_name, _size)				       \
+	static struct shadow_cache_field _name##_fields[_size];		       \
+	static struct shadow_cache _name = {				       \
+		.fields = _name##_fields,				       \
+		.size = (_size),					       \
+	}
+
+/** @brief Reduce a reported document to the values that changed.
+ *
+ *  Values are compared with the ones last acknowledged, and with the ones
+ *  sent and not yet acknowledged. The patch keeps the objects of the
+ *  document that contain a changed value, and only those values. Arrays are
+ *  compared and sent as a whole. Values that are no longer in the document
+ *  are left out, as a device shadow keeps them in either case.
+ *
+ *  If nothing has been acknowledged since the cache was invalidated, the
+ *  patch is the whole document. If the document has more values than the
+ *  cache can hold, the patch is sent without being tracked, and the cache
+ *  is invalidated so that the next report is complete.
+ *
+ *  The values in the patch are marked as sent. Only one report should be
+ *  in flight at a time.
+ *
+ *  @param[in]  cache Cache.
+ *  @param[in]  json  Reported document, a JSON object. It does not need to
+ *                    be null-terminated.
+ *  @param[in]  len   Length of the document.
+ *  @param[out] buf   Patch, null-terminated. A buffer of @p len + 1 bytes
+ *                    is always large enough.
+ *  @param[in]  size  Size of @p buf.
+ *
+ *  @return Length of the patch, or 0 if no value changed and nothing needs
+ *          to be sent.
+ *  @return -EINVAL If the document is not a valid JSON object.
+ *  @return -ENOMEM If the document has more than
+ *                  CONFIG_SHADOW_CACHE_JSON_TOKENS tokens, and they
+ *                  could not be allocated.
+ *  @return -EFBIG  If the document is longer than JSON_TOK_MAX_LEN.
+ *  @return -ENOBUFS If the patch does not fit @p buf.
+ */
+int shadow_cache_diff(struct shadow_cache *cache, const char *json,
+		      size_t len, char *buf, size_t size);
+
+/** @brief Acknowledge the report in flight.
+ *
+ *  The values sent become the acknowledged ones. The version of a shadow
+ *  increases by one with each accepted update. If it does not follow the
+ *  last known version, the shadow was changed by someone else, and the
+ *  cache is invalidated.
+ *
+ *  @param[in] cache   Cache.
+ *  @param[in] version Version of the shadow after the update, or 0 if it is
+ *                     not known.
+ *
+ *  @retval 0 If successful.
+ *  @retval -ESTALE If the version does not follow the last known version.
+ *                  The cache has been invalidated.
+ */
+int shadow_cache_ack(struct shadow_cache *cache, uint32_t version);
+
+/** @brief Check the version of a document received from the shadow.
+ *
+ *  A delta increases the version by one, and a document requested from the
+ *  shadow has the current version. Any other version means that the shadow
+ *  was changed by someone else, and the cache is invalidated.
+ *
+ *  @param[in] cache   Cache.
+ *  @param[in] version Version of the received document.
+ *
+ *  @retval 0 If successful.
+ *  @retval -ESTALE If the version does not match the last known version.
+ *                  The cache has been invalidated.
+ */
+int shadow_cache_version_check(struct shadow_cache *cache, uint32_t version);
+
+/** @brief Forget all values and the version, so that the next report is
+ *         complete.
+ *
+ *  Call this after a reconnect, or when a report was rejected.
+ *
+ *  @param[in] cache Cache.
+ */
+void shadow_cache_invalidate(struct shadow_cache *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* SHADOW_CACHE_H__ */
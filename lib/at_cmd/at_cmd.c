@@ -9,10 +9,11 @@
 #include <stdio.h>
 #include <net/socket.h>
 #include <init.h>
-#include <bsd_limits.h>
 
 #include <modem/at_cmd.h>
+#if defined(CONFIG_BSD_LIBRARY)
 #include <modem/bsdlib.h>
+#endif
 
 LOG_MODULE_REGISTER(at_cmd, CONFIG_AT_CMD_LOG_LEVEL);
 
@@ -246,6 +247,7 @@ static void socket_thread_fn(void *arg1, void *arg2, void *arg3)
 		/* Handle possible socket-level errors */
 
 		if (bytes_read < 0) {
+#if defined(CONFIG_BSD_LIBRARY)
 			if (errno == EHOSTDOWN) {
 				LOG_DBG("AT host is going down, sleeping");
 				atomic_set(&shutdown_mode, 1);
@@ -262,10 +264,10 @@ static void socket_thread_fn(void *arg1, void *arg2, void *arg3)
 
 
 				continue;
-			} else {
-				LOG_ERR("AT socket recv failed with err %d",
-					bytes_read);
 			}
+#endif /* CONFIG_BSD_LIBRARY */
+
+			LOG_ERR("AT socket recv failed with err %d", bytes_read);
 
 			if ((close(common_socket_fd) == 0) &&
 			    (open_socket() == 0)) {
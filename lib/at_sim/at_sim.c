@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <net/socket.h>
+#include <sockets_internal.h>
+#include <sys/fdtable.h>
+#include <logging/log.h>
+
+#include <modem/at_sim.h>
+
+LOG_MODULE_REGISTER(at_sim, CONFIG_AT_SIM_LOG_LEVEL);
+
+#define AT_SIM_OK_STR    "OK\r\n"
+#define AT_SIM_ERROR_STR "ERROR\r\n"
+
+/* Message waiting to be read from a socket */
+struct rx_item {
+	int64_t ready_at;	/* Uptime when the message can be read */
+	const char *msg;	/* Null-terminated message */
+	bool notif;		/* Message is a notification */
+};
+
+struct sim_socket {
+	bool in_use;
+	struct k_sem rx_sem;
+	/* Messages sorted by ready time, read from index 0. */
+	struct rx_item rx[CONFIG_AT_SIM_QUEUE_LEN];
+	size_t rx_count;
+};
+
+static struct sim_socket sockets[CONFIG_AT_SIM_SOCKETS_MAX];
+static const struct at_sim_entry *script;
+static size_t script_len;
+static size_t script_pos;
+static struct at_sim_stats stats;
+
+K_MUTEX_DEFINE(sim_mutex);
+
+static const struct socket_op_vtable at_sim_fd_op_vtable;
+
+/* Must be called with sim_mutex held. */
+static int rx_enqueue(struct sim_socket *sock, const char *msg,
+		      int64_t ready_at, bool notif)
+{
+	size_t i;
+
+	if (sock->rx_count == ARRAY_SIZE(sock->rx)) {
+		stats.dropped++;
+		return -ENOBUFS;
+	}
+
+	/* Keep messages in the order they become ready, preserving the
+	 * order of messages that become ready at the same time.
+	 */
+	for (i = sock->rx_count; i > 0; i--) {
+		if (sock->rx[i - 1].ready_at <= ready_at) {
+			break;
+		}
+
+		sock->rx[i] = sock->rx[i - 1];
+	}
+
+	sock->rx[i].ready_at = ready_at;
+	sock->rx[i].msg = msg;
+	sock->rx[i].notif = notif;
+	sock->rx_count++;
+
+	k_sem_give(&sock->rx_sem);
+
+	return 0;
+}
+
+/* Must be called with sim_mutex held. */
+static int notify_all(const char *notif, int64_t ready_at)
+{
+	int err = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(sockets); i++) {
+		if (!sockets[i].in_use) {
+			continue;
+		}
+
+		if (rx_enqueue(&sockets[i], notif, ready_at, true)) {
+			err = -ENOBUFS;
+		}
+	}
+
+	return err;
+}
+
+static bool entry_match(const struct at_sim_entry *entry, const char *cmd,
+			size_t len)
+{
+	size_t cmd_len = strlen(entry->cmd);
+
+	return (len >= cmd_len) && (strncmp(entry->cmd, cmd, cmd_len) == 0);
+}
+
+/* Must be called with sim_mutex held. */
+static const struct at_sim_entry *script_lookup(const char *cmd, size_t len)
+{
+	for (size_t i = 0; i < script_len; i++) {
+		size_t idx = (script_pos + i) % script_len;
+
+		if (entry_match(&script[idx], cmd, len)) {
+			script_pos = (idx + 1) % script_len;
+			return &script[idx];
+		}
+	}
+
+	return NULL;
+}
+
+static int at_sim_socket_create(int family, int type, int proto)
+{
+	int fd;
+	struct sim_socket *sock = NULL;
+
+	k_mutex_lock(&sim_mutex, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(sockets); i++) {
+		if (!sockets[i].in_use) {
+			sock = &sockets[i];
+			break;
+		}
+	}
+
+	if (sock == NULL) {
+		k_mutex_unlock(&sim_mutex);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	fd = z_reserve_fd();
+	if (fd < 0) {
+		k_mutex_unlock(&sim_mutex);
+		return -1;
+	}
+
+	sock->in_use = true;
+	sock->rx_count = 0;
+	k_sem_init(&sock->rx_sem, 0, 1);
+
+	k_mutex_unlock(&sim_mutex);
+
+	z_finalize_fd(fd, sock,
+		      (const struct fd_op_vtable *)&at_sim_fd_op_vtable);
+
+	LOG_DBG("Simulated AT socket %d created", fd);
+
+	return fd;
+}
+
+static ssize_t at_sim_sendto(void *obj, const void *buf, size_t len,
+			     int flags, const struct sockaddr *to,
+			     socklen_t tolen)
+{
+	struct sim_socket *sock = obj;
+	const struct at_sim_entry *entry;
+	const char *resp;
+	int64_t ready_at = k_uptime_get();
+
+	ARG_UNUSED(flags);
+	ARG_UNUSED(to);
+	ARG_UNUSED(tolen);
+
+	k_mutex_lock(&sim_mutex, K_FOREVER);
+
+	stats.cmds++;
+
+	entry = script_lookup(buf, len);
+	if (entry) {
+		resp = entry->resp;
+		ready_at += entry->latency_ms;
+	} else {
+		LOG_DBG("No script entry for command");
+		stats.unmatched++;
+		resp = IS_ENABLED(CONFIG_AT_SIM_UNMATCHED_ERROR) ?
+			AT_SIM_ERROR_STR : AT_SIM_OK_STR;
+	}
+
+	(void)rx_enqueue(sock, resp, ready_at, false);
+
+	if (entry && entry->notif) {
+		for (size_t i = 0; i < entry->notif_count; i++) {
+			(void)notify_all(entry->notif, ready_at);
+			ready_at += entry->notif_interval_ms;
+		}
+	}
+
+	k_mutex_unlock(&sim_mutex);
+
+	return len;
+}
+
+static ssize_t at_sim_recvfrom(void *obj, void *buf, size_t max_len,
+			       int flags, struct sockaddr *from,
+			       socklen_t *fromlen)
+{
+	struct sim_socket *sock = obj;
+	struct rx_item item;
+	size_t len;
+
+	ARG_UNUSED(from);
+	ARG_UNUSED(fromlen);
+
+	for (;;) {
+		k_timeout_t timeout = K_FOREVER;
+
+		k_mutex_lock(&sim_mutex, K_FOREVER);
+
+		if (!sock->in_use) {
+			k_mutex_unlock(&sim_mutex);
+			errno = EBADF;
+			return -1;
+		}
+
+		if (sock->rx_count > 0) {
+			int64_t wait = sock->rx[0].ready_at - k_uptime_get();
+
+			if (wait <= 0) {
+				item = sock->rx[0];
+				sock->rx_count--;
+				memmove(&sock->rx[0], &sock->rx[1],
+					sock->rx_count * sizeof(sock->rx[0]));
+
+				if (item.notif) {
+					stats.notifs++;
+				}
+
+				k_mutex_unlock(&sim_mutex);
+				break;
+			}
+
+			timeout = K_MSEC(wait);
+		}
+
+		k_mutex_unlock(&sim_mutex);
+
+		if (flags & MSG_DONTWAIT) {
+			errno = EAGAIN;
+			return -1;
+		}
+
+		(void)k_sem_take(&sock->rx_sem, timeout);
+	}
+
+	/* Like the modem, include the null terminator in the message. */
+	len = MIN(strlen(item.msg) + 1, max_len);
+	memcpy(buf, item.msg, len);
+
+	return len;
+}
+
+static ssize_t at_sim_read(void *obj, void *buf, size_t count)
+{
+	return at_sim_recvfrom(obj, buf, count, 0, NULL, NULL);
+}
+
+static ssize_t at_sim_write(void *obj, const void *buf, size_t count)
+{
+	return at_sim_sendto(obj, buf, count, 0, NULL, 0);
+}
+
+static int at_sim_close(void *obj)
+{
+	struct sim_socket *sock = obj;
+
+	k_mutex_lock(&sim_mutex, K_FOREVER);
+	sock->in_use = false;
+	sock->rx_count = 0;
+	k_mutex_unlock(&sim_mutex);
+
+	/* Wake up any pending reader. */
+	k_sem_give(&sock->rx_sem);
+
+	return 0;
+}
+
+static int at_sim_ioctl(void *obj, unsigned int request, va_list args)
+{
+	ARG_UNUSED(obj);
+	ARG_UNUSED(request);
+	ARG_UNUSED(args);
+
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+static const struct socket_op_vtable at_sim_fd_op_vtable = {
+	.fd_vtable = {
+		.read = at_sim_read,
+		.write = at_sim_write,
+		.close = at_sim_close,
+		.ioctl = at_sim_ioctl,
+	},
+	.sendto = at_sim_sendto,
+	.recvfrom = at_sim_recvfrom,
+};
+
+static bool at_sim_is_supported(int family, int type, int proto)
+{
+	ARG_UNUSED(type);
+
+	return (family == AF_LTE) && (proto == NPROTO_AT);
+}
+
+NET_SOCKET_REGISTER(at_sim, AF_LTE, at_sim_is_supported,
+		    at_sim_socket_create);
+
+int at_sim_script_set(const struct at_sim_entry *entries, size_t count)
+{
+	if ((entries == NULL) && (count > 0)) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if ((entries[i].cmd == NULL) || (entries[i].resp == NULL)) {
+			LOG_ERR("Script entry %d is incomplete", i);
+			return -EINVAL;
+		}
+	}
+
+	k_mutex_lock(&sim_mutex, K_FOREVER);
+	script = entries;
+	script_len = count;
+	script_pos = 0;
+	k_mutex_unlock(&sim_mutex);
+
+	return 0;
+}
+
+int at_sim_notify(const char *notif, uint32_t delay_ms)
+{
+	return at_sim_notify_burst(notif, 1, delay_ms);
+}
+
+int at_sim_notify_burst(const char *notif, size_t count, uint32_t interval_ms)
+{
+	int err = 0;
+	int64_t ready_at = k_uptime_get();
+
+	if (notif == NULL) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&sim_mutex, K_FOREVER);
+
+	for (size_t i = 0; i < count; i++) {
+		ready_at += interval_ms;
+
+		if (notify_all(notif, ready_at)) {
+			err = -ENOBUFS;
+		}
+	}
+
+	k_mutex_unlock(&sim_mutex);
+
+	return err;
+}
+
+void at_sim_stats_get(struct at_sim_stats *out)
+{
+	k_mutex_lock(&sim_mutex, K_FOREVER);
+	*out = stats;
+	k_mutex_unlock(&sim_mutex);
+}
+
+void at_sim_reset(void)
+{
+	k_mutex_lock(&sim_mutex, K_FOREVER);
+
+	script_pos = 0;
+	memset(&stats, 0, sizeof(stats));
+
+	for (size_t i = 0; i < ARRAY_SIZE(sockets); i++) {
+		sockets[i].rx_count = 0;
+	}
+
+	k_mutex_unlock(&sim_mutex);
+}
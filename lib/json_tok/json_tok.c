@@ -0,0 +1,669 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <json_tok.h>
+
+/* While a container is open, its next index holds the enclosing container */
+#define NO_PARENT UINT16_MAX
+
+enum expect {
+	EXPECT_VALUE,
+	EXPECT_KEY,
+	EXPECT_COLON,
+	EXPECT_COMMA,
+	EXPECT_NOTHING,
+};
+
+static bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static int hex_val(char c)
+{
+	if (is_digit(c)) {
+		return c - '0';
+	} else if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	} else if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+
+	return -1;
+}
+
+/* Return the length of the string starting after the opening quote */
+static int string_len(const char *json, size_t pos, size_t len)
+{
+	size_t start = pos;
+
+	for (; pos < len && json[pos] != '\0'; pos++) {
+		char c = json[pos];
+
+		if (c == '"') {
+			return pos - start;
+		}
+
+		if ((uint8_t)c < 0x20) {
+			return -EINVAL;
+		}
+
+		if (c != '\\') {
+			continue;
+		}
+
+		if (++pos >= len) {
+			return -EINVAL;
+		}
+
+		switch (json[pos]) {
+		case '"':
+		case '\\':
+		case '/':
+		case 'b':
+		case 'f':
+		case 'n':
+		case 'r':
+		case 't':
+			break;
+		case 'u':
+			if (len - pos <= 4) {
+				return -EINVAL;
+			}
+			for (int i = 1; i <= 4; i++) {
+				if (hex_val(json[pos + i]) < 0) {
+					return -EINVAL;
+				}
+			}
+			pos += 4;
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+
+	/* Not terminated */
+	return -EINVAL;
+}
+
+static bool is_number(const char *str, size_t len)
+{
+	size_t i = 0;
+	size_t digits;
+
+	if (i < len && str[i] == '-') {
+		i++;
+	}
+
+	/* No leading zeros */
+	if (i < len && str[i] == '0') {
+		i++;
+	} else {
+		for (digits = 0; i < len && is_digit(str[i]); i++) {
+			digits++;
+		}
+		if (digits == 0) {
+			return false;
+		}
+	}
+
+	if (i < len && str[i] == '.') {
+		for (i++, digits = 0; i < len && is_digit(str[i]); i++) {
+			digits++;
+		}
+		if (digits == 0) {
+			return false;
+		}
+	}
+
+	if (i < len && (str[i] == 'e' || str[i] == 'E')) {
+		i++;
+		if (i < len && (str[i] == '+' || str[i] == '-')) {
+			i++;
+		}
+		for (digits = 0; i < len && is_digit(str[i]); i++) {
+			digits++;
+		}
+		if (digits == 0) {
+			return false;
+		}
+	}
+
+	return i == len;
+}
+
+static bool is_literal(const char *str, size_t len, const char *literal)
+{
+	return len == strlen(literal) && memcmp(str, literal, len) == 0;
+}
+
+/* Return the length of the number or literal starting at pos */
+static int primitive_len(const char *json, size_t pos, size_t len)
+{
+	size_t start = pos;
+	size_t n;
+
+	for (; pos < len && json[pos] != '\0'; pos++) {
+		char c = json[pos];
+
+		if (is_space(c) || c == ',' || c == ']' || c == '}' ||
+		    c == ':') {
+			break;
+		}
+	}
+
+	n = pos - start;
+
+	if (is_literal(&json[start], n, "true") ||
+	    is_literal(&json[start], n, "false") ||
+	    is_literal(&json[start], n, "null") ||
+	    is_number(&json[start], n)) {
+		return n;
+	}
+
+	return -EINVAL;
+}
+
+int json_tok_parse(const char *json, size_t len,
+		   struct json_tok *toks, size_t count)
+{
+	enum expect expect = EXPECT_VALUE;
+	/* Set right after a container is opened, when it may be closed */
+	bool empty = false;
+	uint16_t parent = NO_PARENT;
+	/* Without tokens, the open containers are kept as bits, set for
+	 * arrays, with the innermost one in the lowest bit.
+	 */
+	uint32_t arrays = 0;
+	uint8_t depth = 0;
+	/* Values that are only counted */
+	struct json_tok counted;
+	bool in_obj;
+	uint16_t n = 0;
+	size_t pos;
+
+	if (json == NULL) {
+		return -EINVAL;
+	}
+
+	if (len > JSON_TOK_MAX_LEN) {
+		return -EFBIG;
+	}
+
+	/* A document has fewer tokens than characters */
+	count = (toks == NULL) ? UINT16_MAX : MIN(count, UINT16_MAX);
+
+	for (pos = 0; pos < len && json[pos] != '\0'; pos++) {
+		char c = json[pos];
+		struct json_tok *tok;
+		int tok_len;
+
+		if (is_space(c)) {
+			continue;
+		}
+
+		switch (c) {
+		case '{':
+		case '[':
+			if (expect != EXPECT_VALUE) {
+				return -EINVAL;
+			}
+			if (n >= count) {
+				return -ENOMEM;
+			}
+
+			if (toks == NULL) {
+				if (depth >= JSON_TOK_COUNT_MAX_DEPTH) {
+					return -ENOMEM;
+				}
+				arrays = (arrays << 1) | (c == '[');
+				depth++;
+				n++;
+			} else {
+				tok = &toks[n];
+				tok->type = (c == '{') ? JSON_TOK_OBJ
+						       : JSON_TOK_ARR;
+				tok->start = pos;
+				tok->next = parent;
+				parent = n++;
+			}
+
+			expect = (c == '{') ? EXPECT_KEY : EXPECT_VALUE;
+			empty = true;
+			continue;
+
+		case '}':
+		case ']':
+			if (!empty && expect != EXPECT_COMMA) {
+				return -EINVAL;
+			}
+
+			if (toks == NULL) {
+				if (depth == 0 ||
+				    (arrays & 1) != (uint32_t)(c == ']')) {
+					return -EINVAL;
+				}
+				arrays >>= 1;
+				depth--;
+				break;
+			}
+
+			if (parent == NO_PARENT) {
+				return -EINVAL;
+			}
+
+			tok = &toks[parent];
+			if (tok->type != ((c == '}') ? JSON_TOK_OBJ
+						     : JSON_TOK_ARR)) {
+				return -EINVAL;
+			}
+
+			parent = tok->next;
+			tok->next = n;
+			tok->len = pos + 1 - tok->start;
+			break;
+
+		case ':':
+			if (expect != EXPECT_COLON) {
+				return -EINVAL;
+			}
+			expect = EXPECT_VALUE;
+			continue;
+
+		case ',':
+			if (expect != EXPECT_COMMA) {
+				return -EINVAL;
+			}
+			in_obj = (toks == NULL) ? !(arrays & 1) :
+				 (toks[parent].type == JSON_TOK_OBJ);
+			expect = in_obj ? EXPECT_KEY : EXPECT_VALUE;
+			continue;
+
+		case '"':
+			if (expect != EXPECT_VALUE && expect != EXPECT_KEY) {
+				return -EINVAL;
+			}
+
+			tok_len = string_len(json, pos + 1, len);
+			if (tok_len < 0) {
+				return tok_len;
+			}
+			if (n >= count) {
+				return -ENOMEM;
+			}
+
+			tok = (toks == NULL) ? &counted : &toks[n];
+			tok->type = JSON_TOK_STR;
+			tok->start = pos + 1;
+			tok->len = tok_len;
+			tok->next = ++n;
+
+			pos += tok_len + 1;
+
+			if (expect == EXPECT_KEY) {
+				expect = EXPECT_COLON;
+				empty = false;
+				continue;
+			}
+			break;
+
+		default:
+			if (expect != EXPECT_VALUE) {
+				return -EINVAL;
+			}
+
+			tok_len = primitive_len(json, pos, len);
+			if (tok_len < 0) {
+				return tok_len;
+			}
+			if (n >= count) {
+				return -ENOMEM;
+			}
+
+			tok = (toks == NULL) ? &counted : &toks[n];
+			tok->type = JSON_TOK_PRIM;
+			tok->start = pos;
+			tok->len = tok_len;
+			tok->next = ++n;
+
+			pos += tok_len - 1;
+			break;
+		}
+
+		/* A value is complete */
+		if (toks == NULL) {
+			expect = (depth == 0) ? EXPECT_NOTHING : EXPECT_COMMA;
+		} else {
+			expect = (parent == NO_PARENT) ? EXPECT_NOTHING
+						       : EXPECT_COMMA;
+		}
+		empty = false;
+	}
+
+	if (expect != EXPECT_NOTHING) {
+		return -EINVAL;
+	}
+
+	return n;
+}
+
+int json_tok_parse_alloc(const char *json, size_t len,
+			 struct json_tok *buf, size_t count,
+			 struct json_tok **toks)
+{
+	int n = json_tok_parse(json, len, buf, count);
+
+	*toks = buf;
+
+#if defined(CONFIG_JSON_TOK_HEAP)
+	if (n != -ENOMEM) {
+		return n;
+	}
+
+	n = json_tok_parse(json, len, NULL, 0);
+	if (n < 0) {
+		return n;
+	}
+
+	*toks = k_malloc(n * sizeof(struct json_tok));
+	if (*toks == NULL) {
+		*toks = buf;
+		return -ENOMEM;
+	}
+
+	n = json_tok_parse(json, len, *toks, n);
+	if (n < 0) {
+		json_tok_free(*toks, buf);
+		*toks = buf;
+	}
+#endif /* defined(CONFIG_JSON_TOK_HEAP) */
+
+	return n;
+}
+
+void json_tok_free(struct json_tok *toks, const struct json_tok *buf)
+{
+#if defined(CONFIG_JSON_TOK_HEAP)
+	if (toks != buf) {
+		k_free(toks);
+	}
+#endif
+}
+
+/* Parse an array index, which must be all digits */
+static int index_parse(const char *str, size_t len)
+{
+	int index = 0;
+
+	if (len == 0 || len > 4) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		if (!is_digit(str[i])) {
+			return -EINVAL;
+		}
+		index = index * 10 + (str[i] - '0');
+	}
+
+	return index;
+}
+
+static int member_find(const char *json, const struct json_tok *toks,
+		       int obj, const char *key, size_t key_len)
+{
+	int i = obj + 1;
+
+	while (i < toks[obj].next) {
+		const struct json_tok *name = &toks[i];
+
+		if (name->len == key_len &&
+		    memcmp(&json[name->start], key, key_len) == 0) {
+			return i + 1;
+		}
+
+		/* Skip the name and the whole value */
+		i = toks[i + 1].next;
+	}
+
+	return -ENOENT;
+}
+
+static int element_find(const struct json_tok *toks, int arr, int index)
+{
+	int i = arr + 1;
+
+	while (i < toks[arr].next) {
+		if (index-- == 0) {
+			return i;
+		}
+
+		i = toks[i].next;
+	}
+
+	return -ENOENT;
+}
+
+int json_tok_find(const char *json, const struct json_tok *toks,
+		  int from, const char *path)
+{
+	int i = from;
+
+	if (json == NULL || toks == NULL || path == NULL || from < 0) {
+		return -ENOENT;
+	}
+
+	while (*path != '\0' && i >= 0) {
+		const char *dot = strchr(path, '.');
+		size_t seg_len = dot ? (size_t)(dot - path) : strlen(path);
+
+		if (toks[i].type == JSON_TOK_OBJ) {
+			i = member_find(json, toks, i, path, seg_len);
+		} else if (toks[i].type == JSON_TOK_ARR) {
+			int index = index_parse(path, seg_len);
+
+			i = index < 0 ? -ENOENT : element_find(toks, i, index);
+		} else {
+			i = -ENOENT;
+		}
+
+		path += seg_len;
+		if (*path == '.') {
+			path++;
+		}
+	}
+
+	return i;
+}
+
+bool json_tok_eq(const char *json, const struct json_tok *tok,
+		 const char *str)
+{
+	return tok->type == JSON_TOK_STR && is_literal(&json[tok->start],
+						       tok->len, str);
+}
+
+/* Encode a code point as UTF-8, and return its length */
+static size_t utf8_encode(uint32_t cp, char *out)
+{
+	if (cp < 0x80) {
+		out[0] = cp;
+		return 1;
+	} else if (cp < 0x800) {
+		out[0] = 0xc0 | (cp >> 6);
+		out[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	} else if (cp < 0x10000) {
+		out[0] = 0xe0 | (cp >> 12);
+		out[1] = 0x80 | ((cp >> 6) & 0x3f);
+		out[2] = 0x80 | (cp & 0x3f);
+		return 3;
+	}
+
+	out[0] = 0xf0 | (cp >> 18);
+	out[1] = 0x80 | ((cp >> 12) & 0x3f);
+	out[2] = 0x80 | ((cp >> 6) & 0x3f);
+	out[3] = 0x80 | (cp & 0x3f);
+	return 4;
+}
+
+/* The escape has been validated by the tokenizer */
+static uint32_t hex4(const char *str)
+{
+	uint32_t val = 0;
+
+	for (int i = 0; i < 4; i++) {
+		val = (val << 4) | hex_val(str[i]);
+	}
+
+	return val;
+}
+
+int json_tok_str(const char *json, const struct json_tok *tok,
+		 char *buf, size_t size)
+{
+	const char *str = &json[tok->start];
+	const char *end = str + tok->len;
+	size_t out_len = 0;
+
+	if (tok->type != JSON_TOK_STR) {
+		return -EINVAL;
+	}
+
+	while (str < end) {
+		char decoded[4];
+		size_t n = 1;
+		uint32_t cp;
+
+		if (*str != '\\') {
+			decoded[0] = *str++;
+		} else {
+			str++;
+			switch (*str) {
+			case 'b':
+				decoded[0] = '\b';
+				break;
+			case 'f':
+				decoded[0] = '\f';
+				break;
+			case 'n':
+				decoded[0] = '\n';
+				break;
+			case 'r':
+				decoded[0] = '\r';
+				break;
+			case 't':
+				decoded[0] = '\t';
+				break;
+			case 'u':
+				cp = hex4(str + 1);
+				str += 4;
+
+				/* Combine surrogate pairs */
+				if (cp >= 0xd800 && cp < 0xdc00 &&
+				    end - str > 6 && str[1] == '\\' &&
+				    str[2] == 'u') {
+					uint32_t low = hex4(str + 3);
+
+					if (low >= 0xdc00 && low < 0xe000) {
+						cp = 0x10000 +
+						     ((cp - 0xd800) << 10) +
+						     (low - 0xdc00);
+						str += 6;
+					}
+				}
+
+				n = utf8_encode(cp, decoded);
+				break;
+			default:
+				decoded[0] = *str;
+				break;
+			}
+			str++;
+		}
+
+		for (size_t i = 0; i < n; i++, out_len++) {
+			if (buf != NULL && out_len + 1 < size) {
+				buf[out_len] = decoded[i];
+			}
+		}
+	}
+
+	if (buf != NULL && size > 0) {
+		buf[MIN(out_len, size - 1)] = '\0';
+	}
+
+	return out_len;
+}
+
+int json_tok_int(const char *json, const struct json_tok *tok,
+		 int32_t *value)
+{
+	const char *str = &json[tok->start];
+	size_t len = tok->len;
+	bool negative = false;
+	int64_t val = 0;
+
+	if (tok->type != JSON_TOK_PRIM || len == 0) {
+		return -EINVAL;
+	}
+
+	if (*str == '-') {
+		negative = true;
+		str++;
+		len--;
+	}
+
+	if (len == 0) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		if (!is_digit(str[i])) {
+			return -EINVAL;
+		}
+
+		val = val * 10 + (str[i] - '0');
+		if (val > (int64_t)INT32_MAX + 1) {
+			return -ERANGE;
+		}
+	}
+
+	val = negative ? -val : val;
+	if (val > INT32_MAX) {
+		return -ERANGE;
+	}
+
+	*value = val;
+
+	return 0;
+}
+
+int json_tok_bool(const char *json, const struct json_tok *tok, bool *value)
+{
+	const char *str = &json[tok->start];
+
+	if (tok->type != JSON_TOK_PRIM) {
+		return -EINVAL;
+	}
+
+	if (is_literal(str, tok->len, "true")) {
+		*value = true;
+	} else if (is_literal(str, tok->len, "false")) {
+		*value = false;
+	} else {
+		return -EINVAL;
+	}
+
+	return 0;
+}
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <json_writer.h>
+
+/* Depth 0 is the document itself, which holds a single value */
+BUILD_ASSERT(CONFIG_JSON_WRITER_MAX_DEPTH < 32,
+	     "Containers are tracked in 32-bit masks");
+
+static int fail(struct json_writer *w, int err)
+{
+	if (w->err == 0) {
+		w->err = err;
+	}
+
+	return w->err;
+}
+
+static void put(struct json_writer *w, const char *data, size_t len)
+{
+	if (w->err) {
+		return;
+	}
+
+	if (w->buf != NULL) {
+		/* Keep room for the terminating null character */
+		if (len >= w->size - w->len) {
+			(void)fail(w, -ENOMEM);
+			return;
+		}
+		memcpy(&w->buf[w->len], data, len);
+	}
+
+	w->len += len;
+}
+
+static void put_char(struct json_writer *w, char c)
+{
+	put(w, &c, 1);
+}
+
+static void put_str(struct json_writer *w, const char *str)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *run = str;
+	char esc[6];
+
+	put_char(w, '"');
+
+	for (; *str != '\0'; str++) {
+		uint8_t c = *str;
+
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+
+		/* Copy the characters that need no escaping at once */
+		put(w, run, str - run);
+		run = str + 1;
+
+		esc[0] = '\\';
+		switch (c) {
+		case '"':
+		case '\\':
+			esc[1] = c;
+			break;
+		case '\b':
+			esc[1] = 'b';
+			break;
+		case '\f':
+			esc[1] = 'f';
+			break;
+		case '\n':
+			esc[1] = 'n';
+			break;
+		case '\r':
+			esc[1] = 'r';
+			break;
+		case '\t':
+			esc[1] = 't';
+			break;
+		default:
+			esc[1] = 'u';
+			esc[2] = '0';
+			esc[3] = '0';
+			esc[4] = hex[c >> 4];
+			esc[5] = hex[c & 0xf];
+			put(w, esc, 6);
+			continue;
+		}
+		put(w, esc, 2);
+	}
+
+	put(w, run, str - run);
+	put_char(w, '"');
+}
+
+/* Separate the value from the previous one and write its member name */
+static int value_start(struct json_writer *w, const char *key)
+{
+	uint32_t bit = BIT(w->depth);
+	bool in_obj = w->depth > 0 && !(w->array & bit);
+
+	if (w->err) {
+		return w->err;
+	}
+
+	if ((key != NULL) != in_obj ||
+	    (w->depth == 0 && (w->members & bit))) {
+		return fail(w, -EINVAL);
+	}
+
+	if (w->members & bit) {
+		put_char(w, ',');
+	}
+	w->members |= bit;
+
+	if (key != NULL) {
+		put_str(w, key);
+		put_char(w, ':');
+	}
+
+	return w->err;
+}
+
+static int container_start(struct json_writer *w, const char *key, bool array)
+{
+	uint32_t bit;
+
+	if (value_start(w, key)) {
+		return w->err;
+	}
+
+	if (w->depth >= CONFIG_JSON_WRITER_MAX_DEPTH) {
+		return fail(w, -EOVERFLOW);
+	}
+
+	put_char(w, array ? '[' : '{');
+
+	w->depth++;
+	bit = BIT(w->depth);
+	w->members &= ~bit;
+	if (array) {
+		w->array |= bit;
+	} else {
+		w->array &= ~bit;
+	}
+
+	return w->err;
+}
+
+static int container_end(struct json_writer *w, bool array)
+{
+	if (w->err) {
+		return w->err;
+	}
+
+	if (w->depth == 0 || !!(w->array & BIT(w->depth)) != array) {
+		return fail(w, -EINVAL);
+	}
+
+	put_char(w, array ? ']' : '}');
+	w->depth--;
+
+	return w->err;
+}
+
+void json_writer_init(struct json_writer *w, char *buf, size_t size)
+{
+	memset(w, 0, sizeof(*w));
+	w->buf = buf;
+	w->size = size;
+
+	if (buf != NULL && size == 0) {
+		w->err = -ENOMEM;
+	}
+}
+
+int json_writer_obj_start(struct json_writer *w, const char *key)
+{
+	return container_start(w, key, false);
+}
+
+int json_writer_obj_end(struct json_writer *w)
+{
+	return container_end(w, false);
+}
+
+int json_writer_arr_start(struct json_writer *w, const char *key)
+{
+	return container_start(w, key, true);
+}
+
+int json_writer_arr_end(struct json_writer *w)
+{
+	return container_end(w, true);
+}
+
+int json_writer_str(struct json_writer *w, const char *key, const char *str)
+{
+	if (str == NULL) {
+		return fail(w, -EINVAL);
+	}
+
+	if (value_start(w, key)) {
+		return w->err;
+	}
+
+	put_str(w, str);
+
+	return w->err;
+}
+
+int json_writer_int(struct json_writer *w, const char *key, int64_t value)
+{
+	/* Formatted by hand, as not all C libraries print 64-bit integers */
+	char digits[20];
+	size_t i = sizeof(digits);
+	uint64_t u = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+	if (value_start(w, key)) {
+		return w->err;
+	}
+
+	do {
+		digits[--i] = '0' + u % 10;
+		u /= 10;
+	} while (u > 0);
+
+	if (value < 0) {
+		put_char(w, '-');
+	}
+	put(w, &digits[i], sizeof(digits) - i);
+
+	return w->err;
+}
+
+int json_writer_num(struct json_writer *w, const char *key, double value)
+{
+	char num[32];
+	int len;
+
+	if (!isfinite(value)) {
+		return json_writer_null(w, key);
+	}
+
+	if (value_start(w, key)) {
+		return w->err;
+	}
+
+	/* Same precision as cJSON */
+	len = snprintf(num, sizeof(num), "%1.15g", value);
+	if (len < 0 || (size_t)len >= sizeof(num)) {
+		return fail(w, -EINVAL);
+	}
+
+	put(w, num, len);
+
+	return w->err;
+}
+
+int json_writer_bool(struct json_writer *w, const char *key, bool value)
+{
+	if (value_start(w, key)) {
+		return w->err;
+	}
+
+	put(w, value ? "true" : "false", value ? 4 : 5);
+
+	return w->err;
+}
+
+int json_writer_null(struct json_writer *w, const char *key)
+{
+	if (value_start(w, key)) {
+		return w->err;
+	}
+
+	put(w, "null", 4);
+
+	return w->err;
+}
+
+int json_writer_raw(struct json_writer *w, const char *key,
+		    const char *json, size_t len)
+{
+	if (json == NULL || len == 0) {
+		return fail(w, -EINVAL);
+	}
+
+	if (value_start(w, key)) {
+		return w->err;
+	}
+
+	put(w, json, len);
+
+	return w->err;
+}
+
+int json_writer_finish(struct json_writer *w)
+{
+	if (w->err) {
+		return w->err;
+	}
+
+	if (w->depth != 0 || !(w->members & BIT(0))) {
+		return fail(w, -EINVAL);
+	}
+
+	if (w->buf != NULL) {
+		/* put() always leaves room for it */
+		w->buf[w->len] = '\0';
+	}
+
+	return w->len;
+}
@@ -115,7 +115,9 @@ static int update_device_shadow_version(struct mqtt_client *const client)
 	param.message.topic.topic.size = update_delta_topic_len;
 	param.message.payload.data = shadow_update_payload;
 	param.message.payload.len = shadow_update_payload_len;
-	param.message_id = sys_rand32_get();
+	/* The IDs from AWS_JOBS_EXEC_MESSAGE_ID_FIRST up are used by AWS FOTA */
+	param.message_id = 1 + sys_rand32_get() %
+			   (AWS_JOBS_EXEC_MESSAGE_ID_FIRST - 1);
 	param.dup_flag = 0;
 	param.retain_flag = 0;
 
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Pack an MCUboot image into the compressed container used by the
+compressed DFU target (CONFIG_DFU_TARGET_COMPRESSED).
+
+The image is split into blocks which are compressed on their own with
+LZSS, in the heatshrink bit stream format, so that the download can be
+resumed at any block boundary.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0x535a4c4e
+VERSION = 1
+HEADER = struct.Struct('<IHHI')
+BLOCK_HEADER = struct.Struct('<HHBB')
+MIN_MATCH = 3
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.nbits = 0
+
+    def put(self, value, count):
+        self.acc = (self.acc << count) | value
+        self.nbits += count
+        while self.nbits >= 8:
+            self.nbits -= 8
+            self.out.append((self.acc >> self.nbits) & 0xff)
+        self.acc &= (1 << self.nbits) - 1
+
+    def finish(self):
+        if self.nbits:
+            self.out.append((self.acc << (8 - self.nbits)) & 0xff)
+            self.nbits = 0
+        return bytes(self.out)
+
+
+def lzss_compress(data, window_bits, lookahead_bits):
+    window = 1 << window_bits
+    max_len = 1 << lookahead_bits
+    # A back-reference must be shorter than the literals it replaces.
+    min_len = max(MIN_MATCH, (1 + window_bits + lookahead_bits) // 9 + 1)
+    chains = {}
+    bw = BitWriter()
+    pos = 0
+
+    def insert(i):
+        if i + MIN_MATCH <= len(data):
+            chains.setdefault(data[i:i + MIN_MATCH], []).append(i)
+
+    while pos < len(data):
+        best_len = 0
+        best_dist = 0
+        for cand in reversed(chains.get(data[pos:pos + MIN_MATCH], [])):
+            dist = pos - cand
+            if dist > window:
+                break
+            length = 0
+            limit = min(max_len, len(data) - pos)
+            while length < limit and data[cand + length] == data[pos + length]:
+                length += 1
+            if length > best_len:
+                best_len = length
+                best_dist = dist
+                if length == limit:
+                    break
+
+        if best_len >= min_len:
+            bw.put(0, 1)
+            bw.put(best_dist - 1, window_bits)
+            bw.put(best_len - 1, lookahead_bits)
+            step = best_len
+        else:
+            bw.put(1, 1)
+            bw.put(data[pos], 8)
+            step = 1
+
+        for i in range(pos, pos + step):
+            insert(i)
+        pos += step
+
+    return bw.finish()
+
+
+def lzss_decompress(data, window_bits, lookahead_bits, raw_len):
+    out = bytearray()
+    acc = 0
+    nbits = 0
+    it = iter(data)
+
+    def get(count):
+        nonlocal acc, nbits
+        while nbits < count:
+            acc = (acc << 8) | next(it)
+            nbits += 8
+        nbits -= count
+        return (acc >> nbits) & ((1 << count) - 1)
+
+    try:
+        while len(out) < raw_len:
+            if get(1):
+                out.append(get(8))
+            else:
+                dist = get(window_bits) + 1
+                for _ in range(get(lookahead_bits) + 1):
+                    out.append(out[-dist])
+    except StopIteration:
+        pass
+    return bytes(out)
+
+
+def compress(image, block_size, window_bits, lookahead_bits):
+    out = bytearray(HEADER.pack(MAGIC, VERSION, HEADER.size, len(image)))
+
+    for start in range(0, len(image), block_size):
+        raw = image[start:start + block_size]
+        comp = lzss_compress(raw, window_bits, lookahead_bits)
+        if len(comp) >= len(raw):
+            # Incompressible, store the block as is
+            out += BLOCK_HEADER.pack(len(raw), len(raw), 0, 0) + raw
+        else:
+            out += BLOCK_HEADER.pack(len(raw), len(comp), window_bits,
+                                     lookahead_bits) + comp
+
+    return bytes(out)
+
+
+def decompress(container):
+    magic, version, hdr_size, image_size = HEADER.unpack_from(container)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError('Not a compressed image')
+
+    out = bytearray()
+    pos = hdr_size
+    while pos < len(container):
+        raw_len, comp_len, window_bits, lookahead_bits = \
+            BLOCK_HEADER.unpack_from(container, pos)
+        pos += BLOCK_HEADER.size
+        comp = container[pos:pos + comp_len]
+        pos += comp_len
+        if window_bits == 0:
+            out += comp
+        else:
+            out += lzss_decompress(comp, window_bits, lookahead_bits, raw_len)
+
+    if len(out) != image_size:
+        raise ValueError('Image size mismatch')
+    return bytes(out)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description='Compress an MCUboot image for the compressed DFU target.',
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+
+    parser.add_argument('--in', '-i', dest='infile', required=True,
+                        help='Signed MCUboot image (*.bin).')
+    parser.add_argument('--out', '-o', dest='outfile', required=True,
+                        help='Compressed image.')
+    parser.add_argument('--block-size', type=int, default=4096,
+                        help='Image bytes per block. Use a multiple of the '
+                             'flash page size, so that the download can '
+                             'resume at every block (default: 4096).')
+    parser.add_argument('--window-bits', type=int, default=10,
+                        help='Window size as a power of two. Must not exceed '
+                             'CONFIG_DFU_TARGET_COMPRESSED_WINDOW_BITS '
+                             '(default: 10).')
+    parser.add_argument('--lookahead-bits', type=int, default=4,
+                        help='Longest match as a power of two (default: 4).')
+    args = parser.parse_args()
+
+    if not 0 < args.block_size <= 0xffff:
+        parser.error('block size must be between 1 and 65535')
+    if not 4 <= args.window_bits <= 14:
+        parser.error('window bits must be between 4 and 14')
+    if not 3 <= args.lookahead_bits < args.window_bits:
+        parser.error('lookahead bits must be at least 3 and less than the '
+                     'window bits')
+    return args
+
+
+def main():
+    args = parse_args()
+
+    with open(args.infile, 'rb') as f:
+        image = f.read()
+
+    container = compress(image, args.block_size, args.window_bits,
+                         args.lookahead_bits)
+
+    if decompress(container) != image:
+        sys.exit('Compressed image does not decompress to the input')
+
+    with open(args.outfile, 'wb') as f:
+        f.write(container)
+
+    print('Compressed {} bytes to {} bytes ({:.1f}%)'.format(
+        len(image), len(container), 100.0 * len(container) / len(image)))
+
+
+if __name__ == '__main__':
+    main()
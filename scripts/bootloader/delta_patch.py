@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Create a patch which turns the MCUboot image in the primary slot into a
+new image, for the delta DFU target (CONFIG_DFU_TARGET_DELTA).
+
+The patch is a list of commands which either copy a part of the active
+image, or insert new data. The device applies the patch while it is
+downloaded, so commands are split at every block of the new image, where
+the download can resume.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = 0x544c4544
+VERSION = 1
+HEADER = struct.Struct('<IHHII32s')
+CMD = struct.Struct('<BII')
+OP_COPY = 1
+OP_INSERT = 2
+
+SEED_LEN = 8
+MAX_CANDIDATES = 8
+# A copy must save more than the command it costs.
+MIN_COPY = 2 * CMD.size
+
+
+def index_source(source):
+    index = {}
+    for i in range(len(source) - SEED_LEN + 1):
+        candidates = index.setdefault(source[i:i + SEED_LEN], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(i)
+    return index
+
+
+def match_len(source, src, target, pos):
+    n = 0
+    limit = min(len(source) - src, len(target) - pos)
+    while n < limit and source[src + n] == target[pos + n]:
+        n += 1
+    return n
+
+
+def diff(source, target):
+    """Return a list of (op, offset, data or length) covering the target."""
+    index = index_source(source)
+    ops = []
+    literal = bytearray()
+    pos = 0
+    next_src = 0
+
+    while pos < len(target):
+        candidates = list(index.get(target[pos:pos + SEED_LEN], []))
+        # Changes often leave the rest of the image where it was
+        if next_src + len(literal) < len(source):
+            candidates.insert(0, next_src + len(literal))
+
+        best_len = 0
+        best_src = 0
+        for src in candidates:
+            n = match_len(source, src, target, pos)
+            if n > best_len:
+                best_len = n
+                best_src = src
+
+        if best_len >= MIN_COPY:
+            if literal:
+                ops.append((OP_INSERT, 0, bytes(literal)))
+                literal = bytearray()
+            ops.append((OP_COPY, best_src, best_len))
+            pos += best_len
+            next_src = best_src + best_len
+        else:
+            literal.append(target[pos])
+            pos += 1
+
+    if literal:
+        ops.append((OP_INSERT, 0, bytes(literal)))
+    return ops
+
+
+def encode(source, target, ops, block_size):
+    out = bytearray(HEADER.pack(MAGIC, VERSION, HEADER.size, len(source),
+                                len(target), hashlib.sha256(source).digest()))
+    pos = 0
+
+    for op, offset, arg in ops:
+        length = arg if op == OP_COPY else len(arg)
+        done = 0
+        while done < length:
+            # Do not cross a block boundary of the new image
+            n = min(length - done, block_size - pos % block_size)
+            if op == OP_COPY:
+                out += CMD.pack(OP_COPY, offset + done, n)
+            else:
+                out += CMD.pack(OP_INSERT, 0, n) + arg[done:done + n]
+            done += n
+            pos += n
+
+    return bytes(out)
+
+
+def apply(source, patch):
+    magic, version, hdr_size, source_size, image_size, digest = \
+        HEADER.unpack_from(patch)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError('Not a patch')
+    if hashlib.sha256(source[:source_size]).digest() != digest:
+        raise ValueError('Patch is not for this image')
+
+    out = bytearray()
+    pos = hdr_size
+    while pos < len(patch):
+        op, offset, length = CMD.unpack_from(patch, pos)
+        pos += CMD.size
+        if op == OP_COPY:
+            out += source[offset:offset + length]
+        elif op == OP_INSERT:
+            out += patch[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError('Invalid command {}'.format(op))
+
+    if len(out) != image_size:
+        raise ValueError('Image size mismatch')
+    return bytes(out)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description='Create a patch for the delta DFU target.',
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+
+    parser.add_argument('--source', '-s', required=True,
+                        help='MCUboot image running on the device (*.bin).')
+    parser.add_argument('--target', '-t', required=True,
+                        help='New MCUboot image (*.bin).')
+    parser.add_argument('--out', '-o', dest='outfile', required=True,
+                        help='Patch.')
+    parser.add_argument('--block-size', type=int, default=4096,
+                        help='The download can resume at every block of '
+                             'the new image. Use a multiple of the flash '
+                             'page size (default: 4096).')
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+
+    with open(args.source, 'rb') as f:
+        source = f.read()
+    with open(args.target, 'rb') as f:
+        target = f.read()
+
+    patch = encode(source, target, diff(source, target), args.block_size)
+
+    if apply(source, patch) != target:
+        sys.exit('Patch does not produce the new image')
+
+    with open(args.outfile, 'wb') as f:
+        f.write(patch)
+
+    print('Patch of {} bytes for an image of {} bytes ({:.1f}%)'.format(
+        len(patch), len(target), 100.0 * len(patch) / len(target)))
+
+
+if __name__ == '__main__':
+    main()
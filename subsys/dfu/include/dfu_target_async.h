@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/** @file dfu_target_async.h
+ *
+ * @defgroup dfu_target_async DFU Target asynchronous writer
+ * @{
+ * @brief Double-buffered writer which writes to the DFU target in a
+ *	  separate thread.
+ */
+
+#ifndef DFU_TARGET_ASYNC_H__
+#define DFU_TARGET_ASYNC_H__
+
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start writing to a DFU target.
+ *
+ * Data buffered for the previous target is written to it first.
+ *
+ * @param[in] write Write function of the DFU target.
+ */
+void dfu_target_async_start(int (*write)(const void *const buf, size_t len));
+
+/**
+ * @brief Buffer data to be written to the DFU target.
+ *
+ * Blocks while both buffers are being used.
+ *
+ * @param[in] buf Data to write.
+ * @param[in] len Length of the data.
+ *
+ * @retval 0 If successful.
+ * @retval -ETIMEDOUT If no buffer became available in time.
+ * @return A negative error code returned by the DFU target for earlier data.
+ */
+int dfu_target_async_write(const void *const buf, size_t len);
+
+/**
+ * @brief Write all buffered data to the DFU target and wait until it is
+ *	  written.
+ *
+ * @retval 0 If successful.
+ * @retval -ETIMEDOUT If the data was not written in time.
+ * @return A negative error code returned by the DFU target.
+ */
+int dfu_target_async_flush(void);
+
+/**
+ * @brief Get the number of bytes that have been buffered, but not yet
+ *	  written to the DFU target.
+ *
+ * The DFU target may be writing some of them, so the number is only exact
+ * while it is idle.
+ *
+ * @return Number of buffered bytes.
+ */
+size_t dfu_target_async_pending(void);
+
+/**
+ * @brief Discard buffered data, and wait until the DFU target is idle.
+ *
+ * A buffer which the DFU target has started to write is written in full.
+ */
+void dfu_target_async_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DFU_TARGET_ASYNC_H__ */
+
+/**@} */
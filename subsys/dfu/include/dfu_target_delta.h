@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/** @file dfu_target_delta.h
+ *
+ * @defgroup dfu_target_delta Delta MCUboot DFU Target
+ * @{
+ * @brief DFU Target for patches against the active MCUboot image
+ */
+
+#ifndef DFU_TARGET_DELTA_H__
+#define DFU_TARGET_DELTA_H__
+
+#include <stddef.h>
+#include <dfu/dfu_target.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief See if data in buf indicates a patch of the MCUboot image.
+ *
+ * @param[in] buf Pointer to data to inspect.
+ *
+ * @return true if data matches, false otherwise.
+ */
+bool dfu_target_delta_identify(const void *const buf);
+
+/**
+ * @brief Initialize dfu target, perform steps necessary to receive firmware.
+ *
+ * If the write progress of a patched image was stored, the patch is
+ * applied from the last resume point.
+ *
+ * @param[in] file_size Size of the patch being downloaded.
+ * @param[in] cb Callback for signaling events (unused).
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int dfu_target_delta_init(size_t file_size, dfu_target_callback_t cb);
+
+/**
+ * @brief Get offset in the patch to continue the download from.
+ *
+ * @param[out] offset Returns the offset.
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int dfu_target_delta_offset_get(size_t *offset);
+
+/**
+ * @brief Apply the patch to the active image, and write the result to the
+ *	  MCUboot slot.
+ *
+ * The active image is verified against the digest in the patch header
+ * before the patch is applied.
+ *
+ * @param[in] buf Pointer to patch data.
+ * @param[in] len Length of the data.
+ *
+ * @return 0 on success, -EINVAL if the data is not a valid patch,
+ *	   -EBADMSG if the patch is not for the active image, -EFBIG if the
+ *	   image does not fit in the slot, or another negative errno.
+ */
+int dfu_target_delta_write(const void *const buf, size_t len);
+
+/**
+ * @brief Deinitialize resources and finalize firmware upgrade if successful.
+ *
+ * @param[in] successful Indicate whether the firmware was successfully
+ *			 received.
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int dfu_target_delta_done(bool successful);
+
+/**
+ * @brief Mark the image as ready to be tested by MCUboot at the next reboot.
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int dfu_target_delta_schedule_update(void);
+
+/**
+ * @brief Cancel the upgrade scheduled with
+ *	  @ref dfu_target_delta_schedule_update.
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int dfu_target_delta_cancel_update(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DFU_TARGET_DELTA_H__ */
+
+/**@} */
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/** @file dfu_target_hash.h
+ *
+ * @defgroup dfu_target_hash DFU Target streaming hash
+ * @{
+ * @brief SHA-256 of the image, computed while it is written to the DFU target
+ */
+
+#ifndef DFU_TARGET_HASH_H__
+#define DFU_TARGET_HASH_H__
+
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start hashing an image, or continue hashing an image whose
+ *	  download is resumed.
+ *
+ * If the image is resumed from an offset which has not been hashed in this
+ * session, for example after a reset, the image can not be verified.
+ *
+ * @param[in] img_type Image type identifier.
+ * @param[in] file_size Size of the image file.
+ * @param[in] offset Offset from where the image is written.
+ */
+void dfu_target_hash_start(int img_type, size_t file_size, size_t offset);
+
+/**
+ * @brief Hash the next part of the image.
+ *
+ * For MCUboot images, the image header is checked against the file size,
+ * and the SHA-256 digest is taken from the image TLVs.
+ *
+ * @param[in] buf Image data.
+ * @param[in] len Length of the image data.
+ *
+ * @retval 0 If successful.
+ * @retval -EINVAL If the image header does not match the file.
+ */
+int dfu_target_hash_update(const void *const buf, size_t len);
+
+/**
+ * @brief Compare the hash of the image with the expected digest.
+ *
+ * The digest set by the application is compared with the hash of the whole
+ * image file. The digest in the TLVs of an MCUboot image is compared with the
+ * hash of the region it covers.
+ *
+ * @retval 0 If the digests match, or if there is nothing to compare.
+ * @retval -EBADMSG If the digests differ.
+ * @retval -ENOTSUP If a digest was set by the application, but the image
+ *		    could not be hashed.
+ */
+int dfu_target_hash_verify(void);
+
+/**
+ * @brief Mark the image being written as one that can not be hashed.
+ *
+ * A digest set by the application is kept, so that the image is rejected
+ * by @ref dfu_target_hash_verify.
+ */
+void dfu_target_hash_invalidate(void);
+
+/**
+ * @brief Forget the image being hashed, and the digest set for it by the
+ *	  application.
+ */
+void dfu_target_hash_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DFU_TARGET_HASH_H__ */
+
+/**@} */
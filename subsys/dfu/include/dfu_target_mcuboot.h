@@ -67,6 +67,33 @@ int dfu_target_mcuboot_init(size_t file_size, dfu_target_callback_t cb);
  */
 int dfu_target_mcuboot_offset_get(size_t *offset);
 
+/**
+ * @brief Set the resume point of an image which is transformed before it
+ *	  is written, such as a compressed image.
+ *
+ * The source offset is stored with the write progress when @p offset bytes
+ * have been written to flash. Progress is then only stored at resume points.
+ *
+ * @param[in] offset Number of bytes written to flash at the resume point.
+ * @param[in] src_offset Offset in the downloaded file at the resume point.
+ * @param[in] image_size Size of the image written to flash.
+ */
+void dfu_target_mcuboot_src_offset_set(size_t offset, size_t src_offset,
+				       size_t image_size);
+
+/**
+ * @brief Get the resume point which matches the write progress.
+ *
+ * @param[out] offset Number of bytes written to flash.
+ * @param[out] src_offset Offset in the downloaded file to resume from.
+ * @param[out] image_size Size of the image written to flash.
+ *
+ * @return 0 on success, -ENOENT if the write progress is not at a resume
+ *	   point.
+ */
+int dfu_target_mcuboot_src_offset_get(size_t *offset, size_t *src_offset,
+				      size_t *image_size);
+
 /**
  * @brief Write firmware data.
  *
@@ -86,6 +113,23 @@ int dfu_target_mcuboot_write(const void *const buf, size_t len);
  */
 int dfu_target_mcuboot_done(bool successful);
 
+/**
+ * @brief Mark the firmware in the secondary slot as ready to be tested
+ *	  by MCUboot at the next reboot.
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int dfu_target_mcuboot_schedule_update(void);
+
+/**
+ * @brief Cancel the upgrade scheduled with
+ *	  @ref dfu_target_mcuboot_schedule_update. The secondary slot is
+ *	  erased.
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int dfu_target_mcuboot_cancel_update(void);
+
 #endif /* DFU_TARGET_MCUBOOT_H__ */
 
 /**@} */
@@ -66,6 +66,21 @@ int dfu_target_modem_write(const void *const buf, size_t len);
  */
 int dfu_target_modem_done(bool successful);
 
+/**
+ * @brief Request the modem to apply the firmware upgrade at the next boot.
+ *
+ * @return 0 on success, negative errno otherwise.
+ */
+int dfu_target_modem_schedule_update(void);
+
+/**
+ * @brief Cancel the upgrade requested with
+ *	  @ref dfu_target_modem_schedule_update. Not supported by the modem.
+ *
+ * @return -ENOTSUP.
+ */
+int dfu_target_modem_cancel_update(void);
+
 #endif /* DFU_TARGET_MODEM_H__ */
 
 /**@} */
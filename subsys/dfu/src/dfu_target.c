@@ -7,6 +7,8 @@
 #include <logging/log.h>
 #include <dfu/mcuboot.h>
 #include <dfu/dfu_target.h>
+#include "dfu_target_hash.h"
+#include "dfu_target_async.h"
 
 #define DEF_DFU_TARGET(name) \
 static const struct dfu_target dfu_target_ ## name  = { \
@@ -14,6 +16,8 @@ static const struct dfu_target dfu_target_ ## name  = { \
 	.offset_get = dfu_target_## name ##_offset_get, \
 	.write = dfu_target_ ## name ## _write, \
 	.done = dfu_target_ ## name ## _done, \
+	.schedule_update = dfu_target_ ## name ## _schedule_update, \
+	.cancel_update = dfu_target_ ## name ## _cancel_update, \
 }
 
 #ifdef CONFIG_DFU_TARGET_MODEM
@@ -24,12 +28,47 @@ DEF_DFU_TARGET(modem);
 #include "dfu_target_mcuboot.h"
 DEF_DFU_TARGET(mcuboot);
 #endif
+#ifdef CONFIG_DFU_TARGET_COMPRESSED
+#include "dfu_target_compressed.h"
+DEF_DFU_TARGET(compressed);
+#endif
+#ifdef CONFIG_DFU_TARGET_DELTA
+#include "dfu_target_delta.h"
+DEF_DFU_TARGET(delta);
+#endif
 
 #define MIN_SIZE_IDENTIFY_BUF 32
+/* The modem and the MCUboot secondary slot hold one image each */
+#define STAGED_MAX 2
 
 LOG_MODULE_REGISTER(dfu_target, CONFIG_DFU_TARGET_LOG_LEVEL);
 
 static const struct dfu_target *current_target;
+static int current_img_type;
+
+/* Images which are complete, but not yet scheduled */
+static struct {
+	const struct dfu_target *target;
+	int img_type;
+} staged[STAGED_MAX];
+static size_t staged_count;
+
+/* All images other than modem firmware are stored in the
+ * secondary slot of MCUboot.
+ */
+static bool is_staged(int img_type)
+{
+	bool modem = img_type == DFU_TARGET_IMAGE_TYPE_MODEM_DELTA;
+
+	for (size_t i = 0; i < staged_count; i++) {
+		if ((staged[i].img_type ==
+		     DFU_TARGET_IMAGE_TYPE_MODEM_DELTA) == modem) {
+			return true;
+		}
+	}
+
+	return false;
+}
 
 int dfu_target_img_type(const void *const buf, size_t len)
 {
@@ -42,6 +81,16 @@ int dfu_target_img_type(const void *const buf, size_t len)
 	if (dfu_target_modem_identify(buf)) {
 		return DFU_TARGET_IMAGE_TYPE_MODEM_DELTA;
 	}
+#endif
+#ifdef CONFIG_DFU_TARGET_COMPRESSED
+	if (dfu_target_compressed_identify(buf)) {
+		return DFU_TARGET_IMAGE_TYPE_COMPRESSED;
+	}
+#endif
+#ifdef CONFIG_DFU_TARGET_DELTA
+	if (dfu_target_delta_identify(buf)) {
+		return DFU_TARGET_IMAGE_TYPE_DELTA;
+	}
 #endif
 	if (len < MIN_SIZE_IDENTIFY_BUF) {
 		return -EAGAIN;
@@ -53,6 +102,8 @@ int dfu_target_img_type(const void *const buf, size_t len)
 
 int dfu_target_init(int img_type, size_t file_size, dfu_target_callback_t cb)
 {
+	int err;
+	size_t offset;
 	const struct dfu_target *new_target = NULL;
 
 #ifdef CONFIG_DFU_TARGET_MCUBOOT
@@ -64,12 +115,34 @@ int dfu_target_init(int img_type, size_t file_size, dfu_target_callback_t cb)
 	if (img_type == DFU_TARGET_IMAGE_TYPE_MODEM_DELTA) {
 		new_target = &dfu_target_modem;
 	}
+#endif
+#ifdef CONFIG_DFU_TARGET_COMPRESSED
+	if (img_type == DFU_TARGET_IMAGE_TYPE_COMPRESSED) {
+		new_target = &dfu_target_compressed;
+	}
+#endif
+#ifdef CONFIG_DFU_TARGET_DELTA
+	if (img_type == DFU_TARGET_IMAGE_TYPE_DELTA) {
+		new_target = &dfu_target_delta;
+	}
 #endif
 	if (new_target == NULL) {
 		LOG_ERR("Unknown image type");
 		return -ENOTSUP;
 	}
 
+	if (is_staged(img_type)) {
+		LOG_ERR("A staged image would be overwritten");
+		return -EEXIST;
+	}
+
+	if (IS_ENABLED(CONFIG_DFU_TARGET_ASYNC)) {
+		/* Data still buffered for the previous target is written
+		 * to it before the new target is initialized.
+		 */
+		dfu_target_async_start(new_target->write);
+	}
+
 	/* The user is re-initializing with an previously aborted target.
 	 * Avoid re-initializing generally to ensure that the download can
 	 * continue where it left off. Re-initializing is required for modem
@@ -77,21 +150,60 @@ int dfu_target_init(int img_type, size_t file_size, dfu_target_callback_t cb)
 	 */
 	if (new_target == current_target
 	   && img_type != DFU_TARGET_IMAGE_TYPE_MODEM_DELTA) {
-		return 0;
+		err = 0;
+	} else {
+		current_target = new_target;
+		err = current_target->init(file_size, cb);
 	}
 
-	current_target = new_target;
+	current_img_type = img_type;
 
-	return current_target->init(file_size, cb);
+	if (IS_ENABLED(CONFIG_DFU_TARGET_STREAM_HASH) && err == 0) {
+		/* Hash the image from where it is written */
+		if (current_target->offset_get(&offset) == 0) {
+			dfu_target_hash_start(img_type, file_size, offset);
+		} else {
+			dfu_target_hash_invalidate();
+		}
+	}
+
+	return err;
 }
 
 int dfu_target_offset_get(size_t *offset)
+{
+	int err;
+
+	if (current_target == NULL) {
+		return -EACCES;
+	}
+
+	err = current_target->offset_get(offset);
+	if (err != 0) {
+		return err;
+	}
+
+	if (IS_ENABLED(CONFIG_DFU_TARGET_ASYNC)) {
+		/* The offset includes all data given to dfu_target_write(),
+		 * without waiting for the buffered data to be written.
+		 */
+		*offset += dfu_target_async_pending();
+	}
+
+	return 0;
+}
+
+int dfu_target_flush(void)
 {
 	if (current_target == NULL) {
 		return -EACCES;
 	}
 
-	return current_target->offset_get(offset);
+	if (IS_ENABLED(CONFIG_DFU_TARGET_ASYNC)) {
+		return dfu_target_async_flush();
+	}
+
+	return 0;
 }
 
 int dfu_target_write(const void *const buf, size_t len)
@@ -100,10 +212,26 @@ int dfu_target_write(const void *const buf, size_t len)
 		return -EACCES;
 	}
 
+	if (IS_ENABLED(CONFIG_DFU_TARGET_STREAM_HASH)) {
+		/* Reject an image which does not match
+		 * its header before writing it.
+		 */
+		int err = dfu_target_hash_update(buf, len);
+
+		if (err != 0) {
+			return err;
+		}
+	}
+
+	if (IS_ENABLED(CONFIG_DFU_TARGET_ASYNC)) {
+		return dfu_target_async_write(buf, len);
+	}
+
 	return current_target->write(buf, len);
 }
 
-int dfu_target_done(bool successful)
+/* Complete the image of the current target */
+static int target_done(bool successful)
 {
 	int err;
 
@@ -111,21 +239,132 @@ int dfu_target_done(bool successful)
 		return -EACCES;
 	}
 
+	if (IS_ENABLED(CONFIG_DFU_TARGET_ASYNC) && successful) {
+		err = dfu_target_async_flush();
+		if (err != 0) {
+			LOG_ERR("Unable to write buffered data, err %d", err);
+			(void)current_target->done(false);
+			current_target = NULL;
+			return err;
+		}
+	} else if (IS_ENABLED(CONFIG_DFU_TARGET_ASYNC)) {
+		/* Buffered data is not written to an aborted image */
+		dfu_target_async_stop();
+	}
+
+	if (IS_ENABLED(CONFIG_DFU_TARGET_STREAM_HASH) && !successful) {
+		/* The expected digest is not left for the next image */
+		dfu_target_hash_stop();
+	}
+
+	if (IS_ENABLED(CONFIG_DFU_TARGET_STREAM_HASH) && successful) {
+		/* Only mark the image as pending if its digest matches */
+		err = dfu_target_hash_verify();
+		if (err != 0) {
+			(void)current_target->done(false);
+			current_target = NULL;
+			return err;
+		}
+	}
+
 	err = current_target->done(successful);
 	if (err != 0) {
 		LOG_ERR("Unable to clean up dfu_target");
 		return err;
 	}
 
-	if (successful) {
-		current_target = NULL;
+	return 0;
+}
+
+int dfu_target_done(bool successful)
+{
+	int err;
+	const struct dfu_target *target = current_target;
+
+	err = target_done(successful);
+	if (err != 0 || !successful) {
+		return err;
+	}
+
+	current_target = NULL;
+
+	return target->schedule_update();
+}
+
+int dfu_target_stage(void)
+{
+	int err;
+	size_t i;
+	const struct dfu_target *target = current_target;
+
+	err = target_done(true);
+	if (err != 0) {
+		return err;
+	}
+
+	current_target = NULL;
+
+	/* The upgrade of the modem can not be cancelled once it has been
+	 * scheduled, so the modem image is kept last.
+	 */
+	i = staged_count;
+	if (current_img_type != DFU_TARGET_IMAGE_TYPE_MODEM_DELTA) {
+		while (i > 0 && staged[i - 1].img_type ==
+				DFU_TARGET_IMAGE_TYPE_MODEM_DELTA) {
+			staged[i] = staged[i - 1];
+			i--;
+		}
 	}
 
+	staged[i].target = target;
+	staged[i].img_type = current_img_type;
+	staged_count++;
+
 	return 0;
 }
 
+int dfu_target_schedule_update(void)
+{
+	int err = 0;
+	size_t i;
+
+	for (i = 0; i < staged_count; i++) {
+		err = staged[i].target->schedule_update();
+		if (err != 0) {
+			LOG_ERR("Unable to schedule staged image, err %d", err);
+			break;
+		}
+	}
+
+	if (err != 0) {
+		/* Upgrade all of the images or none of them */
+		while (i-- > 0) {
+			int res = staged[i].target->cancel_update();
+
+			if (res != 0) {
+				LOG_ERR("Unable to cancel scheduled image, "
+					"err %d", res);
+			}
+		}
+	}
+
+	staged_count = 0;
+
+	return err;
+}
+
 int dfu_target_reset(void)
 {
+	if (IS_ENABLED(CONFIG_DFU_TARGET_ASYNC)) {
+		dfu_target_async_stop();
+	}
+
+	if (IS_ENABLED(CONFIG_DFU_TARGET_STREAM_HASH)) {
+		dfu_target_hash_stop();
+	}
+
+	staged_count = 0;
+
 	if (current_target != NULL) {
 		int err = current_target->done(false);
 
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <sys/atomic.h>
+#include <logging/log.h>
+#include "dfu_target_async.h"
+
+LOG_MODULE_DECLARE(dfu_target, CONFIG_DFU_TARGET_LOG_LEVEL);
+
+#define BUF_SIZE CONFIG_DFU_TARGET_ASYNC_BUF_SIZE
+#define TIMEOUT K_MSEC(CONFIG_DFU_TARGET_ASYNC_TIMEOUT_MS)
+
+struct async_buf {
+	uint8_t data[BUF_SIZE];
+	size_t len;
+};
+
+/* The caller fills one buffer while the writer thread writes the other */
+static struct async_buf bufs[2];
+static uint8_t fill_idx;
+static uint8_t write_idx;
+
+/* Given by the caller when a buffer is ready to be written */
+static K_SEM_DEFINE(filled_sem, 0, 1);
+/* Given by the writer thread when a buffer has been written */
+static K_SEM_DEFINE(free_sem, 1, 1);
+
+static int (*target_write)(const void *const buf, size_t len);
+/* First error returned by the DFU target, reported to the caller */
+static atomic_t write_err;
+/* Number of bytes given by the caller, but not yet written */
+static atomic_t pending;
+
+static void writer_thread(void *p1, void *p2, void *p3)
+{
+	int err;
+	struct async_buf *buf;
+
+	while (true) {
+		k_sem_take(&filled_sem, K_FOREVER);
+
+		buf = &bufs[write_idx];
+		write_idx ^= 1;
+
+		/* Buffers are dropped once an error is set,
+		 * also when the image is aborted.
+		 */
+		if (atomic_get(&write_err) == 0) {
+			err = target_write(buf->data, buf->len);
+			if (err != 0) {
+				LOG_ERR("Write to DFU target failed, err %d",
+					err);
+				atomic_set(&write_err, err);
+			}
+		}
+
+		atomic_sub(&pending, buf->len);
+		buf->len = 0;
+		k_sem_give(&free_sem);
+	}
+}
+
+K_THREAD_DEFINE(dfu_target_writer, CONFIG_DFU_TARGET_ASYNC_STACK_SIZE,
+		writer_thread, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+
+/* Hand the buffer being filled to the writer thread, and take the other
+ * one once it has been written.
+ */
+static int buf_submit(void)
+{
+	if (k_sem_take(&free_sem, TIMEOUT) != 0) {
+		LOG_ERR("DFU target busy");
+		return -ETIMEDOUT;
+	}
+
+	k_sem_give(&filled_sem);
+	fill_idx ^= 1;
+
+	return 0;
+}
+
+/* Wait for the writer thread to finish the buffer it is writing */
+static int idle_wait(void)
+{
+	if (k_sem_take(&free_sem, TIMEOUT) != 0) {
+		LOG_ERR("DFU target busy");
+		return -ETIMEDOUT;
+	}
+
+	k_sem_give(&free_sem);
+
+	return 0;
+}
+
+void dfu_target_async_start(int (*write)(const void *const buf, size_t len))
+{
+	if (target_write != NULL) {
+		(void)dfu_target_async_flush();
+	}
+
+	target_write = write;
+	atomic_set(&write_err, 0);
+}
+
+int dfu_target_async_write(const void *const buf, size_t len)
+{
+	int err;
+	size_t n;
+	const uint8_t *data = buf;
+	struct async_buf *fill;
+
+	while (len > 0) {
+		err = atomic_get(&write_err);
+		if (err != 0) {
+			return err;
+		}
+
+		fill = &bufs[fill_idx];
+		n = MIN(len, BUF_SIZE - fill->len);
+		memcpy(&fill->data[fill->len], data, n);
+		fill->len += n;
+		atomic_add(&pending, n);
+		data += n;
+		len -= n;
+
+		if (fill->len == BUF_SIZE) {
+			err = buf_submit();
+			if (err) {
+				return err;
+			}
+		}
+	}
+
+	return atomic_get(&write_err);
+}
+
+int dfu_target_async_flush(void)
+{
+	int err;
+
+	if (bufs[fill_idx].len > 0) {
+		err = buf_submit();
+		if (err) {
+			return err;
+		}
+	}
+
+	err = idle_wait();
+	if (err) {
+		return err;
+	}
+
+	return atomic_get(&write_err);
+}
+
+size_t dfu_target_async_pending(void)
+{
+	return atomic_get(&pending);
+}
+
+void dfu_target_async_stop(void)
+{
+	/* Let the writer thread drop the buffer it has not started on */
+	atomic_set(&write_err, -ECANCELED);
+	(void)idle_wait();
+
+	bufs[fill_idx].len = 0;
+	target_write = NULL;
+	atomic_set(&pending, 0);
+	atomic_set(&write_err, 0);
+}
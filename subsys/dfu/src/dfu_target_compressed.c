@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <logging/log.h>
+#include <sys/byteorder.h>
+#include <pm_config.h>
+#include <dfu/dfu_target.h>
+#include "dfu_target_mcuboot.h"
+#include "dfu_target_compressed.h"
+
+LOG_MODULE_REGISTER(dfu_target_compressed, CONFIG_DFU_TARGET_LOG_LEVEL);
+
+/* The compressed container starts with a header:
+ *   u32 magic, u16 version, u16 header size, u32 image size
+ * followed by blocks, each of which is decompressed on its own:
+ *   u16 image length, u16 data length, u8 window bits, u8 lookahead bits
+ * and the compressed data of the block. The data is an LZSS bit stream in
+ * the heatshrink format. Blocks with zero window bits are stored as is.
+ * All fields are little endian.
+ */
+#define COMPRESSED_MAGIC 0x535a4c4e
+#define COMPRESSED_VERSION 1
+#define HEADER_SIZE 12
+#define BLOCK_HEADER_SIZE 6
+
+#define WINDOW_BITS_MIN 4
+#define LOOKAHEAD_BITS_MIN 3
+#define WINDOW_SIZE BIT(CONFIG_DFU_TARGET_COMPRESSED_WINDOW_BITS)
+
+enum parse_state {
+	PARSE_HEADER,
+	PARSE_HEADER_EXT,
+	PARSE_BLOCK_HEADER,
+	PARSE_BLOCK,
+};
+
+enum sym_state {
+	SYM_TAG,
+	SYM_LITERAL,
+	SYM_INDEX,
+	SYM_COUNT,
+};
+
+static struct {
+	enum parse_state state;
+	uint8_t hdr[HEADER_SIZE];
+	size_t hdr_fill;
+	size_t hdr_skip;
+	/* Size of the decompressed image, from the resume point if resumed */
+	size_t image_size;
+	/* Bytes of the compressed file parsed so far */
+	size_t src_pos;
+	/* Offset of the current block in the decompressed image */
+	size_t img_pos;
+
+	/* Current block */
+	uint16_t raw_len;
+	uint16_t comp_len;
+	uint8_t window_bits;
+	uint8_t lookahead_bits;
+	uint16_t comp_pos;
+	uint16_t out_pos;
+	uint16_t flushed;
+
+	/* Bit reader */
+	uint32_t bits;
+	uint8_t nbits;
+	enum sym_state sym;
+	uint16_t index;
+} dec;
+
+/* Output of the current block, back-references are copied from here */
+static uint8_t window[WINDOW_SIZE];
+
+static uint32_t bits_get(uint8_t count)
+{
+	dec.nbits -= count;
+
+	return (dec.bits >> dec.nbits) & (BIT(count) - 1);
+}
+
+static int flush(void)
+{
+	int err;
+	size_t start = dec.flushed % WINDOW_SIZE;
+	size_t len = dec.out_pos - dec.flushed;
+
+	if (len == 0) {
+		return 0;
+	}
+
+	/* The unwritten part of the window may wrap around */
+	if (start + len > WINDOW_SIZE) {
+		err = dfu_target_mcuboot_write(&window[start],
+					       WINDOW_SIZE - start);
+		if (err) {
+			return err;
+		}
+		len -= WINDOW_SIZE - start;
+		start = 0;
+	}
+
+	err = dfu_target_mcuboot_write(&window[start], len);
+	if (err) {
+		return err;
+	}
+
+	dec.flushed = dec.out_pos;
+
+	return 0;
+}
+
+static int out_byte(uint8_t byte)
+{
+	if (dec.out_pos == dec.raw_len) {
+		LOG_ERR("Block decompresses to more than %d bytes",
+			dec.raw_len);
+		return -EINVAL;
+	}
+
+	if (dec.out_pos - dec.flushed == WINDOW_SIZE) {
+		int err = flush();
+
+		if (err) {
+			return err;
+		}
+	}
+
+	window[dec.out_pos % WINDOW_SIZE] = byte;
+	dec.out_pos++;
+
+	return 0;
+}
+
+static int backref_copy(uint16_t distance, uint16_t count)
+{
+	int err;
+
+	if (distance > dec.out_pos) {
+		LOG_ERR("Back-reference before start of block");
+		return -EINVAL;
+	}
+
+	while (count--) {
+		err = out_byte(window[(dec.out_pos - distance) % WINDOW_SIZE]);
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static int decode(uint8_t byte)
+{
+	int err;
+
+	dec.bits = (dec.bits << 8) | byte;
+	dec.nbits += 8;
+
+	while (true) {
+		switch (dec.sym) {
+		case SYM_TAG:
+			if (dec.nbits < 1) {
+				return 0;
+			}
+			dec.sym = bits_get(1) ? SYM_LITERAL : SYM_INDEX;
+			break;
+		case SYM_LITERAL:
+			if (dec.nbits < 8) {
+				return 0;
+			}
+			err = out_byte(bits_get(8));
+			if (err) {
+				return err;
+			}
+			dec.sym = SYM_TAG;
+			break;
+		case SYM_INDEX:
+			if (dec.nbits < dec.window_bits) {
+				return 0;
+			}
+			dec.index = bits_get(dec.window_bits);
+			dec.sym = SYM_COUNT;
+			break;
+		case SYM_COUNT:
+			if (dec.nbits < dec.lookahead_bits) {
+				return 0;
+			}
+			err = backref_copy(dec.index + 1,
+					   bits_get(dec.lookahead_bits) + 1);
+			if (err) {
+				return err;
+			}
+			dec.sym = SYM_TAG;
+			break;
+		}
+	}
+}
+
+static int header_parse(void)
+{
+	uint16_t hdr_size = sys_get_le16(&dec.hdr[6]);
+
+	if (sys_get_le32(&dec.hdr[0]) != COMPRESSED_MAGIC ||
+	    sys_get_le16(&dec.hdr[4]) != COMPRESSED_VERSION ||
+	    hdr_size < HEADER_SIZE) {
+		LOG_ERR("Unsupported compressed image header");
+		return -EINVAL;
+	}
+
+	dec.image_size = sys_get_le32(&dec.hdr[8]);
+	if (dec.image_size > PM_MCUBOOT_SECONDARY_SIZE) {
+		LOG_ERR("Image too big to fit in flash %zu > 0x%x",
+			dec.image_size, PM_MCUBOOT_SECONDARY_SIZE);
+		return -EFBIG;
+	}
+
+	dec.hdr_skip = hdr_size - HEADER_SIZE;
+	dec.state = dec.hdr_skip ? PARSE_HEADER_EXT : PARSE_BLOCK_HEADER;
+
+	return 0;
+}
+
+static int block_start(void)
+{
+	dec.raw_len = sys_get_le16(&dec.hdr[0]);
+	dec.comp_len = sys_get_le16(&dec.hdr[2]);
+	dec.window_bits = dec.hdr[4];
+	dec.lookahead_bits = dec.hdr[5];
+
+	if (dec.raw_len == 0 || dec.comp_len == 0) {
+		LOG_ERR("Empty block");
+		return -EINVAL;
+	}
+
+	if (dec.window_bits == 0) {
+		if (dec.comp_len != dec.raw_len) {
+			LOG_ERR("Stored block size mismatch");
+			return -EINVAL;
+		}
+	} else if (dec.window_bits < WINDOW_BITS_MIN ||
+		   dec.window_bits > CONFIG_DFU_TARGET_COMPRESSED_WINDOW_BITS ||
+		   dec.lookahead_bits < LOOKAHEAD_BITS_MIN ||
+		   dec.lookahead_bits >= dec.window_bits) {
+		LOG_ERR("Unsupported window %d bits, lookahead %d bits",
+			dec.window_bits, dec.lookahead_bits);
+		return -EINVAL;
+	}
+
+	if (dec.img_pos + dec.raw_len > dec.image_size) {
+		LOG_ERR("Blocks exceed image size %zu", dec.image_size);
+		return -EINVAL;
+	}
+
+	dec.comp_pos = 0;
+	dec.out_pos = 0;
+	dec.flushed = 0;
+	dec.bits = 0;
+	dec.nbits = 0;
+	dec.sym = SYM_TAG;
+	dec.state = PARSE_BLOCK;
+
+	/* Once this block is in flash, the download can resume after it */
+	dfu_target_mcuboot_src_offset_set(dec.img_pos + dec.raw_len,
+					  dec.src_pos + dec.comp_len,
+					  dec.image_size);
+
+	return 0;
+}
+
+static int block_end(void)
+{
+	/* Trailing bits of the last byte are padding */
+	if (dec.out_pos != dec.raw_len) {
+		LOG_ERR("Block decompresses to %d bytes, expected %d",
+			dec.out_pos, dec.raw_len);
+		return -EINVAL;
+	}
+
+	dec.img_pos += dec.raw_len;
+	dec.state = PARSE_BLOCK_HEADER;
+
+	return flush();
+}
+
+static int parse_byte(uint8_t byte)
+{
+	int err;
+
+	dec.src_pos++;
+
+	switch (dec.state) {
+	case PARSE_HEADER:
+		dec.hdr[dec.hdr_fill++] = byte;
+		if (dec.hdr_fill < HEADER_SIZE) {
+			return 0;
+		}
+		dec.hdr_fill = 0;
+		return header_parse();
+	case PARSE_HEADER_EXT:
+		if (--dec.hdr_skip == 0) {
+			dec.state = PARSE_BLOCK_HEADER;
+		}
+		return 0;
+	case PARSE_BLOCK_HEADER:
+		dec.hdr[dec.hdr_fill++] = byte;
+		if (dec.hdr_fill < BLOCK_HEADER_SIZE) {
+			return 0;
+		}
+		dec.hdr_fill = 0;
+		return block_start();
+	case PARSE_BLOCK:
+		if (dec.window_bits) {
+			err = decode(byte);
+		} else {
+			err = out_byte(byte);
+		}
+		if (err) {
+			return err;
+		}
+		if (++dec.comp_pos == dec.comp_len) {
+			return block_end();
+		}
+		return 0;
+	}
+
+	return 0;
+}
+
+bool dfu_target_compressed_identify(const void *const buf)
+{
+	return sys_get_le32(buf) == COMPRESSED_MAGIC;
+}
+
+int dfu_target_compressed_init(size_t file_size, dfu_target_callback_t cb)
+{
+	int err;
+	size_t offset;
+	size_t src_offset;
+	size_t image_size;
+
+	err = dfu_target_mcuboot_init(file_size, cb);
+	if (err) {
+		return err;
+	}
+
+	memset(&dec, 0, sizeof(dec));
+
+	if (dfu_target_mcuboot_src_offset_get(&offset, &src_offset,
+					      &image_size) == 0 &&
+	    src_offset > 0) {
+		/* Continue with the block after the stored progress */
+		LOG_INF("Resuming compressed image at %zu (image %zu)",
+			src_offset, offset);
+		dec.src_pos = src_offset;
+		dec.img_pos = offset;
+		dec.image_size = image_size;
+		dec.state = PARSE_BLOCK_HEADER;
+		return 0;
+	}
+
+	err = dfu_target_mcuboot_offset_get(&offset);
+	if (err == 0 && offset > 0) {
+		/* Progress without a resume point can not be used */
+		LOG_WRN("Discarding write progress of %zu bytes", offset);
+		(void)dfu_target_mcuboot_done(false);
+	}
+
+	return 0;
+}
+
+int dfu_target_compressed_offset_get(size_t *out)
+{
+	*out = dec.src_pos;
+	return 0;
+}
+
+int dfu_target_compressed_write(const void *const buf, size_t len)
+{
+	int err;
+	const uint8_t *data = buf;
+
+	for (size_t i = 0; i < len; i++) {
+		err = parse_byte(data[i]);
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+int dfu_target_compressed_done(bool successful)
+{
+	if (successful &&
+	    (dec.state != PARSE_BLOCK_HEADER || dec.hdr_fill != 0 ||
+	     dec.img_pos != dec.image_size)) {
+		LOG_ERR("Compressed image is incomplete");
+		(void)dfu_target_mcuboot_done(false);
+		memset(&dec, 0, sizeof(dec));
+		return -EINVAL;
+	}
+
+	memset(&dec, 0, sizeof(dec));
+
+	return dfu_target_mcuboot_done(successful);
+}
+
+int dfu_target_compressed_schedule_update(void)
+{
+	return dfu_target_mcuboot_schedule_update();
+}
+
+int dfu_target_compressed_cancel_update(void)
+{
+	return dfu_target_mcuboot_cancel_update();
+}
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <logging/log.h>
+#include <sys/byteorder.h>
+#include <pm_config.h>
+#include <storage/flash_map.h>
+#include <tinycrypt/constants.h>
+#include <tinycrypt/sha256.h>
+#include <dfu/dfu_target.h>
+#include "dfu_target_mcuboot.h"
+#include "dfu_target_delta.h"
+
+LOG_MODULE_REGISTER(dfu_target_delta, CONFIG_DFU_TARGET_LOG_LEVEL);
+
+/* The patch starts with a header:
+ *   u32 magic, u16 version, u16 header size, u32 source size,
+ *   u32 image size, u8 source SHA-256[32]
+ * followed by commands which build the new image:
+ *   u8 op, u32 offset, u32 length
+ * COPY copies 'length' bytes at 'offset' in the active image, INSERT is
+ * followed by 'length' bytes of new data. Commands do not cross multiples
+ * of the block size in the new image, so the download can resume at every
+ * block. All fields are little endian.
+ */
+#define DELTA_MAGIC 0x544c4544
+#define DELTA_VERSION 1
+#define HEADER_SIZE 48
+#define CMD_SIZE 9
+
+#define OP_COPY 1
+#define OP_INSERT 2
+
+enum parse_state {
+	PARSE_HEADER,
+	PARSE_HEADER_EXT,
+	PARSE_CMD,
+	PARSE_INSERT,
+};
+
+static struct {
+	enum parse_state state;
+	uint8_t hdr[HEADER_SIZE];
+	size_t hdr_fill;
+	size_t hdr_skip;
+	/* Size of the active image, 0 if resumed */
+	size_t source_size;
+	/* Size of the new image, from the resume point if resumed */
+	size_t image_size;
+	/* Bytes of the patch parsed so far */
+	size_t patch_pos;
+	/* Bytes of the new image written so far */
+	size_t img_pos;
+	/* Bytes left of the current INSERT command */
+	size_t insert_left;
+} dec;
+
+static const struct flash_area *source;
+/* Bounds the RAM used to read the active image */
+static uint8_t read_buf[CONFIG_DFU_TARGET_DELTA_BUF_SIZE];
+
+static int source_verify(const uint8_t *digest)
+{
+	int err;
+	size_t len;
+	struct tc_sha256_state_struct sha;
+	uint8_t actual[TC_SHA256_DIGEST_SIZE];
+
+	(void)tc_sha256_init(&sha);
+
+	for (size_t off = 0; off < dec.source_size; off += len) {
+		len = MIN(sizeof(read_buf), dec.source_size - off);
+		err = flash_area_read(source, off, read_buf, len);
+		if (err) {
+			LOG_ERR("flash_area_read error %d", err);
+			return err;
+		}
+		(void)tc_sha256_update(&sha, read_buf, len);
+	}
+
+	(void)tc_sha256_final(actual, &sha);
+
+	if (memcmp(actual, digest, sizeof(actual)) != 0) {
+		LOG_ERR("Patch is not for the active image");
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+static int header_parse(void)
+{
+	int err;
+	uint16_t hdr_size = sys_get_le16(&dec.hdr[6]);
+
+	if (sys_get_le32(&dec.hdr[0]) != DELTA_MAGIC ||
+	    sys_get_le16(&dec.hdr[4]) != DELTA_VERSION ||
+	    hdr_size < HEADER_SIZE) {
+		LOG_ERR("Unsupported patch header");
+		return -EINVAL;
+	}
+
+	dec.source_size = sys_get_le32(&dec.hdr[8]);
+	dec.image_size = sys_get_le32(&dec.hdr[12]);
+
+	if (dec.source_size > source->fa_size) {
+		LOG_ERR("Patch source larger than the active slot");
+		return -EINVAL;
+	}
+
+	if (dec.image_size > PM_MCUBOOT_SECONDARY_SIZE) {
+		LOG_ERR("Image too big to fit in flash %zu > 0x%x",
+			dec.image_size, PM_MCUBOOT_SECONDARY_SIZE);
+		return -EFBIG;
+	}
+
+	/* Before anything is written */
+	err = source_verify(&dec.hdr[16]);
+	if (err) {
+		return err;
+	}
+
+	dec.hdr_skip = hdr_size - HEADER_SIZE;
+	dec.state = dec.hdr_skip ? PARSE_HEADER_EXT : PARSE_CMD;
+
+	return 0;
+}
+
+static int copy(size_t offset, size_t len)
+{
+	int err;
+	size_t n;
+
+	if (offset + len > source->fa_size ||
+	    (dec.source_size != 0 && offset + len > dec.source_size)) {
+		LOG_ERR("Copy outside of the active image");
+		return -EINVAL;
+	}
+
+	while (len > 0) {
+		n = MIN(len, sizeof(read_buf));
+		err = flash_area_read(source, offset, read_buf, n);
+		if (err) {
+			LOG_ERR("flash_area_read error %d", err);
+			return err;
+		}
+
+		err = dfu_target_mcuboot_write(read_buf, n);
+		if (err) {
+			return err;
+		}
+
+		offset += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int cmd_parse(void)
+{
+	int err;
+	uint8_t op = dec.hdr[0];
+	size_t offset = sys_get_le32(&dec.hdr[1]);
+	size_t len = sys_get_le32(&dec.hdr[5]);
+
+	if (len == 0 || (op != OP_COPY && op != OP_INSERT)) {
+		LOG_ERR("Invalid patch command %d", op);
+		return -EINVAL;
+	}
+
+	if (dec.img_pos + len > dec.image_size) {
+		LOG_ERR("Patch exceeds image size %zu", dec.image_size);
+		return -EINVAL;
+	}
+
+	/* Once this command is in flash, the download can resume after it */
+	dfu_target_mcuboot_src_offset_set(dec.img_pos + len,
+		dec.patch_pos + (op == OP_INSERT ? len : 0), dec.image_size);
+
+	if (op == OP_INSERT) {
+		dec.insert_left = len;
+		dec.state = PARSE_INSERT;
+		return 0;
+	}
+
+	err = copy(offset, len);
+	if (err) {
+		return err;
+	}
+
+	dec.img_pos += len;
+
+	return 0;
+}
+
+static int parse_byte(uint8_t byte)
+{
+	dec.patch_pos++;
+
+	switch (dec.state) {
+	case PARSE_HEADER:
+		dec.hdr[dec.hdr_fill++] = byte;
+		if (dec.hdr_fill < HEADER_SIZE) {
+			return 0;
+		}
+		dec.hdr_fill = 0;
+		return header_parse();
+	case PARSE_HEADER_EXT:
+		if (--dec.hdr_skip == 0) {
+			dec.state = PARSE_CMD;
+		}
+		return 0;
+	case PARSE_CMD:
+		dec.hdr[dec.hdr_fill++] = byte;
+		if (dec.hdr_fill < CMD_SIZE) {
+			return 0;
+		}
+		dec.hdr_fill = 0;
+		return cmd_parse();
+	case PARSE_INSERT:
+		/* Handled in dfu_target_delta_write() */
+		break;
+	}
+
+	return 0;
+}
+
+bool dfu_target_delta_identify(const void *const buf)
+{
+	return sys_get_le32(buf) == DELTA_MAGIC;
+}
+
+int dfu_target_delta_init(size_t file_size, dfu_target_callback_t cb)
+{
+	int err;
+	size_t offset;
+	size_t patch_offset;
+	size_t image_size;
+
+	err = flash_area_open(PM_MCUBOOT_PRIMARY_ID, &source);
+	if (err) {
+		LOG_ERR("flash_area_open error %d", err);
+		return err;
+	}
+
+	err = dfu_target_mcuboot_init(file_size, cb);
+	if (err) {
+		return err;
+	}
+
+	memset(&dec, 0, sizeof(dec));
+
+	if (dfu_target_mcuboot_src_offset_get(&offset, &patch_offset,
+					      &image_size) == 0 &&
+	    patch_offset > 0) {
+		/* The active image was verified when the patch was started */
+		LOG_INF("Resuming patch at %zu (image %zu)",
+			patch_offset, offset);
+		dec.patch_pos = patch_offset;
+		dec.img_pos = offset;
+		dec.image_size = image_size;
+		dec.state = PARSE_CMD;
+		return 0;
+	}
+
+	err = dfu_target_mcuboot_offset_get(&offset);
+	if (err == 0 && offset > 0) {
+		/* Progress without a resume point can not be used */
+		LOG_WRN("Discarding write progress of %zu bytes", offset);
+		(void)dfu_target_mcuboot_done(false);
+	}
+
+	return 0;
+}
+
+int dfu_target_delta_offset_get(size_t *out)
+{
+	*out = dec.patch_pos;
+	return 0;
+}
+
+int dfu_target_delta_write(const void *const buf, size_t len)
+{
+	int err;
+	size_t n;
+	const uint8_t *data = buf;
+
+	while (len > 0) {
+		if (dec.state == PARSE_INSERT) {
+			n = MIN(len, dec.insert_left);
+			err = dfu_target_mcuboot_write(data, n);
+			if (err) {
+				return err;
+			}
+
+			dec.patch_pos += n;
+			dec.img_pos += n;
+			dec.insert_left -= n;
+			if (dec.insert_left == 0) {
+				dec.state = PARSE_CMD;
+			}
+		} else {
+			n = 1;
+			err = parse_byte(*data);
+			if (err) {
+				return err;
+			}
+		}
+
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int dfu_target_delta_done(bool successful)
+{
+	if (successful &&
+	    (dec.state != PARSE_CMD || dec.hdr_fill != 0 ||
+	     dec.img_pos != dec.image_size)) {
+		LOG_ERR("Patch is incomplete");
+		(void)dfu_target_mcuboot_done(false);
+		memset(&dec, 0, sizeof(dec));
+		return -EINVAL;
+	}
+
+	memset(&dec, 0, sizeof(dec));
+
+	return dfu_target_mcuboot_done(successful);
+}
+
+int dfu_target_delta_schedule_update(void)
+{
+	return dfu_target_mcuboot_schedule_update();
+}
+
+int dfu_target_delta_cancel_update(void)
+{
+	return dfu_target_mcuboot_cancel_update();
+}
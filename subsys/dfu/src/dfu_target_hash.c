@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <logging/log.h>
+#include <sys/byteorder.h>
+#include <tinycrypt/constants.h>
+#include <tinycrypt/sha256.h>
+#include <dfu/dfu_target.h>
+#include "dfu_target_hash.h"
+
+LOG_MODULE_DECLARE(dfu_target, CONFIG_DFU_TARGET_LOG_LEVEL);
+
+#define DIGEST_SIZE TC_SHA256_DIGEST_SIZE
+
+/* MCUboot image header, see bootutil/image.h */
+#define MCUBOOT_HDR_SIZE 32
+#define MCUBOOT_HDR_OFF_HDR_SIZE 8
+#define MCUBOOT_HDR_OFF_PROTECT_TLV_SIZE 10
+#define MCUBOOT_HDR_OFF_IMG_SIZE 12
+
+/* MCUboot TLV area following the protected part of the image */
+#define MCUBOOT_TLV_INFO_MAGIC 0x6907
+#define MCUBOOT_TLV_SHA256 0x10
+#define MCUBOOT_TLV_HDR_SIZE 4
+
+enum tlv_state {
+	TLV_INFO,
+	TLV_HDR,
+	TLV_VALUE,
+	TLV_END,
+};
+
+/* Hash of the region of an MCUboot image covered by its SHA-256 TLV */
+static struct tc_sha256_state_struct sha;
+/* Hash of the whole file, as given by the application */
+static struct tc_sha256_state_struct sha_file;
+/* The hashes cover all of the image written so far */
+static bool active;
+static int type;
+/* Size of the image file */
+static size_t file_size;
+/* Number of image bytes written so far */
+static size_t pos;
+/* Number of image bytes covered by the digest in the MCUboot TLV */
+static size_t hashed_len;
+
+static uint8_t hdr[MCUBOOT_HDR_SIZE];
+
+static struct {
+	enum tlv_state state;
+	uint8_t hdr[MCUBOOT_TLV_HDR_SIZE];
+	size_t fill;
+	uint8_t type;
+	uint16_t len;
+	uint16_t value_pos;
+} tlv;
+
+static uint8_t tlv_digest[DIGEST_SIZE];
+static bool has_tlv_digest;
+
+/* Digest given by the application, for example from a job document */
+static uint8_t expected_digest[DIGEST_SIZE];
+static bool has_expected_digest;
+
+static int mcuboot_hdr_parse(void)
+{
+	uint16_t hdr_size = sys_get_le16(&hdr[MCUBOOT_HDR_OFF_HDR_SIZE]);
+	uint16_t protect_size =
+		sys_get_le16(&hdr[MCUBOOT_HDR_OFF_PROTECT_TLV_SIZE]);
+	uint32_t img_size = sys_get_le32(&hdr[MCUBOOT_HDR_OFF_IMG_SIZE]);
+
+	/* MCUboot hashes the header, the image and the protected TLVs */
+	hashed_len = hdr_size + img_size + protect_size;
+
+	if (hdr_size < MCUBOOT_HDR_SIZE || hashed_len > file_size) {
+		LOG_ERR("Image header does not match file size %d",
+			file_size);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void mcuboot_tlv_byte(uint8_t byte)
+{
+	switch (tlv.state) {
+	case TLV_INFO:
+		tlv.hdr[tlv.fill++] = byte;
+		if (tlv.fill < MCUBOOT_TLV_HDR_SIZE) {
+			break;
+		}
+		tlv.fill = 0;
+		if (sys_get_le16(&tlv.hdr[0]) != MCUBOOT_TLV_INFO_MAGIC) {
+			LOG_WRN("Image has no TLV area");
+			tlv.state = TLV_END;
+			break;
+		}
+		tlv.state = TLV_HDR;
+		break;
+	case TLV_HDR:
+		tlv.hdr[tlv.fill++] = byte;
+		if (tlv.fill < MCUBOOT_TLV_HDR_SIZE) {
+			break;
+		}
+		tlv.fill = 0;
+		tlv.type = tlv.hdr[0];
+		tlv.len = sys_get_le16(&tlv.hdr[2]);
+		tlv.value_pos = 0;
+		if (tlv.len > 0) {
+			tlv.state = TLV_VALUE;
+		}
+		break;
+	case TLV_VALUE:
+		if (tlv.type == MCUBOOT_TLV_SHA256 && tlv.len == DIGEST_SIZE) {
+			tlv_digest[tlv.value_pos] = byte;
+		}
+		if (++tlv.value_pos < tlv.len) {
+			break;
+		}
+		if (tlv.type == MCUBOOT_TLV_SHA256 && tlv.len == DIGEST_SIZE) {
+			has_tlv_digest = true;
+		}
+		tlv.state = TLV_HDR;
+		break;
+	case TLV_END:
+		break;
+	}
+}
+
+void dfu_target_hash_start(int img_type, size_t size, size_t offset)
+{
+	if (offset != 0) {
+		/* The hash can only continue if it covers all of the image
+		 * written before the download was interrupted.
+		 */
+		if (!active || img_type != type || offset != pos) {
+			LOG_WRN("Resumed image can not be verified");
+			active = false;
+		}
+		return;
+	}
+
+	(void)tc_sha256_init(&sha);
+	(void)tc_sha256_init(&sha_file);
+	active = true;
+	type = img_type;
+	file_size = size;
+	pos = 0;
+	has_tlv_digest = false;
+	memset(&tlv, 0, sizeof(tlv));
+
+	if (img_type == DFU_TARGET_IMAGE_TYPE_MCUBOOT) {
+		/* Updated once the header has been received */
+		hashed_len = MCUBOOT_HDR_SIZE;
+	} else {
+		/* Only the hash of the whole file is used */
+		hashed_len = 0;
+	}
+}
+
+int dfu_target_hash_update(const void *const buf, size_t len)
+{
+	int err;
+	size_t n;
+	const uint8_t *data = buf;
+
+	if (!active) {
+		return 0;
+	}
+
+	(void)tc_sha256_update(&sha_file, data, len);
+
+	if (type == DFU_TARGET_IMAGE_TYPE_MCUBOOT && pos < MCUBOOT_HDR_SIZE) {
+		n = MIN(len, MCUBOOT_HDR_SIZE - pos);
+		memcpy(&hdr[pos], data, n);
+
+		if (pos + n == MCUBOOT_HDR_SIZE) {
+			err = mcuboot_hdr_parse();
+			if (err) {
+				active = false;
+				return err;
+			}
+		}
+	}
+
+	if (pos < hashed_len) {
+		n = MIN(len, hashed_len - pos);
+		(void)tc_sha256_update(&sha, data, n);
+		data += n;
+		len -= n;
+		pos += n;
+	}
+
+	if (type == DFU_TARGET_IMAGE_TYPE_MCUBOOT) {
+		for (size_t i = 0; i < len; i++) {
+			mcuboot_tlv_byte(data[i]);
+		}
+	}
+
+	pos += len;
+
+	return 0;
+}
+
+int dfu_target_hash_verify(void)
+{
+	uint8_t digest[DIGEST_SIZE];
+	bool expected = has_expected_digest;
+
+	/* The digest from the application is for this image only */
+	has_expected_digest = false;
+
+	if (!active) {
+		if (expected) {
+			/* Accepting the image would skip the check the
+			 * application asked for.
+			 */
+			LOG_ERR("Image could not be hashed, "
+				"expected digest not verified");
+			return -ENOTSUP;
+		}
+
+		LOG_WRN("Image could not be hashed, it is not verified");
+		return 0;
+	}
+
+	active = false;
+
+	if (!expected && !has_tlv_digest) {
+		LOG_WRN("No digest to verify the image against");
+		return 0;
+	}
+
+	if (expected) {
+		(void)tc_sha256_final(digest, &sha_file);
+		if (memcmp(digest, expected_digest, DIGEST_SIZE) != 0) {
+			LOG_ERR("Image digest does not match the expected "
+				"digest");
+			return -EBADMSG;
+		}
+	}
+
+	if (has_tlv_digest) {
+		(void)tc_sha256_final(digest, &sha);
+		if (memcmp(digest, tlv_digest, DIGEST_SIZE) != 0) {
+			LOG_ERR("Image digest does not match the image TLV");
+			return -EBADMSG;
+		}
+	}
+
+	LOG_INF("Image SHA-256 verified");
+
+	return 0;
+}
+
+void dfu_target_hash_invalidate(void)
+{
+	active = false;
+}
+
+void dfu_target_hash_stop(void)
+{
+	active = false;
+	has_expected_digest = false;
+}
+
+int dfu_target_digest_set(const uint8_t *digest, size_t len)
+{
+	if (digest == NULL) {
+		has_expected_digest = false;
+		return 0;
+	}
+
+	if (len != DIGEST_SIZE) {
+		return -EINVAL;
+	}
+
+	memcpy(expected_digest, digest, DIGEST_SIZE);
+	has_expected_digest = true;
+
+	return 0;
+}
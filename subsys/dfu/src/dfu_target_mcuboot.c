@@ -32,6 +32,24 @@ LOG_MODULE_REGISTER(dfu_target_mcuboot, CONFIG_DFU_TARGET_LOG_LEVEL);
 
 static struct flash_img_context flash_img;
 
+/* For images which are transformed before they are written, such as
+ * compressed images: the offset in the downloaded file from where the
+ * download can resume once 'offset' bytes have been written to flash, and
+ * the size of the image being written.
+ */
+static struct {
+	size_t offset;
+	size_t src_offset;
+	size_t image_size;
+	bool valid;
+} src;
+
+#if defined(CONFIG_DFU_TARGET_MCUBOOT_SAVE_PROGRESS)
+/* Progress stored by the last checkpoint, and when it was stored */
+static size_t checkpoint_offset;
+static int64_t checkpoint_time;
+#endif
+
 int dfu_ctx_mcuboot_set_b1_file(const char *file, bool s0_active,
 				const char **update)
 {
@@ -77,9 +95,16 @@ static int store_flash_img_context(void)
 {
 	if (IS_ENABLED(CONFIG_DFU_TARGET_MCUBOOT_SAVE_PROGRESS)) {
 		char key[] = MODULE "/" FILE_FLASH_IMG;
-		size_t bytes_written = flash_img_bytes_written(&flash_img);
-		int err = settings_save_one(key, &bytes_written,
-					    sizeof(bytes_written));
+		size_t record[3] = {
+			flash_img_bytes_written(&flash_img),
+			src.src_offset,
+			src.image_size,
+		};
+		/* The resume point is stored with the progress, so that
+		 * they are always restored together.
+		 */
+		int err = settings_save_one(key, record, src.valid ?
+					    sizeof(record) : sizeof(record[0]));
 
 		if (err) {
 			LOG_ERR("Problem storing offset (err %d)", err);
@@ -90,6 +115,61 @@ static int store_flash_img_context(void)
 	return 0;
 }
 
+/**
+ * @brief Store the write progress if the checkpoint policy says so.
+ *
+ * The progress only advances when flash_img has written a whole block to
+ * flash, so every stored offset is at a block boundary. To spare the
+ * settings partition, the progress is stored once enough bytes have been
+ * written since the last checkpoint, or enough time has passed.
+ */
+static int checkpoint(void)
+{
+#if defined(CONFIG_DFU_TARGET_MCUBOOT_SAVE_PROGRESS)
+	int err;
+	size_t offset = flash_img_bytes_written(&flash_img);
+	int64_t now = k_uptime_get();
+
+	if (offset == checkpoint_offset) {
+		/* Nothing new has reached the flash */
+		return 0;
+	}
+
+	if (src.valid && offset != src.offset) {
+		/* The download can not resume from this offset */
+		return 0;
+	}
+
+	if ((offset - checkpoint_offset <
+	     CONFIG_DFU_TARGET_MCUBOOT_SAVE_PROGRESS_INTERVAL) &&
+	    (CONFIG_DFU_TARGET_MCUBOOT_SAVE_PROGRESS_PERIOD_MS == 0 ||
+	     now - checkpoint_time <
+	     CONFIG_DFU_TARGET_MCUBOOT_SAVE_PROGRESS_PERIOD_MS)) {
+		return 0;
+	}
+
+	err = store_flash_img_context();
+	if (err) {
+		return err;
+	}
+
+	LOG_DBG("Progress checkpoint at %d bytes", offset);
+
+	checkpoint_offset = offset;
+	checkpoint_time = now;
+#endif
+
+	return 0;
+}
+
+static void checkpoint_reset(void)
+{
+#if defined(CONFIG_DFU_TARGET_MCUBOOT_SAVE_PROGRESS)
+	checkpoint_offset = flash_img_bytes_written(&flash_img);
+	checkpoint_time = k_uptime_get();
+#endif
+}
+
 /**
  * @brief Function used by settings_load() to restore the flash_img variable.
  *	  See the Zephyr documentation of the settings subsystem for more
@@ -99,13 +179,19 @@ static int settings_set(const char *key, size_t len_rd,
 			settings_read_cb read_cb, void *cb_arg)
 {
 	if (!strcmp(key, FILE_FLASH_IMG)) {
-		ssize_t len = read_cb(cb_arg, &flash_img.stream.bytes_written,
-				      sizeof(flash_img.stream.bytes_written));
+		size_t record[3];
+		ssize_t len = read_cb(cb_arg, record, sizeof(record));
 
-		if (len != sizeof(flash_img.stream.bytes_written)) {
+		if (len != sizeof(record[0]) && len != sizeof(record)) {
 			LOG_ERR("Can't read flash_img from storage");
 			return len;
 		}
+
+		flash_img.stream.bytes_written = record[0];
+		src.offset = record[0];
+		src.src_offset = (len == sizeof(record)) ? record[1] : 0;
+		src.image_size = (len == sizeof(record)) ? record[2] : 0;
+		src.valid = (len == sizeof(record));
 	}
 
 	return 0;
@@ -157,6 +243,8 @@ int dfu_target_mcuboot_init(size_t file_size, dfu_target_callback_t cb)
 			LOG_ERR("Cannot load settings (err %d)", err);
 			return err;
 		}
+
+		checkpoint_reset();
 	}
 
 	return 0;
@@ -168,6 +256,31 @@ int dfu_target_mcuboot_offset_get(size_t *out)
 	return 0;
 }
 
+void dfu_target_mcuboot_src_offset_set(size_t offset, size_t src_offset,
+				       size_t image_size)
+{
+	src.offset = offset;
+	src.src_offset = src_offset;
+	src.image_size = image_size;
+	src.valid = true;
+}
+
+int dfu_target_mcuboot_src_offset_get(size_t *offset, size_t *src_offset,
+				      size_t *image_size)
+{
+	size_t written = flash_img_bytes_written(&flash_img);
+
+	if (!src.valid || src.offset != written) {
+		return -ENOENT;
+	}
+
+	*offset = written;
+	*src_offset = src.src_offset;
+	*image_size = src.image_size;
+
+	return 0;
+}
+
 int dfu_target_mcuboot_write(const void *const buf, size_t len)
 {
 	int err = flash_img_buffered_write(&flash_img, (uint8_t *)buf, len, false);
@@ -177,7 +290,7 @@ int dfu_target_mcuboot_write(const void *const buf, size_t len)
 		return err;
 	}
 
-	err = store_flash_img_context();
+	err = checkpoint();
 	if (err != 0) {
 		/* Failing to store progress is not a critical error you'll just
 		 * be left to download a bit more if you fail and resume.
@@ -196,10 +309,13 @@ static void reset_flash_context(void)
 	if (err) {
 		LOG_ERR("Unable to re-initialize flash_img");
 	}
+	memset(&src, 0, sizeof(src));
 	err = store_flash_img_context();
 	if (err != 0) {
 		LOG_ERR("Unable to reset write progress: %d", err);
 	}
+
+	checkpoint_reset();
 }
 
 int dfu_target_mcuboot_done(bool successful)
@@ -213,16 +329,6 @@ int dfu_target_mcuboot_done(bool successful)
 			reset_flash_context();
 			return err;
 		}
-
-		err = boot_request_upgrade(BOOT_UPGRADE_TEST);
-		if (err != 0) {
-			LOG_ERR("boot_request_upgrade error %d", err);
-			reset_flash_context();
-			return err;
-		}
-
-		LOG_INF("MCUBoot image upgrade scheduled. Reset the device to "
-			"apply");
 	} else {
 		LOG_INF("MCUBoot image upgrade aborted.");
 	}
@@ -230,3 +336,34 @@ int dfu_target_mcuboot_done(bool successful)
 	reset_flash_context();
 	return err;
 }
+
+int dfu_target_mcuboot_schedule_update(void)
+{
+	int err;
+
+	err = boot_request_upgrade(BOOT_UPGRADE_TEST);
+	if (err != 0) {
+		LOG_ERR("boot_request_upgrade error %d", err);
+		return err;
+	}
+
+	LOG_INF("MCUBoot image upgrade scheduled. Reset the device to apply");
+
+	return 0;
+}
+
+int dfu_target_mcuboot_cancel_update(void)
+{
+	int err;
+
+	/* Erasing the slot also erases the upgrade request in its trailer */
+	err = boot_erase_img_bank(PM_MCUBOOT_SECONDARY_ID);
+	if (err != 0) {
+		LOG_ERR("boot_erase_img_bank error %d", err);
+		return err;
+	}
+
+	LOG_INF("MCUBoot image upgrade cancelled");
+
+	return 0;
+}
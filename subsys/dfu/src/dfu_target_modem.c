@@ -6,6 +6,7 @@
 
 #include <zephyr.h>
 #include <stdio.h>
+#include <string.h>
 #include <drivers/flash.h>
 #include <net/socket.h>
 #include <nrf_socket.h>
@@ -23,10 +24,21 @@ struct modem_delta_header {
 	uint32_t magic;
 };
 
+enum send_state {
+	SEND_DATA,
+	SEND_ERASE,
+	SEND_RESUME,
+};
+
 static int  fd;
+/* Number of image bytes stored by the modem */
 static int  offset;
 static dfu_target_callback_t callback;
 
+/* Fragments are collected into chunks of the size the modem prefers */
+static uint8_t chunk[CONFIG_DFU_TARGET_MODEM_CHUNK_SIZE];
+static size_t chunk_len;
+
 static int get_modem_error(void)
 {
 	int rc;
@@ -56,6 +68,7 @@ static int apply_modem_upgrade(void)
 		} else {
 			LOG_ERR("SO_DFU_APPLY failed, modem error %d", err);
 		}
+		return -EFAULT;
 	}
 	return 0;
 }
@@ -97,6 +110,106 @@ static int delete_banked_modem_fw(void)
 	return 0;
 }
 
+/* Read the offset up to which the modem has stored the image */
+static int confirmed_offset_get(void)
+{
+	int err;
+	socklen_t len = sizeof(offset);
+
+	err = getsockopt(fd, SOL_DFU, SO_DFU_OFFSET, &offset, &len);
+	if (err < 0) {
+		if (errno == ENOEXEC) {
+			LOG_ERR("Modem error: %d", get_modem_error());
+		} else {
+			LOG_ERR("getsockopt(OFFSET) errno: %d", errno);
+		}
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+/* Send the buffered chunk. If the modem rejects the data because of stale
+ * image data, the banked firmware is deleted once and sending resumes from
+ * the offset confirmed by the modem.
+ */
+static int chunk_send(void)
+{
+	int err;
+	int rc;
+	int modem_error;
+	bool erased = false;
+	size_t sent = 0;
+	/* Image offset of the first byte in the chunk */
+	int start = offset;
+	enum send_state state = SEND_DATA;
+
+	/* Done once all of the chunk has been sent */
+	while (state != SEND_DATA || sent < chunk_len) {
+		switch (state) {
+		case SEND_DATA:
+			rc = send(fd, &chunk[sent], chunk_len - sent, 0);
+			if (rc >= 0) {
+				sent += rc;
+				break;
+			}
+
+			if (errno != ENOEXEC) {
+				LOG_ERR("send failed, errno %d", errno);
+				return -EFAULT;
+			}
+
+			modem_error = get_modem_error();
+			LOG_ERR("send failed, dfu err %d", modem_error);
+			if (modem_error == DFU_INVALID_UUID) {
+				return -EINVAL;
+			}
+			if (modem_error != DFU_INVALID_FILE_OFFSET &&
+			    modem_error != DFU_AREA_NOT_BLANK) {
+				return -EFAULT;
+			}
+			if (erased) {
+				return -EINVAL;
+			}
+
+			state = SEND_ERASE;
+			break;
+		case SEND_ERASE:
+			err = delete_banked_modem_fw();
+			if (err) {
+				return err;
+			}
+
+			erased = true;
+			state = SEND_RESUME;
+			break;
+		case SEND_RESUME:
+			err = confirmed_offset_get();
+			if (err) {
+				return err;
+			}
+
+			if (offset < start || (size_t)(offset - start) > chunk_len) {
+				/* The download must restart from the offset */
+				LOG_ERR("Can not resume at offset %d, chunk at %d",
+					offset, start);
+				chunk_len = 0;
+				return -EINVAL;
+			}
+
+			sent = offset - start;
+			state = SEND_DATA;
+			break;
+		}
+	}
+
+	offset = start + chunk_len;
+	chunk_len = 0;
+	LOG_DBG("Modem has stored %d bytes", offset);
+
+	return 0;
+}
+
 /**@brief Initialize DFU socket. */
 static int modem_dfu_socket_init(void)
 {
@@ -143,6 +256,7 @@ int dfu_target_modem_init(size_t file_size, dfu_target_callback_t cb)
 	socklen_t len = sizeof(offset);
 
 	callback = cb;
+	chunk_len = 0;
 
 	err = modem_dfu_socket_init();
 	if (err < 0) {
@@ -190,73 +304,53 @@ int dfu_target_modem_init(size_t file_size, dfu_target_callback_t cb)
 
 int dfu_target_modem_offset_get(size_t *out)
 {
-	*out = offset;
+	/* Buffered bytes are sent before the next chunk */
+	*out = offset + chunk_len;
 	return 0;
 }
 
 int dfu_target_modem_write(const void *const buf, size_t len)
 {
-	int err = 0;
-	int sent = 0;
-	int modem_error = 0;
-	int send_result = 0;
-
-	while (send_result >= 0) {
-		send_result = send(fd, (((uint8_t *)buf) + sent),
-				   (len - sent), 0);
-		if (send_result > 0) {
-			sent += send_result;
-			if (sent >= len) {
-				offset += len;
-				return 0;
+	int err;
+	size_t n;
+	const uint8_t *data = buf;
+
+	while (len > 0) {
+		n = MIN(len, sizeof(chunk) - chunk_len);
+		memcpy(&chunk[chunk_len], data, n);
+		chunk_len += n;
+		data += n;
+		len -= n;
+
+		if (chunk_len == sizeof(chunk)) {
+			err = chunk_send();
+			if (err) {
+				return err;
 			}
 		}
 	}
 
-	if (errno != ENOEXEC) {
-		return -EFAULT;
-	}
-
-	modem_error = get_modem_error();
-	LOG_ERR("send failed, modem errno %d, dfu err %d", errno, modem_error);
-	switch (modem_error) {
-	case DFU_INVALID_UUID:
-		return -EINVAL;
-	case DFU_INVALID_FILE_OFFSET:
-		delete_banked_modem_fw();
-		err = dfu_target_modem_write(buf, len);
-		if (err < 0) {
-			return -EINVAL;
-		} else {
-			return 0;
-		}
-	case DFU_AREA_NOT_BLANK:
-		delete_banked_modem_fw();
-		err = dfu_target_modem_write(buf, len);
-		if (err < 0) {
-			return -EINVAL;
-		} else {
-			return 0;
-		}
-	default:
-		return -EFAULT;
-	}
+	return 0;
 }
 
 int dfu_target_modem_done(bool successful)
 {
 	int err = 0;
+	int send_err = 0;
 
-	if (successful) {
-		err = apply_modem_upgrade();
-		if (err < 0) {
-			LOG_ERR("Failed request modem DFU upgrade");
-			return err;
+	if (successful && chunk_len > 0) {
+		send_err = chunk_send();
+		if (send_err < 0) {
+			LOG_ERR("Failed to send the last chunk");
+			successful = false;
 		}
-	} else {
-		LOG_INF("Modem upgrade aborted.");
 	}
 
+	chunk_len = 0;
+
+	if (!successful) {
+		LOG_INF("Modem upgrade aborted.");
+	}
 
 	err = close(fd);
 	if (err < 0) {
@@ -264,5 +358,35 @@ int dfu_target_modem_done(bool successful)
 		return err;
 	}
 
-	return 0;
+	return send_err;
+}
+
+int dfu_target_modem_schedule_update(void)
+{
+	int err;
+
+	/* The socket is closed once the image has been received */
+	err = modem_dfu_socket_init();
+	if (err < 0) {
+		return err;
+	}
+
+	err = apply_modem_upgrade();
+	if (err < 0) {
+		LOG_ERR("Failed request modem DFU upgrade");
+	}
+
+	(void)close(fd);
+
+	return err;
+}
+
+int dfu_target_modem_cancel_update(void)
+{
+	/* The modem applies the upgrade at the next boot once it has been
+	 * requested, which is why modem images are scheduled last.
+	 */
+	LOG_ERR("Modem upgrade can not be cancelled");
+
+	return -ENOTSUP;
 }
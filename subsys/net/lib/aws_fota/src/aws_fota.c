@@ -6,9 +6,10 @@
 
 #include <zephyr.h>
 #include <stdio.h>
-#include <data/json.h>
+#include <string.h>
 #include <net/fota_download.h>
 #include <net/aws_jobs.h>
+#include <net/aws_jobs_exec.h>
 #include <net/aws_fota.h>
 #include <logging/log.h>
 
@@ -16,11 +17,6 @@
 
 LOG_MODULE_REGISTER(aws_fota, CONFIG_AWS_FOTA_LOG_LEVEL);
 
-/* State variable to ensure that the AWS Fota library does not update the job
- * execution document before the last update is accepted by AWS IoT.
- */
-static bool accepted = true;
-
 /* Enum to keep the fota status */
 enum fota_status {
 	NONE = 0,
@@ -28,494 +24,183 @@ enum fota_status {
 	APPLY_UPDATE,
 };
 
-/* Pointer to initialized MQTT client instance */
-static struct mqtt_client *c;
-
 /* Enum for tracking the job exectuion state */
 static enum execution_status execution_state = AWS_JOBS_QUEUED;
 static enum fota_status fota_state = NONE;
 
-/* Document version is read out from the job execution document and is then
- * incremented with each accepted update to the job execution.
- */
-static uint32_t execution_version_number;
-
-/* File download progress % */
-static size_t download_progress;
-
-/* Allocated strings for topics */
-static uint8_t notify_next_topic[AWS_JOBS_TOPIC_MAX_LEN];
-static uint8_t update_topic[AWS_JOBS_TOPIC_MAX_LEN];
-static uint8_t get_topic[AWS_JOBS_TOPIC_MAX_LEN];
-
-/* Allocated buffers for keeping hostname, json payload and file_path */
-static uint8_t payload_buf[CONFIG_AWS_FOTA_PAYLOAD_SIZE];
+/* Allocated buffers for keeping hostname and file_path */
 static uint8_t hostname[CONFIG_AWS_FOTA_HOSTNAME_MAX_LEN];
 static uint8_t file_path[CONFIG_AWS_FOTA_FILE_PATH_MAX_LEN];
 static uint8_t job_id[AWS_JOBS_JOB_ID_MAX_LEN];
 static aws_fota_callback_t callback;
 
 /**
- * @brief Read the payload out of the published MQTT message from the MQTT
- *	  Client instance
- *
- * @param[in] client  Connected MQTT client instance.
- * @param[out] write_buf  Buffer where the MQTT publish message's payload is
- *			  stored.
- * @param[in] length  Length of the payload received.
- *
- * @return 0 If successful otherwise a negative error code is returned.
- */
-static int get_published_payload(struct mqtt_client *client, uint8_t *write_buf,
-				 size_t length)
-{
-	uint8_t *buf = write_buf;
-	uint8_t *end = buf + length;
-
-	if (length > sizeof(payload_buf)) {
-		return -EMSGSIZE;
-	}
-	while (buf < end) {
-		int ret = mqtt_read_publish_payload_blocking(client, buf,
-							     end - buf);
-
-		if (ret < 0) {
-			return ret;
-		} else if (ret == 0) {
-			return -EIO;
-		}
-		buf += ret;
-	}
-	return 0;
-}
-
-/**
- * @brief Wait for a job update to be accepted.
+ * @brief Reset the program state, so that the next job can be run.
  */
-static inline void wait_for_update_accepted(void)
+static void fota_reset(void)
 {
-	while (!accepted) {
-		k_yield();
-	};
+	fota_state = NONE;
+	execution_state = AWS_JOBS_QUEUED;
 }
 
 /**
- * @brief Update an AWS IoT Job Execution with a state and status details
+ * @brief Update the execution of the current job. The update is queued by the
+ *	  jobs execution engine, which sends it when the previous one has been
+ *	  accepted.
  *
- * @param[in] client  Connected MQTT client instance
- * @param[in] job_id  Unique identifier for the devices Job Execution
- * @param[in] execution_state  The execution state to update the Job Execution
- *			       with.
- * @param[in] client_token  Client identifier which will be repeated in the
- *			    respone of the update.
+ * @param[in] state  The execution state to update the Job Execution with.
  *
  * @return 0 If successful otherwise a negative error code is returned.
  */
-static int update_job_execution(struct mqtt_client *const client,
-				const uint8_t *job_id,
-				enum execution_status state,
-				const char *client_token)
+static int update_job_execution(enum execution_status state)
 {
 	int ret;
 
-	/* Waiting for the previous call to this function to be accepted. */
-	wait_for_update_accepted();
-	accepted = false;
-	LOG_DBG("%s, state: %d, version_number: %d", __func__,
-		state, execution_version_number);
-
-	ret = aws_jobs_update_job_execution(client, job_id, state,
-						 NULL,
-					     execution_version_number,
-					     client_token, update_topic);
+	LOG_DBG("%s, state: %d", __func__, state);
 
+	ret = aws_jobs_exec_update(job_id, state, NULL);
 	if (ret < 0) {
-		LOG_ERR("aws_jobs_update_job_execution failed: %d", ret);
+		LOG_ERR("aws_jobs_exec_update failed: %d", ret);
 	}
 
 	return ret;
 }
 
 /**
- * @brief Parsing an AWS IoT Job Execution response received on $next/get MQTT
- *	  topic or notify-next. If it is a valid response the program state is
- *	  updated and the MQTT client instance is subscribed to the update
- *	  topics for the job id received.
- *
- * @param[in] client  Connected MQTT client instance
- * @param[in] payload_len  Length of the payload going to be read out from the
- *			   MQTT message.
- *
- * @return 0 If successful otherwise a negative error code is returned.
+ * @brief Start the firmware download of the current job.
  */
-static int get_job_execution(struct mqtt_client *const client,
-			     uint32_t payload_len)
+static void download_start(void)
 {
-	int err = get_published_payload(client, payload_buf, payload_len);
-
-	if (err) {
-		LOG_ERR("Error when getting the payload: %d", err);
-		return err;
-	}
-
-#if IS_ENABLED(CONFIG_AWS_FOTA_LOG_LEVEL_DBG)
-	char job_doc[payload_len + 1];
+	struct aws_fota_event aws_fota_evt = { .id = AWS_FOTA_EVT_START };
+	int sec_tag = -1;
+	char *apn = NULL;
+	int err;
 
-	memcpy(job_doc, payload_buf, payload_len);
-	job_doc[payload_len] = '\0';
-	LOG_DBG("Job doc: %s", log_strdup(job_doc));
+	execution_state = AWS_JOBS_IN_PROGRESS;
+	LOG_DBG("Start downloading firmware from %s/%s",
+		log_strdup(hostname), log_strdup(file_path));
+#if defined(CONFIG_AWS_FOTA_DOWNLOAD_SECURITY_TAG)
+	sec_tag = CONFIG_AWS_FOTA_DOWNLOAD_SECURITY_TAG;
 #endif
 
-	/* Check if message received is a job. */
-	err = aws_fota_parse_DescribeJobExecution_rsp(payload_buf, payload_len,
-						      job_id, hostname,
-						      file_path,
-						     &execution_version_number);
-
-	if (err < 0) {
-		LOG_ERR("Error when parsing the json: %d", err);
-		return err;
-	} else if (err == 0) {
-		LOG_DBG("Got only one field");
-		LOG_DBG("No queued jobs for this device");
-		return 0;
-	}
-
-	LOG_DBG("Job ID: %s", log_strdup(job_id));
-	LOG_DBG("hostname: %s", log_strdup(hostname));
-	LOG_DBG("file_path %s", log_strdup(file_path));
-	LOG_DBG("execution_version_number: %d ", execution_version_number);
-
-	/* Subscribe to update topic to receive feedback on whether an
-	 * update is accepted or not.
-	 */
-	err = aws_jobs_subscribe_topic_update(client, job_id, update_topic);
+	err = fota_download_start(hostname, file_path, sec_tag, apn, 0);
 	if (err) {
-		LOG_ERR("Error when subscribing job_id_update: "
-				"%d", err);
-		return err;
+		LOG_ERR("Error (%d) when trying to start firmware "
+			"download", err);
+		execution_state = AWS_JOBS_FAILED;
+		(void)update_job_execution(AWS_JOBS_FAILED);
+		aws_fota_evt.id = AWS_FOTA_EVT_ERROR;
 	}
-	LOG_DBG("Subscribed to FOTA update topic %s", log_strdup(update_topic));
-
-	/* Set fota_state to DOWNLOAD_FIRMWARE, when we are subscribed
-	 * to job_id topics we will try to publish and if accepted we
-	 * can start the download
-	 */
-	fota_state = DOWNLOAD_FIRMWARE;
 
-	return 0;
+	callback(&aws_fota_evt);
 }
 
 /**
- * @brief Updating the program state when a job document update is accepted.
+ * @brief Handle a job that is next in the queue. The job document was parsed
+ *	  once by the jobs execution engine, and is kept by it until the job is
+ *	  done.
  *
- * @param[in] client  Connected MQTT client instance
- * @param[in] payload_len  Length of the payload going to be read out from the
- *			   MQTT message.
- *
- * @return 0 If successful otherwise a negative error code is returned.
+ * @param[in] job  Job received by the jobs execution engine.
  */
-static int job_update_accepted(struct mqtt_client *const client,
-			       uint32_t payload_len)
+static void job_start(const struct aws_jobs_exec_job *job)
 {
-	int sec_tag = -1;
-	char *apn = NULL;
-	int err = get_published_payload(client, payload_buf, payload_len);
+	int err;
 
-	if (err) {
-		LOG_ERR("Error when getting the payload: %d", err);
-		return err;
+	if (fota_state == APPLY_UPDATE) {
+		LOG_DBG("Waiting for reboot, job %s is run later",
+			log_strdup(job->id));
+		return;
 	}
 
-	accepted = true;
-	/* Update accepted, so the execution version number needs to be
-	 * incremented. This can also be parsed out from the response but it's
-	 * better if the device handles this state so we need to send less data.
-	 * Also it means that the device is the driver of updates to this
-	 * document.
-	 */
-	execution_version_number++;
-
-	if (execution_state != AWS_JOBS_IN_PROGRESS
-	    && fota_state == DOWNLOAD_FIRMWARE) {
-		struct aws_fota_event aws_fota_evt = {
-			.id = AWS_FOTA_EVT_START };
-		/*Job document is updated and we are ready to download
-		 * the firmware.
-		 */
-		execution_state = AWS_JOBS_IN_PROGRESS;
-		LOG_DBG("Start downloading firmware from %s/%s",
-			log_strdup(hostname), log_strdup(file_path));
-#if defined(CONFIG_AWS_FOTA_DOWNLOAD_SECURITY_TAG)
-		sec_tag = CONFIG_AWS_FOTA_DOWNLOAD_SECURITY_TAG;
-#endif
-
-		err = fota_download_start(hostname, file_path, sec_tag, apn, 0);
-		if (err) {
-			LOG_ERR("Error (%d) when trying to start firmware "
-				"download", err);
-			execution_state = AWS_JOBS_FAILED;
-			err = update_job_execution(client, job_id,
-						   execution_state, "");
-			if (err) {
-				return err;
-			}
+	LOG_DBG("Job doc: %s", log_strdup(job->doc));
 
-		}
-		callback(&aws_fota_evt);
-	} else if (execution_state == AWS_JOBS_IN_PROGRESS
-		   && fota_state == APPLY_UPDATE) {
-		LOG_DBG("Firmware download completed");
-		execution_state = AWS_JOBS_SUCCEEDED;
-		err = update_job_execution(client, job_id, execution_state, "");
-		if (err) {
-			LOG_ERR("Unable to update the job execution");
-			return err;
-		}
-	} else if (execution_state == AWS_JOBS_SUCCEEDED &&
-		   fota_state == APPLY_UPDATE) {
-		struct aws_fota_event aws_fota_evt = {
-			.id = AWS_FOTA_EVT_DONE };
-
-		callback(&aws_fota_evt);
-		LOG_DBG("Job document updated with SUCCEDED");
-		LOG_DBG("Ready to reboot");
-	} else if (execution_state == AWS_JOBS_FAILED) {
-		fota_state = NONE;
-		execution_state = AWS_JOBS_QUEUED;
-		accepted = false;
+	err = aws_fota_parse_job_document(job->doc, job->doc_len,
+					  hostname, file_path);
+	if (err) {
+		LOG_ERR("Error when parsing the job document: %d", err);
+		(void)aws_jobs_exec_update(job->id, AWS_JOBS_REJECTED, NULL);
+		return;
 	}
-	return 0;
-}
 
-/**
- * @brief Handling of a job document update when it is rejected.
- *
- * @param[in] client  Connected MQTT client instance
- * @param[in] payload_len  Length of the payload going to be read out from the
- *			   MQTT message.
- *
- * @return A negative error code is returned.
- */
+	strcpy(job_id, job->id);
 
-static int job_update_rejected(struct mqtt_client *const client,
-			       uint32_t payload_len)
-{
-	struct aws_fota_event aws_fota_evt = { .id = AWS_FOTA_EVT_ERROR };
-	LOG_ERR("Job document update was rejected");
-	execution_version_number--;
-	int err = get_published_payload(client, payload_buf, payload_len);
+	LOG_DBG("Job ID: %s", log_strdup(job_id));
+	LOG_DBG("hostname: %s", log_strdup(hostname));
+	LOG_DBG("file_path %s", log_strdup(file_path));
 
-	if (err) {
-		LOG_ERR("Error %d when getting the payload", err);
-		return err;
+	fota_state = DOWNLOAD_FIRMWARE;
+
+	/* A job that was in progress when the device restarted is
+	 * downloaded again without updating the job execution first.
+	 */
+	if (job->status == AWS_JOBS_IN_PROGRESS) {
+		download_start();
+		return;
 	}
-	LOG_ERR("%s", log_strdup(payload_buf));
-	callback(&aws_fota_evt);
-	return -EFAULT;
+
+	(void)update_job_execution(AWS_JOBS_IN_PROGRESS);
 }
 
 /**
- * @brief Handling of a MQTT publish event. It checks whether the topic matches
- *	  any of the expected AWS IoT Jobs topics used for FOTA.
- *
- * @param[in] client  Connected MQTT client instance.
- * @param[in] topic  String containing the received topic.
- * @param[in] topic_len  Length of the topic string.
- * @param[in] payload_len  Length of the received payload.
+ * @brief Handle the events of the jobs execution engine.
  *
- * @return 1 If the topic is not a topic used for AWS IoT Jobs. 0 If the content
- *	     in the topic was successfully handled. Otherwise a negative error
- *	     code is returned.
+ * @param[in] evt  Event from the jobs execution engine.
  */
-static int on_publish_evt(struct mqtt_client *const client,
-				   const uint8_t *topic,
-				   uint32_t topic_len,
-				   uint32_t payload_len)
+static void job_evt_handler(const struct aws_jobs_exec_evt *evt)
 {
-	bool is_get_next_topic =
-		aws_jobs_cmp(get_topic, topic, topic_len, "");
-	bool is_get_accepted =
-		aws_jobs_cmp(get_topic, topic, topic_len, "accepted");
-	bool is_notify_next_topic =
-		aws_jobs_cmp(notify_next_topic, topic, topic_len, "");
-	bool doc_update_accepted =
-		aws_jobs_cmp(update_topic, topic, topic_len, "accepted");
-	bool doc_update_rejected =
-		aws_jobs_cmp(update_topic, topic, topic_len, "rejected");
-
-#if defined(CONFIG_AWS_FOTA_LOG_LEVEL_DBG)
-	char debug_log[topic_len + 1];
-
-	memcpy(debug_log, topic, topic_len);
-	debug_log[topic_len] = '\0';
-	LOG_DBG("Received topic: %s", log_strdup(debug_log));
-#endif
-
-	if (is_notify_next_topic || is_get_next_topic || is_get_accepted) {
-		LOG_DBG("Checking for an available job");
-		return get_job_execution(client, payload_len);
-	} else if (doc_update_accepted) {
-		return job_update_accepted(client, payload_len);
-	} else if (doc_update_rejected) {
-		LOG_ERR("Job document update was rejected");
-		return job_update_rejected(client, payload_len);
-	}
-#if defined(CONFIG_AWS_FOTA_LOG_LEVEL_DBG)
-	LOG_DBG("received an unhandled MQTT publish event on topic: %s",
-		log_strdup(debug_log));
-#endif
-
-	return 1;
-}
-
-int aws_fota_mqtt_evt_handler(struct mqtt_client *const client,
-			      const struct mqtt_evt *evt)
-{
-	int err;
+	struct aws_fota_event aws_fota_evt;
+	bool current = (fota_state != NONE) &&
+		       (strcmp(evt->job->id, job_id) == 0);
 
 	switch (evt->type) {
-	case MQTT_EVT_CONNACK:
-		if (evt->result != 0) {
-			/* Expect more processing of CONNACK event by another
-			 * MQTT Event Handler
-			 */
-			return 1;
-		}
-
-		if (IS_ENABLED(CONFIG_MQTT_CLEAN_SESSION) ||
-		    !evt->param.connack.session_present_flag) {
-			err = aws_jobs_subscribe_topic_notify_next(client,
-							     notify_next_topic);
-			if (err) {
-				LOG_ERR("Unable to subscribe to"
-					" notify-next topic");
-				return err;
-			}
-
-			err = aws_jobs_subscribe_topic_get(client, "$next",
-							   get_topic);
-			if (err) {
-				LOG_ERR("Unable to subscribe to"
-					" jobs/$next/get");
-				return err;
-			}
-		} else {
-			LOG_DBG("Previous session valid;"
-				" skipping FOTA subscriptions");
-			err = aws_jobs_create_topic_notify_next(client,
-							     notify_next_topic);
-			if (err) {
-				LOG_ERR("Error when creating topic: %d", err);
-				return err;
-			}
-			LOG_DBG("Created notify_next_topic %s",
-				log_strdup(notify_next_topic));
-
-			err = aws_jobs_create_topic_get(client, "$next",
-							get_topic);
-			if (err) {
-				LOG_ERR("Error when creating topic: %d", err);
-				return err;
-			}
-			LOG_DBG("Created get_topic %s", log_strdup(get_topic));
-
-			LOG_DBG("previously subscribed to notify-next topic");
-			err = aws_jobs_get_job_execution(client, "$next",
-							 get_topic);
-			if (err) {
-				LOG_ERR("Error when publishing: %d", err);
-				return err;
-			}
-		}
-
-		/* This expects that the application's mqtt handler will handle
-		 * any situations where you could not connect to the MQTT
-		 * broker.
-		 */
-		return 1;
-
-	case MQTT_EVT_DISCONNECT:
-		return 1;
-
-	case MQTT_EVT_PUBLISH: {
-		const struct mqtt_publish_param *p = &evt->param.publish;
-
-		err = on_publish_evt(client,
-				     p->message.topic.topic.utf8,
-				     p->message.topic.topic.size,
-				     p->message.payload.len);
-
-		if (err < 0) {
-			return err;
-		} else if (err == 1) {
-			return err;
-		}
-
-		if (p->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE) {
-			const struct mqtt_puback_param ack = {
-				.message_id = p->message_id
-			};
-
-			/* Send acknowledgment. */
-			err = mqtt_publish_qos1_ack(c, &ack);
-			if (err) {
-				return err;
-			}
-		}
-		return 0;
-
-	} break;
-
-	case MQTT_EVT_PUBACK:
-		if (evt->result != 0) {
-			LOG_ERR("MQTT PUBACK error %d", evt->result);
-			return 0;
-		}
-		return 1;
+	case AWS_JOBS_EXEC_EVT_JOB:
+		job_start(evt->job);
+		break;
 
-	case MQTT_EVT_SUBACK:
-		if (evt->result != 0) {
-			return evt->result;
-		}
-		if (evt->param.suback.message_id == SUBSCRIBE_NOTIFY_NEXT) {
-			LOG_DBG("subscribed to notify-next topic");
-			err = aws_jobs_get_job_execution(client, "$next",
-							 get_topic);
-			if (err) {
-				return err;
-			}
-			return 0;
+	case AWS_JOBS_EXEC_EVT_ACCEPTED:
+		if (!current) {
+			break;
 		}
 
-		if (evt->param.suback.message_id == SUBSCRIBE_GET) {
-			LOG_DBG("subscribed to get topic");
-			return 0;
+		if (evt->status == AWS_JOBS_IN_PROGRESS
+		    && fota_state == DOWNLOAD_FIRMWARE
+		    && execution_state != AWS_JOBS_IN_PROGRESS) {
+			/* Job document is updated and we are ready to download
+			 * the firmware.
+			 */
+			download_start();
+		} else if (evt->status == AWS_JOBS_SUCCEEDED
+			   && fota_state == APPLY_UPDATE) {
+			aws_fota_evt.id = AWS_FOTA_EVT_DONE;
+			callback(&aws_fota_evt);
+			LOG_DBG("Job document updated with SUCCEDED");
+			LOG_DBG("Ready to reboot");
+		} else if (evt->status == AWS_JOBS_FAILED) {
+			fota_reset();
 		}
+		break;
 
-		if ((fota_state == DOWNLOAD_FIRMWARE) &&
-		   (evt->param.suback.message_id == SUBSCRIBE_JOB_ID_UPDATE)) {
-			download_progress = 0;
-			err = update_job_execution(client, job_id,
-						   AWS_JOBS_IN_PROGRESS, "");
-			if (err) {
-				return err;
-			}
-			return 0;
+	case AWS_JOBS_EXEC_EVT_REJECTED:
+		if (!current) {
+			break;
 		}
 
-		return 1;
-
-	default:
-		/* Handling for default case */
-		return 1;
+		LOG_ERR("Job document update was rejected");
+		fota_reset();
+		aws_fota_evt.id = AWS_FOTA_EVT_ERROR;
+		callback(&aws_fota_evt);
+		break;
 	}
 }
 
-static void http_fota_handler(const struct fota_download_evt *evt)
+int aws_fota_mqtt_evt_handler(struct mqtt_client *const client,
+			      const struct mqtt_evt *evt)
 {
-	__ASSERT_NO_MSG(c != NULL);
+	return aws_jobs_exec_mqtt_evt_handler(client, evt);
+}
 
+static void http_fota_handler(const struct fota_download_evt *evt)
+{
 	int err = 0;
 	struct aws_fota_event aws_fota_evt;
 
@@ -529,7 +214,8 @@ static void http_fota_handler(const struct fota_download_evt *evt)
 		callback(&aws_fota_evt);
 
 		fota_state = APPLY_UPDATE;
-		err = update_job_execution(c, job_id, AWS_JOBS_IN_PROGRESS, "");
+		execution_state = AWS_JOBS_SUCCEEDED;
+		err = update_job_execution(AWS_JOBS_SUCCEEDED);
 		if (err != 0) {
 			aws_fota_evt.id = AWS_FOTA_EVT_ERROR;
 			callback(&aws_fota_evt);
@@ -548,19 +234,20 @@ static void http_fota_handler(const struct fota_download_evt *evt)
 
 	case FOTA_DOWNLOAD_EVT_ERROR:
 		LOG_ERR("FOTA download failed, report back");
-		fota_state = NONE;
-		execution_state = AWS_JOBS_QUEUED;
-		(void)update_job_execution(c, job_id, AWS_JOBS_FAILED, "");
+		execution_state = AWS_JOBS_FAILED;
+		(void)update_job_execution(AWS_JOBS_FAILED);
 		aws_fota_evt.id = AWS_FOTA_EVT_ERROR;
 		callback(&aws_fota_evt);
 		break;
 
 	case FOTA_DOWNLOAD_EVT_PROGRESS:
 		/* Only if CONFIG_FOTA_DOWNLOAD_PROGRESS_EVT is enabled */
-		download_progress = evt->progress;
 		aws_fota_evt.id = AWS_FOTA_EVT_DL_PROGRESS;
-		aws_fota_evt.dl.progress = download_progress;
+		aws_fota_evt.dl.progress = evt->progress;
 		callback(&aws_fota_evt);
+
+		/* Rate-limited by the jobs execution engine */
+		(void)aws_jobs_exec_progress(job_id, evt->progress);
 		break;
 	}
 }
@@ -574,10 +261,14 @@ int aws_fota_init(struct mqtt_client *const client,
 		return -EINVAL;
 	}
 
-	/* Store client to make it available in event handlers. */
-	c = client;
 	callback = evt_handler;
 
+	err = aws_jobs_exec_init(client, job_evt_handler);
+	if (err != 0) {
+		LOG_ERR("aws_jobs_exec_init error %d", err);
+		return err;
+	}
+
 	err = fota_download_init(http_fota_handler);
 	if (err != 0) {
 		LOG_ERR("fota_download_init error %d", err);
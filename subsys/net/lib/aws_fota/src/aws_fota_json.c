@@ -6,139 +6,70 @@
 
 #include <zephyr.h>
 #include <string.h>
-#include <cJSON.h>
+#include <json_tok.h>
 #include <sys/util.h>
-#include <net/aws_jobs.h>
 
 #include "aws_fota_json.h"
 
-/**@brief Copy max maxlen bytes from src to dst. Insert null-terminator.
+/**@brief Copy the string token at path to buf, truncating it as needed.
  */
-static void strncpy_nullterm(char *dst, const char *src, size_t maxlen)
+static int str_get(const char *json, const struct json_tok *toks, int from,
+		   const char *path, char *buf, size_t size)
 {
-	size_t len = strlen(src) + 1;
+	int i = json_tok_find(json, toks, from, path);
 
-	memcpy(dst, src, MIN(len, maxlen));
-	if (len > maxlen) {
-		dst[maxlen - 1] = '\0';
+	if (i < 0 || json_tok_str(json, &toks[i], buf, size) < 0) {
+		return -ENODATA;
 	}
+
+	return 0;
 }
 
-int aws_fota_parse_UpdateJobExecution_rsp(const char *update_rsp_document,
-					  size_t payload_len, char *status_buf)
+/**@brief Copy the host and path of the firmware location at path.
+ */
+static int location_get(const char *json, const struct json_tok *toks,
+			int from, const char *path, char *hostname_buf,
+			char *file_path_buf)
 {
-	if (update_rsp_document == NULL || status_buf == NULL) {
-		return -EINVAL;
-	}
-
-	int ret;
-
-	cJSON *update_response = cJSON_Parse(update_rsp_document);
+	int location = json_tok_find(json, toks, from, path);
+	int err;
 
-	if (update_response == NULL) {
-		ret = -ENODATA;
-		goto cleanup;
+	if (location < 0 || toks[location].type != JSON_TOK_OBJ) {
+		return -ENODATA;
 	}
 
-	cJSON *status = cJSON_GetObjectItemCaseSensitive(update_response,
-							  "status");
-	if (cJSON_IsString(status) && status->valuestring != NULL) {
-		strncpy_nullterm(status_buf, status->valuestring,
-				 STATUS_MAX_LEN);
-	} else {
-		ret = -ENODATA;
-		goto cleanup;
+	err = str_get(json, toks, location, "host",
+		      hostname_buf, CONFIG_AWS_FOTA_HOSTNAME_MAX_LEN);
+	if (err) {
+		return err;
 	}
 
-	ret = 0;
-cleanup:
-	cJSON_Delete(update_response);
-	return ret;
+	return str_get(json, toks, location, "path",
+		       file_path_buf, CONFIG_AWS_FOTA_FILE_PATH_MAX_LEN);
 }
 
-int aws_fota_parse_DescribeJobExecution_rsp(const char *job_document,
-					   uint32_t payload_len,
-					   char *job_id_buf,
-					   char *hostname_buf,
-					   char *file_path_buf,
-					   int *execution_version_number)
+int aws_fota_parse_job_document(const char *job_document, size_t len,
+				char *hostname_buf, char *file_path_buf)
 {
 	if (job_document == NULL
-	    || job_id_buf == NULL
 	    || hostname_buf == NULL
-	    || file_path_buf == NULL
-	    || execution_version_number == NULL) {
+	    || file_path_buf == NULL) {
 		return -EINVAL;
 	}
 
-	int ret;
-
-	cJSON *json_data = cJSON_Parse(job_document);
-
-	if (json_data == NULL) {
-		ret = -ENODATA;
-		goto cleanup;
-	}
-
-	cJSON *execution = cJSON_GetObjectItemCaseSensitive(json_data,
-							    "execution");
-	if (execution == NULL) {
-		ret = 0;
-		goto cleanup;
-	}
-
-	cJSON *job_id = cJSON_GetObjectItemCaseSensitive(execution, "jobId");
+	int err;
+	struct json_tok buf[CONFIG_AWS_FOTA_JSON_TOKENS];
+	struct json_tok *toks;
 
-	if (cJSON_GetStringValue(job_id) != NULL) {
-		strncpy_nullterm(job_id_buf, job_id->valuestring,
-				AWS_JOBS_JOB_ID_MAX_LEN);
-	} else {
-		ret = -ENODATA;
-		goto cleanup;
+	err = json_tok_parse_alloc(job_document, len, buf, ARRAY_SIZE(buf),
+				   &toks);
+	if (err < 0) {
+		return -ENODATA;
 	}
 
-	cJSON *job_data = cJSON_GetObjectItemCaseSensitive(execution,
-							   "jobDocument");
-
-	if (!cJSON_IsObject(job_data)) {
-		ret = -ENODATA;
-		goto cleanup;
-	}
-
-	cJSON *location = cJSON_GetObjectItemCaseSensitive(job_data,
-							    "location");
-
-	if (!cJSON_IsObject(location)) {
-		ret = -ENODATA;
-		goto cleanup;
-	}
-
-	cJSON *hostname = cJSON_GetObjectItemCaseSensitive(location, "host");
-	cJSON *path = cJSON_GetObjectItemCaseSensitive(location, "path");
-
-	if ((cJSON_GetStringValue(hostname) != NULL)
-	   && (cJSON_GetStringValue(path) != NULL)) {
-		strncpy_nullterm(hostname_buf, hostname->valuestring,
-				CONFIG_AWS_FOTA_HOSTNAME_MAX_LEN);
-		strncpy_nullterm(file_path_buf, path->valuestring,
-				CONFIG_AWS_FOTA_FILE_PATH_MAX_LEN);
-	} else {
-		ret = -ENODATA;
-		goto cleanup;
-	}
-
-	cJSON *version_number = cJSON_GetObjectItemCaseSensitive(
-					execution, "versionNumber");
-
-	if (cJSON_IsNumber(version_number)) {
-		*execution_version_number = version_number->valueint;
-	} else {
-		ret = -ENODATA;
-		goto cleanup;
-	}
+	err = location_get(job_document, toks, 0, "location", hostname_buf,
+			   file_path_buf);
+	json_tok_free(toks, buf);
 
-	ret = 1;
-cleanup:
-	cJSON_Delete(json_data);
-	return ret;
+	return err;
 }
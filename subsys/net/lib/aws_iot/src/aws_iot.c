@@ -11,9 +11,14 @@
 #include <stdio.h>
 
 #if defined(CONFIG_AWS_FOTA)
+#include <net/aws_jobs.h>
 #include <net/aws_fota.h>
 #endif
 
+#if defined(CONFIG_CLOUD_OUTBOX)
+#include <net/cloud_outbox.h>
+#endif
+
 #if defined(CONFIG_BOARD_QEMU_X86) && !defined(CONFIG_BSD_LIBRARY)
 #include "certificates.h"
 #endif
@@ -32,66 +37,149 @@ BUILD_ASSERT(sizeof(CONFIG_AWS_IOT_BROKER_HOST_NAME) > 1,
 #endif
 
 #define AWS_TOPIC "$aws/things/"
-#define AWS_TOPIC_LEN (sizeof(AWS_TOPIC))
 
 #define AWS_CLIENT_ID_PREFIX "%s"
 #define AWS_CLIENT_ID_LEN_MAX CONFIG_AWS_IOT_CLIENT_ID_MAX_LEN
 
-#define GET_TOPIC AWS_TOPIC "%s/shadow/get"
-#define GET_TOPIC_LEN (AWS_TOPIC_LEN + AWS_CLIENT_ID_LEN_MAX + 11)
-
-#define UPDATE_TOPIC AWS_TOPIC "%s/shadow/update"
-#define UPDATE_TOPIC_LEN (AWS_TOPIC_LEN + AWS_CLIENT_ID_LEN_MAX + 14)
+#define SHADOW_TOPIC AWS_TOPIC "%s/shadow/%s"
+#define SHADOW_TOPIC_SIZE(suffix) \
+	(sizeof(AWS_TOPIC) + AWS_CLIENT_ID_LEN_MAX + sizeof("/shadow/" suffix))
+#define SHADOW_TOPIC_COUNT (AWS_IOT_SHADOW_TOPIC_DELETE_REJECTED + 1)
+
+/* Size of the buffer that holds the shadow topics in use */
+#define SHADOW_TOPIC_BUF_SIZE						       \
+	(SHADOW_TOPIC_SIZE("get") +					       \
+	 SHADOW_TOPIC_SIZE("update") +					       \
+	 SHADOW_TOPIC_SIZE("delete") +					       \
+	 IS_ENABLED(CONFIG_AWS_IOT_TOPIC_GET_ACCEPTED_SUBSCRIBE) *	       \
+		SHADOW_TOPIC_SIZE("get/accepted") +			       \
+	 IS_ENABLED(CONFIG_AWS_IOT_TOPIC_GET_REJECTED_SUBSCRIBE) *	       \
+		SHADOW_TOPIC_SIZE("get/rejected") +			       \
+	 IS_ENABLED(CONFIG_AWS_IOT_TOPIC_UPDATE_ACCEPTED_SUBSCRIBE) *	       \
+		SHADOW_TOPIC_SIZE("update/accepted") +			       \
+	 IS_ENABLED(CONFIG_AWS_IOT_TOPIC_UPDATE_REJECTED_SUBSCRIBE) *	       \
+		SHADOW_TOPIC_SIZE("update/rejected") +			       \
+	 IS_ENABLED(CONFIG_AWS_IOT_TOPIC_UPDATE_DELTA_SUBSCRIBE) *	       \
+		SHADOW_TOPIC_SIZE("update/delta") +			       \
+	 IS_ENABLED(CONFIG_AWS_IOT_TOPIC_DELETE_ACCEPTED_SUBSCRIBE) *	       \
+		SHADOW_TOPIC_SIZE("delete/accepted") +			       \
+	 IS_ENABLED(CONFIG_AWS_IOT_TOPIC_DELETE_REJECTED_SUBSCRIBE) *	       \
+		SHADOW_TOPIC_SIZE("delete/rejected"))
+
+struct shadow_topic {
+	const char *suffix;
+	/* The topic is published to */
+	bool publish;
+	/* The topic is subscribed to */
+	bool subscribe;
+};
 
-#define DELETE_TOPIC AWS_TOPIC "%s/shadow/delete"
-#define DELETE_TOPIC_LEN (AWS_TOPIC_LEN + AWS_CLIENT_ID_LEN_MAX + 14)
+static const struct shadow_topic shadow_topics[SHADOW_TOPIC_COUNT] = {
+	[AWS_IOT_SHADOW_TOPIC_GET] = {
+		.suffix = "get",
+		.publish = true,
+	},
+	[AWS_IOT_SHADOW_TOPIC_UPDATE] = {
+		.suffix = "update",
+		.publish = true,
+	},
+	[AWS_IOT_SHADOW_TOPIC_DELETE] = {
+		.suffix = "delete",
+		.publish = true,
+	},
+	[AWS_IOT_SHADOW_TOPIC_GET_ACCEPTED] = {
+		.suffix = "get/accepted",
+		.subscribe =
+			IS_ENABLED(CONFIG_AWS_IOT_TOPIC_GET_ACCEPTED_SUBSCRIBE),
+	},
+	[AWS_IOT_SHADOW_TOPIC_GET_REJECTED] = {
+		.suffix = "get/rejected",
+		.subscribe =
+			IS_ENABLED(CONFIG_AWS_IOT_TOPIC_GET_REJECTED_SUBSCRIBE),
+	},
+	[AWS_IOT_SHADOW_TOPIC_UPDATE_ACCEPTED] = {
+		.suffix = "update/accepted",
+		.subscribe =
+			IS_ENABLED(CONFIG_AWS_IOT_TOPIC_UPDATE_ACCEPTED_SUBSCRIBE),
+	},
+	[AWS_IOT_SHADOW_TOPIC_UPDATE_REJECTED] = {
+		.suffix = "update/rejected",
+		.subscribe =
+			IS_ENABLED(CONFIG_AWS_IOT_TOPIC_UPDATE_REJECTED_SUBSCRIBE),
+	},
+	[AWS_IOT_SHADOW_TOPIC_UPDATE_DELTA] = {
+		.suffix = "update/delta",
+		.subscribe =
+			IS_ENABLED(CONFIG_AWS_IOT_TOPIC_UPDATE_DELTA_SUBSCRIBE),
+	},
+	[AWS_IOT_SHADOW_TOPIC_DELETE_ACCEPTED] = {
+		.suffix = "delete/accepted",
+		.subscribe =
+			IS_ENABLED(CONFIG_AWS_IOT_TOPIC_DELETE_ACCEPTED_SUBSCRIBE),
+	},
+	[AWS_IOT_SHADOW_TOPIC_DELETE_REJECTED] = {
+		.suffix = "delete/rejected",
+		.subscribe =
+			IS_ENABLED(CONFIG_AWS_IOT_TOPIC_DELETE_REJECTED_SUBSCRIBE),
+	},
+};
 
 static char client_id_buf[AWS_CLIENT_ID_LEN_MAX + 1];
-static char get_topic[GET_TOPIC_LEN + 1];
-static char update_topic[UPDATE_TOPIC_LEN + 1];
-static char delete_topic[DELETE_TOPIC_LEN + 1];
-
-#if defined(CONFIG_AWS_IOT_TOPIC_UPDATE_ACCEPTED_SUBSCRIBE)
-#define UPDATE_ACCEPTED_TOPIC AWS_TOPIC "%s/shadow/update/accepted"
-#define UPDATE_ACCEPTED_TOPIC_LEN (AWS_TOPIC_LEN + AWS_CLIENT_ID_LEN_MAX + 23)
-static char update_accepted_topic[UPDATE_ACCEPTED_TOPIC_LEN + 1];
-#endif
+static size_t client_id_len;
+static char shadow_topic_buf[SHADOW_TOPIC_BUF_SIZE];
 
-#if defined(CONFIG_AWS_IOT_TOPIC_UPDATE_REJECTED_SUBSCRIBE)
-#define UPDATE_REJECTED_TOPIC AWS_TOPIC "%s/shadow/update/rejected"
-#define UPDATE_REJECTED_TOPIC_LEN (AWS_TOPIC_LEN + AWS_CLIENT_ID_LEN_MAX + 23)
-static char update_rejected_topic[UPDATE_REJECTED_TOPIC_LEN + 1];
-#endif
+/* Shadow topics in use, built once at init and indexed by topic type.
+ * Topics that are not in use have a length of 0.
+ */
+static struct aws_iot_topic_data topics[SHADOW_TOPIC_COUNT];
 
-#if defined(CONFIG_AWS_IOT_TOPIC_UPDATE_DELTA_SUBSCRIBE)
-#define UPDATE_DELTA_TOPIC AWS_TOPIC "%s/shadow/update/delta"
-#define UPDATE_DELTA_TOPIC_LEN (AWS_TOPIC_LEN + AWS_CLIENT_ID_LEN_MAX + 20)
-static char update_delta_topic[UPDATE_DELTA_TOPIC_LEN + 1];
-#endif
+/* Length of the prefix shared by all shadow topics,
+ * "$aws/things/<client-id>/shadow/".
+ */
+static size_t shadow_prefix_len;
 
-#if defined(CONFIG_AWS_IOT_TOPIC_GET_ACCEPTED_SUBSCRIBE)
-#define GET_ACCEPTED_TOPIC AWS_TOPIC "%s/shadow/get/accepted"
-#define GET_ACCEPTED_TOPIC_LEN (AWS_TOPIC_LEN + AWS_CLIENT_ID_LEN_MAX + 20)
-static char get_accepted_topic[GET_ACCEPTED_TOPIC_LEN + 1];
-#endif
+/* Message IDs of messages that wait for a PUBACK or SUBACK, 0 if free */
+static uint16_t inflight_ids[CONFIG_AWS_IOT_INFLIGHT_MAX];
+static uint16_t last_message_id;
+static struct k_spinlock message_id_lock;
 
-#if defined(CONFIG_AWS_IOT_TOPIC_GET_REJECTED_SUBSCRIBE)
-#define GET_REJECTED_TOPIC AWS_TOPIC "%s/shadow/get/rejected"
-#define GET_REJECTED_TOPIC_LEN (AWS_TOPIC_LEN + AWS_CLIENT_ID_LEN_MAX + 20)
-static char get_rejected_topic[GET_REJECTED_TOPIC_LEN + 1];
+/* The message IDs above it are left to the job execution engine of
+ * AWS FOTA, which shares the MQTT client.
+ */
+#if defined(CONFIG_AWS_FOTA)
+#define MESSAGE_ID_MAX (AWS_JOBS_EXEC_MESSAGE_ID_FIRST - 1)
+#else
+#define MESSAGE_ID_MAX UINT16_MAX
 #endif
 
-#if defined(CONFIG_AWS_IOT_TOPIC_DELETE_ACCEPTED_SUBSCRIBE)
-#define DELETE_ACCEPTED_TOPIC AWS_TOPIC "%s/shadow/delete/accepted"
-#define DELETE_ACCEPTED_TOPIC_LEN (AWS_TOPIC_LEN + AWS_CLIENT_ID_LEN_MAX + 23)
-static char delete_accepted_topic[DELETE_ACCEPTED_TOPIC_LEN + 1];
+/* IDs are only allocated below the ones the cloud outbox sends with. */
+#if defined(CONFIG_CLOUD_OUTBOX)
+#define MESSAGE_ID_ALLOC_MAX (CLOUD_OUTBOX_MESSAGE_ID_FIRST - 1)
+#else
+#define MESSAGE_ID_ALLOC_MAX MESSAGE_ID_MAX
 #endif
 
-#if defined(CONFIG_AWS_IOT_TOPIC_DELETE_REJECTED_SUBSCRIBE)
-#define DELETE_REJECTED_TOPIC AWS_TOPIC "%s/shadow/delete/rejected"
-#define DELETE_REJECTED_TOPIC_LEN (AWS_TOPIC_LEN + AWS_CLIENT_ID_LEN_MAX + 23)
-static char delete_rejected_topic[DELETE_REJECTED_TOPIC_LEN + 1];
-#endif
+/* Topics that can be subscribed to: the shadow topics, followed by the
+ * application topics.
+ */
+#define SUBSCRIPTION_COUNT \
+	(SHADOW_TOPIC_COUNT + CONFIG_AWS_IOT_APP_SUBSCRIPTION_LIST_COUNT)
+
+/* Subscriptions of the session on the broker, indexed like the topics
+ * above. When a persistent session is resumed, the topics that the broker
+ * has confirmed since boot are not subscribed to again, unless they have
+ * changed.
+ */
+static struct {
+	/* Hash of the topic when it was confirmed, 0 if not confirmed */
+	uint32_t hash;
+	/* ID of the SUBSCRIBE message that waits for a SUBACK, 0 if none */
+	uint16_t message_id;
+} subscriptions[SUBSCRIPTION_COUNT];
+
+static struct aws_iot_connect_stats connect_stats;
+/* Uptime when the last connection was started, -1 if none */
+static int64_t connect_start = -1;
 
 #if defined(CONFIG_CLOUD_API)
 static struct cloud_backend *aws_iot_backend;
@@ -268,6 +356,10 @@ static void aws_iot_notify_event(const struct aws_iot_evt *aws_iot_evt)
 		cloud_evt.data.fota_progress =
 				aws_iot_evt->data.fota_progress;
 		break;
+	case AWS_IOT_EVT_PUBACK:
+		cloud_evt.type = CLOUD_EVT_DATA_SENT;
+		cloud_evt.data.msg.message_id = aws_iot_evt->data.message_id;
+		break;
 	default:
 		LOG_ERR("Unknown AWS IoT event");
 		break;
@@ -330,6 +422,8 @@ static void aws_fota_cb_handler(struct aws_fota_event *fota_evt)
 static int aws_iot_topics_populate(char *const id, size_t id_len)
 {
 	int err;
+	size_t offset = 0;
+
 #if defined(CONFIG_AWS_IOT_CLIENT_ID_APP)
 	err = snprintf(client_id_buf, sizeof(client_id_buf),
 		       AWS_CLIENT_ID_PREFIX, id);
@@ -349,187 +443,375 @@ static int aws_iot_topics_populate(char *const id, size_t id_len)
 		return -ENOMEM;
 	}
 #endif
-	err = snprintf(get_topic, sizeof(get_topic),
-		       GET_TOPIC, client_id_buf);
-	if (err >= GET_TOPIC_LEN) {
-		return -ENOMEM;
+	client_id_len = err;
+
+	for (size_t i = 0; i < SHADOW_TOPIC_COUNT; i++) {
+		const struct shadow_topic *shadow_topic = &shadow_topics[i];
+
+		topics[i].type = i;
+		topics[i].str = NULL;
+		topics[i].len = 0;
+
+		if (!shadow_topic->publish && !shadow_topic->subscribe) {
+			continue;
+		}
+
+		err = snprintf(&shadow_topic_buf[offset],
+			       sizeof(shadow_topic_buf) - offset,
+			       SHADOW_TOPIC, client_id_buf,
+			       shadow_topic->suffix);
+		if (err >= sizeof(shadow_topic_buf) - offset) {
+			return -ENOMEM;
+		}
+
+		topics[i].str = &shadow_topic_buf[offset];
+		topics[i].len = err;
+		offset += err + 1;
 	}
 
-	err = snprintf(update_topic, sizeof(update_topic),
-		       UPDATE_TOPIC, client_id_buf);
-	if (err >= UPDATE_TOPIC_LEN) {
-		return -ENOMEM;
+	shadow_prefix_len = topics[AWS_IOT_SHADOW_TOPIC_GET].len -
+			    strlen(shadow_topics[AWS_IOT_SHADOW_TOPIC_GET].suffix);
+
+	return 0;
+}
+
+/* Response topics of the get, update and delete topics, in the order
+ * accepted, rejected and delta.
+ */
+static const enum aws_iot_topic_type response_topics[][3] = {
+	[AWS_IOT_SHADOW_TOPIC_GET] = {
+		AWS_IOT_SHADOW_TOPIC_GET_ACCEPTED,
+		AWS_IOT_SHADOW_TOPIC_GET_REJECTED,
+		AWS_IOT_SHADOW_TOPIC_UNKNOWN,
+	},
+	[AWS_IOT_SHADOW_TOPIC_UPDATE] = {
+		AWS_IOT_SHADOW_TOPIC_UPDATE_ACCEPTED,
+		AWS_IOT_SHADOW_TOPIC_UPDATE_REJECTED,
+		AWS_IOT_SHADOW_TOPIC_UPDATE_DELTA,
+	},
+	[AWS_IOT_SHADOW_TOPIC_DELETE] = {
+		AWS_IOT_SHADOW_TOPIC_DELETE_ACCEPTED,
+		AWS_IOT_SHADOW_TOPIC_DELETE_REJECTED,
+		AWS_IOT_SHADOW_TOPIC_UNKNOWN,
+	},
+};
+
+/* Find the shadow topic that a message was received on. The first
+ * character of each topic level after the shared prefix selects the only
+ * candidate, which is then compared once.
+ */
+static enum aws_iot_topic_type topic_type_get(const char *str, size_t len)
+{
+	enum aws_iot_topic_type type;
+	size_t base_len;
+
+	if (len <= shadow_prefix_len) {
+		return AWS_IOT_SHADOW_TOPIC_UNKNOWN;
 	}
 
-	err = snprintf(delete_topic, sizeof(delete_topic),
-		       DELETE_TOPIC, client_id_buf);
-	if (err >= DELETE_TOPIC_LEN) {
-		return -ENOMEM;
+	switch (str[shadow_prefix_len]) {
+	case 'g':
+		type = AWS_IOT_SHADOW_TOPIC_GET;
+		break;
+	case 'u':
+		type = AWS_IOT_SHADOW_TOPIC_UPDATE;
+		break;
+	case 'd':
+		type = AWS_IOT_SHADOW_TOPIC_DELETE;
+		break;
+	default:
+		return AWS_IOT_SHADOW_TOPIC_UNKNOWN;
 	}
 
-#if defined(CONFIG_AWS_IOT_TOPIC_GET_ACCEPTED_SUBSCRIBE)
-	err = snprintf(get_accepted_topic, sizeof(get_accepted_topic),
-		       GET_ACCEPTED_TOPIC, client_id_buf);
-	if (err >= GET_ACCEPTED_TOPIC_LEN) {
-		return -ENOMEM;
+	base_len = topics[type].len;
+
+	if (len > base_len + 1) {
+		switch (str[base_len + 1]) {
+		case 'a':
+			type = response_topics[type][0];
+			break;
+		case 'r':
+			type = response_topics[type][1];
+			break;
+		case 'd':
+			type = response_topics[type][2];
+			break;
+		default:
+			return AWS_IOT_SHADOW_TOPIC_UNKNOWN;
+		}
 	}
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_GET_REJECTED_SUBSCRIBE)
-	err = snprintf(get_rejected_topic, sizeof(get_rejected_topic),
-		       GET_REJECTED_TOPIC, client_id_buf);
-	if (err >= GET_REJECTED_TOPIC_LEN) {
-		return -ENOMEM;
+
+	if (topics[type].len != len || memcmp(topics[type].str, str, len)) {
+		return AWS_IOT_SHADOW_TOPIC_UNKNOWN;
 	}
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_UPDATE_ACCEPTED_SUBSCRIBE)
-	err = snprintf(update_accepted_topic, sizeof(update_accepted_topic),
-		       UPDATE_ACCEPTED_TOPIC, client_id_buf);
-	if (err >= UPDATE_ACCEPTED_TOPIC_LEN) {
-		return -ENOMEM;
+
+	return type;
+}
+
+static bool message_id_inflight(uint16_t message_id)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(inflight_ids); i++) {
+		if (inflight_ids[i] == message_id) {
+			return true;
+		}
 	}
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_UPDATE_REJECTED_SUBSCRIBE)
-	err = snprintf(update_rejected_topic, sizeof(update_rejected_topic),
-		       UPDATE_REJECTED_TOPIC, client_id_buf);
-	if (err >= UPDATE_REJECTED_TOPIC_LEN) {
-		return -ENOMEM;
+
+	return false;
+}
+
+/* Track the message ID until it is acknowledged. If message_id is 0, the
+ * next ID that is not in flight is allocated. Returns the message ID,
+ * -EBUSY if the given ID is already in flight, or -EINVAL if it is above
+ * MESSAGE_ID_MAX.
+ */
+static int message_id_track(uint16_t message_id)
+{
+	k_spinlock_key_t key;
+	int ret;
+
+	if (message_id > MESSAGE_ID_MAX) {
+		return -EINVAL;
 	}
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_UPDATE_DELTA_SUBSCRIBE)
-	err = snprintf(update_delta_topic, sizeof(update_delta_topic),
-		       UPDATE_DELTA_TOPIC, client_id_buf);
-	if (err >= UPDATE_DELTA_TOPIC_LEN) {
-		return -ENOMEM;
+
+	key = k_spin_lock(&message_id_lock);
+
+	if (message_id == 0) {
+		do {
+			if (last_message_id >= MESSAGE_ID_ALLOC_MAX) {
+				last_message_id = 0;
+			}
+
+			last_message_id++;
+		} while (message_id_inflight(last_message_id));
+
+		message_id = last_message_id;
+	} else if (message_id_inflight(message_id)) {
+		k_spin_unlock(&message_id_lock, key);
+		return -EBUSY;
 	}
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_DELETE_ACCEPTED_SUBSCRIBE)
-	err = snprintf(delete_accepted_topic, sizeof(delete_accepted_topic),
-		       DELETE_ACCEPTED_TOPIC, client_id_buf);
-	if (err >= DELETE_ACCEPTED_TOPIC_LEN) {
-		return -ENOMEM;
+
+	ret = message_id;
+
+	for (size_t i = 0; i < ARRAY_SIZE(inflight_ids); i++) {
+		if (inflight_ids[i] == 0) {
+			inflight_ids[i] = message_id;
+			message_id = 0;
+			break;
+		}
 	}
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_DELETE_REJECTED_SUBSCRIBE)
-	err = snprintf(delete_rejected_topic, sizeof(delete_rejected_topic),
-		       DELETE_REJECTED_TOPIC, client_id_buf);
-	if (err >= DELETE_REJECTED_TOPIC_LEN) {
-		return -ENOMEM;
+
+	k_spin_unlock(&message_id_lock, key);
+
+	if (message_id != 0) {
+		/* Allocated IDs are still unique until the counter wraps */
+		LOG_DBG("No room to track message ID %d", message_id);
 	}
-#endif
-	return 0;
+
+	return ret;
 }
 
-/** Returns the number of topics subscribed to (0 or greater),
-  * or a negative error code. */
-static int topic_subscribe(void)
+static void message_id_release(uint16_t message_id)
 {
-	int err;
-	const struct mqtt_topic aws_iot_rx_list[] = {
-#if defined(CONFIG_AWS_IOT_TOPIC_GET_ACCEPTED_SUBSCRIBE)
-		{
-			.topic = {
-				.utf8 = get_accepted_topic,
-				.size = strlen(get_accepted_topic)
-			},
-			.qos = MQTT_QOS_1_AT_LEAST_ONCE
-		},
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_GET_REJECTED_SUBSCRIBE)
-		{
-			.topic = {
-				.utf8 = get_rejected_topic,
-				.size = strlen(get_rejected_topic)
-			},
-			.qos = MQTT_QOS_1_AT_LEAST_ONCE
-		},
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_UPDATE_ACCEPTED_SUBSCRIBE)
-		{
-			.topic = {
-				.utf8 = update_accepted_topic,
-				.size = strlen(update_accepted_topic)
-			},
-			.qos = MQTT_QOS_1_AT_LEAST_ONCE
-		},
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_UPDATE_REJECTED_SUBSCRIBE)
-		{
-			.topic = {
-				.utf8 = update_rejected_topic,
-				.size = strlen(update_rejected_topic)
-			},
-			.qos = MQTT_QOS_1_AT_LEAST_ONCE
-		},
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_UPDATE_DELTA_SUBSCRIBE)
-		{
-			.topic = {
-				.utf8 = update_delta_topic,
-				.size = strlen(update_delta_topic)
-			},
-			.qos = MQTT_QOS_1_AT_LEAST_ONCE
-		},
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_DELETE_ACCEPTED_SUBSCRIBE)
-		{
-			.topic = {
-				.utf8 = delete_accepted_topic,
-				.size = strlen(delete_accepted_topic)
-			},
-			.qos = MQTT_QOS_1_AT_LEAST_ONCE
-		},
-#endif
-#if defined(CONFIG_AWS_IOT_TOPIC_DELETE_REJECTED_SUBSCRIBE)
-		{
-			.topic = {
-				.utf8 = delete_rejected_topic,
-				.size = strlen(delete_rejected_topic)
-			},
-			.qos = MQTT_QOS_1_AT_LEAST_ONCE
-		},
-#endif
-	};
+	k_spinlock_key_t key = k_spin_lock(&message_id_lock);
+
+	for (size_t i = 0; i < ARRAY_SIZE(inflight_ids); i++) {
+		if (inflight_ids[i] == message_id) {
+			inflight_ids[i] = 0;
+			break;
+		}
+	}
+
+	k_spin_unlock(&message_id_lock, key);
+}
+
+static void message_id_release_all(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&message_id_lock);
+
+	memset(inflight_ids, 0, sizeof(inflight_ids));
+
+	k_spin_unlock(&message_id_lock, key);
+}
+
+/* FNV-1a hash of a topic, never 0 */
+static uint32_t topic_hash(const struct mqtt_utf8 *topic)
+{
+	uint32_t hash = 2166136261U;
+
+	for (size_t i = 0; i < topic->size; i++) {
+		hash = (hash ^ topic->utf8[i]) * 16777619U;
+	}
 
-	if (app_topic_data.list_count > 0) {
-		const struct mqtt_subscription_list app_sub_list = {
-			.list = app_topic_data.list,
-			.list_count = app_topic_data.list_count,
-			.message_id = k_cycle_get_32()
-		};
+	return hash ? hash : 1;
+}
 
-		for (size_t i = 0; i < app_sub_list.list_count; i++) {
-			LOG_DBG("Subscribing to application topic: %s",
-				log_strdup(app_sub_list.list[i].topic.utf8));
+/* Get the topic of subscription i. Returns false if the topic is not
+ * subscribed to.
+ */
+static bool subscription_topic_get(size_t i, struct mqtt_topic *topic)
+{
+	if (i < SHADOW_TOPIC_COUNT) {
+		if (!shadow_topics[i].subscribe) {
+			return false;
 		}
 
-		err = mqtt_subscribe(&client, &app_sub_list);
-		if (err) {
-			LOG_ERR("Application topics subscribe, error: %d", err);
+		topic->topic.utf8 = topics[i].str;
+		topic->topic.size = topics[i].len;
+		topic->qos = MQTT_QOS_1_AT_LEAST_ONCE;
+		return true;
+	}
+
+	i -= SHADOW_TOPIC_COUNT;
+	if (i >= app_topic_data.list_count) {
+		return false;
+	}
+
+	*topic = app_topic_data.list[i];
+	return true;
+}
+
+/* Forget the subscriptions, for a new session. */
+static void subscriptions_reset(void)
+{
+	memset(subscriptions, 0, sizeof(subscriptions));
+}
+
+/* Release the message IDs of SUBSCRIBE messages that will not be
+ * acknowledged, because the connection they were sent on is gone.
+ */
+static void subscriptions_pending_release(void)
+{
+	for (size_t i = 0; i < SUBSCRIPTION_COUNT; i++) {
+		if (subscriptions[i].message_id != 0) {
+			message_id_release(subscriptions[i].message_id);
+			subscriptions[i].message_id = 0;
 		}
 	}
+}
+
+/* Subscribe to the topics of subscriptions first to last - 1 that the broker
+ * has not confirmed, in one SUBSCRIBE message. Returns the number of topics
+ * subscribed to, or a negative error code.
+ */
+static int subscriptions_send(size_t first, size_t last)
+{
+	struct mqtt_topic list[SUBSCRIPTION_COUNT];
+	struct mqtt_subscription_list sub_list = {
+		.list = list,
+		.message_id = message_id_track(0)
+	};
+	int err;
 
-	if (ARRAY_SIZE(aws_iot_rx_list) > 0) {
-		const struct mqtt_subscription_list aws_sub_list = {
-			.list = (struct mqtt_topic *)&aws_iot_rx_list,
-			.list_count = ARRAY_SIZE(aws_iot_rx_list),
-			.message_id = k_cycle_get_32()
-		};
+	for (size_t i = first; i < last; i++) {
+		struct mqtt_topic *topic = &list[sub_list.list_count];
 
-		for (size_t i = 0; i < aws_sub_list.list_count; i++) {
-			LOG_DBG("Subscribing to AWS shadow topic: %s",
-				log_strdup(aws_sub_list.list[i].topic.utf8));
+		if (!subscription_topic_get(i, topic)) {
+			continue;
 		}
 
-		err = mqtt_subscribe(&client, &aws_sub_list);
-		if (err) {
-			LOG_ERR("AWS shadow topics subscribe, error: %d", err);
+		if (subscriptions[i].hash == topic_hash(&topic->topic)) {
+			LOG_DBG("Already subscribed to topic: %s",
+				log_strdup(topic->topic.utf8));
+			connect_stats.skipped++;
+			continue;
 		}
+
+		LOG_DBG("Subscribing to topic: %s",
+			log_strdup(topic->topic.utf8));
+
+		subscriptions[i].hash = 0;
+		subscriptions[i].message_id = sub_list.message_id;
+		sub_list.list_count++;
 	}
 
-	if (err < 0) {
+	if (sub_list.list_count == 0) {
+		message_id_release(sub_list.message_id);
+		return 0;
+	}
+
+	err = mqtt_subscribe(&client, &sub_list);
+	if (err) {
+		LOG_ERR("Subscribe, error: %d", err);
+
+		for (size_t i = first; i < last; i++) {
+			if (subscriptions[i].message_id ==
+			    sub_list.message_id) {
+				subscriptions[i].message_id = 0;
+			}
+		}
+
+		message_id_release(sub_list.message_id);
 		return err;
 	}
-	return app_topic_data.list_count + ARRAY_SIZE(aws_iot_rx_list);
+
+	connect_stats.subscribed += sub_list.list_count;
+
+	return sub_list.list_count;
+}
+
+/* Returns the number of topics subscribed to (0 or greater),
+ * or a negative error code.
+ */
+static int topic_subscribe(void)
+{
+	int app_count;
+	int shadow_count;
+
+	app_count = subscriptions_send(SHADOW_TOPIC_COUNT, SUBSCRIPTION_COUNT);
+	if (app_count < 0) {
+		return app_count;
+	}
+
+	shadow_count = subscriptions_send(0, SHADOW_TOPIC_COUNT);
+	if (shadow_count < 0) {
+		return shadow_count;
+	}
+
+	return app_count + shadow_count;
+}
+
+/* Record the topics confirmed by a SUBACK. Returns true if no more SUBACKs
+ * are expected.
+ */
+static bool subscriptions_ack(const struct mqtt_suback_param *suback)
+{
+	size_t code = 0;
+	bool pending = false;
+	bool acked = false;
+
+	for (size_t i = 0; i < SUBSCRIPTION_COUNT; i++) {
+		struct mqtt_topic topic;
+
+		if (subscriptions[i].message_id != suback->message_id) {
+			pending |= (subscriptions[i].message_id != 0);
+			continue;
+		}
+
+		subscriptions[i].message_id = 0;
+		acked = true;
+
+		if ((code >= suback->return_codes.len) ||
+		    (suback->return_codes.data[code++] ==
+		     MQTT_SUBACK_FAILURE) ||
+		    !subscription_topic_get(i, &topic)) {
+			LOG_WRN("Subscription %d not confirmed", i);
+			continue;
+		}
+
+		subscriptions[i].hash = topic_hash(&topic.topic);
+	}
+
+	return acked && !pending;
+}
+
+static void ready_notify(void)
+{
+	const struct aws_iot_evt aws_iot_evt = {
+		.type = AWS_IOT_EVT_READY
+	};
+
+	connect_stats.ready_ms = k_uptime_get() - connect_start;
+	aws_iot_notify_event(&aws_iot_evt);
 }
 
 static int publish_get_payload(struct mqtt_client *const c, size_t length)
@@ -585,29 +867,40 @@ static void mqtt_evt_handler(struct mqtt_client *const c,
 		aws_iot_evt.data.persistent_session =
 				   !IS_ENABLED(CONFIG_MQTT_CLEAN_SESSION) &&
 				   mqtt_evt->param.connack.session_present_flag;
+
+		connect_stats.connack_ms = k_uptime_get() - connect_start;
+		connect_stats.persistent_session =
+					aws_iot_evt.data.persistent_session;
+
 		aws_iot_evt.type = AWS_IOT_EVT_CONNECTED;
 		aws_iot_notify_event(&aws_iot_evt);
 
+		/* Acknowledgments of the previous connection are lost, also
+		 * in a resumed session, because messages are not sent again.
+		 */
+		subscriptions_pending_release();
+		message_id_release_all();
+
 		if (!mqtt_evt->param.connack.session_present_flag) {
-			err = topic_subscribe();
+			subscriptions_reset();
+		}
 
-			if (err < 0) {
-				aws_iot_evt.type = AWS_IOT_EVT_ERROR;
-				aws_iot_evt.data.err = err;
-				aws_iot_notify_event(&aws_iot_evt);
-				break;
-			}
-			if (err == 0) {
-				/* There were not topics to subscribe to. */
-				aws_iot_evt.type = AWS_IOT_EVT_READY;
-				aws_iot_notify_event(&aws_iot_evt);
-			} /* else: wait for SUBACK */
-		} else {
-			/** pre-existing session:
-			  * subscription is already established */
-			aws_iot_evt.type = AWS_IOT_EVT_READY;
+		/* Only topics that are not confirmed in the session. The
+		 * topics of a session resumed from before a reset are not
+		 * known, and are subscribed to again.
+		 */
+		err = topic_subscribe();
+
+		if (err < 0) {
+			aws_iot_evt.type = AWS_IOT_EVT_ERROR;
+			aws_iot_evt.data.err = err;
 			aws_iot_notify_event(&aws_iot_evt);
+			break;
 		}
+		if (err == 0) {
+			/* There were no topics to subscribe to. */
+			ready_notify();
+		} /* else: wait for SUBACK */
 		break;
 	case MQTT_EVT_DISCONNECT:
 		LOG_DBG("MQTT_EVT_DISCONNECT: result = %d", mqtt_evt->result);
@@ -654,7 +947,9 @@ static void mqtt_evt_handler(struct mqtt_client *const c,
 		aws_iot_evt.type = AWS_IOT_EVT_DATA_RECEIVED;
 		aws_iot_evt.data.msg.ptr = payload_buf;
 		aws_iot_evt.data.msg.len = p->message.payload.len;
-		aws_iot_evt.data.msg.topic.type = AWS_IOT_SHADOW_TOPIC_UNKNOWN;
+		aws_iot_evt.data.msg.topic.type =
+			topic_type_get(p->message.topic.topic.utf8,
+				       p->message.topic.topic.size);
 		aws_iot_evt.data.msg.topic.str = p->message.topic.topic.utf8;
 		aws_iot_evt.data.msg.topic.len = p->message.topic.topic.size;
 
@@ -664,14 +959,22 @@ static void mqtt_evt_handler(struct mqtt_client *const c,
 		LOG_DBG("MQTT_EVT_PUBACK: id = %d result = %d",
 			mqtt_evt->param.puback.message_id,
 			mqtt_evt->result);
+		message_id_release(mqtt_evt->param.puback.message_id);
+
+		aws_iot_evt.type = AWS_IOT_EVT_PUBACK;
+		aws_iot_evt.data.message_id = mqtt_evt->param.puback.message_id;
+		aws_iot_notify_event(&aws_iot_evt);
 		break;
 	case MQTT_EVT_SUBACK:
 		LOG_DBG("MQTT_EVT_SUBACK: id = %d result = %d",
 			mqtt_evt->param.suback.message_id,
 			mqtt_evt->result);
-		/* MQTT subscription established. */
-		aws_iot_evt.type = AWS_IOT_EVT_READY;
-		aws_iot_notify_event(&aws_iot_evt);
+		message_id_release(mqtt_evt->param.suback.message_id);
+
+		/* Ready when all subscriptions are established. */
+		if (subscriptions_ack(&mqtt_evt->param.suback)) {
+			ready_notify();
+		}
 		break;
 	default:
 		break;
@@ -681,10 +984,11 @@ static void mqtt_evt_handler(struct mqtt_client *const c,
 #if !defined(CONFIG_BSD_LIBRARY)
 static int certificates_provision(void)
 {
+#if defined(CONFIG_NET_SOCKETS_SOCKOPT_TLS)
 	static bool certs_added;
 	int err;
 
-	if (!IS_ENABLED(CONFIG_NET_SOCKETS_SOCKOPT_TLS) || certs_added) {
+	if (certs_added) {
 		return 0;
 	}
 
@@ -717,6 +1021,7 @@ static int certificates_provision(void)
 	}
 
 	certs_added = true;
+#endif /* defined(CONFIG_NET_SOCKETS_SOCKOPT_TLS) */
 
 	return 0;
 }
@@ -729,7 +1034,7 @@ static int broker_init(void)
 		((struct sockaddr_in *)&broker);
 
 	inet_pton(AF_INET, CONFIG_AWS_IOT_STATIC_IPV4_ADDR,
-		  &broker->sin_addr);
+		  &broker4->sin_addr);
 	broker4->sin_family = AF_INET;
 	broker4->sin_port = htons(CONFIG_AWS_IOT_PORT);
 
@@ -822,7 +1127,7 @@ static int client_broker_init(struct mqtt_client *const client)
 	client->broker			= &broker;
 	client->evt_cb			= mqtt_evt_handler;
 	client->client_id.utf8		= (char *)client_id_buf;
-	client->client_id.size		= strlen(client_id_buf);
+	client->client_id.size		= client_id_len;
 	client->password		= NULL;
 	client->user_name		= NULL;
 	client->protocol_version	= MQTT_VERSION_3_1_1;
@@ -860,6 +1165,17 @@ static int client_broker_init(struct mqtt_client *const client)
 	return err;
 }
 
+static void connect_stats_start(void)
+{
+	memset(&connect_stats, 0, sizeof(connect_stats));
+	connect_start = k_uptime_get();
+}
+
+static void connect_stats_handshake_done(void)
+{
+	connect_stats.handshake_ms = k_uptime_get() - connect_start;
+}
+
 static int connection_poll_start(void)
 {
 	if (atomic_get(&connection_poll_active)) {
@@ -896,35 +1212,27 @@ int aws_iot_send(const struct aws_iot_data *const tx_data)
 		.qos	    = tx_data->qos,
 		.topic.type = tx_data->topic.type,
 		.topic.str  = tx_data->topic.str,
-		.topic.len  = tx_data->topic.len
+		.topic.len  = tx_data->topic.len,
+		.message_id = tx_data->message_id
 	};
+	int err;
 
 	switch (tx_data_pub.topic.type) {
 #if defined(CONFIG_CLOUD_API)
 	case CLOUD_EP_STATE_GET:
-		tx_data_pub.topic.str = get_topic;
-		tx_data_pub.topic.len = strlen(get_topic);
+		tx_data_pub.topic = topics[AWS_IOT_SHADOW_TOPIC_GET];
 		break;
 	case CLOUD_EP_STATE:
-		tx_data_pub.topic.str = update_topic;
-		tx_data_pub.topic.len = strlen(update_topic);
+		tx_data_pub.topic = topics[AWS_IOT_SHADOW_TOPIC_UPDATE];
 		break;
 	case CLOUD_EP_STATE_DELETE:
-		tx_data_pub.topic.str = delete_topic;
-		tx_data_pub.topic.len = strlen(delete_topic);
+		tx_data_pub.topic = topics[AWS_IOT_SHADOW_TOPIC_DELETE];
 		break;
 #else
 	case AWS_IOT_SHADOW_TOPIC_GET:
-		tx_data_pub.topic.str = get_topic;
-		tx_data_pub.topic.len = strlen(get_topic);
-		break;
 	case AWS_IOT_SHADOW_TOPIC_UPDATE:
-		tx_data_pub.topic.str = update_topic;
-		tx_data_pub.topic.len = strlen(update_topic);
-		break;
 	case AWS_IOT_SHADOW_TOPIC_DELETE:
-		tx_data_pub.topic.str = delete_topic;
-		tx_data_pub.topic.len = strlen(delete_topic);
+		tx_data_pub.topic = topics[tx_data_pub.topic.type];
 		break;
 #endif
 	default:
@@ -936,6 +1244,17 @@ int aws_iot_send(const struct aws_iot_data *const tx_data)
 		break;
 	}
 
+	if (tx_data_pub.qos != MQTT_QOS_0_AT_MOST_ONCE) {
+		err = message_id_track(tx_data_pub.message_id);
+		if (err < 0) {
+			LOG_ERR("Message ID %d is in use or reserved",
+				tx_data_pub.message_id);
+			return err;
+		}
+
+		tx_data_pub.message_id = err;
+	}
+
 	struct mqtt_publish_param param;
 
 	param.message.topic.qos		= tx_data_pub.qos;
@@ -943,14 +1262,19 @@ int aws_iot_send(const struct aws_iot_data *const tx_data)
 	param.message.topic.topic.size	= tx_data_pub.topic.len;
 	param.message.payload.data	= tx_data_pub.ptr;
 	param.message.payload.len	= tx_data_pub.len;
-	param.message_id		= k_cycle_get_32();
+	param.message_id		= tx_data_pub.message_id;
 	param.dup_flag			= 0;
 	param.retain_flag		= 0;
 
 	LOG_DBG("Publishing to topic: %s",
 		log_strdup(param.message.topic.topic.utf8));
 
-	return mqtt_publish(&client, &param);
+	err = mqtt_publish(&client, &param);
+	if (err && tx_data_pub.qos != MQTT_QOS_0_AT_MOST_ONCE) {
+		message_id_release(tx_data_pub.message_id);
+	}
+
+	return err;
 }
 
 int aws_iot_disconnect(void)
@@ -967,6 +1291,7 @@ int aws_iot_connect(struct aws_iot_config *const config)
 		err = connection_poll_start();
 	} else {
 		atomic_set(&disconnect_requested, 0);
+		connect_stats_start();
 
 		err = client_broker_init(&client);
 		if (err) {
@@ -979,6 +1304,8 @@ int aws_iot_connect(struct aws_iot_config *const config)
 			LOG_ERR("mqtt_connect, error: %d", err);
 		}
 
+		connect_stats_handshake_done();
+
 		err = connect_error_translate(err);
 
 		if (err == 0) {
@@ -991,6 +1318,17 @@ int aws_iot_connect(struct aws_iot_config *const config)
 	return err;
 }
 
+int aws_iot_connect_stats_get(struct aws_iot_connect_stats *const stats)
+{
+	if (connect_start < 0) {
+		return -ENODATA;
+	}
+
+	*stats = connect_stats;
+
+	return 0;
+}
+
 int aws_iot_subscription_topics_add(
 			const struct aws_iot_topic_data *const topic_list,
 			size_t list_count)
@@ -1039,6 +1377,9 @@ int aws_iot_init(const struct aws_iot_config *const config,
 		return err;
 	}
 
+	/* The session on the broker belongs to the client ID */
+	subscriptions_reset();
+
 #if defined(CONFIG_AWS_FOTA)
 	err = aws_fota_init(&client, aws_fota_cb_handler);
 	if (err) {
@@ -1070,6 +1411,8 @@ start:
 	aws_iot_evt.type = AWS_IOT_EVT_CONNECTING;
 	aws_iot_notify_event(&aws_iot_evt);
 
+	connect_stats_start();
+
 	err = client_broker_init(&client);
 	if (err) {
 		LOG_ERR("client_broker_init, error: %d", err);
@@ -1080,6 +1423,8 @@ start:
 		LOG_ERR("mqtt_connect, error: %d", err);
 	}
 
+	connect_stats_handshake_done();
+
 	err = connect_error_translate(err);
 
 	if (err != AWS_IOT_CONNECT_RES_SUCCESS) {
@@ -1229,7 +1574,8 @@ static int api_send(const struct cloud_backend *const backend,
 		.qos = msg->qos,
 		.topic.str = msg->endpoint.str,
 		.topic.len = msg->endpoint.len,
-		.topic.type = msg->endpoint.type
+		.topic.type = msg->endpoint.type,
+		.message_id = msg->message_id
 	};
 
 	return aws_iot_send(&tx_data);
@@ -275,6 +275,33 @@ int aws_jobs_update_job_execution(struct mqtt_client *const client,
 
 }
 
+const char *aws_jobs_status_str(enum execution_status status)
+{
+	if ((unsigned int)status >= ARRAY_SIZE(execution_status_strings)) {
+		return NULL;
+	}
+
+	return execution_status_strings[status];
+}
+
+int aws_jobs_status_parse(const char *str, size_t len,
+			  enum execution_status *status)
+{
+	if (str == NULL || status == NULL) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(execution_status_strings); i++) {
+		if (strlen(execution_status_strings[i]) == len &&
+		    strncmp(execution_status_strings[i], str, len) == 0) {
+			*status = i;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
 #define JOB_ID_GET_PAYLOAD "{\"clientToken\": \"\"}"
 int aws_jobs_get_job_execution(struct mqtt_client *const client,
 			       const char *job_id, uint8_t *topic_buf)
@@ -0,0 +1,928 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <json_tok.h>
+#include <net/mqtt.h>
+#include <net/mqtt_topic_trie.h>
+#include <net/aws_jobs.h>
+#include <net/aws_jobs_exec.h>
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(aws_jobs_exec, CONFIG_AWS_JOBS_LOG_LEVEL);
+
+enum topic_type {
+	TOPIC_NOTIFY_NEXT,
+	TOPIC_NOTIFY,
+	TOPIC_PENDING,
+	TOPIC_GET,
+	TOPIC_UPDATE,
+};
+
+/* Topic filters, indexed by topic type. The thing name is matched by the
+ * first '+', and replaced by the client ID when subscribing. The job ID and
+ * the response type are matched by the ones after it.
+ */
+static const char *const topic_filters[] = {
+	[TOPIC_NOTIFY_NEXT] = AWS "+/jobs/notify-next",
+	[TOPIC_NOTIFY] = AWS "+/jobs/notify",
+	[TOPIC_PENDING] = AWS "+/jobs/get/+",
+	[TOPIC_GET] = AWS "+/jobs/+/get/+",
+	[TOPIC_UPDATE] = AWS "+/jobs/+/update/+",
+};
+
+/* Large enough for the topic levels of all filters */
+MQTT_TOPIC_TRIE_DEFINE(topic_trie, 24);
+
+#define UPDATE_PAYLOAD "{\"status\":\"%s\"%s%s,\"expectedVersion\":%d," \
+		       "\"clientToken\":\"%u-%d\"}"
+#define PROGRESS_DETAILS "{\"progress\":\"%d\"}"
+#define GET_PAYLOAD "{\"clientToken\":\"\"}"
+
+/* The subscription takes the first message ID of the engine, and the
+ * publications take the others in turn. There are more of them than
+ * requests and updates that can be in flight.
+ */
+#define SUBSCRIBE_ID AWS_JOBS_EXEC_MESSAGE_ID_FIRST
+
+BUILD_ASSERT(CONFIG_AWS_JOBS_EXEC_JOBS_MAX *
+	     (CONFIG_AWS_JOBS_EXEC_PIPELINE_DEPTH + 1) + 2 <
+	     AWS_JOBS_EXEC_MESSAGE_ID_LAST - SUBSCRIBE_ID,
+	     "Not enough message IDs for the requests in flight");
+
+struct job_slot {
+	struct aws_jobs_exec_job job;
+	/* Order in which the jobs were received, 0 for a free slot */
+	uint32_t seq;
+	/* Status and status details to report */
+	enum execution_status status;
+	char details[CONFIG_AWS_JOBS_EXEC_DETAILS_MAX_LEN];
+	/* The status or the status details changed since they were sent */
+	bool dirty;
+	/* Waiting for the job execution to be read from AWS IoT */
+	bool resync;
+	/* The job has been announced with AWS_JOBS_EXEC_EVT_JOB */
+	bool started;
+	/* Incremented when the updates in flight are given up, so that late
+	 * responses to them are told apart by their client token.
+	 */
+	uint8_t gen;
+	/* Statuses of the updates waiting for a response, oldest first. The
+	 * first one was sent with the version of the job as expected version,
+	 * the next one with the version after it, and so on.
+	 */
+	enum execution_status in_flight[CONFIG_AWS_JOBS_EXEC_PIPELINE_DEPTH];
+	size_t in_flight_count;
+	/* Uptime when status details were last sent without a status change */
+	int64_t details_sent;
+};
+
+static struct job_slot slots[CONFIG_AWS_JOBS_EXEC_JOBS_MAX];
+static uint32_t seq_last;
+
+static struct mqtt_client *c;
+static aws_jobs_exec_evt_handler_t evt_handler;
+static bool connected;
+static bool initialized;
+static uint16_t message_id;
+
+static uint8_t payload_buf[CONFIG_AWS_JOBS_EXEC_PAYLOAD_SIZE];
+static char update_buf[CONFIG_AWS_JOBS_EXEC_DETAILS_MAX_LEN + 96];
+static uint8_t topic_buf[AWS_JOBS_TOPIC_MAX_LEN];
+
+static struct k_delayed_work flush_work;
+static K_MUTEX_DEFINE(exec_lock);
+
+static uint16_t message_id_next(void)
+{
+	if ((message_id <= SUBSCRIBE_ID) ||
+	    (message_id >= AWS_JOBS_EXEC_MESSAGE_ID_LAST)) {
+		message_id = SUBSCRIBE_ID;
+	}
+
+	return ++message_id;
+}
+
+static bool status_final(enum execution_status status)
+{
+	return status > AWS_JOBS_IN_PROGRESS;
+}
+
+static bool capture_eq(const struct mqtt_topic_trie_capture *capture,
+		       const char *str)
+{
+	return (strlen(str) == capture->len) &&
+	       (memcmp(capture->ptr, str, capture->len) == 0);
+}
+
+static struct job_slot *job_find(const char *id, size_t len)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		if ((slots[i].seq != 0) &&
+		    (strlen(slots[i].job.id) == len) &&
+		    (memcmp(slots[i].job.id, id, len) == 0)) {
+			return &slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+static size_t job_free_count(void)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		count += (slots[i].seq == 0);
+	}
+
+	return count;
+}
+
+static void evt_notify(enum aws_jobs_exec_evt_type type,
+		       struct job_slot *slot, enum execution_status status)
+{
+	const struct aws_jobs_exec_evt evt = {
+		.type = type,
+		.job = &slot->job,
+		.status = status,
+	};
+
+	evt_handler(&evt);
+}
+
+/* Request a job execution, the next one for "$next", or the list of pending
+ * job executions for "".
+ */
+static int job_get(const char *id)
+{
+	struct mqtt_publish_param param = {
+		.message.topic.qos = MQTT_QOS_1_AT_LEAST_ONCE,
+		.message.payload.data = (uint8_t *)GET_PAYLOAD,
+		.message.payload.len = sizeof(GET_PAYLOAD) - 1,
+	};
+	int len;
+	int err;
+
+	len = snprintf(topic_buf, sizeof(topic_buf), AWS "%.*s/jobs/%s%sget",
+		       (int)c->client_id.size, c->client_id.utf8, id,
+		       id[0] ? "/" : "");
+	if (len >= sizeof(topic_buf)) {
+		return -ENOMEM;
+	}
+
+	param.message.topic.topic.utf8 = topic_buf;
+	param.message.topic.topic.size = len;
+	param.message_id = message_id_next();
+
+	err = mqtt_publish(c, &param);
+	if (err) {
+		LOG_ERR("Failed to request job execution, error: %d", err);
+	}
+
+	return err;
+}
+
+static int update_send(struct job_slot *slot)
+{
+	int version = slot->job.version + slot->in_flight_count;
+	struct mqtt_publish_param param = {
+		.message.topic.qos = MQTT_QOS_1_AT_LEAST_ONCE,
+	};
+	int len;
+
+	len = snprintf(topic_buf, sizeof(topic_buf),
+		       AWS "%.*s/jobs/%s/update", (int)c->client_id.size,
+		       c->client_id.utf8, slot->job.id);
+	if (len >= sizeof(topic_buf)) {
+		return -ENOMEM;
+	}
+
+	param.message.topic.topic.utf8 = topic_buf;
+	param.message.topic.topic.size = len;
+
+	len = snprintf(update_buf, sizeof(update_buf), UPDATE_PAYLOAD,
+		       aws_jobs_status_str(slot->status),
+		       slot->details[0] ? ",\"statusDetails\":" : "",
+		       slot->details, version, slot->gen, version);
+	if (len >= sizeof(update_buf)) {
+		return -ENOMEM;
+	}
+
+	param.message.payload.data = update_buf;
+	param.message.payload.len = len;
+
+	param.message_id = message_id_next();
+
+	LOG_DBG("Update %s: %s", log_strdup(slot->job.id),
+		log_strdup(update_buf));
+
+	return mqtt_publish(c, &param);
+}
+
+/* Send the status of a job if it changed, unless the updates in flight fill
+ * the pipeline, or status details were sent too recently.
+ */
+static void job_flush(struct job_slot *slot, int64_t now)
+{
+	enum execution_status last;
+	int err;
+
+	if (!slot->dirty || slot->resync || !connected ||
+	    (slot->in_flight_count == ARRAY_SIZE(slot->in_flight))) {
+		return;
+	}
+
+	last = slot->in_flight_count ?
+	       slot->in_flight[slot->in_flight_count - 1] : slot->job.status;
+
+	if (slot->status == last) {
+		int64_t wait = slot->details_sent - now +
+			       CONFIG_AWS_JOBS_EXEC_PROGRESS_INTERVAL_MS;
+
+		if (wait > 0) {
+			int32_t left = k_delayed_work_remaining_get(&flush_work);
+
+			if ((left == 0) || (left > wait)) {
+				k_delayed_work_submit(&flush_work,
+						      K_MSEC(wait));
+			}
+			return;
+		}
+
+		slot->details_sent = now;
+	}
+
+	err = update_send(slot);
+	if (err) {
+		LOG_ERR("Failed to send job update, error: %d", err);
+		return;
+	}
+
+	slot->in_flight[slot->in_flight_count++] = slot->status;
+	slot->dirty = false;
+}
+
+static void flush_work_fn(struct k_work *work)
+{
+	int64_t now = k_uptime_get();
+
+	k_mutex_lock(&exec_lock, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].seq != 0) {
+			job_flush(&slots[i], now);
+		}
+	}
+
+	k_mutex_unlock(&exec_lock);
+}
+
+/* Announce the oldest job in the queue, unless a job is already running */
+static void job_next_start(void)
+{
+	struct job_slot *next = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].seq == 0) {
+			continue;
+		}
+
+		if (slots[i].started) {
+			return;
+		}
+
+		if ((next == NULL) || (slots[i].seq < next->seq)) {
+			next = &slots[i];
+		}
+	}
+
+	if (next) {
+		next->started = true;
+		evt_notify(AWS_JOBS_EXEC_EVT_JOB, next, next->job.status);
+	}
+}
+
+static void job_remove(struct job_slot *slot)
+{
+	memset(slot, 0, sizeof(*slot));
+
+	job_next_start();
+
+	/* Fetch the jobs that did not fit the queue */
+	if (connected) {
+		(void)job_get("");
+	}
+}
+
+/* Read the version and status from an execution or execution state */
+static int execution_state_read(struct job_slot *slot, const char *json,
+				const struct json_tok *toks, int state)
+{
+	int32_t version;
+	int i;
+
+	i = json_tok_find(json, toks, state, "versionNumber");
+	if ((i < 0) || json_tok_int(json, &toks[i], &version)) {
+		return -ENODATA;
+	}
+
+	i = json_tok_find(json, toks, state, "status");
+	if ((i >= 0) && (toks[i].type == JSON_TOK_STR)) {
+		(void)aws_jobs_status_parse(&json[toks[i].start], toks[i].len,
+					    &slot->job.status);
+	}
+
+	slot->job.version = version;
+
+	return 0;
+}
+
+static void job_add(const char *id, const char *json,
+		    const struct json_tok *toks, int execution)
+{
+	struct job_slot *slot = NULL;
+	int doc = json_tok_find(json, toks, execution, "jobDocument");
+
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].seq == 0) {
+			slot = &slots[i];
+			break;
+		}
+	}
+
+	if (slot == NULL) {
+		LOG_DBG("Job queue full, %s fetched later", log_strdup(id));
+		return;
+	}
+
+	if ((doc < 0) || (toks[doc].type != JSON_TOK_OBJ) ||
+	    (toks[doc].len >= sizeof(slot->job.doc))) {
+		LOG_ERR("Missing or too large job document for %s",
+			log_strdup(id));
+		return;
+	}
+
+	strcpy(slot->job.id, id);
+	memcpy(slot->job.doc, &json[toks[doc].start], toks[doc].len);
+	slot->job.doc[toks[doc].len] = '\0';
+	slot->job.doc_len = toks[doc].len;
+
+	if (execution_state_read(slot, json, toks, execution)) {
+		LOG_ERR("Missing version of job %s", log_strdup(id));
+		memset(slot, 0, sizeof(*slot));
+		return;
+	}
+
+	slot->status = slot->job.status;
+	slot->seq = ++seq_last;
+
+	LOG_DBG("Job %s queued, version %d", log_strdup(id),
+		slot->job.version);
+
+	job_next_start();
+}
+
+/* Handle a job execution, received on notify-next or in response to a
+ * request. Known jobs keep the document they were received with.
+ */
+static void execution_handle(const char *json, const struct json_tok *toks)
+{
+	char id[AWS_JOBS_JOB_ID_MAX_LEN];
+	struct job_slot *slot;
+	int execution;
+	int i;
+
+	execution = json_tok_find(json, toks, 0, "execution");
+	if (execution < 0) {
+		LOG_DBG("No pending job");
+		return;
+	}
+
+	i = json_tok_find(json, toks, execution, "jobId");
+	if ((i < 0) || (json_tok_str(json, &toks[i], id, sizeof(id)) < 0) ||
+	    (toks[i].len >= sizeof(id))) {
+		LOG_ERR("Missing or invalid job ID");
+		return;
+	}
+
+	slot = job_find(id, strlen(id));
+	if (slot == NULL) {
+		job_add(id, json, toks, execution);
+		return;
+	}
+
+	/* The version is only taken over when no update can have changed it
+	 * since the execution was read.
+	 */
+	if (slot->resync ||
+	    ((slot->in_flight_count == 0) && !slot->dirty)) {
+		if (execution_state_read(slot, json, toks, execution) == 0) {
+			slot->resync = false;
+			job_flush(slot, k_uptime_get());
+		}
+	}
+}
+
+/* Fetch the jobs of a list of job execution summaries that are not in the
+ * queue, while there is room for them.
+ */
+static void summaries_handle(const char *json, const struct json_tok *toks,
+			     const char *path, size_t *room)
+{
+	char id[AWS_JOBS_JOB_ID_MAX_LEN];
+	int list = json_tok_find(json, toks, 0, path);
+
+	if ((list < 0) || (toks[list].type != JSON_TOK_ARR)) {
+		return;
+	}
+
+	for (int i = list + 1; (i < toks[list].next) && (*room > 0);
+	     i = toks[i].next) {
+		int id_tok = json_tok_find(json, toks, i, "jobId");
+
+		if ((id_tok < 0) ||
+		    (json_tok_str(json, &toks[id_tok], id, sizeof(id)) < 0) ||
+		    (toks[id_tok].len >= sizeof(id))) {
+			continue;
+		}
+
+		if ((job_find(id, strlen(id)) == NULL) && (job_get(id) == 0)) {
+			(*room)--;
+		}
+	}
+}
+
+/* Read the client token of an update response, as set by update_send() */
+static int token_get(const char *json, const struct json_tok *toks,
+		     uint8_t *gen, int *version)
+{
+	char token[24];
+	char *end;
+	int i = json_tok_find(json, toks, 0, "clientToken");
+
+	if ((i < 0) ||
+	    (json_tok_str(json, &toks[i], token, sizeof(token)) < 0)) {
+		return -ENODATA;
+	}
+
+	*gen = strtoul(token, &end, 10);
+	if (*end != '-') {
+		return -ENODATA;
+	}
+
+	*version = strtol(end + 1, &end, 10);
+	if (*end != '\0') {
+		return -ENODATA;
+	}
+
+	return 0;
+}
+
+static void update_accepted(struct job_slot *slot, const char *json,
+			    const struct json_tok *toks)
+{
+	enum execution_status status;
+	uint8_t gen;
+	int version;
+
+	if (token_get(json, toks, &gen, &version) || (gen != slot->gen) ||
+	    (slot->in_flight_count == 0) || (version != slot->job.version)) {
+		LOG_DBG("Stale update response for %s",
+			log_strdup(slot->job.id));
+		return;
+	}
+
+	status = slot->in_flight[0];
+	slot->in_flight_count--;
+	memmove(&slot->in_flight[0], &slot->in_flight[1],
+		slot->in_flight_count * sizeof(slot->in_flight[0]));
+
+	slot->job.status = status;
+	slot->job.version++;
+
+	evt_notify(AWS_JOBS_EXEC_EVT_ACCEPTED, slot, status);
+
+	if (status_final(status)) {
+		job_remove(slot);
+		return;
+	}
+
+	job_flush(slot, k_uptime_get());
+}
+
+static void update_rejected(struct job_slot *slot, const char *json,
+			    const struct json_tok *toks)
+{
+	enum execution_status status;
+	uint8_t gen;
+	int version;
+	int i;
+
+	if (token_get(json, toks, &gen, &version) || (gen != slot->gen) ||
+	    (version < slot->job.version) ||
+	    (version >= slot->job.version + (int)slot->in_flight_count)) {
+		LOG_DBG("Stale update response for %s",
+			log_strdup(slot->job.id));
+		return;
+	}
+
+	i = json_tok_find(json, toks, 0, "code");
+	if ((i >= 0) && json_tok_eq(json, &toks[i], "VersionMismatch")) {
+		int state = json_tok_find(json, toks, 0, "executionState");
+
+		LOG_DBG("Version mismatch for %s, sending update again",
+			log_strdup(slot->job.id));
+
+		/* The updates after the rejected one were rejected as well */
+		slot->gen++;
+		slot->in_flight_count = 0;
+		slot->dirty = true;
+
+		if ((state >= 0) &&
+		    (execution_state_read(slot, json, toks, state) == 0)) {
+			job_flush(slot, k_uptime_get());
+		} else {
+			slot->resync = true;
+			(void)job_get(slot->job.id);
+		}
+
+		return;
+	}
+
+	status = slot->in_flight[version - slot->job.version];
+
+	LOG_ERR("Update of job %s rejected", log_strdup(slot->job.id));
+
+	evt_notify(AWS_JOBS_EXEC_EVT_REJECTED, slot, status);
+	job_remove(slot);
+}
+
+static void publish_handle(enum topic_type type,
+			   const struct mqtt_topic_trie_match *match,
+			   size_t len)
+{
+	const struct mqtt_topic_trie_capture *result =
+		&match->capture[match->capture_count - 1];
+	const char *json = payload_buf;
+	struct json_tok buf[CONFIG_AWS_JOBS_EXEC_JSON_TOKENS];
+	struct json_tok *toks;
+	struct job_slot *slot = NULL;
+	size_t room;
+	int err;
+
+	if ((type == TOPIC_PENDING) || (type == TOPIC_GET) ||
+	    (type == TOPIC_UPDATE)) {
+		if (!capture_eq(result, "accepted") &&
+		    !capture_eq(result, "rejected")) {
+			return;
+		}
+	}
+
+	err = json_tok_parse_alloc(json, len, buf, ARRAY_SIZE(buf), &toks);
+	if (err < 0) {
+		LOG_ERR("Failed to parse job message, error: %d", err);
+		return;
+	}
+
+	if ((type == TOPIC_GET) || (type == TOPIC_UPDATE)) {
+		slot = job_find(match->capture[1].ptr, match->capture[1].len);
+	}
+
+	switch (type) {
+	case TOPIC_NOTIFY_NEXT:
+		execution_handle(json, toks);
+		break;
+	case TOPIC_NOTIFY:
+		room = job_free_count();
+		summaries_handle(json, toks, "jobs.IN_PROGRESS", &room);
+		summaries_handle(json, toks, "jobs.QUEUED", &room);
+		break;
+	case TOPIC_PENDING:
+		if (capture_eq(result, "accepted")) {
+			room = job_free_count();
+			summaries_handle(json, toks, "inProgressJobs", &room);
+			summaries_handle(json, toks, "queuedJobs", &room);
+		}
+		break;
+	case TOPIC_GET:
+		if (capture_eq(result, "accepted")) {
+			execution_handle(json, toks);
+		} else if (slot) {
+			/* The job no longer exists */
+			LOG_ERR("Job %s not found", log_strdup(slot->job.id));
+			evt_notify(AWS_JOBS_EXEC_EVT_REJECTED, slot,
+				   slot->status);
+			job_remove(slot);
+		}
+		break;
+	case TOPIC_UPDATE:
+		if (slot == NULL) {
+			LOG_DBG("Update response for unknown job");
+		} else if (capture_eq(result, "accepted")) {
+			update_accepted(slot, json, toks);
+		} else {
+			update_rejected(slot, json, toks);
+		}
+		break;
+	}
+
+	json_tok_free(toks, buf);
+}
+
+static int topics_subscribe(void)
+{
+	static char filters[ARRAY_SIZE(topic_filters)][AWS_JOBS_TOPIC_MAX_LEN];
+	struct mqtt_topic topics[ARRAY_SIZE(topic_filters)];
+	const struct mqtt_subscription_list list = {
+		.list = topics,
+		.list_count = ARRAY_SIZE(topics),
+		.message_id = SUBSCRIBE_ID
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(topic_filters); i++) {
+		int len = snprintf(filters[i], sizeof(filters[i]),
+				   AWS "%.*s%s", (int)c->client_id.size,
+				   c->client_id.utf8,
+				   topic_filters[i] + AWS_LEN + 1);
+
+		if (len >= sizeof(filters[i])) {
+			return -ENOMEM;
+		}
+
+		topics[i].topic.utf8 = filters[i];
+		topics[i].topic.size = len;
+		topics[i].qos = MQTT_QOS_1_AT_LEAST_ONCE;
+	}
+
+	return mqtt_subscribe(c, &list);
+}
+
+/* Fetch the next job and the pending jobs, read the version of the jobs
+ * with updates that may have been lost, and send the queued updates.
+ */
+static int requests_send(void)
+{
+	int64_t now = k_uptime_get();
+	int err;
+
+	err = job_get("$next");
+	if (err) {
+		return err;
+	}
+
+	err = job_get("");
+	if (err) {
+		return err;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (slots[i].seq == 0) {
+			continue;
+		}
+
+		if (slots[i].resync) {
+			err = job_get(slots[i].job.id);
+			if (err) {
+				return err;
+			}
+		} else {
+			job_flush(&slots[i], now);
+		}
+	}
+
+	return 0;
+}
+
+static void connected_handle(void)
+{
+	connected = true;
+
+	/* Responses to the updates in flight may have been lost with the
+	 * connection. Their status is sent again once the version is known.
+	 */
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		if ((slots[i].seq != 0) && (slots[i].in_flight_count > 0)) {
+			slots[i].gen++;
+			slots[i].in_flight_count = 0;
+			slots[i].dirty = true;
+			slots[i].resync = true;
+		}
+	}
+}
+
+int aws_jobs_exec_mqtt_evt_handler(struct mqtt_client *const client,
+				   const struct mqtt_evt *evt)
+{
+	int err = 1;
+
+	if ((client == NULL) || (evt == NULL) || (client != c)) {
+		return 1;
+	}
+
+	switch (evt->type) {
+	case MQTT_EVT_CONNACK:
+		if (evt->result != 0) {
+			return 1;
+		}
+
+		k_mutex_lock(&exec_lock, K_FOREVER);
+
+		connected_handle();
+
+		if (IS_ENABLED(CONFIG_MQTT_CLEAN_SESSION) ||
+		    !evt->param.connack.session_present_flag) {
+			err = topics_subscribe();
+			if (err) {
+				LOG_ERR("Failed to subscribe to job topics, "
+					"error: %d", err);
+			}
+		} else {
+			LOG_DBG("Previous session valid;"
+				" skipping job subscriptions");
+			err = requests_send();
+		}
+
+		k_mutex_unlock(&exec_lock);
+
+		/* The application handles the event as well */
+		return err ? err : 1;
+
+	case MQTT_EVT_DISCONNECT:
+		k_mutex_lock(&exec_lock, K_FOREVER);
+		connected = false;
+		k_delayed_work_cancel(&flush_work);
+		k_mutex_unlock(&exec_lock);
+		return 1;
+
+	case MQTT_EVT_SUBACK:
+		if (evt->param.suback.message_id != SUBSCRIBE_ID) {
+			return 1;
+		}
+
+		if (evt->result != 0) {
+			return evt->result;
+		}
+
+		k_mutex_lock(&exec_lock, K_FOREVER);
+		err = requests_send();
+		k_mutex_unlock(&exec_lock);
+
+		return err;
+
+	case MQTT_EVT_PUBACK:
+		/* Requests and updates are tracked by their responses */
+		if (evt->param.puback.message_id <= SUBSCRIBE_ID) {
+			return 1;
+		}
+
+		return 0;
+
+	case MQTT_EVT_PUBLISH: {
+		const struct mqtt_publish_param *p = &evt->param.publish;
+		struct mqtt_topic_trie_match match;
+		int type;
+
+		type = mqtt_topic_trie_match(&topic_trie,
+					     p->message.topic.topic.utf8,
+					     p->message.topic.topic.size,
+					     &match);
+		if ((type < 0) ||
+		    (match.capture[0].len != c->client_id.size) ||
+		    memcmp(match.capture[0].ptr, c->client_id.utf8,
+			   match.capture[0].len)) {
+			return 1;
+		}
+
+		if (p->message.payload.len > sizeof(payload_buf)) {
+			LOG_ERR("Job message too large for payload buffer");
+			return -EMSGSIZE;
+		}
+
+		err = mqtt_readall_publish_payload(client, payload_buf,
+						   p->message.payload.len);
+		if (err) {
+			return err;
+		}
+
+		k_mutex_lock(&exec_lock, K_FOREVER);
+		publish_handle(type, &match, p->message.payload.len);
+		k_mutex_unlock(&exec_lock);
+
+		if (p->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE) {
+			const struct mqtt_puback_param ack = {
+				.message_id = p->message_id
+			};
+
+			err = mqtt_publish_qos1_ack(client, &ack);
+			if (err) {
+				return err;
+			}
+		}
+
+		return 0;
+	}
+
+	default:
+		return 1;
+	}
+}
+
+int aws_jobs_exec_update(const char *job_id, enum execution_status status,
+			 const char *status_details)
+{
+	struct job_slot *slot;
+	size_t len = 0;
+	int err = 0;
+
+	if ((job_id == NULL) || ((status != AWS_JOBS_IN_PROGRESS) &&
+				 (status != AWS_JOBS_SUCCEEDED) &&
+				 (status != AWS_JOBS_FAILED) &&
+				 (status != AWS_JOBS_REJECTED))) {
+		return -EINVAL;
+	}
+
+	if (status_details) {
+		len = strlen(status_details);
+		if (len >= CONFIG_AWS_JOBS_EXEC_DETAILS_MAX_LEN) {
+			return -ENOMEM;
+		}
+	}
+
+	k_mutex_lock(&exec_lock, K_FOREVER);
+
+	slot = job_find(job_id, strlen(job_id));
+	if (slot == NULL) {
+		err = -ENOENT;
+	} else if (status_final(slot->status)) {
+		err = -EINVAL;
+	} else if ((status != slot->status) ||
+		   (status_details && strcmp(status_details, slot->details))) {
+		slot->status = status;
+		if (status_details) {
+			memcpy(slot->details, status_details, len + 1);
+		}
+
+		slot->dirty = true;
+		job_flush(slot, k_uptime_get());
+	}
+
+	k_mutex_unlock(&exec_lock);
+
+	return err;
+}
+
+int aws_jobs_exec_progress(const char *job_id, int progress)
+{
+	char details[sizeof(PROGRESS_DETAILS) + 8];
+
+	snprintf(details, sizeof(details), PROGRESS_DETAILS, progress);
+
+	return aws_jobs_exec_update(job_id, AWS_JOBS_IN_PROGRESS, details);
+}
+
+int aws_jobs_exec_init(struct mqtt_client *const client,
+		       aws_jobs_exec_evt_handler_t handler)
+{
+	int err;
+
+	if ((client == NULL) || (handler == NULL)) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&exec_lock, K_FOREVER);
+
+	if (!initialized) {
+		for (size_t i = 0; i < ARRAY_SIZE(topic_filters); i++) {
+			err = mqtt_topic_trie_add(&topic_trie,
+						  topic_filters[i],
+						  strlen(topic_filters[i]), i);
+			if (err) {
+				LOG_ERR("Failed to add topic filter, error: %d",
+					err);
+				mqtt_topic_trie_clear(&topic_trie);
+				k_mutex_unlock(&exec_lock);
+				return err;
+			}
+		}
+
+		k_delayed_work_init(&flush_work, flush_work_fn);
+		initialized = true;
+	}
+
+	k_delayed_work_cancel(&flush_work);
+	memset(slots, 0, sizeof(slots));
+	c = client;
+	evt_handler = handler;
+	connected = false;
+
+	k_mutex_unlock(&exec_lock);
+
+	return 0;
+}
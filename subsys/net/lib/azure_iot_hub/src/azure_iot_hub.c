@@ -583,7 +583,7 @@ static int broker_init(bool dps)
 		((struct sockaddr_in *)&broker);
 
 	inet_pton(AF_INET, CONFIG_AZURE_IOT_HUB_STATIC_IPV4_ADDR,
-		  &broker->sin_addr);
+		  &broker4->sin_addr);
 	broker4->sin_family = AF_INET;
 	broker4->sin_port = htons(CONFIG_AZURE_IOT_HUB_PORT);
 
@@ -669,10 +669,11 @@ static int broker_init(bool dps)
 #if !defined(CONFIG_BSD_LIBRARY)
 static int certificates_provision(void)
 {
+#if defined(CONFIG_NET_SOCKETS_SOCKOPT_TLS)
 	static bool certs_added;
 	int err;
 
-	if (!IS_ENABLED(CONFIG_NET_SOCKETS_SOCKOPT_TLS) || certs_added) {
+	if (certs_added) {
 		return 0;
 	}
 
@@ -706,6 +707,7 @@ static int certificates_provision(void)
 	}
 
 	certs_added = true;
+#endif /* defined(CONFIG_NET_SOCKETS_SOCKOPT_TLS) */
 
 	return 0;
 }
@@ -56,6 +56,12 @@ static void api_event_handler(struct azure_iot_hub_evt *evt)
 		cloud_notify_event(azure_iot_hub_backend, &cloud_evt,
 				   config->user_data);
 		break;
+	case AZURE_IOT_HUB_EVT_PUBACK:
+		cloud_evt.type = CLOUD_EVT_DATA_SENT;
+		cloud_evt.data.msg.message_id = evt->data.message_id;
+		cloud_notify_event(azure_iot_hub_backend, &cloud_evt,
+				   config->user_data);
+		break;
 	case AZURE_IOT_HUB_EVT_TWIN_RECEIVED:
 		cloud_evt.type = CLOUD_EVT_DATA_RECEIVED;
 		cloud_evt.data.msg.buf = evt->data.msg.ptr;
@@ -168,6 +174,7 @@ static int api_send(const struct cloud_backend *const backend,
 		.qos = msg->qos,
 		.topic.str = msg->endpoint.str,
 		.topic.len = msg->endpoint.len,
+		.message_id = msg->message_id,
 	};
 
 	switch (msg->endpoint.type) {
@@ -9,6 +9,8 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include <net/mqtt_topic_trie.h>
+
 #include "azure_iot_hub_topic.h"
 
 #include <logging/log.h>
@@ -18,44 +20,43 @@ LOG_MODULE_REGISTER(azure_iot_hub_topic, CONFIG_AZURE_IOT_HUB_LOG_LEVEL);
 #define PROP_BAG_STR_EMPTY_VAL	"%s="
 #define PROP_BAG_STR_NO_VAL	"%s"
 
-static char *topic_prefixes[] = {
-	[TOPIC_TYPE_DEVICEBOUND] = TOPIC_PREFIX_DEVICEBOUND,
-	[TOPIC_TYPE_TWIN_UPDATE_DESIRED] = TOPIC_PREFIX_TWIN_DESIRED,
-	[TOPIC_TYPE_TWIN_UPDATE_RESULT] = TOPIC_PREFIX_TWIN_RES,
-	[TOPIC_TYPE_DPS_REG_RESULT] = TOPIC_PREFIX_DPS_REG_RESULT,
-	[TOPIC_TYPE_DIRECT_METHOD] = TOPIC_PREFIX_DIRECT_METHOD,
+/* Topic filters, indexed by topic type. The dynamic value of the topic is
+ * matched by '+', and the property bags by '#'.
+ */
+static const char *const topic_filters[] = {
+	[TOPIC_TYPE_DEVICEBOUND] = TOPIC_PREFIX_DEVICEBOUND
+				   "+/messages/devicebound/#",
+	[TOPIC_TYPE_TWIN_UPDATE_DESIRED] = TOPIC_PREFIX_TWIN_DESIRED "#",
+	[TOPIC_TYPE_TWIN_UPDATE_RESULT] = TOPIC_PREFIX_TWIN_RES "+/#",
+	[TOPIC_TYPE_DPS_REG_RESULT] = TOPIC_PREFIX_DPS_REG_RESULT "+/#",
+	[TOPIC_TYPE_DIRECT_METHOD] = TOPIC_PREFIX_DIRECT_METHOD "+/#",
 };
 
-/* If the topic type is TOPIC_TYPE_DEVICEBOUND, the dynamic value in the
- * topic (the device ID), is placed in the middle of the topic, and
- * the following string needs to be skipped before reaching the property
- * bag part of the topic. This can't be achieved by searching for '?' as
- * the separator indicating start of property bag component, as its not
- * consistently enforced on the cloud side, and the topic may or may not
- * contain '?' as separator.
- */
-#define TOPIC_DEVICE_BOUND_SUFFIX	"messages/devicebound/"
+/* Large enough for the topic levels of all filters */
+MQTT_TOPIC_TRIE_DEFINE(topic_trie, 32);
+static bool topic_trie_ready;
 
-/* Move a pointer forward by the number of bytes corresponding to the
- * prefix length of the relevant topic.
- */
-static inline char *skip_prefix(char *const buf, enum topic_type type)
+static int topic_trie_init(void)
 {
-	return buf + strlen(topic_prefixes[type]);
-}
+	int err;
 
-/* Get the next occurence of a character within a string, where the length
- * of the string to inspect is set by the max argument.
- */
-static inline char *get_next_occurrence(char *str, char c, size_t max)
-{
-	for (size_t i = 0; i < max; i++) {
-		if (str[i] == c) {
-			return &str[i];
+	if (topic_trie_ready) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(topic_filters); i++) {
+		err = mqtt_topic_trie_add(&topic_trie, topic_filters[i],
+					  strlen(topic_filters[i]), i);
+		if (err) {
+			LOG_ERR("Failed to add topic filter, error: %d", err);
+			mqtt_topic_trie_clear(&topic_trie);
+			return err;
 		}
 	}
 
-	return NULL;
+	topic_trie_ready = true;
+
+	return 0;
 }
 
 /* Gets the next property bag, on the format "<key>[=[<value>]]", where '=' and
@@ -164,47 +165,63 @@ static int get_next_prop_bag(char *buf, size_t buf_len,
 	return parsed_len;
 }
 
-enum topic_type topic_type_get(const char *buf, const size_t len)
+static enum topic_type topic_match(const char *buf, const size_t len,
+				   struct mqtt_topic_trie_match *match)
 {
+	int ret;
+
 	if (buf == NULL || len == 0) {
 		return TOPIC_TYPE_EMPTY;
 	}
 
-	for (size_t i = 0; i < ARRAY_SIZE(topic_prefixes); i++) {
-		if (strncmp(topic_prefixes[i], buf,
-			    MIN(strlen(topic_prefixes[i]), len)) == 0) {
-			return i;
-		}
+	if (topic_trie_init()) {
+		return TOPIC_TYPE_UNEXPECTED;
 	}
 
-	return TOPIC_TYPE_UNEXPECTED;
+	ret = mqtt_topic_trie_match(&topic_trie, buf, len, match);
+	if (ret < 0) {
+		return TOPIC_TYPE_UNEXPECTED;
+	}
+
+	return ret;
+}
+
+enum topic_type topic_type_get(const char *buf, const size_t len)
+{
+	return topic_match(buf, len, NULL);
 }
 
 int azure_iot_hub_topic_parse(struct topic_parser_data *const data)
 {
-	char *start_ptr, *stop_ptr;
-	const char *max_ptr = data->topic + data->topic_len;
-	size_t len;
+	struct mqtt_topic_trie_match match;
+	const struct mqtt_topic_trie_capture *prop_bags;
+	enum topic_type type;
+	char *start_ptr;
+	const char *max_ptr;
 
 	if (!data->topic || (data->topic_len == 0)) {
 		return -EINVAL;
 	}
 
+	type = topic_match(data->topic, data->topic_len, &match);
+
 	if (data->type >= TOPIC_TYPE_UNKNOWN) {
-		data->type = topic_type_get(data->topic, data->topic_len);
+		data->type = type;
 
 		if ((data->type == TOPIC_TYPE_EMPTY) ||
 		    (data->type == TOPIC_TYPE_UNEXPECTED)) {
 			return 0;
 		}
+	} else if (data->type != type) {
+		return -EFAULT;
 	}
 
-	start_ptr = skip_prefix((char *)data->topic, data->type);
-
 	/* This is the common format for topics:
 	 *	<prefix>/<dynamic value>/<suffix>/<property bags>
 	 *
 	 * Where <dynamic value> and <suffix> fields are not present for all.
+	 * The dynamic value is the first capture of the match, and the
+	 * property bags the last one.
 	 *
 	 * Property bags have the following format:
 	 *	<key 1>=<value 1>&<key 2>=<value 2>&...
@@ -212,26 +229,22 @@ int azure_iot_hub_topic_parse(struct topic_parser_data *const data)
 	 * Where the value field may be left empty. It's also allowed to leave
 	 * out the '=' sign.
 	 */
-
-	/* Detect if the topic carries more information than just the prefix. */
-	if (start_ptr == max_ptr) {
-		return 0;
-	}
+	prop_bags = &match.capture[match.capture_count - 1];
 
 	/* Get the dynamic value for topics that have one */
 	if (data->type != TOPIC_TYPE_TWIN_UPDATE_DESIRED) {
-		stop_ptr = get_next_occurrence(start_ptr, '/',
-					data->topic_len -
-					(start_ptr - data->topic));
-		len = stop_ptr ? stop_ptr - start_ptr : 0;
+		size_t len = match.capture[0].len;
 
+		/* Detect if the topic carries more information than just
+		 * the prefix.
+		 */
 		if (len == 0) {
-			return -EFAULT;
+			return (prop_bags->len == 0) ? 0 : -EFAULT;
 		} else if (len > TOPIC_DYNAMIC_VALUE_MAX_LEN) {
 			return -ENOMEM;
 		}
 
-		memcpy(data->name, start_ptr, len);
+		memcpy(data->name, match.capture[0].ptr, len);
 		data->name[len] = '\0';
 
 		LOG_DBG("Dynamic value: %s", log_strdup(data->name));
@@ -247,17 +260,12 @@ int azure_iot_hub_topic_parse(struct topic_parser_data *const data)
 				LOG_ERR("Failed to parse string as number");
 				return -EFAULT;
 			}
-		} else if (data->type == TOPIC_TYPE_DEVICEBOUND) {
-			stop_ptr += sizeof(TOPIC_DEVICE_BOUND_SUFFIX) - 1;
 		}
-
-		/* Move the start pointer to the end of the method name plus the
-		 * subsequent '/'. start_ptr will now be at the start of the
-		 * property bags, if there are any.
-		 */
-		start_ptr = stop_ptr + 1;
 	}
 
+	/* The property bags are parsed from where the match left them */
+	start_ptr = (char *)prop_bags->ptr;
+	max_ptr = prop_bags->ptr + prop_bags->len;
 	data->prop_bag_count = 0;
 
 	while ((start_ptr < max_ptr) &&
@@ -273,7 +281,6 @@ int azure_iot_hub_topic_parse(struct topic_parser_data *const data)
 		start_ptr  += ret;
 	}
 
-
 	return 0;
 }
 
@@ -0,0 +1,755 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <net/cloud.h>
+#include <net/cloud_outbox.h>
+#include <logging/log.h>
+
+#if defined(CONFIG_CLOUD_OUTBOX_FLASH)
+#include <fs/fcb.h>
+#include <storage/flash_map.h>
+
+#if USE_PARTITION_MANAGER
+#include <pm_config.h>
+#define OUTBOX_FLASH_AREA_ID PM_CLOUD_OUTBOX_ID
+#else
+#define OUTBOX_FLASH_AREA_ID FLASH_AREA_ID(storage)
+#endif
+
+#define OUTBOX_FLASH_MAGIC 0x584f4243 /* "CBOX" */
+#endif /* defined(CONFIG_CLOUD_OUTBOX_FLASH) */
+
+LOG_MODULE_REGISTER(cloud_outbox, CONFIG_CLOUD_OUTBOX_LOG_LEVEL);
+
+#define REC_BATCH	CLOUD_OUTBOX_BATCH
+#define REC_SENT	BIT(1)
+#define REC_ACKED	BIT(2)
+
+/* Queued message. The topic and the payload follow the header. Records
+ * are stored in the same format in RAM and in flash.
+ */
+struct record {
+	/* Size of the record including the header, rounded up to a multiple
+	 * of 4. 0 marks that the next record is at the start of the ring.
+	 */
+	uint16_t size;
+	uint16_t id;
+	/* Message ID of the publication the record was sent in. */
+	uint16_t message_id;
+	uint16_t ep_type;
+	uint16_t topic_len;
+	uint16_t payload_len;
+	uint8_t qos;
+	uint8_t flags;
+	uint16_t reserved;
+	uint8_t data[];
+};
+
+BUILD_ASSERT((sizeof(struct record) % 4) == 0,
+	     "Record header must keep the records aligned");
+BUILD_ASSERT((CONFIG_CLOUD_OUTBOX_SIZE % 4) == 0,
+	     "Outbox size must be a multiple of 4");
+
+static const struct cloud_backend *outbox_backend;
+static cloud_outbox_evt_handler_t evt_handler;
+static K_MUTEX_DEFINE(outbox_lock);
+static struct k_delayed_work send_work;
+static struct k_delayed_work ack_work;
+static bool online;
+
+static uint8_t ring[CONFIG_CLOUD_OUTBOX_SIZE] __aligned(4);
+/* Oldest record, next record to send and first free byte. */
+static size_t head;
+static size_t send_pos;
+static size_t tail;
+/* Records in the ring, and how many of them have not been sent. */
+static size_t count;
+static size_t unsent;
+/* Payload bytes of the unsent messages that can be batched. */
+static size_t unsent_batch_size;
+
+static char batch_buf[CONFIG_CLOUD_OUTBOX_BATCH_SIZE];
+static uint16_t next_id;
+static uint16_t next_message_id;
+
+#if defined(CONFIG_CLOUD_OUTBOX_FLASH)
+static struct fcb fcb;
+static struct flash_sector sectors[CONFIG_CLOUD_OUTBOX_FLASH_SECTORS];
+/* Last entry moved from flash to the ring, and entries left in flash. */
+static struct fcb_entry flash_loc;
+static size_t flash_count;
+#else
+static const size_t flash_count;
+#endif
+
+static inline struct record *rec_at(size_t pos)
+{
+	return (struct record *)&ring[pos];
+}
+
+static size_t rec_size(const struct cloud_msg *msg)
+{
+	return ROUND_UP(sizeof(struct record) + msg->endpoint.len + msg->len,
+			4);
+}
+
+/* Record at pos. If pos is at the end of the ring marker, it is moved to
+ * the start of the ring. Only valid if there is a record at or after pos.
+ */
+static struct record *rec_get(size_t *pos)
+{
+	if (rec_at(*pos)->size == 0) {
+		*pos = 0;
+	}
+
+	return rec_at(*pos);
+}
+
+/* Position after the record at pos. The marker is not checked, as the
+ * next record may not have been written yet.
+ */
+static size_t rec_next(size_t pos)
+{
+	pos += rec_at(pos)->size;
+
+	return (pos == sizeof(ring)) ? 0 : pos;
+}
+
+static void notify(enum cloud_outbox_evt_type type, uint16_t id)
+{
+	const struct cloud_outbox_evt evt = {
+		.type = type,
+		.id = id,
+	};
+
+	if (evt_handler) {
+		evt_handler(&evt);
+	}
+}
+
+/* Reserve size bytes at the end of the ring. */
+static struct record *ring_alloc(size_t size)
+{
+	if (count == 0) {
+		head = send_pos = tail = 0;
+	}
+
+	if (count > 0 && tail <= head) {
+		/* Only the space up to the oldest record is free. */
+		return (head - tail >= size) ? rec_at(tail) : NULL;
+	}
+
+	if (sizeof(ring) - tail >= size) {
+		return rec_at(tail);
+	}
+
+	/* Does not fit before the end of the ring, wrap around. */
+	if (head < size) {
+		return NULL;
+	}
+
+	rec_at(tail)->size = 0;
+	tail = 0;
+
+	return rec_at(tail);
+}
+
+static void ring_commit(struct record *rec)
+{
+	tail += rec->size;
+	count++;
+	unsent++;
+
+	if (rec->flags & REC_BATCH) {
+		unsent_batch_size += rec->payload_len;
+	}
+
+	if (tail == sizeof(ring)) {
+		tail = 0;
+	}
+}
+
+#if defined(CONFIG_CLOUD_OUTBOX_FLASH)
+/* Flash writes must be word aligned, so the parts of a record are written
+ * through this buffer.
+ */
+struct flash_writer {
+	struct fcb_entry loc;
+	size_t offset;
+	size_t fill;
+	uint8_t buf[32] __aligned(4);
+};
+
+static int flash_writer_flush(struct flash_writer *w)
+{
+	int err;
+
+	if (w->fill == 0) {
+		return 0;
+	}
+
+	/* Records are padded to a multiple of 4 bytes. */
+	memset(&w->buf[w->fill], 0, ROUND_UP(w->fill, 4) - w->fill);
+	w->fill = ROUND_UP(w->fill, 4);
+
+	err = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(w->loc) +
+			       w->offset, w->buf, w->fill);
+	w->offset += w->fill;
+	w->fill = 0;
+
+	return err;
+}
+
+static int flash_writer_write(struct flash_writer *w, const void *data,
+			      size_t len)
+{
+	const uint8_t *src = data;
+	int err;
+
+	while (len > 0) {
+		size_t chunk = MIN(len, sizeof(w->buf) - w->fill);
+
+		memcpy(&w->buf[w->fill], src, chunk);
+		w->fill += chunk;
+		src += chunk;
+		len -= chunk;
+
+		if (w->fill == sizeof(w->buf)) {
+			err = flash_writer_flush(w);
+			if (err) {
+				return err;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int flash_put(const struct record *hdr, const struct cloud_msg *msg)
+{
+	struct flash_writer w = { 0 };
+	int err;
+
+	err = fcb_append(&fcb, hdr->size, &w.loc);
+	if (err) {
+		return (err == -ENOSPC) ? -ENOMEM : err;
+	}
+
+	err = flash_writer_write(&w, hdr, sizeof(*hdr));
+	if (!err && hdr->topic_len > 0) {
+		err = flash_writer_write(&w, msg->endpoint.str, hdr->topic_len);
+	}
+	if (!err) {
+		err = flash_writer_write(&w, msg->buf, hdr->payload_len);
+	}
+	if (!err) {
+		err = flash_writer_flush(&w);
+	}
+	if (err) {
+		LOG_ERR("Failed to write to flash: %d", err);
+		return err;
+	}
+
+	err = fcb_append_finish(&fcb, &w.loc);
+	if (err) {
+		return err;
+	}
+
+	flash_count++;
+
+	return 0;
+}
+
+/* Move records from flash to the ring, as long as they fit. Returns the
+ * number of records moved.
+ */
+static size_t flash_refill(void)
+{
+	size_t moved = 0;
+
+	while (flash_count > 0) {
+		struct fcb_entry loc = flash_loc;
+		struct record hdr;
+		struct record *rec;
+		int err;
+
+		err = fcb_getnext(&fcb, &loc);
+		if (err == 0) {
+			err = flash_area_read(fcb.fap,
+					      FCB_ENTRY_FA_DATA_OFF(loc),
+					      &hdr, sizeof(hdr));
+		}
+		if (err || hdr.size != loc.fe_data_len) {
+			LOG_ERR("Outbox in flash is corrupt, %d messages lost",
+				flash_count);
+			fcb_clear(&fcb);
+			flash_loc.fe_sector = NULL;
+			flash_count = 0;
+			break;
+		}
+
+		rec = ring_alloc(hdr.size);
+		if (rec == NULL) {
+			break;
+		}
+
+		err = flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), rec,
+				      hdr.size);
+		if (err) {
+			LOG_ERR("Failed to read from flash: %d", err);
+			break;
+		}
+
+		ring_commit(rec);
+		flash_count--;
+		moved++;
+
+		/* Erase a sector once all of its records are in the ring. */
+		if (flash_loc.fe_sector != NULL &&
+		    flash_loc.fe_sector != loc.fe_sector) {
+			fcb_rotate(&fcb);
+		}
+
+		flash_loc = loc;
+	}
+
+	if (flash_count == 0 && flash_loc.fe_sector != NULL) {
+		fcb_clear(&fcb);
+		flash_loc.fe_sector = NULL;
+	}
+
+	return moved;
+}
+
+static int flash_init(void)
+{
+	struct fcb_entry loc = { 0 };
+	uint32_t sector_cnt = ARRAY_SIZE(sectors);
+	int err;
+
+	err = flash_area_get_sectors(OUTBOX_FLASH_AREA_ID, &sector_cnt,
+				     sectors);
+	if (err) {
+		LOG_ERR("Failed to get flash sectors: %d", err);
+		return err;
+	}
+
+	fcb.f_magic = OUTBOX_FLASH_MAGIC;
+	fcb.f_version = 1;
+	fcb.f_sector_cnt = sector_cnt;
+	fcb.f_scratch_cnt = 0;
+	fcb.f_sectors = sectors;
+
+	err = fcb_init(OUTBOX_FLASH_AREA_ID, &fcb);
+	if (err) {
+		LOG_ERR("Failed to initialize flash storage: %d", err);
+		return err;
+	}
+
+	flash_loc.fe_sector = NULL;
+	flash_count = 0;
+
+	while (fcb_getnext(&fcb, &loc) == 0) {
+		flash_count++;
+	}
+
+	if (flash_count > 0) {
+		LOG_INF("%d messages restored from flash", flash_count);
+	}
+
+	return 0;
+}
+#endif /* defined(CONFIG_CLOUD_OUTBOX_FLASH) */
+
+/* Remove the acknowledged records at the start of the ring. */
+static void release(void)
+{
+	while (count > unsent) {
+		struct record *rec = rec_get(&head);
+		uint16_t id = rec->id;
+
+		if (!(rec->flags & REC_ACKED)) {
+			break;
+		}
+
+		count--;
+
+		if (count > 0) {
+			head = rec_next(head);
+		}
+
+		/* Dropped records have already been reported. */
+		if (id != 0) {
+			notify(CLOUD_OUTBOX_EVT_SENT, id);
+		}
+	}
+
+#if defined(CONFIG_CLOUD_OUTBOX_FLASH)
+	if (flash_refill() > 0 && online) {
+		k_delayed_work_submit(&send_work, K_NO_WAIT);
+	}
+#endif
+
+	if (count > unsent) {
+		k_delayed_work_submit(&ack_work,
+				      K_SECONDS(CONFIG_CLOUD_OUTBOX_ACK_TIMEOUT_SEC));
+	} else {
+		k_delayed_work_cancel(&ack_work);
+	}
+}
+
+/* Queue the records that have not been acknowledged for sending again. */
+static void requeue(void)
+{
+	size_t pos = head;
+
+	send_pos = head;
+	unsent = count;
+	unsent_batch_size = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		struct record *rec = rec_get(&pos);
+
+		if (!(rec->flags & REC_ACKED)) {
+			rec->flags &= ~REC_SENT;
+
+			if (rec->flags & REC_BATCH) {
+				unsent_batch_size += rec->payload_len;
+			}
+		}
+
+		pos = rec_next(pos);
+	}
+
+	k_delayed_work_cancel(&ack_work);
+}
+
+static uint16_t message_id_get(void)
+{
+	if (next_message_id < CLOUD_OUTBOX_MESSAGE_ID_FIRST ||
+	    next_message_id >= CLOUD_OUTBOX_MESSAGE_ID_LAST) {
+		next_message_id = CLOUD_OUTBOX_MESSAGE_ID_FIRST;
+	} else {
+		next_message_id++;
+	}
+
+	return next_message_id;
+}
+
+static bool batch_match(const struct record *a, const struct record *b)
+{
+	return (b->flags & REC_BATCH) && !(b->flags & REC_ACKED) &&
+	       a->ep_type == b->ep_type && a->qos == b->qos &&
+	       a->topic_len == b->topic_len &&
+	       memcmp(a->data, b->data, a->topic_len) == 0;
+}
+
+/* Join consecutive batchable records into a JSON array. Returns the number
+ * of records in the batch.
+ */
+static size_t batch_build(struct record *first, size_t *len)
+{
+	size_t pos = send_pos;
+	size_t n = 0;
+
+	*len = 1;
+	batch_buf[0] = '[';
+
+	while (n < unsent) {
+		struct record *rec = rec_get(&pos);
+
+		if (!batch_match(first, rec) ||
+		    *len + rec->payload_len + 1 > sizeof(batch_buf)) {
+			break;
+		}
+
+		memcpy(&batch_buf[*len], &rec->data[rec->topic_len],
+		       rec->payload_len);
+		*len += rec->payload_len;
+		batch_buf[(*len)++] = ',';
+
+		n++;
+		pos = rec_next(pos);
+	}
+
+	/* Replace the last separator. */
+	batch_buf[*len - 1] = ']';
+
+	return n;
+}
+
+static void send_all(void)
+{
+	while (online && unsent > 0) {
+		struct record *rec = rec_get(&send_pos);
+		struct cloud_msg msg = {
+			.qos = rec->qos,
+			.endpoint.type = rec->ep_type,
+			.endpoint.str = rec->topic_len ? (char *)rec->data : NULL,
+			.endpoint.len = rec->topic_len,
+		};
+		size_t n = 1;
+		int err;
+
+		if (rec->flags & REC_ACKED) {
+			/* Acknowledged after a resend had been queued. */
+			send_pos = rec_next(send_pos);
+			unsent--;
+			continue;
+		}
+
+		if (rec->flags & REC_BATCH) {
+			n = batch_build(rec, &msg.len);
+			msg.buf = batch_buf;
+		} else {
+			msg.buf = (char *)&rec->data[rec->topic_len];
+			msg.len = rec->payload_len;
+		}
+
+		if (msg.qos != CLOUD_QOS_AT_MOST_ONCE) {
+			msg.message_id = message_id_get();
+		}
+
+		err = cloud_send(outbox_backend, &msg);
+		if (err == -EINVAL || err == -ENOTSUP || err == -EMSGSIZE) {
+			/* The backend will never accept the message. */
+			LOG_ERR("Message %d rejected by backend: %d", rec->id,
+				err);
+		} else if (err) {
+			LOG_WRN("Failed to send message %d: %d", rec->id, err);
+			k_delayed_work_submit(&send_work,
+				K_SECONDS(CONFIG_CLOUD_OUTBOX_RETRY_SEC));
+			return;
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			rec = rec_get(&send_pos);
+			rec->flags |= REC_SENT;
+			rec->message_id = msg.message_id;
+
+			if (err) {
+				rec->flags |= REC_ACKED;
+				notify(CLOUD_OUTBOX_EVT_DROPPED, rec->id);
+				/* Do not report it as sent on release. */
+				rec->id = 0;
+			} else if (msg.qos == CLOUD_QOS_AT_MOST_ONCE) {
+				rec->flags |= REC_ACKED;
+			}
+
+			if (rec->flags & REC_BATCH) {
+				unsent_batch_size -= rec->payload_len;
+			}
+
+			send_pos = rec_next(send_pos);
+			unsent--;
+		}
+
+		LOG_DBG("Sent %d message(s), message ID %d", n,
+			msg.message_id);
+
+		release();
+	}
+}
+
+static void send_work_fn(struct k_work *work)
+{
+	k_mutex_lock(&outbox_lock, K_FOREVER);
+	send_all();
+	k_mutex_unlock(&outbox_lock);
+}
+
+static void ack_work_fn(struct k_work *work)
+{
+	k_mutex_lock(&outbox_lock, K_FOREVER);
+
+	if (count > unsent) {
+		LOG_WRN("No acknowledgment received, sending again");
+		requeue();
+		send_all();
+	}
+
+	k_mutex_unlock(&outbox_lock);
+}
+
+static void ack(uint16_t message_id)
+{
+	size_t pos = head;
+	size_t sent = count - unsent;
+
+	for (size_t i = 0; i < sent; i++) {
+		struct record *rec = rec_get(&pos);
+
+		if ((rec->flags & REC_SENT) && !(rec->flags & REC_ACKED)) {
+			/* Backends that do not report message IDs acknowledge
+			 * in order.
+			 */
+			if (message_id == 0) {
+				message_id = rec->message_id;
+			}
+
+			if (rec->message_id == message_id) {
+				rec->flags |= REC_ACKED;
+			}
+		}
+
+		pos = rec_next(pos);
+	}
+
+	release();
+}
+
+int cloud_outbox_init(const struct cloud_backend *backend,
+		      cloud_outbox_evt_handler_t handler)
+{
+	if (backend == NULL) {
+		return -EINVAL;
+	}
+
+	if (outbox_backend != NULL) {
+		k_delayed_work_cancel(&send_work);
+		k_delayed_work_cancel(&ack_work);
+	}
+
+	outbox_backend = backend;
+	evt_handler = handler;
+	online = false;
+	count = unsent = unsent_batch_size = 0;
+
+	k_delayed_work_init(&send_work, send_work_fn);
+	k_delayed_work_init(&ack_work, ack_work_fn);
+
+#if defined(CONFIG_CLOUD_OUTBOX_FLASH)
+	int err = flash_init();
+
+	if (err) {
+		return err;
+	}
+
+	(void)flash_refill();
+#endif
+
+	return 0;
+}
+
+int cloud_outbox_send(const struct cloud_msg *msg, uint32_t flags)
+{
+	struct record hdr = { 0 };
+	struct record *rec;
+	int err = 0;
+
+	if (msg == NULL || (msg->buf == NULL && msg->len > 0) ||
+	    (msg->endpoint.str == NULL && msg->endpoint.len > 0) ||
+	    msg->qos >= CLOUD_QOS_COUNT || msg->message_id != 0) {
+		return -EINVAL;
+	}
+
+	if (rec_size(msg) > MIN(sizeof(ring), UINT16_MAX) ||
+	    ((flags & CLOUD_OUTBOX_BATCH) &&
+	     msg->len + 2 > sizeof(batch_buf))) {
+		return -EMSGSIZE;
+	}
+
+	hdr.size = rec_size(msg);
+	hdr.ep_type = msg->endpoint.type;
+	hdr.topic_len = msg->endpoint.len;
+	hdr.payload_len = msg->len;
+	hdr.qos = msg->qos;
+	hdr.flags = flags & CLOUD_OUTBOX_BATCH;
+
+	k_mutex_lock(&outbox_lock, K_FOREVER);
+
+	if (++next_id == 0) {
+		next_id++;
+	}
+	hdr.id = next_id;
+
+	/* Newer messages wait in flash as well, to keep the order. */
+	rec = (flash_count == 0) ? ring_alloc(hdr.size) : NULL;
+	if (rec != NULL) {
+		*rec = hdr;
+		memcpy(rec->data, msg->endpoint.str, hdr.topic_len);
+		memcpy(&rec->data[hdr.topic_len], msg->buf, hdr.payload_len);
+		ring_commit(rec);
+	} else {
+#if defined(CONFIG_CLOUD_OUTBOX_FLASH)
+		err = flash_put(&hdr, msg);
+#else
+		err = -ENOMEM;
+#endif
+	}
+
+	if (err) {
+		k_mutex_unlock(&outbox_lock);
+		return err;
+	}
+
+	if (!(flags & CLOUD_OUTBOX_BATCH) ||
+	    unsent_batch_size + unsent + 1 >= sizeof(batch_buf)) {
+		/* Send right away, together with any batch in progress. */
+		k_delayed_work_submit(&send_work, K_NO_WAIT);
+	} else if (k_delayed_work_remaining_get(&send_work) == 0) {
+		k_delayed_work_submit(&send_work,
+				      K_MSEC(CONFIG_CLOUD_OUTBOX_LATENCY_MS));
+	}
+
+	k_mutex_unlock(&outbox_lock);
+
+	return hdr.id;
+}
+
+void cloud_outbox_event_handle(const struct cloud_event *evt)
+{
+	if (evt == NULL || outbox_backend == NULL) {
+		return;
+	}
+
+	k_mutex_lock(&outbox_lock, K_FOREVER);
+
+	switch (evt->type) {
+	case CLOUD_EVT_READY:
+		online = true;
+		if (unsent > 0) {
+			k_delayed_work_submit(&send_work, K_NO_WAIT);
+		}
+		break;
+	case CLOUD_EVT_DISCONNECTED:
+		online = false;
+		k_delayed_work_cancel(&send_work);
+		requeue();
+		break;
+	case CLOUD_EVT_DATA_SENT:
+		ack(evt->data.msg.message_id);
+		break;
+	default:
+		break;
+	}
+
+	k_mutex_unlock(&outbox_lock);
+}
+
+int cloud_outbox_flush(void)
+{
+	if (outbox_backend == NULL) {
+		return -ENOENT;
+	}
+
+	k_delayed_work_submit(&send_work, K_NO_WAIT);
+
+	return 0;
+}
+
+size_t cloud_outbox_count(void)
+{
+	size_t n;
+
+	k_mutex_lock(&outbox_lock, K_FOREVER);
+	n = count + flash_count;
+	k_mutex_unlock(&outbox_lock);
+
+	return n;
+}
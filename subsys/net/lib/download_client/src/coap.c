@@ -15,7 +15,8 @@ LOG_MODULE_DECLARE(download_client, CONFIG_DOWNLOAD_CLIENT_LOG_LEVEL);
 #define FILENAME_SIZE CONFIG_DOWNLOAD_CLIENT_MAX_FILENAME_SIZE
 
 int url_parse_file(const char *url, char *file, size_t len);
-int socket_send(const struct download_client *client, size_t len);
+int socket_send(const struct download_client *client, const char *buf,
+		size_t len);
 
 int coap_block_init(struct download_client *client, size_t from)
 {
@@ -65,7 +66,7 @@ int coap_parse(struct download_client *client, size_t len)
 	const uint8_t *payload;
 	struct coap_packet response;
 
-	err = coap_packet_parse(&response, client->buf, len, NULL, 0);
+	err = coap_packet_parse(&response, client->rx_buf, len, NULL, 0);
 	if (err) {
 		LOG_ERR("Failed to parse CoAP packet, err %d", err);
 		return -1;
@@ -89,17 +90,14 @@ int coap_parse(struct download_client *client, size_t len)
 		return -1;
 	}
 
-	/* TODO: because our buffer is large enough for the whole datagram,
-	 * we don't scrictly need to copy the bytes at the beginning
-	 * of the buffer, we could simply send a fragment pointing to the
-	 * payload directly.
+	/* The whole datagram is in the buffer,
+	 * so the fragment can point to the payload directly.
 	 */
-	LOG_DBG("CoAP response: %d, copying %d bytes",
+	LOG_DBG("CoAP response: %d, %d payload bytes",
 		coap_header_get_code(&response), payload_len - blk_off);
-	memcpy(client->buf + client->offset, payload + blk_off,
-	       payload_len - blk_off);
 
-	client->offset += payload_len - blk_off;
+	client->frag_off = payload + blk_off - (uint8_t *)client->rx_buf;
+	client->offset = client->frag_off + payload_len - blk_off;
 	client->progress += payload_len - blk_off;
 
 	return 0;
@@ -147,7 +145,7 @@ int coap_request_send(struct download_client *client)
 
 	LOG_DBG("CoAP next block: %d", client->coap.block_ctx.current);
 
-	err = socket_send(client, request.offset);
+	err = socket_send(client, client->buf, request.offset);
 	if (err) {
 		LOG_ERR("Failed to send CoAP request, errno %d", errno);
 		return err;
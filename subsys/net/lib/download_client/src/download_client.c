@@ -28,11 +28,15 @@ int url_parse_host(const char *url, char *host, size_t len);
 
 int http_parse(struct download_client *client, size_t len);
 int http_get_request_send(struct download_client *client);
+int http_pipeline_fill(struct download_client *client);
+void http_fragment_done(struct download_client *client);
 
 int coap_block_init(struct download_client *client, size_t from);
 int coap_parse(struct download_client *client, size_t len);
 int coap_request_send(struct download_client *client);
 
+void resume_start(struct download_client *client, size_t from);
+
 static const char *str_family(int family)
 {
 	switch (family) {
@@ -273,13 +277,14 @@ cleanup:
 	return err;
 }
 
-int socket_send(const struct download_client *client, size_t len)
+int socket_send(const struct download_client *client, const char *buf,
+		size_t len)
 {
 	int sent;
 	size_t off = 0;
 
 	while (len) {
-		sent = send(client->fd, client->buf + off, len, 0);
+		sent = send(client->fd, buf + off, len, 0);
 		if (sent <= 0) {
 			return -errno;
 		}
@@ -307,19 +312,81 @@ static int request_send(struct download_client *dl)
 	return 0;
 }
 
-static int fragment_evt_send(const struct download_client *client)
+/* Offset past the last byte of the download, zero if not yet known */
+size_t range_end_get(const struct download_client *client)
 {
+	if (client->range_end != 0 &&
+	    (client->file_size == 0 || client->range_end < client->file_size)) {
+		return client->range_end;
+	}
+
+	return client->file_size;
+}
+
+/* Receive into a buffer lent by the application, if any */
+static void rx_buf_get(struct download_client *client)
+{
+	char *buf = NULL;
+
+	if (client->config.buf_provider) {
+		buf = client->config.buf_provider->get();
+	}
+
+	if (buf == NULL) {
+		buf = client->buf;
+	}
+
+	client->rx_buf = buf;
+}
+
+/* Give back a lent buffer which has not been handed
+ * to the application with a fragment.
+ */
+static void rx_buf_put(struct download_client *client)
+{
+	if (client->rx_buf != client->buf &&
+	    client->config.buf_provider->put) {
+		client->config.buf_provider->put(client->rx_buf);
+	}
+
+	client->rx_buf = client->buf;
+}
+
+static int fragment_evt_send(struct download_client *client)
+{
+	char *buf = client->rx_buf;
+
 	__ASSERT(client->offset <= CONFIG_DOWNLOAD_CLIENT_BUF_SIZE,
 		 "Buffer overflow!");
 
 	const struct download_client_evt evt = {
 		.id = DOWNLOAD_CLIENT_EVT_FRAGMENT,
 		.fragment = {
-			.buf = client->buf,
-			.len = client->offset,
+			.buf = buf + client->frag_off,
+			.len = client->offset - client->frag_off,
+			.offset = client->progress -
+				  (client->offset - client->frag_off),
 		}
 	};
 
+	if (client->config.buf_provider) {
+		/* The buffer is handed to the application with the fragment,
+		 * take a new one and move the start of the next pipelined
+		 * response to it.
+		 */
+		rx_buf_get(client);
+
+		if (client->rx_buf != buf) {
+			if (client->http.leftover) {
+				memcpy(client->rx_buf, buf + client->offset,
+				       client->http.leftover);
+			}
+			client->offset = 0;
+		}
+	}
+
+	client->frag_off = 0;
+
 	return client->callback(&evt);
 }
 
@@ -354,6 +421,11 @@ static int reconnect(struct download_client *dl)
 	return 0;
 }
 
+static bool is_http(const struct download_client *dl)
+{
+	return dl->proto == IPPROTO_TCP || dl->proto == IPPROTO_TLS_1_2;
+}
+
 void download_thread(void *client, void *a, void *b)
 {
 	int rc = 0;
@@ -366,17 +438,26 @@ restart_and_suspend:
 	while (true) {
 		__ASSERT(dl->offset < sizeof(dl->buf), "Buffer overflow");
 
+		if (dl->http.leftover) {
+			/* The start of the next pipelined response has
+			 * already been received with the previous fragment.
+			 */
+			len = dl->http.leftover;
+			dl->http.leftover = 0;
+			goto parse;
+		}
+
 		if (sizeof(dl->buf) - dl->offset == 0) {
-			LOG_ERR("Could not fit HTTP header from server (> %d)",
+			LOG_ERR("Receive buffer is full (%d bytes)",
 				sizeof(dl->buf));
 			error_evt_send(dl, E2BIG);
 			break;
 		}
 
 		LOG_DBG("Receiving up to %d bytes at %p...",
-			(sizeof(dl->buf) - dl->offset), (dl->buf + dl->offset));
+			(sizeof(dl->buf) - dl->offset), (dl->rx_buf + dl->offset));
 
-		len = recv(dl->fd, dl->buf + dl->offset,
+		len = recv(dl->fd, dl->rx_buf + dl->offset,
 			   sizeof(dl->buf) - dl->offset, 0);
 
 		if ((len == 0) || (len == -1)) {
@@ -396,7 +477,11 @@ restart_and_suspend:
 			}
 
 			if (len == -1) {
-				if (errno == ETIMEDOUT) {
+				/* Resending is only safe when no other
+				 * request is pending on the connection.
+				 */
+				if (errno == ETIMEDOUT &&
+				    dl->http.inflight <= 1) {
 					LOG_DBG("Socket timeout, resending");
 					goto send_again;
 				}
@@ -405,6 +490,10 @@ restart_and_suspend:
 
 			if (len == 0) {
 				LOG_WRN("Peer closed connection!");
+				if (dl->http.inflight > 1) {
+					LOG_WRN("Disabling HTTP pipelining");
+					dl->http.serial = true;
+				}
 			}
 
 			/* Notify the application of the error via en event.
@@ -428,7 +517,8 @@ restart_and_suspend:
 
 		LOG_DBG("Read %d bytes from socket", len);
 
-		if (dl->proto == IPPROTO_TCP || dl->proto == IPPROTO_TLS_1_2) {
+parse:
+		if (is_http(dl)) {
 			rc = http_parse(client, len);
 			if (rc > 0) {
 				/* Wait for more data (fragment/header) */
@@ -439,10 +529,11 @@ restart_and_suspend:
 		}
 
 		if (rc < 0) {
-			/* Something was wrong with the packet
-			 * Restart and suspend
+			/* Something was wrong with the packet, or the file
+			 * has changed on the server. Restart and suspend
 			 */
-			error_evt_send(dl, EBADMSG);
+			error_evt_send(dl,
+				       rc == -ECANCELED ? ECANCELED : EBADMSG);
 			break;
 		}
 
@@ -464,20 +555,61 @@ restart_and_suspend:
 			break;
 		}
 
-		if (dl->progress == dl->file_size) {
+		if (dl->progress == range_end_get(dl)) {
+			if (dl->range_next && dl->range_next(dl) == 0) {
+				LOG_DBG("Continuing with range %u-%u",
+					dl->progress, dl->range_end - 1);
+				goto send_again;
+			}
+
 			LOG_INF("Download complete");
 			const struct download_client_evt evt = {
 				.id = DOWNLOAD_CLIENT_EVT_DONE,
 			};
 			dl->callback(&evt);
-			/* Restart and suspend */
-			break;
+			if (!dl->chained) {
+				/* Restart and suspend */
+				break;
+			}
+
+			/* Request the next file on the same connection */
+			dl->chained = false;
+			if (is_http(dl) && dl->http.connection_close) {
+				dl->http.connection_close = false;
+				rc = reconnect(dl);
+				if (rc) {
+					error_evt_send(dl, EHOSTDOWN);
+					break;
+				}
+			}
+
+			dl->offset = 0;
+			rc = request_send(dl);
+			if (rc) {
+				goto send_failed;
+			}
+
+			continue;
 		}
 
-		/* Attempt to reconnect if the connection was closed */
-		if (dl->http.connection_close) {
-			dl->http.connection_close = false;
-			reconnect(dl);
+		if (is_http(dl)) {
+			/* Attempt to reconnect if the connection was closed,
+			 * once the current response has been received.
+			 */
+			if (dl->http.connection_close && !dl->http.has_header) {
+				dl->http.connection_close = false;
+				reconnect(dl);
+				goto send_again;
+			}
+
+			/* Keep the pipeline full (HTTPS) */
+			http_fragment_done(dl);
+			rc = http_pipeline_fill(dl);
+			if (rc) {
+				goto send_failed;
+			}
+
+			continue;
 		}
 
 send_again:
@@ -489,23 +621,31 @@ send_again:
 
 			rc = request_send(dl);
 			if (rc) {
-				rc = error_evt_send(dl, ECONNRESET);
-				if (rc) {
-					/* Restart and suspend */
-					break;
-				}
+				goto send_failed;
+			}
+		}
 
-				rc = reconnect(dl);
-				if (rc) {
-					error_evt_send(dl, EHOSTDOWN);
-					break;
-				}
+		continue;
 
-				goto send_again;
-			}
+send_failed:
+		rc = error_evt_send(dl, ECONNRESET);
+		if (rc) {
+			/* Restart and suspend */
+			break;
+		}
+
+		rc = reconnect(dl);
+		if (rc) {
+			error_evt_send(dl, EHOSTDOWN);
+			break;
 		}
+
+		goto send_again;
 	}
 
+	/* Give back the buffer lent by the application, if any */
+	rx_buf_put(dl);
+
 	/* Do not let the thread return, since it can't be restarted */
 	goto restart_and_suspend;
 }
@@ -519,6 +659,13 @@ int download_client_init(struct download_client *const client,
 
 	client->fd = -1;
 	client->callback = callback;
+	client->rx_buf = client->buf;
+	client->range_next = NULL;
+	client->chained = false;
+
+#if defined(CONFIG_DOWNLOAD_CLIENT_RESUME)
+	memset(&client->resume, 0, sizeof(client->resume));
+#endif
 
 	/* The thread is spawned now, but it will suspend itself;
 	 * it is resumed when the download is started via the API.
@@ -596,6 +743,12 @@ int download_client_disconnect(struct download_client *const client)
 
 int download_client_start(struct download_client *client, const char *file,
 			  size_t from)
+{
+	return download_client_range_start(client, file, from, 0);
+}
+
+int download_client_range_start(struct download_client *client,
+				const char *file, size_t from, size_t to)
 {
 	int err;
 
@@ -603,6 +756,10 @@ int download_client_start(struct download_client *client, const char *file,
 		return -EINVAL;
 	}
 
+	if (to != 0 && to <= from) {
+		return -EINVAL;
+	}
+
 	if (client->fd < 0) {
 		return -ENOTCONN;
 	}
@@ -610,9 +767,20 @@ int download_client_start(struct download_client *client, const char *file,
 	client->file = file;
 	client->file_size = 0;
 	client->progress = from;
+	client->range_end = to;
 
 	client->offset = 0;
+	client->frag_off = 0;
 	client->http.has_header = false;
+	client->http.serial = false;
+
+	rx_buf_put(client);
+	rx_buf_get(client);
+
+	if (IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_RESUME) && is_http(client)) {
+		/* The file size is known already when resuming */
+		resume_start(client, from);
+	}
 
 	if (IS_ENABLED(CONFIG_COAP)) {
 		coap_block_init(client, from);
@@ -623,6 +791,16 @@ int download_client_start(struct download_client *client, const char *file,
 		}
 	}
 
+	if (k_current_get() == client->tid) {
+		/* Started from the callback of the previous download,
+		 * the download thread sends the request.
+		 */
+		client->chained = true;
+		LOG_INF("Downloading next: %s [%u]", log_strdup(client->file),
+			client->progress);
+		return 0;
+	}
+
 	err = request_send(client);
 	if (err) {
 		return err;
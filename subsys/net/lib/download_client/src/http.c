@@ -6,7 +6,6 @@
 
 #include <ctype.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 #include <logging/log.h>
 #include <sys/__assert.h>
@@ -21,6 +20,7 @@ LOG_MODULE_DECLARE(download_client, CONFIG_DOWNLOAD_CLIENT_LOG_LEVEL);
 	"GET /%s HTTP/1.1\r\n"                                                 \
 	"Host: %s\r\n"                                                         \
 	"Range: bytes=%u-\r\n"                                                 \
+	"%s%s%s"                                                               \
 	"Connection: keep-alive\r\n"                                           \
 	"\r\n"
 
@@ -28,18 +28,67 @@ LOG_MODULE_DECLARE(download_client, CONFIG_DOWNLOAD_CLIENT_LOG_LEVEL);
 	"GET /%s HTTP/1.1\r\n"                                                 \
 	"Host: %s\r\n"                                                         \
 	"Range: bytes=%u-%u\r\n"                                               \
+	"%s%s%s"                                                               \
 	"Connection: keep-alive\r\n"                                           \
 	"\r\n"
 
 int url_parse_host(const char *url, char *host, size_t len);
 int url_parse_file(const char *url, char *file, size_t len);
-int socket_send(const struct download_client *client, size_t len);
+int socket_send(const struct download_client *client, const char *buf,
+		size_t len);
+size_t range_end_get(const struct download_client *client);
 
-int http_get_request_send(struct download_client *client)
+void resume_field_begin(struct download_client *client, bool etag);
+void resume_field_char(struct download_client *client, char c);
+void resume_field_end(struct download_client *client);
+void resume_header_done(struct download_client *client);
+const char *resume_if_range_get(const struct download_client *client);
+
+static bool range_requests_used(const struct download_client *client)
+{
+	return client->proto == IPPROTO_TLS_1_2 ||
+	       client->range_end != 0 ||
+	       IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_RANGE_REQUESTS);
+}
+
+static size_t frag_size_get(const struct download_client *client)
+{
+	if (client->config.frag_size_override) {
+		return client->config.frag_size_override;
+	}
+
+	return CONFIG_DOWNLOAD_CLIENT_HTTP_FRAG_SIZE;
+}
+
+static size_t pipeline_depth_get(const struct download_client *client)
+{
+	/* Ranges can only be pipelined once the file size is known */
+	if (!range_requests_used(client) || client->http.serial ||
+	    client->file_size == 0) {
+		return 1;
+	}
+
+	return CONFIG_DOWNLOAD_CLIENT_HTTP_PIPELINE_DEPTH;
+}
+
+/* Validator of the file to send in an If-Range field, or NULL */
+static const char *if_range_get(const struct download_client *client)
+{
+	if (!IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_RESUME)) {
+		return NULL;
+	}
+
+	return resume_if_range_get(client);
+}
+
+static int range_request_send(struct download_client *client, size_t from)
 {
 	int err;
 	int len;
 	size_t off;
+	char *req;
+	const char *if_range;
+	size_t req_size;
 	char host[HOSTNAME_SIZE];
 	char file[FILENAME_SIZE];
 
@@ -57,136 +106,432 @@ int http_get_request_send(struct download_client *client)
 	}
 
 	/* Offset of last byte in range (Content-Range) */
-	if (client->config.frag_size_override) {
-		off = client->progress + client->config.frag_size_override - 1;
-	} else {
-		off = client->progress +
-			CONFIG_DOWNLOAD_CLIENT_HTTP_FRAG_SIZE - 1;
+	off = from + frag_size_get(client) - 1;
+
+	if (range_end_get(client) != 0) {
+		/* Don't request bytes past the end of file or range */
+		off = MIN(off, range_end_get(client) - 1);
 	}
 
-	if (client->file_size != 0) {
-		/* Don't request bytes past the end of file */
-		off = MIN(off, client->file_size);
+	/* The request is written after any pipelined response data
+	 * which is already in the buffer, unless the response data
+	 * is received into a buffer lent by the application.
+	 */
+	req = client->buf;
+	if (client->rx_buf == client->buf) {
+		req += client->offset + client->http.leftover;
 	}
+	req_size = sizeof(client->buf) - (req - client->buf);
+
+	/* When resuming, the ranges are only sent if the file
+	 * has not changed on the server.
+	 */
+	if_range = if_range_get(client);
 
 	/* We use range requests only for HTTPS, due to memory limitations.
 	 * When using HTTP, we request the whole resource to minimize
 	 * network usage (only one request/response are sent).
 	 */
-	if (client->proto == IPPROTO_TLS_1_2
-	   || IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_RANGE_REQUESTS)) {
-		len = snprintf(client->buf,
-			CONFIG_DOWNLOAD_CLIENT_BUF_SIZE,
-			GET_HTTPS_TEMPLATE, file, host, client->progress, off);
+	if (range_requests_used(client)) {
+		len = snprintf(req, req_size, GET_HTTPS_TEMPLATE,
+			       file, host, from, off,
+			       if_range ? "If-Range: " : "",
+			       if_range ? if_range : "",
+			       if_range ? "\r\n" : "");
 	} else {
-		len = snprintf(client->buf,
-			CONFIG_DOWNLOAD_CLIENT_BUF_SIZE,
-			GET_HTTP_TEMPLATE, file, host, client->progress);
+		len = snprintf(req, req_size, GET_HTTP_TEMPLATE,
+			       file, host, from,
+			       if_range ? "If-Range: " : "",
+			       if_range ? if_range : "",
+			       if_range ? "\r\n" : "");
 	}
 
-	if (len < 0 || len > CONFIG_DOWNLOAD_CLIENT_BUF_SIZE) {
-		LOG_ERR("Cannot create GET request, buffer too small");
+	if (len < 0 || len >= req_size) {
+		if (client->http.inflight > 0) {
+			/* Room is made when the next fragment is handled */
+			LOG_DBG("No room for pipelined request, deferred");
+		} else {
+			LOG_ERR("Cannot create GET request, buffer too small");
+		}
 		return -ENOMEM;
 	}
 
 	if (IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_LOG_HEADERS)) {
-		LOG_HEXDUMP_DBG(client->buf, len, "HTTP request");
+		LOG_HEXDUMP_DBG(req, len, "HTTP request");
 	}
 
-	err = socket_send(client, len);
+	err = socket_send(client, req, len);
 	if (err) {
 		LOG_ERR("Failed to send HTTP request, errno %d", errno);
 		return err;
 	}
 
+	client->http.next_range = off + 1;
+	client->http.inflight++;
+
 	return 0;
 }
 
-/* Returns:
- *  1 while the header is being received
- *  0 if the header has been fully received
- * -1 on error
+/* Send range requests until the configured number of requests
+ * is in flight, or all of the file has been requested.
  */
-static int http_header_parse(struct download_client *client, size_t *hdr_len)
+int http_pipeline_fill(struct download_client *client)
 {
-	char *p;
+	int err;
 
-	p = strstr(client->buf, "\r\n\r\n");
-	if (!p) {
-		/* Waiting full HTTP header */
-		LOG_DBG("Waiting full header in response");
-		return 1;
+	while (client->http.inflight < pipeline_depth_get(client)) {
+		if (range_end_get(client) != 0 &&
+		    client->http.next_range >= range_end_get(client)) {
+			break;
+		}
+
+		err = range_request_send(client, client->http.next_range);
+		if (err == -ENOMEM && client->http.inflight > 0) {
+			/* No room in the buffer right now, the request
+			 * is sent once the next fragment has been handled.
+			 */
+			break;
+		}
+
+		if (err) {
+			LOG_ERR("Failed to send range request, err %d", err);
+			return err;
+		}
 	}
 
-	/* Offset of the end of the HTTP header in the buffer */
-	*hdr_len = p + strlen("\r\n\r\n") - client->buf;
+	return 0;
+}
 
-	LOG_DBG("GET header size: %u", *hdr_len);
-	if (IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_LOG_HEADERS)) {
-		LOG_HEXDUMP_DBG(client->buf, *hdr_len, "HTTP response");
+/* Move any pipelined response data which followed the fragment
+ * to the beginning of the buffer.
+ */
+void http_fragment_done(struct download_client *client)
+{
+	if (client->http.leftover) {
+		LOG_DBG("Moving %u bytes of next response",
+			client->http.leftover);
+		memmove(client->rx_buf, client->rx_buf + client->offset,
+			client->http.leftover);
+	}
+
+	client->offset = 0;
+}
+
+/* Response header parser states */
+enum hdr_state {
+	HDR_STATUS_VERSION,
+	HDR_STATUS_CODE,
+	HDR_STATUS_REASON,
+	HDR_NAME,
+	HDR_VALUE,
+};
+
+/* Header fields of interest */
+enum hdr_field {
+	HDR_FIELD_NONE,
+	HDR_FIELD_CONTENT_LENGTH,
+	HDR_FIELD_CONTENT_RANGE,
+	HDR_FIELD_CONNECTION,
+	HDR_FIELD_ETAG,
+	HDR_FIELD_LAST_MODIFIED,
+	HDR_FIELD_LAST = HDR_FIELD_LAST_MODIFIED,
+};
+
+#define HDR_FIELDS_ALL (BIT(HDR_FIELD_CONTENT_LENGTH) | \
+			BIT(HDR_FIELD_CONTENT_RANGE) | \
+			BIT(HDR_FIELD_CONNECTION) | \
+			BIT(HDR_FIELD_ETAG) | \
+			BIT(HDR_FIELD_LAST_MODIFIED))
+
+/* Value of the "pos" field once a value is known not to match */
+#define HDR_POS_MISMATCH UINT8_MAX
+
+static const char *const hdr_field_names[] = {
+	[HDR_FIELD_CONTENT_LENGTH] = "content-length",
+	[HDR_FIELD_CONTENT_RANGE] = "content-range",
+	[HDR_FIELD_CONNECTION] = "connection",
+	[HDR_FIELD_ETAG] = "etag",
+	[HDR_FIELD_LAST_MODIFIED] = "last-modified",
+};
+
+static const char hdr_version[] = "http/";
+static const char hdr_close[] = "close";
+
+static void hdr_parser_reset(struct download_client *client)
+{
+	memset(&client->http.parser, 0, sizeof(client->http.parser));
+	client->http.parser.state = HDR_STATUS_VERSION;
+}
+
+static int hdr_digit_add(size_t *val, char c)
+{
+	if (*val > (SIZE_MAX - 9) / 10) {
+		return -1;
+	}
+
+	*val = *val * 10 + (c - '0');
+
+	return 0;
+}
+
+static void hdr_name_char(struct download_client *client, char c)
+{
+	uint8_t pos = client->http.parser.pos;
+
+	c = tolower((unsigned char)c);
+
+	for (int i = HDR_FIELD_CONTENT_LENGTH; i <= HDR_FIELD_LAST; i++) {
+		const char *name = hdr_field_names[i];
+
+		if ((client->http.parser.match & BIT(i)) &&
+		    (pos >= strlen(name) || name[pos] != c)) {
+			client->http.parser.match &= ~BIT(i);
+		}
+	}
+
+	if (pos < UINT8_MAX) {
+		client->http.parser.pos++;
+	}
+}
+
+static void hdr_name_end(struct download_client *client)
+{
+	client->http.parser.field = HDR_FIELD_NONE;
+
+	for (int i = HDR_FIELD_CONTENT_LENGTH; i <= HDR_FIELD_LAST; i++) {
+		if ((client->http.parser.match & BIT(i)) &&
+		    strlen(hdr_field_names[i]) == client->http.parser.pos) {
+			client->http.parser.field = i;
+		}
 	}
 
-	for (size_t i = 0; i < *hdr_len; i++) {
-		client->buf[i] = tolower(client->buf[i]);
+	/* The validators of the file are kept to resume the download */
+	if (IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_RESUME) &&
+	    (client->http.parser.field == HDR_FIELD_ETAG ||
+	     client->http.parser.field == HDR_FIELD_LAST_MODIFIED)) {
+		resume_field_begin(client,
+			client->http.parser.field == HDR_FIELD_ETAG);
 	}
 
-	p = strstr(client->buf, "http/1.1 206");
-	if (!p) {
-		if (client->proto == IPPROTO_TLS_1_2
-		   || IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_RANGE_REQUESTS)) {
+	client->http.parser.state = HDR_VALUE;
+	client->http.parser.pos = 0;
+}
+
+static int hdr_value_char(struct download_client *client, char c)
+{
+	switch (client->http.parser.field) {
+	case HDR_FIELD_CONTENT_LENGTH:
+		if (isdigit((unsigned char)c)) {
+			client->http.parser.has_content_length = true;
+			return hdr_digit_add(
+				&client->http.parser.content_length, c);
+		}
+		break;
+	case HDR_FIELD_CONTENT_RANGE:
+		/* The file size follows the '/' in "bytes 0-1023/4096" */
+		if (c == '/') {
+			client->http.parser.pos = 1;
+		} else if (client->http.parser.pos &&
+			   isdigit((unsigned char)c)) {
+			client->http.parser.has_file_size = true;
+			return hdr_digit_add(&client->http.parser.file_size, c);
+		}
+		break;
+	case HDR_FIELD_CONNECTION:
+		if (c == ' ' || c == '\t') {
+			/* Skip whitespace around the value */
+			if (client->http.parser.pos == 0 ||
+			    client->http.parser.pos == strlen(hdr_close)) {
+				break;
+			}
+		}
+		if (client->http.parser.pos < strlen(hdr_close) &&
+		    tolower((unsigned char)c) ==
+		    hdr_close[client->http.parser.pos]) {
+			client->http.parser.pos++;
+		} else {
+			client->http.parser.pos = HDR_POS_MISMATCH;
+		}
+		break;
+	case HDR_FIELD_ETAG:
+	case HDR_FIELD_LAST_MODIFIED:
+		if (IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_RESUME)) {
+			resume_field_char(client, c);
+		}
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static void hdr_line_end(struct download_client *client)
+{
+	if (client->http.parser.field == HDR_FIELD_CONNECTION &&
+	    client->http.parser.pos == strlen(hdr_close)) {
+		LOG_WRN("Peer closed connection, will re-connect");
+		client->http.connection_close = true;
+		/* Requests pipelined after this one would be lost */
+		client->http.serial = true;
+	}
+
+	if (IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_RESUME) &&
+	    (client->http.parser.field == HDR_FIELD_ETAG ||
+	     client->http.parser.field == HDR_FIELD_LAST_MODIFIED)) {
+		resume_field_end(client);
+	}
+
+	client->http.parser.field = HDR_FIELD_NONE;
+	client->http.parser.state = HDR_NAME;
+	client->http.parser.match = HDR_FIELDS_ALL;
+	client->http.parser.pos = 0;
+}
+
+/* Returns:
+ *  1 if the character was the last one of the header
+ *  0 if the header continues
+ * -1 on error
+ */
+static int hdr_char(struct download_client *client, char c)
+{
+	switch (client->http.parser.state) {
+	case HDR_STATUS_VERSION:
+		if (client->http.parser.pos < strlen(hdr_version)) {
+			if (tolower((unsigned char)c) !=
+			    hdr_version[client->http.parser.pos]) {
+				LOG_ERR("Server response is not HTTP");
+				return -1;
+			}
+			client->http.parser.pos++;
+		} else if (c == ' ') {
+			client->http.parser.state = HDR_STATUS_CODE;
+		}
+		break;
+	case HDR_STATUS_CODE:
+		if (isdigit((unsigned char)c)) {
+			client->http.parser.status =
+				client->http.parser.status * 10 + (c - '0');
+			if (client->http.parser.status > 999) {
+				LOG_ERR("Invalid HTTP status code");
+				return -1;
+			}
+		} else if (c == '\n') {
+			hdr_line_end(client);
+		} else {
+			client->http.parser.state = HDR_STATUS_REASON;
+		}
+		break;
+	case HDR_STATUS_REASON:
+		if (c == '\n') {
+			hdr_line_end(client);
+		}
+		break;
+	case HDR_NAME:
+		if (c == '\r') {
+			break;
+		}
+		if (c == '\n') {
+			if (client->http.parser.pos == 0) {
+				/* Empty line, end of header */
+				return 1;
+			}
+			/* Line without a field value, ignore it */
+			hdr_line_end(client);
+		} else if (c == ':') {
+			hdr_name_end(client);
+		} else {
+			hdr_name_char(client, c);
+		}
+		break;
+	case HDR_VALUE:
+		if (c == '\r') {
+			break;
+		}
+		if (c == '\n') {
+			hdr_line_end(client);
+		} else if (hdr_value_char(client, c)) {
+			LOG_ERR("Header field value out of range");
+			return -1;
+		}
+		break;
+	}
+
+	return 0;
+}
+
+/* Handle the fields of a complete header.
+ * Returns 0 on success, -ECANCELED if the file has changed
+ * since the download was started, -1 on other errors.
+ */
+static int http_header_process(struct download_client *client)
+{
+	LOG_DBG("HTTP status %d", client->http.parser.status);
+
+	if (client->http.parser.status == 200 && if_range_get(client)) {
+		/* The server sends the whole file instead of
+		 * the range when the validator does not match.
+		 */
+		LOG_WRN("File has changed on the server");
+		return -ECANCELED;
+	}
+
+	if (client->http.parser.status != 206) {
+		if (range_requests_used(client)) {
 			LOG_ERR("Server did not honor partial content request");
 			return -1;
 		}
-		p = strstr(client->buf, "http/1.1 200");
-		if (!p) {
+		if (client->http.parser.status != 200) {
 			LOG_ERR("Server response is not 200 Success");
 			return -1;
 		}
+		if (client->progress != 0) {
+			LOG_ERR("Server did not honor range request");
+			return -1;
+		}
 	}
 
 	/* The file size is returned via "Content-Length" in case of HTTP,
 	 * and via "Content-Range" in case of HTTPS with range requests.
 	 */
 	if (client->file_size == 0) {
-		if (client->proto == IPPROTO_TLS_1_2
-		   || IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_RANGE_REQUESTS)) {
-			p = strstr(client->buf, "content-range");
-			if (!p) {
+		if (range_requests_used(client)) {
+			if (!client->http.parser.has_file_size) {
 				LOG_ERR("Server did not send "
 					"\"Content-Range\" in response");
 				return -1;
 			}
-			p = strstr(p, "/");
-			if (!p) {
-				LOG_ERR("No file size in response");
-				return -1;
-			}
+			client->file_size = client->http.parser.file_size;
 		} else { /* proto == PROTO_HTTP */
-			p = strstr(client->buf, "content-length");
-			if (!p) {
+			if (!client->http.parser.has_content_length) {
 				LOG_WRN("Server did not send "
 					"\"Content-Length\" in response");
-					return -1;
-			}
-			p = strstr(p, ":");
-			if (!p) {
-				LOG_ERR("No file size in response");
 				return -1;
 			}
 			/* Accumulate any eventual progress (starting offset)
 			 * when reading the file size from Content-Length
 			 */
-			client->file_size = client->progress;
+			client->file_size = client->progress +
+				client->http.parser.content_length;
 		}
 
-		client->file_size += atoi(p + 1);
 		LOG_DBG("File size = %u", client->file_size);
 	}
 
-	p = strstr(client->buf, "connection: close");
-	if (p) {
-		LOG_WRN("Peer closed connection, will re-connect");
-		client->http.connection_close = true;
+	if (IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_RESUME)) {
+		resume_header_done(client);
+	}
+
+	/* The length of the payload tells where the next
+	 * pipelined response begins.
+	 */
+	if (client->http.parser.has_content_length) {
+		client->http.body_left = client->http.parser.content_length;
+	} else if (range_requests_used(client)) {
+		client->http.body_left = MIN(frag_size_get(client),
+			range_end_get(client) - client->progress);
+	} else {
+		client->http.body_left = SIZE_MAX;
 	}
 
 	client->http.has_header = true;
@@ -194,63 +539,130 @@ static int http_header_parse(struct download_client *client, size_t *hdr_len)
 	return 0;
 }
 
+/* Parse header bytes as they are received, without the header
+ * having to be in the buffer all at once.
+ *
+ * Returns:
+ *  1 while the header is being received
+ *  0 if the header has been fully received, hdr_len is set to
+ *    the number of header bytes in data
+ * -ECANCELED if the file has changed on the server
+ * -1 on other errors
+ */
+static int http_header_parse(struct download_client *client, const char *data,
+			     size_t len, size_t *hdr_len)
+{
+	int rc;
+
+	for (size_t i = 0; i < len; i++) {
+		rc = hdr_char(client, data[i]);
+		if (rc < 0) {
+			return -1;
+		}
+		if (rc == 0) {
+			continue;
+		}
+
+		*hdr_len = i + 1;
+
+		if (IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_LOG_HEADERS)) {
+			LOG_HEXDUMP_DBG(data, *hdr_len, "HTTP response");
+		}
+
+		rc = http_header_process(client);
+
+		/* Prepare for the header of the next response */
+		hdr_parser_reset(client);
+
+		return rc;
+	}
+
+	if (IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_LOG_HEADERS)) {
+		LOG_HEXDUMP_DBG(data, len, "HTTP response");
+	}
+
+	LOG_DBG("Waiting full header in response");
+
+	return 1;
+}
+
+int http_get_request_send(struct download_client *client)
+{
+	/* Start over from the current progress,
+	 * discarding any requests still in flight.
+	 */
+	client->http.has_header = false;
+	client->http.leftover = 0;
+	client->http.inflight = 0;
+	client->http.next_range = client->progress;
+	hdr_parser_reset(client);
+
+	return http_pipeline_fill(client);
+}
+
 /* Returns:
  *  1 if more data is expected
  *  0 if a whole fragment has been received
- * -1 on error
+ * -ECANCELED if the file has changed on the server
+ * -1 on other errors
  */
 int http_parse(struct download_client *client, size_t len)
 {
 	int rc;
+	char *data;
 	size_t hdr_len;
-
-	/* Accumulate buffer offset */
-	client->offset += len;
+	size_t payload;
 
 	if (!client->http.has_header) {
-		rc = http_header_parse(client, &hdr_len);
+		data = client->rx_buf + client->offset;
+
+		rc = http_header_parse(client, data, len, &hdr_len);
 		if (rc > 0) {
-			/* Wait for header */
+			/* Wait for header, the header bytes
+			 * are not kept in the buffer.
+			 */
 			return 1;
 		}
 		if (rc < 0) {
 			/* Something is wrong with the header */
-			return -1;
+			return rc;
 		}
 
-		if (client->offset != hdr_len) {
-			/* The buffer contains some payload bytes,
-			 * copy them at the beginning of the buffer
-			 * and update the offset.
-			 */
-			LOG_DBG("Copying %u payload bytes",
-				client->offset - hdr_len);
-			memcpy(client->buf, client->buf + hdr_len,
-			       client->offset - hdr_len);
-
-			client->offset -= hdr_len;
-		} else {
-			/* Reset the offset.
-			 * The payload is received in an empty buffer.
-			 */
-			client->offset = 0;
+		/* Move any payload bytes over the header */
+		len -= hdr_len;
+		if (len) {
+			LOG_DBG("Copying %u payload bytes", len);
+			memmove(data, data + hdr_len, len);
 		}
 	}
 
-	/* Accumulate overall file progress.
-	 * If the last recv() call read an HTTP header,
-	 * `offset` has been moved at the end of any trailing
-	 * payload bytes by http_header_parse(). In this case,
-	 * `offset` is less than `len` and it represents
-	 * the actual payload bytes.
+	/* Accumulate buffer offset */
+	client->offset += len;
+
+	/* When requests are pipelined, the bytes past the end of the
+	 * current response belong to the next response. They are kept
+	 * in the buffer, after the fragment.
 	 */
-	client->progress += MIN(client->offset, len);
+	payload = MIN(len, client->http.body_left);
+	client->http.leftover = len - payload;
+	client->http.body_left -= payload;
+	client->offset -= client->http.leftover;
+
+	/* Accumulate overall file progress */
+	client->progress += payload;
+
+	if (client->http.body_left == 0) {
+		/* The response is complete */
+		client->http.has_header = false;
+		if (client->http.inflight > 0) {
+			client->http.inflight--;
+		}
+		return 0;
+	}
 
 	/* Have we received a whole fragment or the whole file? */
-	if (client->progress != client->file_size &&
-	    client->offset < (client->config.frag_size_override != 0 ?
-			      client->config.frag_size_override :
-			      CONFIG_DOWNLOAD_CLIENT_HTTP_FRAG_SIZE)) {
+	if (client->progress != range_end_get(client) &&
+	    client->offset < frag_size_get(client)) {
 		return 1;
 	}
 
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <stdio.h>
+#include <string.h>
+#include <settings/settings.h>
+#include <net/download_client.h>
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(download_client, CONFIG_DOWNLOAD_CLIENT_LOG_LEVEL);
+
+#define SETTINGS_SUBTREE "dl_client"
+#define SETTINGS_KEY_SIZE 48
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+/* Record being loaded by settings_load_subtree() */
+static struct {
+	const char *name;
+	struct download_client_resume *record;
+	bool found;
+} load;
+
+static int settings_set(const char *key, size_t len_rd,
+			settings_read_cb read_cb, void *cb_arg)
+{
+	ssize_t len;
+
+	if (load.record == NULL || strcmp(key, load.name) != 0) {
+		return 0;
+	}
+
+	if (len_rd != sizeof(*load.record)) {
+		LOG_WRN("Ignoring resume record of unexpected size %d", len_rd);
+		return 0;
+	}
+
+	len = read_cb(cb_arg, load.record, sizeof(*load.record));
+	if (len != sizeof(*load.record)) {
+		LOG_ERR("Can't read resume record from storage");
+		return len;
+	}
+
+	load.found = true;
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(download_client, SETTINGS_SUBTREE, NULL,
+			       settings_set, NULL, NULL);
+
+static uint32_t hash_add(uint32_t hash, const char *str)
+{
+	while (*str) {
+		hash ^= (uint8_t)*str++;
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+static uint32_t url_hash(const char *host, const char *file)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+
+	hash = hash_add(hash, host);
+	hash = hash_add(hash, "/");
+	hash = hash_add(hash, file);
+
+	return hash;
+}
+
+static int key_get(const struct download_client *client, char *key,
+		   size_t size)
+{
+	int len;
+
+	if (client->config.resume_key == NULL) {
+		return -EINVAL;
+	}
+
+	len = snprintf(key, size, SETTINGS_SUBTREE "/%s",
+		       client->config.resume_key);
+	if (len < 0 || len >= size) {
+		return -ENAMETOOLONG;
+	}
+
+	return 0;
+}
+
+/* Called when a download is started */
+void resume_start(struct download_client *client, size_t from)
+{
+	struct download_client_resume *record = &client->resume.record;
+
+	/* Keep the validator when resuming the same file, so that
+	 * the range requests are conditional.
+	 */
+	if (from != 0 && record->validator[0] != '\0' &&
+	    record->url_hash == url_hash(client->host, client->file)) {
+		LOG_DBG("Resuming from %u, validator %s", from,
+			log_strdup(record->validator));
+		client->file_size = record->file_size;
+		client->resume.capture = false;
+		return;
+	}
+
+	memset(record, 0, sizeof(*record));
+	client->resume.capture = true;
+	client->resume.etag = false;
+}
+
+/* Called when a validator field is found in the response header */
+void resume_field_begin(struct download_client *client, bool etag)
+{
+	/* An ETag is preferred to a Last-Modified date */
+	if (!client->resume.capture || (client->resume.etag && !etag)) {
+		return;
+	}
+
+	client->resume.in_value = true;
+	client->resume.etag = etag;
+	client->resume.len = 0;
+	client->resume.record.validator[0] = '\0';
+}
+
+void resume_field_char(struct download_client *client, char c)
+{
+	char *validator = client->resume.record.validator;
+
+	if (!client->resume.in_value) {
+		return;
+	}
+
+	/* Skip leading whitespace */
+	if (client->resume.len == 0 && (c == ' ' || c == '\t')) {
+		return;
+	}
+
+	if (client->resume.len == sizeof(client->resume.record.validator) - 1) {
+		/* Too long to be used, do without it */
+		LOG_WRN("Validator too long, resumed download is unconditional");
+		client->resume.in_value = false;
+		client->resume.len = 0;
+		validator[0] = '\0';
+		return;
+	}
+
+	validator[client->resume.len++] = c;
+	validator[client->resume.len] = '\0';
+}
+
+void resume_field_end(struct download_client *client)
+{
+	char *validator = client->resume.record.validator;
+
+	if (!client->resume.in_value) {
+		return;
+	}
+
+	/* Strip trailing whitespace */
+	while (client->resume.len > 0 &&
+	       (validator[client->resume.len - 1] == ' ' ||
+		validator[client->resume.len - 1] == '\t')) {
+		validator[--client->resume.len] = '\0';
+	}
+
+	client->resume.in_value = false;
+}
+
+/* Called when the response header has been processed */
+void resume_header_done(struct download_client *client)
+{
+	if (!client->resume.capture) {
+		return;
+	}
+
+	/* The validator of the first response is kept for the download */
+	client->resume.capture = false;
+	client->resume.record.url_hash = url_hash(client->host, client->file);
+	client->resume.record.file_size = client->file_size;
+}
+
+/* Validator to send in If-Range, or NULL */
+const char *resume_if_range_get(const struct download_client *client)
+{
+	if (client->resume.capture ||
+	    client->resume.record.validator[0] == '\0') {
+		return NULL;
+	}
+
+	return client->resume.record.validator;
+}
+
+int download_client_resume_load(struct download_client *client,
+				const char *file,
+				struct download_client_resume *record)
+{
+	int err;
+	char key[SETTINGS_KEY_SIZE];
+
+	if (client == NULL || file == NULL || record == NULL ||
+	    client->host == NULL) {
+		return -EINVAL;
+	}
+
+	err = key_get(client, key, sizeof(key));
+	if (err) {
+		return err;
+	}
+
+	err = settings_subsys_init();
+	if (err) {
+		LOG_ERR("Failed to initialize settings, err %d", err);
+		return err;
+	}
+
+	load.name = client->config.resume_key;
+	load.record = &client->resume.record;
+	load.found = false;
+
+	err = settings_load_subtree(key);
+
+	load.record = NULL;
+
+	if (err) {
+		LOG_ERR("Cannot load resume record, err %d", err);
+		return err;
+	}
+
+	if (!load.found) {
+		return -ENOENT;
+	}
+
+	if (client->resume.record.url_hash != url_hash(client->host, file)) {
+		LOG_INF("Resume record is for another file");
+		memset(&client->resume.record, 0,
+		       sizeof(client->resume.record));
+		return -ENOENT;
+	}
+
+	/* Make sure the validator is null-terminated */
+	client->resume.record.validator[
+		sizeof(client->resume.record.validator) - 1] = '\0';
+
+	*record = client->resume.record;
+
+	LOG_INF("Resume record found, offset %u of %u bytes",
+		record->offset, record->file_size);
+
+	return 0;
+}
+
+int download_client_resume_save(struct download_client *client,
+				size_t offset, uint32_t user)
+{
+	int err;
+	char key[SETTINGS_KEY_SIZE];
+
+	if (client == NULL || client->file == NULL) {
+		return -EINVAL;
+	}
+
+	err = key_get(client, key, sizeof(key));
+	if (err) {
+		return err;
+	}
+
+	if (client->resume.capture) {
+		/* No response header received yet */
+		return -EAGAIN;
+	}
+
+	client->resume.record.offset = offset;
+	client->resume.record.user = user;
+
+	err = settings_save_one(key, &client->resume.record,
+				sizeof(client->resume.record));
+	if (err) {
+		LOG_ERR("Failed to store resume record, err %d", err);
+		return err;
+	}
+
+	return 0;
+}
+
+int download_client_resume_clear(struct download_client *client)
+{
+	int err;
+	char key[SETTINGS_KEY_SIZE];
+
+	if (client == NULL) {
+		return -EINVAL;
+	}
+
+	err = key_get(client, key, sizeof(key));
+	if (err) {
+		return err;
+	}
+
+	memset(&client->resume.record, 0, sizeof(client->resume.record));
+
+	return settings_delete(key);
+}
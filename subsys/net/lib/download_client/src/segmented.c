@@ -0,0 +1,449 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <net/socket.h>
+#include <net/download_client.h>
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(download_client, CONFIG_DOWNLOAD_CLIENT_LOG_LEVEL);
+
+#define CONNECTIONS  CONFIG_DOWNLOAD_CLIENT_SEGMENTED_CONNECTIONS
+#define SEGMENT_SIZE CONFIG_DOWNLOAD_CLIENT_SEGMENT_SIZE
+#define WINDOW_SIZE  CONFIG_DOWNLOAD_CLIENT_REORDER_WINDOW_SIZE
+
+/* Segment assigned to a connection */
+struct segment {
+	/* Offset of the first byte of the segment */
+	size_t from;
+	/* Offset past the last byte of the segment, zero if unassigned */
+	size_t to;
+	/* Number of bytes received, either delivered or in the window */
+	size_t recv;
+	/* The connection is waiting for the download to move forward */
+	bool waiting;
+	struct k_sem wake;
+};
+
+static struct download_client clients[CONNECTIONS];
+static struct segment segments[CONNECTIONS];
+
+static download_client_callback_t callback;
+static bool in_order;
+static const char *file;
+
+static size_t file_size;
+/* Offset of the first segment not yet assigned to a connection */
+static size_t next_segment;
+/* In order delivery, offset up to which the file has been delivered */
+static size_t delivered;
+/* Number of connections taking part in the download */
+static size_t started;
+/* Number of connections which have no more segments to download */
+static size_t finished;
+/* The application has stopped the download */
+static bool stopped;
+/* The clients have been initialized */
+static bool initialized;
+
+/* Fragments received ahead of the delivered part of the file,
+ * indexed by their offset in the file modulo the window size.
+ */
+static uint8_t window[WINDOW_SIZE];
+
+static K_MUTEX_DEFINE(segmented_mutex);
+
+static struct segment *segment_find(size_t offset)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(segments); i++) {
+		if (segments[i].to != 0 &&
+		    segments[i].from <= offset && offset < segments[i].to) {
+			return &segments[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void segment_assign(struct segment *seg, size_t size)
+{
+	seg->from = next_segment;
+	seg->to = next_segment + size;
+	if (file_size != 0) {
+		seg->to = MIN(seg->to, file_size);
+	}
+	seg->recv = 0;
+
+	next_segment = seg->to;
+}
+
+/* Must be called with segmented_mutex held. */
+static void segment_wait(struct segment *seg)
+{
+	seg->waiting = true;
+	k_mutex_unlock(&segmented_mutex);
+
+	(void)k_sem_take(&seg->wake, K_FOREVER);
+
+	k_mutex_lock(&segmented_mutex, K_FOREVER);
+}
+
+/* Must be called with segmented_mutex held. */
+static void waiters_wake(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(segments); i++) {
+		if (segments[i].waiting) {
+			segments[i].waiting = false;
+			k_sem_give(&segments[i].wake);
+		}
+	}
+}
+
+static bool buf_is_lent(const void *buf)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		if ((const char *)buf >= clients[i].buf &&
+		    (const char *)buf < clients[i].buf + sizeof(clients[i].buf)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static int fragment_send(const void *buf, size_t len, size_t offset)
+{
+	const struct download_client_evt evt = {
+		.id = DOWNLOAD_CLIENT_EVT_FRAGMENT,
+		.fragment = {
+			.buf = buf,
+			.len = len,
+			.offset = offset,
+		},
+	};
+
+	return callback(&evt);
+}
+
+static void window_store(const struct download_fragment *frag)
+{
+	size_t pos = frag->offset % WINDOW_SIZE;
+	size_t chunk = MIN(frag->len, WINDOW_SIZE - pos);
+
+	memcpy(&window[pos], frag->buf, chunk);
+	memcpy(&window[0], (const uint8_t *)frag->buf + chunk,
+	       frag->len - chunk);
+}
+
+/* Deliver the fragments held in the window which
+ * follow the delivered part of the file.
+ */
+static int window_flush(void)
+{
+	int err;
+	size_t pos;
+	size_t chunk;
+	struct segment *seg;
+
+	while ((seg = segment_find(delivered)) != NULL) {
+		if (seg->from + seg->recv == delivered) {
+			/* Not received yet */
+			break;
+		}
+
+		pos = delivered % WINDOW_SIZE;
+		chunk = MIN(seg->from + seg->recv - delivered,
+			    WINDOW_SIZE - pos);
+
+		err = fragment_send(&window[pos], chunk, delivered);
+
+		delivered += chunk;
+
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+/* Start downloading on the other connections,
+ * once the file size is known.
+ */
+static void connections_start(void)
+{
+	int err;
+	struct segment *seg;
+
+	file_size = clients[0].file_size;
+
+	/* The first segment was assigned without knowing the file size */
+	segments[0].to = MIN(segments[0].to, file_size);
+	next_segment = MIN(next_segment, file_size);
+
+	for (size_t i = 1; i < ARRAY_SIZE(clients); i++) {
+		if (next_segment >= file_size) {
+			break;
+		}
+
+		seg = &segments[i];
+		segment_assign(seg, SEGMENT_SIZE);
+
+		err = download_client_range_start(&clients[i], file,
+						  seg->from, seg->to);
+		if (err) {
+			LOG_WRN("Failed to start connection %d, err %d",
+				i, err);
+			next_segment = seg->from;
+			seg->to = 0;
+			break;
+		}
+
+		started++;
+	}
+
+	LOG_INF("Segmented download on %d connections", started);
+}
+
+static int fragment_in_order(const struct download_fragment *frag,
+			     struct segment *seg)
+{
+	int err;
+
+	/* Fragments ahead of the delivered part of the file are held in the
+	 * window, if they fit. Otherwise, wait for the window to move.
+	 */
+	while (!stopped && frag->offset != delivered &&
+	       frag->offset + frag->len - delivered > WINDOW_SIZE) {
+		segment_wait(seg);
+	}
+
+	if (stopped) {
+		return 1;
+	}
+
+	seg->recv += frag->len;
+
+	if (frag->offset != delivered) {
+		window_store(frag);
+
+		/* The application does not see the lent buffer */
+		if (buf_is_lent(frag->buf) &&
+		    clients[0].config.buf_provider->put) {
+			clients[0].config.buf_provider->put((void *)frag->buf);
+		}
+
+		return 0;
+	}
+
+	err = fragment_send(frag->buf, frag->len, frag->offset);
+	delivered += frag->len;
+
+	if (!err) {
+		err = window_flush();
+	}
+
+	waiters_wake();
+
+	return err;
+}
+
+static int segmented_callback(const struct download_client_evt *evt)
+{
+	int err = 0;
+	struct segment *seg;
+
+	k_mutex_lock(&segmented_mutex, K_FOREVER);
+
+	switch (evt->id) {
+	case DOWNLOAD_CLIENT_EVT_FRAGMENT:
+		if (stopped) {
+			err = 1;
+			break;
+		}
+
+		if (file_size == 0) {
+			connections_start();
+		}
+
+		seg = segment_find(evt->fragment.offset);
+		if (seg == NULL) {
+			LOG_ERR("Fragment at %u is outside of segments",
+				evt->fragment.offset);
+			err = -EBADMSG;
+		} else if (in_order) {
+			err = fragment_in_order(&evt->fragment, seg);
+		} else {
+			seg->recv += evt->fragment.len;
+			err = callback(evt);
+		}
+		break;
+	case DOWNLOAD_CLIENT_EVT_DONE:
+		finished++;
+		if (finished == started && !stopped) {
+			LOG_INF("Segmented download complete");
+			(void)callback(evt);
+		}
+		break;
+	default:
+		err = callback(evt);
+		break;
+	}
+
+	if (err) {
+		/* Stop the other connections too */
+		stopped = true;
+		waiters_wake();
+	}
+
+	k_mutex_unlock(&segmented_mutex);
+
+	return err;
+}
+
+static int range_next(struct download_client *client)
+{
+	int err = -ENODATA;
+	struct segment *seg = &segments[client - clients];
+
+	k_mutex_lock(&segmented_mutex, K_FOREVER);
+
+	/* The window may still hold data of the segment, so wait for it
+	 * to be delivered before reusing the segment.
+	 */
+	while (in_order && !stopped && delivered < seg->to) {
+		segment_wait(seg);
+	}
+
+	if (!stopped && next_segment < file_size) {
+		segment_assign(seg, SEGMENT_SIZE);
+		client->progress = seg->from;
+		client->range_end = seg->to;
+		err = 0;
+	}
+
+	k_mutex_unlock(&segmented_mutex);
+
+	return err;
+}
+
+int download_client_segmented_init(download_client_callback_t cb,
+				   bool order)
+{
+	int err;
+
+	if (cb == NULL) {
+		return -EINVAL;
+	}
+
+	callback = cb;
+	in_order = order;
+
+	/* The threads of the clients can only be created once */
+	if (initialized) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		err = download_client_init(&clients[i], segmented_callback);
+		if (err) {
+			return err;
+		}
+
+		clients[i].range_next = range_next;
+		k_sem_init(&segments[i].wake, 0, 1);
+	}
+
+	initialized = true;
+
+	return 0;
+}
+
+int download_client_segmented_connect(const char *host,
+				      const struct download_client_cfg *config)
+{
+	int err;
+
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		err = download_client_connect(&clients[i], host, config);
+		if (err) {
+			LOG_ERR("Failed to connect connection %d, err %d",
+				i, err);
+			(void)download_client_segmented_disconnect();
+			return err;
+		}
+	}
+
+	if (clients[0].proto != IPPROTO_TCP &&
+	    clients[0].proto != IPPROTO_TLS_1_2) {
+		LOG_ERR("Segmented download requires HTTP or HTTPS");
+		(void)download_client_segmented_disconnect();
+		return -EPROTONOSUPPORT;
+	}
+
+	return 0;
+}
+
+int download_client_segmented_start(const char *f, size_t from)
+{
+	int err;
+
+	if (f == NULL) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&segmented_mutex, K_FOREVER);
+
+	file = f;
+	file_size = 0;
+	next_segment = from;
+	delivered = from;
+	finished = 0;
+	stopped = false;
+
+	for (size_t i = 0; i < ARRAY_SIZE(segments); i++) {
+		segments[i].to = 0;
+		segments[i].waiting = false;
+		k_sem_reset(&segments[i].wake);
+	}
+
+	/* The other connections are started once the first segment
+	 * has told the file size.
+	 */
+	segment_assign(&segments[0], SEGMENT_SIZE);
+	started = 1;
+
+	k_mutex_unlock(&segmented_mutex);
+
+	err = download_client_range_start(&clients[0], file,
+					  segments[0].from, segments[0].to);
+	if (err) {
+		LOG_ERR("Failed to start download, err %d", err);
+		return err;
+	}
+
+	return 0;
+}
+
+int download_client_segmented_disconnect(void)
+{
+	int err;
+	int ret = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		if (clients[i].fd < 0) {
+			continue;
+		}
+
+		err = download_client_disconnect(&clients[i]);
+		if (err) {
+			ret = err;
+		}
+	}
+
+	return ret;
+}
@@ -24,6 +24,15 @@ static fota_download_callback_t callback;
 static struct download_client   dlc;
 static struct k_delayed_work    dlc_with_offset_work;
 static int socket_retries_left;
+static bool first_fragment = true;
+static size_t file_size;
+static int img_type;
+
+/* Images of a multi-image download, none in a single image download */
+static struct fota_download_image images[FOTA_DOWNLOAD_IMAGES_MAX];
+static size_t image_count;
+/* Index of the image being downloaded */
+static size_t image_idx;
 
 static void send_evt(enum fota_download_evt_id id)
 {
@@ -68,10 +77,156 @@ static void dfu_target_callback_handler(enum dfu_target_evt_id evt)
 	}
 }
 
+/* Abort the download of the current image. In a multi-image download,
+ * the images staged so far are discarded as well.
+ */
+static int target_abort(void)
+{
+	if (image_count > 0) {
+		image_count = 0;
+		return dfu_target_reset();
+	}
+
+	return dfu_target_done(false);
+}
+
+static int image_digest_set(void)
+{
+	if (!IS_ENABLED(CONFIG_DFU_TARGET_STREAM_HASH)) {
+		return 0;
+	}
+
+	if (images[image_idx].sha256 == NULL) {
+		/* No digest is carried over from the previous image */
+		return dfu_target_digest_set(NULL, 0);
+	}
+
+	return dfu_target_digest_set(images[image_idx].sha256,
+				     FOTA_DOWNLOAD_SHA256_SIZE);
+}
+
+/* Stage the downloaded image and continue with the next one on the same
+ * connection. Once all images are staged, all of them are scheduled.
+ */
+static int image_done(void)
+{
+	int err;
+
+	err = dfu_target_stage();
+	if (err != 0) {
+		LOG_ERR("dfu_target_stage error: %d", err);
+		(void)target_abort();
+		(void)download_client_disconnect(&dlc);
+		send_error_evt(err == -EBADMSG ?
+			       FOTA_DOWNLOAD_ERROR_CAUSE_INVALID_UPDATE :
+			       FOTA_DOWNLOAD_ERROR_CAUSE_DOWNLOAD_FAILED);
+		return err;
+	}
+
+	first_fragment = true;
+	image_idx++;
+
+	if (image_idx < image_count) {
+		LOG_INF("Image %d of %d staged", image_idx, image_count);
+
+		err = image_digest_set();
+		if (err == 0) {
+			err = download_client_start(&dlc,
+						    images[image_idx].file, 0);
+		}
+		if (err != 0) {
+			LOG_ERR("Unable to start next image, err %d", err);
+			(void)target_abort();
+			(void)download_client_disconnect(&dlc);
+			send_error_evt(FOTA_DOWNLOAD_ERROR_CAUSE_DOWNLOAD_FAILED);
+			return err;
+		}
+
+		return 0;
+	}
+
+	/* Every image has been verified */
+	image_count = 0;
+	(void)download_client_disconnect(&dlc);
+
+	err = dfu_target_schedule_update();
+	if (err != 0) {
+		LOG_ERR("dfu_target_schedule_update error: %d", err);
+		send_error_evt(FOTA_DOWNLOAD_ERROR_CAUSE_DOWNLOAD_FAILED);
+		return err;
+	}
+
+	send_evt(FOTA_DOWNLOAD_EVT_FINISHED);
+
+	return 0;
+}
+
+#if defined(CONFIG_FOTA_DOWNLOAD_RESUME)
+/* Offset from where to resume an interrupted download of the file.
+ * The DFU target is initialized from the resume record, so that the
+ * download can continue without first receiving the image header.
+ */
+static size_t resume_offset_get(const char *file)
+{
+	int err;
+	size_t offset;
+	struct download_client_resume record;
+
+	err = download_client_resume_load(&dlc, file, &record);
+	if (err != 0) {
+		return 0;
+	}
+
+	err = dfu_target_init(record.user, record.file_size,
+			      dfu_target_callback_handler);
+	if ((err < 0) && (err != -EBUSY)) {
+		LOG_WRN("Cannot resume download, dfu_target_init error %d",
+			err);
+		(void)download_client_resume_clear(&dlc);
+		return 0;
+	}
+
+	/* The DFU target knows how much of the image it has stored */
+	err = dfu_target_offset_get(&offset);
+	if (err != 0 || offset == 0 || offset >= record.file_size) {
+		/* Nothing to resume. The target is initialized again for
+		 * the image type found in the first fragment.
+		 */
+		(void)dfu_target_reset();
+		return 0;
+	}
+
+	img_type = record.user;
+	file_size = record.file_size;
+	first_fragment = false;
+
+	LOG_INF("Resuming download from offset %d", offset);
+
+	return offset;
+}
+
+/* The file has changed on the server, discard what was stored
+ * and download the new file from the beginning.
+ */
+static void resume_restart(void)
+{
+	int err;
+
+	(void)download_client_resume_clear(&dlc);
+	(void)download_client_disconnect(&dlc);
+
+	err = dfu_target_done(false);
+	if (err != 0 && err != -EACCES) {
+		LOG_ERR("Unable to reset DFU target");
+	}
+
+	first_fragment = true;
+	k_delayed_work_submit(&dlc_with_offset_work, K_SECONDS(1));
+}
+#endif /* CONFIG_FOTA_DOWNLOAD_RESUME */
+
 static int download_client_callback(const struct download_client_evt *event)
 {
-	static bool first_fragment = true;
-	static size_t file_size;
 	size_t offset;
 	int err;
 
@@ -90,13 +245,14 @@ static int download_client_callback(const struct download_client_evt *event)
 				return err;
 			}
 			first_fragment = false;
-			int img_type = dfu_target_img_type(event->fragment.buf,
-							event->fragment.len);
+			img_type = dfu_target_img_type(event->fragment.buf,
+						       event->fragment.len);
 			err = dfu_target_init(img_type, file_size,
 					      dfu_target_callback_handler);
 			if ((err < 0) && (err != -EBUSY)) {
 				LOG_ERR("dfu_target_init error %d", err);
 				send_error_evt(FOTA_DOWNLOAD_ERROR_CAUSE_DOWNLOAD_FAILED);
+				image_count = 0;
 				int res = dfu_target_reset();
 
 				if (res != 0) {
@@ -130,17 +286,37 @@ static int download_client_callback(const struct download_client_evt *event)
 				       event->fragment.len);
 		if (err != 0) {
 			LOG_ERR("dfu_target_write error %d", err);
-			int res = dfu_target_done(false);
+			int res = target_abort();
 
 			if (res != 0) {
 				LOG_ERR("Unable to free DFU target resources");
 			}
 			first_fragment = true;
+#if defined(CONFIG_FOTA_DOWNLOAD_RESUME)
+			(void)download_client_resume_clear(&dlc);
+#endif
 			(void) download_client_disconnect(&dlc);
 			send_error_evt(FOTA_DOWNLOAD_ERROR_CAUSE_INVALID_UPDATE);
 			return err;
 		}
 
+#if defined(CONFIG_FOTA_DOWNLOAD_RESUME)
+		/* The record identifies the file being downloaded, the
+		 * progress itself is kept by the DFU target. Store it once
+		 * the validator of the file has been received.
+		 */
+		if (image_count == 0 && event->fragment.offset == 0 &&
+		    dfu_target_flush() == 0 &&
+		    dfu_target_offset_get(&offset) == 0) {
+			err = download_client_resume_save(&dlc, offset,
+							  img_type);
+			if (err != 0) {
+				LOG_WRN("Unable to store resume record: %d",
+					err);
+			}
+		}
+#endif
+
 		if (IS_ENABLED(CONFIG_FOTA_DOWNLOAD_PROGRESS_EVT) &&
 		    !first_fragment) {
 			err = dfu_target_offset_get(&offset);
@@ -164,6 +340,10 @@ static int download_client_callback(const struct download_client_evt *event)
 	}
 
 	case DOWNLOAD_CLIENT_EVT_DONE:
+		if (image_count > 0) {
+			return image_done();
+		}
+
 		err = dfu_target_done(true);
 		if (err != 0) {
 			LOG_ERR("dfu_target_done error: %d", err);
@@ -176,11 +356,21 @@ static int download_client_callback(const struct download_client_evt *event)
 			send_error_evt(FOTA_DOWNLOAD_ERROR_CAUSE_DOWNLOAD_FAILED);
 			return err;
 		}
+#if defined(CONFIG_FOTA_DOWNLOAD_RESUME)
+		(void)download_client_resume_clear(&dlc);
+#endif
 		send_evt(FOTA_DOWNLOAD_EVT_FINISHED);
 		first_fragment = true;
 		break;
 
 	case DOWNLOAD_CLIENT_EVT_ERROR: {
+#if defined(CONFIG_FOTA_DOWNLOAD_RESUME)
+		if (event->error == -ECANCELED) {
+			LOG_WRN("File changed on server, restarting download");
+			resume_restart();
+			return event->error;
+		}
+#endif
 		/* In case of socket errors we can return 0 to retry/continue,
 		 * or non-zero to stop
 		 */
@@ -195,7 +385,7 @@ static int download_client_callback(const struct download_client_evt *event)
 		} else {
 			download_client_disconnect(&dlc);
 			LOG_ERR("Download client error");
-			err = dfu_target_done(false);
+			err = target_abort();
 			if (err == -EACCES) {
 				LOG_DBG("No DFU target was initialized");
 			} else if (err != 0) {
@@ -240,15 +430,56 @@ static void download_with_offset(struct k_work *unused)
 	return;
 }
 
+#ifdef PM_S1_ADDRESS
+/* B1 upgrade is supported, check what B1 slot is active,
+ * (s0 or s1), and update file to point to correct candidate if
+ * space separated file is given.
+ */
+static int b1_file_select(const char **file)
+{
+	int err;
+	const char *update;
+	struct fw_info s0;
+	struct fw_info s1;
+
+	err = spm_firmware_info(PM_S0_ADDRESS, &s0);
+	if (err != 0) {
+		return err;
+	}
+
+	err = spm_firmware_info(PM_S1_ADDRESS, &s1);
+	if (err != 0) {
+		return err;
+	}
+
+	bool s0_active = s0.version >= s1.version;
+
+	err = dfu_ctx_mcuboot_set_b1_file(*file, s0_active, &update);
+	if (err != 0) {
+		return err;
+	}
+
+	if (update != NULL) {
+		LOG_INF("B1 update, selected file:\n%s", update);
+		*file = update;
+	}
+
+	return 0;
+}
+#endif /* PM_S1_ADDRESS */
+
 int fota_download_start(const char *host, const char *file, int sec_tag,
 			const char *apn, size_t fragment_size)
 {
 	int err = -1;
+	size_t from = 0;
 
 	struct download_client_cfg config = {
 		.sec_tag = sec_tag,
 		.apn = apn,
 		.frag_size_override = fragment_size,
+		.resume_key = IS_ENABLED(CONFIG_FOTA_DOWNLOAD_RESUME) ?
+			      "fota_download" : NULL,
 	};
 
 	if (host == NULL || file == NULL || callback == NULL) {
@@ -256,46 +487,98 @@ int fota_download_start(const char *host, const char *file, int sec_tag,
 	}
 
 	socket_retries_left = CONFIG_FOTA_SOCKET_RETRIES;
+	image_count = 0;
 
-#ifdef PM_S1_ADDRESS
-	/* B1 upgrade is supported, check what B1 slot is active,
-	 * (s0 or s1), and update file to point to correct candidate if
-	 * space separated file is given.
-	 */
-	const char *update;
-	struct fw_info s0;
-	struct fw_info s1;
+	if (IS_ENABLED(CONFIG_DFU_TARGET_STREAM_HASH)) {
+		/* The file is downloaded without an expected digest */
+		(void)dfu_target_digest_set(NULL, 0);
+	}
 
-	err = spm_firmware_info(PM_S0_ADDRESS, &s0);
+#ifdef PM_S1_ADDRESS
+	err = b1_file_select(&file);
 	if (err != 0) {
 		return err;
 	}
+#endif /* PM_S1_ADDRESS */
 
-	err = spm_firmware_info(PM_S1_ADDRESS, &s1);
+	err = download_client_connect(&dlc, host, &config);
 	if (err != 0) {
 		return err;
 	}
 
-	bool s0_active = s0.version >= s1.version;
+#if defined(CONFIG_FOTA_DOWNLOAD_RESUME)
+	from = resume_offset_get(file);
+#endif
 
-	err = dfu_ctx_mcuboot_set_b1_file(file, s0_active, &update);
+	err = download_client_start(&dlc, file, from);
 	if (err != 0) {
+		download_client_disconnect(&dlc);
 		return err;
 	}
 
-	if (update != NULL) {
-		LOG_INF("B1 update, selected file:\n%s", update);
-		file = update;
+	return 0;
+}
+
+int fota_download_manifest_start(const char *host,
+				 const struct fota_download_image *manifest,
+				 size_t count, int sec_tag, const char *apn,
+				 size_t fragment_size)
+{
+	int err;
+
+	/* The images share the connection, a resume record
+	 * can only describe one file.
+	 */
+	struct download_client_cfg config = {
+		.sec_tag = sec_tag,
+		.apn = apn,
+		.frag_size_override = fragment_size,
+	};
+
+	if (host == NULL || manifest == NULL || callback == NULL ||
+	    count == 0 || count > ARRAY_SIZE(images)) {
+		return -EINVAL;
 	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (manifest[i].file == NULL) {
+			return -EINVAL;
+		}
+
+		images[i] = manifest[i];
+#ifdef PM_S1_ADDRESS
+		err = b1_file_select(&images[i].file);
+		if (err != 0) {
+			return err;
+		}
 #endif /* PM_S1_ADDRESS */
+	}
+
+	socket_retries_left = CONFIG_FOTA_SOCKET_RETRIES;
+	first_fragment = true;
+	image_idx = 0;
+
+	/* Discard images staged by an interrupted download */
+	err = dfu_target_reset();
+	if (err != 0) {
+		return err;
+	}
+
+	err = image_digest_set();
+	if (err != 0) {
+		return err;
+	}
 
 	err = download_client_connect(&dlc, host, &config);
 	if (err != 0) {
 		return err;
 	}
 
-	err = download_client_start(&dlc, file, 0);
+	image_count = count;
+
+	err = download_client_start(&dlc, images[0].file, 0);
 	if (err != 0) {
+		image_count = 0;
 		download_client_disconnect(&dlc);
 		return err;
 	}
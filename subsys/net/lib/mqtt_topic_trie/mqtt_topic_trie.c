@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <net/mqtt_topic_trie.h>
+
+#define ROOT 0
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+struct level {
+	const char *ptr;
+	size_t len;
+	uint32_t hash;
+};
+
+struct match_ctx {
+	const struct mqtt_topic_trie *trie;
+	const struct level *levels;
+	size_t level_count;
+	const char *end;
+	struct mqtt_topic_trie_match *match;
+};
+
+static uint32_t level_hash(const char *level, size_t len)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ (uint8_t)level[i]) * FNV_PRIME;
+	}
+
+	return hash;
+}
+
+static size_t slot_first(const struct mqtt_topic_trie *trie, uint16_t parent,
+			 uint32_t hash)
+{
+	return (hash ^ (parent * 2654435761u)) % trie->slot_count;
+}
+
+/* Find the literal child of parent for a topic level. The hash table is at
+ * most half full, so the probe sequence is short.
+ */
+static uint16_t literal_find(const struct mqtt_topic_trie *trie,
+			     uint16_t parent, const char *level, size_t len,
+			     uint32_t hash)
+{
+	size_t slot = slot_first(trie, parent, hash);
+
+	for (size_t i = 0; i < trie->slot_count; i++) {
+		uint16_t index = trie->slots[slot];
+		const struct mqtt_topic_trie_node *node = &trie->nodes[index];
+
+		if (index == 0) {
+			return 0;
+		}
+
+		if (node->parent == parent && node->level_hash == hash &&
+		    node->level_len == len && !memcmp(node->level, level, len)) {
+			return index;
+		}
+
+		slot = (slot + 1) % trie->slot_count;
+	}
+
+	return 0;
+}
+
+static int node_add(struct mqtt_topic_trie *trie, uint16_t parent,
+		    const char *level, size_t len, uint32_t hash)
+{
+	struct mqtt_topic_trie_node *node;
+
+	if (trie->node_count >= trie->node_max) {
+		return -ENOMEM;
+	}
+
+	node = &trie->nodes[trie->node_count];
+	node->level = level;
+	node->level_len = len;
+	node->parent = parent;
+	node->plus = 0;
+	node->hash = 0;
+	node->level_hash = hash;
+	node->id = -1;
+
+	return trie->node_count++;
+}
+
+static int literal_add(struct mqtt_topic_trie *trie, uint16_t parent,
+		       const char *level, size_t len, uint32_t hash)
+{
+	size_t slot = slot_first(trie, parent, hash);
+	int index = node_add(trie, parent, level, len, hash);
+
+	if (index < 0) {
+		return index;
+	}
+
+	/* There are twice as many slots as nodes, so a free one is found */
+	while (trie->slots[slot] != 0) {
+		slot = (slot + 1) % trie->slot_count;
+	}
+
+	trie->slots[slot] = index;
+
+	return index;
+}
+
+/* Get the next topic level, starting at *pos. Returns false when there are
+ * no more levels.
+ */
+static bool level_next(const char **pos, const char *end, bool *last,
+		       struct level *level)
+{
+	const char *sep;
+
+	if (*last) {
+		return false;
+	}
+
+	sep = memchr(*pos, '/', end - *pos);
+	if (sep == NULL) {
+		sep = end;
+		*last = true;
+	}
+
+	level->ptr = *pos;
+	level->len = sep - *pos;
+	level->hash = level_hash(level->ptr, level->len);
+
+	*pos = sep + 1;
+
+	return true;
+}
+
+static bool is_wildcard(const struct level *level, char wildcard)
+{
+	return level->len == 1 && level->ptr[0] == wildcard;
+}
+
+void mqtt_topic_trie_clear(struct mqtt_topic_trie *trie)
+{
+	memset(trie->slots, 0, trie->slot_count * sizeof(trie->slots[0]));
+	trie->node_count = 0;
+
+	(void)node_add(trie, ROOT, NULL, 0, 0);
+}
+
+static int filter_check(const char *filter, size_t len)
+{
+	const char *pos = filter;
+	struct level level;
+	bool last = false;
+	size_t wildcards = 0;
+	size_t levels = 0;
+
+	while (level_next(&pos, filter + len, &last, &level)) {
+		levels++;
+
+		if (is_wildcard(&level, '#')) {
+			if (!last) {
+				return -EINVAL;
+			}
+			wildcards++;
+		} else if (is_wildcard(&level, '+')) {
+			wildcards++;
+		} else if (memchr(level.ptr, '+', level.len) ||
+			   memchr(level.ptr, '#', level.len)) {
+			return -EINVAL;
+		}
+	}
+
+	if (wildcards > CONFIG_MQTT_TOPIC_TRIE_CAPTURE_MAX ||
+	    levels > CONFIG_MQTT_TOPIC_TRIE_LEVEL_MAX) {
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int mqtt_topic_trie_add(struct mqtt_topic_trie *trie, const char *filter,
+			size_t len, int id)
+{
+	const char *pos = filter;
+	struct level level;
+	bool last = false;
+	uint16_t index = ROOT;
+	int err;
+
+	if (trie == NULL || filter == NULL || len == 0 || id < 0) {
+		return -EINVAL;
+	}
+
+	err = filter_check(filter, len);
+	if (err) {
+		return err;
+	}
+
+	if (trie->node_count == 0) {
+		mqtt_topic_trie_clear(trie);
+	}
+
+	while (level_next(&pos, filter + len, &last, &level)) {
+		uint16_t *wildcard = NULL;
+		int child;
+
+		if (is_wildcard(&level, '#')) {
+			wildcard = &trie->nodes[index].hash;
+		} else if (is_wildcard(&level, '+')) {
+			wildcard = &trie->nodes[index].plus;
+		}
+
+		if (wildcard != NULL) {
+			child = *wildcard;
+			if (child == 0) {
+				child = node_add(trie, index, level.ptr,
+						 level.len, level.hash);
+				if (child < 0) {
+					return child;
+				}
+				*wildcard = child;
+			}
+		} else {
+			child = literal_find(trie, index, level.ptr, level.len,
+					     level.hash);
+			if (child == 0) {
+				child = literal_add(trie, index, level.ptr,
+						    level.len, level.hash);
+				if (child < 0) {
+					return child;
+				}
+			}
+		}
+
+		index = child;
+	}
+
+	if (trie->nodes[index].id >= 0) {
+		return -EALREADY;
+	}
+
+	trie->nodes[index].id = id;
+
+	return 0;
+}
+
+static void capture(struct match_ctx *ctx, const char *ptr, size_t len)
+{
+	struct mqtt_topic_trie_match *match = ctx->match;
+
+	/* The number of wildcards in a filter is checked when it is added */
+	match->capture[match->capture_count].ptr = ptr;
+	match->capture[match->capture_count].len = len;
+	match->capture_count++;
+}
+
+static int node_match(struct match_ctx *ctx, size_t depth, uint16_t index)
+{
+	const struct mqtt_topic_trie_node *node = &ctx->trie->nodes[index];
+	const struct mqtt_topic_trie_node *hash = &ctx->trie->nodes[node->hash];
+	const struct level *level = &ctx->levels[depth];
+	size_t capture_count = ctx->match->capture_count;
+	uint16_t child;
+	int ret;
+
+	if (depth == ctx->level_count) {
+		if (node->id >= 0) {
+			return node->id;
+		}
+
+		/* "a/#" also matches "a" */
+		if (node->hash != 0 && hash->id >= 0) {
+			capture(ctx, ctx->end, 0);
+			return hash->id;
+		}
+
+		return -ENOENT;
+	}
+
+	child = literal_find(ctx->trie, index, level->ptr, level->len,
+			     level->hash);
+	if (child != 0) {
+		ret = node_match(ctx, depth + 1, child);
+		if (ret >= 0) {
+			return ret;
+		}
+	}
+
+	/* Topics starting with '$' are reserved, and wildcards at the first
+	 * level do not match them.
+	 */
+	if (depth == 0 && level->len > 0 && level->ptr[0] == '$') {
+		return -ENOENT;
+	}
+
+	if (node->plus != 0) {
+		capture(ctx, level->ptr, level->len);
+
+		ret = node_match(ctx, depth + 1, node->plus);
+		if (ret >= 0) {
+			return ret;
+		}
+
+		ctx->match->capture_count = capture_count;
+	}
+
+	if (node->hash != 0 && hash->id >= 0) {
+		capture(ctx, level->ptr, ctx->end - level->ptr);
+		return hash->id;
+	}
+
+	return -ENOENT;
+}
+
+int mqtt_topic_trie_match(const struct mqtt_topic_trie *trie,
+			  const char *topic, size_t len,
+			  struct mqtt_topic_trie_match *match)
+{
+	struct level levels[CONFIG_MQTT_TOPIC_TRIE_LEVEL_MAX];
+	struct mqtt_topic_trie_match unused;
+	struct match_ctx ctx = {
+		.trie = trie,
+		.levels = levels,
+		.end = topic + len,
+		.match = match ? match : &unused,
+	};
+	const char *pos = topic;
+	bool last = false;
+
+	ctx.match->capture_count = 0;
+
+	if (trie == NULL || trie->node_count == 0 || topic == NULL ||
+	    len == 0) {
+		return -ENOENT;
+	}
+
+	while (level_next(&pos, ctx.end, &last,
+			  &levels[ctx.level_count])) {
+		ctx.level_count++;
+
+		if (ctx.level_count == ARRAY_SIZE(levels) && !last) {
+			return -E2BIG;
+		}
+	}
+
+	return node_match(&ctx, 0, ROOT);
+}
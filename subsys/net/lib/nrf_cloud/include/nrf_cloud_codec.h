@@ -45,6 +45,37 @@ int nrf_cloud_encode_config_response(struct nrf_cloud_data const *const input,
 				     struct nrf_cloud_data *const output,
 				     bool *const has_config);
 
+/**@brief Reduce a shadow update to the values that changed since the last
+ * acknowledged one.
+ *
+ * @param[in] input  Complete update.
+ * @param[in] id     Message ID the patch is sent with. Its acknowledgment is
+ *                   passed to @ref nrf_cloud_shadow_cache_ack.
+ * @param[out] output Patch.
+ *
+ * @retval 0 If the update was reduced. @p output must be freed.
+ * @retval -ENODATA If no value changed, and nothing needs to be sent.
+ * @retval -ENOTSUP If the shadow cache is disabled.
+ * @return Otherwise, a negative error code. The update must be sent as it
+ *         is, and the next one is complete.
+ */
+int nrf_cloud_encode_shadow_patch(const struct nrf_cloud_data *input,
+				  uint16_t id, struct nrf_cloud_data *output);
+
+/**@brief Mark the last shadow patch sent as acknowledged, if @p id is its
+ * message ID. The patches before it were sent on the same connection, so
+ * they have been received too.
+ *
+ * @retval true If @p id is the ID of the last patch sent.
+ */
+bool nrf_cloud_shadow_cache_ack(uint16_t id);
+
+/**@brief Check the version of a shadow document received from the cloud. */
+void nrf_cloud_shadow_cache_version_check(const struct nrf_cloud_data *input);
+
+/**@brief Forget the reported state, so that the next update is complete. */
+void nrf_cloud_shadow_cache_invalidate(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,6 +13,11 @@
 extern "C" {
 #endif
 
+/** Highest of the fixed message IDs of the library, such as the ones of the
+ *  subscriptions and of the state requests and reports.
+ */
+#define NCT_MSG_ID_FIXED_MAX 9999
+
 enum nct_evt_type {
 	NCT_EVT_CONNECTED,
 	NCT_EVT_CC_CONNECTED,
@@ -73,7 +78,20 @@ int nct_cc_connect(void);
 /**@brief Establishes the logical data channel on the transport connection. */
 int nct_dc_connect(void);
 
-/**@brief Sends data on the control channel. */
+/**@brief Get a message ID for a publication.
+ *
+ * IDs are allocated in turn above @ref NCT_MSG_ID_FIXED_MAX, so that they
+ * do not collide with the fixed IDs of the library or with each other
+ * while in flight. The IDs of the AWS FOTA job execution engine are left
+ * out.
+ */
+uint16_t nct_next_message_id(void);
+
+/**@brief Sends data on the control channel. A message ID is allocated if
+ * @p cc has none. The acknowledgment is reported with a @ref
+ * NCT_EVT_CC_TX_DATA_ACK event. Returns -EBUSY if
+ * CONFIG_NRF_CLOUD_CC_INFLIGHT_MAX messages are already waiting for one.
+ */
 int nct_cc_send(const struct nct_cc_data *cc);
 
 /**@brief Sends data on the data channel. Reliable, should expect a @ref
@@ -111,6 +129,12 @@ void nct_dc_endpoint_get(struct nrf_cloud_data *tx_endpoint,
 			 struct nrf_cloud_data *rx_endpoint,
 			 struct nrf_cloud_data *m_endpoint);
 
+/**
+ * @brief Check if the endpoint information is set. It is kept while the
+ *        session is persistent, also when the transport is disconnected.
+ */
+bool nct_dc_endpoint_valid(void);
+
 /**@brief Needed for keep alive. */
 void nct_process(void);
 
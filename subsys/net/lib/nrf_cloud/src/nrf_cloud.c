@@ -36,6 +36,35 @@ static nrf_cloud_event_handler_t app_event_handler;
 
 static K_MUTEX_DEFINE(state_mutex);
 
+static struct nrf_cloud_connect_stats connect_stats;
+/* Uptime when the last connection was started, -1 if none */
+static int64_t connect_start = -1;
+
+/* Record the time of the connection steps, as the state machine notifies
+ * them.
+ */
+static void connect_stats_update(enum nfsm_state state,
+				 const struct nrf_cloud_evt *evt)
+{
+	uint32_t elapsed = k_uptime_get() - connect_start;
+
+	if (state == STATE_CLOUD_STATE_REQUESTED) {
+		connect_stats.shadow_requested = true;
+	}
+
+	if (evt == NULL) {
+		return;
+	}
+
+	if (evt->type == NRF_CLOUD_EVT_TRANSPORT_CONNECTED) {
+		connect_stats.connack_ms = elapsed;
+		connect_stats.persistent_session = (evt->status != 0);
+	} else if ((evt->type == NRF_CLOUD_EVT_READY) &&
+		   (connect_stats.ready_ms == 0)) {
+		connect_stats.ready_ms = elapsed;
+	}
+}
+
 enum nfsm_state nfsm_get_current_state(void)
 {
 	return current_state;
@@ -48,6 +77,7 @@ void nfsm_set_current_state_and_notify(enum nfsm_state state,
 	LOG_DBG("state: %d", state);
 
 	current_state = state;
+	connect_stats_update(state, evt);
 	if ((app_event_handler != NULL) && (evt != NULL)) {
 		app_event_handler(evt);
 	}
@@ -91,11 +121,39 @@ int nrf_cloud_init(const struct nrf_cloud_init_param *param)
 
 int nrf_cloud_connect(const struct nrf_cloud_connect_param *param)
 {
+	int err;
+
 	if (NOT_VALID_STATE(STATE_INITIALIZED)) {
 		return -EACCES;
 	}
 	atomic_set(&disconnect_requested, 0);
-	return nct_connect();
+
+	/* Updates may have been lost with the previous connection */
+	nrf_cloud_shadow_cache_invalidate();
+
+	memset(&connect_stats, 0, sizeof(connect_stats));
+	connect_start = k_uptime_get();
+
+	err = nct_connect();
+
+	connect_stats.handshake_ms = k_uptime_get() - connect_start;
+
+	return err;
+}
+
+int nrf_cloud_connect_stats_get(struct nrf_cloud_connect_stats *stats)
+{
+	if (stats == NULL) {
+		return -EINVAL;
+	}
+
+	if (connect_start < 0) {
+		return -ENODATA;
+	}
+
+	*stats = connect_stats;
+
+	return 0;
 }
 
 int nrf_cloud_disconnect(void)
@@ -109,14 +167,47 @@ int nrf_cloud_disconnect(void)
 	return nct_disconnect();
 }
 
-int nrf_cloud_shadow_update(const struct nrf_cloud_sensor_data *param)
+/* Send a shadow update, reduced to the values that changed if the shadow
+ * cache is enabled. The update is sent with the tag of the application as
+ * message ID, or with a new one if it has none.
+ */
+static int shadow_update_send(const struct nrf_cloud_data *update, uint32_t id)
 {
 	int err;
-	struct nct_cc_data sensor_data = {
+	struct nct_cc_data shadow_data = {
 		.opcode = NCT_CC_OPCODE_UPDATE_REQ,
-		.id = param->tag
+		.id = id ? id : nct_next_message_id(),
 	};
 
+	/* The acknowledgment of the patch is matched by its ID */
+	err = nrf_cloud_encode_shadow_patch(update, shadow_data.id,
+					    &shadow_data.data);
+	if (err == -ENODATA) {
+		LOG_DBG("Reported state unchanged, shadow update not sent");
+		return 0;
+	}
+
+	if (err) {
+		shadow_data.data = *update;
+		return nct_cc_send(&shadow_data);
+	}
+
+	err = nct_cc_send(&shadow_data);
+	nrf_cloud_free((void *)shadow_data.data.ptr);
+
+	/* The patch will not be acknowledged */
+	if (err) {
+		nrf_cloud_shadow_cache_invalidate();
+	}
+
+	return err;
+}
+
+int nrf_cloud_shadow_update(const struct nrf_cloud_sensor_data *param)
+{
+	int err;
+	struct nrf_cloud_data update;
+
 	if (NOT_VALID_STATE(STATE_DC_CONNECTED)) {
 		return -EACCES;
 	}
@@ -125,13 +216,13 @@ int nrf_cloud_shadow_update(const struct nrf_cloud_sensor_data *param)
 		return -EINVAL;
 	}
 
-	err = nrf_cloud_encode_shadow_data(param, &sensor_data.data);
+	err = nrf_cloud_encode_shadow_data(param, &update);
 	if (err) {
 		return err;
 	}
 
-	err = nct_cc_send(&sensor_data);
-	nrf_cloud_free((void *)sensor_data.data.ptr);
+	err = shadow_update_send(&update, param->tag);
+	nrf_cloud_free((void *)update.ptr);
 
 	return err;
 }
@@ -272,6 +363,7 @@ static void api_event_handler(const struct nrf_cloud_evt *nrf_cloud_evt)
 		LOG_DBG("NRF_CLOUD_EVT_SENSOR_DATA_ACK");
 
 		evt.type = CLOUD_EVT_DATA_SENT;
+		evt.data.msg.message_id = nrf_cloud_evt->tag;
 
 		cloud_notify_event(nrf_cloud_backend, &evt, config->user_data);
 		break;
@@ -430,7 +522,8 @@ static int api_send(const struct cloud_backend *const backend,
 	case CLOUD_EP_MSG: {
 		const struct nct_dc_data buf = {
 			.data.ptr = msg->buf,
-			.data.len = msg->len
+			.data.len = msg->len,
+			.id = msg->message_id
 		};
 
 		if (msg->qos == CLOUD_QOS_AT_MOST_ONCE) {
@@ -445,13 +538,12 @@ static int api_send(const struct cloud_backend *const backend,
 		break;
 	}
 	case CLOUD_EP_STATE: {
-		struct nct_cc_data shadow_data = {
-			.opcode = NCT_CC_OPCODE_UPDATE_REQ,
-			.data.ptr = msg->buf,
-			.data.len = msg->len
+		const struct nrf_cloud_data update = {
+			.ptr = msg->buf,
+			.len = msg->len
 		};
 
-		err = nct_cc_send(&shadow_data);
+		err = shadow_update_send(&update, msg->message_id);
 		if (err) {
 			LOG_ERR("nct_cc_send failed, error: %d\n", err);
 			return err;
@@ -9,6 +9,7 @@
 #include <drivers/gps.h>
 #include <net/socket.h>
 #include <nrf_socket.h>
+#include <sys/byteorder.h>
 
 #include <modem/modem_info.h>
 #include <net/nrf_cloud_agps.h>
@@ -26,6 +27,38 @@ static int fd = -1;
 static bool agps_print_enabled;
 static const struct device *gps_dev;
 
+enum agps_parser_state {
+	AGPS_PARSER_VERSION,
+	AGPS_PARSER_HEADER,
+	AGPS_PARSER_ELEMENT,
+	AGPS_PARSER_DONE,
+};
+
+/* Incremental parser state. Only a single element is buffered at any time,
+ * so RAM usage does not depend on the size of the A-GPS response.
+ */
+static struct {
+	enum agps_parser_state state;
+	enum nrf_cloud_agps_type type;
+	uint16_t elements_left;
+	size_t element_size;
+	/* Number of bytes of the current header or element collected. */
+	size_t offset;
+	bool sys_time_pending;
+	struct nrf_cloud_agps_system_time sys_time;
+	union {
+		uint8_t raw[sizeof(struct nrf_cloud_agps_system_time)];
+		struct nrf_cloud_agps_utc utc;
+		struct nrf_cloud_agps_ephemeris ephemeris;
+		struct nrf_cloud_agps_almanac almanac;
+		struct nrf_cloud_agps_klobuchar klobuchar;
+		struct nrf_cloud_agps_tow_element tow;
+		struct nrf_cloud_agps_system_time time_and_tow;
+		struct nrf_cloud_agps_location location;
+		struct nrf_cloud_agps_integrity integrity;
+	} element;
+} parser;
+
 static enum gps_agps_type type_lookup_socket2gps[] = {
 	[NRF_GNSS_AGPS_UTC_PARAMETERS]	= GPS_AGPS_UTC_PARAMETERS,
 	[NRF_GNSS_AGPS_EPHEMERIDES]	= GPS_AGPS_EPHEMERIDES,
@@ -398,7 +431,7 @@ static int agps_send_to_modem(struct nrf_cloud_apgs_element *agps_data)
 {
 	switch (agps_data->type) {
 	case NRF_CLOUD_AGPS_UTC_PARAMETERS: {
-		nrf_gnss_agps_data_utc_t utc;
+		nrf_gnss_agps_data_utc_t utc = {0};
 
 		copy_utc(&utc, agps_data);
 		LOG_DBG("A-GPS type: NRF_CLOUD_AGPS_UTC_PARAMETERS");
@@ -407,7 +440,7 @@ static int agps_send_to_modem(struct nrf_cloud_apgs_element *agps_data)
 				     NRF_GNSS_AGPS_UTC_PARAMETERS);
 	}
 	case NRF_CLOUD_AGPS_EPHEMERIDES: {
-		nrf_gnss_agps_data_ephemeris_t ephemeris;
+		nrf_gnss_agps_data_ephemeris_t ephemeris = {0};
 
 		copy_ephemeris(&ephemeris, agps_data);
 		LOG_DBG("A-GPS type: NRF_CLOUD_AGPS_EPHEMERIDES");
@@ -416,7 +449,7 @@ static int agps_send_to_modem(struct nrf_cloud_apgs_element *agps_data)
 				     NRF_GNSS_AGPS_EPHEMERIDES);
 	}
 	case NRF_CLOUD_AGPS_ALMANAC: {
-		nrf_gnss_agps_data_almanac_t almanac;
+		nrf_gnss_agps_data_almanac_t almanac = {0};
 
 		copy_almanac(&almanac, agps_data);
 		LOG_DBG("A-GPS type: NRF_CLOUD_AGPS_ALMANAC");
@@ -425,7 +458,7 @@ static int agps_send_to_modem(struct nrf_cloud_apgs_element *agps_data)
 				     NRF_GNSS_AGPS_ALMANAC);
 	}
 	case NRF_CLOUD_AGPS_KLOBUCHAR_CORRECTION: {
-		nrf_gnss_agps_data_klobuchar_t klobuchar;
+		nrf_gnss_agps_data_klobuchar_t klobuchar = {0};
 
 		copy_klobuchar(&klobuchar, agps_data);
 		LOG_DBG("A-GPS type: NRF_CLOUD_AGPS_KLOBUCHAR_CORRECTION");
@@ -434,7 +467,7 @@ static int agps_send_to_modem(struct nrf_cloud_apgs_element *agps_data)
 				NRF_GNSS_AGPS_KLOBUCHAR_IONOSPHERIC_CORRECTION);
 	}
 	case NRF_CLOUD_AGPS_GPS_SYSTEM_CLOCK: {
-		nrf_gnss_agps_data_system_time_and_sv_tow_t time_and_tow;
+		nrf_gnss_agps_data_system_time_and_sv_tow_t time_and_tow = {0};
 
 		copy_time_and_tow(&time_and_tow, agps_data);
 		LOG_DBG("A-GPS type: NRF_CLOUD_AGPS_GPS_SYSTEM_CLOCK");
@@ -465,95 +498,175 @@ static int agps_send_to_modem(struct nrf_cloud_apgs_element *agps_data)
 	return 0;
 }
 
-static size_t get_next_agps_element(struct nrf_cloud_apgs_element *element,
-				    const char *buf)
+static size_t element_size_get(enum nrf_cloud_agps_type type)
 {
-	static uint16_t elements_left_to_process;
-	static enum nrf_cloud_agps_type element_type;
-	size_t len = 0;
-
-	/* Check if there are more elements left in the array to process.
-	 * The element type is only given once before the array, and not for
-	 * each element.
-	 */
-	if (elements_left_to_process == 0) {
-		element->type =
-			(enum nrf_cloud_agps_type)buf[NRF_CLOUD_AGPS_BIN_TYPE_OFFSET];
-		element_type = element->type;
-		elements_left_to_process =
-			*(uint16_t *)&buf[NRF_CLOUD_AGPS_BIN_COUNT_OFFSET] - 1;
-		len += NRF_CLOUD_AGPS_BIN_TYPE_SIZE +
-			NRF_CLOUD_AGPS_BIN_COUNT_SIZE;
-	} else {
-		element->type = element_type;
-		elements_left_to_process -= 1;
+	switch (type) {
+	case NRF_CLOUD_AGPS_UTC_PARAMETERS:
+		return sizeof(struct nrf_cloud_agps_utc);
+	case NRF_CLOUD_AGPS_EPHEMERIDES:
+		return sizeof(struct nrf_cloud_agps_ephemeris);
+	case NRF_CLOUD_AGPS_ALMANAC:
+		return sizeof(struct nrf_cloud_agps_almanac);
+	case NRF_CLOUD_AGPS_KLOBUCHAR_CORRECTION:
+		return sizeof(struct nrf_cloud_agps_klobuchar);
+	case NRF_CLOUD_AGPS_GPS_SYSTEM_CLOCK:
+		/* The TOW array is sent as separate elements. */
+		return sizeof(parser.sys_time) -
+			sizeof(parser.sys_time.sv_tow) + 4;
+	case NRF_CLOUD_AGPS_GPS_TOWS:
+		return sizeof(struct nrf_cloud_agps_tow_element);
+	case NRF_CLOUD_AGPS_LOCATION:
+		return sizeof(struct nrf_cloud_agps_location);
+	case NRF_CLOUD_AGPS_INTEGRITY:
+		return sizeof(struct nrf_cloud_agps_integrity);
+	default:
+		return 0;
 	}
+}
+
+static void element_setup(struct nrf_cloud_apgs_element *element)
+{
+	uint8_t *data = parser.element.raw;
+
+	element->type = parser.type;
 
 	switch (element->type) {
 	case NRF_CLOUD_AGPS_UTC_PARAMETERS:
-		element->utc = (struct nrf_cloud_agps_utc *)(buf + len);
-		len += sizeof(struct nrf_cloud_agps_utc);
+		element->utc = (struct nrf_cloud_agps_utc *)data;
 		break;
 	case NRF_CLOUD_AGPS_EPHEMERIDES:
-		element->ephemeris = (struct nrf_cloud_agps_ephemeris *)(buf + len);
-		len += sizeof(struct nrf_cloud_agps_ephemeris);
+		element->ephemeris = (struct nrf_cloud_agps_ephemeris *)data;
 		break;
 	case NRF_CLOUD_AGPS_ALMANAC:
-		element->almanac = (struct nrf_cloud_agps_almanac *)(buf + len);
-		len += sizeof(struct nrf_cloud_agps_almanac);
+		element->almanac = (struct nrf_cloud_agps_almanac *)data;
 		break;
 	case NRF_CLOUD_AGPS_KLOBUCHAR_CORRECTION:
 		element->ion_correction.klobuchar =
-			(struct nrf_cloud_agps_klobuchar *)(buf + len);
-		len += sizeof(struct nrf_cloud_agps_klobuchar);
+			(struct nrf_cloud_agps_klobuchar *)data;
 		break;
 	case NRF_CLOUD_AGPS_GPS_SYSTEM_CLOCK:
 		element->time_and_tow =
-			(struct nrf_cloud_agps_system_time *)(buf + len);
-		len += sizeof(struct nrf_cloud_agps_system_time) -
-			sizeof(element->time_and_tow->sv_tow) + 4;
+			(struct nrf_cloud_agps_system_time *)data;
 		break;
 	case NRF_CLOUD_AGPS_GPS_TOWS:
-		element->tow =
-			(struct nrf_cloud_agps_tow_element *)(buf + len);
-		len += sizeof(struct nrf_cloud_agps_tow_element);
+		element->tow = (struct nrf_cloud_agps_tow_element *)data;
 		break;
 	case NRF_CLOUD_AGPS_LOCATION:
-		element->location = (struct nrf_cloud_agps_location *)(buf + len);
-		len += sizeof(struct nrf_cloud_agps_location);
+		element->location = (struct nrf_cloud_agps_location *)data;
 		break;
 	case NRF_CLOUD_AGPS_INTEGRITY:
-		element->integrity =
-			(struct nrf_cloud_agps_integrity *)(buf + len);
-		len += sizeof(struct nrf_cloud_agps_integrity);
+		element->integrity = (struct nrf_cloud_agps_integrity *)data;
 		break;
 	default:
-		LOG_DBG("Unhandled A-GPS data type: %d", element->type);
+		break;
+	}
+}
+
+/* System time is injected once the whole binary has been parsed, as the
+ * TOW elements it carries are received as a separate array.
+ */
+static int sys_time_flush(void)
+{
+	struct nrf_cloud_apgs_element element = {
+		.type = NRF_CLOUD_AGPS_GPS_SYSTEM_CLOCK,
+		.time_and_tow = &parser.sys_time,
+	};
+
+	if (!parser.sys_time_pending) {
 		return 0;
 	}
 
-	return len;
+	parser.sys_time_pending = false;
+
+	return agps_send_to_modem(&element);
 }
 
-int nrf_cloud_agps_process(const char *buf, size_t buf_len, const int *socket)
+static int element_process(void)
 {
-	int err;
 	struct nrf_cloud_apgs_element element = {};
-	struct nrf_cloud_agps_system_time sys_time;
-	size_t parsed_len = 0;
-	uint8_t version;
+	uint8_t sv_idx;
+
+	element_setup(&element);
 
-	version = buf[NRF_CLOUD_AGPS_BIN_SCHEMA_VERSION_INDEX];
-	parsed_len += NRF_CLOUD_AGPS_BIN_SCHEMA_VERSION_SIZE;
+	switch (element.type) {
+	case NRF_CLOUD_AGPS_GPS_TOWS:
+		sv_idx = element.tow->sv_id - 1;
 
-	__ASSERT(version == NRF_CLOUD_AGPS_BIN_SCHEMA_VERSION,
-		 "Cannot parse schema version: %d", version);
+		if (sv_idx >= NRF_CLOUD_AGPS_MAX_SV_TOW) {
+			LOG_WRN("Invalid TOW SV ID: %d", element.tow->sv_id);
+			return 0;
+		}
 
-	LOG_DBG("Receievd AGPS data. Schema version: %d, length: %d",
-		version, buf_len);
+		memcpy(&parser.sys_time.sv_tow[sv_idx], element.tow,
+		       sizeof(parser.sys_time.sv_tow[0]));
 
+		LOG_DBG("TOW %d copied", sv_idx);
+
+		return 0;
+	case NRF_CLOUD_AGPS_GPS_SYSTEM_CLOCK:
+		memcpy(&parser.sys_time, element.time_and_tow,
+		       sizeof(parser.sys_time) - sizeof(parser.sys_time.sv_tow));
+		parser.sys_time_pending = true;
+
+		LOG_DBG("System time copied, bitmask: 0x%08x",
+			parser.sys_time.sv_mask);
+
+		return 0;
+	default:
+		return agps_send_to_modem(&element);
+	}
+}
+
+static int header_process(void)
+{
+	parser.type = (enum nrf_cloud_agps_type)
+		parser.element.raw[NRF_CLOUD_AGPS_BIN_TYPE_OFFSET];
+	parser.elements_left =
+		sys_get_le16(&parser.element.raw[NRF_CLOUD_AGPS_BIN_COUNT_OFFSET]);
+	parser.element_size = element_size_get(parser.type);
+
+	if (parser.element_size == 0) {
+		LOG_DBG("Unhandled A-GPS data type: %d, parsing finished",
+			parser.type);
+		parser.state = AGPS_PARSER_DONE;
+		return 0;
+	}
+
+	LOG_DBG("A-GPS type %d, %d element(s)", parser.type,
+		parser.elements_left);
+
+	parser.state = parser.elements_left ?
+		AGPS_PARSER_ELEMENT : AGPS_PARSER_HEADER;
+
+	return 0;
+}
+
+/* Collect up to the number of bytes the current state needs. Returns true
+ * when the element or header is complete.
+ */
+static bool collect(const char **buf, size_t *len, size_t needed)
+{
+	size_t copy_len = MIN(needed - parser.offset, *len);
+
+	memcpy(&parser.element.raw[parser.offset], *buf, copy_len);
+
+	parser.offset += copy_len;
+	*buf += copy_len;
+	*len -= copy_len;
+
+	if (parser.offset < needed) {
+		return false;
+	}
+
+	parser.offset = 0;
+
+	return true;
+}
+
+static int sink_init(const int *socket)
+{
 	if (socket) {
-		LOG_DBG("Using user-provided socket, fd %d", fd);
+		LOG_DBG("Using user-provided socket, fd %d", *socket);
 
 		gps_dev = NULL;
 		fd = *socket;
@@ -565,41 +678,125 @@ int nrf_cloud_agps_process(const char *buf, size_t buf_len, const int *socket)
 		}
 	}
 
-	while (parsed_len < buf_len) {
-		size_t element_size =
-			get_next_agps_element(&element, &buf[parsed_len]);
+	return 0;
+}
 
-		if (element_size == 0) {
-			LOG_DBG("Parsing finished\n");
-			break;
-		}
+int nrf_cloud_agps_stream_init(const int *socket)
+{
+	int err;
 
-		parsed_len += element_size;
+	err = sink_init(socket);
+	if (err) {
+		return err;
+	}
+
+	memset(&parser, 0, sizeof(parser));
+	parser.state = AGPS_PARSER_VERSION;
+
+	return 0;
+}
 
-		LOG_DBG("Parsed_len: %d\n", parsed_len);
+int nrf_cloud_agps_stream_process(const char *buf, size_t buf_len)
+{
+	int err;
+	uint8_t version;
 
-		if (element.type == NRF_CLOUD_AGPS_GPS_TOWS) {
-			memcpy(&sys_time.sv_tow[element.tow->sv_id - 1],
-				element.tow,
-				sizeof(sys_time.sv_tow[0]));
+	while (buf_len > 0) {
+		switch (parser.state) {
+		case AGPS_PARSER_VERSION:
+			version = buf[NRF_CLOUD_AGPS_BIN_SCHEMA_VERSION_INDEX];
+			buf += NRF_CLOUD_AGPS_BIN_SCHEMA_VERSION_SIZE;
+			buf_len -= NRF_CLOUD_AGPS_BIN_SCHEMA_VERSION_SIZE;
 
-			LOG_DBG("TOW %d copied", element.tow->sv_id - 1);
+			if (version != NRF_CLOUD_AGPS_BIN_SCHEMA_VERSION) {
+				LOG_ERR("Cannot parse schema version: %d",
+					version);
+				parser.state = AGPS_PARSER_DONE;
+				return -EBADMSG;
+			}
 
-			continue;
-		} else if (element.type == NRF_CLOUD_AGPS_GPS_SYSTEM_CLOCK) {
-			memcpy(&sys_time, element.time_and_tow,
-				sizeof(sys_time) - sizeof(sys_time.sv_tow));
+			LOG_DBG("Received A-GPS data. Schema version: %d",
+				version);
 
-			LOG_DBG("TOWs copied, bitmask: 0x%08x",
-				element.time_and_tow->sv_mask);
-		}
+			parser.state = AGPS_PARSER_HEADER;
+			break;
+		case AGPS_PARSER_HEADER:
+			if (!collect(&buf, &buf_len,
+				     NRF_CLOUD_AGPS_BIN_TYPE_SIZE +
+				     NRF_CLOUD_AGPS_BIN_COUNT_SIZE)) {
+				break;
+			}
+
+			err = header_process();
+			if (err) {
+				return err;
+			}
 
-		err = agps_send_to_modem(&element);
-		if (err) {
-			LOG_ERR("Failed to send data to modem, error: %d", err);
-			return err;
+			break;
+		case AGPS_PARSER_ELEMENT:
+			if (!collect(&buf, &buf_len, parser.element_size)) {
+				break;
+			}
+
+			parser.elements_left -= 1;
+			if (parser.elements_left == 0) {
+				parser.state = AGPS_PARSER_HEADER;
+			}
+
+			err = element_process();
+			if (err) {
+				LOG_ERR("Failed to send data to modem, error: %d",
+					err);
+				return err;
+			}
+
+			break;
+		case AGPS_PARSER_DONE:
+			return 0;
+		default:
+			return -EINVAL;
 		}
 	}
 
 	return 0;
 }
+
+int nrf_cloud_agps_stream_finish(void)
+{
+	int err;
+	bool complete = (parser.state == AGPS_PARSER_DONE) ||
+			((parser.state == AGPS_PARSER_HEADER) &&
+			 (parser.offset == 0));
+
+	err = sys_time_flush();
+	if (err) {
+		LOG_ERR("Failed to send data to modem, error: %d", err);
+		return err;
+	}
+
+	if (!complete) {
+		LOG_WRN("A-GPS data ended in the middle of an element");
+		return -ENODATA;
+	}
+
+	LOG_DBG("Parsing finished");
+
+	return 0;
+}
+
+int nrf_cloud_agps_process(const char *buf, size_t buf_len, const int *socket)
+{
+	int err;
+
+	err = nrf_cloud_agps_stream_init(socket);
+	if (err) {
+		return err;
+	}
+
+	err = nrf_cloud_agps_stream_process(buf, buf_len);
+	if (err) {
+		return err;
+	}
+
+	return nrf_cloud_agps_stream_finish();
+}
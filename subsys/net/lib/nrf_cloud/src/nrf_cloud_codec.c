@@ -11,6 +11,9 @@
 #include <string.h>
 #include <zephyr.h>
 #include <logging/log.h>
+#include <json_writer.h>
+#include <json_tok.h>
+#include <net/shadow_cache.h>
 #include "cJSON.h"
 #include "cJSON_os.h"
 
@@ -20,6 +23,16 @@ LOG_MODULE_REGISTER(nrf_cloud_codec, CONFIG_NRF_CLOUD_LOG_LEVEL);
 #define TIMEOUT_STR "timeout"
 #define PAIRED_STR "paired"
 
+#if defined(CONFIG_NRF_CLOUD_SHADOW_CACHE)
+/* Reported state acknowledged by the shadow. Updates are reduced by the
+ * application thread and acknowledged by the connection thread.
+ */
+SHADOW_CACHE_DEFINE(shadow_cache, CONFIG_NRF_CLOUD_SHADOW_CACHE_FIELDS);
+static K_MUTEX_DEFINE(shadow_cache_lock);
+/* Message ID of the last patch sent, 0 if none is in flight */
+static uint16_t shadow_cache_id;
+#endif
+
 static const char *const sensor_type_str[] = {
 	[NRF_CLOUD_SENSOR_GPS] = "GPS",
 	[NRF_CLOUD_SENSOR_FLIP] = "FLIP",
@@ -41,75 +54,44 @@ static int json_add_obj(cJSON *parent, const char *str, cJSON *item)
 	return 0;
 }
 
-static int json_add_str(cJSON *parent, const char *str, const char *item)
-{
-	cJSON *json_str;
+/* --- Lookups in the tokens of a received message --- */
 
-	json_str = cJSON_CreateString(item);
-	if (json_str == NULL) {
-		return -ENOMEM;
-	}
-
-	return json_add_obj(parent, str, json_str);
-}
-
-static int json_add_null(cJSON *parent, const char *str)
+static int tok_decode_and_alloc(const char *json,
+				const struct json_tok *toks, int tok,
+				struct nrf_cloud_data *data)
 {
-	cJSON *json_null;
-
-	json_null = cJSON_CreateNull();
-	if (json_null == NULL) {
-		return -ENOMEM;
-	}
-
-	return json_add_obj(parent, str, json_null);
-}
+	int len = tok < 0 ? -ENOENT : json_tok_str(json, &toks[tok], NULL, 0);
 
-static cJSON *json_object_decode(cJSON *obj, const char *str)
-{
-	return obj ? cJSON_GetObjectItem(obj, str) : NULL;
-}
-
-static int json_decode_and_alloc(cJSON *obj, struct nrf_cloud_data *data)
-{
-	if (obj == NULL || (obj->type != cJSON_String)) {
+	if (len < 0) {
 		data->ptr = NULL;
 		return -ENOENT;
 	}
 
-	data->len = strlen(obj->valuestring);
+	data->len = len;
 	data->ptr = nrf_cloud_malloc(data->len + 1);
 
 	if (data->ptr == NULL) {
 		return -ENOMEM;
 	}
 
-	strncpy((char *)data->ptr, obj->valuestring, data->len + 1);
+	(void)json_tok_str(json, &toks[tok], (char *)data->ptr, data->len + 1);
 
 	return 0;
 }
 
-static bool compare(const char *s1, const char *s2)
+static int nrf_cloud_decode_desired_tok(const char *json,
+					const struct json_tok *toks)
 {
-	return !strncmp(s1, s2, strlen(s2));
-}
+	/* On initial pairing, a shadow delta event is sent */
+	/* which does not include the "desired" JSON key, */
+	/* "state" is used instead */
+	int state_tok = json_tok_find(json, toks, 0, "state");
 
-static void nrf_cloud_decode_desired_obj(cJSON *const root_obj,
-					 cJSON **desired_obj)
-{
-	cJSON *state_obj;
-
-	if ((root_obj != NULL) && (desired_obj != NULL)) {
-		/* On initial pairing, a shadow delta event is sent */
-		/* which does not include the "desired" JSON key, */
-		/* "state" is used instead */
-		state_obj = json_object_decode(root_obj, "state");
-		if (state_obj == NULL) {
-			*desired_obj = json_object_decode(root_obj, "desired");
-		} else {
-			*desired_obj = state_obj;
-		}
+	if (state_tok < 0) {
+		return json_tok_find(json, toks, 0, "desired");
 	}
+
+	return state_tok;
 }
 
 int nrf_codec_init(void)
@@ -119,143 +101,175 @@ int nrf_codec_init(void)
 	return 0;
 }
 
-int nrf_cloud_encode_shadow_data(const struct nrf_cloud_sensor_data *sensor,
-				 struct nrf_cloud_data *output)
+/* Encode in two passes, the first one sizes the output buffer */
+static int json_encode(int (*write)(struct json_writer *w, const void *ctx),
+		       const void *ctx, struct nrf_cloud_data *output)
 {
-	int ret;
+	int len;
 	char *buffer;
+	struct json_writer w;
 
-	__ASSERT_NO_MSG(sensor != NULL);
-	__ASSERT_NO_MSG(sensor->data.ptr != NULL);
-	__ASSERT_NO_MSG(sensor->data.len != 0);
-	__ASSERT_NO_MSG(output != NULL);
-
-	cJSON *root_obj = cJSON_CreateObject();
-	cJSON *state_obj = cJSON_CreateObject();
-	cJSON *reported_obj = cJSON_CreateObject();
+	json_writer_init(&w, NULL, 0);
+	(void)write(&w, ctx);
+	len = json_writer_finish(&w);
+	if (len < 0) {
+		return len;
+	}
 
-	if (root_obj == NULL || state_obj == NULL || reported_obj == NULL) {
-		cJSON_Delete(root_obj);
-		cJSON_Delete(state_obj);
-		cJSON_Delete(reported_obj);
+	buffer = nrf_cloud_malloc(len + 1);
+	if (buffer == NULL) {
 		return -ENOMEM;
 	}
 
-	ret = json_add_obj(reported_obj, sensor_type_str[sensor->type],
-			   (cJSON *)sensor->data.ptr);
-	ret += json_add_obj(state_obj, "reported", reported_obj);
-	ret += json_add_obj(root_obj, "state", state_obj);
-
-	if (ret != 0) {
-		cJSON_Delete(root_obj);
-		cJSON_Delete(state_obj);
-		cJSON_Delete(reported_obj);
+	json_writer_init(&w, buffer, len + 1);
+	(void)write(&w, ctx);
+	len = json_writer_finish(&w);
+	if (len < 0) {
+		nrf_cloud_free(buffer);
+		return len;
 	}
 
-	buffer = cJSON_PrintUnformatted(root_obj);
-	cJSON_Delete(root_obj);
-
 	output->ptr = buffer;
-	output->len = strlen(buffer);
+	output->len = len;
 
 	return 0;
 }
 
-int nrf_cloud_encode_sensor_data(const struct nrf_cloud_sensor_data *sensor,
+struct shadow_data {
+	const char *type;
+	const char *reported;
+};
+
+static int shadow_data_write(struct json_writer *w, const void *ctx)
+{
+	const struct shadow_data *data = ctx;
+
+	json_writer_obj_start(w, NULL);
+	json_writer_obj_start(w, "state");
+	json_writer_obj_start(w, "reported");
+	json_writer_raw(w, data->type, data->reported, strlen(data->reported));
+	json_writer_obj_end(w);
+	json_writer_obj_end(w);
+
+	return json_writer_obj_end(w);
+}
+
+int nrf_cloud_encode_shadow_data(const struct nrf_cloud_sensor_data *sensor,
 				 struct nrf_cloud_data *output)
 {
 	int ret;
+	char *reported;
 
 	__ASSERT_NO_MSG(sensor != NULL);
 	__ASSERT_NO_MSG(sensor->data.ptr != NULL);
 	__ASSERT_NO_MSG(sensor->data.len != 0);
 	__ASSERT_NO_MSG(output != NULL);
 
-	cJSON *root_obj = cJSON_CreateObject();
-
-	if (root_obj == NULL) {
+	/* The data is consumed, as when it was added to the shadow tree */
+	reported = cJSON_PrintUnformatted((cJSON *)sensor->data.ptr);
+	cJSON_Delete((cJSON *)sensor->data.ptr);
+	if (reported == NULL) {
 		return -ENOMEM;
 	}
 
-	ret = json_add_str(root_obj, "appId", sensor_type_str[sensor->type]);
-	ret += json_add_str(root_obj, "data", sensor->data.ptr);
-	ret += json_add_str(root_obj, "messageType", "DATA");
+	const struct shadow_data data = {
+		.type = sensor_type_str[sensor->type],
+		.reported = reported,
+	};
 
-	if (ret != 0) {
-		cJSON_Delete(root_obj);
-		return -ENOMEM;
-	}
+	ret = json_encode(shadow_data_write, &data, output);
+	cJSON_FreeString(reported);
 
-	char *buffer;
+	return ret;
+}
 
-	buffer = cJSON_PrintUnformatted(root_obj);
-	cJSON_Delete(root_obj);
+static int sensor_data_write(struct json_writer *w, const void *ctx)
+{
+	const struct nrf_cloud_sensor_data *sensor = ctx;
 
-	output->ptr = buffer;
-	output->len = strlen(buffer);
+	json_writer_obj_start(w, NULL);
+	json_writer_str(w, "appId", sensor_type_str[sensor->type]);
+	json_writer_str(w, "data", sensor->data.ptr);
+	json_writer_str(w, "messageType", "DATA");
 
-	return 0;
+	return json_writer_obj_end(w);
 }
 
-int nrf_cloud_decode_requested_state(const struct nrf_cloud_data *input,
-				     enum nfsm_state *requested_state)
+int nrf_cloud_encode_sensor_data(const struct nrf_cloud_sensor_data *sensor,
+				 struct nrf_cloud_data *output)
 {
-	__ASSERT_NO_MSG(requested_state != NULL);
-	__ASSERT_NO_MSG(input != NULL);
-	__ASSERT_NO_MSG(input->ptr != NULL);
-	__ASSERT_NO_MSG(input->len != 0);
-
-	cJSON *root_obj;
-	cJSON *desired_obj;
-	cJSON *pairing_obj;
-	cJSON *pairing_state_obj;
-	cJSON *topic_prefix_obj;
+	__ASSERT_NO_MSG(sensor != NULL);
+	__ASSERT_NO_MSG(sensor->data.ptr != NULL);
+	__ASSERT_NO_MSG(sensor->data.len != 0);
+	__ASSERT_NO_MSG(output != NULL);
 
-	root_obj = cJSON_Parse(input->ptr);
-	if (root_obj == NULL) {
-		LOG_ERR("cJSON_Parse failed: %s",
-			log_strdup((char *)input->ptr));
-		return -ENOENT;
-	}
+	return json_encode(sensor_data_write, sensor, output);
+}
 
-	nrf_cloud_decode_desired_obj(root_obj, &desired_obj);
+static int requested_state_decode(const char *json,
+				  const struct json_tok *toks,
+				  enum nfsm_state *requested_state)
+{
+	int desired_tok = nrf_cloud_decode_desired_tok(json, toks);
+	int pairing_state_tok;
 
-	topic_prefix_obj =
-		json_object_decode(desired_obj, "nrfcloud_mqtt_topic_prefix");
-	if (topic_prefix_obj != NULL) {
+	if (json_tok_find(json, toks, desired_tok,
+			  "nrfcloud_mqtt_topic_prefix") >= 0) {
 		(*requested_state) = STATE_UA_PIN_COMPLETE;
-		cJSON_Delete(root_obj);
 		return 0;
 	}
 
-	pairing_obj = json_object_decode(desired_obj, "pairing");
-	pairing_state_obj = json_object_decode(pairing_obj, "state");
+	pairing_state_tok = json_tok_find(json, toks, desired_tok,
+					  "pairing.state");
 
-	if (!pairing_state_obj || pairing_state_obj->type != cJSON_String) {
-		if (cJSON_HasObjectItem(desired_obj, "config") == false) {
+	if (pairing_state_tok < 0 ||
+	    toks[pairing_state_tok].type != JSON_TOK_STR) {
+		if (json_tok_find(json, toks, desired_tok, "config") < 0) {
 			LOG_WRN("Unhandled data received from nRF Cloud.");
 			LOG_INF("Ensure device firmware is up to date.");
 			LOG_INF("Delete and re-add device to nRF Cloud if problem persists.");
 		}
-		cJSON_Delete(root_obj);
 		return -ENOENT;
 	}
 
-	const char *state_str = pairing_state_obj->valuestring;
-
-	if (compare(state_str, DUA_PIN_STR)) {
+	if (json_tok_eq(json, &toks[pairing_state_tok], DUA_PIN_STR)) {
 		(*requested_state) = STATE_UA_PIN_WAIT;
 	} else {
 		LOG_ERR("Deprecated state. Delete device from nRF Cloud and update device with JITP certificates.");
-		cJSON_Delete(root_obj);
 		return -ENOTSUP;
 	}
 
-	cJSON_Delete(root_obj);
-
 	return 0;
 }
 
+int nrf_cloud_decode_requested_state(const struct nrf_cloud_data *input,
+				     enum nfsm_state *requested_state)
+{
+	__ASSERT_NO_MSG(requested_state != NULL);
+	__ASSERT_NO_MSG(input != NULL);
+	__ASSERT_NO_MSG(input->ptr != NULL);
+	__ASSERT_NO_MSG(input->len != 0);
+
+	struct json_tok buf[CONFIG_NRF_CLOUD_JSON_TOKENS];
+	struct json_tok *toks;
+	int err;
+
+	/* The shadow is tokenized in place, the tokens are allocated only
+	 * if it has more than fit on the stack.
+	 */
+	err = json_tok_parse_alloc(input->ptr, input->len, buf,
+				   ARRAY_SIZE(buf), &toks);
+	if (err < 0) {
+		LOG_ERR("json_tok_parse_alloc failed: %d", err);
+		return -ENOENT;
+	}
+
+	err = requested_state_decode(input->ptr, toks, requested_state);
+	json_tok_free(toks, buf);
+
+	return err;
+}
+
 int nrf_cloud_encode_config_response(struct nrf_cloud_data const *const input,
 				     struct nrf_cloud_data *const output,
 				     bool *const has_config)
@@ -338,41 +352,26 @@ int nrf_cloud_encode_config_response(struct nrf_cloud_data const *const input,
 	return 0;
 }
 
-int nrf_cloud_encode_state(uint32_t reported_state, struct nrf_cloud_data *output)
+static int state_write(struct json_writer *w, const void *ctx)
 {
-	int ret;
+	uint32_t reported_state = *(const uint32_t *)ctx;
 
-	__ASSERT_NO_MSG(output != NULL);
-
-	cJSON *root_obj = cJSON_CreateObject();
-	cJSON *state_obj = cJSON_CreateObject();
-	cJSON *reported_obj = cJSON_CreateObject();
-	cJSON *pairing_obj = cJSON_CreateObject();
-	cJSON *connection_obj = cJSON_CreateObject();
-
-	if ((root_obj == NULL) || (state_obj == NULL) ||
-	    (reported_obj == NULL) || (pairing_obj == NULL) ||
-	    (connection_obj == NULL)) {
-		cJSON_Delete(root_obj);
-		cJSON_Delete(state_obj);
-		cJSON_Delete(reported_obj);
-		cJSON_Delete(pairing_obj);
-		cJSON_Delete(connection_obj);
-
-		return -ENOMEM;
-	}
-
-	ret = 0;
+	json_writer_obj_start(w, NULL);
+	json_writer_obj_start(w, "state");
+	json_writer_obj_start(w, "reported");
 
 	switch (reported_state) {
 	case STATE_UA_PIN_WAIT: {
-		ret += json_add_str(pairing_obj, "state", DUA_PIN_STR);
-		ret += json_add_null(pairing_obj, "topics");
-		ret += json_add_null(pairing_obj, "config");
-		ret += json_add_null(reported_obj, "stage");
-		ret += json_add_null(reported_obj,
-				     "nrfcloud_mqtt_topic_prefix");
-		ret += json_add_null(connection_obj, "keepalive");
+		json_writer_null(w, "stage");
+		json_writer_null(w, "nrfcloud_mqtt_topic_prefix");
+		json_writer_obj_start(w, "pairing");
+		json_writer_str(w, "state", DUA_PIN_STR);
+		json_writer_null(w, "topics");
+		json_writer_null(w, "config");
+		json_writer_obj_end(w);
+		json_writer_obj_start(w, "connection");
+		json_writer_null(w, "keepalive");
+		json_writer_obj_end(w);
 		break;
 	}
 	case STATE_UA_PIN_COMPLETE: {
@@ -382,80 +381,94 @@ int nrf_cloud_encode_state(uint32_t reported_state, struct nrf_cloud_data *outpu
 
 		/* Get the endpoint information. */
 		nct_dc_endpoint_get(&tx_endp, &rx_endp, &m_endp);
-		ret += json_add_str(reported_obj, "nrfcloud_mqtt_topic_prefix",
-				    m_endp.ptr);
+		json_writer_str(w, "nrfcloud_mqtt_topic_prefix", m_endp.ptr);
 
 		/* Clear pairing config and pairingStatus fields. */
-		ret += json_add_str(pairing_obj, "state", PAIRED_STR);
-		ret += json_add_null(pairing_obj, "config");
-		ret += json_add_null(reported_obj, "pairingStatus");
-
-		/* Report keepalive value. */
-		if (cJSON_AddNumberToObject(connection_obj, "keepalive",
-					    CONFIG_MQTT_KEEPALIVE) == NULL) {
-			ret = -ENOMEM;
-		}
+		json_writer_null(w, "pairingStatus");
+		json_writer_obj_start(w, "pairing");
+		json_writer_str(w, "state", PAIRED_STR);
+		json_writer_null(w, "config");
 
 		/* Report pairing topics. */
-		cJSON *topics_obj = cJSON_CreateObject();
+		json_writer_obj_start(w, "topics");
+		json_writer_str(w, "d2c", tx_endp.ptr);
+		json_writer_str(w, "c2d", rx_endp.ptr);
+		json_writer_obj_end(w);
+		json_writer_obj_end(w);
 
-		if (topics_obj == NULL) {
-			cJSON_Delete(root_obj);
-			cJSON_Delete(state_obj);
-			cJSON_Delete(reported_obj);
-			cJSON_Delete(pairing_obj);
-			cJSON_Delete(connection_obj);
-
-			return -ENOMEM;
-		}
-
-		ret += json_add_str(topics_obj, "d2c", tx_endp.ptr);
-		ret += json_add_str(topics_obj, "c2d", rx_endp.ptr);
-		ret += json_add_obj(pairing_obj, "topics", topics_obj);
-
-		if (ret != 0) {
-			cJSON_Delete(topics_obj);
-		}
+		/* Report keepalive value. */
+		json_writer_obj_start(w, "connection");
+		json_writer_int(w, "keepalive", CONFIG_MQTT_KEEPALIVE);
+		json_writer_obj_end(w);
 		break;
 	}
-	default: {
-		cJSON_Delete(root_obj);
-		cJSON_Delete(state_obj);
-		cJSON_Delete(reported_obj);
-		cJSON_Delete(pairing_obj);
-		cJSON_Delete(connection_obj);
+	default:
 		return -ENOTSUP;
 	}
+
+	json_writer_obj_end(w);
+	json_writer_obj_end(w);
+
+	return json_writer_obj_end(w);
+}
+
+int nrf_cloud_encode_state(uint32_t reported_state, struct nrf_cloud_data *output)
+{
+	__ASSERT_NO_MSG(output != NULL);
+
+	if (reported_state != STATE_UA_PIN_WAIT &&
+	    reported_state != STATE_UA_PIN_COMPLETE) {
+		return -ENOTSUP;
 	}
 
-	ret += json_add_obj(reported_obj, "pairing", pairing_obj);
-	ret += json_add_obj(reported_obj, "connection", connection_obj);
-	ret += json_add_obj(state_obj, "reported", reported_obj);
-	ret += json_add_obj(root_obj, "state", state_obj);
+	return json_encode(state_write, &reported_state, output);
+}
 
-	if (ret != 0) {
-		cJSON_Delete(root_obj);
-		cJSON_Delete(state_obj);
-		cJSON_Delete(reported_obj);
-		cJSON_Delete(pairing_obj);
-		cJSON_Delete(connection_obj);
+static int data_endpoint_decode(const char *json,
+				const struct json_tok *toks,
+				struct nrf_cloud_data *tx_endpoint,
+				struct nrf_cloud_data *rx_endpoint,
+				struct nrf_cloud_data *m_endpoint)
+{
+	int err;
+	int m_endpoint_tok = -ENOENT;
+	int desired_tok = nrf_cloud_decode_desired_tok(json, toks);
+	int pairing_tok;
+	int pairing_state_tok;
+	int topic_tok;
 
-		return -ENOMEM;
+	if (m_endpoint != NULL) {
+		m_endpoint_tok = json_tok_find(json, toks, desired_tok,
+					       "nrfcloud_mqtt_topic_prefix");
 	}
 
-	char *buffer;
+	pairing_tok = json_tok_find(json, toks, desired_tok, "pairing");
+	pairing_state_tok = json_tok_find(json, toks, pairing_tok, "state");
+	topic_tok = json_tok_find(json, toks, pairing_tok, "topics");
 
-	buffer = cJSON_PrintUnformatted(root_obj);
-	cJSON_Delete(root_obj);
+	if ((pairing_state_tok < 0) || (topic_tok < 0) ||
+	    !json_tok_eq(json, &toks[pairing_state_tok], PAIRED_STR)) {
+		return -ENOENT;
+	}
 
-	if (buffer == NULL) {
-		return -ENOMEM;
+	if (m_endpoint_tok >= 0) {
+		err = tok_decode_and_alloc(json, toks, m_endpoint_tok,
+					   m_endpoint);
+		if (err) {
+			return err;
+		}
 	}
 
-	output->ptr = buffer;
-	output->len = strlen(buffer);
+	err = tok_decode_and_alloc(json, toks,
+				   json_tok_find(json, toks, topic_tok, "d2c"),
+				   tx_endpoint);
+	if (err) {
+		return err;
+	}
 
-	return 0;
+	return tok_decode_and_alloc(json, toks,
+				    json_tok_find(json, toks, topic_tok, "c2d"),
+				    rx_endpoint);
 }
 
 /**
@@ -477,64 +490,127 @@ int nrf_cloud_decode_data_endpoint(const struct nrf_cloud_data *input,
 	__ASSERT_NO_MSG(rx_endpoint != NULL);
 
 	int err;
-	cJSON *root_obj;
-	cJSON *m_endpoint_obj = NULL;
-	cJSON *desired_obj = NULL;
+	struct json_tok buf[CONFIG_NRF_CLOUD_JSON_TOKENS];
+	struct json_tok *toks;
 
-	root_obj = cJSON_Parse(input->ptr);
-	if (root_obj == NULL) {
+	err = json_tok_parse_alloc(input->ptr, input->len, buf,
+				   ARRAY_SIZE(buf), &toks);
+	if (err < 0) {
 		return -ENOENT;
 	}
 
-	nrf_cloud_decode_desired_obj(root_obj, &desired_obj);
+	err = data_endpoint_decode(input->ptr, toks, tx_endpoint, rx_endpoint,
+				   m_endpoint);
+	json_tok_free(toks, buf);
 
-	if (m_endpoint != NULL) {
-		m_endpoint_obj = json_object_decode(
-			desired_obj, "nrfcloud_mqtt_topic_prefix");
-	}
+	return err;
+}
 
-	cJSON *pairing_obj = json_object_decode(desired_obj, "pairing");
-	cJSON *pairing_state_obj = json_object_decode(pairing_obj, "state");
-	cJSON *topic_obj = json_object_decode(pairing_obj, "topics");
+int nrf_cloud_encode_shadow_patch(const struct nrf_cloud_data *input,
+				  uint16_t id, struct nrf_cloud_data *output)
+{
+	__ASSERT_NO_MSG(input != NULL);
+	__ASSERT_NO_MSG(input->ptr != NULL);
+	__ASSERT_NO_MSG(output != NULL);
 
-	if ((pairing_state_obj == NULL) || (topic_obj == NULL) ||
-	    (pairing_state_obj->type != cJSON_String)) {
-		cJSON_Delete(root_obj);
-		return -ENOENT;
+#if defined(CONFIG_NRF_CLOUD_SHADOW_CACHE)
+	char *buffer;
+	int len;
+
+	k_mutex_lock(&shadow_cache_lock, K_FOREVER);
+
+	/* The patch is never longer than the update */
+	buffer = nrf_cloud_malloc(input->len + 1);
+	if (buffer == NULL) {
+		len = -ENOMEM;
+	} else {
+		len = shadow_cache_diff(&shadow_cache, input->ptr, input->len,
+					buffer, input->len + 1);
 	}
 
-	const char *state_str = pairing_state_obj->valuestring;
+	/* The update is sent as it is, so its values are no longer known */
+	if (len < 0) {
+		shadow_cache_invalidate(&shadow_cache);
+		shadow_cache_id = 0;
+	} else if (len > 0) {
+		shadow_cache_id = id;
+	}
 
-	if (!compare(state_str, PAIRED_STR)) {
-		cJSON_Delete(root_obj);
-		return -ENOENT;
+	k_mutex_unlock(&shadow_cache_lock);
+
+	if (len <= 0) {
+		nrf_cloud_free(buffer);
+		return len == 0 ? -ENODATA : len;
 	}
 
-	if (m_endpoint_obj != NULL) {
-		err = json_decode_and_alloc(m_endpoint_obj, m_endpoint);
-		if (err) {
-			cJSON_Delete(root_obj);
-			return err;
-		}
+	LOG_DBG("Shadow update reduced from %d to %d bytes", input->len, len);
+
+	output->ptr = buffer;
+	output->len = len;
+
+	return 0;
+#else
+	return -ENOTSUP;
+#endif /* defined(CONFIG_NRF_CLOUD_SHADOW_CACHE) */
+}
+
+bool nrf_cloud_shadow_cache_ack(uint16_t id)
+{
+	bool acked = false;
+
+#if defined(CONFIG_NRF_CLOUD_SHADOW_CACHE)
+	k_mutex_lock(&shadow_cache_lock, K_FOREVER);
+	if (id != 0 && id == shadow_cache_id) {
+		/* The MQTT acknowledgment does not carry the shadow version */
+		(void)shadow_cache_ack(&shadow_cache, 0);
+		shadow_cache_id = 0;
+		acked = true;
 	}
+	k_mutex_unlock(&shadow_cache_lock);
+#endif
 
-	cJSON *tx_obj = json_object_decode(topic_obj, "d2c");
+	return acked;
+}
 
-	err = json_decode_and_alloc(tx_obj, tx_endpoint);
-	if (err) {
-		cJSON_Delete(root_obj);
-		return err;
+void nrf_cloud_shadow_cache_version_check(const struct nrf_cloud_data *input)
+{
+	__ASSERT_NO_MSG(input != NULL);
+
+#if defined(CONFIG_NRF_CLOUD_SHADOW_CACHE)
+	struct json_tok buf[CONFIG_NRF_CLOUD_JSON_TOKENS];
+	struct json_tok *toks;
+	int32_t version;
+	int tok;
+
+	if (json_tok_parse_alloc(input->ptr, input->len, buf,
+				 ARRAY_SIZE(buf), &toks) < 0) {
+		return;
 	}
 
-	cJSON *rx_obj = json_object_decode(topic_obj, "c2d");
+	tok = json_tok_find(input->ptr, toks, 0, "version");
+	if (tok < 0 || json_tok_int(input->ptr, &toks[tok], &version)) {
+		version = 0;
+	}
+	json_tok_free(toks, buf);
 
-	err = json_decode_and_alloc(rx_obj, rx_endpoint);
-	if (err) {
-		cJSON_Delete(root_obj);
-		return err;
+	if (version <= 0) {
+		return;
 	}
 
-	cJSON_Delete(root_obj);
+	k_mutex_lock(&shadow_cache_lock, K_FOREVER);
+	if (shadow_cache_version_check(&shadow_cache, version) == -ESTALE) {
+		LOG_DBG("Shadow updated elsewhere, next update is complete");
+	}
+	k_mutex_unlock(&shadow_cache_lock);
+#endif
+}
 
-	return err;
+void nrf_cloud_shadow_cache_invalidate(void)
+{
+#if defined(CONFIG_NRF_CLOUD_SHADOW_CACHE)
+	k_mutex_lock(&shadow_cache_lock, K_FOREVER);
+	shadow_cache_invalidate(&shadow_cache);
+	shadow_cache_id = 0;
+	k_mutex_unlock(&shadow_cache_lock);
+#endif
 }
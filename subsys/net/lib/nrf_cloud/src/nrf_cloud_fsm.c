@@ -204,6 +204,8 @@ static int handle_device_config_update(const struct nct_evt *const evt,
 		return -ENOENT;
 	}
 
+	nrf_cloud_shadow_cache_version_check(&evt->param.cc->data);
+
 	err = nrf_cloud_encode_config_response(&evt->param.cc->data, &msg.data,
 					       config_found);
 	if ((err) && (err != -ESRCH)) {
@@ -222,6 +224,11 @@ static int handle_device_config_update(const struct nct_evt *const evt,
 		if (err) {
 			LOG_ERR("nct_cc_send failed %d", err);
 		}
+
+		/* The response changes the reported configuration without
+		 * going through the shadow cache.
+		 */
+		nrf_cloud_shadow_cache_invalidate();
 	}
 
 	cloud_evt.data = evt->param.cc->data;
@@ -347,6 +354,20 @@ static int cc_connection_handler(const struct nct_evt *nct_evt)
 
 	nfsm_set_current_state_and_notify(STATE_CC_CONNECTED, NULL);
 
+	if (persistent_session && nct_dc_endpoint_valid()) {
+		/* The session and the data endpoints of the previous
+		 * connection are still valid. Changes to the shadow are
+		 * delivered on the delta topic, so the shadow is not
+		 * requested again.
+		 */
+		struct nct_evt nevt = { .type = NCT_EVT_DC_CONNECTED,
+					.status = 0 };
+
+		LOG_DBG("Previous session valid; skipping shadow request");
+		nfsm_handle_incoming_event(&nevt, STATE_DC_CONNECTING);
+		return 0;
+	}
+
 	/* Request the shadow state now. */
 	err = nct_cc_send(&get_request);
 	if (err) {
@@ -427,10 +448,34 @@ static int cc_rx_data_handler(const struct nct_evt *nct_evt)
 	return 0;
 }
 
+/* Report the acknowledgment of data sent by the application. */
+static void data_ack_notify(uint32_t tag)
+{
+	struct nrf_cloud_evt evt = {
+		.type = NRF_CLOUD_EVT_SENSOR_DATA_ACK,
+		.tag = tag,
+	};
+
+	nfsm_set_current_state_and_notify(nfsm_get_current_state(), &evt);
+}
+
 static int cc_tx_ack_handler(const struct nct_evt *nct_evt)
 {
 	int err;
 
+	/* Shadow updates of the application are acknowledged like data, the
+	 * state reports and requests of the library are not.
+	 */
+	if ((nct_evt->param.data_id != CLOUD_STATE_REQ_ID) &&
+	    (nct_evt->param.data_id != PAIRING_STATUS_REPORT_ID) &&
+	    (nct_evt->param.data_id != DEFAULT_REPORT_ID)) {
+		data_ack_notify(nct_evt->param.data_id);
+	}
+
+	if (nrf_cloud_shadow_cache_ack(nct_evt->param.data_id)) {
+		return 0;
+	}
+
 	if (nct_evt->param.data_id == CLOUD_STATE_REQ_ID) {
 		nfsm_set_current_state_and_notify(STATE_CLOUD_STATE_REQUESTED,
 						  NULL);
@@ -501,7 +546,9 @@ static int dc_rx_data_handler(const struct nct_evt *nct_evt)
 
 static int dc_tx_ack_handler(const struct nct_evt *nct_evt)
 {
-	return 0; /* Nothing to do */
+	data_ack_notify(nct_evt->param.data_id);
+
+	return 0;
 }
 
 static int dc_disconnection_handler(const struct nct_evt *nct_evt)
@@ -13,6 +13,7 @@
 #include <net/mqtt.h>
 #include <net/socket.h>
 #include <net/cloud.h>
+#include <net/mqtt_topic_trie.h>
 #include <logging/log.h>
 #include <sys/util.h>
 #include <settings/settings.h>
@@ -22,11 +23,27 @@
 #endif
 
 #if defined(CONFIG_AWS_FOTA)
+#include <net/aws_jobs.h>
 #include <net/aws_fota.h>
 #endif
 
+#if defined(CONFIG_CLOUD_OUTBOX)
+#include <net/cloud_outbox.h>
+#endif
+
 LOG_MODULE_REGISTER(nrf_cloud_transport, CONFIG_NRF_CLOUD_LOG_LEVEL);
 
+/* The message IDs above it are left to the cloud outbox and to the job
+ * execution engine of AWS FOTA, which shares the MQTT client.
+ */
+#if defined(CONFIG_CLOUD_OUTBOX)
+#define NCT_MSG_ID_MAX (CLOUD_OUTBOX_MESSAGE_ID_FIRST - 1)
+#elif defined(CONFIG_AWS_FOTA)
+#define NCT_MSG_ID_MAX (AWS_JOBS_EXEC_MESSAGE_ID_FIRST - 1)
+#else
+#define NCT_MSG_ID_MAX UINT16_MAX
+#endif
+
 #if defined(CONFIG_NRF_CLOUD_PROVISION_CERTIFICATES)
 #include CONFIG_NRF_CLOUD_CERTIFICATES_FILE
 #if defined(CONFIG_MODEM_KEY_MGMT)
@@ -108,9 +125,6 @@ static bool persistent_session;
 #define NCT_CC_SUBSCRIBE_ID 1234
 #define NCT_DC_SUBSCRIBE_ID 8765
 
-#define NCT_RX_LIST 0
-#define NCT_TX_LIST 1
-
 static int nct_settings_set(const char *key, size_t len_rd,
 			    settings_read_cb read_cb, void *cb_arg);
 
@@ -123,6 +137,16 @@ static int nct_settings_set(const char *key, size_t len_rd,
 SETTINGS_STATIC_HANDLER_DEFINE(nrf_cloud, SETTINGS_NAME, NULL, nct_settings_set,
 			       NULL, NULL);
 
+/* Message IDs are allocated from the control and data channels, and for
+ * shadow updates from the application.
+ */
+static struct k_spinlock message_id_lock;
+
+/* Message IDs of the control channel messages that wait for a PUBACK, 0 if
+ * free. Other PUBACKs acknowledge data channel messages.
+ */
+static uint16_t cc_inflight_ids[CONFIG_NRF_CLOUD_CC_INFLIGHT_MAX];
+
 /* Forward declaration of the event handler registered with MQTT. */
 static void nct_mqtt_evt_handler(struct mqtt_client *client,
 				 const struct mqtt_evt *evt);
@@ -136,6 +160,7 @@ static struct nct {
 	struct mqtt_utf8 dc_rx_endp;
 	struct mqtt_utf8 dc_m_endp;
 	struct mqtt_utf8 job_status_endp;
+	/* Last message ID allocated by nct_next_message_id() */
 	uint32_t message_id;
 	uint8_t rx_buf[CONFIG_NRF_CLOUD_MQTT_MESSAGE_BUFFER_LEN];
 	uint8_t tx_buf[CONFIG_NRF_CLOUD_MQTT_MESSAGE_BUFFER_LEN];
@@ -189,6 +214,11 @@ static uint32_t const nct_cc_rx_opcode_map[] = {
 	NCT_CC_OPCODE_UPDATE_ACCEPT_RSP
 };
 
+/* Control channel topics that are received on, with the index in
+ * nct_cc_rx_list as ID.
+ */
+MQTT_TOPIC_TRIE_DEFINE(nct_cc_rx_trie, 16);
+
 /* Internal routine to reset data endpoint information. */
 static void dc_endpoint_reset(void)
 {
@@ -205,16 +235,62 @@ static void dc_endpoint_reset(void)
 	nct.job_status_endp.size = 0;
 }
 
-/* Get the next unused message id. */
-static uint32_t dc_get_next_message_id(void)
+uint16_t nct_next_message_id(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&message_id_lock);
+	uint16_t message_id;
+
+	if (nct.message_id < NCT_MSG_ID_FIXED_MAX ||
+	    nct.message_id >= NCT_MSG_ID_MAX) {
+		nct.message_id = NCT_MSG_ID_FIXED_MAX;
+	}
+
+	message_id = ++nct.message_id;
+
+	k_spin_unlock(&message_id_lock, key);
+
+	return message_id;
+}
+
+/* Track the message ID of a control channel message until it is
+ * acknowledged. The library reuses some IDs, so an ID can be tracked more
+ * than once. Returns -EBUSY if there is no room to track it.
+ */
+static int cc_inflight_add(uint16_t message_id)
 {
-	nct.message_id++;
+	k_spinlock_key_t key = k_spin_lock(&message_id_lock);
+	int err = -EBUSY;
 
-	if ((uint16_t)nct.message_id == 0) {
-		nct.message_id++;
+	for (size_t i = 0; i < ARRAY_SIZE(cc_inflight_ids); i++) {
+		if (cc_inflight_ids[i] == 0) {
+			cc_inflight_ids[i] = message_id;
+			err = 0;
+			break;
+		}
 	}
 
-	return nct.message_id;
+	k_spin_unlock(&message_id_lock, key);
+
+	return err;
+}
+
+/* Stop tracking the message ID. Returns true if it was in flight. */
+static bool cc_inflight_remove(uint16_t message_id)
+{
+	k_spinlock_key_t key = k_spin_lock(&message_id_lock);
+	bool found = false;
+
+	for (size_t i = 0; i < ARRAY_SIZE(cc_inflight_ids); i++) {
+		if (cc_inflight_ids[i] == message_id) {
+			cc_inflight_ids[i] = 0;
+			found = true;
+			break;
+		}
+	}
+
+	k_spin_unlock(&message_id_lock, key);
+
+	return found;
 }
 
 /* Free memory allocated for the data endpoint and reset the endpoint.
@@ -265,45 +341,27 @@ static uint32_t dc_send(const struct nct_dc_data *dc_data, uint8_t qos)
 	if (dc_data->id != 0) {
 		publish.message_id = dc_data->id;
 	} else {
-		publish.message_id = dc_get_next_message_id();
+		publish.message_id = nct_next_message_id();
 	}
 
 	return mqtt_publish(&nct.client, &publish);
 }
 
-static bool strings_compare(const char *s1, const char *s2, uint32_t s1_len,
-			    uint32_t s2_len)
-{
-	return (strncmp(s1, s2, MIN(s1_len, s2_len))) ? false : true;
-}
-
 /* Verify if the topic is a control channel topic or not. */
-static bool control_channel_topic_match(uint32_t list_id,
-					const struct mqtt_topic *topic,
+static bool control_channel_topic_match(const struct mqtt_topic *topic,
 					enum nct_cc_opcode *opcode)
 {
-	struct mqtt_topic *topic_list;
-	uint32_t list_size;
-
-	if (list_id == NCT_RX_LIST) {
-		topic_list = (struct mqtt_topic *)nct_cc_rx_list;
-		list_size = ARRAY_SIZE(nct_cc_rx_list);
-	} else if (list_id == NCT_TX_LIST) {
-		topic_list = (struct mqtt_topic *)nct_cc_tx_list;
-		list_size = ARRAY_SIZE(nct_cc_tx_list);
-	} else {
+	int index = mqtt_topic_trie_match(&nct_cc_rx_trie,
+					  (const char *)topic->topic.utf8,
+					  topic->topic.size, NULL);
+
+	if (index < 0) {
 		return false;
 	}
 
-	for (uint32_t index = 0; index < list_size; index++) {
-		if (strings_compare(
-			    topic->topic.utf8, topic_list[index].topic.utf8,
-			    topic->topic.size, topic_list[index].topic.size)) {
-			*opcode = nct_cc_rx_opcode_map[index];
-			return true;
-		}
-	}
-	return false;
+	*opcode = nct_cc_rx_opcode_map[index];
+
+	return true;
 }
 
 /* Function to get the client id */
@@ -394,6 +452,19 @@ static int nct_topics_populate(void)
 	}
 	LOG_DBG("shadow_get_topic: %s", log_strdup(shadow_get_topic));
 
+	mqtt_topic_trie_clear(&nct_cc_rx_trie);
+
+	for (size_t i = 0; i < ARRAY_SIZE(nct_cc_rx_list); i++) {
+		ret = mqtt_topic_trie_add(&nct_cc_rx_trie,
+				(const char *)nct_cc_rx_list[i].topic.utf8,
+				nct_cc_rx_list[i].topic.size, i);
+		if (ret) {
+			LOG_ERR("Failed to add control channel topic: %d",
+				ret);
+			return ret;
+		}
+	}
+
 	return 0;
 }
 
@@ -409,6 +480,15 @@ static int nct_provision(void)
 	nct.tls_config.sec_tag_list = sec_tag_list;
 	nct.tls_config.hostname = NRF_CLOUD_HOSTNAME;
 
+#if defined(CONFIG_BSD_LIBRARY)
+	nct.tls_config.session_cache =
+		IS_ENABLED(CONFIG_NRF_CLOUD_TLS_SESSION_CACHING) ?
+			TLS_SESSION_CACHE_ENABLED : TLS_SESSION_CACHE_DISABLED;
+#else
+	/* TLS session caching is not supported by the Zephyr network stack */
+	nct.tls_config.session_cache = TLS_SESSION_CACHE_DISABLED;
+#endif
+
 #if defined(CONFIG_NRF_CLOUD_PROVISION_CERTIFICATES)
 #if defined(CONFIG_BSD_LIBRARY)
 	{
@@ -697,7 +777,13 @@ int nct_mqtt_connect(void)
 		nct.client.protocol_version = MQTT_VERSION_3_1_1;
 		nct.client.password = NULL;
 		nct.client.user_name = NULL;
-		nct.client.clean_session = persistent_session ? 0U : 1U;
+		/* The session is kept on the broker also before the
+		 * subscriptions are complete, so that it can be resumed
+		 * after the first disconnect. Whether it is valid is tracked
+		 * with the persistent_session flag.
+		 */
+		nct.client.clean_session =
+			IS_ENABLED(CONFIG_MQTT_CLEAN_SESSION) ? 1U : 0U;
 		LOG_DBG("MQTT clean session flag: %u",
 			nct.client.clean_session);
 
@@ -810,6 +896,14 @@ static void nct_mqtt_evt_handler(struct mqtt_client *const mqtt_client,
 			save_session_state(0);
 		}
 
+		/* Messages are not sent again, so the acknowledgments of the
+		 * ones in flight on the previous connection never arrive.
+		 */
+		k_spinlock_key_t key = k_spin_lock(&message_id_lock);
+
+		memset(cc_inflight_ids, 0, sizeof(cc_inflight_ids));
+		k_spin_unlock(&message_id_lock, key);
+
 		evt.type = NCT_EVT_CONNECTED;
 		event_notify = true;
 		break;
@@ -834,7 +928,7 @@ static void nct_mqtt_evt_handler(struct mqtt_client *const mqtt_client,
 		/* If the data arrives on one of the subscribed control channel
 		 * topic. Then we notify the same.
 		 */
-		if (control_channel_topic_match(NCT_RX_LIST, &p->message.topic,
+		if (control_channel_topic_match(&p->message.topic,
 						&cc.opcode)) {
 			cc.id = p->message_id;
 			cc.data.ptr = nct.payload_buf;
@@ -902,7 +996,12 @@ static void nct_mqtt_evt_handler(struct mqtt_client *const mqtt_client,
 		LOG_DBG("MQTT_EVT_PUBACK: id = %d result = %d",
 			_mqtt_evt->param.puback.message_id, _mqtt_evt->result);
 
-		evt.type = NCT_EVT_CC_TX_DATA_ACK;
+		if (cc_inflight_remove(_mqtt_evt->param.puback.message_id)) {
+			evt.type = NCT_EVT_CC_TX_DATA_ACK;
+		} else {
+			evt.type = NCT_EVT_DC_TX_DATA_ACK;
+		}
+
 		evt.param.data_id = _mqtt_evt->param.puback.message_id;
 		event_notify = true;
 		break;
@@ -1055,8 +1154,6 @@ int nct_cc_connect(void)
 
 int nct_cc_send(const struct nct_cc_data *cc_data)
 {
-	static uint32_t msg_id;
-
 	if (cc_data == NULL) {
 		LOG_ERR("cc_data == NULL");
 		return -EINVAL;
@@ -1081,15 +1178,29 @@ int nct_cc_send(const struct nct_cc_data *cc_data)
 		publish.message.payload.len = cc_data->data.len;
 	}
 
-	publish.message_id = cc_data->id ? cc_data->id : ++msg_id;
+	publish.message_id = cc_data->id ? cc_data->id : nct_next_message_id();
 
 	LOG_DBG("mqtt_publish: id = %d opcode = %d len = %d", publish.message_id,
 		cc_data->opcode, cc_data->data.len);
 
-	int err = mqtt_publish(&nct.client, &publish);
+	int err;
+
+	if (publish.message.topic.qos != MQTT_QOS_0_AT_MOST_ONCE) {
+		err = cc_inflight_add(publish.message_id);
+		if (err) {
+			LOG_ERR("Too many messages in flight");
+			return err;
+		}
+	}
+
+	err = mqtt_publish(&nct.client, &publish);
 
 	if (err) {
 		LOG_ERR("mqtt_publish failed %d", err);
+
+		if (publish.message.topic.qos != MQTT_QOS_0_AT_MOST_ONCE) {
+			(void)cc_inflight_remove(publish.message_id);
+		}
 	}
 
 	return err;
@@ -1227,10 +1338,21 @@ int nct_disconnect(void)
 {
 	LOG_DBG("nct_disconnect");
 
-	dc_endpoint_free();
+	/* The data endpoints stay valid in a persistent session, so that the
+	 * connection can be resumed without requesting the shadow again.
+	 */
+	if (!persistent_session) {
+		dc_endpoint_free();
+	}
+
 	return mqtt_disconnect(&nct.client);
 }
 
+bool nct_dc_endpoint_valid(void)
+{
+	return nct.dc_rx_endp.utf8 != NULL;
+}
+
 void nct_process(void)
 {
 	mqtt_input(&nct.client);
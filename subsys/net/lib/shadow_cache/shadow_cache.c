@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <json_tok.h>
+#include <net/shadow_cache.h>
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+struct diff_ctx {
+	struct shadow_cache *cache;
+	const char *json;
+	const struct json_tok *toks;
+	/* Patch output. The length keeps counting when the buffer is full. */
+	char *buf;
+	size_t size;
+	size_t len;
+	/* Mark the changed values as sent, instead of writing the patch */
+	bool mark;
+	/* Number of changed values that do not have a field yet */
+	size_t new_fields;
+};
+
+static uint32_t hash_add(uint32_t hash, const char *str, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ (uint8_t)str[i]) * FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/* The separator cannot occur in a member name, which keeps "a" + "bc" and
+ * "ab" + "c" apart.
+ */
+static uint32_t path_hash(uint32_t parent, const char *name, size_t len)
+{
+	return hash_add(parent * FNV_PRIME, name, len);
+}
+
+/* Hash of a value, never 0 so that 0 can mean none */
+static uint32_t value_hash(const char *value, size_t len)
+{
+	uint32_t hash = hash_add(FNV_OFFSET_BASIS, value, len);
+
+	return hash ? hash : 1;
+}
+
+static struct shadow_cache_field *field_find(struct shadow_cache *cache,
+					     uint32_t path)
+{
+	for (size_t i = 0; i < cache->count; i++) {
+		if (cache->fields[i].path == path) {
+			return &cache->fields[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void patch_write(struct diff_ctx *ctx, const char *str, size_t len)
+{
+	if (ctx->len + len < ctx->size) {
+		memcpy(&ctx->buf[ctx->len], str, len);
+	}
+
+	ctx->len += len;
+}
+
+/* Raw text of a value, including the quotes of a string */
+static const char *tok_raw(const struct diff_ctx *ctx, int tok, size_t *len)
+{
+	const struct json_tok *t = &ctx->toks[tok];
+
+	if (t->type == JSON_TOK_STR) {
+		*len = t->len + 2;
+		return &ctx->json[t->start - 1];
+	}
+
+	*len = t->len;
+	return &ctx->json[t->start];
+}
+
+static bool value_diff(struct diff_ctx *ctx, uint32_t path, int tok)
+{
+	struct shadow_cache_field *field = field_find(ctx->cache, path);
+	size_t len;
+	const char *raw = tok_raw(ctx, tok, &len);
+	uint32_t hash = value_hash(raw, len);
+
+	/* A value sent and not yet acknowledged must be sent again if it
+	 * changed back, or the report in flight would overwrite it.
+	 */
+	if (field && field->acked == hash &&
+	    (field->sent == 0 || field->sent == hash)) {
+		return false;
+	}
+
+	if (!ctx->mark) {
+		ctx->new_fields += (field == NULL);
+		patch_write(ctx, raw, len);
+		return true;
+	}
+
+	if (field == NULL) {
+		field = &ctx->cache->fields[ctx->cache->count++];
+		field->path = path;
+		field->acked = 0;
+	}
+
+	field->sent = hash;
+
+	return true;
+}
+
+/* Write the members of an object that contain a changed value. Return the
+ * number of members written.
+ */
+static size_t object_diff(struct diff_ctx *ctx, uint32_t path, int obj)
+{
+	size_t written = 0;
+	int tok = obj + 1;
+
+	patch_write(ctx, "{", 1);
+
+	while (tok < ctx->toks[obj].next) {
+		const struct json_tok *name = &ctx->toks[tok];
+		int value = tok + 1;
+		uint32_t member = path_hash(path, &ctx->json[name->start],
+					    name->len);
+		size_t start = ctx->len;
+		bool changed;
+
+		if (written) {
+			patch_write(ctx, ",", 1);
+		}
+
+		patch_write(ctx, &ctx->json[name->start - 1], name->len + 2);
+		patch_write(ctx, ":", 1);
+
+		/* Empty objects are compared as values */
+		if (ctx->toks[value].type == JSON_TOK_OBJ &&
+		    ctx->toks[value].next > value + 1) {
+			changed = object_diff(ctx, member, value) > 0;
+		} else {
+			changed = value_diff(ctx, member, value);
+		}
+
+		if (changed) {
+			written++;
+		} else {
+			ctx->len = start;
+		}
+
+		tok = ctx->toks[value].next;
+	}
+
+	patch_write(ctx, "}", 1);
+
+	return written;
+}
+
+static int cache_diff(struct diff_ctx *ctx)
+{
+	struct shadow_cache *cache = ctx->cache;
+	size_t patch_len;
+
+	if (ctx->toks[0].type != JSON_TOK_OBJ) {
+		return -EINVAL;
+	}
+
+	if (object_diff(ctx, FNV_OFFSET_BASIS, 0) == 0) {
+		if (ctx->size > 0) {
+			ctx->buf[0] = '\0';
+		}
+		return 0;
+	}
+
+	if (ctx->len >= ctx->size) {
+		return -ENOBUFS;
+	}
+
+	ctx->buf[ctx->len] = '\0';
+	patch_len = ctx->len;
+
+	/* The patch is sent either way, but if it cannot be tracked, the
+	 * next report must be complete.
+	 */
+	if (cache->count + ctx->new_fields > cache->size) {
+		shadow_cache_invalidate(cache);
+		return patch_len;
+	}
+
+	ctx->buf = NULL;
+	ctx->size = 0;
+	ctx->len = 0;
+	ctx->mark = true;
+	(void)object_diff(ctx, FNV_OFFSET_BASIS, 0);
+
+	return patch_len;
+}
+
+int shadow_cache_diff(struct shadow_cache *cache, const char *json,
+		      size_t len, char *buf, size_t size)
+{
+	struct json_tok toks[CONFIG_SHADOW_CACHE_JSON_TOKENS];
+	struct json_tok *alloc_toks;
+	struct diff_ctx ctx = {
+		.cache = cache,
+		.json = json,
+		.buf = buf,
+		.size = size,
+	};
+	int err;
+
+	__ASSERT_NO_MSG(cache != NULL);
+	__ASSERT_NO_MSG(json != NULL);
+	__ASSERT_NO_MSG(buf != NULL);
+
+	err = json_tok_parse_alloc(json, len, toks, ARRAY_SIZE(toks),
+				   &alloc_toks);
+	if (err < 0) {
+		return err;
+	}
+
+	ctx.toks = alloc_toks;
+	err = cache_diff(&ctx);
+	json_tok_free(alloc_toks, toks);
+
+	return err;
+}
+
+int shadow_cache_ack(struct shadow_cache *cache, uint32_t version)
+{
+	__ASSERT_NO_MSG(cache != NULL);
+
+	if (version != 0 && cache->version != 0 &&
+	    version != cache->version + 1) {
+		shadow_cache_invalidate(cache);
+		cache->version = version;
+		return -ESTALE;
+	}
+
+	if (version != 0) {
+		cache->version = version;
+	} else if (cache->version != 0) {
+		cache->version++;
+	}
+
+	for (size_t i = 0; i < cache->count; i++) {
+		struct shadow_cache_field *field = &cache->fields[i];
+
+		if (field->sent != 0) {
+			field->acked = field->sent;
+			field->sent = 0;
+		}
+	}
+
+	return 0;
+}
+
+int shadow_cache_version_check(struct shadow_cache *cache, uint32_t version)
+{
+	__ASSERT_NO_MSG(cache != NULL);
+
+	if (cache->version != 0 && version != cache->version &&
+	    version != cache->version + 1) {
+		shadow_cache_invalidate(cache);
+		cache->version = version;
+		return -ESTALE;
+	}
+
+	cache->version = version;
+
+	return 0;
+}
+
+void shadow_cache_invalidate(struct shadow_cache *cache)
+{
+	__ASSERT_NO_MSG(cache != NULL);
+
+	cache->count = 0;
+	cache->version = 0;
+}
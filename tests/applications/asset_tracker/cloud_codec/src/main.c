@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <date_time.h>
+#include <benchmark.h>
+#include "cJSON.h"
+#include "cJSON_os.h"
+#include "cloud_codec.h"
+
+#define MSG_COUNT 1000
+
+/* Unix time at boot, in milliseconds */
+#define BOOT_TIME_MS 1593088000000LL
+
+/* Heap operations of both encoders, counted by wrapping the kernel heap
+ * when linking.
+ */
+static uint32_t heap_ops;
+
+void *__real_k_malloc(size_t size);
+void __real_k_free(void *ptr);
+
+void *__wrap_k_malloc(size_t size)
+{
+	heap_ops++;
+	return __real_k_malloc(size);
+}
+
+void __wrap_k_free(void *ptr)
+{
+	if (ptr != NULL) {
+		heap_ops++;
+	}
+	__real_k_free(ptr);
+}
+
+/* Mocks of the date time library, the time is known unless cleared */
+static bool time_known = true;
+
+int date_time_uptime_to_unix_time_ms(int64_t *uptime)
+{
+	if (!time_known) {
+		return -ENODATA;
+	}
+
+	*uptime += BOOT_TIME_MS;
+
+	return 0;
+}
+
+int date_time_timestamp_clear(int64_t *unix_timestamp)
+{
+	*unix_timestamp = 0;
+
+	return 0;
+}
+
+static const char *const channel_str[] = {
+	[CLOUD_CHANNEL_GPS] = CLOUD_CHANNEL_STR_GPS,
+	[CLOUD_CHANNEL_TEMP] = CLOUD_CHANNEL_STR_TEMP,
+	[CLOUD_CHANNEL_FLIP] = CLOUD_CHANNEL_STR_FLIP,
+	[CLOUD_CHANNEL_LTE_LINK_RSRP] = CLOUD_CHANNEL_STR_LTE_LINK_RSRP,
+	[CLOUD_CHANNEL_BUTTON] = CLOUD_CHANNEL_STR_BUTTON,
+};
+
+#define SAMPLE_DATA(_str) { .buf = _str, .len = sizeof(_str) - 1 }
+
+/* Messages recorded from the asset tracker on a Thingy:91 */
+static struct cloud_channel_data samples[] = {
+	{
+		.type = CLOUD_CHANNEL_GPS,
+		.data = SAMPLE_DATA("$GPGGA,085634.00,6325.30562,N,01023.57853,"
+				    "E,1,07,1.30,52.5,M,39.8,M,,*6A"),
+		.ts = 496123,
+	},
+	{
+		.type = CLOUD_CHANNEL_TEMP,
+		.data = SAMPLE_DATA("24.5"),
+		.ts = 501004,
+	},
+	{
+		.type = CLOUD_CHANNEL_FLIP,
+		.data = SAMPLE_DATA("UPSIDE_DOWN"),
+		.ts = 532870,
+	},
+	{
+		.type = CLOUD_CHANNEL_LTE_LINK_RSRP,
+		.data = SAMPLE_DATA("-95"),
+		.ts = 2871,
+	},
+	{
+		/* Not sent as is, but checks that strings are escaped the
+		 * same way.
+		 */
+		.type = CLOUD_CHANNEL_BUTTON,
+		.data = SAMPLE_DATA("\"1\\2\"\n\t\x01"),
+		.ts = 600441,
+	},
+};
+
+/* The cJSON encoders replaced by the JSON writer, which give the expected
+ * output.
+ */
+static char *ref_data(const struct cloud_channel_data *channel,
+		      int64_t unix_ts)
+{
+	char *out;
+	cJSON *root = cJSON_CreateObject();
+
+	cJSON_AddItemToObject(root, "appId",
+			      cJSON_CreateString(channel_str[channel->type]));
+	cJSON_AddItemToObject(root, "data",
+			      cJSON_CreateString(channel->data.buf));
+	cJSON_AddItemToObject(root, "messageType",
+			      cJSON_CreateString(CLOUD_CMD_GROUP_STR_DATA));
+	cJSON_AddItemToObject(root, "ts", cJSON_CreateNumber(unix_ts));
+
+	out = cJSON_PrintUnformatted(root);
+	cJSON_Delete(root);
+
+	return out;
+}
+
+static char *ref_config(bool enable)
+{
+	char *out;
+	cJSON *root = cJSON_CreateObject();
+	cJSON *state = cJSON_CreateObject();
+	cJSON *reported = cJSON_CreateObject();
+	cJSON *config = cJSON_CreateObject();
+	cJSON *gps = cJSON_CreateObject();
+
+	cJSON_AddItemToObject(gps, CLOUD_CMD_TYPE_STR_ENABLE,
+			      cJSON_CreateBool(enable));
+	cJSON_AddItemToObject(config, CLOUD_CHANNEL_STR_GPS, gps);
+	cJSON_AddItemToObject(reported, "config", config);
+	cJSON_AddItemToObject(state, "reported", reported);
+	cJSON_AddItemToObject(root, "state", state);
+
+	out = cJSON_PrintUnformatted(root);
+	cJSON_Delete(root);
+
+	return out;
+}
+
+/* Byte for byte, without the terminating null character */
+static void output_check(struct cloud_msg *output, char *expected)
+{
+	zassert_not_null(expected, "cJSON failed");
+	zassert_equal(output->len, strlen(expected), "Wrong length %zu",
+		      output->len);
+	zassert_true(memcmp(output->buf, expected, output->len) == 0,
+		     "Unexpected output %s", output->buf);
+
+	cJSON_FreeString(expected);
+	k_free(output->buf);
+}
+
+static void test_data(void)
+{
+	int err;
+	struct cloud_msg output;
+
+	for (size_t i = 0; i < ARRAY_SIZE(samples); i++) {
+		err = cloud_encode_data(&samples[i], CLOUD_CMD_GROUP_DATA,
+					&output);
+		zassert_equal(err, 0, "Encoding failed: %d", err);
+		output_check(&output,
+			     ref_data(&samples[i],
+				      BOOT_TIME_MS + samples[i].ts));
+	}
+}
+
+static void test_data_without_time(void)
+{
+	int err;
+	struct cloud_msg output;
+
+	time_known = false;
+	err = cloud_encode_data(&samples[1], CLOUD_CMD_GROUP_DATA, &output);
+	time_known = true;
+
+	zassert_equal(err, 0, "Encoding failed: %d", err);
+	output_check(&output, ref_data(&samples[1], 0));
+}
+
+static void test_data_errors(void)
+{
+	struct cloud_msg output;
+	struct cloud_channel_data empty = {
+		.type = CLOUD_CHANNEL_TEMP,
+		.data.buf = "",
+	};
+
+	zassert_equal(cloud_encode_data(&empty, CLOUD_CMD_GROUP_DATA,
+					&output), -EINVAL,
+		      "Empty data encoded");
+	zassert_equal(cloud_encode_data(&samples[0], CLOUD_CMD_GROUP__TOTAL,
+					&output), -EINVAL,
+		      "Unknown group encoded");
+}
+
+static void test_config(void)
+{
+	int err;
+	struct cloud_msg output;
+
+	/* Nothing is reported while the state is not known */
+	err = cloud_encode_config_data(&output);
+	zassert_equal(err, 0, "Encoding failed: %d", err);
+	zassert_is_null(output.buf, "Unknown state reported");
+	zassert_equal(output.len, 0, "Unknown state reported");
+
+	cloud_set_channel_enable_state(CLOUD_CHANNEL_GPS, CLOUD_CMD_STATE_TRUE);
+	err = cloud_encode_config_data(&output);
+	zassert_equal(err, 0, "Encoding failed: %d", err);
+	output_check(&output, ref_config(true));
+
+	cloud_set_channel_enable_state(CLOUD_CHANNEL_GPS,
+				       CLOUD_CMD_STATE_FALSE);
+	err = cloud_encode_config_data(&output);
+	zassert_equal(err, 0, "Encoding failed: %d", err);
+	output_check(&output, ref_config(false));
+}
+
+static void test_benchmark(void)
+{
+	int err;
+	char *out;
+	uint64_t start;
+	uint32_t ref_ns;
+	uint32_t ref_ops;
+	uint32_t encode_ns;
+	uint32_t encode_ops;
+	struct cloud_msg output;
+
+	for (size_t i = 0; i < ARRAY_SIZE(samples); i++) {
+		heap_ops = 0;
+		start = benchmark_time_ns();
+
+		for (int n = 0; n < MSG_COUNT; n++) {
+			out = ref_data(&samples[i],
+				       BOOT_TIME_MS + samples[i].ts);
+			zassert_not_null(out, "cJSON failed");
+			cJSON_FreeString(out);
+		}
+
+		ref_ns = (benchmark_time_ns() - start) / MSG_COUNT;
+		ref_ops = heap_ops / MSG_COUNT;
+
+		heap_ops = 0;
+		start = benchmark_time_ns();
+
+		for (int n = 0; n < MSG_COUNT; n++) {
+			err = cloud_encode_data(&samples[i],
+						CLOUD_CMD_GROUP_DATA, &output);
+			zassert_equal(err, 0, "Encoding failed: %d", err);
+			k_free(output.buf);
+		}
+
+		encode_ns = (benchmark_time_ns() - start) / MSG_COUNT;
+		encode_ops = heap_ops / MSG_COUNT;
+
+		TC_PRINT("%-6s (%zu bytes): cJSON %d heap operations, %d ns, "
+			 "writer %d heap operations, %d ns per message\n",
+			 channel_str[samples[i].type], output.len, ref_ops,
+			 ref_ns, encode_ops, encode_ns);
+	}
+}
+
+void test_main(void)
+{
+	cloud_decode_init(NULL);
+
+	ztest_test_suite(cloud_codec_test,
+			 ztest_unit_test(test_data),
+			 ztest_unit_test(test_data_without_time),
+			 ztest_unit_test(test_data_errors),
+			 ztest_unit_test(test_config),
+			 ztest_unit_test(test_benchmark)
+			 );
+
+	ztest_run_test_suite(cloud_codec_test);
+}
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <date_time.h>
+#include <benchmark.h>
+#include "cloud_codec.h"
+#include "cloud_codec_cbor.h"
+
+#define MSG_COUNT 1000
+
+static uint8_t buf[256];
+static char data_buf[128];
+
+/* Mocks of the date time library. The timestamps of the samples are Unix
+ * time already, or 0 if the time is not known yet.
+ */
+int date_time_uptime_to_unix_time_ms(int64_t *uptime)
+{
+	return *uptime == 0 ? -ENODATA : 0;
+}
+
+int date_time_timestamp_clear(int64_t *unix_timestamp)
+{
+	*unix_timestamp = 0;
+
+	return 0;
+}
+
+/* Messages recorded from the asset tracker on a Thingy:91 */
+static const struct cloud_cbor_data samples[] = {
+	{
+		.channel = CLOUD_CHANNEL_GPS,
+		.group = CLOUD_CMD_GROUP_DATA,
+		.data = "$GPGGA,085634.00,6325.30562,N,01023.57853,E,1,07,"
+			"1.30,52.5,M,39.8,M,,*6A",
+		.ts = 1593088496123,
+	},
+	{
+		.channel = CLOUD_CHANNEL_TEMP,
+		.group = CLOUD_CMD_GROUP_DATA,
+		.data = "24.5",
+		.ts = 1593088501004,
+	},
+	{
+		.channel = CLOUD_CHANNEL_HUMID,
+		.group = CLOUD_CMD_GROUP_DATA,
+		.data = "41.2",
+		.ts = 1593088501010,
+	},
+	{
+		.channel = CLOUD_CHANNEL_AIR_PRESS,
+		.group = CLOUD_CMD_GROUP_DATA,
+		.data = "101.3",
+		.ts = 1593088501017,
+	},
+	{
+		.channel = CLOUD_CHANNEL_FLIP,
+		.group = CLOUD_CMD_GROUP_DATA,
+		.data = "UPSIDE_DOWN",
+		.ts = 1593088532870,
+	},
+	{
+		.channel = CLOUD_CHANNEL_LIGHT_SENSOR,
+		.group = CLOUD_CMD_GROUP_DATA,
+		.data = "120 80 65 300",
+		.ts = 1593088560000,
+	},
+	{
+		.channel = CLOUD_CHANNEL_LTE_LINK_RSRP,
+		.group = CLOUD_CMD_GROUP_DATA,
+		.data = "-95",
+		/* Time not known yet */
+		.ts = 0,
+	},
+	{
+		.channel = CLOUD_CHANNEL_BUTTON,
+		.group = CLOUD_CMD_GROUP_DATA,
+		.data = "1",
+		.ts = 1593088600441,
+	},
+};
+
+static const char *const channel_str[] = {
+	[CLOUD_CHANNEL_GPS] = CLOUD_CHANNEL_STR_GPS,
+	[CLOUD_CHANNEL_TEMP] = CLOUD_CHANNEL_STR_TEMP,
+	[CLOUD_CHANNEL_HUMID] = CLOUD_CHANNEL_STR_HUMID,
+	[CLOUD_CHANNEL_AIR_PRESS] = CLOUD_CHANNEL_STR_AIR_PRESS,
+	[CLOUD_CHANNEL_FLIP] = CLOUD_CHANNEL_STR_FLIP,
+	[CLOUD_CHANNEL_LIGHT_SENSOR] = CLOUD_CHANNEL_STR_LIGHT_SENSOR,
+	[CLOUD_CHANNEL_LTE_LINK_RSRP] = CLOUD_CHANNEL_STR_LTE_LINK_RSRP,
+	[CLOUD_CHANNEL_BUTTON] = CLOUD_CHANNEL_STR_BUTTON,
+};
+
+/* Encode a sample with the cloud codec, as the application sends it */
+static int sample_encode(const struct cloud_cbor_data *sample,
+			 enum cloud_codec_format format,
+			 struct cloud_msg *output)
+{
+	struct cloud_channel_data channel = {
+		.type = sample->channel,
+		.data = {
+			.buf = (char *)sample->data,
+			.len = strlen(sample->data),
+		},
+		.ts = sample->ts,
+	};
+
+	return cloud_encode_data_format(&channel, sample->group, format,
+					output);
+}
+
+static void test_data_round_trip(void)
+{
+	struct cloud_cbor_data out;
+	int len;
+
+	for (size_t i = 0; i < ARRAY_SIZE(samples); i++) {
+		len = cloud_cbor_encode_data(&samples[i], buf, sizeof(buf));
+		zassert_true(len > 0, "Encoding failed: %d", len);
+		zassert_equal(cloud_cbor_encode_data(&samples[i], NULL, 0), len,
+			      "Measured length differs");
+
+		memset(&out, 0, sizeof(out));
+		zassert_equal(cloud_cbor_decode_data(buf, len, &out, data_buf,
+						     sizeof(data_buf)), 0,
+			      "Decoding failed");
+		zassert_equal(out.channel, samples[i].channel, "Wrong channel");
+		zassert_equal(out.group, samples[i].group, "Wrong group");
+		zassert_true(out.ts == samples[i].ts, "Wrong timestamp");
+		zassert_true(strcmp(out.data, samples[i].data) == 0,
+			     "Wrong data");
+	}
+}
+
+static void test_config_round_trip(void)
+{
+	const struct cloud_cbor_config cfg[] = {
+		{ .channel = CLOUD_CHANNEL_GPS, .enable = true },
+		{ .channel = CLOUD_CHANNEL_TEMP, .enable = false },
+		{ .channel = CLOUD_CHANNEL_LIGHT_SENSOR, .enable = true },
+	};
+	struct cloud_cbor_config out[ARRAY_SIZE(cfg)];
+	int len;
+
+	len = cloud_cbor_encode_config(cfg, ARRAY_SIZE(cfg), buf, sizeof(buf));
+	zassert_true(len > 0, "Encoding failed: %d", len);
+	zassert_equal(cloud_cbor_encode_config(cfg, ARRAY_SIZE(cfg), NULL, 0),
+		      len, "Measured length differs");
+
+	zassert_equal(cloud_cbor_decode_config(buf, len, out, ARRAY_SIZE(out)),
+		      ARRAY_SIZE(cfg), "Decoding failed");
+	for (size_t i = 0; i < ARRAY_SIZE(cfg); i++) {
+		zassert_equal(out[i].channel, cfg[i].channel, "Wrong channel");
+		zassert_equal(out[i].enable, cfg[i].enable, "Wrong state");
+	}
+
+	zassert_equal(cloud_cbor_decode_config(buf, len, out, 2), -ENOMEM,
+		      "Too many channels not detected");
+}
+
+static void test_buffer_limits(void)
+{
+	int len = cloud_cbor_encode_data(&samples[0], NULL, 0);
+	struct cloud_cbor_data out;
+
+	zassert_equal(cloud_cbor_encode_data(&samples[0], buf, len - 1),
+		      -ENOMEM, "Overflow not detected");
+	zassert_equal(cloud_cbor_encode_data(&samples[0], buf, len), len,
+		      "Exact fit rejected");
+
+	/* The data needs room for the terminating null character */
+	zassert_equal(cloud_cbor_decode_data(buf, len, &out, data_buf,
+					     strlen(samples[0].data)),
+		      -ENOMEM, "Data overflow not detected");
+	zassert_equal(cloud_cbor_decode_data(buf, len, &out, data_buf,
+					     strlen(samples[0].data) + 1),
+		      0, "Exact fit rejected");
+}
+
+static void test_schema_checks(void)
+{
+	/* Data message with a key from a later version of the schema */
+	static const uint8_t newer[] = {
+		0xa5, 0x00, 0x01, 0x01, 0x61, 'x', 0x02, 0x06,
+		0x03, 0x00, 0x08, 0x63, 'n', 'e', 'w',
+	};
+	/* Data message without a timestamp */
+	static const uint8_t missing[] = {
+		0xa3, 0x00, 0x01, 0x01, 0x61, 'x', 0x02, 0x06,
+	};
+	/* Data message with the channel as a string */
+	static const uint8_t wrong_type[] = {
+		0xa4, 0x00, 0x61, '1', 0x01, 0x61, 'x', 0x02, 0x06,
+		0x03, 0x00,
+	};
+	struct cloud_cbor_config cfg;
+	struct cloud_cbor_data out;
+	int len;
+
+	zassert_equal(cloud_cbor_decode_data(newer, sizeof(newer), &out,
+					     data_buf, sizeof(data_buf)), 0,
+		      "Unknown key not skipped");
+	zassert_true(out.channel == 1 && out.group == 6 &&
+		     strcmp(out.data, "x") == 0, "Wrong message");
+
+	zassert_equal(cloud_cbor_decode_data(missing, sizeof(missing), &out,
+					     data_buf, sizeof(data_buf)),
+		      -EBADMSG, "Missing key not detected");
+	zassert_equal(cloud_cbor_decode_data(wrong_type, sizeof(wrong_type),
+					     &out, data_buf, sizeof(data_buf)),
+		      -EBADMSG, "Wrong type not detected");
+
+	len = cloud_cbor_encode_data(&samples[1], buf, sizeof(buf));
+	zassert_equal(cloud_cbor_decode_data(buf, len - 1, &out, data_buf,
+					     sizeof(data_buf)),
+		      -EBADMSG, "Truncated message not detected");
+
+	/* A data message is not a configuration report */
+	zassert_equal(cloud_cbor_decode_config(buf, len, &cfg, 1), -EBADMSG,
+		      "Wrong message accepted");
+}
+
+static void test_codec(void)
+{
+	struct cloud_cbor_data out;
+	struct cloud_msg output;
+	int err;
+
+	for (size_t i = 0; i < ARRAY_SIZE(samples); i++) {
+		err = sample_encode(&samples[i], CLOUD_CODEC_FORMAT_CBOR,
+				    &output);
+		zassert_equal(err, 0, "Encoding failed: %d", err);
+		zassert_equal(cloud_cbor_decode_data((uint8_t *)output.buf,
+						     output.len, &out,
+						     data_buf,
+						     sizeof(data_buf)), 0,
+			      "Decoding failed");
+		zassert_equal(out.channel, samples[i].channel, "Wrong channel");
+		zassert_true(out.ts == samples[i].ts, "Wrong timestamp");
+		zassert_true(strcmp(out.data, samples[i].data) == 0,
+			     "Wrong data");
+		k_free(output.buf);
+	}
+}
+
+static void test_benchmark(void)
+{
+	size_t json_total = 0;
+	size_t cbor_total = 0;
+	uint64_t start;
+	uint32_t json_ns;
+	uint32_t cbor_ns;
+	struct cloud_msg json;
+	struct cloud_msg cbor;
+
+	for (size_t i = 0; i < ARRAY_SIZE(samples); i++) {
+		zassert_equal(sample_encode(&samples[i],
+					    CLOUD_CODEC_FORMAT_JSON, &json),
+			      0, "JSON encoding failed");
+		zassert_equal(sample_encode(&samples[i],
+					    CLOUD_CODEC_FORMAT_CBOR, &cbor),
+			      0, "CBOR encoding failed");
+
+		TC_PRINT("%-6s JSON %3zu bytes, CBOR %3zu bytes\n",
+			 channel_str[samples[i].channel], json.len, cbor.len);
+
+		json_total += json.len;
+		cbor_total += cbor.len;
+		k_free(json.buf);
+		k_free(cbor.buf);
+	}
+
+	cloud_set_channel_enable_state(CLOUD_CHANNEL_GPS, CLOUD_CMD_STATE_TRUE);
+	zassert_equal(cloud_encode_config_data_format(CLOUD_CODEC_FORMAT_JSON,
+						      &json),
+		      0, "JSON encoding failed");
+	zassert_equal(cloud_encode_config_data_format(CLOUD_CODEC_FORMAT_CBOR,
+						      &cbor),
+		      0, "CBOR encoding failed");
+	TC_PRINT("Config JSON %3zu bytes, CBOR %3zu bytes\n", json.len,
+		 cbor.len);
+
+	json_total += json.len;
+	cbor_total += cbor.len;
+	k_free(json.buf);
+	k_free(cbor.buf);
+
+	zassert_true(cbor_total < json_total, "CBOR is not smaller");
+
+	start = benchmark_time_ns();
+	for (int n = 0; n < MSG_COUNT; n++) {
+		for (size_t i = 0; i < ARRAY_SIZE(samples); i++) {
+			(void)sample_encode(&samples[i],
+					    CLOUD_CODEC_FORMAT_JSON, &json);
+			k_free(json.buf);
+		}
+	}
+	json_ns = (benchmark_time_ns() - start) /
+		  (MSG_COUNT * ARRAY_SIZE(samples));
+
+	start = benchmark_time_ns();
+	for (int n = 0; n < MSG_COUNT; n++) {
+		for (size_t i = 0; i < ARRAY_SIZE(samples); i++) {
+			(void)sample_encode(&samples[i],
+					    CLOUD_CODEC_FORMAT_CBOR, &cbor);
+			k_free(cbor.buf);
+		}
+	}
+	cbor_ns = (benchmark_time_ns() - start) /
+		  (MSG_COUNT * ARRAY_SIZE(samples));
+
+	TC_PRINT("Total: JSON %zu bytes, %u ns per message, CBOR %zu "
+		 "bytes (%zu%%), %u ns per message\n",
+		 json_total, json_ns, cbor_total,
+		 100 * cbor_total / json_total, cbor_ns);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(cloud_codec_cbor_test,
+			 ztest_unit_test(test_data_round_trip),
+			 ztest_unit_test(test_config_round_trip),
+			 ztest_unit_test(test_buffer_limits),
+			 ztest_unit_test(test_schema_checks),
+			 ztest_unit_test(test_codec),
+			 ztest_unit_test(test_benchmark)
+			 );
+
+	ztest_run_test_suite(cloud_codec_cbor_test);
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef BENCHMARK_H__
+#define BENCHMARK_H__
+
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Get the time to measure a benchmark with.
+ *
+ *  Only the difference between two calls is meaningful. On native_posix,
+ *  the host's monotonic clock is used, as simulated time stands still
+ *  while the test runs.
+ *
+ *  @return Time in nanoseconds.
+ */
+uint64_t benchmark_time_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCHMARK_H__ */
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <benchmark.h>
+
+uint64_t benchmark_time_ns(void)
+{
+	/* Extend the 32-bit cycle counter, it is read often enough by a
+	 * benchmark to not wrap twice between two calls.
+	 */
+	static uint32_t last;
+	static uint64_t high;
+	uint32_t now = k_cycle_get_32();
+
+	if (now < last) {
+		high += 1ULL << 32;
+	}
+	last = now;
+
+	return k_cyc_to_ns_floor64(high | now);
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**
+ * @file
+ * @brief Benchmark timing from the host clock on the native_posix board.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+#include <benchmark.h>
+
+uint64_t benchmark_time_ns(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <modem/at_cmd.h>
+#include <modem/at_notif.h>
+#include <modem/at_sim.h>
+#include <benchmark.h>
+
+#define CMD_COUNT 1000
+#define NOTIF_COUNT 100
+#define NOTIF_INTERVAL_MS 1
+#define CMD_LATENCY_MS 20
+
+#define TEST_NOTIF "+CEREG: 1,\"002F\",\"0012BEEF\",7,,,\"11100000\",\"11100000\"\r\n"
+
+/* Heap usage of the AT stack, tracked by wrapping k_malloc() and k_free(). */
+void *__real_k_malloc(size_t size);
+void __real_k_free(void *ptr);
+
+static struct {
+	void *ptr;
+	size_t size;
+} allocs[32];
+static size_t heap_used;
+static size_t heap_peak;
+static uint32_t heap_ops;
+
+void *__wrap_k_malloc(size_t size)
+{
+	void *ptr = __real_k_malloc(size);
+	unsigned int key = irq_lock();
+
+	heap_ops++;
+
+	for (size_t i = 0; ptr && i < ARRAY_SIZE(allocs); i++) {
+		if (allocs[i].ptr == NULL) {
+			allocs[i].ptr = ptr;
+			allocs[i].size = size;
+			heap_used += size;
+			heap_peak = MAX(heap_peak, heap_used);
+			break;
+		}
+	}
+
+	irq_unlock(key);
+
+	return ptr;
+}
+
+void __wrap_k_free(void *ptr)
+{
+	unsigned int key = irq_lock();
+
+	for (size_t i = 0; ptr && i < ARRAY_SIZE(allocs); i++) {
+		if (allocs[i].ptr == ptr) {
+			heap_used -= allocs[i].size;
+			allocs[i].ptr = NULL;
+			break;
+		}
+	}
+
+	irq_unlock(key);
+
+	__real_k_free(ptr);
+}
+
+static void heap_stats_reset(void)
+{
+	heap_peak = heap_used;
+	heap_ops = 0;
+}
+
+static const struct at_sim_entry session[] = {
+	{ .cmd = "AT+CFUN?", .resp = "+CFUN: 1\r\nOK\r\n" },
+	{ .cmd = "AT+CEREG?", .resp = "+CEREG: 5,1,\"002F\",\"0012BEEF\",7\r\nOK\r\n" },
+	{ .cmd = "AT+CGSN", .resp = "352656100367872\r\nOK\r\n" },
+	{ .cmd = "AT+CMEE=1", .resp = "OK\r\n" },
+	{ .cmd = "AT+CFUN=1", .resp = "OK\r\n", .latency_ms = CMD_LATENCY_MS,
+	  .notif = TEST_NOTIF, .notif_count = 3, .notif_interval_ms = 10 },
+	{ .cmd = "AT+CPIN?", .resp = "+CME ERROR: 10\r\n" },
+};
+
+static K_SEM_DEFINE(notif_sem, 0, NOTIF_COUNT);
+static K_SEM_DEFINE(callback_sem, 0, CMD_COUNT);
+/* Host time of the last notification, and the longest time between two */
+static uint64_t notif_last_ns;
+static uint64_t notif_max_gap_ns;
+static uint32_t notif_received;
+
+static void notif_handler(void *context, const char *response)
+{
+	uint64_t now;
+
+	ARG_UNUSED(context);
+
+	if (strcmp(response, TEST_NOTIF) != 0) {
+		return;
+	}
+
+	now = benchmark_time_ns();
+
+	notif_received++;
+	notif_max_gap_ns = MAX(notif_max_gap_ns, now - notif_last_ns);
+	notif_last_ns = now;
+
+	k_sem_give(&notif_sem);
+}
+
+static void cmd_callback(const char *response)
+{
+	ARG_UNUSED(response);
+
+	k_sem_give(&callback_sem);
+}
+
+static void setup(void)
+{
+	at_sim_reset();
+	zassert_equal(at_sim_script_set(session, ARRAY_SIZE(session)), 0,
+		      "Failed to set script");
+	heap_stats_reset();
+}
+
+static void test_at_sim_init(void)
+{
+	zassert_equal(at_cmd_init(), 0, "at_cmd_init failed");
+	zassert_equal(at_notif_init(), 0, "at_notif_init failed");
+	zassert_equal(at_notif_register_handler(NULL, notif_handler), 0,
+		      "Failed to register notification handler");
+}
+
+static void test_at_sim_replay(void)
+{
+	int err;
+	char buf[64];
+	enum at_cmd_state state;
+
+	setup();
+
+	err = at_cmd_write("AT+CEREG?", buf, sizeof(buf), &state);
+	zassert_equal(err, 0, "AT+CEREG? failed: %d", err);
+	zassert_equal(state, AT_CMD_OK, "Unexpected state %d", state);
+	zassert_true(strncmp(buf, "+CEREG: 5,1", 11) == 0,
+		     "Unexpected response %s", buf);
+
+	err = at_cmd_write("AT+CPIN?", NULL, 0, &state);
+	zassert_equal(state, AT_CMD_ERROR_CME, "Unexpected state %d", state);
+	zassert_equal(err, 10, "Unexpected CME error %d", err);
+}
+
+static void test_at_cmd_throughput(void)
+{
+	int err;
+	char buf[32];
+	uint64_t start;
+	uint32_t elapsed_us;
+	struct at_sim_stats stats;
+
+	setup();
+
+	start = benchmark_time_ns();
+
+	for (int i = 0; i < CMD_COUNT; i++) {
+		err = at_cmd_write("AT+CFUN?", buf, sizeof(buf), NULL);
+		zassert_equal(err, 0, "AT+CFUN? failed: %d", err);
+	}
+
+	elapsed_us = (benchmark_time_ns() - start) / NSEC_PER_USEC;
+
+	at_sim_stats_get(&stats);
+	zassert_equal(stats.cmds, CMD_COUNT, "Unexpected command count %d",
+		      stats.cmds);
+	zassert_equal(stats.unmatched, 0, "Commands did not match script");
+	zassert_true(strcmp(buf, "+CFUN: 1\r\n") == 0,
+		     "Unexpected response %s", buf);
+
+	TC_PRINT("Synchronous: %d commands in %u us, %d heap operations, "
+		 "peak heap %d bytes\n",
+		 CMD_COUNT, elapsed_us, heap_ops, heap_peak);
+
+	setup();
+
+	start = benchmark_time_ns();
+
+	for (int i = 0; i < CMD_COUNT; i++) {
+		err = at_cmd_write_with_callback("AT+CFUN?", cmd_callback);
+		zassert_equal(err, 0, "AT+CFUN? failed: %d", err);
+	}
+
+	for (int i = 0; i < CMD_COUNT; i++) {
+		zassert_equal(k_sem_take(&callback_sem, K_SECONDS(1)), 0,
+			      "Callback %d not received", i);
+	}
+
+	elapsed_us = (benchmark_time_ns() - start) / NSEC_PER_USEC;
+
+	TC_PRINT("Queued: %d commands in %u us, %d heap operations, "
+		 "peak heap %d bytes\n",
+		 CMD_COUNT, elapsed_us, heap_ops, heap_peak);
+
+	zassert_equal(heap_used, 0, "Heap memory leaked: %d bytes",
+		      heap_used);
+}
+
+static void test_at_cmd_latency(void)
+{
+	int err;
+	int64_t start;
+	int64_t elapsed;
+
+	setup();
+
+	/* The scripted latency passes in simulated time */
+	start = k_uptime_get();
+	err = at_cmd_write("AT+CFUN=1", NULL, 0, NULL);
+	elapsed = k_uptime_get() - start;
+
+	zassert_equal(err, 0, "AT+CFUN=1 failed: %d", err);
+	zassert_true(elapsed >= CMD_LATENCY_MS,
+		     "Response faster than scripted latency: %lld ms", elapsed);
+
+	/* Let the scripted notifications through before the next test. */
+	for (int i = 0; i < 3; i++) {
+		zassert_equal(k_sem_take(&notif_sem, K_MSEC(100)), 0,
+			      "Scripted notification %d not received", i);
+	}
+
+	TC_PRINT("Command latency %lld ms\n", elapsed);
+}
+
+static void test_at_notif_burst(void)
+{
+	int err;
+	struct at_sim_stats stats;
+
+	setup();
+
+	notif_received = 0;
+	notif_max_gap_ns = 0;
+	notif_last_ns = benchmark_time_ns();
+
+	err = at_sim_notify_burst(TEST_NOTIF, NOTIF_COUNT, NOTIF_INTERVAL_MS);
+	zassert_equal(err, 0, "Failed to inject notifications: %d", err);
+
+	for (int i = 0; i < NOTIF_COUNT; i++) {
+		zassert_equal(k_sem_take(&notif_sem, K_SECONDS(1)), 0,
+			      "Notification %d not received", i);
+	}
+
+	at_sim_stats_get(&stats);
+	zassert_equal(notif_received, NOTIF_COUNT,
+		      "Unexpected notification count %d", notif_received);
+	zassert_equal(stats.dropped, 0, "Notifications dropped");
+
+	TC_PRINT("%d notifications dispatched, at most %u us apart, "
+		 "%d heap operations\n",
+		 NOTIF_COUNT, (uint32_t)(notif_max_gap_ns / NSEC_PER_USEC),
+		 heap_ops);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(at_sim_benchmark,
+			 ztest_unit_test(test_at_sim_init),
+			 ztest_unit_test(test_at_sim_replay),
+			 ztest_unit_test(test_at_cmd_throughput),
+			 ztest_unit_test(test_at_cmd_latency),
+			 ztest_unit_test(test_at_notif_burst)
+			 );
+
+	ztest_run_test_suite(at_sim_benchmark);
+}
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <benchmark.h>
+#include "cJSON.h"
+#include "cJSON_os.h"
+
+#define PARSE_COUNT 200
+#define FRAG_ROUNDS 16
+#define LONG_LIVED_SIZE 32
+
+/* AWS IoT job execution, as parsed by aws_fota */
+static const char job_doc[] =
+	"{\"timestamp\":1559808907,\"execution\":{\"jobId\":"
+	"\"9b5caac6-3e8a-45dd-9273-c1b995762f4a\",\"status\":\"QUEUED\","
+	"\"queuedAt\":1559808906,\"lastUpdatedAt\":1559808906,"
+	"\"versionNumber\":1,\"executionNumber\":1,\"jobDocument\":"
+	"{\"operation\":\"app_fw_update\",\"fwversion\":\"2\","
+	"\"size\":181124,\"location\":{\"protocol\":\"https:\","
+	"\"host\":\"fota-update-bucket.s3.eu-central-1.amazonaws.com\","
+	"\"path\":\"/update.bin?X-Amz-Algorithm=AWS4-HMAC-SHA256"
+	"&X-Amz-Date=20190606T081505Z&X-Amz-Expires=604800\"}}}}";
+
+/* Heap usage of cJSON, tracked by wrapping k_malloc() and k_free(). */
+void *__real_k_malloc(size_t size);
+void __real_k_free(void *ptr);
+
+static struct {
+	void *ptr;
+	size_t size;
+} allocs[128];
+static size_t heap_used;
+static uint32_t heap_ops;
+
+void *__wrap_k_malloc(size_t size)
+{
+	void *ptr = __real_k_malloc(size);
+	unsigned int key = irq_lock();
+
+	heap_ops++;
+
+	for (size_t i = 0; ptr && i < ARRAY_SIZE(allocs); i++) {
+		if (allocs[i].ptr == NULL) {
+			allocs[i].ptr = ptr;
+			allocs[i].size = size;
+			heap_used += size;
+			break;
+		}
+	}
+
+	irq_unlock(key);
+
+	return ptr;
+}
+
+void __wrap_k_free(void *ptr)
+{
+	unsigned int key = irq_lock();
+
+	if (ptr) {
+		heap_ops++;
+	}
+
+	for (size_t i = 0; ptr && i < ARRAY_SIZE(allocs); i++) {
+		if (allocs[i].ptr == ptr) {
+			heap_used -= allocs[i].size;
+			allocs[i].ptr = NULL;
+			break;
+		}
+	}
+
+	irq_unlock(key);
+
+	__real_k_free(ptr);
+}
+
+/* Largest block the heap can still hand out */
+static size_t largest_free_block(void)
+{
+	size_t lo = 0;
+	size_t hi = CONFIG_HEAP_MEM_POOL_SIZE;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi + 1) / 2;
+		void *ptr = __real_k_malloc(mid);
+
+		if (ptr) {
+			__real_k_free(ptr);
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	return lo;
+}
+
+static void job_check(cJSON *root)
+{
+	cJSON *execution = cJSON_GetObjectItem(root, "execution");
+	cJSON *doc = cJSON_GetObjectItem(execution, "jobDocument");
+	cJSON *location = cJSON_GetObjectItem(doc, "location");
+
+	zassert_not_null(root, "Parsing failed");
+	zassert_true(strcmp(cJSON_GetStringValue(
+				cJSON_GetObjectItem(location, "protocol")),
+			    "https:") == 0, "Wrong protocol");
+	zassert_equal(cJSON_GetObjectItem(execution, "versionNumber")->valueint,
+		      1, "Wrong version number");
+}
+
+static void test_arena_parse(void)
+{
+	cJSON *root;
+	size_t used = heap_used;
+	struct cJSON_arena arena;
+
+	heap_ops = 0;
+
+	cJSON_ArenaBegin(&arena, NULL, CONFIG_CJSON_ARENA_SIZE);
+	root = cJSON_Parse(job_doc);
+	job_check(root);
+	zassert_equal(arena.overflow_count, 0, "Arena too small");
+	zassert_equal(heap_ops, 1, "Parsing used the heap");
+	cJSON_ArenaEnd(&arena);
+
+	zassert_equal(heap_ops, 2, "Arena not released at once");
+	zassert_equal(heap_used, used, "Heap memory leaked");
+}
+
+static void test_arena_overflow(void)
+{
+	cJSON *root;
+	size_t used = heap_used;
+	struct cJSON_arena arena;
+	static uint8_t buf[256];
+
+	cJSON_ArenaBegin(&arena, buf, sizeof(buf));
+	root = cJSON_Parse(job_doc);
+	job_check(root);
+	zassert_true(arena.overflow_count > 0, "Document fit in arena");
+
+	/* Deleting is optional, and also releases the overflow */
+	cJSON_Delete(root);
+	zassert_equal(arena.overflow, NULL, "Overflow not released");
+	cJSON_ArenaEnd(&arena);
+
+	cJSON_ArenaBegin(&arena, buf, sizeof(buf));
+	root = cJSON_Parse(job_doc);
+	job_check(root);
+	cJSON_ArenaEnd(&arena);
+
+	zassert_equal(heap_used, used, "Heap memory leaked");
+}
+
+static void test_arena_nested(void)
+{
+	char *str;
+	size_t mark;
+	cJSON *inner_obj;
+	cJSON *outer_obj;
+	struct cJSON_arena outer;
+	struct cJSON_arena inner;
+	static uint8_t outer_buf[512];
+	static uint8_t inner_buf[512];
+
+	cJSON_ArenaBegin(&outer, outer_buf, sizeof(outer_buf));
+	outer_obj = cJSON_CreateObject();
+	zassert_true((uint8_t *)outer_obj >= outer_buf &&
+		     (uint8_t *)outer_obj < outer_buf + sizeof(outer_buf),
+		     "Not allocated from the arena");
+
+	cJSON_ArenaBegin(&inner, inner_buf, sizeof(inner_buf));
+	inner_obj = cJSON_CreateNumber(42);
+	zassert_true((uint8_t *)inner_obj >= inner_buf &&
+		     (uint8_t *)inner_obj < inner_buf + sizeof(inner_buf),
+		     "Not allocated from the inner arena");
+
+	/* A string freed right away is taken back */
+	str = cJSON_PrintUnformatted(inner_obj);
+	zassert_true(strcmp(str, "42") == 0, "Unexpected output %s", str);
+	mark = inner.used;
+	cJSON_FreeString(str);
+	zassert_true(inner.used < mark, "Last allocation not taken back");
+	cJSON_ArenaEnd(&inner);
+
+	cJSON_AddItemToObject(outer_obj, "value", cJSON_CreateNull());
+	cJSON_Delete(outer_obj);
+	cJSON_ArenaEnd(&outer);
+}
+
+/* Hooks of an application which does not call cJSON_Init() */
+static uint32_t app_mallocs;
+static uint32_t app_frees;
+
+static void *app_malloc(size_t size)
+{
+	app_mallocs++;
+	return k_malloc(size);
+}
+
+static void app_free(void *ptr)
+{
+	app_frees++;
+	k_free(ptr);
+}
+
+static void test_app_hooks(void)
+{
+	cJSON *root;
+	cJSON *before;
+	cJSON_Hooks active;
+	struct cJSON_arena arena;
+	cJSON_Hooks hooks = {
+		.malloc_fn = app_malloc,
+		.free_fn = app_free,
+	};
+
+	cJSON_InitHooks(&hooks);
+	before = cJSON_CreateObject();
+	zassert_equal(app_mallocs, 1, "Application hooks not used");
+
+	cJSON_ArenaBegin(&arena, NULL, CONFIG_CJSON_ARENA_SIZE);
+	root = cJSON_Parse(job_doc);
+	job_check(root);
+	zassert_equal(app_mallocs, 1, "Arena not used");
+
+	/* Items allocated before the arena go back to the application */
+	cJSON_Delete(before);
+	zassert_equal(app_frees, 1, "Application hooks not used");
+	cJSON_ArenaEnd(&arena);
+
+	cJSON_GetHooks(&active);
+	zassert_equal_ptr(active.malloc_fn, app_malloc, "Hooks not restored");
+	zassert_equal_ptr(active.free_fn, app_free, "Hooks not restored");
+
+	cJSON_Init();
+}
+
+static void parse_default(void)
+{
+	cJSON *root = cJSON_Parse(job_doc);
+
+	job_check(root);
+	cJSON_Delete(root);
+}
+
+static void parse_arena(void)
+{
+	struct cJSON_arena arena;
+
+	cJSON_ArenaBegin(&arena, NULL, CONFIG_CJSON_ARENA_SIZE);
+	job_check(cJSON_Parse(job_doc));
+	cJSON_ArenaEnd(&arena);
+}
+
+/* Parse while another user of the heap keeps small blocks, and return the
+ * largest block left on the heap.
+ */
+static size_t fragmentation_run(void (*parse)(void))
+{
+	size_t largest;
+	void *kept[FRAG_ROUNDS];
+
+	for (int i = 0; i < FRAG_ROUNDS; i++) {
+		parse();
+		kept[i] = k_malloc(LONG_LIVED_SIZE);
+		zassert_not_null(kept[i], "Heap exhausted");
+		parse();
+	}
+
+	largest = largest_free_block();
+
+	for (int i = 0; i < FRAG_ROUNDS; i++) {
+		k_free(kept[i]);
+	}
+
+	return largest;
+}
+
+static void test_fragmentation(void)
+{
+	size_t used = heap_used;
+	size_t largest_default;
+	size_t largest_arena;
+
+	largest_default = fragmentation_run(parse_default);
+	largest_arena = fragmentation_run(parse_arena);
+
+	TC_PRINT("Largest free block with %d blocks kept: default hooks "
+		 "%zu bytes, arena %zu bytes\n",
+		 FRAG_ROUNDS, largest_default, largest_arena);
+
+	zassert_equal(heap_used, used, "Heap memory leaked");
+}
+
+static void benchmark(const char *name, void (*parse)(void))
+{
+	uint64_t start;
+	uint32_t ns;
+
+	heap_ops = 0;
+	start = benchmark_time_ns();
+
+	for (int i = 0; i < PARSE_COUNT; i++) {
+		parse();
+	}
+
+	ns = (benchmark_time_ns() - start) / PARSE_COUNT;
+
+	TC_PRINT("%s: %d heap operations, %d ns per document\n",
+		 name, heap_ops / PARSE_COUNT, ns);
+}
+
+static void test_throughput(void)
+{
+	benchmark("Default hooks", parse_default);
+	benchmark("Arena", parse_arena);
+
+	zassert_equal(heap_ops, 2 * PARSE_COUNT, "Arena used the heap");
+}
+
+void test_main(void)
+{
+	cJSON_Init();
+
+	ztest_test_suite(cjson_arena_test,
+			 ztest_unit_test(test_arena_parse),
+			 ztest_unit_test(test_arena_overflow),
+			 ztest_unit_test(test_arena_nested),
+			 ztest_unit_test(test_app_hooks),
+			 ztest_unit_test(test_fragmentation),
+			 ztest_unit_test(test_throughput)
+			 );
+
+	ztest_run_test_suite(cjson_arena_test);
+}
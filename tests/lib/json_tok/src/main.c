@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <json_tok.h>
+#include <benchmark.h>
+#include "cJSON.h"
+
+#define MSG_COUNT 1000
+#define TOK_COUNT 64
+
+/* Shadow delta received by nrf_cloud once the device is paired */
+static const char shadow_delta[] =
+	"{\"state\":{\"pairing\":{\"state\":\"paired\",\"topics\":"
+	"{\"d2c\":\"prod/a0b1c2d3/m/d/nrf-352656100367872/d2c\","
+	"\"c2d\":\"prod/a0b1c2d3/m/d/nrf-352656100367872/c2d\"}},"
+	"\"nrfcloud_mqtt_topic_prefix\":\"prod/a0b1c2d3/\","
+	"\"config\":{\"gpst\":true,\"actw\":60,\"list\":[1,-2,3.5e2]}},"
+	"\"version\":12,\"timestamp\":1593088496}";
+
+static struct json_tok toks[TOK_COUNT];
+
+/* Heap operations of cJSON, counted through its allocation hooks. */
+static uint32_t heap_ops;
+
+static void *counting_malloc(size_t size)
+{
+	heap_ops++;
+	return k_malloc(size);
+}
+
+static void counting_free(void *ptr)
+{
+	if (ptr) {
+		heap_ops++;
+	}
+	k_free(ptr);
+}
+
+static int parse(const char *json)
+{
+	return json_tok_parse(json, strlen(json), toks, ARRAY_SIZE(toks));
+}
+
+static void test_find(void)
+{
+	int i;
+	bool gpst;
+	int32_t actw;
+	char topic[64];
+
+	zassert_true(parse(shadow_delta) > 0, "Parsing failed");
+	zassert_equal(toks[0].type, JSON_TOK_OBJ, "Wrong root type");
+	zassert_equal(toks[0].len, strlen(shadow_delta), "Wrong root length");
+
+	i = json_tok_find(shadow_delta, toks, 0, "state.pairing.state");
+	zassert_true(i > 0, "Member not found");
+	zassert_true(json_tok_eq(shadow_delta, &toks[i], "paired"),
+		     "Wrong value");
+	zassert_false(json_tok_eq(shadow_delta, &toks[i], "pair"),
+		      "Prefix matched");
+
+	i = json_tok_find(shadow_delta, toks, 0, "state.pairing.topics.c2d");
+	zassert_true(i > 0, "Member not found");
+	zassert_equal(json_tok_str(shadow_delta, &toks[i], topic,
+				   sizeof(topic)),
+		      strlen("prod/a0b1c2d3/m/d/nrf-352656100367872/c2d"),
+		      "Wrong length");
+	zassert_true(strcmp(topic,
+			    "prod/a0b1c2d3/m/d/nrf-352656100367872/c2d") == 0,
+		     "Wrong value");
+
+	/* Lookups relative to a token, past nested values */
+	i = json_tok_find(shadow_delta, toks, 0, "state.config");
+	zassert_equal(json_tok_bool(shadow_delta,
+				    &toks[json_tok_find(shadow_delta, toks, i,
+							"gpst")],
+				    &gpst), 0, "Not a boolean");
+	zassert_true(gpst, "Wrong value");
+	zassert_equal(json_tok_int(shadow_delta,
+				   &toks[json_tok_find(shadow_delta, toks, i,
+						       "actw")],
+				   &actw), 0, "Not an integer");
+	zassert_equal(actw, 60, "Wrong value");
+	zassert_equal(json_tok_int(shadow_delta,
+				   &toks[json_tok_find(shadow_delta, toks, i,
+						       "list.1")],
+				   &actw), 0, "Not an integer");
+	zassert_equal(actw, -2, "Wrong value");
+	zassert_equal(json_tok_int(shadow_delta,
+				   &toks[json_tok_find(shadow_delta, toks, i,
+						       "list.2")],
+				   &actw), -EINVAL, "Not an integer");
+	zassert_true(json_tok_find(shadow_delta, toks, 0, "version") > 0,
+		     "Member after nested objects not found");
+
+	zassert_equal(json_tok_find(shadow_delta, toks, 0, "state.desired"),
+		      -ENOENT, "Missing member found");
+	zassert_equal(json_tok_find(shadow_delta, toks, i, "list.3"),
+		      -ENOENT, "Missing element found");
+	zassert_equal(json_tok_find(shadow_delta, toks, 0, "version.x"),
+		      -ENOENT, "Member of a number found");
+	zassert_equal(json_tok_find(shadow_delta, toks, -ENOENT, "state"),
+		      -ENOENT, "Lookup from a missing value");
+}
+
+static void test_strings(void)
+{
+	static const char json[] =
+		"[\"a\\\"b\\\\c\\/d\\n\",\"\\u00e6\\u20ac\\ud83d\\ude00\"]";
+	char out[16];
+	int len;
+
+	zassert_equal(parse(json), 3, "Parsing failed");
+
+	len = json_tok_str(json, &toks[1], out, sizeof(out));
+	zassert_equal(len, 8, "Wrong length %d", len);
+	zassert_true(strcmp(out, "a\"b\\c/d\n") == 0, "Wrong value");
+
+	len = json_tok_str(json, &toks[2], out, sizeof(out));
+	zassert_equal(len, 9, "Wrong length %d", len);
+	zassert_true(strcmp(out, "\xc3\xa6\xe2\x82\xac\xf0\x9f\x98\x80") == 0,
+		     "Wrong UTF-8");
+
+	/* Truncated like snprintf() */
+	len = json_tok_str(json, &toks[1], out, 4);
+	zassert_equal(len, 8, "Wrong length %d", len);
+	zassert_true(strcmp(out, "a\"b") == 0, "Wrong truncation");
+
+	zassert_equal(json_tok_str(json, &toks[0], out, sizeof(out)), -EINVAL,
+		      "Array read as string");
+}
+
+static void test_malformed(void)
+{
+	static const char *const invalid[] = {
+		"",
+		"   ",
+		"{",
+		"{\"a\":1",
+		"{\"a\":1,}",
+		"{\"a\" 1}",
+		"{a:1}",
+		"{\"a\":1 \"b\":2}",
+		"[1,2]]",
+		"[1,2}",
+		"{\"a\":[}",
+		"\"abc",
+		"\"a\\qb\"",
+		"\"\\u12g4\"",
+		"01",
+		"1.",
+		"-",
+		"tru",
+		"nul",
+		"{} {}",
+		"[,1]",
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(invalid); i++) {
+		zassert_equal(parse(invalid[i]), -EINVAL,
+			      "Accepted \"%s\"", invalid[i]);
+		zassert_equal(json_tok_parse(invalid[i], strlen(invalid[i]),
+					     NULL, 0), -EINVAL,
+			      "Counted \"%s\"", invalid[i]);
+	}
+
+	zassert_equal(parse("{}"), 1, "Empty object rejected");
+	zassert_equal(parse("[]"), 1, "Empty array rejected");
+	zassert_equal(parse(" 1e-3 "), 1, "Number rejected");
+	zassert_equal(parse("[true,false,null]"), 4, "Literals rejected");
+
+	/* Tokenizing stops at a null character, and at the given length */
+	zassert_equal(json_tok_parse("{}\0{", 4, toks, ARRAY_SIZE(toks)), 1,
+		      "Null character not handled");
+	zassert_equal(json_tok_parse("[1]]", 3, toks, ARRAY_SIZE(toks)), 2,
+		      "Length not respected");
+}
+
+static void test_limits(void)
+{
+	int32_t value;
+
+	zassert_equal(json_tok_parse("[1,2,3]", 7, toks, 3), -ENOMEM,
+		      "Token limit not respected");
+	zassert_equal(json_tok_parse("[1,2,3]", 7, toks, 4), 4,
+		      "Token limit off by one");
+	zassert_equal(json_tok_parse(shadow_delta, JSON_TOK_MAX_LEN + 1,
+				     toks, ARRAY_SIZE(toks)), -EFBIG,
+		      "Length limit not respected");
+
+	zassert_equal(parse("[2147483647,-2147483648,2147483648]"), 4,
+		      "Parsing failed");
+	zassert_equal(json_tok_int("[2147483647,-2147483648,2147483648]",
+				   &toks[1], &value), 0, "Max rejected");
+	zassert_equal(value, INT32_MAX, "Wrong value");
+	zassert_equal(json_tok_int("[2147483647,-2147483648,2147483648]",
+				   &toks[2], &value), 0, "Min rejected");
+	zassert_equal(value, INT32_MIN, "Wrong value");
+	zassert_equal(json_tok_int("[2147483647,-2147483648,2147483648]",
+				   &toks[3], &value), -ERANGE,
+		      "Overflow not detected");
+}
+
+static void test_count(void)
+{
+	char deep[2 * (JSON_TOK_COUNT_MAX_DEPTH + 1)];
+	size_t len = 0;
+
+	zassert_equal(json_tok_parse(shadow_delta, sizeof(shadow_delta) - 1,
+				     NULL, 0), parse(shadow_delta),
+		      "Wrong count");
+	zassert_equal(json_tok_parse("[{},[1],{\"a\":[]}]", 17, NULL, 0), 7,
+		      "Wrong count");
+
+	for (int i = 0; i < JSON_TOK_COUNT_MAX_DEPTH; i++) {
+		deep[len++] = '[';
+	}
+	for (int i = 0; i < JSON_TOK_COUNT_MAX_DEPTH; i++) {
+		deep[len++] = ']';
+	}
+
+	zassert_equal(json_tok_parse(deep, len, NULL, 0),
+		      JSON_TOK_COUNT_MAX_DEPTH, "Deepest document not counted");
+
+	/* One level deeper, it can only be tokenized */
+	memmove(&deep[1], deep, len);
+	deep[0] = '[';
+	deep[++len] = ']';
+	len++;
+
+	zassert_equal(json_tok_parse(deep, len, NULL, 0), -ENOMEM,
+		      "Depth limit not respected");
+	zassert_equal(json_tok_parse(deep, len, toks, ARRAY_SIZE(toks)),
+		      JSON_TOK_COUNT_MAX_DEPTH + 1,
+		      "Deep document not tokenized");
+}
+
+static void test_alloc(void)
+{
+	struct json_tok buf[4];
+	struct json_tok *alloc_toks;
+	int i;
+
+	/* Tokens that fit are not allocated */
+	zassert_equal(json_tok_parse_alloc("[1,2,3]", 7, buf, ARRAY_SIZE(buf),
+					   &alloc_toks), 4, "Parsing failed");
+	zassert_equal_ptr(alloc_toks, buf, "Tokens allocated");
+	json_tok_free(alloc_toks, buf);
+
+	zassert_equal(json_tok_parse_alloc(shadow_delta,
+					   sizeof(shadow_delta) - 1, buf,
+					   ARRAY_SIZE(buf), &alloc_toks),
+		      parse(shadow_delta), "Parsing failed");
+	zassert_not_equal(alloc_toks, buf, "Tokens not allocated");
+
+	i = json_tok_find(shadow_delta, alloc_toks, 0, "state.config.actw");
+	zassert_true(i > 0, "Member not found");
+	json_tok_free(alloc_toks, buf);
+
+	/* Nothing is kept on errors */
+	zassert_equal(json_tok_parse_alloc(shadow_delta,
+					   sizeof(shadow_delta) - 2, buf,
+					   ARRAY_SIZE(buf), &alloc_toks),
+		      -EINVAL, "Truncated document accepted");
+	zassert_equal_ptr(alloc_toks, buf, "Tokens kept on error");
+}
+
+static bool lookup_cjson(void)
+{
+	cJSON *root = cJSON_Parse(shadow_delta);
+	cJSON *state = cJSON_GetObjectItem(root, "state");
+	cJSON *pairing = cJSON_GetObjectItem(state, "pairing");
+	cJSON *topics = cJSON_GetObjectItem(pairing, "topics");
+	bool found = cJSON_GetStringValue(cJSON_GetObjectItem(topics, "c2d")) &&
+		     cJSON_IsTrue(cJSON_GetObjectItem(
+				cJSON_GetObjectItem(state, "config"), "gpst"));
+
+	cJSON_Delete(root);
+
+	return found;
+}
+
+static bool lookup_tok(void)
+{
+	bool gpst = false;
+
+	if (json_tok_parse(shadow_delta, sizeof(shadow_delta) - 1,
+			   toks, ARRAY_SIZE(toks)) < 0) {
+		return false;
+	}
+
+	return json_tok_find(shadow_delta, toks, 0,
+			     "state.pairing.topics.c2d") > 0 &&
+	       json_tok_bool(shadow_delta,
+			     &toks[json_tok_find(shadow_delta, toks, 0,
+						 "state.config.gpst")],
+			     &gpst) == 0 && gpst;
+}
+
+static void test_benchmark(void)
+{
+	static cJSON_Hooks hooks = {
+		.malloc_fn = counting_malloc,
+		.free_fn = counting_free,
+	};
+	uint64_t start;
+	uint32_t cjson_ns;
+	uint32_t cjson_ops;
+	uint32_t tok_ns;
+
+	cJSON_InitHooks(&hooks);
+
+	heap_ops = 0;
+	start = benchmark_time_ns();
+
+	for (int i = 0; i < MSG_COUNT; i++) {
+		zassert_true(lookup_cjson(), "cJSON lookup failed");
+	}
+
+	cjson_ns = (benchmark_time_ns() - start) / MSG_COUNT;
+	cjson_ops = heap_ops;
+
+	heap_ops = 0;
+	start = benchmark_time_ns();
+
+	for (int i = 0; i < MSG_COUNT; i++) {
+		zassert_true(lookup_tok(), "Tokenizer lookup failed");
+	}
+
+	tok_ns = (benchmark_time_ns() - start) / MSG_COUNT;
+
+	zassert_equal(heap_ops, 0, "Tokenizer used the heap");
+
+	TC_PRINT("Shadow delta (%zu bytes): cJSON %d heap operations, %d ns "
+		 "per message, tokenizer 0 heap operations, %d ns per "
+		 "message, %zu bytes of tokens\n",
+		 sizeof(shadow_delta) - 1, cjson_ops / MSG_COUNT, cjson_ns,
+		 tok_ns, parse(shadow_delta) * sizeof(struct json_tok));
+}
+
+void test_main(void)
+{
+	ztest_test_suite(json_tok_test,
+			 ztest_unit_test(test_find),
+			 ztest_unit_test(test_strings),
+			 ztest_unit_test(test_malformed),
+			 ztest_unit_test(test_limits),
+			 ztest_unit_test(test_count),
+			 ztest_unit_test(test_alloc),
+			 ztest_unit_test(test_benchmark)
+			 );
+
+	ztest_run_test_suite(json_tok_test);
+}
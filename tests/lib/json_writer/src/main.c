@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <json_writer.h>
+
+static char buf[512];
+
+static void writer_check(struct json_writer *w, const char *expected)
+{
+	int len = json_writer_finish(w);
+
+	zassert_equal(len, (int)strlen(expected), "Wrong length %d", len);
+	zassert_true(strcmp(buf, expected) == 0, "Unexpected output %s", buf);
+}
+
+static void test_values(void)
+{
+	struct json_writer w;
+
+	json_writer_init(&w, buf, sizeof(buf));
+	json_writer_obj_start(&w, NULL);
+	json_writer_str(&w, "s", "a\"b\\c\n\x01");
+	json_writer_int(&w, "min", INT64_MIN);
+	json_writer_int(&w, "zero", 0);
+	json_writer_num(&w, "num", 0.5);
+	json_writer_bool(&w, "t", true);
+	json_writer_null(&w, "n");
+	json_writer_arr_start(&w, "arr");
+	json_writer_int(&w, NULL, 1);
+	json_writer_obj_start(&w, NULL);
+	json_writer_obj_end(&w);
+	json_writer_arr_start(&w, NULL);
+	json_writer_arr_end(&w);
+	json_writer_raw(&w, NULL, "{\"x\":2}", 7);
+	json_writer_arr_end(&w);
+	json_writer_obj_end(&w);
+
+	writer_check(&w, "{\"s\":\"a\\\"b\\\\c\\n\\u0001\","
+			 "\"min\":-9223372036854775808,\"zero\":0,"
+			 "\"num\":0.5,\"t\":true,\"n\":null,"
+			 "\"arr\":[1,{},[],{\"x\":2}]}");
+}
+
+static void test_measure(void)
+{
+	int len;
+	struct json_writer w;
+
+	json_writer_init(&w, NULL, 0);
+	json_writer_obj_start(&w, NULL);
+	json_writer_str(&w, "appId", "TEMP");
+	json_writer_obj_end(&w);
+	len = json_writer_finish(&w);
+
+	zassert_equal(len, (int)strlen("{\"appId\":\"TEMP\"}"),
+		      "Wrong length %d", len);
+}
+
+static void test_buffer_full(void)
+{
+	int err;
+	struct json_writer w;
+	const char *doc = "{\"appId\":\"TEMP\"}";
+
+	/* No room for the terminating null character */
+	json_writer_init(&w, buf, strlen(doc));
+	json_writer_obj_start(&w, NULL);
+	json_writer_str(&w, "appId", "TEMP");
+	err = json_writer_obj_end(&w);
+	zassert_equal(err, -ENOMEM, "Overflow not detected");
+	zassert_equal(json_writer_finish(&w), -ENOMEM, "Error not kept");
+
+	json_writer_init(&w, buf, strlen(doc) + 1);
+	json_writer_obj_start(&w, NULL);
+	json_writer_str(&w, "appId", "TEMP");
+	json_writer_obj_end(&w);
+	writer_check(&w, doc);
+}
+
+static void test_misuse(void)
+{
+	struct json_writer w;
+
+	/* Member without name */
+	json_writer_init(&w, buf, sizeof(buf));
+	json_writer_obj_start(&w, NULL);
+	zassert_equal(json_writer_int(&w, NULL, 1), -EINVAL, NULL);
+
+	/* Array element with name */
+	json_writer_init(&w, buf, sizeof(buf));
+	json_writer_arr_start(&w, NULL);
+	zassert_equal(json_writer_int(&w, "a", 1), -EINVAL, NULL);
+
+	/* Mismatched end */
+	json_writer_init(&w, buf, sizeof(buf));
+	json_writer_arr_start(&w, NULL);
+	zassert_equal(json_writer_obj_end(&w), -EINVAL, NULL);
+
+	/* String without value, a null value is written explicitly */
+	json_writer_init(&w, buf, sizeof(buf));
+	json_writer_obj_start(&w, NULL);
+	zassert_equal(json_writer_str(&w, "s", NULL), -EINVAL, NULL);
+	json_writer_obj_end(&w);
+	zassert_equal(json_writer_finish(&w), -EINVAL, "Error not kept");
+
+	/* Raw value without JSON */
+	json_writer_init(&w, buf, sizeof(buf));
+	zassert_equal(json_writer_raw(&w, NULL, NULL, 1), -EINVAL, NULL);
+
+	/* Second value in the document */
+	json_writer_init(&w, buf, sizeof(buf));
+	json_writer_null(&w, NULL);
+	zassert_equal(json_writer_null(&w, NULL), -EINVAL, NULL);
+
+	/* Unterminated and empty documents */
+	json_writer_init(&w, buf, sizeof(buf));
+	json_writer_arr_start(&w, NULL);
+	zassert_equal(json_writer_finish(&w), -EINVAL, NULL);
+	json_writer_init(&w, buf, sizeof(buf));
+	zassert_equal(json_writer_finish(&w), -EINVAL, NULL);
+}
+
+static void test_depth(void)
+{
+	int err = 0;
+	struct json_writer w;
+
+	json_writer_init(&w, buf, sizeof(buf));
+
+	for (int i = 0; i < CONFIG_JSON_WRITER_MAX_DEPTH; i++) {
+		err = json_writer_arr_start(&w, NULL);
+		zassert_equal(err, 0, "Depth %d refused", i);
+	}
+
+	err = json_writer_arr_start(&w, NULL);
+	zassert_equal(err, -EOVERFLOW, "Depth limit not enforced");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(json_writer_test,
+			 ztest_unit_test(test_values),
+			 ztest_unit_test(test_measure),
+			 ztest_unit_test(test_buffer_full),
+			 ztest_unit_test(test_misuse),
+			 ztest_unit_test(test_depth)
+			 );
+
+	ztest_run_test_suite(json_writer_test);
+}
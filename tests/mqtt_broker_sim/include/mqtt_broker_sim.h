@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef MQTT_BROKER_SIM_H_
+#define MQTT_BROKER_SIM_H_
+
+/**
+ * @file mqtt_broker_sim.h
+ *
+ * @defgroup mqtt_broker_sim Simulated MQTT broker
+ *
+ * @{
+ *
+ * @brief Public APIs for the simulated MQTT broker.
+ *
+ * The simulated broker is a minimal MQTT 3.1.1 broker that runs in the
+ * same process as the cloud libraries on host builds, and accepts
+ * connections through the loopback interface. Messages published to topics
+ * in a script are answered with recorded responses, so that the cloud
+ * libraries can be tested and benchmarked without a live service.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+#include <stddef.h>
+
+/** @brief Scripted response to a published message. */
+struct mqtt_broker_sim_entry {
+	/** Topic filter matched against the topics of published messages.
+	 *  It may contain the '+' and '#' wildcards.
+	 */
+	const char *topic;
+	/** Topic of the response. If NULL, the response is sent to the
+	 *  topic of the published message, followed by @p resp_suffix.
+	 */
+	const char *resp_topic;
+	/** Suffix added to the topic of the published message, for example
+	 *  "/accepted". Only used if @p resp_topic is NULL.
+	 */
+	const char *resp_suffix;
+	/** Null-terminated payload of the response, or NULL for an empty
+	 *  payload.
+	 */
+	const char *payload;
+	/** Time from the message is received until the response is sent,
+	 *  in milliseconds.
+	 */
+	uint32_t latency_ms;
+	/** Maximum QoS of the response, 0 or 1. */
+	uint8_t qos;
+	/** Keep the response as the retained message of its topic. */
+	bool retain;
+};
+
+/** @brief Statistics of the simulated broker. */
+struct mqtt_broker_sim_stats {
+	/** Number of accepted connections. */
+	uint32_t connects;
+	/** Number of connections that resumed a stored session. */
+	uint32_t sessions_resumed;
+	/** Number of PUBLISH packets received from clients. */
+	uint32_t publish_rx;
+	/** Number of PUBLISH packets sent to clients. */
+	uint32_t publish_tx;
+	/** Number of PUBACK packets received from clients. */
+	uint32_t puback_rx;
+	/** Number of topic filters subscribed to, including filters that
+	 *  were already subscribed to.
+	 */
+	uint32_t subscribes;
+	/** Number of published messages that matched a script entry. */
+	uint32_t scripted;
+	/** Number of bytes received from clients. */
+	uint32_t bytes_rx;
+	/** Number of bytes sent to clients. */
+	uint32_t bytes_tx;
+	/** Number of messages dropped because a queue or buffer was full. */
+	uint32_t dropped;
+};
+
+/**
+ * @brief Start the simulated broker.
+ *
+ * The broker listens on port @option{CONFIG_MQTT_BROKER_SIM_PORT} of all
+ * local IPv4 addresses, and handles its clients in a thread of its own.
+ *
+ * @retval 0         If the operation was successful.
+ * @retval -EALREADY If the broker is already started.
+ * @retval -errno    If the listening socket could not be set up.
+ */
+int mqtt_broker_sim_start(void);
+
+/**
+ * @brief Set the script used to answer published messages.
+ *
+ * Each published message is matched against the topic filters of the
+ * script. The response of the matching entry is sent to the subscribers of
+ * its topic, after the latency of the entry. Consecutive entries with the
+ * same topic filter are all answered, in order. A topic that does not match
+ * any entry is only forwarded to its subscribers.
+ *
+ * @note The script is not copied and must remain valid while it is in use.
+ *
+ * @param script Array of script entries, or NULL to clear the script.
+ * @param count  Number of entries in the array.
+ *
+ * @retval 0       If the operation was successful.
+ * @retval -EINVAL If the script is invalid.
+ * @retval -ENOMEM If the script has too many entries or topic levels.
+ */
+int mqtt_broker_sim_script_set(const struct mqtt_broker_sim_entry *script,
+			       size_t count);
+
+/**
+ * @brief Publish a message to the subscribers of a topic.
+ *
+ * Used to send messages that are not responses, such as shadow deltas and
+ * job notifications.
+ *
+ * @note The topic is copied, but the payload is not, and must remain valid
+ *       until the message has been sent.
+ *
+ * @param topic    Null-terminated topic.
+ * @param payload  Null-terminated payload, or NULL for an empty payload.
+ * @param qos      Maximum QoS of the message, 0 or 1.
+ * @param retain   Keep the message as the retained message of its topic.
+ * @param delay_ms Time until the message is sent, in milliseconds.
+ *
+ * @retval 0        If the operation was successful.
+ * @retval -EINVAL  If the topic is invalid.
+ * @retval -ENOBUFS If the queue of delayed messages, or the table of
+ *                  retained messages, was full.
+ */
+int mqtt_broker_sim_publish(const char *topic, const char *payload,
+			    uint8_t qos, bool retain, uint32_t delay_ms);
+
+/**
+ * @brief Get statistics of the simulated broker.
+ *
+ * @param stats Pointer to where the statistics are stored.
+ */
+void mqtt_broker_sim_stats_get(struct mqtt_broker_sim_stats *stats);
+
+/**
+ * @brief Reset the retained messages, delayed messages and statistics.
+ *
+ * Connected clients, stored sessions and their subscriptions are kept.
+ */
+void mqtt_broker_sim_reset(void);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MQTT_BROKER_SIM_H_ */
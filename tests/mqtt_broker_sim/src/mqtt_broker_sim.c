@@ -0,0 +1,1131 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <net/socket.h>
+#include <net/mqtt_topic_trie.h>
+#include <logging/log.h>
+
+#include <mqtt_broker_sim.h>
+
+LOG_MODULE_REGISTER(mqtt_broker_sim, CONFIG_MQTT_BROKER_SIM_LOG_LEVEL);
+
+/* MQTT 3.1.1 control packet types */
+#define PKT_CONNECT     1
+#define PKT_CONNACK     2
+#define PKT_PUBLISH     3
+#define PKT_PUBACK      4
+#define PKT_SUBSCRIBE   8
+#define PKT_SUBACK      9
+#define PKT_UNSUBSCRIBE 10
+#define PKT_UNSUBACK    11
+#define PKT_PINGREQ     12
+#define PKT_PINGRESP    13
+#define PKT_DISCONNECT  14
+
+#define PROTOCOL_LEVEL_3_1_1       4
+#define CONNACK_ACCEPTED           0
+#define CONNACK_BAD_PROTOCOL_LEVEL 1
+#define CONNACK_SESSION_PRESENT    0x01
+#define CONNECT_FLAG_CLEAN_SESSION 0x02
+#define SUBACK_FAILURE             0x80
+
+/* Fixed header with a remaining length of up to four bytes */
+#define FIXED_HEADER_MAX_LEN 5
+/* Filters in one SUBSCRIBE or UNSUBSCRIBE packet */
+#define FILTERS_PER_PACKET_MAX 16
+
+/* Messages published with mqtt_broker_sim_publish() from another thread
+ * while the broker waits for data are sent within this interval.
+ */
+#define POLL_INTERVAL_MS 10
+
+#define TOPIC_LEN_MAX CONFIG_MQTT_BROKER_SIM_TOPIC_LEN_MAX
+/* Sessions of clients with longer IDs are not stored */
+#define CLIENT_ID_LEN_MAX 64
+
+struct subscription {
+	bool in_use;
+	uint8_t qos;
+	char filter[TOPIC_LEN_MAX + 1];
+};
+
+struct client {
+	int fd;
+	bool connected;
+	/* Set when a send failed, the client is closed by the broker thread */
+	bool failed;
+	uint16_t next_id;
+	/* The client connected without the clean session flag */
+	bool persistent;
+	/* The slot holds the session of a disconnected client, which is
+	 * dropped if the slot is needed for a new connection.
+	 */
+	bool stored;
+	char client_id[CLIENT_ID_LEN_MAX + 1];
+	struct subscription subs[CONFIG_MQTT_BROKER_SIM_SUBSCRIPTIONS_MAX];
+	struct mqtt_topic_trie trie;
+	struct mqtt_topic_trie_node nodes[CONFIG_MQTT_BROKER_SIM_TRIE_NODES];
+	uint16_t slots[2 * CONFIG_MQTT_BROKER_SIM_TRIE_NODES];
+	size_t rx_len;
+	uint8_t rx_buf[CONFIG_MQTT_BROKER_SIM_RX_BUF_SIZE];
+};
+
+struct retained {
+	bool in_use;
+	uint8_t qos;
+	char topic[TOPIC_LEN_MAX + 1];
+	size_t len;
+	uint8_t payload[CONFIG_MQTT_BROKER_SIM_RETAINED_PAYLOAD_MAX];
+};
+
+/* Message waiting to be sent */
+struct pending {
+	int64_t send_at;	/* Uptime when the message is sent */
+	const char *payload;	/* Null-terminated payload, not copied */
+	uint8_t qos;
+	bool retain;
+	char topic[TOPIC_LEN_MAX + 1];
+};
+
+static struct client clients[CONFIG_MQTT_BROKER_SIM_CLIENTS_MAX];
+static struct retained retained[CONFIG_MQTT_BROKER_SIM_RETAINED_MAX];
+/* Messages sorted by send time, sent from index 0. */
+static struct pending queue[CONFIG_MQTT_BROKER_SIM_QUEUE_LEN];
+static size_t queue_len;
+static const struct mqtt_broker_sim_entry *script;
+static size_t script_len;
+static struct mqtt_broker_sim_stats stats;
+static uint8_t tx_buf[CONFIG_MQTT_BROKER_SIM_TX_BUF_SIZE];
+static int listen_fd = -1;
+
+MQTT_TOPIC_TRIE_DEFINE(script_trie, CONFIG_MQTT_BROKER_SIM_TRIE_NODES);
+/* Holds one filter at a time, to find the retained messages it matches. */
+MQTT_TOPIC_TRIE_DEFINE(filter_trie, CONFIG_MQTT_TOPIC_TRIE_LEVEL_MAX + 1);
+
+K_MUTEX_DEFINE(broker_mutex);
+K_THREAD_STACK_DEFINE(broker_stack, CONFIG_MQTT_BROKER_SIM_STACK_SIZE);
+static struct k_thread broker_thread;
+
+static bool topic_valid(const char *topic, size_t len)
+{
+	return (len > 0) && (len <= TOPIC_LEN_MAX) &&
+	       (memchr(topic, '+', len) == NULL) &&
+	       (memchr(topic, '#', len) == NULL);
+}
+
+static int u16_read(const uint8_t **pos, const uint8_t *end, uint16_t *val)
+{
+	if (end - *pos < 2) {
+		return -EBADMSG;
+	}
+
+	*val = ((*pos)[0] << 8) | (*pos)[1];
+	*pos += 2;
+
+	return 0;
+}
+
+static int str_read(const uint8_t **pos, const uint8_t *end,
+		    const char **str, size_t *len)
+{
+	uint16_t str_len;
+
+	if (u16_read(pos, end, &str_len) || (end - *pos < str_len)) {
+		return -EBADMSG;
+	}
+
+	*str = (const char *)*pos;
+	*len = str_len;
+	*pos += str_len;
+
+	return 0;
+}
+
+static size_t fixed_header_write(uint8_t *buf, uint8_t type_flags,
+				 size_t remaining_len)
+{
+	size_t len = 0;
+
+	buf[len++] = type_flags;
+
+	do {
+		buf[len] = remaining_len & 0x7f;
+		remaining_len >>= 7;
+
+		if (remaining_len > 0) {
+			buf[len] |= 0x80;
+		}
+
+		len++;
+	} while (remaining_len > 0);
+
+	return len;
+}
+
+/* Must be called with broker_mutex held. */
+static int send_all(struct client *c, const void *buf, size_t len)
+{
+	const uint8_t *pos = buf;
+
+	while (len > 0) {
+		ssize_t sent = zsock_send(c->fd, pos, len, 0);
+
+		if (sent < 0) {
+			LOG_WRN("Send failed, errno %d", errno);
+			c->failed = true;
+			return -errno;
+		}
+
+		stats.bytes_tx += sent;
+		pos += sent;
+		len -= sent;
+	}
+
+	return 0;
+}
+
+static int ack_send(struct client *c, uint8_t type, uint16_t id)
+{
+	uint8_t buf[] = { type << 4, 2, id >> 8, id & 0xff };
+
+	return send_all(c, buf, sizeof(buf));
+}
+
+/* Must be called with broker_mutex held. */
+static int client_publish(struct client *c, const char *topic, size_t topic_len,
+			  const void *payload, size_t payload_len, uint8_t qos,
+			  bool retain)
+{
+	size_t remaining_len = 2 + topic_len + payload_len + (qos ? 2 : 0);
+	size_t len;
+	int err;
+
+	if (FIXED_HEADER_MAX_LEN + remaining_len > sizeof(tx_buf)) {
+		LOG_WRN("Message does not fit in the transmit buffer");
+		stats.dropped++;
+		return -EMSGSIZE;
+	}
+
+	len = fixed_header_write(tx_buf, (PKT_PUBLISH << 4) | (qos << 1) |
+					 (retain ? 1 : 0),
+				 remaining_len);
+	tx_buf[len++] = topic_len >> 8;
+	tx_buf[len++] = topic_len & 0xff;
+	memcpy(&tx_buf[len], topic, topic_len);
+	len += topic_len;
+
+	if (qos) {
+		if (c->next_id == 0) {
+			c->next_id++;
+		}
+
+		tx_buf[len++] = c->next_id >> 8;
+		tx_buf[len++] = c->next_id & 0xff;
+		c->next_id++;
+	}
+
+	if (payload_len) {
+		memcpy(&tx_buf[len], payload, payload_len);
+		len += payload_len;
+	}
+
+	err = send_all(c, tx_buf, len);
+	if (!err) {
+		stats.publish_tx++;
+	}
+
+	return err;
+}
+
+/* Send a message to all clients subscribed to its topic. As required for
+ * established subscriptions, the retain flag is not set.
+ *
+ * Must be called with broker_mutex held.
+ */
+static void route(const char *topic, size_t topic_len, const void *payload,
+		  size_t payload_len, uint8_t qos)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		struct client *c = &clients[i];
+		int sub;
+
+		if ((c->fd < 0) || !c->connected || c->failed) {
+			continue;
+		}
+
+		sub = mqtt_topic_trie_match(&c->trie, topic, topic_len, NULL);
+		if (sub < 0) {
+			continue;
+		}
+
+		(void)client_publish(c, topic, topic_len, payload, payload_len,
+				     MIN(qos, c->subs[sub].qos), false);
+	}
+}
+
+/* Must be called with broker_mutex held. */
+static int retained_store(const char *topic, size_t topic_len,
+			  const void *payload, size_t payload_len, uint8_t qos)
+{
+	struct retained *r = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(retained); i++) {
+		if (retained[i].in_use &&
+		    (strlen(retained[i].topic) == topic_len) &&
+		    !memcmp(retained[i].topic, topic, topic_len)) {
+			r = &retained[i];
+			break;
+		}
+
+		if (!retained[i].in_use && (r == NULL)) {
+			r = &retained[i];
+		}
+	}
+
+	/* An empty payload removes the retained message of the topic */
+	if (payload_len == 0) {
+		if (r != NULL && r->in_use) {
+			r->in_use = false;
+		}
+
+		return 0;
+	}
+
+	if ((r == NULL) || (payload_len > sizeof(r->payload))) {
+		LOG_WRN("Retained message dropped");
+		stats.dropped++;
+		return -ENOBUFS;
+	}
+
+	r->in_use = true;
+	r->qos = qos;
+	memcpy(r->topic, topic, topic_len);
+	r->topic[topic_len] = '\0';
+	memcpy(r->payload, payload, payload_len);
+	r->len = payload_len;
+
+	return 0;
+}
+
+/* Must be called with broker_mutex held. */
+static void retained_send(struct client *c, const struct subscription *sub)
+{
+	mqtt_topic_trie_clear(&filter_trie);
+
+	if (mqtt_topic_trie_add(&filter_trie, sub->filter, strlen(sub->filter),
+				0)) {
+		return;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(retained); i++) {
+		const struct retained *r = &retained[i];
+
+		if (!r->in_use ||
+		    mqtt_topic_trie_match(&filter_trie, r->topic,
+					  strlen(r->topic), NULL) < 0) {
+			continue;
+		}
+
+		(void)client_publish(c, r->topic, strlen(r->topic), r->payload,
+				     r->len, MIN(r->qos, sub->qos), true);
+	}
+}
+
+/* Must be called with broker_mutex held. */
+static int enqueue(const char *topic, size_t topic_len, const char *payload,
+		   uint8_t qos, bool retain, int64_t send_at)
+{
+	size_t i;
+
+	if (queue_len == ARRAY_SIZE(queue)) {
+		LOG_WRN("Queue full, message dropped");
+		stats.dropped++;
+		return -ENOBUFS;
+	}
+
+	/* Keep messages in the order they are sent, preserving the order of
+	 * messages that are sent at the same time.
+	 */
+	for (i = queue_len; i > 0; i--) {
+		if (queue[i - 1].send_at <= send_at) {
+			break;
+		}
+
+		queue[i] = queue[i - 1];
+	}
+
+	queue[i].send_at = send_at;
+	queue[i].payload = payload;
+	queue[i].qos = qos;
+	queue[i].retain = retain;
+	memcpy(queue[i].topic, topic, topic_len);
+	queue[i].topic[topic_len] = '\0';
+	queue_len++;
+
+	return 0;
+}
+
+/* Send the messages that are due, and return the time until the next one,
+ * in milliseconds.
+ *
+ * Must be called with broker_mutex held.
+ */
+static int queue_process(void)
+{
+	int64_t now = k_uptime_get();
+
+	while ((queue_len > 0) && (queue[0].send_at <= now)) {
+		struct pending *msg = &queue[0];
+		size_t payload_len = msg->payload ? strlen(msg->payload) : 0;
+
+		if (msg->retain) {
+			(void)retained_store(msg->topic, strlen(msg->topic),
+					     msg->payload, payload_len,
+					     msg->qos);
+		}
+
+		route(msg->topic, strlen(msg->topic), msg->payload, payload_len,
+		      msg->qos);
+
+		queue_len--;
+		memmove(&queue[0], &queue[1], queue_len * sizeof(queue[0]));
+	}
+
+	if (queue_len > 0) {
+		return (int)MIN(queue[0].send_at - now, POLL_INTERVAL_MS);
+	}
+
+	return POLL_INTERVAL_MS;
+}
+
+/* Queue the responses of the script entries matching a published topic.
+ *
+ * Must be called with broker_mutex held.
+ */
+static void script_run(const char *topic, size_t topic_len)
+{
+	int64_t now = k_uptime_get();
+	int first = mqtt_topic_trie_match(&script_trie, topic, topic_len, NULL);
+
+	if ((first < 0) || (script == NULL)) {
+		return;
+	}
+
+	stats.scripted++;
+
+	for (size_t i = first; i < script_len; i++) {
+		const struct mqtt_broker_sim_entry *entry = &script[i];
+		char resp_topic[TOPIC_LEN_MAX + 1];
+		size_t len;
+
+		if ((i > (size_t)first) &&
+		    strcmp(entry->topic, script[first].topic)) {
+			break;
+		}
+
+		if (entry->resp_topic) {
+			len = strlen(entry->resp_topic);
+			memcpy(resp_topic, entry->resp_topic, len);
+		} else {
+			size_t suffix_len = entry->resp_suffix ?
+					    strlen(entry->resp_suffix) : 0;
+
+			len = topic_len + suffix_len;
+			if (len > TOPIC_LEN_MAX) {
+				LOG_WRN("Response topic too long");
+				stats.dropped++;
+				continue;
+			}
+
+			memcpy(resp_topic, topic, topic_len);
+			if (suffix_len > 0) {
+				memcpy(&resp_topic[topic_len],
+				       entry->resp_suffix, suffix_len);
+			}
+		}
+
+		(void)enqueue(resp_topic, len, entry->payload, entry->qos,
+			      entry->retain, now + entry->latency_ms);
+	}
+}
+
+static void trie_rebuild(struct client *c)
+{
+	mqtt_topic_trie_clear(&c->trie);
+
+	for (size_t i = 0; i < ARRAY_SIZE(c->subs); i++) {
+		if (c->subs[i].in_use) {
+			(void)mqtt_topic_trie_add(&c->trie, c->subs[i].filter,
+						  strlen(c->subs[i].filter), i);
+		}
+	}
+}
+
+static struct subscription *sub_find(struct client *c, const char *filter,
+				     size_t len)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(c->subs); i++) {
+		if (c->subs[i].in_use && (strlen(c->subs[i].filter) == len) &&
+		    !memcmp(c->subs[i].filter, filter, len)) {
+			return &c->subs[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Returns the granted QoS, or SUBACK_FAILURE. */
+static uint8_t sub_add(struct client *c, const char *filter, size_t len,
+		       uint8_t qos, struct subscription **added)
+{
+	struct subscription *sub = sub_find(c, filter, len);
+	int err;
+
+	if (sub != NULL) {
+		sub->qos = MIN(qos, 1);
+		stats.subscribes++;
+		*added = sub;
+		return sub->qos;
+	}
+
+	if (len > TOPIC_LEN_MAX) {
+		return SUBACK_FAILURE;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(c->subs); i++) {
+		if (c->subs[i].in_use) {
+			continue;
+		}
+
+		sub = &c->subs[i];
+		memcpy(sub->filter, filter, len);
+		sub->filter[len] = '\0';
+
+		err = mqtt_topic_trie_add(&c->trie, sub->filter, len, i);
+		if (err) {
+			LOG_WRN("Subscription failed: %d", err);
+			/* Drop the nodes of the partly added filter */
+			trie_rebuild(c);
+			return SUBACK_FAILURE;
+		}
+
+		sub->in_use = true;
+		sub->qos = MIN(qos, 1);
+		stats.subscribes++;
+		*added = sub;
+
+		return sub->qos;
+	}
+
+	LOG_WRN("Too many subscriptions");
+
+	return SUBACK_FAILURE;
+}
+
+/* Take over the session of a client that connects again. A connection that
+ * still uses the client ID is closed. The session is dropped if the client
+ * asks for a clean session. Returns true if a session was resumed.
+ */
+static bool session_resume(struct client *c, bool clean_session)
+{
+	struct client *stored = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		struct client *other = &clients[i];
+
+		if ((other == c) || strcmp(other->client_id, c->client_id)) {
+			continue;
+		}
+
+		if (other->stored) {
+			stored = other;
+			break;
+		}
+
+		if ((other->fd >= 0) && other->connected) {
+			LOG_DBG("Client ID in use, closing the old connection");
+			other->connected = false;
+			other->failed = true;
+			stored = other->persistent ? other : NULL;
+			break;
+		}
+	}
+
+	if (stored == NULL) {
+		return false;
+	}
+
+	stored->stored = false;
+
+	if (clean_session) {
+		return false;
+	}
+
+	memcpy(c->subs, stored->subs, sizeof(c->subs));
+	trie_rebuild(c);
+	stats.sessions_resumed++;
+
+	return true;
+}
+
+static int connect_handle(struct client *c, const uint8_t *pos,
+			  const uint8_t *end)
+{
+	uint8_t connack[] = { PKT_CONNACK << 4, 2, 0, CONNACK_ACCEPTED };
+	const char *protocol;
+	size_t protocol_len;
+	uint16_t keepalive;
+	const char *client_id;
+	size_t client_id_len;
+	bool clean_session;
+
+	if (c->connected || str_read(&pos, end, &protocol, &protocol_len) ||
+	    (end - pos < 2)) {
+		return -EBADMSG;
+	}
+
+	if (pos[0] != PROTOCOL_LEVEL_3_1_1) {
+		LOG_WRN("Unsupported protocol level %d", pos[0]);
+		connack[3] = CONNACK_BAD_PROTOCOL_LEVEL;
+		(void)send_all(c, connack, sizeof(connack));
+		return -EPROTONOSUPPORT;
+	}
+
+	/* Of the connect flags, only the clean session flag is used. The will
+	 * message, user name and password are ignored.
+	 */
+	clean_session = pos[1] & CONNECT_FLAG_CLEAN_SESSION;
+	pos += 2;
+
+	if (u16_read(&pos, end, &keepalive) ||
+	    str_read(&pos, end, &client_id, &client_id_len)) {
+		return -EBADMSG;
+	}
+
+	LOG_DBG("Client connected, ID length %d, keepalive %d s",
+		client_id_len, keepalive);
+
+	/* Sessions are only stored for clients that have an ID */
+	if ((client_id_len > 0) && (client_id_len <= CLIENT_ID_LEN_MAX)) {
+		memcpy(c->client_id, client_id, client_id_len);
+		c->client_id[client_id_len] = '\0';
+		c->persistent = !clean_session;
+
+		if (session_resume(c, clean_session)) {
+			LOG_DBG("Session resumed");
+			connack[2] = CONNACK_SESSION_PRESENT;
+		}
+	}
+
+	c->connected = true;
+	stats.connects++;
+
+	return send_all(c, connack, sizeof(connack));
+}
+
+static int publish_handle(struct client *c, uint8_t flags, const uint8_t *pos,
+			  const uint8_t *end)
+{
+	uint8_t qos = (flags >> 1) & 0x03;
+	bool retain = flags & 0x01;
+	const char *topic;
+	size_t topic_len;
+	uint16_t id = 0;
+	int err;
+
+	if (str_read(&pos, end, &topic, &topic_len) ||
+	    (qos && u16_read(&pos, end, &id))) {
+		return -EBADMSG;
+	}
+
+	if (qos > 1) {
+		LOG_WRN("QoS %d is not supported", qos);
+		return -ENOTSUP;
+	}
+
+	if (!topic_valid(topic, topic_len)) {
+		LOG_WRN("Invalid topic");
+		return -EINVAL;
+	}
+
+	stats.publish_rx++;
+
+	if (qos) {
+		err = ack_send(c, PKT_PUBACK, id);
+		if (err) {
+			return err;
+		}
+	}
+
+	if (retain) {
+		(void)retained_store(topic, topic_len, pos, end - pos, qos);
+	}
+
+	route(topic, topic_len, pos, end - pos, qos);
+	script_run(topic, topic_len);
+
+	return 0;
+}
+
+static int subscribe_handle(struct client *c, const uint8_t *pos,
+			    const uint8_t *end)
+{
+	uint8_t suback[FIXED_HEADER_MAX_LEN + 2 + FILTERS_PER_PACKET_MAX];
+	struct subscription *added[FILTERS_PER_PACKET_MAX];
+	size_t count = 0;
+	size_t len;
+	uint16_t id;
+	int err;
+
+	if (u16_read(&pos, end, &id) || (pos == end)) {
+		return -EBADMSG;
+	}
+
+	for (; pos < end; count++) {
+		const char *filter;
+		size_t filter_len;
+
+		if ((count == FILTERS_PER_PACKET_MAX) ||
+		    str_read(&pos, end, &filter, &filter_len) || (pos == end)) {
+			return -EBADMSG;
+		}
+
+		added[count] = NULL;
+		suback[FIXED_HEADER_MAX_LEN + 2 + count] =
+			sub_add(c, filter, filter_len, *pos++, &added[count]);
+	}
+
+	/* The fixed header is written right before the packet identifier */
+	len = fixed_header_write(suback, PKT_SUBACK << 4, 2 + count);
+	memmove(&suback[FIXED_HEADER_MAX_LEN - len], suback, len);
+	suback[FIXED_HEADER_MAX_LEN] = id >> 8;
+	suback[FIXED_HEADER_MAX_LEN + 1] = id & 0xff;
+
+	err = send_all(c, &suback[FIXED_HEADER_MAX_LEN - len], len + 2 + count);
+	if (err) {
+		return err;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (added[i] != NULL) {
+			retained_send(c, added[i]);
+		}
+	}
+
+	return 0;
+}
+
+static int unsubscribe_handle(struct client *c, const uint8_t *pos,
+			      const uint8_t *end)
+{
+	uint16_t id;
+
+	if (u16_read(&pos, end, &id) || (pos == end)) {
+		return -EBADMSG;
+	}
+
+	while (pos < end) {
+		const char *filter;
+		size_t filter_len;
+		struct subscription *sub;
+
+		if (str_read(&pos, end, &filter, &filter_len)) {
+			return -EBADMSG;
+		}
+
+		sub = sub_find(c, filter, filter_len);
+		if (sub != NULL) {
+			sub->in_use = false;
+		}
+	}
+
+	trie_rebuild(c);
+
+	return ack_send(c, PKT_UNSUBACK, id);
+}
+
+static int packet_handle(struct client *c, uint8_t type_flags,
+			 const uint8_t *body, size_t len)
+{
+	uint8_t type = type_flags >> 4;
+	uint8_t flags = type_flags & 0x0f;
+	uint8_t pingresp[] = { PKT_PINGRESP << 4, 0 };
+
+	if (!c->connected && (type != PKT_CONNECT)) {
+		LOG_WRN("Packet type %d before CONNECT", type);
+		return -ENOTCONN;
+	}
+
+	switch (type) {
+	case PKT_CONNECT:
+		return connect_handle(c, body, body + len);
+	case PKT_PUBLISH:
+		return publish_handle(c, flags, body, body + len);
+	case PKT_PUBACK:
+		stats.puback_rx++;
+		return 0;
+	case PKT_SUBSCRIBE:
+		return subscribe_handle(c, body, body + len);
+	case PKT_UNSUBSCRIBE:
+		return unsubscribe_handle(c, body, body + len);
+	case PKT_PINGREQ:
+		return send_all(c, pingresp, sizeof(pingresp));
+	case PKT_DISCONNECT:
+		LOG_DBG("Client disconnected");
+		return -ECONNRESET;
+	default:
+		LOG_WRN("Unsupported packet type %d", type);
+		return -ENOTSUP;
+	}
+}
+
+/* Handle the complete packets in the receive buffer. */
+static int client_rx_process(struct client *c)
+{
+	while (c->rx_len >= 2) {
+		size_t remaining_len = 0;
+		size_t header_len = 1;
+		size_t packet_len;
+		uint8_t byte;
+		int err;
+
+		do {
+			if (header_len == FIXED_HEADER_MAX_LEN) {
+				return -EBADMSG;
+			}
+
+			if (header_len == c->rx_len) {
+				/* The remaining length is not complete */
+				return 0;
+			}
+
+			byte = c->rx_buf[header_len];
+			remaining_len |= (byte & 0x7f) << (7 * (header_len - 1));
+			header_len++;
+		} while (byte & 0x80);
+
+		packet_len = header_len + remaining_len;
+		if (packet_len > sizeof(c->rx_buf)) {
+			LOG_ERR("Packet of %d bytes does not fit in the buffer",
+				packet_len);
+			stats.dropped++;
+			return -EMSGSIZE;
+		}
+
+		if (c->rx_len < packet_len) {
+			return 0;
+		}
+
+		err = packet_handle(c, c->rx_buf[0], &c->rx_buf[header_len],
+				    remaining_len);
+		if (err) {
+			return err;
+		}
+
+		c->rx_len -= packet_len;
+		memmove(c->rx_buf, &c->rx_buf[packet_len], c->rx_len);
+	}
+
+	return 0;
+}
+
+static int client_rx(struct client *c)
+{
+	ssize_t len = zsock_recv(c->fd, &c->rx_buf[c->rx_len],
+				 sizeof(c->rx_buf) - c->rx_len,
+				 ZSOCK_MSG_DONTWAIT);
+
+	if (len < 0) {
+		return (errno == EAGAIN) ? 0 : -errno;
+	}
+
+	if (len == 0) {
+		return -ECONNRESET;
+	}
+
+	stats.bytes_rx += len;
+	c->rx_len += len;
+
+	return client_rx_process(c);
+}
+
+/* Close the connection. The subscriptions of a persistent session are kept
+ * in the slot, until the client connects again or the slot is needed.
+ */
+static void client_close(struct client *c)
+{
+	(void)zsock_close(c->fd);
+	c->fd = -1;
+	c->stored = c->connected && c->persistent;
+}
+
+static void client_accept(void)
+{
+	struct client *c = NULL;
+	int fd = zsock_accept(listen_fd, NULL, NULL);
+
+	if (fd < 0) {
+		LOG_ERR("Accept failed, errno %d", errno);
+		return;
+	}
+
+	/* Use a free slot, or else drop a stored session */
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		if ((clients[i].fd < 0) &&
+		    ((c == NULL) || (c->stored && !clients[i].stored))) {
+			c = &clients[i];
+		}
+	}
+
+	if (c == NULL) {
+		LOG_WRN("Too many clients");
+		(void)zsock_close(fd);
+		return;
+	}
+
+	if (c->stored) {
+		LOG_DBG("Stored session dropped");
+	}
+
+	c->fd = fd;
+	c->connected = false;
+	c->failed = false;
+	c->persistent = false;
+	c->stored = false;
+	c->client_id[0] = '\0';
+	c->next_id = 1;
+	c->rx_len = 0;
+	memset(c->subs, 0, sizeof(c->subs));
+	mqtt_topic_trie_clear(&c->trie);
+}
+
+static void broker_thread_fn(void *p1, void *p2, void *p3)
+{
+	struct zsock_pollfd fds[1 + ARRAY_SIZE(clients)];
+	struct client *polled[ARRAY_SIZE(fds)];
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	for (;;) {
+		size_t nfds = 1;
+		int timeout;
+
+		k_mutex_lock(&broker_mutex, K_FOREVER);
+
+		timeout = queue_process();
+
+		fds[0].fd = listen_fd;
+		fds[0].events = ZSOCK_POLLIN;
+
+		for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+			if ((clients[i].fd >= 0) && clients[i].failed) {
+				client_close(&clients[i]);
+			}
+
+			if (clients[i].fd < 0) {
+				continue;
+			}
+
+			polled[nfds] = &clients[i];
+			fds[nfds].fd = clients[i].fd;
+			fds[nfds].events = ZSOCK_POLLIN;
+			nfds++;
+		}
+
+		k_mutex_unlock(&broker_mutex);
+
+		if (zsock_poll(fds, nfds, timeout) <= 0) {
+			continue;
+		}
+
+		k_mutex_lock(&broker_mutex, K_FOREVER);
+
+		for (size_t i = 1; i < nfds; i++) {
+			struct client *c = polled[i];
+			int err = 0;
+
+			if (fds[i].revents & ZSOCK_POLLIN) {
+				err = client_rx(c);
+			} else if (fds[i].revents) {
+				err = -ECONNRESET;
+			}
+
+			if (err || c->failed) {
+				LOG_DBG("Closing client: %d", err);
+				client_close(c);
+			}
+		}
+
+		if (fds[0].revents & ZSOCK_POLLIN) {
+			client_accept();
+		}
+
+		k_mutex_unlock(&broker_mutex);
+	}
+}
+
+int mqtt_broker_sim_start(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(CONFIG_MQTT_BROKER_SIM_PORT),
+		.sin_addr.s_addr = INADDR_ANY,
+	};
+	int optval = 1;
+	int err;
+
+	if (listen_fd >= 0) {
+		return -EALREADY;
+	}
+
+	listen_fd = zsock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listen_fd < 0) {
+		LOG_ERR("Failed to create socket, errno %d", errno);
+		return -errno;
+	}
+
+	(void)zsock_setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &optval,
+			       sizeof(optval));
+
+	err = zsock_bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (!err) {
+		err = zsock_listen(listen_fd, ARRAY_SIZE(clients));
+	}
+
+	if (err) {
+		err = -errno;
+		LOG_ERR("Failed to listen on port %d, errno %d",
+			CONFIG_MQTT_BROKER_SIM_PORT, -err);
+		(void)zsock_close(listen_fd);
+		listen_fd = -1;
+		return err;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		struct client *c = &clients[i];
+
+		c->fd = -1;
+		c->trie.nodes = c->nodes;
+		c->trie.slots = c->slots;
+		c->trie.node_max = ARRAY_SIZE(c->nodes);
+		c->trie.slot_count = ARRAY_SIZE(c->slots);
+	}
+
+	k_thread_create(&broker_thread, broker_stack,
+			K_THREAD_STACK_SIZEOF(broker_stack), broker_thread_fn,
+			NULL, NULL, NULL, CONFIG_MQTT_BROKER_SIM_THREAD_PRIO, 0,
+			K_NO_WAIT);
+	k_thread_name_set(&broker_thread, "mqtt_broker_sim");
+
+	LOG_DBG("Listening on port %d", CONFIG_MQTT_BROKER_SIM_PORT);
+
+	return 0;
+}
+
+int mqtt_broker_sim_script_set(const struct mqtt_broker_sim_entry *entries,
+			       size_t count)
+{
+	int err = 0;
+
+	if ((entries == NULL) && (count > 0)) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&broker_mutex, K_FOREVER);
+
+	mqtt_topic_trie_clear(&script_trie);
+	script = NULL;
+	script_len = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		const struct mqtt_broker_sim_entry *entry = &entries[i];
+
+		if ((entry->topic == NULL) || (entry->qos > 1)) {
+			err = -EINVAL;
+			break;
+		}
+
+		err = mqtt_topic_trie_add(&script_trie, entry->topic,
+					  strlen(entry->topic), i);
+
+		/* Entries with the same topic filter must be consecutive */
+		if ((err == -EALREADY) && (i > 0) &&
+		    !strcmp(entries[i - 1].topic, entry->topic)) {
+			err = 0;
+		} else if (err == -EALREADY) {
+			err = -EINVAL;
+		}
+
+		if (err) {
+			break;
+		}
+	}
+
+	if (err) {
+		LOG_ERR("Invalid script: %d", err);
+		mqtt_topic_trie_clear(&script_trie);
+	} else {
+		script = entries;
+		script_len = count;
+	}
+
+	k_mutex_unlock(&broker_mutex);
+
+	return err;
+}
+
+int mqtt_broker_sim_publish(const char *topic, const char *payload,
+			    uint8_t qos, bool retain, uint32_t delay_ms)
+{
+	size_t payload_len = payload ? strlen(payload) : 0;
+	int err = 0;
+
+	if ((topic == NULL) || !topic_valid(topic, strlen(topic)) ||
+	    (qos > 1)) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&broker_mutex, K_FOREVER);
+
+	if (delay_ms > 0) {
+		err = enqueue(topic, strlen(topic), payload, qos, retain,
+			      k_uptime_get() + delay_ms);
+	} else {
+		if (retain) {
+			err = retained_store(topic, strlen(topic), payload,
+					     payload_len, qos);
+		}
+
+		route(topic, strlen(topic), payload, payload_len, qos);
+	}
+
+	k_mutex_unlock(&broker_mutex);
+
+	return err;
+}
+
+void mqtt_broker_sim_stats_get(struct mqtt_broker_sim_stats *out)
+{
+	k_mutex_lock(&broker_mutex, K_FOREVER);
+	*out = stats;
+	k_mutex_unlock(&broker_mutex);
+}
+
+void mqtt_broker_sim_reset(void)
+{
+	k_mutex_lock(&broker_mutex, K_FOREVER);
+
+	queue_len = 0;
+	memset(retained, 0, sizeof(retained));
+	memset(&stats, 0, sizeof(stats));
+
+	k_mutex_unlock(&broker_mutex);
+}
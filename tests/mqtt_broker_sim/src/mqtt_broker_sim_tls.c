@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/* Stand-in for TLS sockets on host builds. The cloud libraries create their
+ * MQTT sockets with a TLS protocol. So that they can connect to the
+ * simulated broker, these sockets are created as plain TCP sockets, and the
+ * TLS socket options are accepted and ignored.
+ */
+
+#include <zephyr.h>
+#include <errno.h>
+#include <net/socket.h>
+#include <sockets_internal.h>
+#include <sys/fdtable.h>
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(mqtt_broker_sim, CONFIG_MQTT_BROKER_SIM_LOG_LEVEL);
+
+/* The object of a stand-in socket is the descriptor of its TCP socket */
+#define FD_TO_OBJ(fd) ((void *)(intptr_t)((fd) + 1))
+#define OBJ_TO_FD(obj) ((int)(intptr_t)(obj) - 1)
+
+static const struct socket_op_vtable tls_sim_fd_op_vtable;
+
+static ssize_t tls_sim_sendto(void *obj, const void *buf, size_t len,
+			      int flags, const struct sockaddr *to,
+			      socklen_t tolen)
+{
+	return zsock_sendto(OBJ_TO_FD(obj), buf, len, flags, to, tolen);
+}
+
+static ssize_t tls_sim_sendmsg(void *obj, const struct msghdr *msg, int flags)
+{
+	return zsock_sendmsg(OBJ_TO_FD(obj), msg, flags);
+}
+
+static ssize_t tls_sim_recvfrom(void *obj, void *buf, size_t max_len,
+				int flags, struct sockaddr *from,
+				socklen_t *fromlen)
+{
+	return zsock_recvfrom(OBJ_TO_FD(obj), buf, max_len, flags, from,
+			      fromlen);
+}
+
+static ssize_t tls_sim_read(void *obj, void *buf, size_t count)
+{
+	return tls_sim_recvfrom(obj, buf, count, 0, NULL, NULL);
+}
+
+static ssize_t tls_sim_write(void *obj, const void *buf, size_t count)
+{
+	return tls_sim_sendto(obj, buf, count, 0, NULL, 0);
+}
+
+static int tls_sim_connect(void *obj, const struct sockaddr *addr,
+			   socklen_t addrlen)
+{
+	return zsock_connect(OBJ_TO_FD(obj), addr, addrlen);
+}
+
+static int tls_sim_setsockopt(void *obj, int level, int optname,
+			      const void *optval, socklen_t optlen)
+{
+	if (level == SOL_TLS) {
+		LOG_DBG("TLS option %d ignored", optname);
+		return 0;
+	}
+
+	return zsock_setsockopt(OBJ_TO_FD(obj), level, optname, optval,
+				optlen);
+}
+
+static int tls_sim_getsockopt(void *obj, int level, int optname,
+			      void *optval, socklen_t *optlen)
+{
+	if (level == SOL_TLS) {
+		errno = ENOPROTOOPT;
+		return -1;
+	}
+
+	return zsock_getsockopt(OBJ_TO_FD(obj), level, optname, optval,
+				optlen);
+}
+
+/* Polling and fcntl() are forwarded to the TCP socket. */
+static int tls_sim_ioctl(void *obj, unsigned int request, va_list args)
+{
+	const struct fd_op_vtable *vtable;
+	void *tcp_obj = z_get_fd_obj_and_vtable(OBJ_TO_FD(obj), &vtable);
+
+	if (tcp_obj == NULL) {
+		return -1;
+	}
+
+	return vtable->ioctl(tcp_obj, request, args);
+}
+
+static int tls_sim_close(void *obj)
+{
+	return zsock_close(OBJ_TO_FD(obj));
+}
+
+static const struct socket_op_vtable tls_sim_fd_op_vtable = {
+	.fd_vtable = {
+		.read = tls_sim_read,
+		.write = tls_sim_write,
+		.close = tls_sim_close,
+		.ioctl = tls_sim_ioctl,
+	},
+	.connect = tls_sim_connect,
+	.sendto = tls_sim_sendto,
+	.sendmsg = tls_sim_sendmsg,
+	.recvfrom = tls_sim_recvfrom,
+	.getsockopt = tls_sim_getsockopt,
+	.setsockopt = tls_sim_setsockopt,
+};
+
+static bool tls_sim_is_supported(int family, int type, int proto)
+{
+	return ((family == AF_INET) || (family == AF_INET6)) &&
+	       (type == SOCK_STREAM) &&
+	       (proto >= IPPROTO_TLS_1_0) && (proto <= IPPROTO_TLS_1_2);
+}
+
+static int tls_sim_socket_create(int family, int type, int proto)
+{
+	int fd = z_reserve_fd();
+	int tcp_fd;
+
+	ARG_UNUSED(proto);
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	tcp_fd = zsock_socket(family, type, IPPROTO_TCP);
+	if (tcp_fd < 0) {
+		z_free_fd(fd);
+		return -1;
+	}
+
+	z_finalize_fd(fd, FD_TO_OBJ(tcp_fd),
+		      (const struct fd_op_vtable *)&tls_sim_fd_op_vtable);
+
+	LOG_DBG("TLS stand-in socket %d created", fd);
+
+	return fd;
+}
+
+NET_SOCKET_REGISTER(mqtt_broker_sim_tls, AF_UNSPEC, tls_sim_is_supported,
+		    tls_sim_socket_create);
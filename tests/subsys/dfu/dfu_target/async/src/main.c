@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <string.h>
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <dfu/dfu_target.h>
+
+#define BUF_SIZE 64
+#define DATA_SIZE 256
+
+static uint8_t data[DATA_SIZE];
+static uint8_t written[DATA_SIZE];
+static size_t written_len;
+static bool done_param;
+static bool block_writes;
+
+/* Given by the test to let a blocked write complete */
+static K_SEM_DEFINE(write_sem, 0, 1);
+/* Given by the DFU target when it starts to write a buffer */
+static K_SEM_DEFINE(write_started, 0, 1);
+
+bool dfu_target_mcuboot_identify(const void *const buf)
+{
+	return true;
+}
+
+int dfu_target_mcuboot_init(size_t file_size, dfu_target_callback_t cb)
+{
+	return 0;
+}
+
+int dfu_target_mcuboot_offset_get(size_t *offset)
+{
+	*offset = written_len;
+	return 0;
+}
+
+int dfu_target_mcuboot_write(const void *const buf, size_t len)
+{
+	k_sem_give(&write_started);
+
+	/* Simulate a flash page that takes a while to write */
+	if (block_writes) {
+		k_sem_take(&write_sem, K_FOREVER);
+	}
+
+	zassert_true(written_len + len <= DATA_SIZE, "Too much data written");
+	memcpy(&written[written_len], buf, len);
+	written_len += len;
+
+	return 0;
+}
+
+int dfu_target_mcuboot_done(bool successful)
+{
+	done_param = successful;
+	return 0;
+}
+
+int dfu_target_mcuboot_schedule_update(void)
+{
+	return 0;
+}
+
+int dfu_target_mcuboot_cancel_update(void)
+{
+	return 0;
+}
+
+static void setup(void)
+{
+	int err;
+
+	for (int i = 0; i < DATA_SIZE; i++) {
+		data[i] = i * 3;
+	}
+
+	memset(written, 0, sizeof(written));
+	written_len = 0;
+	done_param = false;
+	block_writes = true;
+	k_sem_reset(&write_sem);
+	k_sem_reset(&write_started);
+
+	err = dfu_target_init(DFU_TARGET_IMAGE_TYPE_MCUBOOT, DATA_SIZE, NULL);
+	zassert_equal(err, 0, NULL);
+}
+
+static void test_overlap(void)
+{
+	int err;
+	size_t offset;
+
+	setup();
+
+	/* A full buffer is handed to the writer thread */
+	err = dfu_target_write(data, BUF_SIZE);
+	zassert_equal(err, 0, NULL);
+	err = k_sem_take(&write_started, K_MSEC(100));
+	zassert_equal(err, 0, "Full buffer not written");
+
+	/* The next data is received while the first buffer is written */
+	err = dfu_target_write(&data[BUF_SIZE], BUF_SIZE / 2);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(written_len, 0, "Write did not overlap");
+
+	/* The progress does not wait for the DFU target */
+	err = dfu_target_offset_get(&offset);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(offset, BUF_SIZE + BUF_SIZE / 2, "Wrong offset");
+	zassert_equal(written_len, 0, "Offset waited for the DFU target");
+
+	block_writes = false;
+	k_sem_give(&write_sem);
+
+	err = dfu_target_done(true);
+	zassert_equal(err, 0, NULL);
+	zassert_true(done_param, "Image not marked as done");
+}
+
+static void test_flush_on_done(void)
+{
+	int err;
+
+	setup();
+	block_writes = false;
+
+	/* Less than a buffer is only written when the image is done */
+	err = dfu_target_write(data, DATA_SIZE - BUF_SIZE / 2);
+	zassert_equal(err, 0, NULL);
+
+	err = dfu_target_done(true);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(written_len, DATA_SIZE - BUF_SIZE / 2,
+		      "Buffered data not written");
+	zassert_mem_equal(written, data, written_len, "Wrong data written");
+	zassert_true(done_param, "Image not marked as done");
+}
+
+static void test_abort(void)
+{
+	int err;
+
+	setup();
+
+	err = dfu_target_write(data, BUF_SIZE);
+	zassert_equal(err, 0, NULL);
+	err = k_sem_take(&write_started, K_MSEC(100));
+	zassert_equal(err, 0, "Full buffer not written");
+
+	err = dfu_target_write(&data[BUF_SIZE], BUF_SIZE / 2);
+	zassert_equal(err, 0, NULL);
+
+	/* The buffer being written is completed, the other one dropped */
+	block_writes = false;
+	k_sem_give(&write_sem);
+
+	err = dfu_target_done(false);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(written_len, BUF_SIZE,
+		      "Buffered data written to aborted image");
+	zassert_false(done_param, "Aborted image marked as done");
+
+	/* Nothing is left for the next image */
+	setup();
+	block_writes = false;
+
+	err = dfu_target_done(true);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(written_len, 0, "Dropped data written to next image");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(dfu_target_async_test,
+			 ztest_unit_test(test_overlap),
+			 ztest_unit_test(test_flush_on_done),
+			 ztest_unit_test(test_abort)
+			 );
+
+	ztest_run_test_suite(dfu_target_async_test);
+}
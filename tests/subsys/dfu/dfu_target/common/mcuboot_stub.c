@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <string.h>
+#include <dfu/dfu_target.h>
+#include "mcuboot_stub.h"
+
+uint8_t flash[MCUBOOT_STUB_FLASH_SIZE];
+size_t flash_written;
+bool done_param;
+struct resume_point src;
+struct resume_point stored;
+
+bool dfu_target_mcuboot_identify(const void *const buf)
+{
+	return false;
+}
+
+int dfu_target_mcuboot_init(size_t file_size, dfu_target_callback_t cb)
+{
+	return 0;
+}
+
+int dfu_target_mcuboot_offset_get(size_t *offset)
+{
+	*offset = flash_written;
+	return 0;
+}
+
+int dfu_target_mcuboot_write(const void *const buf, size_t len)
+{
+	zassert_true(flash_written + len <= sizeof(flash), "Image too big");
+	memcpy(&flash[flash_written], buf, len);
+	flash_written += len;
+	if (src.valid && src.offset == flash_written) {
+		stored = src;
+	}
+	return 0;
+}
+
+int dfu_target_mcuboot_done(bool successful)
+{
+	done_param = successful;
+	if (!successful) {
+		mcuboot_stub_reset();
+	}
+	return 0;
+}
+
+int dfu_target_mcuboot_schedule_update(void)
+{
+	return 0;
+}
+
+int dfu_target_mcuboot_cancel_update(void)
+{
+	return 0;
+}
+
+void dfu_target_mcuboot_src_offset_set(size_t offset, size_t src_offset,
+				       size_t image_size)
+{
+	src.offset = offset;
+	src.src_offset = src_offset;
+	src.image_size = image_size;
+	src.valid = true;
+}
+
+int dfu_target_mcuboot_src_offset_get(size_t *offset, size_t *src_offset,
+				      size_t *image_size)
+{
+	if (!stored.valid || stored.offset != flash_written) {
+		return -ENOENT;
+	}
+	*offset = stored.offset;
+	*src_offset = stored.src_offset;
+	*image_size = stored.image_size;
+	return 0;
+}
+
+void mcuboot_stub_reset(void)
+{
+	flash_written = 0;
+	src.valid = false;
+	stored.valid = false;
+}
+
+struct resume_point mcuboot_stub_reboot(void)
+{
+	struct resume_point reboot = stored;
+	int err;
+
+	zassert_true(reboot.valid, "No resume point");
+	err = dfu_target_reset();
+	zassert_equal(err, 0, NULL);
+
+	stored = reboot;
+	flash_written = reboot.offset;
+	memset(&flash[flash_written], 0, sizeof(flash) - flash_written);
+
+	return reboot;
+}
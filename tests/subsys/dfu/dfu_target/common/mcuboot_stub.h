@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/* MCUboot target for the tests of the targets that write through it. The
+ * flash of the secondary slot is a buffer, and the resume point is stored
+ * once the flash reaches it.
+ */
+
+#ifndef MCUBOOT_STUB_H__
+#define MCUBOOT_STUB_H__
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+
+#define MCUBOOT_STUB_FLASH_SIZE 0x8000
+
+struct resume_point {
+	size_t offset;
+	size_t src_offset;
+	size_t image_size;
+	bool valid;
+};
+
+extern uint8_t flash[MCUBOOT_STUB_FLASH_SIZE];
+extern size_t flash_written;
+/* Parameter of the last call to dfu_target_mcuboot_done() */
+extern bool done_param;
+
+/* Set by the target, and stored once the flash reaches it */
+extern struct resume_point src;
+extern struct resume_point stored;
+
+/* Forget the image and its resume point. */
+void mcuboot_stub_reset(void);
+
+/* Reset the DFU target as on a reboot. The data written after the stored
+ * resume point is lost. Returns the resume point.
+ */
+struct resume_point mcuboot_stub_reboot(void);
+
+#endif /* MCUBOOT_STUB_H__ */
@@ -0,0 +1,33 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Write the test image which is compressed with compress_image.py:
+compressible data with some noise, and an incompressible tail.
+"""
+
+import random
+import sys
+
+IMAGE_SIZE = 20000
+TAIL_SIZE = 3000
+
+
+def main():
+    rng = random.Random(0)
+    image = bytearray(IMAGE_SIZE)
+
+    for i in range(IMAGE_SIZE):
+        if i % 97 < 60 and i < IMAGE_SIZE - TAIL_SIZE:
+            image[i] = (i // 13) & 0xff
+        else:
+            image[i] = rng.getrandbits(8)
+
+    with open(sys.argv[1], 'wb') as f:
+        f.write(image)
+
+
+if __name__ == '__main__':
+    main()
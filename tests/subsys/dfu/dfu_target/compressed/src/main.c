@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <string.h>
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <random/rand32.h>
+#include <dfu/dfu_target.h>
+#include "mcuboot_stub.h"
+
+#define IMAGE_SIZE 20000
+#define CONTAINER_SIZE (IMAGE_SIZE * 2)
+
+/* Made by image_gen.py, and compressed by compress_image.py
+ * with blocks of 4096 bytes, 9 window bits and 4 lookahead bits.
+ */
+static const uint8_t image_bin[] = {
+#include "image.bin.inc"
+};
+
+static const uint8_t container_bin[] = {
+#include "container.bin.inc"
+};
+
+BUILD_ASSERT(sizeof(image_bin) == IMAGE_SIZE, "Wrong image size");
+BUILD_ASSERT(sizeof(container_bin) <= CONTAINER_SIZE, "Container too big");
+BUILD_ASSERT(IMAGE_SIZE < MCUBOOT_STUB_FLASH_SIZE, "Image too big");
+
+static uint8_t image[IMAGE_SIZE];
+static uint8_t container[CONTAINER_SIZE];
+static size_t container_len;
+
+static void container_build(void)
+{
+	/* Copied, so that the tests can corrupt the image */
+	memcpy(image, image_bin, IMAGE_SIZE);
+	memcpy(container, container_bin, sizeof(container_bin));
+	container_len = sizeof(container_bin);
+
+	zassert_true(container_len < IMAGE_SIZE, "Image did not compress");
+}
+
+static int feed(size_t from, size_t to)
+{
+	int err;
+	size_t len;
+
+	while (from < to) {
+		len = 1 + sys_rand32_get() % 700;
+		len = MIN(len, to - from);
+		err = dfu_target_write(&container[from], len);
+		if (err) {
+			return err;
+		}
+		from += len;
+	}
+
+	return 0;
+}
+
+static void init(void)
+{
+	int err;
+	int type = dfu_target_img_type(container, container_len);
+
+	zassert_equal(type, DFU_TARGET_IMAGE_TYPE_COMPRESSED, NULL);
+	err = dfu_target_init(type, container_len, NULL);
+	zassert_equal(err, 0, NULL);
+}
+
+static void test_decompress(void)
+{
+	int err;
+
+	container_build();
+
+	for (int i = 0; i < 5; i++) {
+		init();
+		err = feed(0, container_len);
+		zassert_equal(err, 0, "Write failed");
+		err = dfu_target_done(true);
+		zassert_equal(err, 0, "Done failed");
+		zassert_true(done_param, NULL);
+		zassert_equal(flash_written, IMAGE_SIZE, NULL);
+		zassert_mem_equal(flash, image, IMAGE_SIZE, NULL);
+		mcuboot_stub_reset();
+	}
+}
+
+static void test_resume(void)
+{
+	int err;
+	size_t offset;
+	struct resume_point reboot;
+
+	container_build();
+	init();
+
+	err = feed(0, container_len / 2);
+	zassert_equal(err, 0, NULL);
+
+	reboot = mcuboot_stub_reboot();
+
+	init();
+	err = dfu_target_offset_get(&offset);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(offset, reboot.src_offset, "Not resumed at resume point");
+
+	err = feed(offset, container_len);
+	zassert_equal(err, 0, NULL);
+	err = dfu_target_done(true);
+	zassert_equal(err, 0, NULL);
+	zassert_mem_equal(flash, image, IMAGE_SIZE, NULL);
+	mcuboot_stub_reset();
+}
+
+static void test_resume_incomplete(void)
+{
+	int err;
+	size_t offset;
+	struct resume_point reboot;
+
+	container_build();
+	init();
+
+	err = feed(0, container_len / 2);
+	zassert_equal(err, 0, NULL);
+
+	/* Reboot, and stop at the resume point, which is a block boundary */
+	reboot = mcuboot_stub_reboot();
+
+	init();
+	err = dfu_target_offset_get(&offset);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(offset, reboot.src_offset, "Not resumed at resume point");
+
+	err = dfu_target_done(true);
+	zassert_equal(err, -EINVAL, "Incomplete resumed image accepted");
+	(void)dfu_target_reset();
+	mcuboot_stub_reset();
+}
+
+static void test_corrupt(void)
+{
+	int err;
+
+	container_build();
+
+	/* Back-reference before the start of the first block */
+	container[12 + 6] = 0x00;
+	init();
+	err = feed(0, container_len);
+	zassert_equal(err, -EINVAL, "Invalid data accepted");
+	(void)dfu_target_reset();
+
+	/* Truncated image */
+	container_build();
+	init();
+	err = feed(0, container_len - 10);
+	zassert_equal(err, 0, NULL);
+	err = dfu_target_done(true);
+	zassert_equal(err, -EINVAL, "Truncated image accepted");
+	(void)dfu_target_reset();
+}
+
+void test_main(void)
+{
+	ztest_test_suite(dfu_target_compressed_test,
+			 ztest_unit_test(test_decompress),
+			 ztest_unit_test(test_resume),
+			 ztest_unit_test(test_resume_incomplete),
+			 ztest_unit_test(test_corrupt)
+			 );
+
+	ztest_run_test_suite(dfu_target_compressed_test);
+}
@@ -0,0 +1,37 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+
+"""Write the active image and the new image that delta_patch.py makes the
+test patch from. The new image keeps most of the active image, with data
+inserted, removed and appended.
+"""
+
+import random
+import sys
+
+SOURCE_SIZE = 16000
+IMAGE_SIZE = 17000
+
+
+def main():
+    rng = random.Random(0)
+
+    def noise(n):
+        return bytes(rng.getrandbits(8) for _ in range(n))
+
+    source = noise(SOURCE_SIZE)
+    image = (source[:5000] + noise(100) + source[5000:8000] + noise(7) +
+             source[8500:])
+    image += noise(IMAGE_SIZE - len(image))
+
+    with open(sys.argv[1], 'wb') as f:
+        f.write(source)
+    with open(sys.argv[2], 'wb') as f:
+        f.write(image)
+
+
+if __name__ == '__main__':
+    main()
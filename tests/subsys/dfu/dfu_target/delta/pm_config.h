@@ -0,0 +1,13 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/* generated file copied to simplify building the test */
+#ifndef PM_CONFIG_H__
+#define PM_CONFIG_H__
+#define PM_MCUBOOT_PRIMARY_ID 1
+#define PM_MCUBOOT_PRIMARY_SIZE 0x5e000
+#define PM_MCUBOOT_SECONDARY_SIZE 0x5e000
+#endif /* PM_CONFIG_H__ */
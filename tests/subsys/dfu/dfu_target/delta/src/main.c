@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <string.h>
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <random/rand32.h>
+#include <sys/byteorder.h>
+#include <storage/flash_map.h>
+#include <dfu/dfu_target.h>
+#include <pm_config.h>
+#include "mcuboot_stub.h"
+
+#define SOURCE_SIZE 16000
+#define IMAGE_SIZE 17000
+#define BLOCK_SIZE 4096
+#define PATCH_SIZE (IMAGE_SIZE * 2)
+#define HEADER_SIZE 48
+#define OP_COPY 1
+
+/* Made by image_gen.py, and turned into a patch by delta_patch.py
+ * with blocks of 4096 bytes.
+ */
+static const uint8_t source_bin[] = {
+#include "source.bin.inc"
+};
+
+static const uint8_t image_bin[] = {
+#include "image.bin.inc"
+};
+
+static const uint8_t patch_bin[] = {
+#include "patch.bin.inc"
+};
+
+BUILD_ASSERT(sizeof(source_bin) == SOURCE_SIZE, "Wrong source size");
+BUILD_ASSERT(sizeof(image_bin) == IMAGE_SIZE, "Wrong image size");
+BUILD_ASSERT(sizeof(patch_bin) <= PATCH_SIZE, "Patch too big");
+BUILD_ASSERT(IMAGE_SIZE < MCUBOOT_STUB_FLASH_SIZE, "Image too big");
+
+/* Simulated flash of the primary slot */
+static uint8_t primary[SOURCE_SIZE + 1024];
+static const struct flash_area primary_area = {
+	.fa_id = PM_MCUBOOT_PRIMARY_ID,
+	.fa_size = sizeof(primary),
+};
+
+static uint8_t patch[PATCH_SIZE];
+static size_t patch_len;
+
+int flash_area_open(uint8_t id, const struct flash_area **fa)
+{
+	zassert_equal(id, PM_MCUBOOT_PRIMARY_ID, "Wrong flash area");
+	*fa = &primary_area;
+	return 0;
+}
+
+int flash_area_read(const struct flash_area *fa, off_t off, void *dst,
+		    size_t len)
+{
+	zassert_equal_ptr(fa, &primary_area, NULL);
+	zassert_true(off + len <= sizeof(primary), "Read outside of area");
+	memcpy(dst, &primary[off], len);
+	return 0;
+}
+
+static void patch_build(void)
+{
+	/* Copied, so that the tests can corrupt the source and the patch */
+	memcpy(primary, source_bin, SOURCE_SIZE);
+	for (size_t i = SOURCE_SIZE; i < sizeof(primary); i++) {
+		primary[i] = sys_rand32_get();
+	}
+
+	memcpy(patch, patch_bin, sizeof(patch_bin));
+	patch_len = sizeof(patch_bin);
+}
+
+static int feed(size_t from, size_t to)
+{
+	int err;
+	size_t len;
+
+	while (from < to) {
+		len = 1 + sys_rand32_get() % 700;
+		len = MIN(len, to - from);
+		err = dfu_target_write(&patch[from], len);
+		if (err) {
+			return err;
+		}
+		from += len;
+	}
+
+	return 0;
+}
+
+static void init(void)
+{
+	int err;
+	int type = dfu_target_img_type(patch, patch_len);
+
+	zassert_equal(type, DFU_TARGET_IMAGE_TYPE_DELTA, NULL);
+	err = dfu_target_init(type, patch_len, NULL);
+	zassert_equal(err, 0, NULL);
+}
+
+static void cleanup(void)
+{
+	(void)dfu_target_reset();
+	mcuboot_stub_reset();
+}
+
+static void test_apply(void)
+{
+	int err;
+
+	patch_build();
+
+	for (int i = 0; i < 5; i++) {
+		init();
+		err = feed(0, patch_len);
+		zassert_equal(err, 0, "Write failed");
+		err = dfu_target_done(true);
+		zassert_equal(err, 0, "Done failed");
+		zassert_true(done_param, NULL);
+		zassert_equal(flash_written, IMAGE_SIZE, NULL);
+		zassert_mem_equal(flash, image_bin, IMAGE_SIZE, NULL);
+		cleanup();
+	}
+}
+
+static void test_wrong_source(void)
+{
+	int err;
+
+	patch_build();
+	primary[SOURCE_SIZE - 1] ^= 1;
+
+	init();
+	err = feed(0, patch_len);
+	zassert_equal(err, -EBADMSG, "Patch applied to other image");
+	zassert_equal(flash_written, 0, "Data written before verifying");
+	cleanup();
+}
+
+static void test_resume(void)
+{
+	int err;
+	size_t offset;
+	struct resume_point reboot;
+
+	patch_build();
+	init();
+
+	err = feed(0, patch_len * 2 / 3);
+	zassert_equal(err, 0, NULL);
+
+	/* Reboot, the data after the stored resume point is lost */
+	reboot = mcuboot_stub_reboot();
+	zassert_equal(reboot.offset % BLOCK_SIZE, 0, "Not at block boundary");
+
+	init();
+	err = dfu_target_offset_get(&offset);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(offset, reboot.src_offset, "Not resumed at resume point");
+
+	err = feed(offset, patch_len);
+	zassert_equal(err, 0, NULL);
+	err = dfu_target_done(true);
+	zassert_equal(err, 0, NULL);
+	zassert_mem_equal(flash, image_bin, IMAGE_SIZE, NULL);
+	cleanup();
+}
+
+static void test_resume_incomplete(void)
+{
+	int err;
+	size_t offset;
+	struct resume_point reboot;
+
+	patch_build();
+	init();
+
+	err = feed(0, patch_len * 2 / 3);
+	zassert_equal(err, 0, NULL);
+
+	/* Reboot, and stop at the resume point, between two commands */
+	reboot = mcuboot_stub_reboot();
+
+	init();
+	err = dfu_target_offset_get(&offset);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(offset, reboot.src_offset, "Not resumed at resume point");
+
+	err = dfu_target_done(true);
+	zassert_equal(err, -EINVAL, "Incomplete resumed image accepted");
+	cleanup();
+}
+
+static void test_invalid_copy(void)
+{
+	int err;
+
+	patch_build();
+	/* First command copies from outside of the source image */
+	zassert_equal(patch[HEADER_SIZE], OP_COPY, "Patch starts with insert");
+	sys_put_le32(SOURCE_SIZE, &patch[HEADER_SIZE + 1]);
+
+	init();
+	err = feed(0, patch_len);
+	zassert_equal(err, -EINVAL, "Invalid copy accepted");
+	cleanup();
+}
+
+void test_main(void)
+{
+	ztest_test_suite(dfu_target_delta_test,
+			 ztest_unit_test(test_apply),
+			 ztest_unit_test(test_wrong_source),
+			 ztest_unit_test(test_resume),
+			 ztest_unit_test(test_resume_incomplete),
+			 ztest_unit_test(test_invalid_copy)
+			 );
+
+	ztest_run_test_suite(dfu_target_delta_test);
+}
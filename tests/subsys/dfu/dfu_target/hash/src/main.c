@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <string.h>
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <sys/byteorder.h>
+#include <tinycrypt/constants.h>
+#include <tinycrypt/sha256.h>
+#include <dfu/dfu_target.h>
+
+#define HDR_SIZE 0x200
+#define BODY_SIZE 3000
+#define TLV_SIZE (4 + 4 + TC_SHA256_DIGEST_SIZE)
+#define FILE_SIZE (HDR_SIZE + BODY_SIZE + TLV_SIZE)
+
+static uint8_t image[FILE_SIZE];
+static uint8_t digest[TC_SHA256_DIGEST_SIZE];
+static uint8_t file_digest[TC_SHA256_DIGEST_SIZE];
+static size_t offset_get_out_param;
+static bool done_param;
+static int write_calls;
+
+bool dfu_target_mcuboot_identify(const void *const buf)
+{
+	return true;
+}
+
+int dfu_target_mcuboot_init(size_t file_size, dfu_target_callback_t cb)
+{
+	return 0;
+}
+
+int dfu_target_mcuboot_offset_get(size_t *offset)
+{
+	*offset = offset_get_out_param;
+	return 0;
+}
+
+int dfu_target_mcuboot_write(const void *const buf, size_t len)
+{
+	write_calls++;
+	return 0;
+}
+
+int dfu_target_mcuboot_done(bool successful)
+{
+	done_param = successful;
+	return 0;
+}
+
+int dfu_target_mcuboot_schedule_update(void)
+{
+	return 0;
+}
+
+int dfu_target_mcuboot_cancel_update(void)
+{
+	return 0;
+}
+
+/* Build an MCUboot image with a SHA-256 TLV */
+static void image_build(void)
+{
+	struct tc_sha256_state_struct sha;
+	uint8_t *tlv = &image[HDR_SIZE + BODY_SIZE];
+
+	memset(image, 0, sizeof(image));
+	sys_put_le32(0x96f3b83d, &image[0]);
+	sys_put_le16(HDR_SIZE, &image[8]);
+	sys_put_le32(BODY_SIZE, &image[12]);
+
+	for (int i = 0; i < BODY_SIZE; i++) {
+		image[HDR_SIZE + i] = i * 7;
+	}
+
+	(void)tc_sha256_init(&sha);
+	(void)tc_sha256_update(&sha, image, HDR_SIZE + BODY_SIZE);
+	(void)tc_sha256_final(digest, &sha);
+
+	sys_put_le16(0x6907, &tlv[0]);
+	sys_put_le16(TLV_SIZE, &tlv[2]);
+	tlv[4] = 0x10;
+	sys_put_le16(TC_SHA256_DIGEST_SIZE, &tlv[6]);
+	memcpy(&tlv[8], digest, TC_SHA256_DIGEST_SIZE);
+
+	(void)tc_sha256_init(&sha);
+	(void)tc_sha256_update(&sha, image, FILE_SIZE);
+	(void)tc_sha256_final(file_digest, &sha);
+}
+
+static int download(size_t from, size_t chunk)
+{
+	int err;
+
+	offset_get_out_param = from;
+	err = dfu_target_init(DFU_TARGET_IMAGE_TYPE_MCUBOOT, FILE_SIZE, NULL);
+	zassert_equal(err, 0, NULL);
+
+	for (size_t pos = from; pos < FILE_SIZE; pos += chunk) {
+		err = dfu_target_write(&image[pos], MIN(chunk, FILE_SIZE - pos));
+		if (err) {
+			return err;
+		}
+	}
+
+	return dfu_target_done(true);
+}
+
+static void test_valid_image(void)
+{
+	int err;
+
+	image_build();
+
+	err = download(0, 100);
+	zassert_equal(err, 0, "Valid image rejected");
+	zassert_true(done_param, "Image not marked as done");
+
+	err = download(0, 1);
+	zassert_equal(err, 0, "Valid image rejected in small writes");
+}
+
+static void test_corrupt_image(void)
+{
+	int err;
+
+	image_build();
+	image[HDR_SIZE + 10] ^= 1;
+
+	err = download(0, 100);
+	zassert_equal(err, -EBADMSG, "Corrupt image accepted");
+	zassert_false(done_param, "Corrupt image marked as done");
+}
+
+static void test_expected_digest(void)
+{
+	int err;
+
+	image_build();
+
+	/* The expected digest is of the whole file, TLVs included */
+	err = dfu_target_digest_set(file_digest, sizeof(file_digest));
+	zassert_equal(err, 0, NULL);
+	err = download(0, 256);
+	zassert_equal(err, 0, "Image with expected digest rejected");
+
+	err = dfu_target_digest_set(digest, sizeof(digest));
+	zassert_equal(err, 0, NULL);
+	err = download(0, 256);
+	zassert_equal(err, -EBADMSG, "Digest of the TLV region accepted");
+
+	file_digest[0] ^= 1;
+	err = dfu_target_digest_set(file_digest, sizeof(file_digest));
+	zassert_equal(err, 0, NULL);
+	err = download(0, 256);
+	zassert_equal(err, -EBADMSG, "Image with other digest accepted");
+
+	err = dfu_target_digest_set(file_digest, 20);
+	zassert_equal(err, -EINVAL, NULL);
+}
+
+static void test_header_mismatch(void)
+{
+	int err;
+
+	image_build();
+	sys_put_le32(FILE_SIZE, &image[12]);
+
+	write_calls = 0;
+	err = download(0, 16);
+	zassert_equal(err, -EINVAL, "Header not checked against file size");
+	zassert_equal(write_calls, 1, "Data written after invalid header");
+
+	(void)dfu_target_reset();
+}
+
+static void test_resumed_image(void)
+{
+	int err;
+
+	/* Resumed after a reset, the image is left for the bootloader */
+	image_build();
+	image[HDR_SIZE + BODY_SIZE - 1] ^= 1;
+
+	err = download(1024, 100);
+	zassert_equal(err, 0, "Unverifiable image rejected");
+}
+
+static void test_resumed_image_expected_digest(void)
+{
+	int err;
+
+	/* The check asked for by the application can not be skipped */
+	image_build();
+
+	err = dfu_target_digest_set(file_digest, sizeof(file_digest));
+	zassert_equal(err, 0, NULL);
+	err = download(1024, 100);
+	zassert_equal(err, -ENOTSUP, "Unverified image accepted");
+	zassert_false(done_param, "Unverified image marked as done");
+}
+
+static void test_aborted_image_expected_digest(void)
+{
+	int err;
+
+	image_build();
+
+	/* The digest of an aborted image is not used for the next one */
+	file_digest[0] ^= 1;
+	err = dfu_target_digest_set(file_digest, sizeof(file_digest));
+	zassert_equal(err, 0, NULL);
+	offset_get_out_param = 0;
+	err = dfu_target_init(DFU_TARGET_IMAGE_TYPE_MCUBOOT, FILE_SIZE, NULL);
+	zassert_equal(err, 0, NULL);
+	err = dfu_target_write(image, HDR_SIZE);
+	zassert_equal(err, 0, NULL);
+	err = dfu_target_done(false);
+	zassert_equal(err, 0, NULL);
+
+	err = download(0, 100);
+	zassert_equal(err, 0, "Digest of the aborted image used");
+
+	err = dfu_target_digest_set(file_digest, sizeof(file_digest));
+	zassert_equal(err, 0, NULL);
+	err = dfu_target_reset();
+	zassert_equal(err, 0, NULL);
+
+	err = download(0, 100);
+	zassert_equal(err, 0, "Digest used after reset");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(dfu_target_hash_test,
+			 ztest_unit_test(test_valid_image),
+			 ztest_unit_test(test_corrupt_image),
+			 ztest_unit_test(test_expected_digest),
+			 ztest_unit_test(test_header_mismatch),
+			 ztest_unit_test(test_resumed_image),
+			 ztest_unit_test(test_resumed_image_expected_digest),
+			 ztest_unit_test(test_aborted_image_expected_digest)
+			 );
+
+	ztest_run_test_suite(dfu_target_hash_test);
+}
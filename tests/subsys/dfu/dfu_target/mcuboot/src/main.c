@@ -17,6 +17,8 @@ static int write_retval;
 static int write_param_len;
 static void const *write_param_buf;
 static int done_retval;
+static int schedule_retval;
+static int schedule_count;
 static int init_retval;
 static bool identify_retval;
 
@@ -48,6 +50,17 @@ int dfu_target_mcuboot_done(bool successful)
 	return done_retval;
 }
 
+int dfu_target_mcuboot_schedule_update(void)
+{
+	schedule_count++;
+	return schedule_retval;
+}
+
+int dfu_target_mcuboot_cancel_update(void)
+{
+	return 0;
+}
+
 static void init(void)
 {
 	int err;
@@ -140,6 +153,58 @@ static void test_done(void)
 
 }
 
+static void test_stage(void)
+{
+	int err;
+
+	done_retval = 0;
+	schedule_retval = 0;
+
+	init();
+	schedule_count = 0;
+	err = dfu_target_done(true);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(schedule_count, 1, "Done should schedule the upgrade");
+
+	init();
+	schedule_count = 0;
+	err = dfu_target_stage();
+	zassert_equal(err, 0, NULL);
+	zassert_equal(schedule_count, 0, "Staged image was scheduled");
+
+	/* The secondary slot holds the staged image */
+	identify_retval = true;
+	err = dfu_target_init(dfu_target_img_type(0, 0), FILE_SIZE, NULL);
+	zassert_equal(err, -EEXIST, "Staged image would be overwritten");
+
+	err = dfu_target_schedule_update();
+	zassert_equal(err, 0, NULL);
+	zassert_equal(schedule_count, 1, "Staged image was not scheduled");
+
+	/* Nothing left to schedule */
+	err = dfu_target_schedule_update();
+	zassert_equal(err, 0, NULL);
+	zassert_equal(schedule_count, 1, NULL);
+
+	/* A reset discards the staged image */
+	init();
+	err = dfu_target_stage();
+	zassert_equal(err, 0, NULL);
+	err = dfu_target_reset();
+	zassert_equal(err, 0, NULL);
+	err = dfu_target_schedule_update();
+	zassert_equal(err, 0, NULL);
+	zassert_equal(schedule_count, 1, "Discarded image was scheduled");
+
+	init();
+	err = dfu_target_stage();
+	zassert_equal(err, 0, NULL);
+	schedule_retval = -42;
+	err = dfu_target_schedule_update();
+	zassert_equal(err, -42, "Did not get error from dfu target");
+	schedule_retval = 0;
+}
+
 static void test_offset_get(void)
 {
 	int err;
@@ -185,6 +250,7 @@ void test_main(void)
 			 ztest_unit_test(test_write),
 			 ztest_unit_test(test_offset_get),
 			 ztest_unit_test(test_done),
+			 ztest_unit_test(test_stage),
 			 ztest_unit_test(test_init)
 			 );
 
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <string.h>
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <dfu/dfu_target.h>
+
+#define FILE_SIZE 0x1000
+
+/* Order in which the targets are scheduled, 'a' for the application */
+static char scheduled[4];
+static size_t scheduled_count;
+static int mcuboot_schedule_retval;
+static int modem_schedule_retval;
+static int mcuboot_cancel_count;
+
+bool dfu_target_mcuboot_identify(const void *const buf)
+{
+	return false;
+}
+
+int dfu_target_mcuboot_init(size_t file_size, dfu_target_callback_t cb)
+{
+	return 0;
+}
+
+int dfu_target_mcuboot_offset_get(size_t *offset)
+{
+	*offset = 0;
+	return 0;
+}
+
+int dfu_target_mcuboot_write(const void *const buf, size_t len)
+{
+	return 0;
+}
+
+int dfu_target_mcuboot_done(bool successful)
+{
+	return 0;
+}
+
+int dfu_target_mcuboot_schedule_update(void)
+{
+	if (mcuboot_schedule_retval == 0) {
+		scheduled[scheduled_count++] = 'a';
+	}
+	return mcuboot_schedule_retval;
+}
+
+int dfu_target_mcuboot_cancel_update(void)
+{
+	mcuboot_cancel_count++;
+	return 0;
+}
+
+bool dfu_target_modem_identify(const void *const buf)
+{
+	return false;
+}
+
+int dfu_target_modem_init(size_t file_size, dfu_target_callback_t cb)
+{
+	return 0;
+}
+
+int dfu_target_modem_offset_get(size_t *offset)
+{
+	*offset = 0;
+	return 0;
+}
+
+int dfu_target_modem_write(const void *const buf, size_t len)
+{
+	return 0;
+}
+
+int dfu_target_modem_done(bool successful)
+{
+	return 0;
+}
+
+int dfu_target_modem_schedule_update(void)
+{
+	if (modem_schedule_retval == 0) {
+		scheduled[scheduled_count++] = 'm';
+	}
+	return modem_schedule_retval;
+}
+
+int dfu_target_modem_cancel_update(void)
+{
+	zassert_unreachable("Modem upgrade can not be cancelled");
+	return -ENOTSUP;
+}
+
+static void stage(int img_type)
+{
+	int err;
+
+	err = dfu_target_init(img_type, FILE_SIZE, NULL);
+	zassert_equal(err, 0, NULL);
+	err = dfu_target_stage();
+	zassert_equal(err, 0, NULL);
+}
+
+/* Stage a modem image first, and the application image after it */
+static void stage_both(void)
+{
+	memset(scheduled, 0, sizeof(scheduled));
+	scheduled_count = 0;
+	mcuboot_schedule_retval = 0;
+	modem_schedule_retval = 0;
+	mcuboot_cancel_count = 0;
+
+	stage(DFU_TARGET_IMAGE_TYPE_MODEM_DELTA);
+	stage(DFU_TARGET_IMAGE_TYPE_MCUBOOT);
+}
+
+static void test_schedule_order(void)
+{
+	int err;
+
+	stage_both();
+
+	/* The modem upgrade can not be cancelled, so it is scheduled last */
+	err = dfu_target_schedule_update();
+	zassert_equal(err, 0, NULL);
+	zassert_equal(scheduled_count, 2, "Not all images scheduled");
+	zassert_mem_equal(scheduled, "am", 2, "Modem not scheduled last");
+	zassert_equal(mcuboot_cancel_count, 0, NULL);
+}
+
+static void test_schedule_modem_fails(void)
+{
+	int err;
+
+	stage_both();
+
+	modem_schedule_retval = -EFAULT;
+	err = dfu_target_schedule_update();
+	zassert_equal(err, -EFAULT, "Did not get error from modem target");
+	zassert_equal(mcuboot_cancel_count, 1,
+		      "Application upgrade not cancelled");
+
+	/* The staged images are gone */
+	modem_schedule_retval = 0;
+	scheduled_count = 0;
+	err = dfu_target_schedule_update();
+	zassert_equal(err, 0, NULL);
+	zassert_equal(scheduled_count, 0, "Failed images scheduled again");
+}
+
+static void test_schedule_mcuboot_fails(void)
+{
+	int err;
+
+	stage_both();
+
+	mcuboot_schedule_retval = -EIO;
+	err = dfu_target_schedule_update();
+	zassert_equal(err, -EIO, "Did not get error from MCUboot target");
+	zassert_equal(scheduled_count, 0, "Modem scheduled after failure");
+	zassert_equal(mcuboot_cancel_count, 0, "Nothing to cancel");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(dfu_target_multi_image_test,
+			 ztest_unit_test(test_schedule_order),
+			 ztest_unit_test(test_schedule_modem_fails),
+			 ztest_unit_test(test_schedule_mcuboot_fails)
+			 );
+
+	ztest_run_test_suite(dfu_target_multi_image_test);
+}
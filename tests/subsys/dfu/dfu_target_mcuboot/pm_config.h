@@ -9,5 +9,6 @@
 #define PM_CONFIG_H__
 #define PM_S0_ADDRESS 0x8000
 #define PM_S1_ADDRESS 0x15000
+#define PM_MCUBOOT_SECONDARY_ID 2
 #define PM_MCUBOOT_SECONDARY_SIZE 0x5e000
 #endif /* PM_CONFIG_H__ */
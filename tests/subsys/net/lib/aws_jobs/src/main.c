@@ -108,6 +108,29 @@ static void test_aws_jobs_subscribe_topic_get(void)
 	zassert_true(strcmp(expected, topic_buf) == 0, "Should be equal");
 }
 
+static void test_aws_jobs_status(void)
+{
+	enum execution_status status;
+	int ret;
+
+	zassert_true(strcmp(aws_jobs_status_str(AWS_JOBS_IN_PROGRESS),
+			    "IN_PROGRESS") == 0, "Should be equal");
+	zassert_is_null(aws_jobs_status_str(AWS_JOBS_CANCELED + 1),
+			"Should be NULL");
+
+	ret = aws_jobs_status_parse("SUCCEEDED", strlen("SUCCEEDED"), &status);
+	zassert_equal(ret, 0, "Should be 0");
+	zassert_equal(status, AWS_JOBS_SUCCEEDED, "Should be equal");
+
+	/* Only the given length is compared */
+	ret = aws_jobs_status_parse("FAILED\"}", strlen("FAILED"), &status);
+	zassert_equal(ret, 0, "Should be 0");
+	zassert_equal(status, AWS_JOBS_FAILED, "Should be equal");
+
+	ret = aws_jobs_status_parse("FAIL", strlen("FAIL"), &status);
+	zassert_equal(ret, -EINVAL, "Should not be parsed");
+}
+
 void test_main(void)
 {
 	ztest_test_suite(aws_jobs_test,
@@ -116,7 +139,8 @@ void test_main(void)
 			 ztest_unit_test(test_aws_jobs_cmp__no_suffix),
 			 ztest_unit_test(test_aws_jobs_cmp__suffix),
 			 ztest_unit_test(test_aws_jobs_subscribe_topic_update),
-			 ztest_unit_test(test_aws_jobs_subscribe_topic_get)
+			 ztest_unit_test(test_aws_jobs_subscribe_topic_get),
+			 ztest_unit_test(test_aws_jobs_status)
 			 );
 	ztest_run_test_suite(aws_jobs_test);
 }
@@ -0,0 +1,703 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <stdio.h>
+#include <string.h>
+#include <net/socket.h>
+#include <net/mqtt.h>
+#include <mqtt_broker_sim.h>
+#include <net/aws_jobs.h>
+#include <net/aws_jobs_exec.h>
+#include <json_tok.h>
+
+#define DEVICE_ID "sim-device"
+#define SERVICE_ID "sim-service"
+#define THING "$aws/things/" DEVICE_ID "/jobs/"
+
+/* Time to let messages go back and forth through the broker */
+#define SETTLE_MS 100
+
+#define DOC_1 "{\"operation\":\"app_fw_update\"," \
+	      "\"location\":{\"host\":\"h\",\"path\":\"a.bin\"}}"
+#define DOC_2 "{\"operation\":\"app_fw_update\"," \
+	      "\"location\":{\"host\":\"h\",\"path\":\"b.bin\"}}"
+#define DOC_3 "{\"operation\":\"reboot\"}"
+#define DOC_4 "{\"operation\":\"log_upload\"}"
+
+/* Job execution, as kept by the AWS IoT Jobs stand-in */
+struct service_job {
+	const char *id;
+	const char *doc;
+	enum execution_status status;
+	int version;
+	char details[CONFIG_AWS_JOBS_EXEC_DETAILS_MAX_LEN];
+	int updates;
+	int rejects;
+	int gets;
+	/* Expected versions of the first updates received */
+	int expected[4];
+};
+
+/* Event of the engine */
+struct exec_evt {
+	enum aws_jobs_exec_evt_type type;
+	char id[AWS_JOBS_JOB_ID_MAX_LEN];
+	enum execution_status status;
+	char doc[CONFIG_AWS_JOBS_EXEC_DOC_MAX_LEN];
+};
+
+static struct service_job jobs[4];
+static size_t job_count;
+
+static struct exec_evt evts[32];
+static size_t evt_count;
+
+static struct sockaddr_storage broker;
+static struct mqtt_client device;
+static struct mqtt_client service;
+static uint8_t device_rx_buf[1024];
+static uint8_t device_tx_buf[1024];
+static uint8_t service_rx_buf[1024];
+static uint8_t service_tx_buf[1024];
+static bool device_connected;
+static bool service_subscribed;
+
+static char rx_payload[1024];
+static char tx_payload[1024];
+static char tx_topic[128];
+
+static struct service_job *job_find(const char *id)
+{
+	for (size_t i = 0; i < job_count; i++) {
+		if (strcmp(jobs[i].id, id) == 0) {
+			return &jobs[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void job_create(const char *id, const char *doc)
+{
+	zassert_true(job_count < ARRAY_SIZE(jobs), "Too many jobs");
+
+	jobs[job_count++] = (struct service_job) {
+		.id = id,
+		.doc = doc,
+		.status = AWS_JOBS_QUEUED,
+		.version = 1,
+	};
+}
+
+static const struct exec_evt *evt_last(void)
+{
+	zassert_true(evt_count > 0, "No event");
+
+	return &evts[evt_count - 1];
+}
+
+static void service_publish(const char *payload)
+{
+	struct mqtt_publish_param param = {
+		.message.topic.qos = MQTT_QOS_1_AT_LEAST_ONCE,
+		.message.topic.topic.utf8 = (uint8_t *)tx_topic,
+		.message.topic.topic.size = strlen(tx_topic),
+		.message.payload.data = (uint8_t *)payload,
+		.message.payload.len = strlen(payload),
+		.message_id = k_cycle_get_32() & 0xffff,
+	};
+
+	if (param.message_id == 0) {
+		param.message_id = 1;
+	}
+
+	zassert_equal(mqtt_publish(&service, &param), 0, "Publish failed");
+}
+
+static void execution_print(const struct service_job *job)
+{
+	snprintf(tx_payload, sizeof(tx_payload),
+		 "{\"timestamp\":1,\"execution\":{\"jobId\":\"%s\","
+		 "\"status\":\"%s\",\"queuedAt\":1,\"versionNumber\":%d,"
+		 "\"executionNumber\":1,\"jobDocument\":%s}}",
+		 job->id, aws_jobs_status_str(job->status), job->version,
+		 job->doc);
+}
+
+/* Append the summaries of the job executions with a status */
+static void summaries_print(size_t *len, enum execution_status status)
+{
+	bool first = true;
+
+	for (size_t i = 0; i < job_count; i++) {
+		if (jobs[i].status != status) {
+			continue;
+		}
+
+		*len += snprintf(&tx_payload[*len], sizeof(tx_payload) - *len,
+				 "%s{\"jobId\":\"%s\",\"queuedAt\":1,"
+				 "\"versionNumber\":%d}",
+				 first ? "" : ",", jobs[i].id,
+				 jobs[i].version);
+		first = false;
+	}
+}
+
+/* GetPendingJobExecutions */
+static void pending_handle(void)
+{
+	size_t len = 0;
+
+	len += snprintf(tx_payload, sizeof(tx_payload),
+			"{\"inProgressJobs\":[");
+	summaries_print(&len, AWS_JOBS_IN_PROGRESS);
+	len += snprintf(&tx_payload[len], sizeof(tx_payload) - len,
+			"],\"queuedJobs\":[");
+	summaries_print(&len, AWS_JOBS_QUEUED);
+	snprintf(&tx_payload[len], sizeof(tx_payload) - len,
+		 "],\"timestamp\":1,\"clientToken\":\"\"}");
+
+	snprintf(tx_topic, sizeof(tx_topic), THING "get/accepted");
+	service_publish(tx_payload);
+}
+
+/* DescribeJobExecution */
+static void describe_handle(const char *id)
+{
+	struct service_job *job = NULL;
+
+	if (strcmp(id, "$next") == 0) {
+		for (size_t i = 0; (i < job_count) && (job == NULL); i++) {
+			if (jobs[i].status <= AWS_JOBS_IN_PROGRESS) {
+				job = &jobs[i];
+			}
+		}
+
+		if (job == NULL) {
+			snprintf(tx_topic, sizeof(tx_topic),
+				 THING "$next/get/accepted");
+			service_publish("{\"timestamp\":1,"
+					"\"clientToken\":\"\"}");
+			return;
+		}
+	} else {
+		job = job_find(id);
+	}
+
+	if (job == NULL) {
+		snprintf(tx_topic, sizeof(tx_topic), THING "%s/get/rejected",
+			 id);
+		service_publish("{\"code\":\"ResourceNotFound\"}");
+		return;
+	}
+
+	job->gets++;
+	snprintf(tx_topic, sizeof(tx_topic), THING "%s/get/accepted", id);
+	execution_print(job);
+	service_publish(tx_payload);
+}
+
+/* UpdateJobExecution */
+static void update_handle(const char *id, size_t len)
+{
+	struct service_job *job = job_find(id);
+	struct json_tok toks[32];
+	char token[24];
+	char status[16];
+	int32_t expected;
+	int i;
+
+	zassert_not_null(job, "Update of unknown job %s", id);
+	zassert_true(json_tok_parse(rx_payload, len, toks,
+				    ARRAY_SIZE(toks)) > 0,
+		     "Invalid update: %s", rx_payload);
+
+	i = json_tok_find(rx_payload, toks, 0, "expectedVersion");
+	zassert_true(i >= 0, "No expected version: %s", rx_payload);
+	zassert_equal(json_tok_int(rx_payload, &toks[i], &expected), 0, NULL);
+
+	i = json_tok_find(rx_payload, toks, 0, "clientToken");
+	zassert_true(i >= 0, "No client token: %s", rx_payload);
+	(void)json_tok_str(rx_payload, &toks[i], token, sizeof(token));
+
+	i = json_tok_find(rx_payload, toks, 0, "status");
+	zassert_true(i >= 0, "No status: %s", rx_payload);
+	(void)json_tok_str(rx_payload, &toks[i], status, sizeof(status));
+
+	if (job->updates < (int)ARRAY_SIZE(job->expected)) {
+		job->expected[job->updates] = expected;
+	}
+	job->updates++;
+
+	snprintf(tx_topic, sizeof(tx_topic), THING "%s/update/rejected", id);
+
+	if (expected != job->version) {
+		job->rejects++;
+		snprintf(tx_payload, sizeof(tx_payload),
+			 "{\"code\":\"VersionMismatch\",\"message\":\"\","
+			 "\"clientToken\":\"%s\",\"timestamp\":1,"
+			 "\"executionState\":{\"status\":\"%s\","
+			 "\"statusDetails\":{},\"versionNumber\":%d}}",
+			 token, aws_jobs_status_str(job->status),
+			 job->version);
+		service_publish(tx_payload);
+		return;
+	}
+
+	if (job->status > AWS_JOBS_IN_PROGRESS) {
+		snprintf(tx_payload, sizeof(tx_payload),
+			 "{\"code\":\"InvalidStateTransition\","
+			 "\"clientToken\":\"%s\"}", token);
+		service_publish(tx_payload);
+		return;
+	}
+
+	(void)aws_jobs_status_parse(status, strlen(status), &job->status);
+
+	i = json_tok_find(rx_payload, toks, 0, "statusDetails");
+	if (i >= 0) {
+		snprintf(job->details, sizeof(job->details), "%.*s",
+			 toks[i].len, &rx_payload[toks[i].start]);
+	}
+
+	job->version++;
+
+	snprintf(tx_topic, sizeof(tx_topic), THING "%s/update/accepted", id);
+	snprintf(tx_payload, sizeof(tx_payload),
+		 "{\"timestamp\":1,\"clientToken\":\"%s\"}", token);
+	service_publish(tx_payload);
+}
+
+/* Stand-in for AWS IoT Jobs, which answers the requests of the device */
+static void service_request_handle(const char *topic, size_t len)
+{
+	char id[AWS_JOBS_JOB_ID_MAX_LEN];
+	const char *rest = topic + strlen(THING);
+	const char *end;
+
+	zassert_equal(strncmp(topic, THING, strlen(THING)), 0,
+		      "Unexpected topic %s", topic);
+
+	if (strcmp(rest, "get") == 0) {
+		pending_handle();
+		return;
+	}
+
+	end = strchr(rest, '/');
+	zassert_not_null(end, "Unexpected topic %s", topic);
+	snprintf(id, sizeof(id), "%.*s", (int)(end - rest), rest);
+
+	if (strcmp(end, "/get") == 0) {
+		describe_handle(id);
+	} else if (strcmp(end, "/update") == 0) {
+		update_handle(id, len);
+	} else {
+		zassert_unreachable("Unexpected topic %s", topic);
+	}
+}
+
+static void service_evt_handler(struct mqtt_client *const c,
+				const struct mqtt_evt *evt)
+{
+	const struct mqtt_publish_param *p = &evt->param.publish;
+	char topic[128];
+	size_t len;
+	int err;
+
+	switch (evt->type) {
+	case MQTT_EVT_SUBACK:
+		service_subscribed = true;
+		break;
+
+	case MQTT_EVT_PUBLISH:
+		len = MIN(p->message.topic.topic.size, sizeof(topic) - 1);
+		memcpy(topic, p->message.topic.topic.utf8, len);
+		topic[len] = '\0';
+
+		len = p->message.payload.len;
+		zassert_true(len < sizeof(rx_payload), "Payload too large");
+		err = mqtt_readall_publish_payload(c, (uint8_t *)rx_payload,
+						   len);
+		zassert_equal(err, 0, "Failed to read payload");
+		rx_payload[len] = '\0';
+
+		if (p->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE) {
+			const struct mqtt_puback_param ack = {
+				.message_id = p->message_id
+			};
+
+			mqtt_publish_qos1_ack(c, &ack);
+		}
+
+		service_request_handle(topic, len);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void device_evt_handler(struct mqtt_client *const c,
+			       const struct mqtt_evt *evt)
+{
+	int err = aws_jobs_exec_mqtt_evt_handler(c, evt);
+
+	zassert_true(err >= 0, "Engine failed to handle event %d: %d",
+		     evt->type, err);
+
+	if (err == 0) {
+		return;
+	}
+
+	switch (evt->type) {
+	case MQTT_EVT_CONNACK:
+		device_connected = (evt->result == 0);
+		break;
+
+	case MQTT_EVT_DISCONNECT:
+		device_connected = false;
+		break;
+
+	case MQTT_EVT_PUBLISH:
+		zassert_unreachable("Publish not handled by the engine");
+		break;
+
+	case MQTT_EVT_PUBACK:
+	case MQTT_EVT_SUBACK:
+		/* The device sends nothing but the messages of the engine */
+		zassert_unreachable("Acknowledgment of message %d not "
+				    "handled by the engine",
+				    evt->type == MQTT_EVT_PUBACK ?
+				    evt->param.puback.message_id :
+				    evt->param.suback.message_id);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void job_evt_handler(const struct aws_jobs_exec_evt *evt)
+{
+	struct exec_evt *e = &evts[evt_count];
+
+	zassert_true(evt_count < ARRAY_SIZE(evts), "Too many events");
+
+	e->type = evt->type;
+	e->status = evt->status;
+	strcpy(e->id, evt->job->id);
+	strcpy(e->doc, evt->job->doc);
+	evt_count++;
+
+	TC_PRINT("Event %d for %s: %s\n", evt->type, evt->job->id,
+		 aws_jobs_status_str(evt->status));
+}
+
+/* Process the input of both clients for the given time */
+static void pump(int32_t ms)
+{
+	int64_t end = k_uptime_get() + ms;
+	int64_t left;
+
+	while ((left = end - k_uptime_get()) > 0) {
+		struct pollfd fds[2] = {
+			{ .fd = service.transport.tcp.sock, .events = POLLIN },
+			{ .fd = device_connected ?
+				device.transport.tcp.sock : -1,
+			  .events = POLLIN },
+		};
+
+		if (poll(fds, ARRAY_SIZE(fds), left) <= 0) {
+			continue;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			zassert_equal(mqtt_input(&service), 0,
+				      "Service input failed");
+		}
+
+		if (fds[1].revents & POLLIN) {
+			(void)mqtt_input(&device);
+		}
+	}
+}
+
+static void client_connect(struct mqtt_client *client, const char *id,
+			   mqtt_evt_cb_t evt_cb, uint8_t *rx_buf,
+			   uint8_t *tx_buf, size_t buf_size)
+{
+	mqtt_client_init(client);
+
+	client->broker = &broker;
+	client->evt_cb = evt_cb;
+	client->client_id.utf8 = (uint8_t *)id;
+	client->client_id.size = strlen(id);
+	client->protocol_version = MQTT_VERSION_3_1_1;
+	client->rx_buf = rx_buf;
+	client->rx_buf_size = buf_size;
+	client->tx_buf = tx_buf;
+	client->tx_buf_size = buf_size;
+	client->transport.type = MQTT_TRANSPORT_NON_SECURE;
+	client->clean_session = true;
+
+	zassert_equal(mqtt_connect(client), 0, "mqtt_connect failed");
+}
+
+static void device_connect(void)
+{
+	client_connect(&device, DEVICE_ID, device_evt_handler, device_rx_buf,
+		       device_tx_buf, sizeof(device_rx_buf));
+
+	device_connected = true;
+	pump(SETTLE_MS);
+}
+
+static void test_exec_start(void)
+{
+	struct sockaddr_in *broker4 = (struct sockaddr_in *)&broker;
+	struct mqtt_topic topics[] = {
+		{ .topic.utf8 = (uint8_t *)THING "+/update",
+		  .qos = MQTT_QOS_1_AT_LEAST_ONCE },
+		{ .topic.utf8 = (uint8_t *)THING "+/get",
+		  .qos = MQTT_QOS_1_AT_LEAST_ONCE },
+		{ .topic.utf8 = (uint8_t *)THING "get",
+		  .qos = MQTT_QOS_1_AT_LEAST_ONCE },
+	};
+	const struct mqtt_subscription_list list = {
+		.list = topics,
+		.list_count = ARRAY_SIZE(topics),
+		.message_id = 1
+	};
+
+	job_create("job-1", DOC_1);
+	job_create("job-2", DOC_2);
+	job_create("job-3", DOC_3);
+
+	zassert_equal(mqtt_broker_sim_start(), 0, "Failed to start broker");
+
+	broker4->sin_family = AF_INET;
+	broker4->sin_port = htons(CONFIG_MQTT_BROKER_SIM_PORT);
+	inet_pton(AF_INET, "127.0.0.1", &broker4->sin_addr);
+
+	for (size_t i = 0; i < ARRAY_SIZE(topics); i++) {
+		topics[i].topic.size =
+			strlen((const char *)topics[i].topic.utf8);
+	}
+
+	client_connect(&service, SERVICE_ID, service_evt_handler,
+		       service_rx_buf, service_tx_buf, sizeof(service_rx_buf));
+	pump(SETTLE_MS);
+	zassert_equal(mqtt_subscribe(&service, &list), 0, "Subscribe failed");
+	pump(SETTLE_MS);
+	zassert_true(service_subscribed, "Service not subscribed");
+
+	zassert_equal(aws_jobs_exec_init(NULL, job_evt_handler), -EINVAL,
+		      NULL);
+	zassert_equal(aws_jobs_exec_init(&device, job_evt_handler), 0, NULL);
+
+	device_connect();
+
+	/* The first job is announced with its document, the second one is
+	 * queued, and the third one does not fit the queue.
+	 */
+	zassert_equal(evt_count, 1, "Unexpected event count %zu", evt_count);
+	zassert_equal(evts[0].type, AWS_JOBS_EXEC_EVT_JOB, NULL);
+	zassert_equal(strcmp(evts[0].id, "job-1"), 0, NULL);
+	zassert_equal(strcmp(evts[0].doc, DOC_1), 0, "Document %s",
+		      evts[0].doc);
+	zassert_equal(evts[0].status, AWS_JOBS_QUEUED, NULL);
+	zassert_equal(jobs[1].gets, 1, NULL);
+	zassert_equal(jobs[2].gets, 0, NULL);
+}
+
+static void test_exec_notify_next(void)
+{
+	int gets = jobs[0].gets;
+
+	/* The job is known, so it is neither announced nor read again */
+	snprintf(tx_topic, sizeof(tx_topic), THING "notify-next");
+	execution_print(&jobs[0]);
+	service_publish(tx_payload);
+	pump(SETTLE_MS);
+
+	zassert_equal(evt_count, 1, "Unexpected event count %zu", evt_count);
+	zassert_equal(jobs[0].gets, gets, NULL);
+}
+
+static void test_exec_pipeline(void)
+{
+	/* The second update is sent before the first one is accepted */
+	zassert_equal(aws_jobs_exec_update("job-1", AWS_JOBS_IN_PROGRESS,
+					   NULL),
+		      0, NULL);
+	zassert_equal(aws_jobs_exec_progress("job-1", 1), 0, NULL);
+
+	/* The pipeline is full, so this one waits */
+	zassert_equal(aws_jobs_exec_progress("job-1", 2), 0, NULL);
+	pump(SETTLE_MS);
+
+	zassert_equal(jobs[0].expected[0], 1, NULL);
+	zassert_equal(jobs[0].expected[1], 2, NULL);
+	zassert_equal(jobs[0].rejects, 0, NULL);
+	zassert_equal(jobs[0].status, AWS_JOBS_IN_PROGRESS, NULL);
+
+	pump(CONFIG_AWS_JOBS_EXEC_PROGRESS_INTERVAL_MS);
+	zassert_equal(strcmp(jobs[0].details, "{\"progress\":\"2\"}"), 0,
+		      "Details %s", jobs[0].details);
+	zassert_equal(evt_last()->type, AWS_JOBS_EXEC_EVT_ACCEPTED, NULL);
+	zassert_equal(aws_jobs_exec_update("job-9", AWS_JOBS_IN_PROGRESS,
+					   NULL),
+		      -ENOENT, NULL);
+	zassert_equal(aws_jobs_exec_update("job-1", AWS_JOBS_QUEUED, NULL),
+		      -EINVAL, NULL);
+}
+
+static void test_exec_rate_limit(void)
+{
+	int updates = jobs[0].updates;
+	int limit = 98 * 10 / CONFIG_AWS_JOBS_EXEC_PROGRESS_INTERVAL_MS + 3;
+
+	pump(CONFIG_AWS_JOBS_EXEC_PROGRESS_INTERVAL_MS);
+
+	for (int i = 3; i <= 100; i++) {
+		zassert_equal(aws_jobs_exec_progress("job-1", i), 0, NULL);
+		pump(10);
+	}
+
+	pump(2 * CONFIG_AWS_JOBS_EXEC_PROGRESS_INTERVAL_MS);
+
+	updates = jobs[0].updates - updates;
+	TC_PRINT("%d updates sent for 98 progress reports\n", updates);
+
+	zassert_true(updates <= limit, "%d updates sent", updates);
+	zassert_equal(strcmp(jobs[0].details, "{\"progress\":\"100\"}"), 0,
+		      "Details %s", jobs[0].details);
+	zassert_equal(jobs[0].rejects, 0, NULL);
+}
+
+static void test_exec_version_mismatch(void)
+{
+	/* Updated by someone else */
+	jobs[0].version += 3;
+
+	zassert_equal(aws_jobs_exec_update("job-1", AWS_JOBS_IN_PROGRESS,
+					   "{\"step\":\"verify\"}"),
+		      0, NULL);
+	pump(SETTLE_MS + 2 * CONFIG_AWS_JOBS_EXEC_PROGRESS_INTERVAL_MS);
+
+	zassert_equal(jobs[0].rejects, 1, NULL);
+	zassert_equal(strcmp(jobs[0].details, "{\"step\":\"verify\"}"), 0,
+		      "Details %s", jobs[0].details);
+}
+
+static void test_exec_next_job(void)
+{
+	int gets = jobs[1].gets;
+
+	/* Status changes are not rate-limited */
+	zassert_equal(aws_jobs_exec_update("job-1", AWS_JOBS_SUCCEEDED, NULL),
+		      0, NULL);
+	zassert_equal(aws_jobs_exec_update("job-1", AWS_JOBS_IN_PROGRESS,
+					   NULL),
+		      -EINVAL, NULL);
+	pump(SETTLE_MS);
+
+	zassert_equal(jobs[0].status, AWS_JOBS_SUCCEEDED, NULL);
+	zassert_equal(evts[evt_count - 2].type, AWS_JOBS_EXEC_EVT_ACCEPTED,
+		      NULL);
+	zassert_equal(evts[evt_count - 2].status, AWS_JOBS_SUCCEEDED, NULL);
+
+	/* The next job comes from the queue, with the document it was
+	 * received with, and the job that did not fit is fetched.
+	 */
+	zassert_equal(evt_last()->type, AWS_JOBS_EXEC_EVT_JOB, NULL);
+	zassert_equal(strcmp(evt_last()->id, "job-2"), 0, NULL);
+	zassert_equal(strcmp(evt_last()->doc, DOC_2), 0, NULL);
+	zassert_equal(jobs[1].gets, gets, NULL);
+	zassert_equal(jobs[2].gets, 1, NULL);
+}
+
+static void test_exec_reconnect(void)
+{
+	/* The response to the update is lost with the connection */
+	zassert_equal(aws_jobs_exec_update("job-2", AWS_JOBS_IN_PROGRESS,
+					   NULL),
+		      0, NULL);
+	zassert_equal(mqtt_disconnect(&device), 0, "mqtt_disconnect failed");
+	pump(SETTLE_MS);
+
+	device_connect();
+	zassert_true(device_connected, "Device not connected");
+
+	/* The update is sent again once the version has been read */
+	zassert_equal(jobs[1].status, AWS_JOBS_IN_PROGRESS, NULL);
+	zassert_equal(evt_last()->type, AWS_JOBS_EXEC_EVT_ACCEPTED, NULL);
+	zassert_equal(strcmp(evt_last()->id, "job-2"), 0, NULL);
+
+	/* The version was read again, so the next update is accepted */
+	zassert_equal(aws_jobs_exec_update("job-2", AWS_JOBS_FAILED,
+					   "{\"reason\":\"checksum\"}"),
+		      0, NULL);
+	pump(SETTLE_MS);
+
+	zassert_equal(jobs[1].status, AWS_JOBS_FAILED, NULL);
+	zassert_equal(jobs[1].rejects, 0, NULL);
+	zassert_equal(evt_last()->type, AWS_JOBS_EXEC_EVT_JOB, NULL);
+	zassert_equal(strcmp(evt_last()->id, "job-3"), 0, NULL);
+}
+
+static void test_exec_canceled(void)
+{
+	jobs[2].status = AWS_JOBS_CANCELED;
+
+	zassert_equal(aws_jobs_exec_update("job-3", AWS_JOBS_IN_PROGRESS,
+					   NULL),
+		      0, NULL);
+	pump(SETTLE_MS);
+
+	zassert_equal(evt_last()->type, AWS_JOBS_EXEC_EVT_REJECTED, NULL);
+	zassert_equal(strcmp(evt_last()->id, "job-3"), 0, NULL);
+	zassert_equal(aws_jobs_exec_update("job-3", AWS_JOBS_IN_PROGRESS,
+					   NULL),
+		      -ENOENT, NULL);
+}
+
+static void test_exec_notify(void)
+{
+	job_create("job-4", DOC_4);
+
+	snprintf(tx_topic, sizeof(tx_topic), THING "notify");
+	service_publish("{\"timestamp\":1,\"jobs\":{\"QUEUED\":[{"
+			"\"jobId\":\"job-4\",\"queuedAt\":1,"
+			"\"lastUpdatedAt\":1,\"executionNumber\":1,"
+			"\"versionNumber\":1}]}}");
+	pump(SETTLE_MS);
+
+	zassert_equal(evt_last()->type, AWS_JOBS_EXEC_EVT_JOB, NULL);
+	zassert_equal(strcmp(evt_last()->id, "job-4"), 0, NULL);
+	zassert_equal(strcmp(evt_last()->doc, DOC_4), 0, NULL);
+
+	zassert_equal(mqtt_disconnect(&device), 0, "mqtt_disconnect failed");
+	zassert_equal(mqtt_disconnect(&service), 0, "mqtt_disconnect failed");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(aws_jobs_exec,
+			 ztest_unit_test(test_exec_start),
+			 ztest_unit_test(test_exec_notify_next),
+			 ztest_unit_test(test_exec_pipeline),
+			 ztest_unit_test(test_exec_rate_limit),
+			 ztest_unit_test(test_exec_version_mismatch),
+			 ztest_unit_test(test_exec_next_job),
+			 ztest_unit_test(test_exec_reconnect),
+			 ztest_unit_test(test_exec_canceled),
+			 ztest_unit_test(test_exec_notify)
+			 );
+
+	ztest_run_test_suite(aws_jobs_exec);
+}
@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <stdio.h>
+#include <net/cloud.h>
+#include <net/cloud_outbox.h>
+
+#define TOPIC "devices/test/messages"
+#define OTHER_TOPIC "devices/test/alerts"
+#define SHORT_TOPIC "t"
+#define MAX_PUBLISHES 64
+#define MAX_EVENTS 64
+
+/* Time for the work queue to process what was submitted without delay */
+#define SETTLE K_MSEC(10)
+
+struct publish {
+	char payload[CONFIG_CLOUD_OUTBOX_BATCH_SIZE + 1];
+	char topic[32];
+	enum cloud_qos qos;
+	uint16_t message_id;
+};
+
+static struct publish publishes[MAX_PUBLISHES];
+static size_t publish_count;
+static int send_err;
+static size_t send_attempts;
+
+static struct cloud_outbox_evt events[MAX_EVENTS];
+static size_t event_count;
+
+/* Fake backend, records the published messages. */
+static int fake_send(const struct cloud_backend *const backend,
+		     const struct cloud_msg *const msg)
+{
+	struct publish *p = &publishes[publish_count];
+
+	send_attempts++;
+
+	if (send_err) {
+		return send_err;
+	}
+
+	zassert_true(publish_count < MAX_PUBLISHES, "Too many publishes");
+	zassert_true(msg->len < sizeof(p->payload), "Payload too long");
+	zassert_true(msg->endpoint.len < sizeof(p->topic), "Topic too long");
+
+	memcpy(p->payload, msg->buf, msg->len);
+	p->payload[msg->len] = '\0';
+	memcpy(p->topic, msg->endpoint.str, msg->endpoint.len);
+	p->topic[msg->endpoint.len] = '\0';
+	p->qos = msg->qos;
+	p->message_id = msg->message_id;
+
+	publish_count++;
+
+	return 0;
+}
+
+static const struct cloud_api fake_api = {
+	.send = fake_send,
+};
+
+static struct cloud_backend_config fake_config = {
+	.name = "FAKE",
+};
+
+static const struct cloud_backend fake_backend = {
+	.api = &fake_api,
+	.config = &fake_config,
+};
+
+static void outbox_evt_handler(const struct cloud_outbox_evt *evt)
+{
+	zassert_true(event_count < MAX_EVENTS, "Too many events");
+	events[event_count++] = *evt;
+}
+
+static void cloud_evt(enum cloud_event_type type, uint16_t message_id)
+{
+	struct cloud_event evt = {
+		.type = type,
+		.data.msg.message_id = message_id,
+	};
+
+	cloud_outbox_event_handle(&evt);
+}
+
+static int put(const char *topic, const char *payload, enum cloud_qos qos,
+	       uint32_t flags)
+{
+	struct cloud_msg msg = {
+		.buf = (char *)payload,
+		.len = strlen(payload),
+		.qos = qos,
+		.endpoint.type = CLOUD_EP_MSG,
+		.endpoint.str = (char *)topic,
+		.endpoint.len = strlen(topic),
+	};
+
+	return cloud_outbox_send(&msg, flags);
+}
+
+static void test_setup(void)
+{
+	/* Leave nothing behind from the previous test. */
+	cloud_evt(CLOUD_EVT_DISCONNECTED, 0);
+	k_sleep(SETTLE);
+
+	zassert_equal(cloud_outbox_init(&fake_backend, outbox_evt_handler), 0,
+		      "Failed to initialize outbox");
+
+	memset(publishes, 0, sizeof(publishes));
+	publish_count = 0;
+	send_err = 0;
+	send_attempts = 0;
+	event_count = 0;
+}
+
+static void test_drain_in_order(void)
+{
+	int id[3];
+
+	id[0] = put(TOPIC, "1", CLOUD_QOS_AT_MOST_ONCE, 0);
+	id[1] = put(OTHER_TOPIC, "2", CLOUD_QOS_AT_MOST_ONCE, 0);
+	id[2] = put(TOPIC, "3", CLOUD_QOS_AT_MOST_ONCE, 0);
+	zassert_true(id[0] > 0 && id[1] > 0 && id[2] > 0, "Queueing failed");
+
+	k_sleep(SETTLE);
+	zassert_equal(publish_count, 0, "Sent while offline");
+	zassert_equal(cloud_outbox_count(), 3, "Wrong count");
+
+	cloud_evt(CLOUD_EVT_READY, 0);
+	k_sleep(SETTLE);
+
+	zassert_equal(publish_count, 3, "Not all sent");
+	zassert_equal(strcmp(publishes[0].payload, "1"), 0, "Wrong order");
+	zassert_equal(strcmp(publishes[1].payload, "2"), 0, "Wrong order");
+	zassert_equal(strcmp(publishes[2].payload, "3"), 0, "Wrong order");
+	zassert_equal(strcmp(publishes[1].topic, OTHER_TOPIC), 0,
+		      "Wrong topic");
+	zassert_equal(publishes[0].message_id, 0, "Message ID for QoS 0");
+
+	zassert_equal(cloud_outbox_count(), 0, "Messages left");
+	zassert_equal(event_count, 3, "Wrong number of events");
+	for (size_t i = 0; i < 3; i++) {
+		zassert_equal(events[i].type, CLOUD_OUTBOX_EVT_SENT,
+			      "Wrong event");
+		zassert_equal(events[i].id, id[i], "Wrong ID");
+	}
+}
+
+static void test_batch_latency(void)
+{
+	cloud_evt(CLOUD_EVT_READY, 0);
+
+	put(TOPIC, "{\"t\":1}", CLOUD_QOS_AT_MOST_ONCE, CLOUD_OUTBOX_BATCH);
+	put(TOPIC, "{\"t\":2}", CLOUD_QOS_AT_MOST_ONCE, CLOUD_OUTBOX_BATCH);
+	put(OTHER_TOPIC, "{\"a\":1}", CLOUD_QOS_AT_MOST_ONCE,
+	    CLOUD_OUTBOX_BATCH);
+	put(OTHER_TOPIC, "{\"a\":2}", CLOUD_QOS_AT_MOST_ONCE,
+	    CLOUD_OUTBOX_BATCH);
+
+	k_sleep(SETTLE);
+	zassert_equal(publish_count, 0, "Sent before the latency budget");
+
+	k_sleep(K_MSEC(CONFIG_CLOUD_OUTBOX_LATENCY_MS));
+
+	zassert_equal(publish_count, 2, "Wrong number of publishes");
+	zassert_equal(strcmp(publishes[0].payload, "[{\"t\":1},{\"t\":2}]"), 0,
+		      "Wrong batch: %s", publishes[0].payload);
+	zassert_equal(strcmp(publishes[0].topic, TOPIC), 0, "Wrong topic");
+	zassert_equal(strcmp(publishes[1].payload, "[{\"a\":1},{\"a\":2}]"), 0,
+		      "Wrong batch: %s", publishes[1].payload);
+	zassert_equal(event_count, 4, "Messages not reported");
+}
+
+static void test_batch_flushed_by_message(void)
+{
+	cloud_evt(CLOUD_EVT_READY, 0);
+
+	put(TOPIC, "1", CLOUD_QOS_AT_MOST_ONCE, CLOUD_OUTBOX_BATCH);
+	put(TOPIC, "2", CLOUD_QOS_AT_MOST_ONCE, CLOUD_OUTBOX_BATCH);
+	k_sleep(SETTLE);
+	zassert_equal(publish_count, 0, "Sent before the latency budget");
+
+	/* Messages that are not batched go out right away, and take the
+	 * batch in progress with them to keep the order.
+	 */
+	put(TOPIC, "urgent", CLOUD_QOS_AT_MOST_ONCE, 0);
+	k_sleep(SETTLE);
+
+	zassert_equal(publish_count, 2, "Wrong number of publishes");
+	zassert_equal(strcmp(publishes[0].payload, "[1,2]"), 0, "Wrong batch");
+	zassert_equal(strcmp(publishes[1].payload, "urgent"), 0,
+		      "Wrong message");
+}
+
+static void test_batch_size(void)
+{
+	char payload[16];
+
+	cloud_evt(CLOUD_EVT_READY, 0);
+
+	/* More than fits in a batch, so one is sent without waiting. */
+	for (int i = 0; i < CONFIG_CLOUD_OUTBOX_BATCH_SIZE / 4; i++) {
+		snprintf(payload, sizeof(payload), "%d", 1000 + i);
+		zassert_true(put(SHORT_TOPIC, payload, CLOUD_QOS_AT_MOST_ONCE,
+				 CLOUD_OUTBOX_BATCH) > 0, "Queueing failed");
+	}
+
+	k_sleep(SETTLE);
+	zassert_true(publish_count > 0, "Full batch not sent");
+	zassert_true(strlen(publishes[0].payload) <=
+		     CONFIG_CLOUD_OUTBOX_BATCH_SIZE, "Batch too large");
+	zassert_equal(strncmp(publishes[0].payload, "[1000,1001,", 11), 0,
+		      "Wrong batch");
+
+	k_sleep(K_MSEC(CONFIG_CLOUD_OUTBOX_LATENCY_MS));
+	zassert_equal(cloud_outbox_count(), 0, "Messages left");
+}
+
+static void test_ack(void)
+{
+	int id;
+
+	cloud_evt(CLOUD_EVT_READY, 0);
+
+	id = put(TOPIC, "reliable", CLOUD_QOS_AT_LEAST_ONCE, 0);
+	k_sleep(SETTLE);
+
+	zassert_equal(publish_count, 1, "Not sent");
+	zassert_true(publishes[0].message_id >= CLOUD_OUTBOX_MESSAGE_ID_FIRST &&
+		     publishes[0].message_id <= CLOUD_OUTBOX_MESSAGE_ID_LAST,
+		     "Message ID %d out of range", publishes[0].message_id);
+	zassert_equal(cloud_outbox_count(), 1, "Released before ack");
+	zassert_equal(event_count, 0, "Reported before ack");
+
+	/* Acknowledgment for another message */
+	cloud_evt(CLOUD_EVT_DATA_SENT, publishes[0].message_id + 1);
+	zassert_equal(cloud_outbox_count(), 1, "Released by wrong ack");
+
+	cloud_evt(CLOUD_EVT_DATA_SENT, publishes[0].message_id);
+	zassert_equal(cloud_outbox_count(), 0, "Not released");
+	zassert_equal(event_count, 1, "Not reported");
+	zassert_equal(events[0].type, CLOUD_OUTBOX_EVT_SENT, "Wrong event");
+	zassert_equal(events[0].id, id, "Wrong ID");
+
+	/* Backends that do not report message IDs acknowledge in order. */
+	put(TOPIC, "a", CLOUD_QOS_AT_LEAST_ONCE, 0);
+	put(TOPIC, "b", CLOUD_QOS_AT_LEAST_ONCE, 0);
+	k_sleep(SETTLE);
+	zassert_equal(publish_count, 3, "Not sent");
+
+	cloud_evt(CLOUD_EVT_DATA_SENT, 0);
+	zassert_equal(cloud_outbox_count(), 1, "Wrong message released");
+	cloud_evt(CLOUD_EVT_DATA_SENT, 0);
+	zassert_equal(cloud_outbox_count(), 0, "Not released");
+}
+
+static void test_resend_after_disconnect(void)
+{
+	cloud_evt(CLOUD_EVT_READY, 0);
+
+	put(TOPIC, "first", CLOUD_QOS_AT_LEAST_ONCE, 0);
+	put(TOPIC, "second", CLOUD_QOS_AT_MOST_ONCE, 0);
+	k_sleep(SETTLE);
+	zassert_equal(publish_count, 2, "Not sent");
+
+	cloud_evt(CLOUD_EVT_DISCONNECTED, 0);
+	put(TOPIC, "third", CLOUD_QOS_AT_MOST_ONCE, 0);
+	k_sleep(SETTLE);
+	zassert_equal(publish_count, 2, "Sent while offline");
+
+	/* The unacknowledged message is sent again. The message after it
+	 * was handed over already and is not.
+	 */
+	cloud_evt(CLOUD_EVT_READY, 0);
+	k_sleep(SETTLE);
+
+	zassert_equal(publish_count, 4, "Wrong number of publishes");
+	zassert_equal(strcmp(publishes[2].payload, "first"), 0, "Not resent");
+	zassert_not_equal(publishes[2].message_id, publishes[0].message_id,
+			  "Message ID reused");
+	zassert_equal(strcmp(publishes[3].payload, "third"), 0, "Wrong order");
+
+	cloud_evt(CLOUD_EVT_DATA_SENT, publishes[2].message_id);
+	zassert_equal(cloud_outbox_count(), 0, "Messages left");
+}
+
+static void test_ack_timeout(void)
+{
+	cloud_evt(CLOUD_EVT_READY, 0);
+
+	put(TOPIC, "lost", CLOUD_QOS_AT_LEAST_ONCE, 0);
+	k_sleep(SETTLE);
+	zassert_equal(publish_count, 1, "Not sent");
+
+	k_sleep(K_SECONDS(CONFIG_CLOUD_OUTBOX_ACK_TIMEOUT_SEC));
+	k_sleep(SETTLE);
+
+	zassert_equal(publish_count, 2, "Not resent");
+	zassert_equal(strcmp(publishes[1].payload, "lost"), 0, "Wrong message");
+
+	cloud_evt(CLOUD_EVT_DATA_SENT, publishes[1].message_id);
+	zassert_equal(cloud_outbox_count(), 0, "Messages left");
+}
+
+static void test_send_errors(void)
+{
+	int id;
+
+	cloud_evt(CLOUD_EVT_READY, 0);
+
+	/* Temporary errors are retried. */
+	send_err = -EAGAIN;
+	put(TOPIC, "retry", CLOUD_QOS_AT_MOST_ONCE, 0);
+	k_sleep(SETTLE);
+	zassert_equal(send_attempts, 1, "Not attempted");
+	zassert_equal(cloud_outbox_count(), 1, "Message dropped");
+
+	send_err = 0;
+	k_sleep(K_SECONDS(CONFIG_CLOUD_OUTBOX_RETRY_SEC));
+	k_sleep(SETTLE);
+	zassert_equal(publish_count, 1, "Not retried");
+	zassert_equal(cloud_outbox_count(), 0, "Messages left");
+
+	/* Messages rejected by the backend are dropped. */
+	send_err = -EINVAL;
+	id = put(TOPIC, "rejected", CLOUD_QOS_AT_MOST_ONCE, 0);
+	k_sleep(SETTLE);
+	zassert_equal(cloud_outbox_count(), 0, "Message not dropped");
+	zassert_equal(events[event_count - 1].type, CLOUD_OUTBOX_EVT_DROPPED,
+		      "Drop not reported");
+	zassert_equal(events[event_count - 1].id, id, "Wrong ID");
+}
+
+static void test_invalid(void)
+{
+	static char large[CONFIG_CLOUD_OUTBOX_SIZE];
+	struct cloud_msg msg = {
+		.buf = "x",
+		.len = 1,
+		.message_id = 1,
+	};
+
+	zassert_equal(cloud_outbox_send(NULL, 0), -EINVAL, "NULL accepted");
+	zassert_equal(cloud_outbox_send(&msg, 0), -EINVAL,
+		      "Message ID accepted");
+
+	memset(large, 'x', sizeof(large) - 1);
+	zassert_equal(put(TOPIC, large, CLOUD_QOS_AT_MOST_ONCE, 0), -EMSGSIZE,
+		      "Too large message accepted");
+
+	large[CONFIG_CLOUD_OUTBOX_BATCH_SIZE - 1] = '\0';
+	zassert_equal(put(TOPIC, large, CLOUD_QOS_AT_MOST_ONCE,
+			  CLOUD_OUTBOX_BATCH), -EMSGSIZE,
+		      "Too large batch message accepted");
+}
+
+static void test_full(void)
+{
+	char payload[16];
+	size_t queued = 0;
+	int err;
+
+	/* Without flash, the outbox is full when the RAM is. With flash, the
+	 * messages that do not fit in RAM wait in flash.
+	 */
+	for (int i = 0; i < MAX_PUBLISHES; i++) {
+		snprintf(payload, sizeof(payload), "msg-%03d", (int)i);
+		err = put(TOPIC, payload, CLOUD_QOS_AT_MOST_ONCE, 0);
+		if (err == -ENOMEM) {
+			break;
+		}
+
+		zassert_true(err > 0, "Queueing failed: %d", err);
+		queued++;
+	}
+
+	if (IS_ENABLED(CONFIG_CLOUD_OUTBOX_FLASH)) {
+		zassert_equal(queued, MAX_PUBLISHES, "Not spilled to flash");
+	} else {
+		zassert_true(err == -ENOMEM && queued > 0, "Never full");
+	}
+	zassert_equal(cloud_outbox_count(), queued, "Wrong count");
+
+	cloud_evt(CLOUD_EVT_READY, 0);
+	k_sleep(SETTLE);
+
+	zassert_equal(publish_count, queued, "Not all sent");
+	for (size_t i = 0; i < queued; i++) {
+		snprintf(payload, sizeof(payload), "msg-%03d", (int)i);
+		zassert_equal(strcmp(publishes[i].payload, payload), 0,
+			      "Wrong order");
+	}
+	zassert_equal(cloud_outbox_count(), 0, "Messages left");
+}
+
+static void test_restore(void)
+{
+	char payload[16];
+	size_t n = MAX_PUBLISHES / 2;
+
+	if (!IS_ENABLED(CONFIG_CLOUD_OUTBOX_FLASH)) {
+		return;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		snprintf(payload, sizeof(payload), "msg-%03d", (int)i);
+		zassert_true(put(TOPIC, payload, CLOUD_QOS_AT_MOST_ONCE, 0) > 0,
+			     "Queueing failed");
+	}
+
+	/* Messages in RAM are lost in a reset, the ones in flash are
+	 * restored in order.
+	 */
+	zassert_equal(cloud_outbox_init(&fake_backend, outbox_evt_handler), 0,
+		      "Failed to initialize outbox");
+	zassert_true(cloud_outbox_count() > 0, "Nothing restored");
+	zassert_true(cloud_outbox_count() < n, "RAM not lost");
+
+	cloud_evt(CLOUD_EVT_READY, 0);
+	k_sleep(SETTLE);
+
+	zassert_true(publish_count > 0, "Nothing sent");
+	zassert_equal(strcmp(publishes[publish_count - 1].payload, payload), 0,
+		      "Newest message not restored");
+	zassert_equal(cloud_outbox_count(), 0, "Messages left");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(cloud_outbox_test,
+		ztest_unit_test_setup_teardown(test_drain_in_order,
+					       test_setup, unit_test_noop),
+		ztest_unit_test_setup_teardown(test_batch_latency,
+					       test_setup, unit_test_noop),
+		ztest_unit_test_setup_teardown(test_batch_flushed_by_message,
+					       test_setup, unit_test_noop),
+		ztest_unit_test_setup_teardown(test_batch_size,
+					       test_setup, unit_test_noop),
+		ztest_unit_test_setup_teardown(test_ack,
+					       test_setup, unit_test_noop),
+		ztest_unit_test_setup_teardown(test_resend_after_disconnect,
+					       test_setup, unit_test_noop),
+		ztest_unit_test_setup_teardown(test_ack_timeout,
+					       test_setup, unit_test_noop),
+		ztest_unit_test_setup_teardown(test_send_errors,
+					       test_setup, unit_test_noop),
+		ztest_unit_test_setup_teardown(test_invalid,
+					       test_setup, unit_test_noop),
+		ztest_unit_test_setup_teardown(test_full,
+					       test_setup, unit_test_noop),
+		ztest_unit_test_setup_teardown(test_restore,
+					       test_setup, unit_test_noop)
+	);
+
+	ztest_run_test_suite(cloud_outbox_test);
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <string.h>
+#include <stdio.h>
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <ztest.h>
+#include <logging/log.h>
+#include <download_client.h>
+
+LOG_MODULE_REGISTER(download_client, CONFIG_DOWNLOAD_CLIENT_LOG_LEVEL);
+
+#define BODY "0123456789"
+
+int http_get_request_send(struct download_client *client);
+int http_parse(struct download_client *client, size_t len);
+
+static struct download_client client;
+static int requests_sent;
+
+/* Stubs of the other parts of the download client */
+int url_parse_host(const char *url, char *host, size_t len)
+{
+	strncpy(host, url, len);
+	return 0;
+}
+
+int url_parse_file(const char *url, char *file, size_t len)
+{
+	strncpy(file, url, len);
+	return 0;
+}
+
+int socket_send(const struct download_client *client, const char *buf,
+		size_t len)
+{
+	requests_sent++;
+	return 0;
+}
+
+size_t range_end_get(const struct download_client *client)
+{
+	if (client->range_end != 0 &&
+	    (client->file_size == 0 || client->range_end < client->file_size)) {
+		return client->range_end;
+	}
+
+	return client->file_size;
+}
+
+void resume_field_begin(struct download_client *client, bool etag)
+{
+}
+
+void resume_field_char(struct download_client *client, char c)
+{
+}
+
+void resume_field_end(struct download_client *client)
+{
+}
+
+void resume_header_done(struct download_client *client)
+{
+}
+
+const char *resume_if_range_get(const struct download_client *client)
+{
+	return NULL;
+}
+
+static void client_init(int proto)
+{
+	memset(&client, 0, sizeof(client));
+	client.rx_buf = client.buf;
+	client.proto = proto;
+	client.host = "example.com";
+	client.file = "file.bin";
+
+	requests_sent = 0;
+	zassert_equal(http_get_request_send(&client), 0, NULL);
+	zassert_equal(requests_sent, 1, "Request not sent");
+}
+
+/* Receive data as the socket would, after the data already in the buffer */
+static int feed(const char *data, size_t len)
+{
+	zassert_true(client.offset + len <= sizeof(client.buf),
+		     "Buffer overflow");
+	memcpy(client.rx_buf + client.offset, data, len);
+
+	return http_parse(&client, len);
+}
+
+static void response_check(const char *resp, size_t file_size)
+{
+	zassert_equal(client.file_size, file_size, "File size %d",
+		      client.file_size);
+	zassert_equal(client.progress, strlen(BODY), "Progress %d",
+		      client.progress);
+	zassert_equal(client.offset, strlen(BODY), NULL);
+	zassert_mem_equal(client.rx_buf, BODY, strlen(BODY), "%s", resp);
+}
+
+static void test_split(void)
+{
+	static const char resp[] =
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Length: 10\r\n"
+		"ETag: \"abc\"\r\n"
+		"\r\n"
+		BODY;
+	size_t len = strlen(resp);
+	int rc;
+
+	/* Split in two at every byte */
+	for (size_t split = 1; split < len; split++) {
+		client_init(IPPROTO_TCP);
+
+		rc = feed(resp, split);
+		zassert_equal(rc, 1, "Complete after %d bytes", split);
+		rc = feed(resp + split, len - split);
+		zassert_equal(rc, 0, "Not complete, split at %d", split);
+		response_check(resp, strlen(BODY));
+	}
+
+	/* One byte at a time */
+	client_init(IPPROTO_TCP);
+	for (size_t i = 0; i < len - 1; i++) {
+		rc = feed(&resp[i], 1);
+		zassert_equal(rc, 1, "Complete after %d bytes", i + 1);
+	}
+	rc = feed(&resp[len - 1], 1);
+	zassert_equal(rc, 0, "Not complete");
+	response_check(resp, strlen(BODY));
+}
+
+static void test_mixed_case(void)
+{
+	static const char resp[] =
+		"http/1.1 206 Partial Content\r\n"
+		"content-RANGE: bytes 0-9/100\r\n"
+		"X-Content-Length: 7\r\n"
+		"Content-Lengthy: 8\r\n"
+		"CONTENT-LENGTH: 10\r\n"
+		"cOnNeCtIoN:  ClOsE \r\n"
+		"\r\n"
+		BODY;
+	static const char closed[] =
+		"HTTP/1.1 206 Partial Content\r\n"
+		"Content-Range: bytes 0-9/100\r\n"
+		"Connection: closed\r\n"
+		"\r\n";
+	int rc;
+
+	client_init(IPPROTO_TLS_1_2);
+
+	rc = feed(resp, strlen(resp));
+	zassert_equal(rc, 0, "Not complete");
+	response_check(resp, 100);
+	zassert_true(client.http.connection_close, "Connection close missed");
+
+	/* A value that only starts like "close" */
+	client_init(IPPROTO_TLS_1_2);
+
+	rc = feed(closed, strlen(closed));
+	zassert_equal(rc, 1, "Body expected");
+	zassert_false(client.http.connection_close, "Connection closed");
+}
+
+static void test_long_header(void)
+{
+	static char resp[3 * CONFIG_DOWNLOAD_CLIENT_BUF_SIZE];
+	size_t len = 0;
+	size_t pos;
+	size_t n;
+	int rc;
+
+	len += sprintf(&resp[len], "HTTP/1.1 200 OK\r\n");
+
+	/* A long value, and a long name which starts like a known one */
+	len += sprintf(&resp[len], "X-Padding: ");
+	while (len < CONFIG_DOWNLOAD_CLIENT_BUF_SIZE + 10) {
+		resp[len++] = 'a';
+	}
+	len += sprintf(&resp[len], "\r\nContent-Length");
+	while (len < 2 * CONFIG_DOWNLOAD_CLIENT_BUF_SIZE + 20) {
+		resp[len++] = 'b';
+	}
+	len += sprintf(&resp[len], ": 5\r\nContent-Length: 10\r\n\r\n" BODY);
+	zassert_true(len < sizeof(resp), NULL);
+
+	client_init(IPPROTO_TCP);
+
+	/* Each part fits in the buffer, the header does not */
+	for (pos = 0; pos < len; pos += n) {
+		n = MIN(len - pos, CONFIG_DOWNLOAD_CLIENT_BUF_SIZE / 2);
+		rc = feed(&resp[pos], n);
+		zassert_equal(rc, (pos + n < len) ? 1 : 0,
+			      "Unexpected result %d at %d", rc, pos);
+	}
+
+	response_check(resp, strlen(BODY));
+}
+
+static void test_not_http(void)
+{
+	static const char resp[] = "FTP/1.0 200 OK\r\n\r\n";
+
+	client_init(IPPROTO_TCP);
+	zassert_equal(feed(resp, strlen(resp)), -1, "Not HTTP accepted");
+
+	client_init(IPPROTO_TCP);
+	zassert_equal(feed("HTTP/1.1 1000 Bad\r\n", 19), -1,
+		      "Invalid status accepted");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(lib_download_client_http,
+			 ztest_unit_test(test_split),
+			 ztest_unit_test(test_mixed_case),
+			 ztest_unit_test(test_long_header),
+			 ztest_unit_test(test_not_http)
+			 );
+
+	ztest_run_test_suite(lib_download_client_http);
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <stdio.h>
+#include <string.h>
+#include <net/socket.h>
+
+#include "http_server.h"
+
+#define STACK_SIZE 2048
+#define THREAD_PRIO K_PRIO_PREEMPT(7)
+#define REQ_SIZE 512
+
+#define RESPONSE_TEMPLATE                                                      \
+	"HTTP/1.1 206 Partial Content\r\n"                                     \
+	"Content-Range: bytes %u-%u/%u\r\n"                                    \
+	"Content-Length: %u\r\n"                                               \
+	"\r\n"
+
+static const uint8_t *file;
+static size_t file_size;
+
+static int listen_fd = -1;
+static uint32_t delays[HTTP_SERVER_CONNECTIONS];
+static struct http_server_stats stats;
+
+K_THREAD_STACK_DEFINE(listen_stack, STACK_SIZE);
+K_THREAD_STACK_ARRAY_DEFINE(conn_stacks, HTTP_SERVER_CONNECTIONS, STACK_SIZE);
+static struct k_thread listen_thread;
+static struct k_thread conn_threads[HTTP_SERVER_CONNECTIONS];
+
+static int send_all(int fd, const void *buf, size_t len)
+{
+	ssize_t sent;
+
+	while (len > 0) {
+		sent = send(fd, buf, len, 0);
+		if (sent <= 0) {
+			return -EIO;
+		}
+
+		buf = (const uint8_t *)buf + sent;
+		len -= sent;
+	}
+
+	return 0;
+}
+
+static int response_send(int fd, size_t conn, const char *req)
+{
+	char hdr[128];
+	const char *range;
+	unsigned int from;
+	unsigned int to;
+	int len;
+
+	range = strstr(req, "Range: bytes=");
+
+	if (strncmp(req, "GET /" HTTP_SERVER_FILE " ",
+		    strlen("GET /" HTTP_SERVER_FILE " ")) != 0 ||
+	    range == NULL ||
+	    sscanf(range, "Range: bytes=%u-%u", &from, &to) != 2 ||
+	    from > to || from >= file_size) {
+		stats.bad_requests++;
+		return -EINVAL;
+	}
+
+	to = MIN(to, file_size - 1);
+
+	if (delays[conn]) {
+		k_sleep(K_MSEC(delays[conn]));
+	}
+
+	len = snprintf(hdr, sizeof(hdr), RESPONSE_TEMPLATE,
+		       from, to, (unsigned int)file_size, to - from + 1);
+
+	if (send_all(fd, hdr, len) ||
+	    send_all(fd, &file[from], to - from + 1)) {
+		return -EIO;
+	}
+
+	stats.responses[conn]++;
+	stats.sent_max = MAX(stats.sent_max, to + 1);
+
+	return 0;
+}
+
+static void conn_thread_fn(void *p1, void *p2, void *p3)
+{
+	int fd = POINTER_TO_INT(p1);
+	size_t conn = POINTER_TO_UINT(p2);
+	char req[REQ_SIZE];
+	size_t len = 0;
+	ssize_t received;
+	char *end;
+
+	req[0] = '\0';
+
+	while (true) {
+		/* Receive until the end of the next request */
+		while ((end = strstr(req, "\r\n\r\n")) == NULL) {
+			if (len == sizeof(req) - 1) {
+				stats.bad_requests++;
+				goto close;
+			}
+
+			received = recv(fd, &req[len], sizeof(req) - 1 - len, 0);
+			if (received <= 0) {
+				goto close;
+			}
+
+			len += received;
+			req[len] = '\0';
+		}
+
+		if (response_send(fd, conn, req)) {
+			break;
+		}
+
+		/* Keep any pipelined request which followed */
+		end += strlen("\r\n\r\n");
+		len -= end - req;
+		memmove(req, end, len + 1);
+	}
+
+close:
+	(void)close(fd);
+}
+
+static void listen_thread_fn(void *p1, void *p2, void *p3)
+{
+	int fd;
+
+	while (stats.accepted < HTTP_SERVER_CONNECTIONS) {
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			break;
+		}
+
+		k_thread_create(&conn_threads[stats.accepted],
+				conn_stacks[stats.accepted],
+				K_THREAD_STACK_SIZEOF(conn_stacks[0]),
+				conn_thread_fn, INT_TO_POINTER(fd),
+				UINT_TO_POINTER(stats.accepted), NULL,
+				THREAD_PRIO, 0, K_NO_WAIT);
+
+		stats.accepted++;
+	}
+}
+
+int http_server_start(const uint8_t *f, size_t size)
+{
+	int err;
+	int optval = 1;
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(HTTP_SERVER_PORT),
+		.sin_addr.s_addr = htonl(INADDR_ANY),
+	};
+
+	if (listen_fd >= 0) {
+		return -EALREADY;
+	}
+
+	file = f;
+	file_size = size;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listen_fd < 0) {
+		return -errno;
+	}
+
+	(void)setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &optval,
+			 sizeof(optval));
+
+	err = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (!err) {
+		err = listen(listen_fd, HTTP_SERVER_CONNECTIONS);
+	}
+	if (err) {
+		err = -errno;
+		(void)close(listen_fd);
+		listen_fd = -1;
+		return err;
+	}
+
+	k_thread_create(&listen_thread, listen_stack,
+			K_THREAD_STACK_SIZEOF(listen_stack), listen_thread_fn,
+			NULL, NULL, NULL, THREAD_PRIO, 0, K_NO_WAIT);
+
+	return 0;
+}
+
+void http_server_delay_set(size_t conn, uint32_t delay_ms)
+{
+	delays[conn] = delay_ms;
+}
+
+void http_server_stats_get(struct http_server_stats *s)
+{
+	*s = stats;
+}
+
+void http_server_stats_reset(void)
+{
+	uint32_t accepted = stats.accepted;
+
+	memset(&stats, 0, sizeof(stats));
+	stats.accepted = accepted;
+}
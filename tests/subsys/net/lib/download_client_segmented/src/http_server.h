@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef HTTP_SERVER_H__
+#define HTTP_SERVER_H__
+
+#include <zephyr.h>
+
+#define HTTP_SERVER_PORT 80
+#define HTTP_SERVER_FILE "file.bin"
+#define HTTP_SERVER_CONNECTIONS CONFIG_DOWNLOAD_CLIENT_SEGMENTED_CONNECTIONS
+
+/* Statistics of the server */
+struct http_server_stats {
+	/* Number of connections accepted */
+	uint32_t accepted;
+	/* Number of responses sent on each connection, in order of accept */
+	uint32_t responses[HTTP_SERVER_CONNECTIONS];
+	/* Number of requests which could not be served */
+	uint32_t bad_requests;
+	/* Offset past the furthest byte of the file sent */
+	size_t sent_max;
+};
+
+/* Start serving the file with range requests on HTTP_SERVER_PORT.
+ * Each accepted connection is handled by its own thread.
+ */
+int http_server_start(const uint8_t *file, size_t size);
+
+/* Delay the responses on the connection accepted as number conn. */
+void http_server_delay_set(size_t conn, uint32_t delay_ms);
+
+void http_server_stats_get(struct http_server_stats *stats);
+void http_server_stats_reset(void);
+
+#endif /* HTTP_SERVER_H__ */
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <net/download_client.h>
+
+#include "http_server.h"
+
+#define HOST "http://127.0.0.1"
+#define FILE_SIZE 10000
+#define DONE_TIMEOUT K_SECONDS(10)
+
+/* The connection which downloads the first segment is slow,
+ * so the segments of the other connections are received ahead.
+ */
+#define SLOW_CONN 0
+#define SLOW_DELAY_MS 20
+
+static uint8_t file[FILE_SIZE];
+
+/* Number of times each byte of the file has been delivered */
+static uint8_t delivered[FILE_SIZE];
+
+static K_SEM_DEFINE(done_sem, 0, 1);
+
+static struct {
+	/* Offset past the last fragment delivered */
+	size_t next;
+	/* Fragments which did not follow the previous one */
+	uint32_t out_of_order;
+	/* Fragments delivered after data further in the file was sent */
+	uint32_t behind;
+	/* Fragments with an offset or content which does not match */
+	uint32_t bad;
+	int error;
+} result;
+
+static void fragment_check(const struct download_fragment *frag)
+{
+	struct http_server_stats stats;
+
+	if (frag->offset + frag->len > FILE_SIZE ||
+	    memcmp(frag->buf, &file[frag->offset], frag->len) != 0) {
+		result.bad++;
+		return;
+	}
+
+	if (frag->offset != result.next) {
+		result.out_of_order++;
+	}
+
+	http_server_stats_get(&stats);
+	if (stats.sent_max > frag->offset + frag->len) {
+		result.behind++;
+	}
+
+	for (size_t i = 0; i < frag->len; i++) {
+		delivered[frag->offset + i]++;
+	}
+
+	result.next = frag->offset + frag->len;
+}
+
+static int callback(const struct download_client_evt *evt)
+{
+	switch (evt->id) {
+	case DOWNLOAD_CLIENT_EVT_FRAGMENT:
+		fragment_check(&evt->fragment);
+		return 0;
+	case DOWNLOAD_CLIENT_EVT_DONE:
+		k_sem_give(&done_sem);
+		return 0;
+	case DOWNLOAD_CLIENT_EVT_ERROR:
+		result.error = evt->error;
+		k_sem_give(&done_sem);
+		/* Stop the download */
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static void download(bool in_order, size_t from)
+{
+	struct http_server_stats stats;
+
+	memset(&result, 0, sizeof(result));
+	memset(delivered, 0, sizeof(delivered));
+	result.next = from;
+	http_server_stats_reset();
+
+	zassert_equal(download_client_segmented_init(callback, in_order), 0,
+		      "Failed to initialize");
+	zassert_equal(download_client_segmented_start(HTTP_SERVER_FILE, from),
+		      0, "Failed to start");
+	zassert_equal(k_sem_take(&done_sem, DONE_TIMEOUT), 0,
+		      "Download not complete");
+
+	zassert_equal(result.error, 0, "Download failed, error %d",
+		      result.error);
+	zassert_equal(result.bad, 0, "%d fragments did not match the file",
+		      result.bad);
+
+	for (size_t i = 0; i < FILE_SIZE; i++) {
+		zassert_equal(delivered[i], i < from ? 0 : 1,
+			      "Byte %d delivered %d times", i, delivered[i]);
+	}
+
+	/* All of the connections took part in the download */
+	http_server_stats_get(&stats);
+	zassert_equal(stats.bad_requests, 0, "Bad requests");
+	for (size_t i = 0; i < HTTP_SERVER_CONNECTIONS; i++) {
+		zassert_true(stats.responses[i] > 0,
+			     "No responses on connection %d", i);
+	}
+}
+
+static void in_order_check(void)
+{
+	zassert_equal(result.out_of_order, 0, "Fragments out of order");
+	zassert_equal(result.next, FILE_SIZE, "Download ended at %d",
+		      result.next);
+
+	/* Data further in the file was sent before the fragments of the
+	 * slow connection were delivered, so it was held in the window.
+	 */
+	zassert_true(result.behind > 0, "No segments received ahead");
+}
+
+static void test_connect(void)
+{
+	const struct download_client_cfg config = {
+		.sec_tag = -1,
+	};
+	struct http_server_stats stats;
+
+	for (size_t i = 0; i < FILE_SIZE; i++) {
+		file[i] = (i * 31) + (i >> 8);
+	}
+
+	zassert_equal(http_server_start(file, sizeof(file)), 0,
+		      "Failed to start server");
+	http_server_delay_set(SLOW_CONN, SLOW_DELAY_MS);
+
+	zassert_equal(download_client_segmented_init(callback, true), 0,
+		      "Failed to initialize");
+	zassert_equal(download_client_segmented_connect(HOST, &config), 0,
+		      "Failed to connect");
+
+	/* The server thread accepts the connections */
+	k_sleep(K_MSEC(100));
+
+	http_server_stats_get(&stats);
+	zassert_equal(stats.accepted, HTTP_SERVER_CONNECTIONS,
+		      "%d connections accepted", stats.accepted);
+}
+
+static void test_in_order(void)
+{
+	download(true, 0);
+	in_order_check();
+}
+
+static void test_in_order_offset(void)
+{
+	/* Not a multiple of the segment or fragment size */
+	download(true, 1500);
+	in_order_check();
+}
+
+static void test_out_of_order(void)
+{
+	download(false, 0);
+
+	zassert_true(result.out_of_order > 0,
+		     "Fragments delivered in order");
+}
+
+static void test_disconnect(void)
+{
+	zassert_equal(download_client_segmented_disconnect(), 0,
+		      "Failed to disconnect");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(lib_download_client_segmented,
+			 ztest_unit_test(test_connect),
+			 ztest_unit_test(test_in_order),
+			 ztest_unit_test(test_in_order_offset),
+			 ztest_unit_test(test_out_of_order),
+			 ztest_unit_test(test_disconnect)
+			 );
+
+	ztest_run_test_suite(lib_download_client_segmented);
+}
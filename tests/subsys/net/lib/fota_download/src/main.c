@@ -11,6 +11,7 @@
 #include <fw_info.h>
 #include <pm_config.h>
 #include <fota_download.h>
+#include <dfu/dfu_target.h>
 
 /* Create buffer which we will fill with strings to test with.
  * This is needed since 'dfu_ctx_Mcuboot_set_b1_file` will modify its
@@ -25,6 +26,7 @@ char buf[1024];
 #define NO_SPACE "s0s1"
 #define NO_TLS -1
 #define DEFAULT_APN NULL
+#define IMAGE_SIZE 100
 
 /* Stubs and mocks */
 bool dfu_ctx_mcuboot_set_b1_file__s0_active;
@@ -33,24 +35,42 @@ static uint32_t s1_version;
 const char *download_client_start_file;
 char *dfu_ctx_mcuboot_set_b1_file__update;
 
-int dfu_target_init(int img_type, size_t file_size)
+static download_client_callback_t dlc_callback;
+/* Set while the download client calls back */
+static bool in_dlc_callback;
+/* Digest set for the image being downloaded */
+static const uint8_t *expected_digest;
+static const uint8_t manifest_digest[FOTA_DOWNLOAD_SHA256_SIZE] = { 0xab };
+/* A download started from the callback continues on the connection */
+static bool chained;
+static int connect_count;
+static int disconnect_count;
+static int write_retval;
+static int stage_retval;
+static int stage_count;
+static int schedule_count;
+static int reset_count;
+static struct fota_download_evt last_evt;
+
+int dfu_target_init(int img_type, size_t file_size, dfu_target_callback_t cb)
 {
 	return 0;
 }
 
 int dfu_target_img_type(const void *const buf, size_t len)
 {
-	return 0;
+	return DFU_TARGET_IMAGE_TYPE_MCUBOOT;
 }
 
 int dfu_target_offset_get(size_t *offset)
 {
+	*offset = 0;
 	return 0;
 }
 
 int dfu_target_write(const void *const buf, size_t len)
 {
-	return 0;
+	return write_retval;
 }
 
 int dfu_target_done(bool successful)
@@ -58,8 +78,33 @@ int dfu_target_done(bool successful)
 	return 0;
 }
 
+int dfu_target_stage(void)
+{
+	stage_count++;
+	return stage_retval;
+}
+
+int dfu_target_schedule_update(void)
+{
+	schedule_count++;
+	return 0;
+}
+
+int dfu_target_reset(void)
+{
+	reset_count++;
+	return 0;
+}
+
+int dfu_target_digest_set(const uint8_t *digest, size_t len)
+{
+	expected_digest = digest;
+	return 0;
+}
+
 int download_client_disconnect(struct download_client *client)
 {
+	disconnect_count++;
 	return 0;
 }
 
@@ -67,17 +112,20 @@ int download_client_start(struct download_client *client, const char *file,
 			  size_t from)
 {
 	download_client_start_file = file;
+	chained = in_dlc_callback;
 	return 0;
 }
 
 int download_client_file_size_get(struct download_client *client, size_t *size)
 {
+	*size = IMAGE_SIZE;
 	return 0;
 }
 
 int download_client_init(struct download_client *client,
 			 download_client_callback_t callback)
 {
+	dlc_callback = callback;
 	return 0;
 }
 
@@ -99,6 +147,7 @@ int spm_firmware_info(uint32_t fw_address, struct fw_info *info)
 int download_client_connect(struct download_client *client, const char *host,
 			    const struct download_client_cfg *config)
 {
+	connect_count++;
 	return 0;
 }
 
@@ -111,7 +160,10 @@ int dfu_ctx_mcuboot_set_b1_file(char *file, bool s0_active, char **update)
 
 /* END stubs and mocks */
 
-void client_callback(enum fota_download_evt_id evt_id) { }
+void client_callback(const struct fota_download_evt *evt)
+{
+	last_evt = *evt;
+}
 
 static void init(void)
 {
@@ -164,12 +216,182 @@ static void test_fota_download_start(void)
 	err = fota_download_start("something.com", buf, NO_TLS, DEFAULT_APN, 0);
 	zassert_equal(err, 0, NULL);
 	zassert_true(strcmp(download_client_start_file, S1) == 0, NULL);
+
+	/* No digest is left from an earlier download */
+	expected_digest = manifest_digest;
+	err = fota_download_start("something.com", buf, NO_TLS, DEFAULT_APN, 0);
+	zassert_equal(err, 0, NULL);
+	zassert_is_null(expected_digest, "Digest of another image used");
+}
+
+static const struct fota_download_image manifest[] = {
+	{ .file = "modem.bin", .sha256 = manifest_digest },
+	{ .file = "app_update.bin" },
+};
+
+static void manifest_reset(void)
+{
+	init();
+
+	dfu_ctx_mcuboot_set_b1_file__update = NULL;
+	chained = false;
+	connect_count = 0;
+	disconnect_count = 0;
+	write_retval = 0;
+	stage_retval = 0;
+	stage_count = 0;
+	schedule_count = 0;
+	reset_count = 0;
+	memset(&last_evt, 0, sizeof(last_evt));
+}
+
+/* Deliver an event as the download client thread does */
+static int dlc_evt_send(const struct download_client_evt *evt)
+{
+	int rc;
+
+	in_dlc_callback = true;
+	rc = dlc_callback(evt);
+	in_dlc_callback = false;
+
+	return rc;
+}
+
+static int fragment_send(void)
+{
+	static const uint8_t data[IMAGE_SIZE];
+	const struct download_client_evt evt = {
+		.id = DOWNLOAD_CLIENT_EVT_FRAGMENT,
+		.fragment = {
+			.buf = data,
+			.len = sizeof(data),
+			.offset = 0,
+		},
+	};
+
+	return dlc_evt_send(&evt);
+}
+
+static int done_send(void)
+{
+	const struct download_client_evt evt = {
+		.id = DOWNLOAD_CLIENT_EVT_DONE,
+	};
+
+	return dlc_evt_send(&evt);
+}
+
+static void test_fota_download_manifest_start(void)
+{
+	int err;
+	struct fota_download_image no_file[] = { { .file = NULL } };
+
+	manifest_reset();
+
+	err = fota_download_manifest_start("something.com", manifest, 0,
+					   NO_TLS, DEFAULT_APN, 0);
+	zassert_equal(err, -EINVAL, "Empty manifest accepted");
+	err = fota_download_manifest_start("something.com", manifest,
+					   FOTA_DOWNLOAD_IMAGES_MAX + 1,
+					   NO_TLS, DEFAULT_APN, 0);
+	zassert_equal(err, -EINVAL, "Too many images accepted");
+	err = fota_download_manifest_start("something.com", no_file, 1,
+					   NO_TLS, DEFAULT_APN, 0);
+	zassert_equal(err, -EINVAL, "Image without file accepted");
+	zassert_equal(connect_count, 0, NULL);
+
+	err = fota_download_manifest_start("something.com", manifest,
+					   ARRAY_SIZE(manifest), NO_TLS,
+					   DEFAULT_APN, 0);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(connect_count, 1, NULL);
+	zassert_equal(reset_count, 1, "Staged images not discarded");
+	zassert_true(strcmp(download_client_start_file, manifest[0].file) == 0,
+		     "First image not downloaded first");
+	zassert_equal(expected_digest, manifest_digest, "Digest not set");
+	zassert_false(chained, NULL);
+}
+
+static void test_fota_download_manifest_chained(void)
+{
+	int err;
+
+	manifest_reset();
+
+	err = fota_download_manifest_start("something.com", manifest,
+					   ARRAY_SIZE(manifest), NO_TLS,
+					   DEFAULT_APN, 0);
+	zassert_equal(err, 0, NULL);
+
+	/* The next image is requested on the same connection */
+	zassert_equal(fragment_send(), 0, NULL);
+	zassert_equal(done_send(), 0, NULL);
+	zassert_equal(stage_count, 1, "First image not staged");
+	zassert_true(chained, "Next image not started from the callback");
+	zassert_true(strcmp(download_client_start_file, manifest[1].file) == 0,
+		     "Second image not downloaded");
+	zassert_is_null(expected_digest, "Digest of the first image kept");
+	zassert_equal(disconnect_count, 0, "Connection not reused");
+	zassert_equal(schedule_count, 0, "Scheduled before all images");
+
+	chained = false;
+	zassert_equal(fragment_send(), 0, NULL);
+	zassert_equal(done_send(), 0, NULL);
+	zassert_equal(stage_count, 2, "Second image not staged");
+	zassert_false(chained, "Download continued after the last image");
+	zassert_equal(schedule_count, 1, "Images not scheduled");
+	zassert_equal(last_evt.id, FOTA_DOWNLOAD_EVT_FINISHED, NULL);
+	zassert_equal(disconnect_count, 1, NULL);
+}
+
+static void test_fota_download_manifest_second_fails(void)
+{
+	int err;
+
+	/* The second image can not be written */
+	manifest_reset();
+	err = fota_download_manifest_start("something.com", manifest,
+					   ARRAY_SIZE(manifest), NO_TLS,
+					   DEFAULT_APN, 0);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(fragment_send(), 0, NULL);
+	zassert_equal(done_send(), 0, NULL);
+	zassert_true(chained, NULL);
+
+	write_retval = -EIO;
+	zassert_not_equal(fragment_send(), 0, "Failed fragment accepted");
+	zassert_equal(reset_count, 2, "Staged image not discarded");
+	zassert_equal(schedule_count, 0, "Image scheduled after failure");
+	zassert_equal(last_evt.id, FOTA_DOWNLOAD_EVT_ERROR, NULL);
+	zassert_equal(last_evt.cause, FOTA_DOWNLOAD_ERROR_CAUSE_INVALID_UPDATE,
+		      NULL);
+
+	/* The second image does not match its digest */
+	manifest_reset();
+	err = fota_download_manifest_start("something.com", manifest,
+					   ARRAY_SIZE(manifest), NO_TLS,
+					   DEFAULT_APN, 0);
+	zassert_equal(err, 0, NULL);
+	zassert_equal(fragment_send(), 0, NULL);
+	zassert_equal(done_send(), 0, NULL);
+	zassert_equal(fragment_send(), 0, NULL);
+
+	stage_retval = -EBADMSG;
+	zassert_not_equal(done_send(), 0, "Invalid image staged");
+	zassert_equal(reset_count, 2, "Staged image not discarded");
+	zassert_equal(schedule_count, 0, "Image scheduled after failure");
+	zassert_equal(last_evt.id, FOTA_DOWNLOAD_EVT_ERROR, NULL);
+	zassert_equal(last_evt.cause, FOTA_DOWNLOAD_ERROR_CAUSE_INVALID_UPDATE,
+		      NULL);
 }
 
 void test_main(void)
 {
 	ztest_test_suite(lib_fota_download_test,
-	     ztest_unit_test(test_fota_download_start)
+	     ztest_unit_test(test_fota_download_start),
+	     ztest_unit_test(test_fota_download_manifest_start),
+	     ztest_unit_test(test_fota_download_manifest_chained),
+	     ztest_unit_test(test_fota_download_manifest_second_fails)
 	 );
 
 	ztest_run_test_suite(lib_fota_download_test);
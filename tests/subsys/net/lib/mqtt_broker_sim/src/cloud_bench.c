@@ -0,0 +1,557 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/* Benchmark of the cloud library selected by the overlay configuration,
+ * connected to the simulated broker through the cloud API.
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <net/cloud.h>
+#include <mqtt_broker_sim.h>
+#include <benchmark.h>
+
+#if defined(CONFIG_AWS_IOT)
+#include <net/aws_iot.h>
+#elif defined(CONFIG_NRF_CLOUD)
+#include <net/nrf_cloud.h>
+#endif
+
+#if defined(CONFIG_SETTINGS_CUSTOM)
+#include <settings/settings.h>
+#endif
+
+#if defined(CONFIG_CLOUD_OUTBOX)
+#include <net/cloud_outbox.h>
+#endif
+
+#define MSG_COUNT 200
+#define OUTBOX_MSG_COUNT 20
+#define CONNECT_TIMEOUT_MS 10000
+#define RESPONSE_LATENCY_MS 20
+
+#define MSG_PAYLOAD "{\"appId\":\"TEMP\",\"messageType\":\"DATA\",\"data\":\"24.5\"}"
+
+#if defined(CONFIG_AWS_IOT)
+#define BACKEND_NAME "AWS_IOT"
+#define MSG_TOPIC "sim-device/messages"
+#define JOBS_NOTIFY_TOPIC "$aws/things/sim-device/jobs/notify-next"
+#define JOB_DOCUMENT \
+	"{\"execution\":{\"jobId\":\"fw-update-1\",\"status\":\"QUEUED\"," \
+	"\"versionNumber\":1,\"jobDocument\":{\"operation\":\"app_fw_update\"," \
+	"\"fwversion\":\"v1.0.1\",\"location\":{\"protocol\":\"https\"," \
+	"\"host\":\"example.com\",\"path\":\"app_update.bin\"}}}}"
+
+static const struct mqtt_broker_sim_entry script[] = {
+	{ .topic = "$aws/things/+/shadow/get", .resp_suffix = "/accepted",
+	  .payload = "{\"state\":{\"desired\":{\"interval\":60}},\"version\":3}",
+	  .latency_ms = RESPONSE_LATENCY_MS, .qos = 1 },
+	{ .topic = "$aws/things/+/shadow/get",
+	  .resp_topic = "$aws/things/sim-device/shadow/update/delta",
+	  .payload = "{\"state\":{\"interval\":60},\"version\":3}",
+	  .latency_ms = RESPONSE_LATENCY_MS, .qos = 1 },
+};
+
+static const struct cloud_endpoint subscriptions[] = {
+	{ .type = CLOUD_EP_MSG, .str = JOBS_NOTIFY_TOPIC,
+	  .len = sizeof(JOBS_NOTIFY_TOPIC) - 1 },
+};
+
+/* Shadow document, shadow delta and job document */
+#define REQUEST_ENDPOINT CLOUD_EP_STATE_GET
+#define REQUEST_PAYLOAD ""
+#define RESPONSE_COUNT 3
+
+#elif defined(CONFIG_AZURE_IOT_HUB)
+#define BACKEND_NAME "AZURE_IOT_HUB"
+
+static const struct mqtt_broker_sim_entry script[] = {
+	{ .topic = "$dps/registrations/PUT/iotdps-register/#",
+	  .resp_topic = "$dps/registrations/res/202/"
+			"?$rid=sim-device&retry-after=1",
+	  .payload = "{\"operationId\":\"4.sim.op\",\"status\":\"assigning\"}",
+	  .latency_ms = RESPONSE_LATENCY_MS },
+	{ .topic = "$dps/registrations/GET/iotdps-get-operationstatus/#",
+	  .resp_topic = "$dps/registrations/res/200/?$rid=sim-device",
+	  .payload = "{\"operationId\":\"4.sim.op\",\"status\":\"assigned\","
+		     "\"registrationState\":{\"registrationId\":\"sim-device\","
+		     "\"assignedHub\":\"sim-hub.azure-devices.net\","
+		     "\"deviceId\":\"sim-device\",\"status\":\"assigned\"}}",
+	  .latency_ms = RESPONSE_LATENCY_MS },
+	{ .topic = "$iothub/twin/GET/#",
+	  .resp_topic = "$iothub/twin/res/200/?$rid=1",
+	  .payload = "{\"desired\":{\"interval\":60,\"$version\":3},"
+		     "\"reported\":{\"$version\":1}}",
+	  .latency_ms = RESPONSE_LATENCY_MS },
+	{ .topic = "$iothub/twin/GET/#",
+	  .resp_topic = "$iothub/twin/PATCH/properties/desired/?$version=4",
+	  .payload = "{\"interval\":30,\"$version\":4}",
+	  .latency_ms = RESPONSE_LATENCY_MS },
+};
+
+/* Device twin and desired properties */
+#define REQUEST_ENDPOINT CLOUD_EP_STATE_GET
+#define REQUEST_PAYLOAD ""
+#define RESPONSE_COUNT 2
+
+#elif defined(CONFIG_NRF_CLOUD)
+#define BACKEND_NAME "NRF_CLOUD"
+#define D2C_TOPIC "prod/t1/m/d/sim-device/d2c"
+#define C2D_TOPIC "prod/t1/m/d/sim-device/c2d"
+
+static const struct mqtt_broker_sim_entry script[] = {
+	{ .topic = "$aws/things/+/shadow/get",
+	  .resp_topic = "sim-device/shadow/get/accepted",
+	  .payload = "{\"desired\":{\"nrfcloud_mqtt_topic_prefix\":\"prod/t1/\","
+		     "\"pairing\":{\"state\":\"paired\",\"topics\":{"
+		     "\"d2c\":\"" D2C_TOPIC "\",\"c2d\":\"" C2D_TOPIC "\"}}}}",
+	  .latency_ms = RESPONSE_LATENCY_MS, .qos = 1 },
+	{ .topic = D2C_TOPIC, .resp_topic = C2D_TOPIC,
+	  .payload = "{\"appId\":\"TEMP\",\"messageType\":\"CFG_SET\"}",
+	  .latency_ms = RESPONSE_LATENCY_MS, .qos = 1 },
+};
+
+/* Device messages are answered with a cloud-to-device message */
+#define REQUEST_ENDPOINT CLOUD_EP_MSG
+#define REQUEST_PAYLOAD MSG_PAYLOAD
+#define RESPONSE_COUNT 1
+#endif
+
+static struct cloud_backend *backend;
+static K_SEM_DEFINE(ready_sem, 0, 1);
+static K_SEM_DEFINE(disconnected_sem, 0, 1);
+static K_SEM_DEFINE(rx_sem, 0, RESPONSE_COUNT);
+static atomic_t data_sent;
+static K_SEM_DEFINE(outbox_sent_sem, 0, OUTBOX_MSG_COUNT);
+static atomic_t outbox_dropped;
+
+/* Heap usage of the cloud library, tracked by wrapping k_malloc() and
+ * k_free().
+ */
+void *__real_k_malloc(size_t size);
+void __real_k_free(void *ptr);
+
+static struct {
+	void *ptr;
+	size_t size;
+} allocs[128];
+static size_t heap_used;
+static size_t heap_peak;
+static uint32_t heap_ops;
+
+void *__wrap_k_malloc(size_t size)
+{
+	void *ptr = __real_k_malloc(size);
+	unsigned int key = irq_lock();
+
+	heap_ops++;
+
+	for (size_t i = 0; ptr && i < ARRAY_SIZE(allocs); i++) {
+		if (allocs[i].ptr == NULL) {
+			allocs[i].ptr = ptr;
+			allocs[i].size = size;
+			heap_used += size;
+			heap_peak = MAX(heap_peak, heap_used);
+			break;
+		}
+	}
+
+	irq_unlock(key);
+
+	return ptr;
+}
+
+void __wrap_k_free(void *ptr)
+{
+	unsigned int key = irq_lock();
+
+	for (size_t i = 0; ptr && i < ARRAY_SIZE(allocs); i++) {
+		if (allocs[i].ptr == ptr) {
+			heap_used -= allocs[i].size;
+			allocs[i].ptr = NULL;
+			break;
+		}
+	}
+
+	irq_unlock(key);
+
+	__real_k_free(ptr);
+}
+
+static void heap_stats_reset(void)
+{
+	heap_peak = heap_used;
+	heap_ops = 0;
+}
+
+#if defined(CONFIG_SETTINGS_CUSTOM)
+/* Settings are needed for DPS, which stores the assigned hub, and for the
+ * nRF Cloud session state. They are accepted and discarded, so that each run
+ * starts without a stored registration or session.
+ */
+static int settings_discard_load(struct settings_store *cs,
+				 const struct settings_load_arg *arg)
+{
+	return 0;
+}
+
+static int settings_discard_save(struct settings_store *cs, const char *name,
+				 const char *value, size_t val_len)
+{
+	return 0;
+}
+
+static const struct settings_store_itf settings_discard_itf = {
+	.csi_load = settings_discard_load,
+	.csi_save = settings_discard_save,
+};
+
+static struct settings_store settings_discard = {
+	.cs_itf = &settings_discard_itf
+};
+
+int settings_backend_init(void)
+{
+	settings_src_register(&settings_discard);
+	settings_dst_register(&settings_discard);
+
+	return 0;
+}
+#endif /* defined(CONFIG_SETTINGS_CUSTOM) */
+
+static void cloud_evt_handler(const struct cloud_backend *const backend,
+			      const struct cloud_event *const evt,
+			      void *user_data)
+{
+	ARG_UNUSED(backend);
+	ARG_UNUSED(user_data);
+
+#if defined(CONFIG_CLOUD_OUTBOX)
+	cloud_outbox_event_handle(evt);
+#endif
+
+	switch (evt->type) {
+	case CLOUD_EVT_READY:
+		k_sem_give(&ready_sem);
+		break;
+	case CLOUD_EVT_DISCONNECTED:
+		k_sem_give(&disconnected_sem);
+		break;
+	case CLOUD_EVT_DATA_SENT:
+		atomic_inc(&data_sent);
+		break;
+	case CLOUD_EVT_DATA_RECEIVED:
+		k_sem_give(&rx_sem);
+		break;
+	case CLOUD_EVT_ERROR:
+		TC_PRINT("Cloud error: %d\n", evt->data.err);
+		break;
+	default:
+		break;
+	}
+}
+
+#if defined(CONFIG_CLOUD_OUTBOX)
+static void outbox_evt_handler(const struct cloud_outbox_evt *evt)
+{
+	if (evt->type == CLOUD_OUTBOX_EVT_SENT) {
+		k_sem_give(&outbox_sent_sem);
+	} else {
+		atomic_inc(&outbox_dropped);
+	}
+}
+#endif
+
+static int msg_send(enum cloud_endpoint_type type, const char *payload,
+		    enum cloud_qos qos)
+{
+	struct cloud_msg msg = {
+		.buf = (char *)payload,
+		.len = strlen(payload),
+		.qos = qos,
+		.endpoint.type = type,
+	};
+
+#if defined(MSG_TOPIC)
+	if (type == CLOUD_EP_MSG) {
+		msg.endpoint.str = MSG_TOPIC;
+		msg.endpoint.len = strlen(MSG_TOPIC);
+	}
+#endif
+
+	return cloud_send(backend, &msg);
+}
+
+static void connect_stats_print(void)
+{
+#if defined(CONFIG_AWS_IOT)
+	struct aws_iot_connect_stats stats;
+
+	zassert_equal(aws_iot_connect_stats_get(&stats), 0,
+		      "No connection statistics");
+
+	TC_PRINT("%s: handshake %d ms, CONNACK %d ms, ready %d ms, "
+		 "%d topics subscribed, %d skipped\n",
+		 BACKEND_NAME, stats.handshake_ms, stats.connack_ms,
+		 stats.ready_ms, stats.subscribed, stats.skipped);
+#elif defined(CONFIG_NRF_CLOUD)
+	struct nrf_cloud_connect_stats stats;
+
+	zassert_equal(nrf_cloud_connect_stats_get(&stats), 0,
+		      "No connection statistics");
+
+	TC_PRINT("%s: handshake %d ms, CONNACK %d ms, ready %d ms, "
+		 "shadow %srequested\n",
+		 BACKEND_NAME, stats.handshake_ms, stats.connack_ms,
+		 stats.ready_ms, stats.shadow_requested ? "" : "not ");
+#endif
+}
+
+void test_cloud_connect(void)
+{
+	uint64_t start;
+	uint32_t elapsed_us;
+	int err;
+
+	zassert_equal(mqtt_broker_sim_script_set(script, ARRAY_SIZE(script)),
+		      0, "Failed to set script");
+	mqtt_broker_sim_reset();
+	heap_stats_reset();
+
+	backend = cloud_get_binding(BACKEND_NAME);
+	zassert_not_null(backend, "Backend %s not found", BACKEND_NAME);
+
+	backend->config->id = "sim-device";
+	backend->config->id_len = strlen("sim-device");
+
+	err = cloud_init(backend, cloud_evt_handler);
+	zassert_equal(err, 0, "cloud_init failed: %d", err);
+
+#if defined(CONFIG_CLOUD_OUTBOX)
+	err = cloud_outbox_init(backend, outbox_evt_handler);
+	zassert_equal(err, 0, "cloud_outbox_init failed: %d", err);
+#endif
+
+#if defined(CONFIG_AWS_IOT)
+	err = cloud_ep_subscriptions_add(backend, subscriptions,
+					 ARRAY_SIZE(subscriptions));
+	zassert_equal(err, 0, "Failed to add subscriptions: %d", err);
+#endif
+
+	start = benchmark_time_ns();
+
+	err = cloud_connect(backend);
+	zassert_equal(err, CLOUD_CONNECT_RES_SUCCESS, "cloud_connect failed: %d",
+		      err);
+
+	zassert_equal(k_sem_take(&ready_sem, K_MSEC(CONNECT_TIMEOUT_MS)), 0,
+		      "Not ready within %d ms", CONNECT_TIMEOUT_MS);
+
+	elapsed_us = (benchmark_time_ns() - start) / NSEC_PER_USEC;
+
+	TC_PRINT("%s: ready in %u us, %d heap operations, "
+		 "peak heap %d bytes\n",
+		 BACKEND_NAME, elapsed_us, heap_ops, heap_peak);
+	connect_stats_print();
+}
+
+void test_cloud_request(void)
+{
+	int64_t start;
+	int64_t elapsed;
+	int err;
+
+	heap_stats_reset();
+	k_sem_reset(&rx_sem);
+
+	start = k_uptime_get();
+
+	err = msg_send(REQUEST_ENDPOINT, REQUEST_PAYLOAD,
+		       CLOUD_QOS_AT_MOST_ONCE);
+	zassert_equal(err, 0, "Failed to send request: %d", err);
+
+	zassert_equal(k_sem_take(&rx_sem, K_SECONDS(1)), 0,
+		      "No response received");
+
+	elapsed = k_uptime_get() - start;
+
+#if defined(CONFIG_AWS_IOT)
+	err = mqtt_broker_sim_publish(JOBS_NOTIFY_TOPIC, JOB_DOCUMENT, 1,
+				      false, 0);
+	zassert_equal(err, 0, "Failed to publish job document: %d", err);
+#endif
+
+	for (int i = 1; i < RESPONSE_COUNT; i++) {
+		zassert_equal(k_sem_take(&rx_sem, K_SECONDS(1)), 0,
+			      "Response %d not received", i);
+	}
+
+	zassert_true(elapsed >= RESPONSE_LATENCY_MS,
+		     "Response faster than scripted latency: %lld ms", elapsed);
+
+	TC_PRINT("%s: response in %lld ms, %d heap operations, "
+		 "peak heap %d bytes\n",
+		 BACKEND_NAME, elapsed, heap_ops, heap_peak);
+}
+
+void test_cloud_throughput(void)
+{
+	struct mqtt_broker_sim_stats stats;
+	int64_t deadline;
+	uint64_t start;
+	uint32_t elapsed_us;
+	int err;
+
+	/* Only count the messages, no responses are sent */
+	zassert_equal(mqtt_broker_sim_script_set(NULL, 0), 0,
+		      "Failed to clear script");
+	mqtt_broker_sim_reset();
+	heap_stats_reset();
+	atomic_set(&data_sent, 0);
+
+	deadline = k_uptime_get() + CONNECT_TIMEOUT_MS;
+	start = benchmark_time_ns();
+
+	for (int i = 0; i < MSG_COUNT; i++) {
+		err = msg_send(CLOUD_EP_MSG, MSG_PAYLOAD,
+			       CLOUD_QOS_AT_LEAST_ONCE);
+		zassert_equal(err, 0, "Failed to send message %d: %d", i, err);
+	}
+
+	/* Not all libraries report acknowledgments, so the messages are
+	 * counted by the broker.
+	 */
+	do {
+		mqtt_broker_sim_stats_get(&stats);
+		zassert_true(k_uptime_get() < deadline,
+			     "%d of %d messages received", stats.publish_rx,
+			     MSG_COUNT);
+		k_sleep(K_MSEC(1));
+	} while (stats.publish_rx < MSG_COUNT);
+
+	elapsed_us = (benchmark_time_ns() - start) / NSEC_PER_USEC;
+
+	zassert_equal(stats.dropped, 0, "Messages dropped");
+
+#if defined(CONFIG_NRF_CLOUD)
+	/* nRF Cloud reports the acknowledgment of each message */
+	while (atomic_get(&data_sent) < MSG_COUNT) {
+		zassert_true(k_uptime_get() < deadline,
+			     "%d of %d messages acknowledged",
+			     atomic_get(&data_sent), MSG_COUNT);
+		k_sleep(K_MSEC(1));
+	}
+#endif
+
+	TC_PRINT("%s: %d messages in %u us, %d acknowledged, "
+		 "%d bytes sent, %d heap operations, peak heap %d bytes\n",
+		 BACKEND_NAME, MSG_COUNT, elapsed_us, atomic_get(&data_sent),
+		 stats.bytes_rx, heap_ops, heap_peak);
+}
+
+void test_cloud_outbox(void)
+{
+#if defined(CONFIG_CLOUD_OUTBOX)
+	struct mqtt_broker_sim_stats stats;
+	struct cloud_msg msg = {
+		.buf = MSG_PAYLOAD,
+		.len = strlen(MSG_PAYLOAD),
+		.qos = CLOUD_QOS_AT_LEAST_ONCE,
+		.endpoint.type = CLOUD_EP_MSG,
+	};
+	int err;
+
+	mqtt_broker_sim_reset();
+	k_sem_reset(&outbox_sent_sem);
+	atomic_set(&outbox_dropped, 0);
+
+	for (int i = 0; i < OUTBOX_MSG_COUNT; i++) {
+		err = cloud_outbox_send(&msg, 0);
+		zassert_true(err > 0, "Failed to queue message %d: %d", i, err);
+	}
+
+	/* The messages are released by the acknowledgments that the backend
+	 * reports with their message IDs, long before the outbox would send
+	 * them again.
+	 */
+	for (int i = 0; i < OUTBOX_MSG_COUNT; i++) {
+		zassert_equal(k_sem_take(&outbox_sent_sem, K_SECONDS(1)), 0,
+			      "%d of %d messages acknowledged", i,
+			      OUTBOX_MSG_COUNT);
+	}
+
+	mqtt_broker_sim_stats_get(&stats);
+
+	zassert_equal(atomic_get(&outbox_dropped), 0, "Messages dropped");
+	zassert_equal(cloud_outbox_count(), 0, "Messages left in the outbox");
+	zassert_equal(stats.publish_rx, OUTBOX_MSG_COUNT,
+		      "%d messages received", stats.publish_rx);
+#else
+	ztest_test_skip();
+#endif
+}
+
+void test_cloud_reconnect(void)
+{
+	struct mqtt_broker_sim_stats stats;
+	int64_t deadline;
+	uint64_t start;
+	uint32_t elapsed_us;
+	int err;
+
+	zassert_equal(mqtt_broker_sim_script_set(script, ARRAY_SIZE(script)),
+		      0, "Failed to set script");
+
+	k_sem_reset(&disconnected_sem);
+	zassert_equal(cloud_disconnect(backend), 0, "cloud_disconnect failed");
+	zassert_equal(k_sem_take(&disconnected_sem, K_SECONDS(1)), 0,
+		      "Not disconnected");
+
+	mqtt_broker_sim_reset();
+	heap_stats_reset();
+	k_sem_reset(&ready_sem);
+
+	deadline = k_uptime_get() + CONNECT_TIMEOUT_MS;
+	start = benchmark_time_ns();
+
+	/* The connection poll thread may still be cleaning up after the
+	 * previous connection.
+	 */
+	do {
+		err = cloud_connect(backend);
+		if (err == CLOUD_CONNECT_RES_ERR_ALREADY_CONNECTED) {
+			k_sleep(K_MSEC(1));
+		}
+	} while ((err == CLOUD_CONNECT_RES_ERR_ALREADY_CONNECTED) &&
+		 (k_uptime_get() < deadline));
+
+	zassert_equal(err, CLOUD_CONNECT_RES_SUCCESS, "cloud_connect failed: %d",
+		      err);
+
+	zassert_equal(k_sem_take(&ready_sem, K_MSEC(CONNECT_TIMEOUT_MS)), 0,
+		      "Not ready within %d ms", CONNECT_TIMEOUT_MS);
+
+	elapsed_us = (benchmark_time_ns() - start) / NSEC_PER_USEC;
+
+	mqtt_broker_sim_stats_get(&stats);
+
+	TC_PRINT("%s: ready again in %u us, session %sresumed, "
+		 "%d topics subscribed, %d heap operations, "
+		 "peak heap %d bytes\n",
+		 BACKEND_NAME, elapsed_us, stats.sessions_resumed ? "" : "not ",
+		 stats.subscribes, heap_ops, heap_peak);
+	connect_stats_print();
+
+#if defined(CONFIG_AWS_IOT) || defined(CONFIG_NRF_CLOUD)
+	/* The resumed session keeps the subscriptions and the shadow state */
+	zassert_equal(stats.sessions_resumed, 1, "Session not resumed");
+	zassert_equal(stats.subscribes, 0, "%d topics subscribed again",
+		      stats.subscribes);
+	zassert_equal(stats.scripted, 0, "Shadow requested again");
+#endif
+
+	zassert_equal(cloud_disconnect(backend), 0, "cloud_disconnect failed");
+}
@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <net/socket.h>
+#include <net/mqtt.h>
+#include <mqtt_broker_sim.h>
+#include <benchmark.h>
+
+#define EVT_TIMEOUT_MS 1000
+#define SCRIPT_LATENCY_MS 50
+
+#define SHADOW_GET "$aws/things/sim-device/shadow/get"
+#define SHADOW_GET_ACCEPTED SHADOW_GET "/accepted"
+#define SHADOW_STATE "{\"state\":{\"desired\":{\"interval\":60}}}"
+#define SHADOW_DELTA_TOPIC "$aws/things/sim-device/shadow/update/delta"
+#define SHADOW_DELTA "{\"state\":{\"interval\":30}}"
+
+static const struct mqtt_broker_sim_entry script[] = {
+	{ .topic = "$aws/things/+/shadow/get", .resp_suffix = "/accepted",
+	  .payload = SHADOW_STATE, .latency_ms = SCRIPT_LATENCY_MS, .qos = 1 },
+	{ .topic = "$aws/things/+/shadow/get",
+	  .resp_topic = SHADOW_DELTA_TOPIC, .payload = SHADOW_DELTA,
+	  .latency_ms = 2 * SCRIPT_LATENCY_MS },
+};
+
+static struct mqtt_client client;
+static struct sockaddr_storage broker;
+static uint8_t rx_buf[256];
+static uint8_t tx_buf[256];
+
+/* Last event received, and the topic and payload of the last message */
+static struct mqtt_evt last_evt;
+static char topic_buf[128];
+static char payload_buf[256];
+static bool publish_retained;
+
+static void mqtt_evt_handler(struct mqtt_client *const c,
+			     const struct mqtt_evt *evt)
+{
+	last_evt = *evt;
+
+	if (evt->type != MQTT_EVT_PUBLISH) {
+		return;
+	}
+
+	const struct mqtt_publish_param *p = &evt->param.publish;
+	size_t len = MIN(p->message.topic.topic.size, sizeof(topic_buf) - 1);
+
+	memcpy(topic_buf, p->message.topic.topic.utf8, len);
+	topic_buf[len] = '\0';
+	publish_retained = p->retain_flag;
+
+	len = MIN(p->message.payload.len, sizeof(payload_buf) - 1);
+	zassert_equal(mqtt_readall_publish_payload(c, (uint8_t *)payload_buf,
+						   len),
+		      0, "Failed to read payload");
+	payload_buf[len] = '\0';
+
+	if (p->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE) {
+		const struct mqtt_puback_param ack = {
+			.message_id = p->message_id
+		};
+
+		mqtt_publish_qos1_ack(c, &ack);
+	}
+}
+
+/* Process input until an event of the given type is received, and return
+ * the time it took in milliseconds.
+ */
+static int64_t evt_wait(enum mqtt_evt_type type)
+{
+	struct pollfd fds = {
+		.fd = client.transport.tcp.sock,
+		.events = POLLIN
+	};
+	int64_t start = k_uptime_get();
+
+	memset(&last_evt, 0, sizeof(last_evt));
+	last_evt.type = -1;
+
+	while (last_evt.type != type) {
+		int64_t left = start + EVT_TIMEOUT_MS - k_uptime_get();
+
+		zassert_true(left > 0, "Event %d not received", type);
+
+		if (poll(&fds, 1, left) > 0) {
+			zassert_equal(mqtt_input(&client), 0,
+				      "mqtt_input failed");
+		}
+	}
+
+	zassert_equal(last_evt.result, 0, "Event %d failed: %d", type,
+		      last_evt.result);
+
+	return k_uptime_get() - start;
+}
+
+static void publish(const char *topic, const char *payload,
+		    enum mqtt_qos qos, bool retain)
+{
+	struct mqtt_publish_param param = {
+		.message.topic.qos = qos,
+		.message.topic.topic.utf8 = (uint8_t *)topic,
+		.message.topic.topic.size = strlen(topic),
+		.message.payload.data = (uint8_t *)payload,
+		.message.payload.len = strlen(payload),
+		.message_id = k_cycle_get_32() & 0xffff,
+		.retain_flag = retain,
+	};
+
+	if (param.message_id == 0) {
+		param.message_id = 1;
+	}
+
+	zassert_equal(mqtt_publish(&client, &param), 0, "Publish failed");
+}
+
+static void subscribe(const char *filter)
+{
+	struct mqtt_topic topic = {
+		.topic.utf8 = (uint8_t *)filter,
+		.topic.size = strlen(filter),
+		.qos = MQTT_QOS_1_AT_LEAST_ONCE
+	};
+	const struct mqtt_subscription_list list = {
+		.list = &topic,
+		.list_count = 1,
+		.message_id = 1
+	};
+
+	zassert_equal(mqtt_subscribe(&client, &list), 0, "Subscribe failed");
+	evt_wait(MQTT_EVT_SUBACK);
+}
+
+static void test_broker_start(void)
+{
+	struct sockaddr_in *broker4 = (struct sockaddr_in *)&broker;
+
+	zassert_equal(mqtt_broker_sim_start(), 0, "Failed to start broker");
+	zassert_equal(mqtt_broker_sim_start(), -EALREADY,
+		      "Broker started twice");
+
+	broker4->sin_family = AF_INET;
+	broker4->sin_port = htons(CONFIG_MQTT_BROKER_SIM_PORT);
+	inet_pton(AF_INET, "127.0.0.1", &broker4->sin_addr);
+}
+
+/* Connect the client, and wait for CONNACK. */
+static void client_connect(bool clean_session)
+{
+	mqtt_client_init(&client);
+
+	client.broker = &broker;
+	client.evt_cb = mqtt_evt_handler;
+	client.client_id.utf8 = (uint8_t *)"sim-test";
+	client.client_id.size = strlen("sim-test");
+	client.protocol_version = MQTT_VERSION_3_1_1;
+	client.rx_buf = rx_buf;
+	client.rx_buf_size = sizeof(rx_buf);
+	client.tx_buf = tx_buf;
+	client.tx_buf_size = sizeof(tx_buf);
+	client.transport.type = MQTT_TRANSPORT_NON_SECURE;
+	client.clean_session = clean_session;
+
+	zassert_equal(mqtt_connect(&client), 0, "mqtt_connect failed");
+	evt_wait(MQTT_EVT_CONNACK);
+}
+
+static void test_broker_connect(void)
+{
+	struct mqtt_broker_sim_stats stats;
+	uint64_t start;
+	uint32_t elapsed_us;
+
+	start = benchmark_time_ns();
+	client_connect(false);
+	elapsed_us = (benchmark_time_ns() - start) / NSEC_PER_USEC;
+
+	zassert_false(last_evt.param.connack.session_present_flag,
+		      "Session present on first connection");
+
+	mqtt_broker_sim_stats_get(&stats);
+	zassert_equal(stats.connects, 1, "Unexpected connect count %d",
+		      stats.connects);
+
+	TC_PRINT("Connected in %u us\n", elapsed_us);
+}
+
+static void test_broker_retained(void)
+{
+	mqtt_broker_sim_reset();
+
+	publish("sim/retained", "first", MQTT_QOS_0_AT_MOST_ONCE, true);
+	publish("sim/retained", "second", MQTT_QOS_1_AT_LEAST_ONCE, true);
+	evt_wait(MQTT_EVT_PUBACK);
+
+	subscribe("sim/+");
+	evt_wait(MQTT_EVT_PUBLISH);
+
+	zassert_true(strcmp(topic_buf, "sim/retained") == 0,
+		     "Unexpected topic %s", topic_buf);
+	zassert_true(strcmp(payload_buf, "second") == 0,
+		     "Unexpected payload %s", payload_buf);
+	zassert_true(publish_retained, "Retain flag not set");
+
+	/* Messages to established subscriptions are not flagged as retained */
+	publish("sim/echo", "hello", MQTT_QOS_1_AT_LEAST_ONCE, false);
+	evt_wait(MQTT_EVT_PUBLISH);
+
+	zassert_true(strcmp(payload_buf, "hello") == 0,
+		     "Unexpected payload %s", payload_buf);
+	zassert_false(publish_retained, "Retain flag set");
+}
+
+static void test_broker_script(void)
+{
+	struct mqtt_broker_sim_stats stats;
+	int64_t start;
+	int64_t elapsed;
+
+	mqtt_broker_sim_reset();
+	zassert_equal(mqtt_broker_sim_script_set(script, ARRAY_SIZE(script)),
+		      0, "Failed to set script");
+
+	subscribe("$aws/things/sim-device/shadow/#");
+
+	start = k_uptime_get();
+	publish(SHADOW_GET, "", MQTT_QOS_0_AT_MOST_ONCE, false);
+
+	/* The request itself is routed to the subscription */
+	evt_wait(MQTT_EVT_PUBLISH);
+	zassert_true(strcmp(topic_buf, SHADOW_GET) == 0,
+		     "Unexpected topic %s", topic_buf);
+
+	evt_wait(MQTT_EVT_PUBLISH);
+	elapsed = k_uptime_get() - start;
+	zassert_true(strcmp(topic_buf, SHADOW_GET_ACCEPTED) == 0,
+		     "Unexpected topic %s", topic_buf);
+	zassert_true(strcmp(payload_buf, SHADOW_STATE) == 0,
+		     "Unexpected payload %s", payload_buf);
+	zassert_true(elapsed >= SCRIPT_LATENCY_MS - 1,
+		     "Response faster than scripted latency: %lld ms",
+		     elapsed);
+	TC_PRINT("Scripted response in %lld ms\n", elapsed);
+
+	evt_wait(MQTT_EVT_PUBLISH);
+	zassert_true(strcmp(topic_buf, SHADOW_DELTA_TOPIC) == 0,
+		     "Unexpected topic %s", topic_buf);
+	zassert_true(strcmp(payload_buf, SHADOW_DELTA) == 0,
+		     "Unexpected payload %s", payload_buf);
+
+	mqtt_broker_sim_stats_get(&stats);
+	zassert_equal(stats.scripted, 1, "Unexpected script count %d",
+		      stats.scripted);
+	zassert_equal(stats.dropped, 0, "Messages dropped");
+
+	zassert_equal(mqtt_broker_sim_script_set(NULL, 0), 0,
+		      "Failed to clear script");
+}
+
+static void test_broker_publish(void)
+{
+	int64_t elapsed;
+
+	zassert_equal(mqtt_broker_sim_publish("sim/notify", "job", 1, false,
+					      SCRIPT_LATENCY_MS),
+		      0, "Failed to publish");
+
+	elapsed = evt_wait(MQTT_EVT_PUBLISH);
+	zassert_true(strcmp(topic_buf, "sim/notify") == 0,
+		     "Unexpected topic %s", topic_buf);
+	zassert_true(elapsed >= SCRIPT_LATENCY_MS - 1,
+		     "Message sent before its delay: %lld ms", elapsed);
+
+	zassert_equal(mqtt_broker_sim_publish("sim/+", "job", 0, false, 0),
+		      -EINVAL, "Wildcard topic accepted");
+	zassert_equal(mqtt_broker_sim_publish("sim/notify", "job", 2, false,
+					      0),
+		      -EINVAL, "QoS 2 accepted");
+}
+
+static void test_broker_disconnect(void)
+{
+	zassert_equal(mqtt_disconnect(&client), 0, "mqtt_disconnect failed");
+}
+
+static void test_broker_session(void)
+{
+	struct mqtt_broker_sim_stats stats;
+
+	mqtt_broker_sim_reset();
+
+	/* The subscriptions of the previous connection are resumed */
+	client_connect(false);
+	zassert_true(last_evt.param.connack.session_present_flag,
+		     "Session not resumed");
+
+	publish("sim/echo", "resumed", MQTT_QOS_1_AT_LEAST_ONCE, false);
+	evt_wait(MQTT_EVT_PUBLISH);
+	zassert_true(strcmp(payload_buf, "resumed") == 0,
+		     "Unexpected payload %s", payload_buf);
+
+	mqtt_broker_sim_stats_get(&stats);
+	zassert_equal(stats.sessions_resumed, 1, "Unexpected resume count %d",
+		      stats.sessions_resumed);
+	zassert_equal(stats.subscribes, 0, "Unexpected subscribe count %d",
+		      stats.subscribes);
+
+	/* A clean session drops the stored session */
+	zassert_equal(mqtt_disconnect(&client), 0, "mqtt_disconnect failed");
+	client_connect(true);
+	zassert_false(last_evt.param.connack.session_present_flag,
+		      "Session present after clean session");
+	zassert_equal(mqtt_disconnect(&client), 0, "mqtt_disconnect failed");
+
+	client_connect(false);
+	zassert_false(last_evt.param.connack.session_present_flag,
+		      "Clean session stored");
+	zassert_equal(mqtt_disconnect(&client), 0, "mqtt_disconnect failed");
+}
+
+#if defined(CONFIG_CLOUD_API)
+void test_cloud_connect(void);
+void test_cloud_request(void);
+void test_cloud_throughput(void);
+void test_cloud_outbox(void);
+void test_cloud_reconnect(void);
+#else
+static void test_cloud_connect(void)
+{
+	ztest_test_skip();
+}
+
+static void test_cloud_request(void)
+{
+	ztest_test_skip();
+}
+
+static void test_cloud_throughput(void)
+{
+	ztest_test_skip();
+}
+
+static void test_cloud_outbox(void)
+{
+	ztest_test_skip();
+}
+
+static void test_cloud_reconnect(void)
+{
+	ztest_test_skip();
+}
+#endif /* defined(CONFIG_CLOUD_API) */
+
+void test_main(void)
+{
+	ztest_test_suite(mqtt_broker_sim,
+			 ztest_unit_test(test_broker_start),
+			 ztest_unit_test(test_broker_connect),
+			 ztest_unit_test(test_broker_retained),
+			 ztest_unit_test(test_broker_script),
+			 ztest_unit_test(test_broker_publish),
+			 ztest_unit_test(test_broker_disconnect),
+			 ztest_unit_test(test_broker_session),
+			 ztest_unit_test(test_cloud_connect),
+			 ztest_unit_test(test_cloud_request),
+			 ztest_unit_test(test_cloud_throughput),
+			 ztest_unit_test(test_cloud_outbox),
+			 ztest_unit_test(test_cloud_reconnect)
+			 );
+
+	ztest_run_test_suite(mqtt_broker_sim);
+}
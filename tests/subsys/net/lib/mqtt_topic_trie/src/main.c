@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <ztest.h>
+#include <string.h>
+#include <stdio.h>
+#include <net/mqtt_topic_trie.h>
+#include <benchmark.h>
+
+#define THING "$aws/things/nrf-352656100367872"
+#define APP_FILTER_COUNT 32
+#define ITERATIONS 1000
+
+MQTT_TOPIC_TRIE_DEFINE(trie, 160);
+
+static int add(const char *filter, int id)
+{
+	return mqtt_topic_trie_add(&trie, filter, strlen(filter), id);
+}
+
+static int match(const char *topic, struct mqtt_topic_trie_match *m)
+{
+	return mqtt_topic_trie_match(&trie, topic, strlen(topic), m);
+}
+
+static bool capture_equal(const struct mqtt_topic_trie_match *m, size_t i,
+			  const char *str)
+{
+	return i < m->capture_count && m->capture[i].len == strlen(str) &&
+	       !memcmp(m->capture[i].ptr, str, m->capture[i].len);
+}
+
+static void test_literal(void)
+{
+	mqtt_topic_trie_clear(&trie);
+
+	zassert_equal(add("a/b/c", 1), 0, NULL);
+	zassert_equal(add("a/b", 2), 0, NULL);
+	zassert_equal(add("a/bc", 3), 0, NULL);
+	zassert_equal(add("a//c", 4), 0, NULL);
+
+	zassert_equal(match("a/b/c", NULL), 1, NULL);
+	zassert_equal(match("a/b", NULL), 2, NULL);
+	zassert_equal(match("a/bc", NULL), 3, NULL);
+	zassert_equal(match("a//c", NULL), 4, NULL);
+	zassert_equal(match("a", NULL), -ENOENT, NULL);
+	zassert_equal(match("a/b/", NULL), -ENOENT, NULL);
+	zassert_equal(match("a/b/c/d", NULL), -ENOENT, NULL);
+	zassert_equal(match("a/B/c", NULL), -ENOENT, NULL);
+	zassert_equal(match("", NULL), -ENOENT, NULL);
+}
+
+static void test_plus(void)
+{
+	struct mqtt_topic_trie_match m;
+
+	mqtt_topic_trie_clear(&trie);
+
+	zassert_equal(add("devices/+/messages/+", 1), 0, NULL);
+	zassert_equal(add("+", 2), 0, NULL);
+
+	zassert_equal(match("devices/dev-1/messages/events", &m), 1, NULL);
+	zassert_equal(m.capture_count, 2, NULL);
+	zassert_true(capture_equal(&m, 0, "dev-1"), NULL);
+	zassert_true(capture_equal(&m, 1, "events"), NULL);
+
+	/* '+' matches an empty level, but only one level */
+	zassert_equal(match("devices//messages/x", &m), 1, NULL);
+	zassert_true(capture_equal(&m, 0, ""), NULL);
+	zassert_equal(match("devices/a/b/messages/x", &m), -ENOENT, NULL);
+
+	zassert_equal(match("single", &m), 2, NULL);
+	zassert_true(capture_equal(&m, 0, "single"), NULL);
+	zassert_equal(match("two/levels", &m), -ENOENT, NULL);
+}
+
+static void test_hash(void)
+{
+	struct mqtt_topic_trie_match m;
+
+	mqtt_topic_trie_clear(&trie);
+
+	zassert_equal(add("sport/tennis/#", 1), 0, NULL);
+	zassert_equal(add("res/+/#", 2), 0, NULL);
+
+	zassert_equal(match("sport/tennis/player1/ranking", &m), 1, NULL);
+	zassert_true(capture_equal(&m, 0, "player1/ranking"), NULL);
+
+	/* '#' also matches the parent level */
+	zassert_equal(match("sport/tennis", &m), 1, NULL);
+	zassert_true(capture_equal(&m, 0, ""), NULL);
+	zassert_equal(match("sport/tennis/", &m), 1, NULL);
+	zassert_true(capture_equal(&m, 0, ""), NULL);
+	zassert_equal(match("sport", &m), -ENOENT, NULL);
+
+	zassert_equal(match("res/200/?$rid=1&$version=2", &m), 2, NULL);
+	zassert_equal(m.capture_count, 2, NULL);
+	zassert_true(capture_equal(&m, 0, "200"), NULL);
+	zassert_true(capture_equal(&m, 1, "?$rid=1&$version=2"), NULL);
+}
+
+static void test_priority(void)
+{
+	struct mqtt_topic_trie_match m;
+
+	mqtt_topic_trie_clear(&trie);
+
+	zassert_equal(add("a/b/c", 1), 0, NULL);
+	zassert_equal(add("a/+/d", 2), 0, NULL);
+	zassert_equal(add("a/#", 3), 0, NULL);
+
+	zassert_equal(match("a/b/c", &m), 1, NULL);
+	zassert_equal(m.capture_count, 0, NULL);
+
+	/* The literal branch fails at the last level, '+' is tried next */
+	zassert_equal(match("a/b/d", &m), 2, NULL);
+	zassert_equal(m.capture_count, 1, NULL);
+	zassert_true(capture_equal(&m, 0, "b"), NULL);
+
+	/* Captures of the failed '+' branch are dropped */
+	zassert_equal(match("a/b/e", &m), 3, NULL);
+	zassert_equal(m.capture_count, 1, NULL);
+	zassert_true(capture_equal(&m, 0, "b/e"), NULL);
+}
+
+static void test_dollar(void)
+{
+	mqtt_topic_trie_clear(&trie);
+
+	zassert_equal(add("#", 1), 0, NULL);
+	zassert_equal(add("+/monitor/clients", 2), 0, NULL);
+	zassert_equal(add("$SYS/#", 3), 0, NULL);
+
+	zassert_equal(match("$SYS/monitor/clients", NULL), 3, NULL);
+	zassert_equal(match("$aws/things/x", NULL), -ENOENT, NULL);
+	zassert_equal(match("sys/monitor/clients", NULL), 2, NULL);
+	zassert_equal(match("sys/other", NULL), 1, NULL);
+}
+
+static void test_invalid(void)
+{
+	MQTT_TOPIC_TRIE_DEFINE(small, 3);
+
+	mqtt_topic_trie_clear(&trie);
+
+	zassert_equal(add("a/#/b", 1), -EINVAL, NULL);
+	zassert_equal(add("a/b#", 1), -EINVAL, NULL);
+	zassert_equal(add("a/+b", 1), -EINVAL, NULL);
+	zassert_equal(add("a", -1), -EINVAL, NULL);
+	zassert_equal(add("", 1), -EINVAL, NULL);
+	zassert_equal(add("+/+/+/+/+", 1), -EINVAL, NULL);
+	zassert_equal(mqtt_topic_trie_add(&trie, NULL, 1, 1), -EINVAL, NULL);
+
+	zassert_equal(add("a/b", 1), 0, NULL);
+	zassert_equal(add("a/b", 2), -EALREADY, NULL);
+	zassert_equal(match("a/b", NULL), 1, NULL);
+
+	/* A trie that is not cleared first is initialized by the first add */
+	zassert_equal(mqtt_topic_trie_add(&small, "x/y", 3, 1), 0, NULL);
+	zassert_equal(mqtt_topic_trie_add(&small, "z", 1, 2), -ENOMEM, NULL);
+	zassert_equal(mqtt_topic_trie_match(&small, "x/y", 3, NULL), 1, NULL);
+}
+
+static void test_levels(void)
+{
+	char topic[2 * CONFIG_MQTT_TOPIC_TRIE_LEVEL_MAX + 2];
+
+	mqtt_topic_trie_clear(&trie);
+	zassert_equal(add("#", 1), 0, NULL);
+
+	memset(topic, 0, sizeof(topic));
+
+	for (size_t i = 0; i < CONFIG_MQTT_TOPIC_TRIE_LEVEL_MAX; i++) {
+		strcat(topic, i ? "/x" : "x");
+	}
+
+	zassert_equal(match(topic, NULL), 1, NULL);
+
+	strcat(topic, "/x");
+	zassert_equal(match(topic, NULL), -E2BIG, NULL);
+}
+
+static void test_not_terminated(void)
+{
+	const char topic[] = "a/b/c";
+
+	mqtt_topic_trie_clear(&trie);
+	zassert_equal(mqtt_topic_trie_add(&trie, "a/b/cd", 5, 1), 0, NULL);
+
+	zassert_equal(mqtt_topic_trie_match(&trie, topic, 5, NULL), 1, NULL);
+	zassert_equal(mqtt_topic_trie_match(&trie, topic, 3, NULL), -ENOENT,
+		      NULL);
+}
+
+/* Filters of an nRF9160 application connected to AWS IoT, with shadow,
+ * jobs and FOTA topics, and application command topics.
+ */
+static const char *const filters[] = {
+	THING "/shadow/get/accepted",
+	THING "/shadow/get/rejected",
+	THING "/shadow/update/accepted",
+	THING "/shadow/update/rejected",
+	THING "/shadow/update/delta",
+	THING "/shadow/delete/accepted",
+	THING "/shadow/delete/rejected",
+	THING "/jobs/notify-next",
+	THING "/jobs/$next/get/accepted",
+	THING "/jobs/+/get/accepted",
+	THING "/jobs/+/get/rejected",
+	THING "/jobs/+/update/accepted",
+	THING "/jobs/+/update/rejected",
+	"nrf-352656100367872/shadow/get/accepted",
+	"prod/a0b1c2d3-e4f5/m/d/nrf-352656100367872/+",
+	"$iothub/twin/res/+/#",
+	"$iothub/methods/POST/+/#",
+};
+
+static const char *const topics[] = {
+	THING "/shadow/update/delta",
+	THING "/jobs/notify-next",
+	THING "/jobs/fota-1234/get/accepted",
+	"prod/a0b1c2d3-e4f5/m/d/nrf-352656100367872/c2d",
+	"$iothub/twin/res/200/?$rid=738&$version=135",
+	"app/sensor31/device-7/cmd",
+	THING "/shadow/name/other/get/accepted",
+};
+
+static char app_filters[APP_FILTER_COUNT][32];
+
+/* Reference matcher, comparing the topic with each filter in turn */
+static bool filter_match(const char *filter, const char *topic)
+{
+	while (*filter && *topic) {
+		if (*filter == '#') {
+			return true;
+		} else if (*filter == '+') {
+			while (*topic && *topic != '/') {
+				topic++;
+			}
+			filter++;
+		} else if (*filter++ != *topic++) {
+			return false;
+		}
+	}
+
+	return *filter == '\0' && *topic == '\0';
+}
+
+static int linear_match(const char *topic)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(filters); i++) {
+		if (filter_match(filters[i], topic)) {
+			return i;
+		}
+	}
+
+	for (size_t i = 0; i < APP_FILTER_COUNT; i++) {
+		if (filter_match(app_filters[i], topic)) {
+			return ARRAY_SIZE(filters) + i;
+		}
+	}
+
+	return -ENOENT;
+}
+
+static void test_benchmark(void)
+{
+	struct mqtt_topic_trie_match m;
+	uint32_t linear_ns;
+	uint32_t trie_ns;
+	uint64_t start;
+	int id;
+
+	mqtt_topic_trie_clear(&trie);
+
+	for (size_t i = 0; i < ARRAY_SIZE(filters); i++) {
+		zassert_equal(add(filters[i], i), 0, NULL);
+	}
+
+	for (size_t i = 0; i < APP_FILTER_COUNT; i++) {
+		snprintf(app_filters[i], sizeof(app_filters[i]),
+			 "app/sensor%02d/+/cmd", (int)i);
+		zassert_equal(add(app_filters[i], ARRAY_SIZE(filters) + i), 0,
+			      NULL);
+	}
+
+	TC_PRINT("%zu filters in %u nodes\n",
+		 ARRAY_SIZE(filters) + APP_FILTER_COUNT, trie.node_count);
+
+	for (size_t i = 0; i < ARRAY_SIZE(topics); i++) {
+		zassert_equal(match(topics[i], &m), linear_match(topics[i]),
+			      "Mismatch for %s", topics[i]);
+	}
+
+	zassert_equal(match(topics[2], &m), 9, NULL);
+	zassert_true(capture_equal(&m, 0, "fota-1234"), NULL);
+
+	start = benchmark_time_ns();
+
+	for (int i = 0; i < ITERATIONS; i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(topics); j++) {
+			id = linear_match(topics[j]);
+		}
+	}
+
+	linear_ns = (benchmark_time_ns() - start) /
+		    (ITERATIONS * ARRAY_SIZE(topics));
+
+	start = benchmark_time_ns();
+
+	for (int i = 0; i < ITERATIONS; i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(topics); j++) {
+			id = match(topics[j], &m);
+		}
+	}
+
+	trie_ns = (benchmark_time_ns() - start) /
+		  (ITERATIONS * ARRAY_SIZE(topics));
+
+	ARG_UNUSED(id);
+
+	TC_PRINT("ns per topic: filter list %u, trie %u\n", linear_ns,
+		 trie_ns);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(mqtt_topic_trie,
+			 ztest_unit_test(test_literal),
+			 ztest_unit_test(test_plus),
+			 ztest_unit_test(test_hash),
+			 ztest_unit_test(test_priority),
+			 ztest_unit_test(test_dollar),
+			 ztest_unit_test(test_invalid),
+			 ztest_unit_test(test_levels),
+			 ztest_unit_test(test_not_terminated),
+			 ztest_unit_test(test_benchmark)
+			 );
+
+	ztest_run_test_suite(mqtt_topic_trie);
+}
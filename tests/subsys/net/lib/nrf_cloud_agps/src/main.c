@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <sys/byteorder.h>
+#include <nrf_socket.h>
+#include <modem/modem_info.h>
+#include <net/nrf_cloud_agps.h>
+
+#include "nrf_cloud_transport.h"
+#include "nrf_cloud_agps_schema_v1.h"
+
+#define ELEMENTS_MAX 32
+#define RANDOM_RUNS 200
+#define RANDOM_CHUNK_MAX 64
+
+/* Size of a system clock element, without the TOW array */
+#define SYS_CLOCK_SIZE 16
+
+/* Element sent to the modem */
+struct injected {
+	nrf_gnss_agps_data_type_t type;
+	size_t len;
+	/* The largest of the A-GPS data types of the modem */
+	uint8_t data[sizeof(nrf_gnss_agps_data_system_time_and_sv_tow_t)];
+};
+
+static const int sock = 1;
+
+/* A-GPS response in the binary format of schema version 1 */
+static uint8_t blob[1024];
+static size_t blob_len;
+static size_t sys_clock_offset;
+static size_t tows_offset;
+
+/* Elements injected by the one-shot processing, and by the stream */
+static struct injected expected[ELEMENTS_MAX];
+static size_t expected_count;
+static struct injected injected[ELEMENTS_MAX];
+static size_t injected_count;
+
+static uint32_t rand_state;
+
+/* Stubs of the modem and nRF Cloud interfaces */
+ssize_t nrf_sendto(int socket, const void *message, size_t length, int flags,
+		   const void *dest_addr, nrf_socklen_t dest_len)
+{
+	struct injected *element = &injected[injected_count];
+
+	zassert_equal(socket, sock, "Wrong socket");
+	zassert_true(injected_count < ELEMENTS_MAX, "Too many elements");
+	zassert_true(length <= sizeof(element->data), "Element too large");
+	zassert_equal(dest_len, sizeof(element->type), NULL);
+
+	element->type = *(const nrf_gnss_agps_data_type_t *)dest_addr;
+	element->len = length;
+	memcpy(element->data, message, length);
+	injected_count++;
+
+	return length;
+}
+
+void agps_print(enum nrf_cloud_agps_type type, void *data)
+{
+}
+
+int modem_info_init(void)
+{
+	return 0;
+}
+
+int modem_info_params_init(struct modem_param_info *modem)
+{
+	return 0;
+}
+
+int modem_info_params_get(struct modem_param_info *modem)
+{
+	return 0;
+}
+
+int nct_dc_send(const struct nct_dc_data *dc)
+{
+	return 0;
+}
+
+static uint32_t rand_get(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+
+	return rand_state >> 16;
+}
+
+/* Add the elements of a type, and return the offset of the first one */
+static size_t blob_add(enum nrf_cloud_agps_type type, uint16_t count,
+		       size_t size)
+{
+	size_t first;
+
+	blob[blob_len] = type;
+	sys_put_le16(count, &blob[blob_len + NRF_CLOUD_AGPS_BIN_COUNT_OFFSET]);
+	blob_len += NRF_CLOUD_AGPS_BIN_TYPE_SIZE +
+		    NRF_CLOUD_AGPS_BIN_COUNT_SIZE;
+	first = blob_len;
+
+	for (uint16_t i = 0; i < count; i++) {
+		for (size_t j = 0; j < size; j++) {
+			blob[blob_len + j] = rand_get();
+		}
+
+		/* The TOW of satellites 1, 6, 11... */
+		if (type == NRF_CLOUD_AGPS_GPS_TOWS) {
+			blob[blob_len] = 1 + 5 * i;
+		}
+
+		blob_len += size;
+	}
+
+	zassert_true(blob_len <= sizeof(blob), "Blob too large");
+
+	return first;
+}
+
+static void blob_create(void)
+{
+	rand_state = 1;
+	blob_len = 0;
+
+	blob[blob_len++] = NRF_CLOUD_AGPS_BIN_SCHEMA_VERSION;
+
+	blob_add(NRF_CLOUD_AGPS_UTC_PARAMETERS, 1,
+		 sizeof(struct nrf_cloud_agps_utc));
+	blob_add(NRF_CLOUD_AGPS_EPHEMERIDES, 4,
+		 sizeof(struct nrf_cloud_agps_ephemeris));
+	blob_add(NRF_CLOUD_AGPS_ALMANAC, 3,
+		 sizeof(struct nrf_cloud_agps_almanac));
+	blob_add(NRF_CLOUD_AGPS_KLOBUCHAR_CORRECTION, 1,
+		 sizeof(struct nrf_cloud_agps_klobuchar));
+	sys_clock_offset = blob_add(NRF_CLOUD_AGPS_GPS_SYSTEM_CLOCK, 1,
+				    SYS_CLOCK_SIZE);
+	tows_offset = blob_add(NRF_CLOUD_AGPS_GPS_TOWS, 4,
+			       sizeof(struct nrf_cloud_agps_tow_element));
+	blob_add(NRF_CLOUD_AGPS_LOCATION, 1,
+		 sizeof(struct nrf_cloud_agps_location));
+	blob_add(NRF_CLOUD_AGPS_INTEGRITY, 1,
+		 sizeof(struct nrf_cloud_agps_integrity));
+
+	/* The mask of the satellites which have a TOW element */
+	sys_put_le32(BIT(0) | BIT(5) | BIT(10) | BIT(15),
+		     &blob[sys_clock_offset +
+			   offsetof(struct nrf_cloud_agps_system_time,
+				    sv_mask)]);
+}
+
+static void injected_check(void)
+{
+	zassert_equal(injected_count, expected_count,
+		      "%d elements injected, %d expected",
+		      injected_count, expected_count);
+
+	for (size_t i = 0; i < expected_count; i++) {
+		zassert_equal(injected[i].type, expected[i].type,
+			      "Element %d type %d", i, injected[i].type);
+		zassert_equal(injected[i].len, expected[i].len,
+			      "Element %d length %d", i, injected[i].len);
+		zassert_mem_equal(injected[i].data, expected[i].data,
+				  expected[i].len, "Element %d differs", i);
+	}
+}
+
+/* Process the blob in chunks of the given sizes, repeated as needed */
+static void stream_check(const size_t *sizes, size_t count)
+{
+	size_t pos = 0;
+	size_t len;
+	int err;
+
+	injected_count = 0;
+
+	err = nrf_cloud_agps_stream_init(&sock);
+	zassert_equal(err, 0, "Init failed, err %d", err);
+
+	for (size_t i = 0; pos < blob_len; i++) {
+		len = MIN(sizes[i % count], blob_len - pos);
+
+		err = nrf_cloud_agps_stream_process(&blob[pos], len);
+		zassert_equal(err, 0, "Processing failed at %d, err %d",
+			      pos, err);
+		pos += len;
+	}
+
+	err = nrf_cloud_agps_stream_finish();
+	zassert_equal(err, 0, "Finish failed, err %d", err);
+
+	injected_check();
+}
+
+static void test_one_shot(void)
+{
+	const nrf_gnss_agps_data_system_time_and_sv_tow_t *sys_time = NULL;
+	const uint8_t *tow;
+	int err;
+
+	blob_create();
+
+	injected_count = 0;
+	err = nrf_cloud_agps_process(blob, blob_len, &sock);
+	zassert_equal(err, 0, "Processing failed, err %d", err);
+
+	/* The TOWs are injected with the system time, at the end */
+	zassert_equal(injected_count, 1 + 4 + 3 + 1 + 1 + 1 + 1,
+		      "%d elements injected", injected_count);
+
+	memcpy(expected, injected, sizeof(expected));
+	expected_count = injected_count;
+
+	for (size_t i = 0; i < expected_count; i++) {
+		if (expected[i].type ==
+		    NRF_GNSS_AGPS_GPS_SYSTEM_CLOCK_AND_TOWS) {
+			sys_time = (const void *)expected[i].data;
+		}
+	}
+
+	zassert_not_null(sys_time, "System time not injected");
+	zassert_equal(expected[expected_count - 1].type,
+		      NRF_GNSS_AGPS_GPS_SYSTEM_CLOCK_AND_TOWS,
+		      "System time not injected last");
+
+	/* The second TOW element, of satellite 6 */
+	tow = &blob[tows_offset + sizeof(struct nrf_cloud_agps_tow_element)];
+	zassert_equal(sys_time->sv_mask, 0x8421, "SV mask 0x%x",
+		      sys_time->sv_mask);
+	zassert_equal(sys_time->sv_tow[5].tlm, sys_get_le16(&tow[1]),
+		      "TOW not copied");
+}
+
+static void test_byte_split(void)
+{
+	const size_t sizes[] = { 1 };
+
+	stream_check(sizes, ARRAY_SIZE(sizes));
+}
+
+static void test_two_parts(void)
+{
+	size_t sizes[2];
+
+	/* Split at every byte, across the version, header
+	 * and element boundaries.
+	 */
+	for (size_t split = 1; split < blob_len; split++) {
+		sizes[0] = split;
+		sizes[1] = blob_len - split;
+
+		stream_check(sizes, ARRAY_SIZE(sizes));
+	}
+}
+
+static void test_random_split(void)
+{
+	size_t sizes[256];
+
+	rand_state = 2;
+
+	for (int run = 0; run < RANDOM_RUNS; run++) {
+		for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+			/* Single bytes are frequent */
+			if (rand_get() % 4 == 0) {
+				sizes[i] = 1;
+			} else {
+				sizes[i] = 1 + rand_get() % RANDOM_CHUNK_MAX;
+			}
+		}
+
+		stream_check(sizes, ARRAY_SIZE(sizes));
+	}
+}
+
+static void test_truncated(void)
+{
+	int err;
+
+	injected_count = 0;
+
+	zassert_equal(nrf_cloud_agps_stream_init(&sock), 0, NULL);
+	zassert_equal(nrf_cloud_agps_stream_process(blob, blob_len - 1), 0,
+		      NULL);
+
+	err = nrf_cloud_agps_stream_finish();
+	zassert_equal(err, -ENODATA, "Truncated data accepted, err %d", err);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(lib_nrf_cloud_agps,
+			 ztest_unit_test(test_one_shot),
+			 ztest_unit_test(test_byte_split),
+			 ztest_unit_test(test_two_parts),
+			 ztest_unit_test(test_random_split),
+			 ztest_unit_test(test_truncated)
+			 );
+
+	ztest_run_test_suite(lib_nrf_cloud_agps);
+}
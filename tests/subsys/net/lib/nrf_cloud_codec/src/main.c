@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <ztest.h>
+#include <string.h>
+#include <benchmark.h>
+#include <json_tok.h>
+#include "nrf_cloud_codec.h"
+#include "cJSON.h"
+#include "cJSON_os.h"
+
+#define MSG_COUNT 1000
+
+#define D2C_TOPIC "prod/a0b1c2d3/m/d/nrf-352656100367872/d2c"
+#define C2D_TOPIC "prod/a0b1c2d3/m/d/nrf-352656100367872/c2d"
+#define TOPIC_PREFIX "prod/a0b1c2d3/"
+
+#define GPS_NMEA \
+	"$GPGGA,085634.00,6325.30562,N,01023.57853,E,1,07,1.30,52.5,M," \
+	"39.8,M,,*6A"
+
+/* Not sent as is, but checks that strings are escaped the same way */
+#define FLIP_ESCAPED "\"UPSIDE\\DOWN\"\n\t\x01"
+
+/* Device information reported by the asset tracker on a Thingy:91 */
+#define DEVICE_INFO \
+	"{\"networkInfo\":{\"currentBand\":20,\"supportedBands\":\"(2,3,4," \
+	"8,12,13,20,25,26,28,66)\",\"areaCode\":2305,\"mccmnc\":\"24201\"," \
+	"\"ipAddress\":\"10.160.33.51\",\"ueMode\":2,\"cellID\":33703719," \
+	"\"networkMode\":\"LTE-M\"},\"simInfo\":{\"uiccMode\":0," \
+	"\"iccid\":\"89450421180216216095\",\"imsi\":\"204080813516891\"}," \
+	"\"deviceInfo\":{\"modemFirmware\":\"mfw_nrf9160_1.2.0\"," \
+	"\"batteryVoltage\":4370,\"imei\":\"352656100367872\"," \
+	"\"board\":\"thingy91_nrf9160\",\"appVersion\":\"v1.3.0\"}}"
+
+/* Shadow received on the accepted topic once the device is paired. It has
+ * more tokens than fit on the stack.
+ */
+#define FULL_SHADOW \
+	"{\"desired\":{\"pairing\":{\"state\":\"paired\"," \
+	"\"topics\":{\"d2c\":\"prod/a0b1c2d3/m/d/nrf-352656100367872/d2c\"," \
+	"\"c2d\":\"prod/a0b1c2d3/m/d/nrf-352656100367872/c2d\"}}," \
+	"\"nrfcloud_mqtt_topic_prefix\":\"prod/a0b1c2d3/\"," \
+	"\"config\":{\"act\":false,\"actwt\":60,\"mot\":3,\"gpst\":60," \
+	"\"celt\":600,\"acct\":1,\"cfgv\":5}}," \
+	"\"reported\":{\"pairing\":{\"state\":\"paired\"," \
+	"\"topics\":{\"d2c\":\"prod/a0b1c2d3/m/d/nrf-352656100367872/d2c\"," \
+	"\"c2d\":\"prod/a0b1c2d3/m/d/nrf-352656100367872/c2d\"}}," \
+	"\"nrfcloud_mqtt_topic_prefix\":\"prod/a0b1c2d3/\"," \
+	"\"config\":{\"act\":false,\"actwt\":60,\"mot\":3,\"gpst\":60," \
+	"\"celt\":600,\"acct\":1,\"cfgv\":5}," \
+	"\"device\":{\"networkInfo\":{\"currentBand\":20," \
+	"\"supportedBands\":\"(2,3,4,8,12,13,20,25,26,28,66)\"," \
+	"\"areaCode\":2305,\"mccmnc\":\"24201\"," \
+	"\"ipAddress\":\"10.160.33.51\",\"ueMode\":2,\"cellID\":33703719," \
+	"\"networkMode\":\"LTE-M\"},\"simInfo\":{\"uiccMode\":0," \
+	"\"iccid\":\"89450421180216216095\",\"imsi\":\"204080813516891\"}," \
+	"\"deviceInfo\":{\"modemFirmware\":\"mfw_nrf9160_1.2.0\"," \
+	"\"batteryVoltage\":4370,\"imei\":\"352656100367872\"," \
+	"\"board\":\"thingy91_nrf9160\",\"appVersion\":\"v1.3.0\"}," \
+	"\"serviceInfo\":{\"ui\":[\"GPS\",\"FLIP\",\"TEMP\",\"HUMID\"," \
+	"\"AIR_PRESS\",\"RSRP\",\"BUTTON\"],\"fota_v1\":[\"APP\"," \
+	"\"MODEM\"]}}}," \
+	"\"metadata\":{\"reported\":{\"config\":" \
+	"{\"act\":{\"timestamp\":1593088496}," \
+	"\"actwt\":{\"timestamp\":1593088496}," \
+	"\"mot\":{\"timestamp\":1593088496}," \
+	"\"gpst\":{\"timestamp\":1593088496}," \
+	"\"celt\":{\"timestamp\":1593088496}," \
+	"\"acct\":{\"timestamp\":1593088496}," \
+	"\"cfgv\":{\"timestamp\":1593088496}}," \
+	"\"device\":{\"simInfo\":{\"uiccMode\":{\"timestamp\":1593088496}," \
+	"\"iccid\":{\"timestamp\":1593088496}," \
+	"\"imsi\":{\"timestamp\":1593088496}}," \
+	"\"deviceInfo\":{\"modemFirmware\":{\"timestamp\":1593088496}," \
+	"\"batteryVoltage\":{\"timestamp\":1593088496}," \
+	"\"imei\":{\"timestamp\":1593088496}," \
+	"\"board\":{\"timestamp\":1593088496}," \
+	"\"appVersion\":{\"timestamp\":1593088496}}," \
+	"\"serviceInfo\":{\"ui\":[{\"timestamp\":1593088496}," \
+	"{\"timestamp\":1593088496},{\"timestamp\":1593088496}," \
+	"{\"timestamp\":1593088496},{\"timestamp\":1593088496}," \
+	"{\"timestamp\":1593088496},{\"timestamp\":1593088496}]," \
+	"\"fota_v1\":[{\"timestamp\":1593088496}," \
+	"{\"timestamp\":1593088496}]}}}},\"version\":126," \
+	"\"timestamp\":1593088496}"
+
+static const char *const sensor_type_str[] = {
+	[NRF_CLOUD_SENSOR_GPS] = "GPS",
+	[NRF_CLOUD_SENSOR_FLIP] = "FLIP",
+	[NRF_CLOUD_SENSOR_TEMP] = "TEMP",
+	[NRF_CLOUD_DEVICE_INFO] = "DEVICE",
+};
+
+static struct nrf_cloud_data tx_endp = {
+	.ptr = D2C_TOPIC,
+	.len = sizeof(D2C_TOPIC) - 1,
+};
+static struct nrf_cloud_data rx_endp = {
+	.ptr = C2D_TOPIC,
+	.len = sizeof(C2D_TOPIC) - 1,
+};
+static struct nrf_cloud_data m_endp = {
+	.ptr = TOPIC_PREFIX,
+	.len = sizeof(TOPIC_PREFIX) - 1,
+};
+
+/* Heap operations of both encoders, counted by wrapping the kernel heap
+ * when linking.
+ */
+static uint32_t heap_ops;
+
+void *__real_k_malloc(size_t size);
+void __real_k_free(void *ptr);
+
+void *__wrap_k_malloc(size_t size)
+{
+	heap_ops++;
+	return __real_k_malloc(size);
+}
+
+void __wrap_k_free(void *ptr)
+{
+	if (ptr != NULL) {
+		heap_ops++;
+	}
+	__real_k_free(ptr);
+}
+
+/* Mock of the transport, which keeps the endpoints after pairing */
+void nct_dc_endpoint_get(struct nrf_cloud_data *tx_endpoint,
+			 struct nrf_cloud_data *rx_endpoint,
+			 struct nrf_cloud_data *m_endpoint)
+{
+	*tx_endpoint = tx_endp;
+	*rx_endpoint = rx_endp;
+	*m_endpoint = m_endp;
+}
+
+/* The cJSON encoders replaced by the JSON writer, which give the expected
+ * output.
+ */
+static char *ref_sensor_data(const struct nrf_cloud_sensor_data *sensor)
+{
+	char *out;
+	cJSON *root = cJSON_CreateObject();
+
+	cJSON_AddItemToObject(root, "appId",
+			      cJSON_CreateString(sensor_type_str[sensor->type]));
+	cJSON_AddItemToObject(root, "data",
+			      cJSON_CreateString(sensor->data.ptr));
+	cJSON_AddItemToObject(root, "messageType", cJSON_CreateString("DATA"));
+
+	out = cJSON_PrintUnformatted(root);
+	cJSON_Delete(root);
+
+	return out;
+}
+
+static char *ref_shadow_data(const struct nrf_cloud_sensor_data *sensor)
+{
+	char *out;
+	cJSON *root = cJSON_CreateObject();
+	cJSON *state = cJSON_CreateObject();
+	cJSON *reported = cJSON_CreateObject();
+
+	cJSON_AddItemToObject(reported, sensor_type_str[sensor->type],
+			      (cJSON *)sensor->data.ptr);
+	cJSON_AddItemToObject(state, "reported", reported);
+	cJSON_AddItemToObject(root, "state", state);
+
+	out = cJSON_PrintUnformatted(root);
+	cJSON_Delete(root);
+
+	return out;
+}
+
+static char *ref_state(uint32_t reported_state)
+{
+	char *out;
+	cJSON *root = cJSON_CreateObject();
+	cJSON *state = cJSON_CreateObject();
+	cJSON *reported = cJSON_CreateObject();
+	cJSON *pairing = cJSON_CreateObject();
+	cJSON *connection = cJSON_CreateObject();
+
+	if (reported_state == STATE_UA_PIN_WAIT) {
+		cJSON_AddItemToObject(pairing, "state",
+				      cJSON_CreateString("not_associated"));
+		cJSON_AddItemToObject(pairing, "topics", cJSON_CreateNull());
+		cJSON_AddItemToObject(pairing, "config", cJSON_CreateNull());
+		cJSON_AddItemToObject(reported, "stage", cJSON_CreateNull());
+		cJSON_AddItemToObject(reported, "nrfcloud_mqtt_topic_prefix",
+				      cJSON_CreateNull());
+		cJSON_AddItemToObject(connection, "keepalive",
+				      cJSON_CreateNull());
+	} else {
+		cJSON *topics = cJSON_CreateObject();
+
+		cJSON_AddItemToObject(reported, "nrfcloud_mqtt_topic_prefix",
+				      cJSON_CreateString(m_endp.ptr));
+		cJSON_AddItemToObject(pairing, "state",
+				      cJSON_CreateString("paired"));
+		cJSON_AddItemToObject(pairing, "config", cJSON_CreateNull());
+		cJSON_AddItemToObject(reported, "pairingStatus",
+				      cJSON_CreateNull());
+		cJSON_AddNumberToObject(connection, "keepalive",
+					CONFIG_MQTT_KEEPALIVE);
+		cJSON_AddItemToObject(topics, "d2c",
+				      cJSON_CreateString(tx_endp.ptr));
+		cJSON_AddItemToObject(topics, "c2d",
+				      cJSON_CreateString(rx_endp.ptr));
+		cJSON_AddItemToObject(pairing, "topics", topics);
+	}
+
+	cJSON_AddItemToObject(reported, "pairing", pairing);
+	cJSON_AddItemToObject(reported, "connection", connection);
+	cJSON_AddItemToObject(state, "reported", reported);
+	cJSON_AddItemToObject(root, "state", state);
+
+	out = cJSON_PrintUnformatted(root);
+	cJSON_Delete(root);
+
+	return out;
+}
+
+/* The messages sent by the asset tracker: sensor data, a shadow update
+ * with the device information and the state reports of the pairing.
+ */
+static const struct nrf_cloud_sensor_data temp = {
+	.type = NRF_CLOUD_SENSOR_TEMP,
+	.data = { .ptr = "24.5", .len = 4 },
+};
+
+static const struct nrf_cloud_sensor_data gps = {
+	.type = NRF_CLOUD_SENSOR_GPS,
+	.data = { .ptr = GPS_NMEA, .len = sizeof(GPS_NMEA) - 1 },
+};
+
+static const struct nrf_cloud_sensor_data flip = {
+	.type = NRF_CLOUD_SENSOR_FLIP,
+	.data = { .ptr = FLIP_ESCAPED, .len = sizeof(FLIP_ESCAPED) - 1 },
+};
+
+static char *temp_ref(void)
+{
+	return ref_sensor_data(&temp);
+}
+
+static int temp_encode(struct nrf_cloud_data *output)
+{
+	return nrf_cloud_encode_sensor_data(&temp, output);
+}
+
+static char *gps_ref(void)
+{
+	return ref_sensor_data(&gps);
+}
+
+static int gps_encode(struct nrf_cloud_data *output)
+{
+	return nrf_cloud_encode_sensor_data(&gps, output);
+}
+
+static char *flip_ref(void)
+{
+	return ref_sensor_data(&flip);
+}
+
+static int flip_encode(struct nrf_cloud_data *output)
+{
+	return nrf_cloud_encode_sensor_data(&flip, output);
+}
+
+/* The shadow data is consumed by both encoders, so it is parsed for each
+ * message.
+ */
+static char *device_ref(void)
+{
+	const struct nrf_cloud_sensor_data device = {
+		.type = NRF_CLOUD_DEVICE_INFO,
+		.data = {
+			.ptr = cJSON_Parse(DEVICE_INFO),
+			.len = sizeof(cJSON),
+		},
+	};
+
+	return device.data.ptr ? ref_shadow_data(&device) : NULL;
+}
+
+static int device_encode(struct nrf_cloud_data *output)
+{
+	const struct nrf_cloud_sensor_data device = {
+		.type = NRF_CLOUD_DEVICE_INFO,
+		.data = {
+			.ptr = cJSON_Parse(DEVICE_INFO),
+			.len = sizeof(cJSON),
+		},
+	};
+
+	if (device.data.ptr == NULL) {
+		return -ENOMEM;
+	}
+
+	return nrf_cloud_encode_shadow_data(&device, output);
+}
+
+static char *pin_wait_ref(void)
+{
+	return ref_state(STATE_UA_PIN_WAIT);
+}
+
+static int pin_wait_encode(struct nrf_cloud_data *output)
+{
+	return nrf_cloud_encode_state(STATE_UA_PIN_WAIT, output);
+}
+
+static char *paired_ref(void)
+{
+	return ref_state(STATE_UA_PIN_COMPLETE);
+}
+
+static int paired_encode(struct nrf_cloud_data *output)
+{
+	return nrf_cloud_encode_state(STATE_UA_PIN_COMPLETE, output);
+}
+
+static const struct message {
+	const char *name;
+	char *(*ref)(void);
+	int (*encode)(struct nrf_cloud_data *output);
+} messages[] = {
+	{ "Temperature", temp_ref, temp_encode },
+	{ "GPS", gps_ref, gps_encode },
+	{ "Flip", flip_ref, flip_encode },
+	{ "Device information", device_ref, device_encode },
+	{ "Pairing", pin_wait_ref, pin_wait_encode },
+	{ "Paired", paired_ref, paired_encode },
+};
+
+static void test_messages(void)
+{
+	int err;
+	char *expected;
+	struct nrf_cloud_data output;
+
+	for (size_t i = 0; i < ARRAY_SIZE(messages); i++) {
+		expected = messages[i].ref();
+		zassert_not_null(expected, "%s: cJSON failed",
+				 messages[i].name);
+
+		err = messages[i].encode(&output);
+		zassert_equal(err, 0, "%s: encoding failed: %d",
+			      messages[i].name, err);
+
+		/* Byte for byte, without the terminating null character */
+		zassert_equal(output.len, strlen(expected),
+			      "%s: wrong length %d", messages[i].name,
+			      output.len);
+		zassert_true(memcmp(output.ptr, expected, output.len) == 0,
+			     "%s: unexpected output %s", messages[i].name,
+			     (const char *)output.ptr);
+
+		cJSON_FreeString(expected);
+		k_free((void *)output.ptr);
+	}
+}
+
+static void test_state_errors(void)
+{
+	int err;
+	struct nrf_cloud_data output = { 0 };
+	struct nrf_cloud_data prefix = m_endp;
+
+	err = nrf_cloud_encode_state(STATE_UA_PIN_COMPLETE + 1, &output);
+	zassert_equal(err, -ENOTSUP, "Unknown state encoded");
+
+	/* Endpoints are not known before the pairing has completed */
+	m_endp.ptr = NULL;
+	m_endp.len = 0;
+	heap_ops = 0;
+
+	err = nrf_cloud_encode_state(STATE_UA_PIN_COMPLETE, &output);
+
+	m_endp = prefix;
+
+	zassert_equal(err, -EINVAL, "Missing topic prefix encoded");
+	zassert_is_null(output.ptr, "Output set on error");
+	zassert_equal(heap_ops, 0, "Heap used on error");
+}
+
+static void endpoint_check(struct nrf_cloud_data *endpoint,
+			   const char *expected)
+{
+	zassert_equal(endpoint->len, strlen(expected), "Wrong length %d",
+		      endpoint->len);
+	zassert_true(strcmp(endpoint->ptr, expected) == 0,
+		     "Unexpected endpoint %s", (const char *)endpoint->ptr);
+
+	k_free((void *)endpoint->ptr);
+}
+
+static void test_full_shadow(void)
+{
+	int err;
+	enum nfsm_state state;
+	struct nrf_cloud_data tx;
+	struct nrf_cloud_data rx;
+	struct nrf_cloud_data endpoint;
+	const struct nrf_cloud_data input = {
+		.ptr = FULL_SHADOW,
+		.len = sizeof(FULL_SHADOW) - 1,
+	};
+
+	zassert_true(json_tok_parse(input.ptr, input.len, NULL, 0) >
+		     CONFIG_NRF_CLOUD_JSON_TOKENS, "Shadow fits the stack");
+
+	heap_ops = 0;
+	err = nrf_cloud_decode_requested_state(&input, &state);
+	zassert_equal(err, 0, "Decoding failed: %d", err);
+	zassert_equal(state, STATE_UA_PIN_COMPLETE, "Wrong state %d", state);
+	zassert_equal(heap_ops, 2, "Tokens not allocated once and released");
+
+	err = nrf_cloud_decode_data_endpoint(&input, &tx, &rx, &endpoint);
+	zassert_equal(err, 0, "Decoding failed: %d", err);
+	endpoint_check(&tx, D2C_TOPIC);
+	endpoint_check(&rx, C2D_TOPIC);
+	endpoint_check(&endpoint, TOPIC_PREFIX);
+}
+
+static void test_benchmark(void)
+{
+	int err;
+	char *out;
+	uint64_t start;
+	uint32_t ref_ns;
+	uint32_t ref_ops;
+	uint32_t encode_ns;
+	uint32_t encode_ops;
+	struct nrf_cloud_data output;
+
+	for (size_t i = 0; i < ARRAY_SIZE(messages); i++) {
+		heap_ops = 0;
+		start = benchmark_time_ns();
+
+		for (int j = 0; j < MSG_COUNT; j++) {
+			out = messages[i].ref();
+			zassert_not_null(out, "cJSON failed");
+			cJSON_FreeString(out);
+		}
+
+		ref_ns = (benchmark_time_ns() - start) / MSG_COUNT;
+		ref_ops = heap_ops / MSG_COUNT;
+
+		heap_ops = 0;
+		start = benchmark_time_ns();
+
+		for (int j = 0; j < MSG_COUNT; j++) {
+			err = messages[i].encode(&output);
+			zassert_equal(err, 0, "Encoding failed: %d", err);
+			k_free((void *)output.ptr);
+		}
+
+		encode_ns = (benchmark_time_ns() - start) / MSG_COUNT;
+		encode_ops = heap_ops / MSG_COUNT;
+
+		TC_PRINT("%s (%d bytes): cJSON %d heap operations, %d ns, "
+			 "writer %d heap operations, %d ns per message\n",
+			 messages[i].name, output.len, ref_ops, ref_ns,
+			 encode_ops, encode_ns);
+	}
+}
+
+void test_main(void)
+{
+	nrf_codec_init();
+
+	ztest_test_suite(nrf_cloud_codec_test,
+			 ztest_unit_test(test_messages),
+			 ztest_unit_test(test_state_errors),
+			 ztest_unit_test(test_full_shadow),
+			 ztest_unit_test(test_benchmark)
+			 );
+
+	ztest_run_test_suite(nrf_cloud_codec_test);
+}
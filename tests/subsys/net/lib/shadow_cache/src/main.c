@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <ztest.h>
+#include <string.h>
+#include <stdio.h>
+#include <net/shadow_cache.h>
+
+#define REPORT_FMT \
+	"{\"state\":{\"reported\":{" \
+	"\"device\":{\"networkInfo\":{\"rsrp\":%d,\"areaCode\":%d," \
+	"\"cellID\":%d},\"simInfo\":{\"iccid\":\"89450421180216216095\"}," \
+	"\"serviceInfo\":{\"ui\":[\"GPS\",\"FLIP\",\"TEMP\"]," \
+	"\"fota_v1\":[\"APP\",\"MODEM\"]},\"battery\":%d}," \
+	"\"config\":{\"GPS\":{\"enable\":%s}}}}}"
+
+SHADOW_CACHE_DEFINE(cache, 16);
+SHADOW_CACHE_DEFINE(small_cache, 4);
+
+static char patch[512];
+
+static int diff(struct shadow_cache *c, const char *report)
+{
+	return shadow_cache_diff(c, report, strlen(report), patch,
+				 sizeof(patch));
+}
+
+static void assert_patch(struct shadow_cache *c, const char *report,
+			 const char *expected)
+{
+	int len = diff(c, report);
+
+	zassert_equal(len, strlen(expected), "Patch length %d: %s", len,
+		      patch);
+	zassert_equal(strcmp(patch, expected), 0, "Patch: %s", patch);
+}
+
+static int report_print(char *buf, size_t size, int rsrp, int cell,
+			int battery, bool gps)
+{
+	return snprintf(buf, size, REPORT_FMT, rsrp, 2300, cell, battery,
+			gps ? "true" : "false");
+}
+
+static void test_first_report(void)
+{
+	const char *report = "{\"state\":{\"reported\":{\"a\":1,\"b\":\"x\"}}}";
+
+	shadow_cache_invalidate(&cache);
+
+	/* Nothing acknowledged yet, the report is complete */
+	assert_patch(&cache, report, report);
+
+	/* Not acknowledged, so the values are still sent */
+	assert_patch(&cache, report, report);
+
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+	assert_patch(&cache, report, "");
+}
+
+static void test_changed_value(void)
+{
+	shadow_cache_invalidate(&cache);
+
+	(void)diff(&cache, "{\"state\":{\"reported\":{\"a\":1,\"b\":\"x\","
+			   "\"c\":{\"d\":true,\"e\":null}}}}");
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+
+	assert_patch(&cache, "{\"state\":{\"reported\":{\"a\":2,\"b\":\"x\","
+			     "\"c\":{\"d\":true,\"e\":null}}}}",
+		     "{\"state\":{\"reported\":{\"a\":2}}}");
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+
+	/* Only the changed member of a nested object */
+	assert_patch(&cache, "{\"state\":{\"reported\":{\"a\":2,\"b\":\"x\","
+			     "\"c\":{\"d\":false,\"e\":null}}}}",
+		     "{\"state\":{\"reported\":{\"c\":{\"d\":false}}}}");
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+
+	/* A string and a number with the same text differ */
+	assert_patch(&cache, "{\"state\":{\"reported\":{\"a\":\"2\",\"b\":\"x\","
+			     "\"c\":{\"d\":false,\"e\":null}}}}",
+		     "{\"state\":{\"reported\":{\"a\":\"2\"}}}");
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+
+	/* New values are sent, values left out are not */
+	assert_patch(&cache, "{\"state\":{\"reported\":{\"a\":\"2\",\"f\":[]}}}",
+		     "{\"state\":{\"reported\":{\"f\":[]}}}");
+}
+
+static void test_in_flight(void)
+{
+	const char *acked = "{\"state\":{\"reported\":{\"a\":1,\"b\":1}}}";
+
+	shadow_cache_invalidate(&cache);
+	(void)diff(&cache, acked);
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+
+	assert_patch(&cache, "{\"state\":{\"reported\":{\"a\":2,\"b\":1}}}",
+		     "{\"state\":{\"reported\":{\"a\":2}}}");
+
+	/* Before the first update is acknowledged, b changes as well. The
+	 * unacknowledged value of a is sent again.
+	 */
+	assert_patch(&cache, "{\"state\":{\"reported\":{\"a\":2,\"b\":2}}}",
+		     "{\"state\":{\"reported\":{\"a\":2,\"b\":2}}}");
+
+	/* a changes back to the acknowledged value, which must be sent to
+	 * undo the update in flight.
+	 */
+	assert_patch(&cache, acked, "{\"state\":{\"reported\":{\"a\":1,\"b\":1}}}");
+
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+	assert_patch(&cache, acked, "");
+}
+
+static void test_array(void)
+{
+	shadow_cache_invalidate(&cache);
+	(void)diff(&cache, "{\"ui\":[\"GPS\",\"FLIP\"],\"n\":{}}");
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+
+	assert_patch(&cache, "{\"ui\":[\"GPS\",\"FLIP\"],\"n\":{}}", "");
+
+	/* Arrays are sent as a whole */
+	assert_patch(&cache, "{\"ui\":[\"GPS\",\"TEMP\"],\"n\":{}}",
+		     "{\"ui\":[\"GPS\",\"TEMP\"]}");
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+
+	/* An empty object is a value */
+	assert_patch(&cache, "{\"ui\":[\"GPS\",\"TEMP\"],\"n\":{\"x\":1}}",
+		     "{\"n\":{\"x\":1}}");
+}
+
+static void test_invalidate(void)
+{
+	const char *report = "{\"state\":{\"reported\":{\"a\":1}}}";
+
+	shadow_cache_invalidate(&cache);
+	(void)diff(&cache, report);
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+	assert_patch(&cache, report, "");
+
+	/* After a reconnect */
+	shadow_cache_invalidate(&cache);
+	assert_patch(&cache, report, report);
+
+	/* A late acknowledgment of an update sent before the reconnect */
+	shadow_cache_invalidate(&cache);
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+	assert_patch(&cache, report, report);
+}
+
+static void test_version(void)
+{
+	const char *report = "{\"state\":{\"reported\":{\"a\":1}}}";
+
+	shadow_cache_invalidate(&cache);
+	(void)diff(&cache, report);
+	zassert_equal(shadow_cache_ack(&cache, 10), 0, NULL);
+
+	/* A delta increases the version by one */
+	zassert_equal(shadow_cache_version_check(&cache, 11), 0, NULL);
+	zassert_equal(shadow_cache_version_check(&cache, 11), 0, NULL);
+	assert_patch(&cache, report, "");
+
+	/* Acknowledgments without a version count the update */
+	zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+	zassert_equal(shadow_cache_version_check(&cache, 13), 0, NULL);
+	assert_patch(&cache, report, "");
+
+	/* Updated elsewhere in between */
+	zassert_equal(shadow_cache_version_check(&cache, 15), -ESTALE, NULL);
+	assert_patch(&cache, report, report);
+	zassert_equal(shadow_cache_ack(&cache, 16), 0, NULL);
+	assert_patch(&cache, report, "");
+
+	(void)diff(&cache, "{\"state\":{\"reported\":{\"a\":2}}}");
+	zassert_equal(shadow_cache_ack(&cache, 18), -ESTALE, NULL);
+	assert_patch(&cache, report, report);
+}
+
+static void test_overflow(void)
+{
+	const char *report = "{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5}";
+
+	shadow_cache_invalidate(&small_cache);
+
+	/* More values than fields, every report is complete */
+	for (int i = 0; i < 3; i++) {
+		assert_patch(&small_cache, report, report);
+		zassert_equal(shadow_cache_ack(&small_cache, 0), 0, NULL);
+	}
+
+	/* Once the report fits, it is tracked again */
+	(void)diff(&small_cache, "{\"a\":1,\"b\":2}");
+	zassert_equal(shadow_cache_ack(&small_cache, 0), 0, NULL);
+	assert_patch(&small_cache, "{\"a\":1,\"b\":2}", "");
+}
+
+static void test_errors(void)
+{
+	char small[8];
+
+	shadow_cache_invalidate(&cache);
+
+	zassert_equal(diff(&cache, "{\"a\":"), -EINVAL, NULL);
+	zassert_equal(diff(&cache, "[1,2]"), -EINVAL, NULL);
+	zassert_equal(diff(&cache, "\"a\""), -EINVAL, NULL);
+
+	zassert_equal(shadow_cache_diff(&cache, "{\"abc\":123}", 11, small,
+					sizeof(small)),
+		      -ENOBUFS, NULL);
+
+	/* Nothing was marked as sent */
+	zassert_equal(cache.count, 0, NULL);
+}
+
+/* Sequence of device status reports like the asset tracker sends, with the
+ * signal strength, the battery and, at times, the cell or the
+ * configuration changing.
+ */
+static void test_sequence(void)
+{
+	char report[512];
+	size_t full_bytes = 0;
+	size_t patch_bytes = 0;
+	int skipped = 0;
+	int len;
+
+	shadow_cache_invalidate(&cache);
+
+	for (int i = 0; i < 20; i++) {
+		int rsrp = -95 - (i % 3);
+		int cell = (i < 10) ? 21679716 : 21679717;
+		int battery = 4200 - (i / 4) * 10;
+		bool gps = (i % 8) < 4;
+
+		len = report_print(report, sizeof(report), rsrp, cell,
+				   battery, gps);
+		zassert_true(len > 0 && len < sizeof(report), NULL);
+		full_bytes += len;
+
+		len = diff(&cache, report);
+		zassert_true(len >= 0, "Diff failed: %d", len);
+		patch_bytes += len;
+		skipped += (len == 0);
+
+		if (i == 0) {
+			zassert_equal(strcmp(patch, report), 0,
+				      "First report not complete");
+		} else if (i == 10) {
+			zassert_true(strstr(patch, "\"cellID\":21679717") != NULL,
+				     "Cell change not sent: %s", patch);
+			zassert_true(strstr(patch, "iccid") == NULL,
+				     "Unchanged value sent: %s", patch);
+		}
+
+		zassert_equal(shadow_cache_ack(&cache, 0), 0, NULL);
+
+		/* A reconnect in the middle of the sequence */
+		if (i == 14) {
+			shadow_cache_invalidate(&cache);
+		}
+	}
+
+	/* The report after the reconnect is complete */
+	zassert_true(patch_bytes < full_bytes / 2,
+		     "%zu of %zu bytes sent", patch_bytes, full_bytes);
+
+	TC_PRINT("%d reports: %zu bytes complete, %zu bytes in patches, "
+		 "%d not sent\n", 20, full_bytes, patch_bytes, skipped);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(shadow_cache,
+			 ztest_unit_test(test_first_report),
+			 ztest_unit_test(test_changed_value),
+			 ztest_unit_test(test_in_flight),
+			 ztest_unit_test(test_array),
+			 ztest_unit_test(test_invalidate),
+			 ztest_unit_test(test_version),
+			 ztest_unit_test(test_overflow),
+			 ztest_unit_test(test_errors),
+			 ztest_unit_test(test_sequence)
+			 );
+
+	ztest_run_test_suite(shadow_cache);
+}